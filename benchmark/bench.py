@@ -3,7 +3,7 @@
 DocDB Performance Benchmark
 ============================
 Measures latency (per-operation) and throughput (ops/sec) for:
-  1. INSERT   — bulk document insertion
+  1. INSERT   — bulk document insertion, one per request and by insertMany
   2. FIND     — full-collection scan
   3. FIND+F   — filtered find (equality match)
   4. UPDATE   — filtered update
@@ -11,6 +11,8 @@ Measures latency (per-operation) and throughput (ops/sec) for:
   6. COUNT    — count documents
 
 Results are plotted using matplotlib and saved to benchmark/results/.
+The server's own view of each workload (its stats command: p99 by command
+and by subsystem) is saved beside them in server_metrics.json.
 """
 
 import time
@@ -23,7 +25,7 @@ import statistics
 
 # Allow running from the benchmark directory
 sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
-from client import DocDBClient
+from client import DocDBClient, DocDBBinaryClient
 
 # ============================================================================
 # Configuration
@@ -37,6 +39,7 @@ RESULTS_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "results"
 # Workload sizes for scaling tests
 WORKLOAD_SIZES = [100, 500, 1000, 2000, 5000]
 FIND_ITERATIONS = 50  # Number of find operations per workload
+INSERT_BATCH = 500    # Documents per insertMany request
 
 
 def random_name(length=8):
@@ -69,19 +72,51 @@ def benchmark_operation(db, name, op_func, iterations=1):
     return latencies
 
 
+def histogram_p99(before, after):
+    """p99 in µs of the samples between two stats snapshots of one histogram
+    (the bound of the power-of-two bucket holding it), None if there were none."""
+    old = (before or {}).get("buckets", [])
+    new = after.get("buckets", [])
+    delta = [n - (old[b] if b < len(old) else 0) for b, n in enumerate(new)]
+    count = sum(delta)
+    if count == 0:
+        return None
+    rank, seen = max(1, round(0.99 * count)), 0
+    for b, n in enumerate(delta):
+        seen += n
+        if seen >= rank:
+            return 0 if b == 0 else (1 << b) - 1
+    return None
+
+
+def server_p99(before, after):
+    """Per-command and per-subsystem server p99s (µs) between two snapshots."""
+    result = {}
+    for section in ("commands", "latency"):
+        result[section] = {}
+        for name, hist in after.get(section, {}).items():
+            p99 = histogram_p99(before.get(section, {}).get(name), hist)
+            if p99 is not None:
+                result[section][name] = p99
+    return result
+
+
 def run_benchmarks():
     os.makedirs(RESULTS_DIR, exist_ok=True)
 
     all_results = {
         "insert": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
+        "insert_many": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
         "find_all": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
+        "find_all_bson": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
         "find_filter": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
         "count": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
         "update": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
         "delete": {"sizes": [], "avg_latency_ms": [], "p99_latency_ms": [], "throughput_ops": []},
     }
+    server_metrics = {}  # Workload size -> server_p99() over it
 
-    with DocDBClient(HOST, PORT) as db:
+    with DocDBClient(HOST, PORT) as db, DocDBBinaryClient(HOST, PORT) as bdb:
         print("=" * 60)
         print("  DocDB Performance Benchmark")
         print("=" * 60)
@@ -98,6 +133,7 @@ def run_benchmarks():
             # Clean up
             db.drop_collection(COLLECTION)
             db.create_collection(COLLECTION)
+            stats_before = db.stats()
 
             # ---- 1. INSERT benchmark ----
             print(f"  INSERT x{size}...", end=" ", flush=True)
@@ -121,6 +157,31 @@ def run_benchmarks():
             all_results["insert"]["throughput_ops"].append(round(tp_ins, 1))
             print(f"avg={avg_ins:.3f}ms  p99={p99_ins:.3f}ms  throughput={tp_ins:.0f} ops/s")
 
+            # ---- 1b. INSERT_MANY benchmark (same documents, own collection) ----
+            bulk = COLLECTION + "_bulk"
+            print(f"  INSERT_MANY x{size} (batches of {INSERT_BATCH})...", end=" ", flush=True)
+            db.drop_collection(bulk)
+            db.create_collection(bulk)
+            batch_latencies = []
+            start_total = time.perf_counter()
+            for i in range(0, size, INSERT_BATCH):
+                start = time.perf_counter()
+                db.insert_many(bulk, docs[i:i + INSERT_BATCH])
+                end = time.perf_counter()
+                batch_latencies.append((end - start) * 1000)
+            total_bulk = time.perf_counter() - start_total
+            db.drop_collection(bulk)
+
+            avg_bulk = statistics.mean(batch_latencies)
+            p99_bulk = sorted(batch_latencies)[int(len(batch_latencies) * 0.99)]
+            tp_bulk = size / total_bulk
+
+            all_results["insert_many"]["sizes"].append(size)
+            all_results["insert_many"]["avg_latency_ms"].append(round(avg_bulk, 3))
+            all_results["insert_many"]["p99_latency_ms"].append(round(p99_bulk, 3))
+            all_results["insert_many"]["throughput_ops"].append(round(tp_bulk, 1))
+            print(f"avg={avg_bulk:.3f}ms/batch  p99={p99_bulk:.3f}ms  throughput={tp_bulk:.0f} docs/s")
+
             # ---- 2. FIND ALL benchmark ----
             print(f"  FIND_ALL x{FIND_ITERATIONS}...", end=" ", flush=True)
             find_latencies = benchmark_operation(
@@ -138,6 +199,23 @@ def run_benchmarks():
             all_results["find_all"]["throughput_ops"].append(round(tp_find, 1))
             print(f"avg={avg_find:.3f}ms  p99={p99_find:.3f}ms  throughput={tp_find:.0f} ops/s")
 
+            # ---- 2b. FIND ALL over the binary protocol ----
+            print(f"  FIND_ALL (bson) x{FIND_ITERATIONS}...", end=" ", flush=True)
+            bson_latencies = benchmark_operation(
+                bdb, "find_all_bson",
+                lambda: bdb.find(COLLECTION),
+                FIND_ITERATIONS,
+            )
+            avg_fb = statistics.mean(bson_latencies)
+            p99_fb = sorted(bson_latencies)[int(len(bson_latencies) * 0.99)]
+            tp_fb = FIND_ITERATIONS / (sum(bson_latencies) / 1000)
+
+            all_results["find_all_bson"]["sizes"].append(size)
+            all_results["find_all_bson"]["avg_latency_ms"].append(round(avg_fb, 3))
+            all_results["find_all_bson"]["p99_latency_ms"].append(round(p99_fb, 3))
+            all_results["find_all_bson"]["throughput_ops"].append(round(tp_fb, 1))
+            print(f"avg={avg_fb:.3f}ms  p99={p99_fb:.3f}ms  throughput={tp_fb:.0f} ops/s")
+
             # ---- 3. FIND FILTERED benchmark ----
             print(f"  FIND_FILTER x{FIND_ITERATIONS}...", end=" ", flush=True)
             filter_latencies = benchmark_operation(
@@ -215,6 +293,10 @@ def run_benchmarks():
             all_results["delete"]["throughput_ops"].append(round(tp_del, 1))
             print(f"avg={avg_del:.3f}ms  p99={p99_del:.3f}ms  throughput={tp_del:.0f} ops/s")
 
+            server_metrics[size] = server_p99(stats_before, db.stats())
+            print("  server p99 (us): " + "  ".join(
+                f"{name}={us}" for name, us in sorted(server_metrics[size]["commands"].items())))
+
         # Cleanup
         db.drop_collection(COLLECTION)
 
@@ -223,6 +305,8 @@ def run_benchmarks():
     with open(results_path, "w") as f:
         json.dump(all_results, f, indent=2)
     print(f"\nResults saved to {results_path}")
+    with open(os.path.join(RESULTS_DIR, "server_metrics.json"), "w") as f:
+        json.dump(server_metrics, f, indent=2)
 
     return all_results
 
@@ -246,7 +330,9 @@ def plot_results(results):
     plt.style.use("dark_background")
     colors = {
         "insert": "#00d4aa",
+        "insert_many": "#69f0ae",
         "find_all": "#4fc3f7",
+        "find_all_bson": "#40c4ff",
         "find_filter": "#7c4dff",
         "count": "#ffab40",
         "update": "#ff5252",
@@ -254,7 +340,9 @@ def plot_results(results):
     }
     labels = {
         "insert": "INSERT",
+        "insert_many": "INSERT_MANY",
         "find_all": "FIND (all)",
+        "find_all_bson": "FIND (all, BSON)",
         "find_filter": "FIND (filtered)",
         "count": "COUNT",
         "update": "UPDATE",
@@ -1,6 +1,7 @@
 """
 DocDB Python Client — communicates with the DocDB server via TCP sockets
-using the length-prefixed JSON wire protocol.
+using the length-prefixed JSON wire protocol, or (DocDBBinaryClient) the
+binary protocol that carries the same messages as BSON.
 """
 
 import socket
@@ -29,19 +30,36 @@ class DocDBClient:
             self.sock.close()
             self.sock = None
 
+    def _encode(self, request: dict) -> bytes:
+        return json.dumps(request).encode("utf-8")
+
+    def _decode(self, payload: bytes) -> dict:
+        return json.loads(payload.decode("utf-8"))
+
     def _send(self, request: dict) -> dict:
         """Send a request and receive a response."""
-        payload = json.dumps(request).encode("utf-8")
+        payload = self._encode(request)
         header = struct.pack("!I", len(payload))
         self.sock.sendall(header + payload)
+        return self._recv_response()
+
+    def pipeline(self, requests: list) -> list:
+        """Send many requests in one write, then read their responses (in order)."""
+        frames = []
+        for request in requests:
+            payload = self._encode(request)
+            frames.append(struct.pack("!I", len(payload)) + payload)
+        self.sock.sendall(b"".join(frames))
+        return [self._recv_response() for _ in requests]
 
+    def _recv_response(self) -> dict:
         # Read 4-byte response header
         resp_header = self._recv_exact(4)
         resp_len = struct.unpack("!I", resp_header)[0]
 
         # Read response body
         resp_body = self._recv_exact(resp_len)
-        return json.loads(resp_body.decode("utf-8"))
+        return self._decode(resp_body)
 
     def _recv_exact(self, n: int) -> bytes:
         """Read exactly n bytes from socket."""
@@ -59,12 +77,20 @@ class DocDBClient:
         resp = self._send({"cmd": "ping"})
         return resp.get("result", "error")
 
+    def stats(self) -> dict:
+        """Server counters and latency histograms (see the stats command)."""
+        resp = self._send({"cmd": "stats"})
+        return resp.get("result", {})
+
     def list_collections(self) -> list:
         resp = self._send({"cmd": "listCollections"})
         return resp.get("result", [])
 
-    def create_collection(self, name: str) -> bool:
-        resp = self._send({"cmd": "createCollection", "name": name})
+    def create_collection(self, name: str, compressed: bool = False) -> bool:
+        req = {"cmd": "createCollection", "name": name}
+        if compressed:
+            req["compressed"] = True
+        resp = self._send(req)
         return resp.get("ok", False)
 
     def drop_collection(self, name: str) -> bool:
@@ -79,15 +105,50 @@ class DocDBClient:
         })
         return resp
 
-    def find(self, collection: str, filter_doc: dict = None) -> list:
+    def insert_many(self, collection: str, documents: list) -> int:
+        resp = self._send({
+            "cmd": "insertMany",
+            "collection": collection,
+            "documents": documents,
+        })
+        return resp.get("inserted", 0)
+
+    def find(self, collection: str, filter_doc: dict = None, projection: dict = None,
+             skip: int = 0, limit: int = 0, batch_size: int = 0) -> list:
+        """Every matching document: the server's batches, followed to the end."""
+        return [doc for batch in self.find_batches(collection, filter_doc, projection, skip, limit, batch_size)
+                for doc in batch]
+
+    def find_batches(self, collection: str, filter_doc: dict = None, projection: dict = None,
+                     skip: int = 0, limit: int = 0, batch_size: int = 0):
+        """Yield the results a batch at a time (find, then getMore on its cursor).
+        A cursor left unfinished is closed when the generator is."""
         req = {"cmd": "find", "collection": collection}
+        for key, value in (("filter", filter_doc), ("projection", projection), ("skip", skip),
+                           ("limit", limit), ("batchSize", batch_size)):
+            if value:
+                req[key] = value
+        resp = self._send(req)
+        cursor = resp.get("cursor", 0)
+        try:
+            while True:
+                yield resp.get("result", [])
+                if not cursor:
+                    return
+                more = {"cmd": "getMore", "cursor": cursor}
+                if batch_size:
+                    more["batchSize"] = batch_size
+                resp = self._send(more)
+                cursor = resp.get("cursor", 0)
+        finally:
+            if cursor:
+                self._send({"cmd": "killCursors", "cursors": [cursor]})
+
+    def count(self, collection: str, filter_doc: dict = None) -> int:
+        req = {"cmd": "count", "collection": collection}
         if filter_doc:
             req["filter"] = filter_doc
         resp = self._send(req)
-        return resp.get("result", [])
-
-    def count(self, collection: str) -> int:
-        resp = self._send({"cmd": "count", "collection": collection})
         return resp.get("count", 0)
 
     def delete(self, collection: str, filter_doc: dict) -> int:
@@ -115,9 +176,111 @@ class DocDBClient:
         })
         return resp.get("ok", False)
 
+    def explain(self, collection: str, filter_doc: dict = None) -> dict:
+        """The chosen plan ('plan', 'rows', 'cost') and every 'candidates' entry."""
+        req = {"cmd": "explain", "collection": collection}
+        if filter_doc:
+            req["filter"] = filter_doc
+        return self._send(req)
+
+    def analyze(self, collection: str) -> dict:
+        """Refresh planner statistics; returns the row, page and index counts."""
+        return self._send({"cmd": "analyze", "collection": collection})
+
     def __enter__(self):
         self.connect()
         return self
 
     def __exit__(self, *args):
         self.close()
+
+
+# ---- BSON (the subset the server speaks) ----
+
+def bson_encode(doc: dict) -> bytes:
+    body = b"".join(_bson_element(str(k), v) for k, v in doc.items())
+    return struct.pack("<i", len(body) + 5) + body + b"\x00"
+
+
+def _bson_element(key: str, value) -> bytes:
+    name = key.encode("utf-8") + b"\x00"
+    if isinstance(value, bool):
+        return b"\x08" + name + (b"\x01" if value else b"\x00")
+    if isinstance(value, int):
+        if -2**31 <= value < 2**31:
+            return b"\x10" + name + struct.pack("<i", value)
+        return b"\x12" + name + struct.pack("<q", value)
+    if isinstance(value, float):
+        return b"\x01" + name + struct.pack("<d", value)
+    if isinstance(value, str):
+        data = value.encode("utf-8") + b"\x00"
+        return b"\x02" + name + struct.pack("<i", len(data)) + data
+    if isinstance(value, dict):
+        return b"\x03" + name + bson_encode(value)
+    if isinstance(value, (list, tuple)):
+        return b"\x04" + name + bson_encode({str(i): v for i, v in enumerate(value)})
+    if value is None:
+        return b"\x0a" + name
+    raise TypeError(f"cannot encode {type(value).__name__} as BSON")
+
+
+def bson_decode(data: bytes, offset: int = 0, as_list: bool = False):
+    end = offset + struct.unpack_from("<i", data, offset)[0] - 1
+    pos = offset + 4
+    out = {}
+    while pos < end:
+        kind = data[pos]
+        key_end = data.index(b"\x00", pos + 1)
+        key = data[pos + 1:key_end].decode("utf-8")
+        pos = key_end + 1
+        if kind == 0x01:
+            out[key] = struct.unpack_from("<d", data, pos)[0]
+            pos += 8
+        elif kind == 0x02:
+            n = struct.unpack_from("<i", data, pos)[0]
+            out[key] = data[pos + 4:pos + 3 + n].decode("utf-8")
+            pos += 4 + n
+        elif kind in (0x03, 0x04):
+            out[key] = bson_decode(data, pos, kind == 0x04)
+            pos += struct.unpack_from("<i", data, pos)[0]
+        elif kind == 0x08:
+            out[key] = data[pos] == 1
+            pos += 1
+        elif kind == 0x0A:
+            out[key] = None
+        elif kind == 0x10:
+            out[key] = struct.unpack_from("<i", data, pos)[0]
+            pos += 4
+        elif kind == 0x12:
+            out[key] = struct.unpack_from("<q", data, pos)[0]
+            pos += 8
+        else:
+            raise ValueError(f"unknown BSON type 0x{kind:02x}")
+    return list(out.values()) if as_list else out
+
+
+class DocDBBinaryClient(DocDBClient):
+    """Same API over the binary protocol: requests and responses are BSON,
+    and find results arrive as the server stored them."""
+
+    def connect(self):
+        super().connect()
+        resp = self._send({"cmd": "hello", "protocol": "bson"})  # Still JSON
+        if not resp.get("ok"):
+            raise ConnectionError(resp.get("error", "binary protocol refused"))
+        self._binary = True
+
+    def _encode(self, request: dict) -> bytes:
+        if not getattr(self, "_binary", False):
+            return super()._encode(request)
+        return bson_encode(request)
+
+    def _decode(self, payload: bytes) -> dict:
+        if not getattr(self, "_binary", False):
+            return super()._decode(payload)
+        return bson_decode(payload)
+
+    def list_collections(self) -> list:
+        # Small replies arrive as re-encoded JSON, arrays as "0", "1", ... documents
+        result = super().list_collections()
+        return list(result.values()) if isinstance(result, dict) else result
@@ -149,6 +149,7 @@ def main():
   {C}show collections{X}           — List all collections
   {C}use <name>{X}                 — Switch to (or create) a collection
   {C}db.insert({{...}}){X}           — Insert a JSON document
+  {C}db.insertMany([{{...}}, ...]){X} — Insert many documents at once
   {C}db.find(){X}                  — Find all documents
   {C}db.find({{...}}){X}             — Find with filter (equality match)
   {C}db.delete({{...}}){X}           — Delete matching documents
@@ -197,6 +198,20 @@ def main():
                 else:
                     print(f"{R}Error: {resp.get('error', 'unknown')}{X}")
 
+            elif line.startswith("db.insertMany("):
+                if not current_collection:
+                    print(f"{R}Error: no collection selected. Use 'use <name>' first.{X}")
+                    continue
+                inner = line[14:]
+                if inner.endswith(")"):
+                    inner = inner[:-1]
+                docs = parse_json_arg(extract_between(inner, "[", "]"))
+                if not docs or not isinstance(docs, list):
+                    print(f"{R}Usage: db.insertMany([{{...}}, {{...}}]){X}")
+                    continue
+                n = db.insert_many(current_collection, docs)
+                print(f"{G}Inserted {n} documents{X}")
+
             elif line in ("db.find()", "db.find({})"):
                 if not current_collection:
                     print(f"{R}Error: no collection selected.{X}")
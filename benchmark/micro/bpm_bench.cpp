@@ -0,0 +1,126 @@
+// ============================================================================
+// bpm_bench — FetchPage/UnpinPage throughput vs. thread count
+//
+// Every thread loops FetchPage(random page) + UnpinPage over a working set
+// that is preloaded into the pool, so the run measures buffer pool latching
+// rather than disk I/O. Runs once per shard count so a single-latch pool can
+// be compared against a partitioned one.
+//
+// Usage: bpm_bench [--pool N] [--pages N] [--ops N] [--threads N] [--shards a,b,...]
+//                  [--policy lru|lru_k|clock]
+// ============================================================================
+
+#include "storage_engine/buffer/buffer_pool.h"
+#include "storage_engine/disk_manager/disk_manager.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+struct BenchOptions {
+    size_t pool_size = 1024;
+    size_t num_pages = 512;          // Working set; <= pool_size keeps every fetch a hit
+    size_t ops_per_thread = 500000;
+    size_t max_threads = 2 * std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> shard_counts = {1, 8};
+    ReplacerPolicy policy = ReplacerPolicy::LRU;
+};
+
+static std::vector<size_t> ParseList(const char* arg) {
+    std::vector<size_t> out;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(std::strtoul(item.c_str(), nullptr, 10));
+    }
+    return out;
+}
+
+// Returns Mops/s for one (shards, threads) point
+static double RunOnce(const BenchOptions& opt, size_t shards, size_t threads) {
+    DBConfigs config;
+    config.db_file_name = "/tmp/bpm_bench_" + std::to_string(getpid()) + ".db";
+    unlink(config.db_file_name.c_str());
+
+    double mops = 0;
+    {
+        DiskManager disk(config);
+        BufferPoolManager bpm(opt.pool_size, &disk, shards, opt.policy);
+
+        std::vector<page_id_t> pages;
+        for (size_t i = 0; i < opt.num_pages; i++) {
+            page_id_t pid;
+            if (!bpm.NewPage(&pid)) break;
+            bpm.UnpinPage(pid, true);
+            pages.push_back(pid);
+        }
+
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                std::mt19937 rng(static_cast<uint32_t>(t * 7919 + 1));
+                std::uniform_int_distribution<size_t> pick(0, pages.size() - 1);
+                for (size_t i = 0; i < opt.ops_per_thread; i++) {
+                    page_id_t pid = pages[pick(rng)];
+                    if (bpm.FetchPage(pid)) bpm.UnpinPage(pid, false);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mops = (threads * opt.ops_per_thread) / secs / 1e6;
+    }
+
+    unlink(config.db_file_name.c_str());
+    return mops;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (std::strcmp(argv[i], "--pool") == 0) opt.pool_size = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--pages") == 0) opt.num_pages = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--ops") == 0) opt.ops_per_thread = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--threads") == 0) opt.max_threads = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (std::strcmp(argv[i], "--shards") == 0) opt.shard_counts = ParseList(argv[i + 1]);
+        else if (std::strcmp(argv[i], "--policy") == 0) {
+            if (std::strcmp(argv[i + 1], "lru") == 0) opt.policy = ReplacerPolicy::LRU;
+            else if (std::strcmp(argv[i + 1], "lru_k") == 0) opt.policy = ReplacerPolicy::LRU_K;
+            else if (std::strcmp(argv[i + 1], "clock") == 0) opt.policy = ReplacerPolicy::CLOCK;
+            else {
+                std::fprintf(stderr, "unknown policy %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opt.num_pages == 0 || opt.shard_counts.empty()) {
+        std::fprintf(stderr, "--pages and --shards must be non-empty\n");
+        return 1;
+    }
+
+    std::printf("FetchPage+UnpinPage, pool=%zu frames, working set=%zu pages, %zu ops/thread\n",
+                opt.pool_size, opt.num_pages, opt.ops_per_thread);
+    std::printf("%8s %8s %12s %9s\n", "shards", "threads", "Mops/s", "speedup");
+
+    for (size_t shards : opt.shard_counts) {
+        double base = 0;
+        for (size_t threads = 1; threads <= opt.max_threads; threads *= 2) {
+            double mops = RunOnce(opt, shards, threads);
+            if (threads == 1) base = mops;
+            std::printf("%8zu %8zu %12.2f %8.2fx\n", shards, threads, mops, mops / base);
+        }
+    }
+    return 0;
+}
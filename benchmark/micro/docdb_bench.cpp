@@ -0,0 +1,578 @@
+// ============================================================================
+// docdb_bench — in-process microbenchmarks, one suite per storage layer
+//
+//   slotted_page     insert / get / delete cost by record size
+//   bson_serializer  serialize, deserialize and BsonView lookup by field count
+//   buffer_pool      FetchPage+UnpinPage vs. threads, all hits and mostly misses
+//   bptree_<dist>    insert, point search and 100-key range scans by tree size,
+//                    for sequential, reverse, random and string keys
+//   heap_scan        bulk insert and full scans (documents and raw bytes)
+//   filter           Filter over a scan vs. the same filter pushed into it,
+//                    by selectivity
+//
+// Nothing goes over the network or through JSON, so each hot path can be
+// measured on its own. Results are printed as tables and written as JSON
+// in the layout of benchmark/results/*.json: per series, an x axis
+// ("sizes", "threads", ...) and one array per metric.
+//
+// Usage: docdb_bench [--out FILE] [--only suite,...] [--quick] [--threads N]
+//   --out     JSON destination (default micro_benchmark.json)
+//   --only    run the suites whose names start with these (e.g. bptree)
+//   --quick   a tenth of the work, for a smoke run
+// Numbers are only comparable between Release builds
+// (cmake -DCMAKE_BUILD_TYPE=Release).
+// ============================================================================
+
+#include "storage_engine/buffer/buffer_pool.h"
+#include "storage_engine/common/metrics.h"
+#include "storage_engine/disk_manager/disk_manager.h"
+#include "storage_engine/page/slotted_page.h"
+#include "storage_engine/serializer/bson_view.h"
+#include "storage_engine/serializer/serializer.h"
+#include "data_organisation/bptree/bptree.h"
+#include "data_organisation/bptree/index_key.h"
+#include "execution_engine/catalog/catalog.h"
+#include "execution_engine/executor/filter.h"
+#include "execution_engine/executor/seq_scan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+struct BenchOptions {
+    std::string out = "micro_benchmark.json";
+    std::vector<std::string> only;  // Suite name prefixes; empty runs all
+    size_t scale = 10;              // Work multiplier; --quick sets 1
+    size_t max_threads = 2 * std::max(1u, std::thread::hardware_concurrency());
+};
+
+// One series of results: columns[0] is its x axis, the rest its metrics
+struct Series {
+    std::string name;
+    std::vector<std::pair<std::string, std::vector<double>>> columns;
+
+    void Put(const std::string& column, double value) {
+        for (auto& [name, values] : columns) {
+            if (name == column) {
+                values.push_back(value);
+                return;
+            }
+        }
+        columns.push_back({column, {value}});
+    }
+};
+
+// Keeps the optimizer from dropping the measured work
+static volatile uint64_t g_sink = 0;
+
+static double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string TempFile(const char* tag) {
+    return "/tmp/docdb_bench_" + std::string(tag) + "_" + std::to_string(getpid()) + ".db";
+}
+
+static std::vector<std::string> ParseList(const char* arg) {
+    std::vector<std::string> out;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(item);
+    }
+    return out;
+}
+
+static void PrintRow(const Series& series, size_t row) {
+    for (const auto& [name, values] : series.columns) std::printf(" %s=%.3f", name.c_str(), values[row]);
+    std::printf("\n");
+}
+
+// ============================================================================
+// slotted_page — fill a page, read every record, delete them all
+// ============================================================================
+
+static Series BenchSlottedPage(const BenchOptions& opt) {
+    Series series{"slotted_page", {}};
+    const uint16_t page_size = 8192;
+    std::vector<char> page(page_size);
+
+    for (uint16_t record_bytes : {32, 128, 512, 2048}) {
+        std::vector<uint8_t> record(record_bytes, 0xAB);
+        const size_t target = 200000 * opt.scale;
+        size_t ops = 0, per_page = 0;
+        double insert_s = 0, get_s = 0, delete_s = 0;
+
+        while (ops < target) {
+            SlottedPage::Init(page.data(), page_size);
+            auto start = std::chrono::steady_clock::now();
+            int16_t slots = 0;
+            while (SlottedPage::InsertRecord(page.data(), record.data(), record_bytes) >= 0) slots++;
+            insert_s += SecondsSince(start);
+
+            start = std::chrono::steady_clock::now();
+            uint64_t sum = 0;
+            for (int16_t s = 0; s < slots; s++) {
+                uint16_t len;
+                sum += SlottedPage::GetRecord(page.data(), s, &len)[len - 1];
+            }
+            get_s += SecondsSince(start);
+            g_sink = g_sink + sum;
+
+            start = std::chrono::steady_clock::now();
+            for (int16_t s = 0; s < slots; s++) SlottedPage::DeleteRecord(page.data(), s);
+            delete_s += SecondsSince(start);
+
+            per_page = slots;
+            ops += slots;
+        }
+
+        series.Put("record_bytes", record_bytes);
+        series.Put("records_per_page", static_cast<double>(per_page));
+        series.Put("insert_ns", insert_s * 1e9 / ops);
+        series.Put("get_ns", get_s * 1e9 / ops);
+        series.Put("delete_ns", delete_s * 1e9 / ops);
+        PrintRow(series, series.columns[0].second.size() - 1);
+    }
+    return series;
+}
+
+// ============================================================================
+// bson_serializer — one document, over and over
+// ============================================================================
+
+static BsonDocument MakeDocument(size_t num_fields) {
+    BsonDocument doc;
+    for (size_t f = 0; f < num_fields; f++) {
+        std::string key = "field_" + std::to_string(f);
+        switch (f % 4) {
+            case 0: doc.Add(key, int32_t(f * 7)); break;
+            case 1: doc.Add(key, std::string("value of ") + key); break;
+            case 2: doc.Add(key, 1.5 * f); break;
+            default: doc.Add(key, int64_t(f) << 40); break;
+        }
+    }
+    return doc;
+}
+
+static Series BenchSerializer(const BenchOptions& opt) {
+    Series series{"bson_serializer", {}};
+
+    for (size_t num_fields : {4, 16, 64}) {
+        BsonDocument doc = MakeDocument(num_fields);
+        const size_t iterations = 200000 * opt.scale / num_fields;
+        std::vector<uint8_t> bytes;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            BsonSerializer::SerializeTo(doc, &bytes);
+            g_sink = g_sink + bytes.size();
+        }
+        double serialize_s = SecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            BsonDocument back = BsonSerializer::Deserialize(bytes.data(), bytes.size());
+            g_sink = g_sink + back.elements.size();
+        }
+        double deserialize_s = SecondsSince(start);
+
+        // The last field is the worst case for a lookup in place
+        std::string last = "field_" + std::to_string(num_fields - 1);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            BsonView view(bytes.data(), bytes.size());
+            BsonElementView element;
+            g_sink = g_sink + view.Find(last, &element);
+        }
+        double find_s = SecondsSince(start);
+
+        series.Put("fields", static_cast<double>(num_fields));
+        series.Put("doc_bytes", static_cast<double>(bytes.size()));
+        series.Put("serialize_ns", serialize_s * 1e9 / iterations);
+        series.Put("deserialize_ns", deserialize_s * 1e9 / iterations);
+        series.Put("view_find_last_ns", find_s * 1e9 / iterations);
+        series.Put("serialize_mb_s", bytes.size() * iterations / serialize_s / 1e6);
+        PrintRow(series, series.columns[0].second.size() - 1);
+    }
+    return series;
+}
+
+// ============================================================================
+// buffer_pool — random FetchPage+UnpinPage from many threads
+//
+// "hit": the working set fits, so only latching is measured. "miss": four
+// times the pool, so most fetches evict a frame and read the page back
+// (from the OS page cache); the hit ratio comes from Metrics.
+// ============================================================================
+
+struct PoolRun {
+    double mops = 0;
+    double hit_ratio = 0;
+    double evictions_per_op = 0;
+};
+
+static PoolRun RunPool(size_t pool_frames, size_t num_pages, size_t threads, size_t ops_per_thread) {
+    DBConfigs config;
+    config.db_file_name = TempFile("bpm");
+    unlink(config.db_file_name.c_str());
+
+    PoolRun run;
+    {
+        DiskManager disk(config);
+        BufferPoolManager bpm(pool_frames, &disk, 8);
+
+        std::vector<page_id_t> pages;
+        for (size_t i = 0; i < num_pages; i++) {
+            page_id_t pid;
+            if (!bpm.NewPage(&pid)) break;
+            bpm.UnpinPage(pid, true);
+            pages.push_back(pid);
+        }
+        bpm.FlushAllPages();
+
+        MetricsSnapshot before = Metrics::Snapshot();
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                std::mt19937 rng(static_cast<uint32_t>(t * 7919 + 1));
+                std::uniform_int_distribution<size_t> pick(0, pages.size() - 1);
+                for (size_t i = 0; i < ops_per_thread; i++) {
+                    page_id_t pid = pages[pick(rng)];
+                    if (bpm.FetchPage(pid)) bpm.UnpinPage(pid, false);
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        double secs = SecondsSince(start);
+        MetricsSnapshot after = Metrics::Snapshot();
+
+        double ops = static_cast<double>(threads * ops_per_thread);
+        double hits = static_cast<double>(after.Get(Counter::BUFFER_HITS) - before.Get(Counter::BUFFER_HITS));
+        double misses = static_cast<double>(after.Get(Counter::BUFFER_MISSES) - before.Get(Counter::BUFFER_MISSES));
+        run.mops = ops / secs / 1e6;
+        run.hit_ratio = hits + misses > 0 ? hits / (hits + misses) : 0;
+        run.evictions_per_op =
+            static_cast<double>(after.Get(Counter::BUFFER_EVICTIONS) - before.Get(Counter::BUFFER_EVICTIONS)) / ops;
+    }
+    unlink(config.db_file_name.c_str());
+    return run;
+}
+
+static Series BenchBufferPool(const BenchOptions& opt) {
+    Series series{"buffer_pool", {}};
+    const size_t pool_frames = 1024;
+
+    for (size_t threads = 1; threads <= opt.max_threads; threads *= 2) {
+        PoolRun hit = RunPool(pool_frames, pool_frames / 2, threads, 50000 * opt.scale);
+        PoolRun miss = RunPool(pool_frames, pool_frames * 4, threads, 5000 * opt.scale);
+
+        series.Put("threads", static_cast<double>(threads));
+        series.Put("hit_mops", hit.mops);
+        series.Put("miss_mops", miss.mops);
+        series.Put("miss_hit_ratio", miss.hit_ratio);
+        series.Put("miss_evictions_per_op", miss.evictions_per_op);
+        PrintRow(series, series.columns[0].second.size() - 1);
+    }
+    return series;
+}
+
+// ============================================================================
+// bptree_<dist> — build a tree by single inserts, then probe it
+// ============================================================================
+
+static std::vector<std::string> MakeKeys(const std::string& dist, size_t n) {
+    std::vector<std::string> keys(n);
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < n; i++) {
+        if (dist == "string") {
+            std::string s(24, ' ');
+            for (char& c : s) c = static_cast<char>('a' + rng() % 26);
+            IndexKey::Encode(BsonValue(s), &keys[i]);
+        } else {
+            int64_t value = dist == "reverse" ? static_cast<int64_t>(n - i) : static_cast<int64_t>(i);
+            IndexKey::Encode(BsonValue(value), &keys[i]);
+        }
+    }
+    if (dist == "random") std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+static Series BenchBPlusTree(const BenchOptions& opt, const std::string& dist) {
+    Series series{"bptree_" + dist, {}};
+    const size_t range_len = 100;
+
+    for (size_t n : {10000 * opt.scale / 10, 100000 * opt.scale / 10, 1000000 * opt.scale / 10}) {
+        std::vector<std::string> keys = MakeKeys(dist, n);
+        DBConfigs config;
+        config.db_file_name = TempFile("bptree");
+        unlink(config.db_file_name.c_str());
+
+        {
+            DiskManager disk(config);
+            BufferPoolManager bpm(65536, &disk, 8);  // The whole tree stays resident
+            page_id_t root;
+            Page* root_page = bpm.NewPage(&root);
+            BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+            bpm.UnpinPage(root, true);
+            BPlusTree tree(&bpm, root);
+
+            MetricsSnapshot before = Metrics::Snapshot();
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < n; i++) {
+                tree.Insert(keys[i], RecordID{static_cast<page_id_t>(i / 64 + 1), static_cast<uint16_t>(i % 64)});
+            }
+            double insert_s = SecondsSince(start);
+            uint64_t splits = Metrics::Snapshot().Get(Counter::BTREE_SPLITS) - before.Get(Counter::BTREE_SPLITS);
+
+            std::mt19937 rng(7);
+            std::uniform_int_distribution<size_t> pick(0, n - 1);
+            const size_t searches = std::min<size_t>(n, 100000 * opt.scale / 10);
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < searches; i++) {
+                g_sink = g_sink + tree.Search(keys[pick(rng)]).slot_id;
+            }
+            double search_s = SecondsSince(start);
+
+            std::sort(keys.begin(), keys.end());
+            std::uniform_int_distribution<size_t> pick_start(0, n - range_len);
+            const size_t ranges = std::min<size_t>(n / 10, 10000 * opt.scale / 10);
+            size_t scanned = 0;
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < ranges; i++) {
+                size_t lo = pick_start(rng);
+                BPlusTree::Iterator it(&tree, keys[lo], keys[lo + range_len - 1]);
+                RecordID rid;
+                while (it.Next(nullptr, &rid)) scanned++;
+            }
+            double range_s = SecondsSince(start);
+            g_sink = g_sink + scanned;
+
+            series.Put("sizes", static_cast<double>(n));
+            series.Put("insert_kops", n / insert_s / 1e3);
+            series.Put("search_kops", searches / search_s / 1e3);
+            series.Put("range_mkeys_s", scanned / range_s / 1e6);
+            series.Put("splits", static_cast<double>(splits));
+        }
+        unlink(config.db_file_name.c_str());
+        PrintRow(series, series.columns[0].second.size() - 1);
+    }
+    return series;
+}
+
+// ============================================================================
+// heap_scan / filter — one collection in a Catalog, as the server has it
+// ============================================================================
+
+// A catalog over a fresh file, its one collection filled with n documents
+struct ScanFixture {
+    DBConfigs config;
+    std::unique_ptr<DiskManager> disk;
+    std::unique_ptr<BufferPoolManager> bpm;
+    std::unique_ptr<Catalog> catalog;
+    CollectionInfo* coll = nullptr;
+    double insert_s = 0;
+
+    explicit ScanFixture(size_t n) {
+        config.db_file_name = TempFile("scan");
+        unlink(config.db_file_name.c_str());
+        disk = std::make_unique<DiskManager>(config);
+        bpm = std::make_unique<BufferPoolManager>(65536, disk.get(), 8);
+        page_id_t header;
+        bpm->NewPage(&header);  // Page 0 is the catalog's
+        bpm->UnpinPage(header, true);
+        catalog = std::make_unique<Catalog>(bpm.get());
+        catalog->CreateCollection("bench");
+        coll = catalog->GetCollection("bench");
+
+        std::vector<BsonDocument> batch;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++) {
+            BsonDocument doc;
+            doc.Add("id", int64_t(i));
+            doc.Add("bucket", int32_t(i % 100));
+            doc.Add("name", "user_" + std::to_string(i));
+            doc.Add("score", 0.5 * static_cast<double>(i % 1000));
+            batch.push_back(std::move(doc));
+            if (batch.size() == 1000 || i + 1 == n) {
+                coll->heap_file->InsertRecords(batch);
+                batch.clear();
+            }
+        }
+        insert_s = SecondsSince(start);
+    }
+
+    ~ScanFixture() {
+        catalog.reset();
+        bpm.reset();
+        disk.reset();
+        unlink(config.db_file_name.c_str());
+    }
+};
+
+// Rows out of a plan, pulled a batch at a time
+static size_t Drain(Executor* plan) {
+    TupleBatch batch;
+    size_t rows = 0;
+    plan->Init();
+    while (plan->NextBatch(&batch)) rows += batch.Size();
+    plan->Close();
+    return rows;
+}
+
+static Series BenchHeapScan(const BenchOptions& opt) {
+    Series series{"heap_scan", {}};
+
+    for (size_t n : {10000 * opt.scale / 10, 100000 * opt.scale / 10}) {
+        ScanFixture fixture(n);
+        const size_t passes = std::max<size_t>(1, 1000000 * opt.scale / 10 / n);
+
+        double doc_s = 0, bytes_s = 0;
+        for (size_t p = 0; p < passes; p++) {
+            SeqScanExecutor docs(fixture.coll->heap_file.get());
+            auto start = std::chrono::steady_clock::now();
+            g_sink = g_sink + Drain(&docs);
+            doc_s += SecondsSince(start);
+
+            SeqScanExecutor bytes(fixture.coll->heap_file.get());
+            bytes.SetRowFormat(RowFormat::BYTES);
+            start = std::chrono::steady_clock::now();
+            g_sink = g_sink + Drain(&bytes);
+            bytes_s += SecondsSince(start);
+        }
+
+        series.Put("sizes", static_cast<double>(n));
+        series.Put("insert_kdocs_s", n / fixture.insert_s / 1e3);
+        series.Put("scan_docs_mrows_s", n * passes / doc_s / 1e6);
+        series.Put("scan_bytes_mrows_s", n * passes / bytes_s / 1e6);
+        PrintRow(series, series.columns[0].second.size() - 1);
+    }
+    return series;
+}
+
+static Series BenchFilter(const BenchOptions& opt) {
+    Series series{"filter", {}};
+    const size_t n = 100000 * opt.scale / 10;
+    ScanFixture fixture(n);
+    const size_t passes = std::max<size_t>(1, 1000000 * opt.scale / 10 / n);
+
+    for (int32_t pct : {1, 10, 50, 100}) {
+        FilterExpr expr = FilterExpr::Compare("bucket", CompareOp::LT, BsonValue(pct));
+        size_t matched = 0;
+        double filter_s = 0, pushed_s = 0;
+        for (size_t p = 0; p < passes; p++) {
+            FilterExecutor filter(std::make_unique<SeqScanExecutor>(fixture.coll->heap_file.get()), expr);
+            auto start = std::chrono::steady_clock::now();
+            matched = Drain(&filter);
+            filter_s += SecondsSince(start);
+
+            SeqScanExecutor pushed(fixture.coll->heap_file.get(), expr);
+            start = std::chrono::steady_clock::now();
+            if (Drain(&pushed) != matched) std::fprintf(stderr, "filter: pushed-down scan disagrees\n");
+            pushed_s += SecondsSince(start);
+        }
+
+        series.Put("selectivity_pct", pct);
+        series.Put("matched", static_cast<double>(matched));
+        series.Put("filter_mrows_s", n * passes / filter_s / 1e6);
+        series.Put("pushdown_mrows_s", n * passes / pushed_s / 1e6);
+        PrintRow(series, series.columns[0].second.size() - 1);
+    }
+    return series;
+}
+
+// ============================================================================
+// JSON output
+// ============================================================================
+
+// Three decimals at most, like the Python benchmarks' round(x, 3)
+static std::string FormatNumber(double v) {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.3f", v);
+    std::string s(buf);
+    s.erase(s.find_last_not_of('0') + 1);
+    if (s.back() == '.') s.pop_back();
+    return s;
+}
+
+static void WriteJSON(const std::vector<Series>& results, std::ostream& out) {
+    out << "{";
+    for (size_t i = 0; i < results.size(); i++) {
+        out << (i ? "," : "") << "\n  \"" << results[i].name << "\": {";
+        const auto& columns = results[i].columns;
+        for (size_t c = 0; c < columns.size(); c++) {
+            out << (c ? "," : "") << "\n    \"" << columns[c].first << "\": [";
+            for (size_t v = 0; v < columns[c].second.size(); v++) {
+                out << (v ? "," : "") << "\n      " << FormatNumber(columns[c].second[v]);
+            }
+            out << "\n    ]";
+        }
+        out << "\n  }";
+    }
+    out << "\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions opt;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--quick") == 0) opt.scale = 1;
+        else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) opt.out = argv[++i];
+        else if (std::strcmp(argv[i], "--only") == 0 && i + 1 < argc) opt.only = ParseList(argv[++i]);
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) opt.max_threads = std::strtoul(argv[++i], nullptr, 10);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (opt.max_threads == 0) {
+        std::fprintf(stderr, "--threads must be at least 1\n");
+        return 1;
+    }
+
+    auto selected = [&opt](const std::string& suite) {
+        if (opt.only.empty()) return true;
+        for (const std::string& prefix : opt.only) {
+            if (suite.compare(0, prefix.size(), prefix) == 0) return true;
+        }
+        return false;
+    };
+
+    std::vector<Series> results;
+    auto run = [&](const std::string& suite, const std::function<Series()>& bench) {
+        if (!selected(suite)) return;
+        std::printf("--- %s ---\n", suite.c_str());
+        std::fflush(stdout);
+        results.push_back(bench());
+    };
+
+    run("slotted_page", [&] { return BenchSlottedPage(opt); });
+    run("bson_serializer", [&] { return BenchSerializer(opt); });
+    run("buffer_pool", [&] { return BenchBufferPool(opt); });
+    for (const char* dist : {"sequential", "reverse", "random", "string"}) {
+        run(std::string("bptree_") + dist, [&] { return BenchBPlusTree(opt, dist); });
+    }
+    run("heap_scan", [&] { return BenchHeapScan(opt); });
+    run("filter", [&] { return BenchFilter(opt); });
+
+    std::ofstream out(opt.out);
+    if (!out) {
+        std::fprintf(stderr, "cannot write %s\n", opt.out.c_str());
+        return 1;
+    }
+    WriteJSON(results, out);
+    std::printf("Results saved to %s\n", opt.out.c_str());
+    return 0;
+}
@@ -1,4 +1,7 @@
 #include "cli.h"
+#include "data_organisation/bptree/index_key.h"
+#include "data_organisation/bptree/entry_sorter.h"
+#include "storage_engine/serializer/json.h"
 #include <iostream>
 #include <algorithm>
 #include <cctype>
@@ -18,13 +21,10 @@
 // Constructor / Destructor
 // ============================================================================
 
-CLI::CLI(const std::string& db_file) : running_(true) {
-    DBConfigs config;
-    config.db_file_name = db_file;
-    config.page_size = 4096;
-
+CLI::CLI(const DBConfigs& config) : running_(true) {
     disk_manager_ = std::make_unique<DiskManager>(config);
-    bpm_ = std::make_unique<BufferPoolManager>(128, disk_manager_.get());
+    bpm_ = std::make_unique<BufferPoolManager>(config.buffer_pool_size, disk_manager_.get(), 1,
+                                               config.replacer_policy, config.scan_ring_frames);
     catalog_ = std::make_unique<Catalog>(bpm_.get());
     lock_manager_ = std::make_unique<LockManager>();
     txn_manager_ = std::make_unique<TransactionManager>(lock_manager_.get());
@@ -35,18 +35,19 @@ CLI::CLI(const std::string& db_file) : running_(true) {
         page_id_t pid;
         Page* p = bpm_->NewPage(&pid);  // pid will be 0
         if (p) {
-            std::memset(p->GetData(), 0, 4096);
+            std::memset(p->GetData(), 0, bpm_->GetPageSize());
             bpm_->UnpinPage(pid, true);
         }
     } else {
         // Existing DB — load catalog from page 0
         catalog_->LoadCatalog();
     }
+    catalog_->SetSaveOnExtent(true);
 }
 
 CLI::~CLI() {
     // Save catalog metadata and flush everything to disk
-    catalog_->SaveCatalog();
+    catalog_->SaveCatalog(/*final=*/true);
     bpm_->FlushAllPages();
 }
 
@@ -78,86 +79,13 @@ std::string CLI::ExtractBetween(const std::string& s, char open, char close) {
 }
 
 // ============================================================================
-// JSON Mini-Parser
+// JSON — Json's parser; blank text is the empty document
 // ============================================================================
 
 BsonDocument CLI::ParseJSON(const std::string& json) {
-    BsonDocument doc;
-    std::string s = Trim(json);
-
-    if (s.empty() || s[0] != '{') return doc;
-
-    // Remove outer braces
-    s = s.substr(1, s.size() - 2);
-    s = Trim(s);
-    if (s.empty()) return doc;
-
-    // Parse key-value pairs
-    size_t pos = 0;
-    while (pos < s.size()) {
-        // Skip whitespace and commas
-        while (pos < s.size() && (s[pos] == ' ' || s[pos] == ',' || s[pos] == '\t' || s[pos] == '\n')) pos++;
-        if (pos >= s.size()) break;
-
-        // Read key (must be quoted)
-        if (s[pos] != '"') break;
-        pos++;
-        size_t key_end = s.find('"', pos);
-        if (key_end == std::string::npos) break;
-        std::string key = s.substr(pos, key_end - pos);
-        pos = key_end + 1;
-
-        // Skip colon
-        while (pos < s.size() && (s[pos] == ' ' || s[pos] == ':')) pos++;
-        if (pos >= s.size()) break;
-
-        // Read value
-        if (s[pos] == '"') {
-            // String value
-            pos++;
-            size_t val_end = s.find('"', pos);
-            if (val_end == std::string::npos) break;
-            std::string val = s.substr(pos, val_end - pos);
-            doc.Add(key, val);
-            pos = val_end + 1;
-        } else if (s[pos] == 't' || s[pos] == 'f') {
-            // Boolean
-            if (s.substr(pos, 4) == "true") {
-                doc.Add(key, true);
-                pos += 4;
-            } else if (s.substr(pos, 5) == "false") {
-                doc.Add(key, false);
-                pos += 5;
-            }
-        } else if (s[pos] == '-' || std::isdigit(s[pos])) {
-            // Number — determine if int or double
-            size_t num_start = pos;
-            bool is_double = false;
-            if (s[pos] == '-') pos++;
-            while (pos < s.size() && (std::isdigit(s[pos]) || s[pos] == '.')) {
-                if (s[pos] == '.') is_double = true;
-                pos++;
-            }
-            std::string num_str = s.substr(num_start, pos - num_start);
-            if (is_double) {
-                doc.Add(key, std::stod(num_str));
-            } else {
-                int64_t val = std::stoll(num_str);
-                if (val >= INT32_MIN && val <= INT32_MAX) {
-                    doc.Add(key, static_cast<int32_t>(val));
-                } else {
-                    doc.Add(key, val);
-                }
-            }
-        } else if (s[pos] == '{') {
-            // Nested document
-            std::string nested = ExtractBetween(s.substr(pos), '{', '}');
-            auto sub_doc = std::make_shared<BsonDocument>(ParseJSON(nested));
-            doc.Add(key, sub_doc);
-            pos += nested.size();
-        }
-    }
-
+    if (Trim(json).empty()) return BsonDocument();
+    BsonDocument doc = Json::ParseDocument(json);
+    if (doc.is_array) throw std::runtime_error("expected a JSON object, not an array");
     return doc;
 }
 
@@ -165,15 +93,18 @@ BsonDocument CLI::ParseJSON(const std::string& json) {
 // Print Document
 // ============================================================================
 
-void CLI::PrintDoc(const BsonDocument& doc) {
-    std::cout << CLR_DIM "{ " CLR_RESET;
+// Fields of doc (elements of an array) on one line, nested ones inline
+static void PrintFields(const BsonDocument& doc) {
+    std::cout << (doc.is_array ? CLR_DIM "[ " CLR_RESET : CLR_DIM "{ " CLR_RESET);
     bool first = true;
     for (const auto& [key, val] : doc.elements) {
         if (!first) std::cout << CLR_DIM ", " CLR_RESET;
         first = false;
-        std::cout << CLR_CYAN "\"" << key << "\"" CLR_RESET << ": ";
+        if (!doc.is_array) std::cout << CLR_CYAN "\"" << key << "\"" CLR_RESET << ": ";
         if (std::holds_alternative<std::string>(val)) {
-            std::cout << CLR_GREEN "\"" << std::get<std::string>(val) << "\"" CLR_RESET;
+            std::string quoted;
+            Json::WriteString(std::get<std::string>(val), &quoted);
+            std::cout << CLR_GREEN << quoted << CLR_RESET;
         } else if (std::holds_alternative<int32_t>(val)) {
             std::cout << CLR_YELLOW << std::get<int32_t>(val) << CLR_RESET;
         } else if (std::holds_alternative<int64_t>(val)) {
@@ -183,12 +114,17 @@ void CLI::PrintDoc(const BsonDocument& doc) {
         } else if (std::holds_alternative<bool>(val)) {
             std::cout << CLR_MAGENTA << (std::get<bool>(val) ? "true" : "false") << CLR_RESET;
         } else if (std::holds_alternative<std::shared_ptr<BsonDocument>>(val)) {
-            PrintDoc(*std::get<std::shared_ptr<BsonDocument>>(val));
+            PrintFields(*std::get<std::shared_ptr<BsonDocument>>(val));
         } else {
             std::cout << "null";
         }
     }
-    std::cout << CLR_DIM " }" CLR_RESET << std::endl;
+    std::cout << (doc.is_array ? CLR_DIM " ]" CLR_RESET : CLR_DIM " }" CLR_RESET);
+}
+
+void CLI::PrintDoc(const BsonDocument& doc) {
+    PrintFields(doc);
+    std::cout << std::endl;
 }
 
 // ============================================================================
@@ -207,6 +143,47 @@ std::vector<Predicate> CLI::ParseFilter(const BsonDocument& filter_doc) {
     return predicates;
 }
 
+// ============================================================================
+// Index maintenance — keep every index of a collection in step with a document
+// ============================================================================
+
+static void IndexDocument(CollectionInfo* coll, const BsonDocument& doc, const RecordID& rid) {
+    for (auto& idx : coll->indexes) {
+        auto it = doc.elements.find(idx.field_name);
+        std::string key;
+        if (it != doc.elements.end() && IndexKey::Encode(it->second, &key)) {
+            idx.btree->Insert(key, rid);
+        }
+    }
+}
+
+// A batch: each index takes its entries in key order
+static void IndexDocuments(CollectionInfo* coll, const std::vector<BsonDocument>& docs,
+                           const std::vector<RecordID>& rids) {
+    for (auto& idx : coll->indexes) {
+        IndexEntrySorter sorter;
+        for (size_t i = 0; i < docs.size(); i++) {
+            auto it = docs[i].elements.find(idx.field_name);
+            std::string key;
+            if (it != docs[i].elements.end() && IndexKey::Encode(it->second, &key)) sorter.Add(key, rids[i]);
+        }
+        sorter.Finish();
+        std::string key;
+        RecordID rid;
+        while (sorter.Next(&key, &rid)) idx.btree->Insert(key, rid);
+    }
+}
+
+static void UnindexDocument(CollectionInfo* coll, const BsonDocument& doc, const RecordID& rid) {
+    for (auto& idx : coll->indexes) {
+        auto it = doc.elements.find(idx.field_name);
+        std::string key;
+        if (it != doc.elements.end() && IndexKey::Encode(it->second, &key)) {
+            idx.btree->Delete(key, rid);
+        }
+    }
+}
+
 // ============================================================================
 // Command Handlers
 // ============================================================================
@@ -249,32 +226,64 @@ void CLI::HandleInsert(const std::string& json_str) {
         return;
     }
 
-    BsonDocument doc = ParseJSON(json_str);
-    if (doc.elements.empty()) {
-        std::cout << CLR_RED "Error: invalid or empty document." CLR_RESET << std::endl;
-        return;
-    }
-
     try {
+        BsonDocument doc = ParseJSON(json_str);
+        if (doc.elements.empty()) {
+            std::cout << CLR_RED "Error: invalid or empty document." CLR_RESET << std::endl;
+            return;
+        }
+
         RecordID rid = coll->heap_file->InsertRecord(doc);
         std::cout << CLR_GREEN "Inserted 1 document " CLR_RESET
                   << CLR_DIM "(page=" << rid.page_id << ", slot=" << rid.slot_id << ")" CLR_RESET << std::endl;
 
-        // Update indexes
-        for (auto& idx : coll->indexes) {
-            auto it = doc.elements.find(idx.field_name);
-            if (it != doc.elements.end()) {
-                std::string key_str;
-                if (std::holds_alternative<std::string>(it->second)) {
-                    key_str = std::get<std::string>(it->second);
-                } else if (std::holds_alternative<int32_t>(it->second)) {
-                    key_str = std::to_string(std::get<int32_t>(it->second));
-                }
-                if (!key_str.empty()) {
-                    idx.btree->Insert(key_str, rid);
-                }
+        IndexDocument(coll, doc, rid);
+    } catch (const std::exception& e) {
+        std::cout << CLR_RED "Error: " << e.what() << CLR_RESET << std::endl;
+    }
+}
+
+void CLI::HandleInsertMany(const std::string& array_str) {
+    if (current_collection_.empty()) {
+        std::cout << CLR_RED "Error: no collection selected. Use 'use <name>' first." CLR_RESET << std::endl;
+        return;
+    }
+
+    CollectionInfo* coll = catalog_->GetCollection(current_collection_);
+    if (!coll) {
+        std::cout << CLR_RED "Error: collection not found." CLR_RESET << std::endl;
+        return;
+    }
+
+    // Each element of the array, in order
+    std::vector<BsonDocument> docs;
+    try {
+        BsonDocument array = Trim(array_str).empty() ? BsonDocument() : Json::ParseDocument(array_str);
+        if (!array.is_array) {
+            std::cout << CLR_RED "Usage: db.insertMany([{...}, {...}])" CLR_RESET << std::endl;
+            return;
+        }
+        for (auto& [key, value] : array.elements) {
+            auto* doc = std::get_if<std::shared_ptr<BsonDocument>>(&value);
+            if (!doc || (*doc)->is_array || (*doc)->elements.empty()) {
+                std::cout << CLR_RED "Error: invalid or empty document." CLR_RESET << std::endl;
+                return;
             }
+            docs.push_back(std::move(**doc));
         }
+    } catch (const std::exception& e) {
+        std::cout << CLR_RED "Error: " << e.what() << CLR_RESET << std::endl;
+        return;
+    }
+    if (docs.empty()) {
+        std::cout << CLR_RED "Usage: db.insertMany([{...}, {...}])" CLR_RESET << std::endl;
+        return;
+    }
+
+    try {
+        std::vector<RecordID> rids = coll->heap_file->InsertRecords(docs);
+        IndexDocuments(coll, docs, rids);
+        std::cout << CLR_GREEN "Inserted " << rids.size() << " documents" CLR_RESET << std::endl;
     } catch (const std::exception& e) {
         std::cout << CLR_RED "Error: " << e.what() << CLR_RESET << std::endl;
     }
@@ -293,35 +302,22 @@ void CLI::HandleFind(const std::string& filter_str) {
     }
 
     try {
-        if (filter_str.empty() || Trim(filter_str) == "{}") {
-            // No filter — full scan
-            SeqScanExecutor scan(coll->heap_file.get());
-            scan.Init();
-            Tuple tuple;
-            int count = 0;
-            while (scan.Next(&tuple)) {
-                PrintDoc(tuple.doc);
-                count++;
-            }
-            scan.Close();
-            std::cout << CLR_DIM "(" << count << " documents)" CLR_RESET << std::endl;
-        } else {
-            // Filtered scan
-            BsonDocument filter_doc = ParseJSON(filter_str);
-            auto predicates = ParseFilter(filter_doc);
-
-            auto child = std::make_unique<SeqScanExecutor>(coll->heap_file.get());
-            FilterExecutor filter(std::move(child), predicates);
-            filter.Init();
-            Tuple tuple;
-            int count = 0;
-            while (filter.Next(&tuple)) {
-                PrintDoc(tuple.doc);
-                count++;
-            }
-            filter.Close();
-            std::cout << CLR_DIM "(" << count << " documents)" CLR_RESET << std::endl;
+        FilterExpr filter;
+        if (!filter_str.empty() && Trim(filter_str) != "{}") {
+            filter = FilterExpr(ParseFilter(ParseJSON(filter_str)));
+        }
+
+        Planner planner(coll, bpm_->GetPageSize());
+        std::unique_ptr<Executor> plan = planner.Build(planner.Choose(filter), filter);
+        plan->Init();
+        Tuple tuple;
+        int count = 0;
+        while (plan->Next(&tuple)) {
+            PrintDoc(tuple.doc);
+            count++;
         }
+        plan->Close();
+        std::cout << CLR_DIM "(" << count << " documents)" CLR_RESET << std::endl;
     } catch (const std::exception& e) {
         std::cout << CLR_RED "Error: " << e.what() << CLR_RESET << std::endl;
     }
@@ -337,25 +333,25 @@ void CLI::HandleDelete(const std::string& filter_str) {
     if (!coll) return;
 
     try {
-        BsonDocument filter_doc = ParseJSON(filter_str);
-        auto predicates = ParseFilter(filter_doc);
+        FilterExpr filter(ParseFilter(ParseJSON(filter_str)));
 
         // Find matching records first
-        auto child = std::make_unique<SeqScanExecutor>(coll->heap_file.get());
-        FilterExecutor filter(std::move(child), predicates);
-        filter.Init();
+        Planner planner(coll, bpm_->GetPageSize());
+        std::unique_ptr<Executor> plan = planner.Build(planner.Choose(filter), filter);
+        plan->Init();
 
-        std::vector<RecordID> to_delete;
+        std::vector<std::pair<RecordID, BsonDocument>> to_delete;
         Tuple tuple;
-        while (filter.Next(&tuple)) {
-            to_delete.push_back(tuple.rid);
+        while (plan->Next(&tuple)) {
+            to_delete.push_back({tuple.rid, tuple.doc});
         }
-        filter.Close();
+        plan->Close();
 
         // Delete them
         int deleted = 0;
-        for (const auto& rid : to_delete) {
+        for (const auto& [rid, doc] : to_delete) {
             if (coll->heap_file->DeleteRecord(rid)) {
+                UnindexDocument(coll, doc, rid);
                 deleted++;
             }
         }
@@ -376,30 +372,31 @@ void CLI::HandleUpdate(const std::string& filter_str, const std::string& update_
     if (!coll) return;
 
     try {
-        BsonDocument filter_doc = ParseJSON(filter_str);
+        FilterExpr filter(ParseFilter(ParseJSON(filter_str)));
         BsonDocument update_doc = ParseJSON(update_str);
-        auto predicates = ParseFilter(filter_doc);
 
         // Find matching records
-        auto child = std::make_unique<SeqScanExecutor>(coll->heap_file.get());
-        FilterExecutor filter(std::move(child), predicates);
-        filter.Init();
+        Planner planner(coll, bpm_->GetPageSize());
+        std::unique_ptr<Executor> plan = planner.Build(planner.Choose(filter), filter);
+        plan->Init();
 
         std::vector<std::pair<RecordID, BsonDocument>> to_update;
         Tuple tuple;
-        while (filter.Next(&tuple)) {
+        while (plan->Next(&tuple)) {
+            to_update.push_back({tuple.rid, tuple.doc});
+        }
+        plan->Close();
+
+        int updated = 0;
+        for (auto& [rid, old_doc] : to_update) {
             // Merge update fields into existing doc
-            BsonDocument merged = tuple.doc;
+            BsonDocument merged = old_doc;
             for (auto& [key, val] : update_doc.elements) {
                 merged.elements[key] = val;
             }
-            to_update.push_back({tuple.rid, merged});
-        }
-        filter.Close();
-
-        int updated = 0;
-        for (auto& [rid, new_doc] : to_update) {
-            coll->heap_file->UpdateRecord(rid, new_doc);
+            UnindexDocument(coll, old_doc, rid);
+            RecordID new_rid = coll->heap_file->UpdateRecord(rid, merged);
+            IndexDocument(coll, merged, new_rid);
             updated++;
         }
 
@@ -426,7 +423,7 @@ void CLI::HandleCreateIndex(const std::string& field_name) {
     }
 }
 
-void CLI::HandleCount() {
+void CLI::HandleExplain(const std::string& filter_str) {
     if (current_collection_.empty()) {
         std::cout << CLR_RED "Error: no collection selected." CLR_RESET << std::endl;
         return;
@@ -435,14 +432,50 @@ void CLI::HandleCount() {
     CollectionInfo* coll = catalog_->GetCollection(current_collection_);
     if (!coll) return;
 
-    SeqScanExecutor scan(coll->heap_file.get());
-    scan.Init();
-    int count = 0;
-    Tuple tuple;
-    while (scan.Next(&tuple)) { count++; }
-    scan.Close();
+    try {
+        FilterExpr filter;
+        if (!filter_str.empty() && Trim(filter_str) != "{}") {
+            filter = FilterExpr(ParseFilter(ParseJSON(filter_str)));
+        }
 
-    std::cout << CLR_YELLOW << count << CLR_RESET << std::endl;
+        // Chosen plan first, then the alternatives it beat
+        Planner planner(coll, bpm_->GetPageSize());
+        std::vector<AccessPath> paths = planner.Enumerate(filter);
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::cout << (i == 0 ? CLR_GREEN "  * " : CLR_DIM "    ") << paths[i].Describe()
+                      << "  rows=" << paths[i].rows << " cost=" << paths[i].cost << CLR_RESET << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cout << CLR_RED "Error: " << e.what() << CLR_RESET << std::endl;
+    }
+}
+
+void CLI::HandleAnalyze() {
+    if (current_collection_.empty()) {
+        std::cout << CLR_RED "Error: no collection selected." CLR_RESET << std::endl;
+        return;
+    }
+
+    if (!catalog_->Analyze(current_collection_)) return;
+    CollectionInfo* coll = catalog_->GetCollection(current_collection_);
+    std::cout << CLR_GREEN "Analyzed " << coll->stats.row_count << " document(s) in "
+              << coll->stats.page_count << " page(s)" CLR_RESET << std::endl;
+    for (const auto& idx : coll->indexes) {
+        std::cout << CLR_DIM "  " << idx.field_name << ": " << idx.stats.num_entries << " entries, "
+                  << idx.stats.distinct_keys << " distinct" CLR_RESET << std::endl;
+    }
+}
+
+void CLI::HandleCount() {
+    if (current_collection_.empty()) {
+        std::cout << CLR_RED "Error: no collection selected." CLR_RESET << std::endl;
+        return;
+    }
+
+    CollectionInfo* coll = catalog_->GetCollection(current_collection_);
+    if (!coll) return;
+
+    std::cout << CLR_YELLOW << coll->DocumentCount() << CLR_RESET << std::endl;
 }
 
 void CLI::HandleDrop() {
@@ -463,11 +496,14 @@ void CLI::HandleHelp() {
     std::cout << CLR_CYAN "  show collections" CLR_RESET "           — List all collections" << std::endl;
     std::cout << CLR_CYAN "  use <name>" CLR_RESET "                 — Switch to (or create) a collection" << std::endl;
     std::cout << CLR_CYAN "  db.insert({...})" CLR_RESET "           — Insert a JSON document" << std::endl;
+    std::cout << CLR_CYAN "  db.insertMany([{...}, ...])" CLR_RESET " — Insert many documents at once" << std::endl;
     std::cout << CLR_CYAN "  db.find()" CLR_RESET "                  — Find all documents" << std::endl;
     std::cout << CLR_CYAN "  db.find({...})" CLR_RESET "             — Find with filter (equality match)" << std::endl;
     std::cout << CLR_CYAN "  db.delete({...})" CLR_RESET "           — Delete matching documents" << std::endl;
     std::cout << CLR_CYAN "  db.update({filter}, {doc})" CLR_RESET " — Update matching documents" << std::endl;
     std::cout << CLR_CYAN "  db.createIndex(\"field\")" CLR_RESET "    — Create B+ Tree index on a field" << std::endl;
+    std::cout << CLR_CYAN "  db.explain({...})" CLR_RESET "          — Show the plan chosen for a filter" << std::endl;
+    std::cout << CLR_CYAN "  db.analyze()" CLR_RESET "               — Refresh planner statistics" << std::endl;
     std::cout << CLR_CYAN "  db.count()" CLR_RESET "                 — Count documents in collection" << std::endl;
     std::cout << CLR_CYAN "  db.drop()" CLR_RESET "                  — Drop current collection" << std::endl;
     std::cout << CLR_CYAN "  help" CLR_RESET "                       — Show this help" << std::endl;
@@ -528,6 +564,11 @@ void CLI::Run() {
             std::string json = ExtractBetween(inner, '{', '}');
             HandleInsert(json);
 
+        } else if (cmd.substr(0, 14) == "db.insertMany(") {
+            std::string inner = cmd.substr(14);
+            if (!inner.empty() && inner.back() == ')') inner.pop_back();
+            HandleInsertMany(ExtractBetween(inner, '[', ']'));
+
         } else if (cmd == "db.find()" || cmd == "db.find({})") {
             HandleFind("");
 
@@ -566,6 +607,14 @@ void CLI::Run() {
             if (!inner.empty() && inner.back() == ')') inner.pop_back();
             HandleCreateIndex(inner);
 
+        } else if (cmd.substr(0, 11) == "db.explain(") {
+            std::string inner = cmd.substr(11);
+            if (!inner.empty() && inner.back() == ')') inner.pop_back();
+            HandleExplain(ExtractBetween(inner, '{', '}'));
+
+        } else if (cmd == "db.analyze()") {
+            HandleAnalyze();
+
         } else if (cmd == "db.count()") {
             HandleCount();
 
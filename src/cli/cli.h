@@ -5,6 +5,8 @@
 #include "execution_engine/executor/seq_scan.h"
 #include "execution_engine/executor/filter.h"
 #include "execution_engine/executor/index_scan.h"
+#include "execution_engine/executor/filter_expr.h"
+#include "execution_engine/planner/planner.h"
 #include "storage_engine/buffer/buffer_pool.h"
 #include "storage_engine/disk_manager/disk_manager.h"
 #include "storage_engine/serializer/serializer.h"
@@ -26,11 +28,14 @@
 //   show collections
 //   use <collection>                    — set active collection (auto-creates)
 //   db.insert({ "key": "value", ... }) — insert a document
+//   db.insertMany([{ ... }, { ... }])  — insert a batch of documents
 //   db.find()                          — find all documents
 //   db.find({ "key": "value" })        — find with filter
 //   db.delete({ "key": "value" })      — delete matching documents
 //   db.update({ "key": "old" }, { "key": "new" })
 //   db.createIndex("field")            — create B+ Tree index on field
+//   db.explain({ "key": "value" })     — show the planner's choice for a filter
+//   db.analyze()                       — refresh the planner's statistics
 //   db.count()                         — count all documents
 //   db.drop()                          — drop current collection
 //   help                               — show help
@@ -39,7 +44,7 @@
 
 class CLI {
 public:
-    CLI(const std::string& db_file = "docdb_data.db");
+    explicit CLI(const DBConfigs& config = DBConfigs());
     ~CLI();
 
     // Run the interactive REPL
@@ -50,16 +55,21 @@ private:
     void HandleShowCollections();
     void HandleUse(const std::string& collection_name);
     void HandleInsert(const std::string& json_str);
+    void HandleInsertMany(const std::string& array_str);
     void HandleFind(const std::string& filter_str);
     void HandleDelete(const std::string& filter_str);
     void HandleUpdate(const std::string& filter_str, const std::string& update_str);
     void HandleCreateIndex(const std::string& field_name);
+    void HandleExplain(const std::string& filter_str);
+    void HandleAnalyze();
     void HandleCount();
     void HandleDrop();
     void HandleHelp();
 
-    // ---- JSON mini-parser ----
-    // Parses a flat JSON object like { "name": "Alice", "age": 30 }
+    // ---- JSON ----
+    // Parses a JSON object like { "name": "Alice", "tags": ["a", "b"] }
+    // (Json::ParseDocument); blank text is the empty document, and
+    // malformed text throws
     BsonDocument ParseJSON(const std::string& json);
 
     // Print a BsonDocument as JSON
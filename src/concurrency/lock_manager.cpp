@@ -1,164 +1,400 @@
 #include "lock_manager.h"
+#include "storage_engine/common/metrics.h"
 #include <algorithm>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
+#include <unordered_set>
 
 // ============================================================================
-// CanGrantLock — check if a new lock request can be granted
+// Lock modes — compatibility and the upgrade lattice
 // ============================================================================
 
-bool LockManager::CanGrantLock(const LockRequestQueue& queue, LockMode mode) const {
-    for (const auto& req : queue.queue) {
-        if (!req.granted) continue;
+// Indexed [IS, IX, S, SIX, X] x [IS, IX, S, SIX, X]
+static constexpr bool COMPATIBLE[5][5] = {
+    {true,  true,  true,  true,  false},
+    {true,  true,  false, false, false},
+    {true,  false, true,  false, false},
+    {true,  false, false, false, false},
+    {false, false, false, false, false},
+};
+
+static constexpr LockMode COMBINED[5][5] = {
+    {LockMode::INTENTION_SHARED, LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED,
+     LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::EXCLUSIVE},
+    {LockMode::INTENTION_EXCLUSIVE, LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE,
+     LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::EXCLUSIVE},
+    {LockMode::SHARED, LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::SHARED,
+     LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::EXCLUSIVE},
+    {LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE,
+     LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::EXCLUSIVE},
+    {LockMode::EXCLUSIVE, LockMode::EXCLUSIVE, LockMode::EXCLUSIVE, LockMode::EXCLUSIVE,
+     LockMode::EXCLUSIVE},
+};
+
+bool LockManager::Compatible(LockMode a, LockMode b) {
+    return COMPATIBLE[static_cast<int>(a)][static_cast<int>(b)];
+}
 
-        if (mode == LockMode::EXCLUSIVE) {
-            // Exclusive conflicts with anything
-            return false;
-        }
-        if (req.mode == LockMode::EXCLUSIVE) {
-            // Shared conflicts with exclusive
-            return false;
-        }
-        // Shared + Shared = OK
-    }
-    return true;
+LockMode LockManager::Combine(LockMode a, LockMode b) {
+    return COMBINED[static_cast<int>(a)][static_cast<int>(b)];
+}
+
+bool LockManager::Covers(LockMode held, LockMode wanted) {
+    return Combine(held, wanted) == held;
 }
 
 // ============================================================================
-// LockShared
+// Constructor / Destructor, detector thread
 // ============================================================================
 
-bool LockManager::LockShared(txn_id_t txn_id, const RecordID& rid) {
-    LockKey key = MakeKey(rid);
-    std::unique_lock<std::mutex> guard(latch_);
+LockManager::LockManager(size_t escalation_threshold, std::chrono::milliseconds deadlock_interval)
+    : escalation_threshold_(escalation_threshold), deadlock_interval_(deadlock_interval) {}
 
-    auto& queue = lock_table_[key];
+LockManager::~LockManager() {
+    Stop();
+}
 
-    // Check if we already hold a lock on this resource
-    for (auto& req : queue.queue) {
-        if (req.txn_id == txn_id && req.granted) {
-            return true;  // Already have a lock (shared or exclusive)
-        }
+void LockManager::Start() {
+    if (detector_.joinable() || deadlock_interval_.count() == 0) return;
+    {
+        std::lock_guard<std::mutex> guard(detector_mutex_);
+        stop_ = false;
     }
+    detector_ = std::thread(&LockManager::DetectorLoop, this);
+}
 
-    LockRequest request{txn_id, LockMode::SHARED, false};
-    queue.queue.push_back(request);
-    auto it = std::prev(queue.queue.end());
+void LockManager::Stop() {
+    {
+        std::lock_guard<std::mutex> guard(detector_mutex_);
+        stop_ = true;
+    }
+    detector_cv_.notify_all();
+    if (detector_.joinable()) {
+        detector_.join();
+    }
+}
+
+void LockManager::DetectorLoop() {
+    std::unique_lock<std::mutex> lock(detector_mutex_);
+    while (!stop_) {
+        detector_cv_.wait_for(lock, deadlock_interval_, [this] { return stop_; });
+        if (stop_) break;
 
-    // Wait until we can be granted
-    while (!CanGrantLock(queue, LockMode::SHARED)) {
-        queue.cv.wait(guard);
+        lock.unlock();
+        DetectDeadlocks();
+        lock.lock();
     }
+}
 
-    it->granted = true;
-    txn_locks_[txn_id].insert(key);
-    return true;
+LockStats LockManager::GetStats() const {
+    LockStats stats;
+    stats.acquired = acquired_.load();
+    stats.waits = waits_.load();
+    stats.wait_us = wait_us_.load();
+    stats.max_wait_us = max_wait_us_.load();
+    stats.deadlocks = deadlocks_.load();
+    stats.escalations = escalations_.load();
+    return stats;
 }
 
 // ============================================================================
-// LockExclusive
+// Request queues
 // ============================================================================
 
-bool LockManager::LockExclusive(txn_id_t txn_id, const RecordID& rid) {
-    LockKey key = MakeKey(rid);
-    std::unique_lock<std::mutex> guard(latch_);
+LockManager::TxnLocks& LockManager::LocksOf(txn_id_t txn_id) {
+    TxnShard& shard = txn_shards_[static_cast<uint64_t>(txn_id) % NUM_SHARDS];
+    std::lock_guard<std::mutex> guard(shard.latch);
+    return shard.txns[txn_id];  // Node-based: stays valid while others are added
+}
 
-    auto& queue = lock_table_[key];
+bool LockManager::GrantableAlongside(const LockRequestQueue& queue, txn_id_t txn_id, LockMode mode) {
+    for (const auto& req : queue.queue) {
+        if (req.granted && req.txn_id != txn_id && !Compatible(mode, req.mode)) return false;
+    }
+    return true;
+}
 
-    // Check if we already hold an exclusive lock
+// Granted requests form a prefix of the queue: a new one is granted only
+// if nothing waits, and waiters are granted front to back
+void LockManager::GrantWaiters(LockRequestQueue& queue) {
+    if (queue.upgrading != INVALID_TXN_ID) {
+        auto it = std::find_if(queue.queue.begin(), queue.queue.end(),
+                               [&](const LockRequest& r) { return r.txn_id == queue.upgrading; });
+        if (!GrantableAlongside(queue, it->txn_id, it->upgrade_to)) return;
+        it->mode = it->upgrade_to;
+        queue.upgrading = INVALID_TXN_ID;
+        it->cv.notify_one();
+    }
     for (auto& req : queue.queue) {
-        if (req.txn_id == txn_id && req.granted && req.mode == LockMode::EXCLUSIVE) {
-            return true;  // Already have exclusive
-        }
+        if (req.granted) continue;
+        if (!GrantableAlongside(queue, req.txn_id, req.mode)) break;
+        req.granted = true;
+        req.cv.notify_one();
     }
+}
 
-    LockRequest request{txn_id, LockMode::EXCLUSIVE, false};
-    queue.queue.push_back(request);
-    auto it = std::prev(queue.queue.end());
-
-    // Wait until we can be granted — check that no other txn holds any lock
-    while (true) {
-        bool can_grant = true;
-        for (const auto& req : queue.queue) {
-            if (req.txn_id != txn_id && req.granted) {
-                can_grant = false;
-                break;
-            }
-        }
-        if (can_grant) break;
-        queue.cv.wait(guard);
+bool LockManager::Wait(std::unique_lock<std::mutex>& guard, LockRequestQueue& queue,
+                       std::list<LockRequest>::iterator request) {
+    const bool upgrade = queue.upgrading == request->txn_id;
+    auto start = std::chrono::steady_clock::now();
+    request->cv.wait(guard, [&] {
+        return request->aborted || (upgrade ? queue.upgrading != request->txn_id : request->granted);
+    });
+
+    uint64_t waited = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    waits_.fetch_add(1, std::memory_order_relaxed);
+    wait_us_.fetch_add(waited, std::memory_order_relaxed);
+    Metrics::Record(Histogram::LOCK_WAIT, waited);
+    uint64_t max_wait = max_wait_us_.load(std::memory_order_relaxed);
+    while (waited > max_wait && !max_wait_us_.compare_exchange_weak(max_wait, waited)) {}
+
+    if (upgrade ? queue.upgrading != request->txn_id : request->granted) {
+        request->aborted = false;  // Granted before the victim woke: the cycle is gone anyway
+        return true;
     }
-
-    it->granted = true;
-    txn_locks_[txn_id].insert(key);
-    return true;
+    deadlocks_.fetch_add(1, std::memory_order_relaxed);
+    if (upgrade) {
+        request->aborted = false;  // Keeps the mode it had
+        queue.upgrading = INVALID_TXN_ID;
+    } else {
+        queue.queue.erase(request);
+    }
+    GrantWaiters(queue);
+    return false;
 }
 
 // ============================================================================
-// LockUpgrade — shared → exclusive
+// Lock — one resource, no hierarchy
 // ============================================================================
 
-bool LockManager::LockUpgrade(txn_id_t txn_id, const RecordID& rid) {
-    LockKey key = MakeKey(rid);
-    std::unique_lock<std::mutex> guard(latch_);
-
-    auto table_it = lock_table_.find(key);
-    if (table_it == lock_table_.end()) return false;
+bool LockManager::Lock(txn_id_t txn_id, TxnLocks& locks, const LockResource& resource, LockMode mode,
+                       bool* acquired) {
+    auto held = locks.modes.find(resource);
+    if (held != locks.modes.end() && Covers(held->second, mode)) return true;
+
+    Shard& shard = ShardFor(resource);
+    std::unique_lock<std::mutex> guard(shard.latch);
+    LockRequestQueue& queue = shard.table[resource];
+
+    if (held != locks.modes.end()) {
+        // Upgrade in place, ahead of every waiter
+        LockMode target = Combine(held->second, mode);
+        if (queue.upgrading != INVALID_TXN_ID) {
+            // Each would wait for the other to give up its lock
+            deadlocks_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        auto it = std::find_if(queue.queue.begin(), queue.queue.end(),
+                               [&](const LockRequest& r) { return r.txn_id == txn_id; });
+        if (GrantableAlongside(queue, txn_id, target)) {
+            it->mode = target;
+        } else {
+            queue.upgrading = txn_id;
+            it->upgrade_to = target;
+            if (!Wait(guard, queue, it)) return false;
+        }
+        held->second = target;
+        acquired_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
 
-    auto& queue = table_it->second;
+    queue.queue.emplace_back(txn_id, mode);
+    auto it = std::prev(queue.queue.end());
+    bool nothing_ahead = queue.upgrading == INVALID_TXN_ID &&
+                         (it == queue.queue.begin() || std::prev(it)->granted);
+    if (nothing_ahead && GrantableAlongside(queue, txn_id, mode)) {
+        it->granted = true;
+    } else if (!Wait(guard, queue, it)) {
+        if (queue.queue.empty()) shard.table.erase(resource);
+        return false;
+    }
+    guard.unlock();
 
-    // Find our shared lock
-    auto it = std::find_if(queue.queue.begin(), queue.queue.end(),
-        [&](const LockRequest& r) { return r.txn_id == txn_id && r.granted; });
+    locks.held.push_back(resource);
+    locks.modes.emplace(resource, mode);
+    acquired_.fetch_add(1, std::memory_order_relaxed);
+    if (acquired) *acquired = true;
+    return true;
+}
 
-    if (it == queue.queue.end()) return false;
-    if (it->mode == LockMode::EXCLUSIVE) return true;  // Already exclusive
+// ============================================================================
+// LockRecord / LockCollection
+// ============================================================================
 
-    // Wait until we're the only one holding a lock
-    while (true) {
-        bool can_upgrade = true;
-        for (const auto& req : queue.queue) {
-            if (req.txn_id != txn_id && req.granted) {
-                can_upgrade = false;
-                break;
-            }
-        }
-        if (can_upgrade) break;
-        queue.cv.wait(guard);
+bool LockManager::LockRecord(txn_id_t txn_id, uint32_t collection, const RecordID& rid, LockMode mode) {
+    if (mode != LockMode::SHARED && mode != LockMode::EXCLUSIVE) {
+        throw std::runtime_error("LockManager: records are locked SHARED or EXCLUSIVE");
+    }
+    TxnLocks& locks = LocksOf(txn_id);
+    LockResource coll = LockResource::Collection(collection);
+    auto coll_held = locks.modes.find(coll);
+    if (coll_held != locks.modes.end() && Covers(coll_held->second, mode)) return true;
+
+    LockMode intention = mode == LockMode::SHARED ? LockMode::INTENTION_SHARED : LockMode::INTENTION_EXCLUSIVE;
+    if (!Lock(txn_id, locks, coll, intention)) return false;
+
+    size_t& count = locks.record_counts[collection];
+    if (count >= escalation_threshold_) {
+        if (!Lock(txn_id, locks, coll, mode)) return false;
+        escalations_.fetch_add(1, std::memory_order_relaxed);
+        LockMode coll_mode = locks.modes[coll];
+        ReleaseCovered(txn_id, locks, collection, coll_mode);
+        count = 0;
+        if (Covers(coll_mode, mode)) return true;
+        // SIX (S escalated under IX): X record locks are still taken one by one
     }
 
-    it->mode = LockMode::EXCLUSIVE;
+    if (!Lock(txn_id, locks, LockResource::Page(collection, rid.page_id), intention)) return false;
+    bool acquired = false;
+    if (!Lock(txn_id, locks, LockResource::Record(collection, rid), mode, &acquired)) return false;
+    if (acquired) count++;
     return true;
 }
 
+bool LockManager::LockCollection(txn_id_t txn_id, uint32_t collection, LockMode mode) {
+    return Lock(txn_id, LocksOf(txn_id), LockResource::Collection(collection), mode);
+}
+
 // ============================================================================
-// UnlockAll — release all locks held by a transaction (called at commit/abort)
+// Release / UnlockAll
 // ============================================================================
 
-void LockManager::UnlockAll(txn_id_t txn_id) {
-    std::unique_lock<std::mutex> guard(latch_);
+void LockManager::Release(txn_id_t txn_id, const LockResource& resource) {
+    Shard& shard = ShardFor(resource);
+    std::lock_guard<std::mutex> guard(shard.latch);
+    auto table_it = shard.table.find(resource);
+    if (table_it == shard.table.end()) return;
+
+    auto& queue = table_it->second;
+    queue.queue.remove_if([&](const LockRequest& r) { return r.txn_id == txn_id; });
+    if (queue.upgrading == txn_id) queue.upgrading = INVALID_TXN_ID;
+    GrantWaiters(queue);
 
-    auto txn_it = txn_locks_.find(txn_id);
-    if (txn_it == txn_locks_.end()) return;
+    // Clean up empty queues
+    if (queue.queue.empty()) {
+        shard.table.erase(table_it);
+    }
+}
 
-    for (const auto& key : txn_it->second) {
-        auto table_it = lock_table_.find(key);
-        if (table_it == lock_table_.end()) continue;
+void LockManager::ReleaseCovered(txn_id_t txn_id, TxnLocks& locks, uint32_t collection,
+                                 LockMode collection_mode) {
+    auto covered = [&](const LockResource& r) {
+        return r.level != LockResource::Level::COLLECTION && r.collection == collection &&
+               Covers(collection_mode, locks.modes[r]);
+    };
+    auto first = std::stable_partition(locks.held.begin(), locks.held.end(),
+                                       [&](const LockResource& r) { return !covered(r); });
+    for (auto it = first; it != locks.held.end(); ++it) {
+        Release(txn_id, *it);
+        locks.modes.erase(*it);
+    }
+    locks.held.erase(first, locks.held.end());
+}
 
-        auto& queue = table_it->second;
+void LockManager::UnlockAll(txn_id_t txn_id) {
+    TxnLocks locks;
+    {
+        TxnShard& shard = txn_shards_[static_cast<uint64_t>(txn_id) % NUM_SHARDS];
+        std::lock_guard<std::mutex> guard(shard.latch);
+        auto txn_it = shard.txns.find(txn_id);
+        if (txn_it == shard.txns.end()) return;
+        locks = std::move(txn_it->second);
+        shard.txns.erase(txn_it);
+    }
 
-        // Remove all lock requests from this txn
-        queue.queue.remove_if([&](const LockRequest& r) {
-            return r.txn_id == txn_id;
-        });
+    // Finest first, so no waiter is granted a child before its parent frees
+    for (auto it = locks.held.rbegin(); it != locks.held.rend(); ++it) {
+        Release(txn_id, *it);
+    }
+}
 
-        // Wake up waiters
-        queue.cv.notify_all();
+// ============================================================================
+// DetectDeadlocks — waits-for graph over a consistent snapshot
+//
+// A waiting request waits for every granted request of another
+// transaction it conflicts with, and (queues being FIFO) for the
+// conflicting requests queued ahead of it. Every transaction on a cycle
+// waits, so the youngest — the largest id, with the least work to lose —
+// is refused the lock it waits for.
+// ============================================================================
 
-        // Clean up empty queues
-        if (queue.queue.empty()) {
-            lock_table_.erase(table_it);
+size_t LockManager::DetectDeadlocks() {
+    std::vector<std::unique_lock<std::mutex>> guards;
+    guards.reserve(NUM_SHARDS);
+    for (Shard& shard : shards_) guards.emplace_back(shard.latch);
+
+    std::unordered_map<txn_id_t, std::vector<txn_id_t>> waits_for;
+    std::unordered_map<txn_id_t, LockRequest*> waiting;
+    for (Shard& shard : shards_) {
+        for (auto& [resource, queue] : shard.table) {
+            for (auto& req : queue.queue) {
+                bool upgrade = queue.upgrading == req.txn_id;
+                if (req.granted && !upgrade) continue;
+                LockMode wanted = upgrade ? req.upgrade_to : req.mode;
+                waiting[req.txn_id] = &req;
+                auto& edges = waits_for[req.txn_id];
+                bool ahead = true;  // other is queued before req
+                for (const auto& other : queue.queue) {
+                    if (&other == &req) {
+                        ahead = false;
+                        continue;
+                    }
+                    if ((other.granted || ahead) && !Compatible(wanted, other.mode)) {
+                        edges.push_back(other.txn_id);
+                    }
+                }
+            }
         }
     }
+    if (waiting.empty()) return 0;
 
-    txn_locks_.erase(txn_it);
+    std::vector<txn_id_t> nodes;
+    for (auto& [txn_id, edges] : waits_for) {
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        nodes.push_back(txn_id);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    std::unordered_set<txn_id_t> victims;
+    size_t chosen = 0;
+    while (true) {
+        // Depth-first search from each node in id order for a back edge
+        std::unordered_map<txn_id_t, int> color;  // 0 unvisited, 1 on the stack, 2 done
+        std::vector<txn_id_t> stack;
+        std::vector<txn_id_t> cycle;
+        std::function<bool(txn_id_t)> visit = [&](txn_id_t txn_id) {
+            color[txn_id] = 1;
+            stack.push_back(txn_id);
+            auto it = waits_for.find(txn_id);
+            if (it != waits_for.end()) {
+                for (txn_id_t next : it->second) {
+                    if (victims.count(next)) continue;
+                    if (color[next] == 1) {
+                        cycle.assign(std::find(stack.begin(), stack.end(), next), stack.end());
+                        return true;
+                    }
+                    if (color[next] == 0 && visit(next)) return true;
+                }
+            }
+            stack.pop_back();
+            color[txn_id] = 2;
+            return false;
+        };
+        for (txn_id_t txn_id : nodes) {
+            if (victims.count(txn_id) || color[txn_id] != 0) continue;
+            if (visit(txn_id)) break;
+        }
+        if (cycle.empty()) break;
+
+        txn_id_t victim = *std::max_element(cycle.begin(), cycle.end());
+        victims.insert(victim);
+        LockRequest* request = waiting[victim];
+        request->aborted = true;
+        request->cv.notify_one();
+        chosen++;
+    }
+    return chosen;
 }
@@ -2,89 +2,215 @@
 
 #include "storage_engine/common/common.h"
 #include "storage_engine/page/slotted_page.h"
-#include <unordered_map>
-#include <list>
-#include <mutex>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
-#include <set>
 #include <cstdint>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 // ============================================================================
-// Lock Manager — Strict Two-Phase Locking (2PL)
+// Lock Manager — Strict Two-Phase Locking (2PL), multiple granularity
+//
+// Resources form a hierarchy: collection → page → record. A transaction
+// locks a record S or X only under IS / IX on its page and collection, so
+// a collection lock (S, X) conflicts with every record lock beneath it
+// without visiting them. Locks are released only at transaction end
+// (commit/abort) — no early unlock.
+//
+// Lock escalation: once a transaction holds ESCALATION_THRESHOLD record
+// locks in one collection, it locks the whole collection S / X instead
+// and drops the page and record locks that covers.
 //
-// Supports SHARED and EXCLUSIVE locks on resources identified by RecordID.
-// Uses a lock request queue per resource. Locks are released only at
-// transaction end (commit/abort) — no early unlock.
+// The lock table is split into NUM_SHARDS hash partitions, each with its
+// own latch. Every request queue is FIFO: a request is granted when it is
+// compatible with all granted ones and nothing waits ahead of it (an
+// upgrade goes first); a release grants the requests it unblocks and
+// wakes only those, each waiting on its own condition variable.
+//
+// Deadlocks: a background thread (Start / Stop) builds the waits-for
+// graph every interval and, for each cycle, aborts the youngest waiting
+// transaction in it — its Lock* call returns false and the caller must
+// abort the transaction.
 // ============================================================================
 
 using txn_id_t = int64_t;
 static constexpr txn_id_t INVALID_TXN_ID = -1;
 
-enum class LockMode {
-    SHARED,
-    EXCLUSIVE
+enum class LockMode : uint8_t {
+    INTENTION_SHARED,             // IS: will S-lock beneath
+    INTENTION_EXCLUSIVE,          // IX: will X-lock beneath
+    SHARED,                       // S
+    SHARED_INTENTION_EXCLUSIVE,   // SIX: S here, will X-lock beneath
+    EXCLUSIVE                     // X
 };
 
-struct LockRequest {
-    txn_id_t txn_id;
-    LockMode mode;
-    bool granted;
-};
+// A lockable resource. page_id / slot_id are unused above their level.
+struct LockResource {
+    enum class Level : uint8_t { COLLECTION, PAGE, RECORD };
 
-// A resource key: we lock at the page+slot level
-struct LockKey {
-    page_id_t page_id;
-    uint16_t slot_id;
+    Level level = Level::COLLECTION;
+    uint32_t collection = 0;  // Any id unique per collection
+    page_id_t page_id = INVALID_PAGE_ID;
+    uint16_t slot_id = 0;
+
+    static LockResource Collection(uint32_t collection) { return {Level::COLLECTION, collection}; }
+    static LockResource Page(uint32_t collection, page_id_t page_id) {
+        return {Level::PAGE, collection, page_id};
+    }
+    static LockResource Record(uint32_t collection, const RecordID& rid) {
+        return {Level::RECORD, collection, rid.page_id, rid.slot_id};
+    }
 
-    bool operator==(const LockKey& other) const {
-        return page_id == other.page_id && slot_id == other.slot_id;
+    bool operator==(const LockResource& other) const {
+        return level == other.level && collection == other.collection && page_id == other.page_id &&
+               slot_id == other.slot_id;
     }
 };
 
-struct LockKeyHash {
-    size_t operator()(const LockKey& k) const {
-        return std::hash<int64_t>()(
-            (static_cast<int64_t>(k.page_id) << 16) | k.slot_id
-        );
+struct LockResourceHash {
+    size_t operator()(const LockResource& r) const {
+        uint64_t h = (static_cast<uint64_t>(r.collection) << 32) ^ (static_cast<uint64_t>(r.page_id) << 18) ^
+                     (static_cast<uint64_t>(r.slot_id) << 2) ^ static_cast<uint64_t>(r.level);
+        return std::hash<uint64_t>()(h * 0x9E3779B97F4A7C15ull);
     }
 };
 
-struct LockRequestQueue {
-    std::list<LockRequest> queue;
-    std::condition_variable cv;
+// Counters since construction
+struct LockStats {
+    uint64_t acquired = 0;      // Lock requests granted (not counting ones already held)
+    uint64_t waits = 0;         // ... of which had to wait
+    uint64_t wait_us = 0;       // Total time spent waiting
+    uint64_t max_wait_us = 0;   // Longest single wait
+    uint64_t deadlocks = 0;     // Requests refused to break a deadlock
+    uint64_t escalations = 0;   // Record locks traded for a collection lock
 };
 
 class LockManager {
 public:
-    LockManager() = default;
-    ~LockManager() = default;
+    static constexpr size_t NUM_SHARDS = 64;
+    static constexpr size_t DEFAULT_ESCALATION_THRESHOLD = 1000;
+    static constexpr std::chrono::milliseconds DEFAULT_DEADLOCK_INTERVAL{50};
+
+    explicit LockManager(size_t escalation_threshold = DEFAULT_ESCALATION_THRESHOLD,
+                         std::chrono::milliseconds deadlock_interval = DEFAULT_DEADLOCK_INTERVAL);
+    ~LockManager();
+
+    LockManager(const LockManager&) = delete;
+    LockManager& operator=(const LockManager&) = delete;
+
+    // Start / stop the deadlock detector thread
+    void Start();
+    void Stop();
 
-    // Acquire a lock. Blocks if incompatible lock is held.
-    // Returns false if deadlock would occur (simplified detection).
-    bool LockShared(txn_id_t txn_id, const RecordID& rid);
-    bool LockExclusive(txn_id_t txn_id, const RecordID& rid);
+    // Acquire a lock on a record (SHARED or EXCLUSIVE), taking the intention
+    // locks above it first; upgrades S to X. Blocks while incompatible locks
+    // are held. Returns false if the transaction was chosen as a deadlock
+    // victim.
+    bool LockRecord(txn_id_t txn_id, uint32_t collection, const RecordID& rid, LockMode mode);
 
-    // Upgrade from shared to exclusive
-    bool LockUpgrade(txn_id_t txn_id, const RecordID& rid);
+    // Acquire (or strengthen to) any mode on a whole collection
+    bool LockCollection(txn_id_t txn_id, uint32_t collection, LockMode mode);
 
     // Release all locks held by a transaction
     void UnlockAll(txn_id_t txn_id);
 
+    // Search the waits-for graph once and abort a victim per cycle.
+    // Returns how many were chosen.
+    size_t DetectDeadlocks();
+
+    LockStats GetStats() const;
+
+    // Whether a lock of mode a may be held alongside one of mode b
+    static bool Compatible(LockMode a, LockMode b);
+
+    // Whether holding mode `held` already grants `wanted`
+    static bool Covers(LockMode held, LockMode wanted);
+
+    // The weakest mode granting both
+    static LockMode Combine(LockMode a, LockMode b);
+
 private:
-    LockKey MakeKey(const RecordID& rid) const {
-        return {rid.page_id, rid.slot_id};
+    struct LockRequest {
+        LockRequest(txn_id_t id, LockMode m) : txn_id(id), mode(m) {}
+
+        txn_id_t txn_id;
+        LockMode mode;
+        bool granted = false;
+        bool aborted = false;             // Chosen as a deadlock victim while waiting
+        LockMode upgrade_to = LockMode::EXCLUSIVE;
+        std::condition_variable cv;       // Signaled on grant / abort
+    };
+
+    struct LockRequestQueue {
+        std::list<LockRequest> queue;
+        txn_id_t upgrading = INVALID_TXN_ID;  // The granted request waiting to upgrade
+    };
+
+    struct Shard {
+        std::mutex latch;
+        std::unordered_map<LockResource, LockRequestQueue, LockResourceHash> table;
+    };
+
+    // What one transaction holds; touched only by the thread running it
+    struct TxnLocks {
+        std::vector<LockResource> held;  // In acquisition order
+        std::unordered_map<LockResource, LockMode, LockResourceHash> modes;
+        std::unordered_map<uint32_t, size_t> record_counts;  // Record locks per collection
+    };
+
+    struct TxnShard {
+        std::mutex latch;
+        std::unordered_map<txn_id_t, TxnLocks> txns;
+    };
+
+    Shard& ShardFor(const LockResource& resource) {
+        return shards_[LockResourceHash()(resource) % NUM_SHARDS];
     }
 
-    bool CanGrantLock(const LockRequestQueue& queue, LockMode mode) const;
+    TxnLocks& LocksOf(txn_id_t txn_id);
 
-    std::mutex latch_;
-    std::unordered_map<LockKey, LockRequestQueue, LockKeyHash> lock_table_;
-    // Track which locks each txn holds (for UnlockAll)
-    std::unordered_map<txn_id_t, std::set<LockKey, std::less<>>> txn_locks_;
-};
+    // Acquire one resource (no hierarchy). *acquired: newly granted.
+    bool Lock(txn_id_t txn_id, TxnLocks& locks, const LockResource& resource, LockMode mode,
+              bool* acquired = nullptr);
+
+    // Block on request until granted or aborted; false if aborted
+    bool Wait(std::unique_lock<std::mutex>& guard, LockRequestQueue& queue,
+              std::list<LockRequest>::iterator request);
+
+    // mode fits beside every request of other transactions granted in queue
+    static bool GrantableAlongside(const LockRequestQueue& queue, txn_id_t txn_id, LockMode mode);
 
-// Comparison operator for LockKey (used in std::set)
-inline bool operator<(const LockKey& a, const LockKey& b) {
-    if (a.page_id != b.page_id) return a.page_id < b.page_id;
-    return a.slot_id < b.slot_id;
-}
+    // Grant, in FIFO order, the requests that no longer conflict
+    static void GrantWaiters(LockRequestQueue& queue);
+
+    // Remove txn_id's request from resource's queue (and the queue if empty)
+    void Release(txn_id_t txn_id, const LockResource& resource);
+
+    // After escalating to collection_mode: drop the locks beneath it covers
+    void ReleaseCovered(txn_id_t txn_id, TxnLocks& locks, uint32_t collection, LockMode collection_mode);
+
+    void DetectorLoop();
+
+    size_t escalation_threshold_;
+    std::chrono::milliseconds deadlock_interval_;
+
+    std::array<Shard, NUM_SHARDS> shards_;
+    std::array<TxnShard, NUM_SHARDS> txn_shards_;
+
+    std::atomic<uint64_t> acquired_{0};
+    std::atomic<uint64_t> waits_{0};
+    std::atomic<uint64_t> wait_us_{0};
+    std::atomic<uint64_t> max_wait_us_{0};
+    std::atomic<uint64_t> deadlocks_{0};
+    std::atomic<uint64_t> escalations_{0};
+
+    std::thread detector_;
+    std::mutex detector_mutex_;
+    std::condition_variable detector_cv_;
+    bool stop_ = false;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <mutex>
+#include <shared_mutex>
+
+// ============================================================================
+// ReaderWriterLatch — writer-preferring shared latch
+//
+// std::shared_mutex on glibc lets new readers in while a writer waits, so a
+// steady stream of overlapping readers can starve the writer forever. Here a
+// writer holds the turnstile while waiting for the readers to drain, which
+// blocks new readers until it has been through.
+//
+// Satisfies the SharedMutex requirements, so std::shared_lock and
+// std::unique_lock work on it.
+// ============================================================================
+
+class ReaderWriterLatch {
+public:
+    void lock() {
+        std::lock_guard<std::mutex> turn(turnstile_);
+        latch_.lock();
+    }
+    void unlock() { latch_.unlock(); }
+
+    void lock_shared() {
+        { std::lock_guard<std::mutex> turn(turnstile_); }
+        latch_.lock_shared();
+    }
+    void unlock_shared() { latch_.unlock_shared(); }
+
+private:
+    std::mutex turnstile_;
+    std::shared_mutex latch_;
+};
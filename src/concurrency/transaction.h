@@ -1,9 +1,12 @@
 #pragma once
 
 #include "concurrency/lock_manager.h"
+#include "recovery/wal.h"
 #include <atomic>
+#include <memory>
 #include <unordered_set>
 #include <mutex>
+#include <set>
 #include <vector>
 
 // ============================================================================
@@ -16,29 +19,66 @@ enum class TransactionState {
     ABORTED
 };
 
+// ============================================================================
+// TxnStamp — when a transaction's changes became visible to readers
+//
+// 0 while it runs, then the timestamp it ended with. Shared with the
+// versions it leaves behind (see VersionStore), which outlive it.
+// ============================================================================
+struct TxnStamp {
+    std::atomic<uint64_t> commit_ts{0};
+};
+
+// A consistent point to read at: the changes of every transaction that
+// ended at or before read_ts, and nothing later
+struct Snapshot {
+    uint64_t read_ts = 0;
+
+    bool Sees(const TxnStamp& stamp) const {
+        uint64_t ts = stamp.commit_ts.load(std::memory_order_acquire);
+        return ts != 0 && ts <= read_ts;
+    }
+};
+
 // ============================================================================
 // Transaction — represents a single transaction
 // ============================================================================
 struct Transaction {
     txn_id_t txn_id;
     TransactionState state;
+    std::shared_ptr<TxnStamp> stamp;
 
     explicit Transaction(txn_id_t id)
-        : txn_id(id), state(TransactionState::GROWING) {}
+        : txn_id(id), state(TransactionState::GROWING), stamp(std::make_shared<TxnStamp>()) {}
 };
 
 // ============================================================================
 // Transaction Manager — coordinates Begin/Commit/Abort
 // ============================================================================
+//
+// With a WAL attached, Begin/Commit/Abort write BEGIN/COMMIT/ABORT records.
+// Commit does not wait for the log to reach disk when the WAL batches
+// commits, and releases the locks all the same (early lock release);
+// callers pass the returned LSN to WAL::FlushUntil before acknowledging
+// the transaction, or anything read after it.
+//
+// Commit and Abort also stamp the transaction with the next tick of a
+// logical clock, before its locks are released; a snapshot reads at the
+// current tick. Abort stamps too, and undoes nothing itself: the caller
+// first puts back what the transaction changed, under its locks (see
+// WriteUndo in the server), so a reader that sees the abort reads the
+// records as they were. Recovery undoes transactions that never ended.
+// ============================================================================
 class TransactionManager {
 public:
-    explicit TransactionManager(LockManager* lock_manager);
+    explicit TransactionManager(LockManager* lock_manager, WAL* wal = nullptr);
 
     // Begin a new transaction, returns the Transaction object
     Transaction* Begin();
 
-    // Commit a transaction — release all locks
-    void Commit(Transaction* txn);
+    // Commit a transaction — release all locks. Returns the COMMIT record's
+    // LSN (INVALID_LSN without a WAL).
+    lsn_t Commit(Transaction* txn);
 
     // Abort a transaction — release all locks
     void Abort(Transaction* txn);
@@ -46,9 +86,46 @@ public:
     // Get a transaction by ID
     Transaction* GetTransaction(txn_id_t txn_id);
 
+    // Free a committed/aborted transaction. The pointer is invalid afterwards.
+    void Release(Transaction* txn);
+
+    // Start reading at the current tick; every snapshot taken must be
+    // released. Versions a registered snapshot may need are kept.
+    Snapshot TakeSnapshot();
+    void ReleaseSnapshot(const Snapshot& snapshot);
+
+    // The read_ts of the oldest registered snapshot (the current tick if
+    // there is none): a version superseded by a change stamped at or
+    // before it is needed by no reader, now or later
+    uint64_t OldestSnapshot();
+
 private:
+    // Give txn its end timestamp
+    void Stamp(Transaction* txn);
+
     LockManager* lock_manager_;
+    WAL* wal_;
     std::atomic<txn_id_t> next_txn_id_{0};
     std::mutex latch_;
     std::unordered_map<txn_id_t, std::unique_ptr<Transaction>> txn_map_;
+
+    std::mutex clock_latch_;              // Orders stamps against snapshots
+    uint64_t clock_ = 0;
+    std::multiset<uint64_t> snapshots_;   // read_ts of every registered snapshot
+};
+
+// Holds a snapshot for as long as it is in scope
+class ScopedSnapshot {
+public:
+    explicit ScopedSnapshot(TransactionManager* txns) : txns_(txns), snapshot_(txns->TakeSnapshot()) {}
+    ~ScopedSnapshot() { txns_->ReleaseSnapshot(snapshot_); }
+
+    ScopedSnapshot(const ScopedSnapshot&) = delete;
+    ScopedSnapshot& operator=(const ScopedSnapshot&) = delete;
+
+    const Snapshot& Get() const { return snapshot_; }
+
+private:
+    TransactionManager* txns_;
+    Snapshot snapshot_;
 };
@@ -5,8 +5,18 @@
 // TransactionManager
 // ============================================================================
 
-TransactionManager::TransactionManager(LockManager* lock_manager)
-    : lock_manager_(lock_manager) {}
+TransactionManager::TransactionManager(LockManager* lock_manager, WAL* wal)
+    : lock_manager_(lock_manager), wal_(wal) {}
+
+// Append a record with no page payload (BEGIN/COMMIT/ABORT)
+static lsn_t LogTxnRecord(WAL* wal, txn_id_t txn_id, LogRecordType type) {
+    LogRecord record;
+    record.txn_id = txn_id;
+    record.type = type;
+    record.page_id = INVALID_PAGE_ID;
+    record.slot_id = 0;
+    return wal->AppendLogRecord(record);
+}
 
 Transaction* TransactionManager::Begin() {
     txn_id_t txn_id = next_txn_id_.fetch_add(1);
@@ -18,32 +28,44 @@ Transaction* TransactionManager::Begin() {
         txn_map_[txn_id] = std::move(txn);
     }
 
-    std::cout << "TXN [" << txn_id << "] BEGIN" << std::endl;
+    if (wal_) {
+        LogTxnRecord(wal_, txn_id, LogRecordType::BEGIN);
+    }
     return ptr;
 }
 
-void TransactionManager::Commit(Transaction* txn) {
-    if (!txn) return;
+lsn_t TransactionManager::Commit(Transaction* txn) {
+    if (!txn) return INVALID_LSN;
+
+    lsn_t commit_lsn = INVALID_LSN;
+    if (wal_) {
+        commit_lsn = LogTxnRecord(wal_, txn->txn_id, LogRecordType::COMMIT);
+    }
 
     txn->state = TransactionState::SHRINKING;
+    Stamp(txn);
 
     // Release all locks (2PL shrinking phase)
     lock_manager_->UnlockAll(txn->txn_id);
 
     txn->state = TransactionState::COMMITTED;
-    std::cout << "TXN [" << txn->txn_id << "] COMMITTED" << std::endl;
+    return commit_lsn;
 }
 
 void TransactionManager::Abort(Transaction* txn) {
     if (!txn) return;
 
+    if (wal_) {
+        LogTxnRecord(wal_, txn->txn_id, LogRecordType::ABORT);
+    }
+
     txn->state = TransactionState::SHRINKING;
+    Stamp(txn);
 
     // Release all locks
     lock_manager_->UnlockAll(txn->txn_id);
 
     txn->state = TransactionState::ABORTED;
-    std::cout << "TXN [" << txn->txn_id << "] ABORTED" << std::endl;
 }
 
 Transaction* TransactionManager::GetTransaction(txn_id_t txn_id) {
@@ -52,3 +74,37 @@ Transaction* TransactionManager::GetTransaction(txn_id_t txn_id) {
     if (it == txn_map_.end()) return nullptr;
     return it->second.get();
 }
+
+void TransactionManager::Release(Transaction* txn) {
+    if (!txn) return;
+    std::lock_guard<std::mutex> guard(latch_);
+    txn_map_.erase(txn->txn_id);
+}
+
+// ============================================================================
+// Timestamps and snapshots
+// ============================================================================
+
+void TransactionManager::Stamp(Transaction* txn) {
+    std::lock_guard<std::mutex> guard(clock_latch_);
+    txn->stamp->commit_ts.store(++clock_, std::memory_order_release);
+}
+
+Snapshot TransactionManager::TakeSnapshot() {
+    std::lock_guard<std::mutex> guard(clock_latch_);
+    Snapshot snapshot;
+    snapshot.read_ts = clock_;
+    snapshots_.insert(snapshot.read_ts);
+    return snapshot;
+}
+
+void TransactionManager::ReleaseSnapshot(const Snapshot& snapshot) {
+    std::lock_guard<std::mutex> guard(clock_latch_);
+    auto it = snapshots_.find(snapshot.read_ts);
+    if (it != snapshots_.end()) snapshots_.erase(it);
+}
+
+uint64_t TransactionManager::OldestSnapshot() {
+    std::lock_guard<std::mutex> guard(clock_latch_);
+    return snapshots_.empty() ? clock_ : *snapshots_.begin();
+}
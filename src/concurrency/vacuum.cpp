@@ -0,0 +1,63 @@
+#include "vacuum.h"
+#include <iostream>
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+Vacuum::Vacuum(TransactionManager* txns, PruneFn prune, std::chrono::milliseconds interval)
+    : txns_(txns), prune_(std::move(prune)), interval_(interval) {}
+
+Vacuum::~Vacuum() {
+    Stop();
+}
+
+// ============================================================================
+// Start / Stop
+// ============================================================================
+
+void Vacuum::Start() {
+    if (thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = false;
+    }
+    thread_ = std::thread(&Vacuum::Loop, this);
+}
+
+void Vacuum::Stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+// ============================================================================
+// Loop / RunOnce
+// ============================================================================
+
+void Vacuum::Loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        cv_.wait_for(lock, interval_, [this] { return stop_; });
+        if (stop_) break;
+
+        lock.unlock();
+        try {
+            RunOnce();
+        } catch (const std::exception& e) {
+            std::cerr << "Vacuum: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+size_t Vacuum::RunOnce() {
+    size_t dropped = prune_(txns_->OldestSnapshot());
+    pruned_.fetch_add(dropped, std::memory_order_relaxed);
+    return dropped;
+}
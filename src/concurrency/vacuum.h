@@ -0,0 +1,51 @@
+#pragma once
+
+#include "concurrency/transaction.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// ============================================================================
+// Vacuum — prunes versions no snapshot can read any more
+//
+// Every interval it asks the TransactionManager for the oldest registered
+// snapshot and hands its read_ts to prune (the owner's walk over its
+// VersionStores), which drops every version superseded by a writer that
+// snapshot already sees.
+// ============================================================================
+class Vacuum {
+public:
+    using PruneFn = std::function<size_t(uint64_t oldest_read_ts)>;
+
+    Vacuum(TransactionManager* txns, PruneFn prune, std::chrono::milliseconds interval);
+    ~Vacuum();
+
+    Vacuum(const Vacuum&) = delete;
+    Vacuum& operator=(const Vacuum&) = delete;
+
+    // Start / stop the background thread
+    void Start();
+    void Stop();
+
+    // Prune once now. Returns the versions dropped.
+    size_t RunOnce();
+
+    // Versions dropped so far
+    uint64_t GetPruned() const { return pruned_.load(std::memory_order_relaxed); }
+
+private:
+    void Loop();
+
+    TransactionManager* txns_;
+    PruneFn prune_;
+    std::chrono::milliseconds interval_;
+    std::atomic<uint64_t> pruned_{0};
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
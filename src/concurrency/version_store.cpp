@@ -0,0 +1,101 @@
+#include "version_store.h"
+
+// ============================================================================
+// Install / Discard
+// ============================================================================
+
+void VersionStore::Install(const RecordID& rid, const BsonDocument* before, const Transaction* txn) {
+    if (!txn) return;
+    Shard& shard = ShardFor(rid);
+    std::lock_guard<std::mutex> guard(shard.latch);
+    std::vector<Version>& chain = shard.chains[rid];
+    // Readers of txn's own later changes need only what it replaced first
+    if (!chain.empty() && chain.front().writer == txn->stamp) return;
+
+    Version version;
+    version.writer = txn->stamp;
+    version.existed = before != nullptr;
+    if (before) version.image = *before;
+    chain.insert(chain.begin(), std::move(version));
+    size_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void VersionStore::Discard(const RecordID& rid, const Transaction* txn) {
+    if (!txn) return;
+    Shard& shard = ShardFor(rid);
+    std::lock_guard<std::mutex> guard(shard.latch);
+    auto it = shard.chains.find(rid);
+    if (it == shard.chains.end() || it->second.front().writer != txn->stamp) return;
+    it->second.erase(it->second.begin());
+    if (it->second.empty()) shard.chains.erase(it);
+    size_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// ============================================================================
+// Resolve — the result of the newest writer the snapshot sees
+// ============================================================================
+
+VersionStore::Visible VersionStore::Resolve(const RecordID& rid, const Snapshot& snapshot, BsonDocument* out) const {
+    if (Size() == 0) return Visible::CURRENT;
+    const Shard& shard = ShardFor(rid);
+    std::lock_guard<std::mutex> guard(shard.latch);
+    auto it = shard.chains.find(rid);
+    if (it == shard.chains.end()) return Visible::CURRENT;
+
+    const std::vector<Version>& chain = it->second;
+    const Version* visible = &chain.back();  // Sees none of the writers: the oldest image
+    for (size_t i = 0; i < chain.size(); i++) {
+        if (!snapshot.Sees(*chain[i].writer)) continue;
+        if (i == 0) return Visible::CURRENT;
+        visible = &chain[i - 1];
+        break;
+    }
+    if (!visible->existed) return Visible::NONE;
+    *out = visible->image;
+    return Visible::VERSION;
+}
+
+std::vector<RecordID> VersionStore::Changed() const {
+    std::vector<RecordID> rids;
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> guard(shard.latch);
+        for (const auto& [rid, chain] : shard.chains) rids.push_back(rid);
+    }
+    return rids;
+}
+
+// ============================================================================
+// Prune — the vacuum's half: cut each chain at its newest old-enough writer
+//
+// Every snapshot still to be served sees that writer, so it reads the
+// result of it or of a newer one: neither needs the image the writer
+// replaced, nor anything older.
+// ============================================================================
+
+size_t VersionStore::Prune(uint64_t oldest_read_ts) {
+    Snapshot oldest;
+    oldest.read_ts = oldest_read_ts;
+    size_t dropped = 0;
+    for (Shard& shard : shards_) {
+        std::lock_guard<std::mutex> guard(shard.latch);
+        for (auto it = shard.chains.begin(); it != shard.chains.end();) {
+            std::vector<Version>& chain = it->second;
+            size_t keep = chain.size();
+            for (size_t i = 0; i < chain.size(); i++) {
+                if (oldest.Sees(*chain[i].writer)) {
+                    keep = i;
+                    break;
+                }
+            }
+            dropped += chain.size() - keep;
+            chain.resize(keep);
+            if (chain.empty()) {
+                it = shard.chains.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    size_.fetch_sub(dropped, std::memory_order_relaxed);
+    return dropped;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "concurrency/transaction.h"
+#include "storage_engine/common/bson_types.h"
+#include "storage_engine/page/slotted_page.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct RecordIDHash {
+    size_t operator()(const RecordID& rid) const {
+        return std::hash<uint64_t>()((static_cast<uint64_t>(rid.page_id) << 16) | rid.slot_id);
+    }
+};
+
+// ============================================================================
+// VersionStore — older versions of a collection's recently changed records
+//
+// The heap holds only the newest version of each record, committed or
+// not. Before a transaction changes a record it installs the version it
+// replaces here (nothing, for an insert), chained newest first, tagged
+// with the writer's TxnStamp:
+//
+//   heap: v3      chain: [writer T3, image v2] → [writer T2, image v1]
+//
+// A snapshot reads the result of the newest writer it sees: the heap for
+// the head (T3), else the image the next newer writer replaced (a
+// snapshot seeing only T2 reads v2); one that sees no writer on the
+// chain reads the oldest image (v1). Only records written since the
+// oldest registered snapshot began have a chain (see Prune), so a reader
+// finds most records here missing and takes the heap's bytes as they are.
+//
+// Writers install before touching the heap (inserts under the page latch,
+// through the heap's insert listener), so a reader that sees a change in
+// the heap always finds the chain that hides it.
+// ============================================================================
+class VersionStore {
+public:
+    static constexpr size_t NUM_SHARDS = 16;
+
+    enum class Visible : uint8_t {
+        CURRENT,  // What the heap holds now (if anything)
+        VERSION,  // An older version, copied out
+        NONE      // Not there for this snapshot (inserted after, or deleted before)
+    };
+
+    // txn is about to change the record at rid, which holds before now
+    // (nullptr: nothing, rid is being inserted). A no-op without a txn,
+    // or if txn already changed rid.
+    void Install(const RecordID& rid, const BsonDocument* before, const Transaction* txn);
+
+    // Take back the version txn installed at rid, once the heap holds its
+    // image again (a failed write put the record back). A no-op unless
+    // txn's version is the newest.
+    void Discard(const RecordID& rid, const Transaction* txn);
+
+    // The version of rid snapshot reads; *out is set for VERSION
+    Visible Resolve(const RecordID& rid, const Snapshot& snapshot, BsonDocument* out) const;
+
+    // Every record that has a chain now
+    std::vector<RecordID> Changed() const;
+
+    // Drop the versions no snapshot reading at oldest_read_ts or later can
+    // need: those behind a writer stamped at or before it.
+    // Returns how many were dropped.
+    size_t Prune(uint64_t oldest_read_ts);
+
+    // Versions held
+    size_t Size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+    struct Version {
+        std::shared_ptr<TxnStamp> writer;  // Replaced image with the next newer version
+        bool existed = false;              // image holds a document (false before an insert)
+        BsonDocument image;
+    };
+
+    struct Shard {
+        mutable std::mutex latch;
+        std::unordered_map<RecordID, std::vector<Version>, RecordIDHash> chains;  // Newest first
+    };
+
+    Shard& ShardFor(const RecordID& rid) { return shards_[RecordIDHash()(rid) % NUM_SHARDS]; }
+    const Shard& ShardFor(const RecordID& rid) const { return shards_[RecordIDHash()(rid) % NUM_SHARDS]; }
+
+    std::array<Shard, NUM_SHARDS> shards_;
+    std::atomic<size_t> size_{0};
+};
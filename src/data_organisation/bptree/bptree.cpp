@@ -1,419 +1,1174 @@
 #include "bptree.h"
+#include "storage_engine/common/metrics.h"
 #include <algorithm>
+#include <cstddef>
 #include <iostream>
 #include <stdexcept>
 
 // ============================================================================
-// Node Header I/O
+// Node access — header, slots and cells, read in place
 // ============================================================================
 
-void BPlusTree::WriteNodeHeader(char* page_data, const BTreeNodeHeader& header) {
-    size_t offset = 0;
-    page_data[offset++] = header.is_leaf;
-    std::memcpy(page_data + offset, &header.num_keys, sizeof(uint16_t));
-    offset += sizeof(uint16_t);
-    std::memcpy(page_data + offset, &header.next_leaf, sizeof(page_id_t));
+BTreeNodeHeader* BPlusTree::Header(char* page_data) {
+    return reinterpret_cast<BTreeNodeHeader*>(page_data);
 }
 
-BTreeNodeHeader BPlusTree::ReadNodeHeader(const char* page_data) {
-    BTreeNodeHeader header;
-    size_t offset = 0;
-    header.is_leaf = page_data[offset++];
-    std::memcpy(&header.num_keys, page_data + offset, sizeof(uint16_t));
-    offset += sizeof(uint16_t);
-    std::memcpy(&header.next_leaf, page_data + offset, sizeof(page_id_t));
-    return header;
+const BTreeNodeHeader* BPlusTree::Header(const char* page_data) {
+    return reinterpret_cast<const BTreeNodeHeader*>(page_data);
 }
 
-// ============================================================================
-// Leaf Node I/O
-// Format after header: [key_len(2)][key_data...][page_id(4)][slot_id(2)] ...
-// ============================================================================
+void BPlusTree::InitNode(char* page_data, uint32_t page_size, bool is_leaf) {
+    BTreeNodeHeader* header = Header(page_data);
+    std::memset(header, 0, sizeof(BTreeNodeHeader));
+    header->is_leaf = is_leaf ? 1 : 0;
+    header->num_keys = 0;
+    header->cell_start = static_cast<uint16_t>(page_size);
+    header->next_leaf = INVALID_PAGE_ID;
+    header->leftmost_child = INVALID_PAGE_ID;
+}
+
+void BPlusTree::InitLeaf(char* page_data, uint32_t page_size) {
+    std::memset(page_data, 0, page_size);
+    InitNode(page_data, page_size, true);
+}
+
+static inline uint16_t SlotOffset(const char* page_data, uint16_t index) {
+    uint16_t prefix_len;
+    std::memcpy(&prefix_len, page_data + offsetof(BTreeNodeHeader, prefix_len), sizeof(uint16_t));
+    uint16_t offset;
+    std::memcpy(&offset, page_data + BTREE_NODE_HEADER_SIZE + prefix_len + index * sizeof(uint16_t),
+                sizeof(uint16_t));
+    return offset;
+}
 
-void BPlusTree::ReadLeafNode(const char* page_data, std::vector<std::string>& keys, std::vector<RecordID>& rids) {
-    BTreeNodeHeader header = ReadNodeHeader(page_data);
-    size_t offset = BTREE_NODE_HEADER_SIZE;
+static size_t CommonPrefixLength(std::string_view a, std::string_view b) {
+    size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
 
-    for (uint16_t i = 0; i < header.num_keys; ++i) {
-        // Read key
-        uint16_t key_len;
-        std::memcpy(&key_len, page_data + offset, sizeof(uint16_t));
-        offset += sizeof(uint16_t);
-        std::string key(page_data + offset, key_len);
-        offset += key_len;
+// 0 if key starts with prefix; otherwise whether key sorts before (< 0)
+// or after (> 0) every key that does
+static int ComparePrefix(std::string_view prefix, std::string_view key) {
+    size_t n = std::min(prefix.size(), key.size());
+    int c = key.substr(0, n).compare(prefix.substr(0, n));
+    if (c != 0) return c;
+    return key.size() < prefix.size() ? -1 : 0;
+}
 
-        // Read RecordID
-        RecordID rid;
-        std::memcpy(&rid.page_id, page_data + offset, sizeof(page_id_t));
-        offset += sizeof(page_id_t);
-        std::memcpy(&rid.slot_id, page_data + offset, sizeof(uint16_t));
-        offset += sizeof(uint16_t);
+std::string_view BPlusTree::Prefix(const char* page_data) {
+    return std::string_view(page_data + BTREE_NODE_HEADER_SIZE, Header(page_data)->prefix_len);
+}
 
-        keys.push_back(key);
-        rids.push_back(rid);
-    }
+std::string_view BPlusTree::SuffixAt(const char* page_data, uint16_t index) {
+    const char* cell = page_data + SlotOffset(page_data, index);
+    uint16_t suffix_len;
+    std::memcpy(&suffix_len, cell, sizeof(uint16_t));
+    return std::string_view(cell + sizeof(uint16_t), suffix_len);
 }
 
-void BPlusTree::WriteLeafNode(char* page_data, const std::vector<std::string>& keys, const std::vector<RecordID>& rids, page_id_t next_leaf) {
-    BTreeNodeHeader header;
-    header.is_leaf = 1;
-    header.num_keys = static_cast<uint16_t>(keys.size());
-    header.next_leaf = next_leaf;
-    WriteNodeHeader(page_data, header);
+std::string BPlusTree::FullKeyAt(const char* page_data, uint16_t index) {
+    std::string key(Prefix(page_data));
+    key.append(SuffixAt(page_data, index));
+    return key;
+}
+
+const char* BPlusTree::ValueAt(const char* page_data, uint16_t index) {
+    std::string_view suffix = SuffixAt(page_data, index);
+    return suffix.data() + suffix.size();
+}
+
+RecordID BPlusTree::RidAt(const char* page_data, uint16_t index) {
+    // The RecordID ends the entry key; when a node's entries share their
+    // leading RecordID bytes, part of it sits in the prefix
+    std::string_view prefix = Prefix(page_data);
+    std::string_view suffix = SuffixAt(page_data, index);
+    unsigned char tail[BTREE_RID_SIZE];
+    size_t from_suffix = std::min<size_t>(suffix.size(), BTREE_RID_SIZE);
+    size_t from_prefix = BTREE_RID_SIZE - from_suffix;
+    std::memcpy(tail, prefix.data() + prefix.size() - from_prefix, from_prefix);
+    std::memcpy(tail + from_prefix, suffix.data() + suffix.size() - from_suffix, from_suffix);
+
+    RecordID rid;
+    rid.page_id = static_cast<page_id_t>((uint32_t{tail[0]} << 24) | (uint32_t{tail[1]} << 16) |
+                                         (uint32_t{tail[2]} << 8) | tail[3]);
+    rid.slot_id = static_cast<uint16_t>((tail[4] << 8) | tail[5]);
+    return rid;
+}
+
+page_id_t BPlusTree::ChildAt(const char* page_data, uint16_t child_index) {
+    if (child_index == 0) return Header(page_data)->leftmost_child;
+    page_id_t child;
+    std::memcpy(&child, ValueAt(page_data, child_index - 1), sizeof(page_id_t));
+    return child;
+}
+
+bool BPlusTree::KeyEquals(const char* page_data, uint16_t index, std::string_view key) {
+    std::string_view prefix = Prefix(page_data);
+    return ComparePrefix(prefix, key) == 0 && SuffixAt(page_data, index) == key.substr(prefix.size());
+}
+
+uint16_t BPlusTree::LowerBound(const char* page_data, std::string_view key) {
+    uint16_t num_keys = Header(page_data)->num_keys;
+    std::string_view prefix = Prefix(page_data);
+    int c = ComparePrefix(prefix, key);
+    if (c != 0) return c < 0 ? 0 : num_keys;
+
+    std::string_view rest = key.substr(prefix.size());
+    uint16_t lo = 0, hi = num_keys;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        if (SuffixAt(page_data, mid) < rest) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
 
-    size_t offset = BTREE_NODE_HEADER_SIZE;
-    for (size_t i = 0; i < keys.size(); ++i) {
-        uint16_t key_len = static_cast<uint16_t>(keys[i].size());
-        std::memcpy(page_data + offset, &key_len, sizeof(uint16_t));
-        offset += sizeof(uint16_t);
-        std::memcpy(page_data + offset, keys[i].data(), key_len);
-        offset += key_len;
-        std::memcpy(page_data + offset, &rids[i].page_id, sizeof(page_id_t));
-        offset += sizeof(page_id_t);
-        std::memcpy(page_data + offset, &rids[i].slot_id, sizeof(uint16_t));
-        offset += sizeof(uint16_t);
+uint16_t BPlusTree::UpperBound(const char* page_data, std::string_view key) {
+    uint16_t num_keys = Header(page_data)->num_keys;
+    std::string_view prefix = Prefix(page_data);
+    int c = ComparePrefix(prefix, key);
+    if (c != 0) return c < 0 ? 0 : num_keys;
+
+    std::string_view rest = key.substr(prefix.size());
+    uint16_t lo = 0, hi = num_keys;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        if (rest < SuffixAt(page_data, mid)) hi = mid;
+        else lo = mid + 1;
     }
+    return lo;
 }
 
 // ============================================================================
-// Internal Node I/O
-// Format after header: [child0(4)][key_len(2)][key_data...][child1(4)]...
+// Cell insertion / removal
 // ============================================================================
 
-void BPlusTree::ReadInternalNode(const char* page_data, std::vector<std::string>& keys, std::vector<page_id_t>& children) {
-    BTreeNodeHeader header = ReadNodeHeader(page_data);
-    size_t offset = BTREE_NODE_HEADER_SIZE;
+static inline char* SlotArray(char* page_data) {
+    const BTreeNodeHeader* header = reinterpret_cast<const BTreeNodeHeader*>(page_data);
+    return page_data + BTREE_NODE_HEADER_SIZE + header->prefix_len;
+}
 
-    // Read first child
-    page_id_t child;
-    std::memcpy(&child, page_data + offset, sizeof(page_id_t));
-    offset += sizeof(page_id_t);
-    children.push_back(child);
+bool BPlusTree::AppendCell(char* page_data, std::string_view suffix, const char* value, uint16_t value_len) {
+    BTreeNodeHeader* header = Header(page_data);
+    size_t cell_len = sizeof(uint16_t) + suffix.size() + value_len;
+    size_t slots_end = BTREE_NODE_HEADER_SIZE + header->prefix_len +
+                       (header->num_keys + 1) * sizeof(uint16_t);
+    if (slots_end + cell_len > header->cell_start) return false;
+
+    header->cell_start = static_cast<uint16_t>(header->cell_start - cell_len);
+    char* cell = page_data + header->cell_start;
+    uint16_t suffix_len = static_cast<uint16_t>(suffix.size());
+    std::memcpy(cell, &suffix_len, sizeof(uint16_t));
+    std::memcpy(cell + sizeof(uint16_t), suffix.data(), suffix.size());
+    std::memcpy(cell + sizeof(uint16_t) + suffix.size(), value, value_len);
+
+    std::memcpy(SlotArray(page_data) + header->num_keys * sizeof(uint16_t),
+                &header->cell_start, sizeof(uint16_t));
+    header->num_keys++;
+    return true;
+}
+
+bool BPlusTree::InsertCell(char* page_data, uint16_t pos, std::string_view key,
+                           const char* value, uint16_t value_len) {
+    BTreeNodeHeader* header = Header(page_data);
+    std::string_view suffix = key.substr(header->prefix_len);
+    size_t cell_len = sizeof(uint16_t) + suffix.size() + value_len;
+    size_t slots_end = BTREE_NODE_HEADER_SIZE + header->prefix_len +
+                       (header->num_keys + 1) * sizeof(uint16_t);
+
+    if (slots_end + cell_len > header->cell_start) {
+        // Not enough contiguous room; see whether deleted cells would make it
+        size_t live = 0;
+        for (uint16_t i = 0; i < header->num_keys; i++) {
+            live += sizeof(uint16_t) + SuffixAt(page_data, i).size() + value_len;
+        }
+        if (slots_end + live + cell_len > page_size_) return false;
+        Compact(page_data);
+    }
+
+    // Write the cell, then open a gap in the slot array for it
+    header->cell_start = static_cast<uint16_t>(header->cell_start - cell_len);
+    char* cell = page_data + header->cell_start;
+    uint16_t suffix_len = static_cast<uint16_t>(suffix.size());
+    std::memcpy(cell, &suffix_len, sizeof(uint16_t));
+    std::memcpy(cell + sizeof(uint16_t), suffix.data(), suffix.size());
+    std::memcpy(cell + sizeof(uint16_t) + suffix.size(), value, value_len);
+
+    char* slots = SlotArray(page_data);
+    std::memmove(slots + (pos + 1) * sizeof(uint16_t), slots + pos * sizeof(uint16_t),
+                 (header->num_keys - pos) * sizeof(uint16_t));
+    std::memcpy(slots + pos * sizeof(uint16_t), &header->cell_start, sizeof(uint16_t));
+    header->num_keys++;
+    return true;
+}
 
-    for (uint16_t i = 0; i < header.num_keys; ++i) {
-        // Read key
-        uint16_t key_len;
-        std::memcpy(&key_len, page_data + offset, sizeof(uint16_t));
-        offset += sizeof(uint16_t);
-        std::string key(page_data + offset, key_len);
-        offset += key_len;
-        keys.push_back(key);
+void BPlusTree::RemoveCell(char* page_data, uint16_t pos) {
+    BTreeNodeHeader* header = Header(page_data);
+    char* slots = SlotArray(page_data);
+    std::memmove(slots + pos * sizeof(uint16_t), slots + (pos + 1) * sizeof(uint16_t),
+                 (header->num_keys - pos - 1) * sizeof(uint16_t));
+    header->num_keys--;
+}
 
-        // Read next child
-        std::memcpy(&child, page_data + offset, sizeof(page_id_t));
-        offset += sizeof(page_id_t);
-        children.push_back(child);
+void BPlusTree::Compact(char* page_data) {
+    std::vector<char> copy(page_data, page_data + page_size_);
+    const char* src = copy.data();
+    const BTreeNodeHeader* old_header = Header(src);
+    uint16_t value_len = old_header->is_leaf ? BTREE_LEAF_VALUE_SIZE : BTREE_INTERNAL_VALUE_SIZE;
+
+    InitNode(page_data, page_size_, old_header->is_leaf);
+    BTreeNodeHeader* header = Header(page_data);
+    header->next_leaf = old_header->next_leaf;
+    header->leftmost_child = old_header->leftmost_child;
+    header->prefix_len = old_header->prefix_len;
+    std::memcpy(page_data + BTREE_NODE_HEADER_SIZE, src + BTREE_NODE_HEADER_SIZE, old_header->prefix_len);
+    for (uint16_t i = 0; i < old_header->num_keys; i++) {
+        AppendCell(page_data, SuffixAt(src, i), ValueAt(src, i), value_len);
     }
 }
 
-void BPlusTree::WriteInternalNode(char* page_data, const std::vector<std::string>& keys, const std::vector<page_id_t>& children) {
-    BTreeNodeHeader header;
-    header.is_leaf = 0;
-    header.num_keys = static_cast<uint16_t>(keys.size());
-    header.next_leaf = INVALID_PAGE_ID;
-    WriteNodeHeader(page_data, header);
+// ============================================================================
+// Node rebuild — used when the prefix changes and by splits
+// ============================================================================
 
-    size_t offset = BTREE_NODE_HEADER_SIZE;
+std::vector<BPlusTree::Entry> BPlusTree::CollectEntries(const char* page_data, uint16_t pos,
+                                                        std::string_view key, const char* value,
+                                                        std::vector<char>* copy) {
+    copy->assign(page_data, page_data + page_size_);
+    const char* src = copy->data();
+    uint16_t num_keys = Header(src)->num_keys;
+
+    std::vector<Entry> entries;
+    entries.reserve(num_keys + 1);
+    for (uint16_t i = 0; i <= num_keys; i++) {
+        if (i == pos) entries.push_back(Entry{std::string(key), value});
+        if (i < num_keys) entries.push_back(Entry{FullKeyAt(src, i), ValueAt(src, i)});
+    }
+    return entries;
+}
 
-    // Write first child
-    std::memcpy(page_data + offset, &children[0], sizeof(page_id_t));
-    offset += sizeof(page_id_t);
+size_t BPlusTree::NodeSize(const std::vector<Entry>& entries, size_t first, size_t last,
+                           uint16_t value_len) {
+    size_t prefix = last > first ? CommonPrefixLength(entries[first].key, entries[last - 1].key) : 0;
+    size_t size = BTREE_NODE_HEADER_SIZE + prefix;
+    for (size_t i = first; i < last; i++) {
+        size += 2 * sizeof(uint16_t) + entries[i].key.size() - prefix + value_len;
+    }
+    return size;
+}
 
-    for (size_t i = 0; i < keys.size(); ++i) {
-        uint16_t key_len = static_cast<uint16_t>(keys[i].size());
-        std::memcpy(page_data + offset, &key_len, sizeof(uint16_t));
-        offset += sizeof(uint16_t);
-        std::memcpy(page_data + offset, keys[i].data(), key_len);
-        offset += key_len;
-        std::memcpy(page_data + offset, &children[i + 1], sizeof(page_id_t));
-        offset += sizeof(page_id_t);
+void BPlusTree::WriteNode(char* page_data, bool is_leaf, const std::vector<Entry>& entries,
+                          size_t first, size_t last) {
+    uint16_t value_len = is_leaf ? BTREE_LEAF_VALUE_SIZE : BTREE_INTERNAL_VALUE_SIZE;
+    // Keys are sorted, so what the first and last share, all of them share
+    size_t prefix = last > first ? CommonPrefixLength(entries[first].key, entries[last - 1].key) : 0;
+
+    InitNode(page_data, page_size_, is_leaf);
+    Header(page_data)->prefix_len = static_cast<uint16_t>(prefix);
+    if (prefix > 0) std::memcpy(page_data + BTREE_NODE_HEADER_SIZE, entries[first].key.data(), prefix);
+    for (size_t i = first; i < last; i++) {
+        AppendCell(page_data, std::string_view(entries[i].key).substr(prefix), entries[i].value, value_len);
     }
 }
 
 // ============================================================================
-// Constructor — if root page doesn't exist, create an empty leaf
+// Entry keys — big-endian RecordID after the user key, so that entries of
+// one key sort by RecordID
 // ============================================================================
 
-BPlusTree::BPlusTree(BufferPoolManager* bpm, page_id_t root_page_id, uint16_t max_keys)
-    : bpm_(bpm), root_page_id_(root_page_id), max_keys_(max_keys) {}
+std::string BPlusTree::EntryKey(const std::string& key, const RecordID& rid) {
+    std::string entry_key;
+    entry_key.reserve(key.size() + BTREE_RID_SIZE);
+    entry_key.append(key);
+    uint32_t page = static_cast<uint32_t>(rid.page_id);
+    entry_key.push_back(static_cast<char>(page >> 24));
+    entry_key.push_back(static_cast<char>(page >> 16));
+    entry_key.push_back(static_cast<char>(page >> 8));
+    entry_key.push_back(static_cast<char>(page));
+    entry_key.push_back(static_cast<char>(rid.slot_id >> 8));
+    entry_key.push_back(static_cast<char>(rid.slot_id));
+    return entry_key;
+}
+
+std::string_view BPlusTree::UserKey(std::string_view entry_key) {
+    return entry_key.substr(0, entry_key.size() - BTREE_RID_SIZE);
+}
+
+// The smallest entry key a user key can have (below any real RecordID)
+static std::string LowestEntryKey(const std::string& key) {
+    return key + std::string(BTREE_RID_SIZE, '\0');
+}
 
 // ============================================================================
-// FindLeaf — traverse from root to the leaf that should contain key
+// Constructor
 // ============================================================================
 
-page_id_t BPlusTree::FindLeaf(const std::string& key) {
-    page_id_t current = root_page_id_;
+BPlusTree::BPlusTree(BufferPoolManager* bpm, page_id_t root_page_id, uint16_t max_keys)
+    : bpm_(bpm), root_page_id_(root_page_id),
+      max_keys_(max_keys),
+      page_size_(bpm->GetPageSize()) {}
 
-    while (true) {
-        Page* page = bpm_->FetchPage(current);
-        if (!page) return INVALID_PAGE_ID;
+page_id_t BPlusTree::GetRootPageId() const {
+    std::shared_lock<std::shared_mutex> guard(root_latch_);
+    return root_page_id_;
+}
 
-        BTreeNodeHeader header = ReadNodeHeader(page->GetData());
+void BPlusTree::SetRootPageId(page_id_t pid) {
+    std::unique_lock<std::shared_mutex> guard(root_latch_);
+    root_page_id_ = pid;
+}
 
-        if (header.is_leaf) {
-            bpm_->UnpinPage(current, false);
-            return current;
-        }
+// ============================================================================
+// Space checks — will an insert fit without splitting the node?
+// ============================================================================
 
-        // Internal node — find the correct child
-        std::vector<std::string> keys;
-        std::vector<page_id_t> children;
-        ReadInternalNode(page->GetData(), keys, children);
-        bpm_->UnpinPage(current, false);
+size_t BPlusTree::FreeBytes(const char* page_data) const {
+    const BTreeNodeHeader* header = Header(page_data);
+    uint16_t value_len = header->is_leaf ? BTREE_LEAF_VALUE_SIZE : BTREE_INTERNAL_VALUE_SIZE;
+    size_t used = BTREE_NODE_HEADER_SIZE + header->prefix_len + header->num_keys * sizeof(uint16_t);
+    size_t gap = header->cell_start - used;
+    if (gap == page_size_ - used) return gap;  // No cells, nothing fragmented
 
-        // Binary search for the correct child
-        size_t idx = 0;
-        while (idx < keys.size() && key >= keys[idx]) {
-            idx++;
-        }
-        current = children[idx];
+    // Dead cells count too: InsertCell compacts them away
+    for (uint16_t i = 0; i < header->num_keys; i++) {
+        used += sizeof(uint16_t) + SuffixAt(page_data, i).size() + value_len;
     }
+    return page_size_ - used;
 }
 
-// ============================================================================
-// Search — find exact key
-// ============================================================================
+bool BPlusTree::HasRoomFor(const char* page_data, std::string_view key, uint16_t value_len) const {
+    const BTreeNodeHeader* header = Header(page_data);
+    if (max_keys_ != 0 && header->num_keys >= max_keys_) return false;
+    if (ComparePrefix(Prefix(page_data), key) != 0) return false;  // Would rewrite the node
 
-RecordID BPlusTree::Search(const std::string& key) {
-    page_id_t leaf_page = FindLeaf(key);
-    if (leaf_page == INVALID_PAGE_ID) return INVALID_RECORD_ID;
+    size_t need = 2 * sizeof(uint16_t) + key.size() - header->prefix_len + value_len;
+    size_t used = BTREE_NODE_HEADER_SIZE + header->prefix_len + header->num_keys * sizeof(uint16_t);
+    return header->cell_start - used >= need || FreeBytes(page_data) >= need;
+}
+
+bool BPlusTree::SafeForChildSplit(const char* page_data) const {
+    const BTreeNodeHeader* header = Header(page_data);
+    if (max_keys_ != 0 && header->num_keys >= max_keys_) return false;
 
-    Page* page = bpm_->FetchPage(leaf_page);
-    if (!page) return INVALID_RECORD_ID;
+    // The largest possible separator, after the prefix has been dropped
+    // for it in the worst case
+    size_t need = 2 * sizeof(uint16_t) + MaxKeySize() + BTREE_RID_SIZE + BTREE_INTERNAL_VALUE_SIZE +
+                  static_cast<size_t>(header->prefix_len) * header->num_keys;
+    return FreeBytes(page_data) >= need;
+}
+
+bool BPlusTree::Underfull(const char* page_data) const {
+    const BTreeNodeHeader* header = Header(page_data);
+    if (max_keys_ != 0) return header->num_keys < max_keys_ / 2;
+    return page_size_ - FreeBytes(page_data) < page_size_ / 4;
+}
 
-    std::vector<std::string> keys;
-    std::vector<RecordID> rids;
-    ReadLeafNode(page->GetData(), keys, rids);
-    bpm_->UnpinPage(leaf_page, false);
+bool BPlusTree::SafeForRemove(const char* page_data) const {
+    const BTreeNodeHeader* header = Header(page_data);
+    // An internal node must keep a key to keep two children
+    if (!header->is_leaf && header->num_keys < 2) return false;
+    if (max_keys_ != 0) return header->num_keys > max_keys_ / 2;
+
+    size_t largest = 2 * sizeof(uint16_t) + MaxKeySize() + BTREE_RID_SIZE + BTREE_INTERNAL_VALUE_SIZE;
+    size_t used = page_size_ - FreeBytes(page_data);
+    return used >= page_size_ / 4 + largest;
+}
+
+// ============================================================================
+// FindLeaf — crab down from the root with shared latches
+//
+// The child is latched before the parent is let go. The root latch is
+// held until the root page itself is latched, so a root split cannot
+// slip in between reading root_page_id_ and latching that page. With
+// write_leaf the leaf ends up exclusively latched instead: it is first
+// latched shared to learn it is a leaf, then re-latched exclusively while
+// the parent is still held, so it cannot split in between.
+// ============================================================================
 
-    for (size_t i = 0; i < keys.size(); ++i) {
-        if (keys[i] == key) {
-            return rids[i];
+Page* BPlusTree::FindLeaf(const std::string& key, page_id_t* leaf_page_id, bool write_leaf) {
+    std::shared_lock<std::shared_mutex> root_guard(root_latch_);
+    page_id_t current = root_page_id_;
+    Page* page = bpm_->FetchPage(current);
+    if (!page) return nullptr;
+    page->RLatch();
+    if (write_leaf && Header(page->GetData())->is_leaf) {
+        page->RUnlatch();
+        page->WLatch();
+    }
+    root_guard.unlock();
+
+    while (!Header(page->GetData())->is_leaf) {
+        // Internal node — the child left of the first key greater than ours
+        const char* data = page->GetData();
+        page_id_t child_id = ChildAt(data, UpperBound(data, key));
+        Page* child = bpm_->FetchPage(child_id);
+        if (!child) {
+            page->RUnlatch();
+            bpm_->UnpinPage(current, false);
+            return nullptr;
         }
+        child->RLatch();
+        if (write_leaf && Header(child->GetData())->is_leaf) {
+            child->RUnlatch();
+            child->WLatch();
+        }
+        page->RUnlatch();
+        bpm_->UnpinPage(current, false);
+        page = child;
+        current = child_id;
     }
 
-    return INVALID_RECORD_ID;
+    *leaf_page_id = current;
+    return page;
 }
 
 // ============================================================================
-// Insert
+// Search — the first entry at or after (key, lowest RecordID)
 // ============================================================================
 
-void BPlusTree::Insert(const std::string& key, const RecordID& rid) {
-    InsertResult result = InsertInternal(root_page_id_, key, rid);
-
-    if (result.did_split) {
-        // Root was split — create a new root
-        page_id_t new_root_id;
-        Page* new_root = bpm_->NewPage(&new_root_id);
-        if (!new_root) {
-            throw std::runtime_error("BPlusTree: Failed to allocate new root page");
+RecordID BPlusTree::Search(const std::string& key) {
+    std::string lo = LowestEntryKey(key);
+    page_id_t leaf_page;
+    Page* page = FindLeaf(lo, &leaf_page, false);
+
+    // The first entry may open the next leaf when lo sorts after this one's
+    // last; latch the right sibling before letting go of the left
+    while (page) {
+        const char* data = page->GetData();
+        uint16_t pos = LowerBound(data, lo);
+        if (pos < Header(data)->num_keys) {
+            RecordID result = INVALID_RECORD_ID;
+            if (UserKey(FullKeyAt(data, pos)) == key) result = RidAt(data, pos);
+            page->RUnlatch();
+            bpm_->UnpinPage(leaf_page, false);
+            return result;
         }
 
-        std::memset(new_root->GetData(), 0, 4096);
+        page_id_t next_page = Header(data)->next_leaf;
+        Page* next = next_page == INVALID_PAGE_ID ? nullptr : bpm_->FetchPage(next_page);
+        if (next) next->RLatch();
+        page->RUnlatch();
+        bpm_->UnpinPage(leaf_page, false);
+        page = next;
+        leaf_page = next_page;
+    }
+    return INVALID_RECORD_ID;
+}
 
-        std::vector<std::string> keys = {result.split_key};
-        std::vector<page_id_t> children = {root_page_id_, result.new_page_id};
-        WriteInternalNode(new_root->GetData(), keys, children);
+// ============================================================================
+// Insert — optimistic first, pessimistic if the leaf has to split
+// ============================================================================
 
-        bpm_->UnpinPage(new_root_id, true);
-        root_page_id_ = new_root_id;
+void BPlusTree::Insert(const std::string& key, const RecordID& rid) {
+    if (key.size() > MaxKeySize()) {
+        throw std::runtime_error("BPlusTree: key of " + std::to_string(key.size()) +
+                                 " bytes exceeds the " + std::to_string(MaxKeySize()) + " byte limit");
+    }
+    std::string entry_key = EntryKey(key, rid);
+    if (!InsertOptimistic(entry_key)) {
+        InsertPessimistic(entry_key);
     }
 }
 
-BPlusTree::InsertResult BPlusTree::InsertInternal(page_id_t node_page_id, const std::string& key, const RecordID& rid) {
-    Page* page = bpm_->FetchPage(node_page_id);
+// Shared latches down to the leaf, an exclusive one on the leaf alone.
+// Gives up (false) if the leaf has no room, before changing anything.
+bool BPlusTree::InsertOptimistic(const std::string& key) {
+    page_id_t leaf_page;
+    Page* page = FindLeaf(key, &leaf_page, true);
     if (!page) {
         throw std::runtime_error("BPlusTree: Failed to fetch page");
     }
+    char* data = page->GetData();
+
+    // key is an entry key: equal user keys already differ by RecordID
+    uint16_t pos = LowerBound(data, key);
+    bool exists = pos < Header(data)->num_keys && KeyEquals(data, pos, key);
+    bool fits = exists || HasRoomFor(data, key, BTREE_LEAF_VALUE_SIZE);
+    if (fits && !exists) {
+        InsertCell(data, pos, key, key.data(), BTREE_LEAF_VALUE_SIZE);
+    }
+    page->WUnlatch();
+    bpm_->UnpinPage(leaf_page, fits && !exists);
+    return fits;
+}
 
-    BTreeNodeHeader header = ReadNodeHeader(page->GetData());
-
-    if (header.is_leaf) {
-        // ---- LEAF INSERT ----
-        std::vector<std::string> keys;
-        std::vector<RecordID> rids;
-        ReadLeafNode(page->GetData(), keys, rids);
-
-        // Find insertion position (sorted order)
-        auto it = std::lower_bound(keys.begin(), keys.end(), key);
-        size_t pos = it - keys.begin();
+// Exclusive latches from the root down. Once a node is sure not to split
+// (it has room for whatever its child might push up), every latch above it,
+// and the root latch, is released: a split can only reach as far up as the
+// nodes still held.
+void BPlusTree::InsertPessimistic(const std::string& key) {
+    struct PathNode {
+        Page* page;
+        page_id_t page_id;
+        uint16_t child_idx;  // Child followed from this node
+    };
+    std::vector<PathNode> path;
+    size_t modified_from = SIZE_MAX;  // path[i] for i >= this were changed
+
+    std::unique_lock<std::shared_mutex> root_guard(root_latch_);
+    auto release = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            path[i].page->WUnlatch();
+            bpm_->UnpinPage(path[i].page_id, i >= modified_from);
+        }
+    };
+
+    try {
+        page_id_t current = root_page_id_;
+        while (true) {
+            Page* page = bpm_->FetchPage(current);
+            if (!page) {
+                throw std::runtime_error("BPlusTree: Failed to fetch page");
+            }
+            page->WLatch();
+            path.push_back(PathNode{page, current, 0});
+
+            const char* data = page->GetData();
+            bool is_leaf = Header(data)->is_leaf;
+            bool safe = is_leaf ? HasRoomFor(data, key, BTREE_LEAF_VALUE_SIZE) : SafeForChildSplit(data);
+            if (safe) {
+                release(0, path.size() - 1);
+                path.erase(path.begin(), path.end() - 1);
+                if (root_guard.owns_lock()) root_guard.unlock();
+            }
+            if (is_leaf) break;
 
-        // Allow duplicate keys (non-unique indexes)
-        // Skip to after existing entries with the same key
-        while (it != keys.end() && *it == key) {
-            ++it;
-            ++pos;
+            path.back().child_idx = UpperBound(data, key);
+            current = ChildAt(data, path.back().child_idx);
         }
 
-        keys.insert(it, key);
-        rids.insert(rids.begin() + pos, rid);
+        size_t level = path.size() - 1;
+        char* leaf = path[level].page->GetData();
+        uint16_t pos = LowerBound(leaf, key);
+        if (pos < Header(leaf)->num_keys && KeyEquals(leaf, pos, key)) {
+            release(0, path.size());
+            return;
+        }
 
-        if (keys.size() <= max_keys_) {
-            // No split needed
-            std::memset(page->GetData(), 0, 4096);
-            WriteLeafNode(page->GetData(), keys, rids, header.next_leaf);
-            bpm_->UnpinPage(node_page_id, true);
-            return {false, "", INVALID_PAGE_ID};
+        modified_from = level;
+        InsertResult result = InsertIntoNode(path[level].page, pos, key, key.data(), BTREE_LEAF_VALUE_SIZE);
+
+        // Child split — the new key goes at child_idx, its right child after it
+        while (result.did_split && level > 0) {
+            level--;
+            modified_from = level;
+            std::string split_key = std::move(result.split_key);
+            page_id_t new_child = result.new_page_id;
+            result = InsertIntoNode(path[level].page, path[level].child_idx, split_key,
+                                    reinterpret_cast<const char*>(&new_child), BTREE_INTERNAL_VALUE_SIZE);
         }
 
-        // ---- LEAF SPLIT ----
-        size_t mid = keys.size() / 2;
+        if (result.did_split) {
+            // The root split (so the root latch was never released) — create a new root
+            page_id_t new_root_id;
+            Page* new_root = bpm_->NewPage(&new_root_id);
+            if (!new_root) {
+                throw std::runtime_error("BPlusTree: Failed to allocate new root page");
+            }
 
-        // Left half stays in current page
-        std::vector<std::string> left_keys(keys.begin(), keys.begin() + mid);
-        std::vector<RecordID> left_rids(rids.begin(), rids.begin() + mid);
+            char* data = new_root->GetData();
+            std::memset(data, 0, page_size_);
+            InitNode(data, page_size_, false);
+            Header(data)->leftmost_child = root_page_id_;
+            AppendCell(data, result.split_key, reinterpret_cast<const char*>(&result.new_page_id),
+                       BTREE_INTERNAL_VALUE_SIZE);
 
-        // Right half goes to new page
-        std::vector<std::string> right_keys(keys.begin() + mid, keys.end());
-        std::vector<RecordID> right_rids(rids.begin() + mid, rids.end());
+            bpm_->UnpinPage(new_root_id, true);
+            root_page_id_ = new_root_id;
+        }
+    } catch (...) {
+        release(0, path.size());
+        throw;
+    }
+    release(0, path.size());
+}
 
-        page_id_t new_page_id;
-        Page* new_page = bpm_->NewPage(&new_page_id);
-        if (!new_page) {
-            throw std::runtime_error("BPlusTree: Failed to allocate new leaf page");
+BPlusTree::InsertResult BPlusTree::InsertIntoNode(Page* page, uint16_t pos, std::string_view key,
+                                                  const char* value, uint16_t value_len) {
+    char* data = page->GetData();
+    bool capped = max_keys_ != 0 && Header(data)->num_keys >= max_keys_;
+    if (!capped) {
+        if (ComparePrefix(Prefix(data), key) == 0) {
+            if (InsertCell(data, pos, key, value, value_len)) {
+                return {false, "", INVALID_PAGE_ID};
+            }
+        } else {
+            // The key does not share the node's prefix: rewrite the node
+            // with a shorter one if everything still fits
+            std::vector<char> copy;
+            std::vector<Entry> entries = CollectEntries(data, pos, key, value, &copy);
+            if (NodeSize(entries, 0, entries.size(), value_len) <= page_size_) {
+                const BTreeNodeHeader* old_header = Header(copy.data());
+                WriteNode(data, old_header->is_leaf, entries, 0, entries.size());
+                Header(data)->next_leaf = old_header->next_leaf;
+                Header(data)->leftmost_child = old_header->leftmost_child;
+                return {false, "", INVALID_PAGE_ID};
+            }
         }
-        std::memset(new_page->GetData(), 0, 4096);
+    }
+    return SplitNode(page, pos, key, value, value_len);
+}
 
-        // Link: current → new → old_next
-        WriteLeafNode(new_page->GetData(), right_keys, right_rids, header.next_leaf);
-        bpm_->UnpinPage(new_page_id, true);
+// ============================================================================
+// SplitNode — divide the node's entries plus the new one across two pages
+//
+// The split point is the entry where the bytes, not the key counts, even
+// out. Leaf: entries [0, mid) stay, [mid, n] move right, and the shortest
+// key between the two halves goes up. Internal: entry mid moves up, its
+// child becomes the right node's leftmost child.
+// ============================================================================
 
-        std::memset(page->GetData(), 0, 4096);
-        WriteLeafNode(page->GetData(), left_keys, left_rids, new_page_id);
-        bpm_->UnpinPage(node_page_id, true);
+BPlusTree::InsertResult BPlusTree::SplitNode(Page* page, uint16_t pos, std::string_view key,
+                                             const char* value, uint16_t value_len) {
+    Metrics::Add(Counter::BTREE_SPLITS);
+    char* data = page->GetData();
+    std::vector<char> copy;
+    std::vector<Entry> entries = CollectEntries(data, pos, key, value, &copy);
+    const BTreeNodeHeader* old_header = Header(copy.data());
+    bool is_leaf = old_header->is_leaf;
+    page_id_t old_next_leaf = old_header->next_leaf;
+    page_id_t old_leftmost = old_header->leftmost_child;
+    size_t total = entries.size();
+
+    size_t total_bytes = 0;
+    for (const Entry& e : entries) total_bytes += e.key.size() + value_len;
+    size_t mid = 0;
+    for (size_t left_bytes = 0; mid < total && left_bytes * 2 < total_bytes; mid++) {
+        left_bytes += entries[mid].key.size() + value_len;
+    }
+    // Both halves need an entry (an internal right half gets its leftmost
+    // child from entry mid)
+    mid = std::max<size_t>(1, std::min(mid, is_leaf ? total - 1 : total - 2));
+
+    size_t right_from = is_leaf ? mid : mid + 1;
+    if (NodeSize(entries, 0, mid, value_len) > page_size_ ||
+        NodeSize(entries, right_from, total, value_len) > page_size_) {
+        throw std::runtime_error("BPlusTree: keys too large for a node");
+    }
 
-        return {true, right_keys[0], new_page_id};
+    std::string split_key = is_leaf ? Separator(entries[mid - 1].key, entries[mid].key) : entries[mid].key;
 
+    page_id_t new_page_id;
+    Page* new_page = bpm_->NewPage(&new_page_id);
+    if (!new_page) {
+        throw std::runtime_error(is_leaf ? "BPlusTree: Failed to allocate new leaf page"
+                                         : "BPlusTree: Failed to allocate new internal page");
+    }
+    char* right = new_page->GetData();
+    std::memset(right, 0, page_size_);
+
+    WriteNode(right, is_leaf, entries, right_from, total);
+    WriteNode(data, is_leaf, entries, 0, mid);
+    if (is_leaf) {
+        // Link: current → new → old_next. The new page is complete before
+        // the latched left page points at it.
+        Header(right)->next_leaf = old_next_leaf;
+        Header(data)->next_leaf = new_page_id;
     } else {
-        // ---- INTERNAL NODE ----
-        std::vector<std::string> keys;
-        std::vector<page_id_t> children;
-        ReadInternalNode(page->GetData(), keys, children);
-        bpm_->UnpinPage(node_page_id, false);
-
-        // Find which child to recurse into
-        size_t idx = 0;
-        while (idx < keys.size() && key >= keys[idx]) {
-            idx++;
-        }
+        Header(data)->leftmost_child = old_leftmost;
+        std::memcpy(&Header(right)->leftmost_child, entries[mid].value, sizeof(page_id_t));
+    }
 
-        InsertResult child_result = InsertInternal(children[idx], key, rid);
+    bpm_->UnpinPage(new_page_id, true);
+    return {true, split_key, new_page_id};
+}
 
-        if (!child_result.did_split) {
-            return {false, "", INVALID_PAGE_ID};
-        }
+std::string BPlusTree::Separator(const std::string& left_last, const std::string& right_first) {
+    if (!(left_last < right_first)) return right_first;
+    return right_first.substr(0, CommonPrefixLength(left_last, right_first) + 1);
+}
 
-        // Child split — insert the new key + child pointer
-        keys.insert(keys.begin() + idx, child_result.split_key);
-        children.insert(children.begin() + idx + 1, child_result.new_page_id);
-
-        if (keys.size() <= max_keys_) {
-            // No split needed at this level
-            Page* p = bpm_->FetchPage(node_page_id);
-            std::memset(p->GetData(), 0, 4096);
-            WriteInternalNode(p->GetData(), keys, children);
-            bpm_->UnpinPage(node_page_id, true);
-            return {false, "", INVALID_PAGE_ID};
-        }
+// ============================================================================
+// BulkLoad — pack sorted entries into leaves, then internal levels
+//
+// One node per level is open at a time. A node's size is tracked as
+// entries arrive: the keys are sorted, so the prefix it will be written
+// with is what its first and last key share.
+// ============================================================================
+
+// Bytes of a node with n keys totalling key_bytes whose first and last
+// key share prefix bytes
+static size_t PackedSize(size_t n, size_t key_bytes, size_t prefix, uint16_t value_len) {
+    return BTREE_NODE_HEADER_SIZE + prefix + n * (2 * sizeof(uint16_t) + value_len) + key_bytes - n * prefix;
+}
 
-        // ---- INTERNAL SPLIT ----
-        size_t mid = keys.size() / 2;
-        std::string push_up_key = keys[mid];
+void BPlusTree::BulkLoad(const std::function<bool(std::string* key, RecordID* rid)>& next,
+                         double fill_factor) {
+    std::unique_lock<std::shared_mutex> root_guard(root_latch_);
+    size_t target = static_cast<size_t>(std::min(1.0, std::max(0.1, fill_factor)) * page_size_);
 
-        std::vector<std::string> left_keys(keys.begin(), keys.begin() + mid);
-        std::vector<page_id_t> left_children(children.begin(), children.begin() + mid + 1);
+    page_id_t leaf_id = root_page_id_;
+    Page* leaf = bpm_->FetchPage(leaf_id);
+    if (!leaf) {
+        throw std::runtime_error("BPlusTree: Failed to fetch page");
+    }
+    if (!Header(leaf->GetData())->is_leaf || Header(leaf->GetData())->num_keys != 0) {
+        bpm_->UnpinPage(leaf_id, false);
+        throw std::runtime_error("BPlusTree: BulkLoad needs an empty tree");
+    }
 
-        std::vector<std::string> right_keys(keys.begin() + mid + 1, keys.end());
-        std::vector<page_id_t> right_children(children.begin() + mid + 1, children.end());
+    static const char no_value = 0;  // Leaf values are empty
+    std::vector<Entry> entries;
+    std::vector<BulkLevel> levels;  // levels[0] sits right above the leaves
+    size_t key_bytes = 0;
+    std::string key;
+    RecordID rid;
+
+    try {
+        while (next(&key, &rid)) {
+            if (key.size() > MaxKeySize()) {
+                throw std::runtime_error("BPlusTree: key of " + std::to_string(key.size()) +
+                                         " bytes exceeds the " + std::to_string(MaxKeySize()) + " byte limit");
+            }
+            std::string entry_key = EntryKey(key, rid);
+            if (!entries.empty() && !(entries.back().key < entry_key)) {
+                throw std::runtime_error("BPlusTree: BulkLoad input is not in key order");
+            }
+            key_bytes += entry_key.size();
+            entries.push_back(Entry{std::move(entry_key), &no_value});
+
+            size_t prefix = CommonPrefixLength(entries.front().key, entries.back().key);
+            bool full = PackedSize(entries.size(), key_bytes, prefix, BTREE_LEAF_VALUE_SIZE) > target ||
+                        (max_keys_ != 0 && entries.size() > max_keys_);
+            if (!full || entries.size() == 1) continue;
+
+            // The new entry opens the next leaf
+            Entry first = std::move(entries.back());
+            entries.pop_back();
+            page_id_t next_id;
+            Page* next_leaf = bpm_->NewPage(&next_id);
+            if (!next_leaf) {
+                throw std::runtime_error("BPlusTree: Failed to allocate new leaf page");
+            }
+            std::memset(next_leaf->GetData(), 0, page_size_);
+
+            WriteNode(leaf->GetData(), true, entries, 0, entries.size());
+            Header(leaf->GetData())->next_leaf = next_id;
+            std::string separator = Separator(entries.back().key, first.key);
+            bpm_->UnpinPage(leaf_id, true);
+            page_id_t closed_id = leaf_id;
+            leaf = next_leaf;
+            leaf_id = next_id;
+
+            BulkAddToLevel(levels, 0, closed_id, std::move(separator), next_id, target);
+            entries.clear();
+            key_bytes = first.key.size();
+            entries.push_back(std::move(first));
+        }
 
-        page_id_t new_page_id;
-        Page* new_page = bpm_->NewPage(&new_page_id);
-        if (!new_page) {
+        WriteNode(leaf->GetData(), true, entries, 0, entries.size());
+        Header(leaf->GetData())->next_leaf = INVALID_PAGE_ID;
+        bpm_->UnpinPage(leaf_id, true);
+        leaf = nullptr;
+
+        // Close the open node of every level; the topmost is the root
+        page_id_t root = root_page_id_;
+        for (BulkLevel& level : levels) {
+            BulkWriteLevel(level);
+            root = level.page_id;
+            level.page = nullptr;
+        }
+        root_page_id_ = root;
+    } catch (...) {
+        if (leaf) bpm_->UnpinPage(leaf_id, false);
+        for (BulkLevel& level : levels) {
+            if (level.page) bpm_->UnpinPage(level.page_id, false);
+        }
+        throw;
+    }
+}
+
+void BPlusTree::BulkAddToLevel(std::vector<BulkLevel>& levels, size_t level, page_id_t left_child,
+                               std::string separator, page_id_t right_child, size_t target) {
+    if (level == levels.size()) {
+        // First node of a new level: its leftmost child is the first node below
+        page_id_t page_id;
+        Page* page = bpm_->NewPage(&page_id);
+        if (!page) {
             throw std::runtime_error("BPlusTree: Failed to allocate new internal page");
         }
-        std::memset(new_page->GetData(), 0, 4096);
-        WriteInternalNode(new_page->GetData(), right_keys, right_children);
-        bpm_->UnpinPage(new_page_id, true);
+        std::memset(page->GetData(), 0, page_size_);
+        levels.push_back(BulkLevel{page, page_id, left_child, {}, {}, 0});
+    }
+
+    levels[level].key_bytes += separator.size();
+    levels[level].keys.push_back(std::move(separator));
+    levels[level].children.push_back(right_child);
+
+    BulkLevel& open = levels[level];
+    size_t n = open.keys.size();
+    size_t prefix = CommonPrefixLength(open.keys.front(), open.keys.back());
+    bool full = PackedSize(n, open.key_bytes, prefix, BTREE_INTERNAL_VALUE_SIZE) > target ||
+                (max_keys_ != 0 && n > max_keys_);
+    if (!full || n == 1) return;
+
+    // The last separator moves up; its child becomes the next node's leftmost
+    std::string up_key = std::move(open.keys.back());
+    page_id_t next_leftmost = open.children.back();
+    open.key_bytes -= up_key.size();
+    open.keys.pop_back();
+    open.children.pop_back();
+    BulkWriteLevel(open);
+    page_id_t closed_id = open.page_id;
+
+    page_id_t page_id;
+    Page* page = bpm_->NewPage(&page_id);
+    if (!page) {
+        open.page = nullptr;
+        throw std::runtime_error("BPlusTree: Failed to allocate new internal page");
+    }
+    std::memset(page->GetData(), 0, page_size_);
+    levels[level] = BulkLevel{page, page_id, next_leftmost, {}, {}, 0};
 
-        Page* p = bpm_->FetchPage(node_page_id);
-        std::memset(p->GetData(), 0, 4096);
-        WriteInternalNode(p->GetData(), left_keys, left_children);
-        bpm_->UnpinPage(node_page_id, true);
+    BulkAddToLevel(levels, level + 1, closed_id, std::move(up_key), page_id, target);
+}
 
-        return {true, push_up_key, new_page_id};
+// Write the level's open node to its page and unpin it
+void BPlusTree::BulkWriteLevel(BulkLevel& level) {
+    std::vector<Entry> entries;
+    entries.reserve(level.keys.size());
+    for (size_t i = 0; i < level.keys.size(); i++) {
+        entries.push_back(Entry{level.keys[i], reinterpret_cast<const char*>(&level.children[i])});
     }
+    WriteNode(level.page->GetData(), false, entries, 0, entries.size());
+    Header(level.page->GetData())->leftmost_child = level.leftmost;
+    bpm_->UnpinPage(level.page_id, true);
 }
 
 // ============================================================================
-// Delete — simplified: remove from leaf, no rebalancing
+// Delete — optimistic first, pessimistic if the leaf would underflow
 // ============================================================================
 
+bool BPlusTree::Delete(const std::string& key, const RecordID& rid) {
+    std::string entry_key = EntryKey(key, rid);
+    int result = DeleteOptimistic(entry_key);
+    if (result >= 0) return result == 1;
+    return DeletePessimistic(entry_key);
+}
+
 bool BPlusTree::Delete(const std::string& key) {
-    page_id_t leaf_page = FindLeaf(key);
-    if (leaf_page == INVALID_PAGE_ID) return false;
+    // Another deleter may take the same entry first; then look again
+    while (true) {
+        RecordID rid = Search(key);
+        if (!rid.IsValid()) return false;
+        if (Delete(key, rid)) return true;
+    }
+}
 
-    Page* page = bpm_->FetchPage(leaf_page);
-    if (!page) return false;
+// Shared latches down to the leaf, an exclusive one on the leaf alone
+int BPlusTree::DeleteOptimistic(const std::string& key) {
+    page_id_t leaf_page;
+    Page* page = FindLeaf(key, &leaf_page, true);
+    if (!page) return 0;
+
+    char* data = page->GetData();
+    uint16_t pos = LowerBound(data, key);
+    int result = 0;
+    if (pos < Header(data)->num_keys && KeyEquals(data, pos, key)) {
+        // Exact for the entry at hand, unlike the worst case SafeForRemove assumes
+        size_t cell = 2 * sizeof(uint16_t) + SuffixAt(data, pos).size() + BTREE_LEAF_VALUE_SIZE;
+        bool stays = max_keys_ != 0 ? Header(data)->num_keys > max_keys_ / 2
+                                    : page_size_ - FreeBytes(data) >= page_size_ / 4 + cell;
+        result = stays ? 1 : -1;
+        if (result == 1) RemoveCell(data, pos);
+    }
+    page->WUnlatch();
+    bpm_->UnpinPage(leaf_page, result == 1);
+    return result;
+}
 
-    std::vector<std::string> keys;
-    std::vector<RecordID> rids;
-    BTreeNodeHeader header = ReadNodeHeader(page->GetData());
-    ReadLeafNode(page->GetData(), keys, rids);
+// Exclusive latches from the root down, released above any node that
+// cannot underflow. Underflow is then repaired bottom-up along the path.
+bool BPlusTree::DeletePessimistic(const std::string& key) {
+    struct PathNode {
+        Page* page;
+        page_id_t page_id;
+        uint16_t child_idx;  // Child followed from this node
+    };
+    std::vector<PathNode> path;
+    size_t modified_from = SIZE_MAX;  // path[i] for i >= this were changed
+    std::vector<page_id_t> freed;
+
+    std::unique_lock<std::shared_mutex> root_guard(root_latch_);
+    auto release = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            path[i].page->WUnlatch();
+            bpm_->UnpinPage(path[i].page_id, i >= modified_from);
+        }
+    };
 
-    // Find and remove the key
     bool found = false;
-    for (size_t i = 0; i < keys.size(); ++i) {
-        if (keys[i] == key) {
-            keys.erase(keys.begin() + i);
-            rids.erase(rids.begin() + i);
-            found = true;
-            break;
+    try {
+        page_id_t current = root_page_id_;
+        while (true) {
+            Page* page = bpm_->FetchPage(current);
+            if (!page) {
+                throw std::runtime_error("BPlusTree: Failed to fetch page");
+            }
+            page->WLatch();
+            bool is_root = root_guard.owns_lock() && path.empty();
+            path.push_back(PathNode{page, current, 0});
+
+            // The root never underflows, it only collapses once it is an
+            // internal node down to its last key
+            const char* data = page->GetData();
+            bool is_leaf = Header(data)->is_leaf;
+            bool safe = is_root ? is_leaf || Header(data)->num_keys > 1 : SafeForRemove(data);
+            if (safe) {
+                release(0, path.size() - 1);
+                path.erase(path.begin(), path.end() - 1);
+                if (root_guard.owns_lock()) root_guard.unlock();
+            }
+            if (is_leaf) break;
+
+            path.back().child_idx = UpperBound(data, key);
+            current = ChildAt(data, path.back().child_idx);
         }
+
+        size_t level = path.size() - 1;
+        char* leaf = path[level].page->GetData();
+        uint16_t pos = LowerBound(leaf, key);
+        found = pos < Header(leaf)->num_keys && KeyEquals(leaf, pos, key);
+        if (found) {
+            modified_from = level;
+            RemoveCell(leaf, pos);
+
+            while (level > 0 && Underfull(path[level].page->GetData())) {
+                modified_from = level - 1;
+                if (!Rebalance(path[level - 1].page, path[level - 1].child_idx, path[level].page, &freed)) break;
+                level--;
+            }
+
+            // A root down to one child hands the tree to that child
+            char* root = path[0].page->GetData();
+            if (root_guard.owns_lock() && !Header(root)->is_leaf && Header(root)->num_keys == 0) {
+                root_page_id_ = Header(root)->leftmost_child;
+                freed.push_back(path[0].page_id);
+            }
+        }
+    } catch (...) {
+        release(0, path.size());
+        throw;
     }
+    release(0, path.size());
+    if (root_guard.owns_lock()) root_guard.unlock();
+    FreePages(freed);
+    return found;
+}
+
+// ============================================================================
+// Rebalance — merge with a sibling, or even the pair out
+//
+// The pair is (left, right) with parent key sep between them: the child's
+// right sibling, or its left one if the child is the parent's last child.
+// Internal nodes route the separator through: it joins the merged node
+// with right's leftmost child, and when evening out, the middle entry goes
+// up in its place. Evening out is skipped if the new separator is too long
+// for the parent; the child then stays underfull, which is only a matter
+// of space.
+// ============================================================================
 
-    if (found) {
-        std::memset(page->GetData(), 0, 4096);
-        WriteLeafNode(page->GetData(), keys, rids, header.next_leaf);
-        bpm_->UnpinPage(leaf_page, true);
+bool BPlusTree::Rebalance(Page* parent, uint16_t child_idx, Page* child, std::vector<page_id_t>* freed) {
+    char* pdata = parent->GetData();
+    uint16_t parent_keys = Header(pdata)->num_keys;
+    if (parent_keys == 0) return false;  // No sibling
+
+    bool child_is_left = child_idx < parent_keys;
+    uint16_t sep = child_is_left ? child_idx : child_idx - 1;
+    page_id_t left_id = ChildAt(pdata, sep);
+    page_id_t right_id = ChildAt(pdata, sep + 1);
+
+    Page* left;
+    Page* right;
+    if (child_is_left) {
+        left = child;
+        right = bpm_->FetchPage(right_id);
+        if (!right) {
+            throw std::runtime_error("BPlusTree: Failed to fetch page");
+        }
+        right->WLatch();
     } else {
-        bpm_->UnpinPage(leaf_page, false);
+        // Siblings are latched left to right; the parent keeps the child's
+        // place in the tree while it is let go
+        right = child;
+        right->WUnlatch();
+        left = bpm_->FetchPage(left_id);
+        if (!left) {
+            right->WLatch();
+            throw std::runtime_error("BPlusTree: Failed to fetch page");
+        }
+        left->WLatch();
+        right->WLatch();
+    }
+    Page* sibling = child_is_left ? right : left;
+    page_id_t sibling_id = child_is_left ? right_id : left_id;
+
+    char* ldata = left->GetData();
+    char* rdata = right->GetData();
+    bool is_leaf = Header(ldata)->is_leaf;
+    uint16_t value_len = is_leaf ? BTREE_LEAF_VALUE_SIZE : BTREE_INTERNAL_VALUE_SIZE;
+
+    // left's entries, [separator → right's leftmost child,] right's entries
+    std::vector<char> left_copy, right_copy, parent_copy;
+    std::vector<Entry> entries = CollectEntries(ldata, NO_INSERT, {}, nullptr, &left_copy);
+    std::vector<Entry> right_entries = CollectEntries(rdata, NO_INSERT, {}, nullptr, &right_copy);
+    const BTreeNodeHeader* left_header = Header(left_copy.data());
+    const BTreeNodeHeader* right_header = Header(right_copy.data());
+    if (!is_leaf) {
+        entries.push_back(Entry{FullKeyAt(pdata, sep), reinterpret_cast<const char*>(&right_header->leftmost_child)});
+    }
+    for (Entry& e : right_entries) entries.push_back(std::move(e));
+    size_t total = entries.size();
+
+    bool merged = NodeSize(entries, 0, total, value_len) <= page_size_ && (max_keys_ == 0 || total <= max_keys_);
+    bool changed = merged;
+    if (merged) {
+        WriteNode(ldata, is_leaf, entries, 0, total);
+        Header(ldata)->next_leaf = right_header->next_leaf;
+        Header(ldata)->leftmost_child = left_header->leftmost_child;
+        // Emptied, so a cursor still parked on it descends again
+        InitNode(rdata, page_size_, is_leaf);
+        RemoveCell(pdata, sep);
+        freed->push_back(right_id);
+    } else {
+        size_t total_bytes = 0;
+        for (const Entry& e : entries) total_bytes += e.key.size() + value_len;
+        size_t mid = 0;
+        for (size_t left_bytes = 0; mid < total && left_bytes * 2 < total_bytes; mid++) {
+            left_bytes += entries[mid].key.size() + value_len;
+        }
+        mid = std::max<size_t>(1, std::min(mid, is_leaf ? total - 1 : total - 2));
+        size_t right_from = is_leaf ? mid : mid + 1;
+        std::string new_sep = is_leaf ? Separator(entries[mid - 1].key, entries[mid].key) : entries[mid].key;
+
+        std::vector<Entry> parent_entries = CollectEntries(pdata, NO_INSERT, {}, nullptr, &parent_copy);
+        parent_entries[sep].key = new_sep;
+        bool capped = max_keys_ != 0 && (mid > max_keys_ || total - right_from > max_keys_);
+        if (!capped && NodeSize(entries, 0, mid, value_len) <= page_size_ &&
+            NodeSize(entries, right_from, total, value_len) <= page_size_ &&
+            NodeSize(parent_entries, 0, parent_keys, BTREE_INTERNAL_VALUE_SIZE) <= page_size_) {
+            page_id_t left_leftmost = left_header->leftmost_child;
+            page_id_t right_next = right_header->next_leaf;
+            page_id_t right_leftmost = INVALID_PAGE_ID;
+            if (!is_leaf) std::memcpy(&right_leftmost, entries[mid].value, sizeof(page_id_t));
+
+            WriteNode(ldata, is_leaf, entries, 0, mid);
+            WriteNode(rdata, is_leaf, entries, right_from, total);
+            Header(ldata)->next_leaf = is_leaf ? right_id : INVALID_PAGE_ID;
+            Header(ldata)->leftmost_child = left_leftmost;
+            Header(rdata)->next_leaf = right_next;
+            Header(rdata)->leftmost_child = right_leftmost;
+
+            page_id_t parent_leftmost = Header(parent_copy.data())->leftmost_child;
+            WriteNode(pdata, false, parent_entries, 0, parent_keys);
+            Header(pdata)->leftmost_child = parent_leftmost;
+            changed = true;
+        }
     }
 
-    return found;
+    sibling->WUnlatch();
+    bpm_->UnpinPage(sibling_id, changed);
+    return merged;
+}
+
+void BPlusTree::FreePages(const std::vector<page_id_t>& pages) {
+    for (page_id_t page_id : pages) {
+        bpm_->DeletePage(page_id);
+    }
 }
 
 // ============================================================================
-// RangeScan — follow leaf chain
+// RangeScan — drain an Iterator
 // ============================================================================
 
 std::vector<std::pair<std::string, RecordID>> BPlusTree::RangeScan(const std::string& lo_key, const std::string& hi_key) {
     std::vector<std::pair<std::string, RecordID>> results;
+    Iterator it(this, lo_key, hi_key);
+    std::string key;
+    RecordID rid;
+    while (it.Next(&key, &rid)) {
+        results.emplace_back(key, rid);
+    }
+    return results;
+}
 
-    page_id_t leaf_page = FindLeaf(lo_key);
-    if (leaf_page == INVALID_PAGE_ID) return results;
+// ============================================================================
+// Iterator
+// ============================================================================
 
-    while (leaf_page != INVALID_PAGE_ID) {
-        Page* page = bpm_->FetchPage(leaf_page);
-        if (!page) break;
+BPlusTree::Iterator::Iterator(BPlusTree* tree, const std::string& lo_key, const std::string& hi_key)
+    : tree_(tree), lo_(LowestEntryKey(lo_key)), hi_key_(hi_key) {}
 
-        std::vector<std::string> keys;
-        std::vector<RecordID> rids;
-        BTreeNodeHeader header = ReadNodeHeader(page->GetData());
-        ReadLeafNode(page->GetData(), keys, rids);
-        bpm_->UnpinPage(leaf_page, false);
+BPlusTree::Iterator::~Iterator() {
+    Release();
+}
 
-        for (size_t i = 0; i < keys.size(); ++i) {
-            if (keys[i] >= lo_key && keys[i] <= hi_key) {
-                results.emplace_back(keys[i], rids[i]);
-            }
-            if (keys[i] > hi_key) {
-                return results;  // Done — past the range
-            }
+void BPlusTree::Iterator::Release() {
+    if (leaf_page_ != INVALID_PAGE_ID) {
+        tree_->bpm_->UnpinPage(leaf_page_, false);
+        leaf_page_ = INVALID_PAGE_ID;
+        leaf_ = nullptr;
+    }
+}
+
+bool BPlusTree::Iterator::Next(std::string* key, RecordID* rid) {
+    if (done_) return false;
+    BufferPoolManager* bpm = tree_->bpm_;
+
+    // Position: descend on the first call, or again if the last entry moved
+    if (leaf_) {
+        leaf_->RLatch();
+        const char* data = leaf_->GetData();
+        bool in_place = pos_ > 0 && pos_ - 1 < Header(data)->num_keys && KeyEquals(data, pos_ - 1, last_);
+        if (!in_place) {
+            leaf_->RUnlatch();
+            Release();
         }
+    }
+    if (!leaf_) {
+        leaf_ = tree_->FindLeaf(started_ ? last_ : lo_, &leaf_page_, false);
+        if (!leaf_) {
+            leaf_page_ = INVALID_PAGE_ID;
+            done_ = true;
+            return false;
+        }
+        pos_ = started_ ? UpperBound(leaf_->GetData(), last_) : LowerBound(leaf_->GetData(), lo_);
+        started_ = true;
+    }
 
-        leaf_page = header.next_leaf;
+    // Step over exhausted (or emptied) leaves, latching the right sibling
+    // before letting go of the left
+    const char* data = leaf_->GetData();
+    while (pos_ >= Header(data)->num_keys) {
+        page_id_t next_page = Header(data)->next_leaf;
+        Page* next = next_page == INVALID_PAGE_ID ? nullptr : bpm->FetchPage(next_page);
+        if (next) next->RLatch();
+        leaf_->RUnlatch();
+        Release();
+        if (!next) {
+            done_ = true;
+            return false;
+        }
+        leaf_ = next;
+        leaf_page_ = next_page;
+        data = leaf_->GetData();
+        pos_ = 0;
     }
 
-    return results;
+    std::string entry_key = FullKeyAt(data, pos_);
+    std::string_view user_key = UserKey(entry_key);
+    if (user_key > hi_key_) {
+        leaf_->RUnlatch();
+        Release();
+        done_ = true;
+        return false;
+    }
+    if (key) key->assign(user_key.data(), user_key.size());
+    *rid = RidAt(data, pos_);
+    leaf_->RUnlatch();
+    last_ = std::move(entry_key);
+    pos_++;
+    return true;
 }
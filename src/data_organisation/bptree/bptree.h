@@ -7,72 +7,264 @@
 #include <vector>
 #include <cstring>
 #include <optional>
+#include <string_view>
+#include <shared_mutex>
+#include <functional>
 
 // ============================================================================
 // B+ Tree Index
 //
-// On-disk B+ Tree with variable-length string keys.
-// Each node occupies one page.
+// On-disk B+ Tree with variable-length string keys; keys may repeat
+// (non-unique secondary indexes). Each node occupies one page.
 //
-// Node Layout (in page data):
-//   [NodeHeader][Key1][Value1][Key2][Value2]...[KeyN][ValueN]
+// Node Layout (slotted, like heap pages):
+//   [NodeHeader][prefix][slot 0][slot 1]...[slot N-1] -> free <- [cells]
 //
-// NodeHeader:
-//   is_leaf (1 byte) | num_keys (uint16) | next_leaf (page_id, leaf only)
+//   prefix: bytes every key in the node starts with, stored once
+//           (prefix compression); cells hold only what follows it
+//   slot i: uint16 offset of cell i; slots are kept in key order
+//   cell:   [uint16_t suffix_len][suffix bytes][value]
 //
-// Key: [uint16_t length][char data...]
-// Value (leaf):    RecordID (6 bytes: page_id + slot_id)
-// Value (internal): page_id_t (4 bytes, child pointer)
+// Key (leaf):       the entry key, user key + RecordID (6 bytes big-endian:
+//                   page_id, slot_id), so every entry is unique and the
+//                   entries of one user key are ordered by RecordID
+// Value (leaf):     none — the RecordID is read back from the key
+// Value (internal): page_id_t (4 bytes, the child to the RIGHT of the key)
 //
 // Internal node: keys[i] separates children[i] and children[i+1]
 //   children[0] | key[0] | children[1] | key[1] | ... | children[n]
-//   So there are num_keys keys and num_keys+1 children.
-//   Stored as: [child0][key0][child1][key1]...[keyN-1][childN]
+//   children[0] lives in the header (leftmost_child); cell i holds key[i]
+//   and children[i+1].
 //
-// Leaf node: keys[i] maps to rid[i], plus next_leaf pointer
+// Leaf node: sorted entry keys, plus next_leaf pointer
+//
+// Duplicates: a low-cardinality key repeats in many entries, but within a
+// node it becomes part of the prefix, so a run of equal keys costs about
+// what a posting list would. User keys must be prefix-free (no key is a
+// proper prefix of another, as IndexKey guarantees) for the entries of
+// different keys not to interleave.
+//
+// Lookups binary-search the slot array and compare keys in place as
+// string_views; inserts and deletes shift the slot array, and cells are
+// compacted only when the free gap is too small. Nothing is decoded into
+// vectors, so a point lookup allocates nothing.
+//
+// Splits: a node splits when its page is full (or at max_keys_per_node,
+// if set), at the entry that divides its bytes evenly. A leaf split
+// posts the shortest key that separates the two halves (suffix
+// truncation), not the right half's whole first key. Each half is
+// rewritten with the common prefix of its own keys.
+//
+// Keys longer than MaxKeySize() are rejected, so a split always has room.
+//
+// Deletes: a node left underfull (under a quarter of its page, or under
+// half of max_keys_per_node) merges with a sibling under the same parent
+// if both fit in one page, and otherwise takes entries from it so the two
+// hold about as many bytes each. A merge removes the separator from the
+// parent, which may leave it underfull in turn; a root left with one
+// child is replaced by that child. Emptied pages go back to the
+// DiskManager's free list for the next allocation.
+//
+// Concurrency: latch crabbing on the pages' own latches; a child is always
+// latched before its parent is released, and siblings left to right.
+//   - Search, Iterator: shared latches down the tree. Readers never hold
+//     more than two pages.
+//   - Insert, Delete: optimistic first — shared latches down, the leaf
+//     exclusively — which is enough unless the leaf must split or would
+//     be left underfull. Otherwise they restart with exclusive latches from
+//     the root, dropping every ancestor as soon as a node cannot split
+//     (insert) or underflow (delete). A rebalance that needs the left
+//     sibling lets go of the child first, to latch the two left to right.
+//   - root_latch_ guards root_page_id_: readers hold it shared until the
+//     root page is latched, a pessimistic insert or delete exclusively
+//     until it knows the root will not split or collapse.
+// An Iterator holds latches only inside Next(), never between calls.
 // ============================================================================
 
-static constexpr uint16_t BTREE_NODE_HEADER_SIZE = 1 + 2 + 4;  // is_leaf + num_keys + next_leaf
-
 struct BTreeNodeHeader {
     uint8_t is_leaf;
+    uint8_t reserved;
     uint16_t num_keys;
-    page_id_t next_leaf;  // Only used for leaf nodes (-1 if none)
+    uint16_t cell_start;       // Lowest byte used by cells (page size when empty)
+    uint16_t prefix_len;       // Length of the prefix stored after the header
+    page_id_t next_leaf;       // Leaf: right sibling (-1 if none)
+    page_id_t leftmost_child;  // Internal: children[0]
 };
 
+static_assert(sizeof(BTreeNodeHeader) == 16, "BTreeNodeHeader must be 16 bytes");
+
+static constexpr uint16_t BTREE_NODE_HEADER_SIZE = sizeof(BTreeNodeHeader);
+static constexpr uint16_t BTREE_RID_SIZE = sizeof(page_id_t) + sizeof(uint16_t);
+static constexpr uint16_t BTREE_LEAF_VALUE_SIZE = 0;
+static constexpr uint16_t BTREE_INTERNAL_VALUE_SIZE = sizeof(page_id_t);
+
 class BPlusTree {
 public:
-    BPlusTree(BufferPoolManager* bpm, page_id_t root_page_id, uint16_t max_keys_per_node = 50);
+    // max_keys_per_node = 0 splits only when a node's page is full
+    BPlusTree(BufferPoolManager* bpm, page_id_t root_page_id, uint16_t max_keys_per_node = 0);
+
+    // Format a freshly allocated page as an empty leaf (a new tree's root)
+    static void InitLeaf(char* page_data, uint32_t page_size);
 
-    // Insert a key-RecordID pair
+    // Insert a key-RecordID pair; inserting a pair that exists is a no-op.
+    // Throws std::runtime_error if the key is longer than MaxKeySize().
     void Insert(const std::string& key, const RecordID& rid);
 
-    // Search for an exact key. Returns the RecordID or INVALID_RECORD_ID.
+    // Search for an exact key. Returns its lowest RecordID or INVALID_RECORD_ID.
     RecordID Search(const std::string& key);
 
-    // Delete a key
+    // Delete one key-RecordID pair, rebalancing underfull nodes
+    bool Delete(const std::string& key, const RecordID& rid);
+
+    // Delete the key's lowest RecordID
     bool Delete(const std::string& key);
 
-    // Range scan: returns all RecordIDs where lo_key <= key <= hi_key
+    // Build the tree bottom-up from (key, RecordID) pairs that next() yields
+    // in tree order (key bytes, then RecordID; see IndexEntrySorter). The
+    // tree must be empty. Leaves are filled left to right to fill_factor of
+    // a page, then each internal level is built over the one below in the
+    // same pass — no descents, no splits, every page written once.
+    // Throws std::runtime_error on an out-of-order pair or a key longer
+    // than MaxKeySize().
+    void BulkLoad(const std::function<bool(std::string* key, RecordID* rid)>& next,
+                  double fill_factor = 0.9);
+
+    // Range scan: returns every (key, RecordID) where lo_key <= key <= hi_key,
+    // in key order and, within a key, in RecordID order
     std::vector<std::pair<std::string, RecordID>> RangeScan(const std::string& lo_key, const std::string& hi_key);
 
+    // =========================================================================
+    // Iterator — streaming range scan over [lo_key, hi_key]
+    //
+    // Keeps one leaf pinned and walks the next_leaf chain, so memory stays
+    // constant and the first entry is ready without reading the rest.
+    // Between calls the tree may change: each Next() checks that the entry
+    // it returned last is still where it was, and if not (a split moved it,
+    // or a delete shifted the slots) descends again to just after it.
+    // =========================================================================
+    class Iterator {
+    public:
+        Iterator(BPlusTree* tree, const std::string& lo_key, const std::string& hi_key);
+        ~Iterator();
+
+        Iterator(const Iterator&) = delete;
+        Iterator& operator=(const Iterator&) = delete;
+
+        // Advance to the next entry in range. key may be null.
+        // Returns false when done.
+        bool Next(std::string* key, RecordID* rid);
+
+    private:
+        // Drop the pin on the current leaf, if any
+        void Release();
+
+        BPlusTree* tree_;
+        std::string lo_;    // Lowest entry key of lo_key
+        std::string hi_key_;
+        page_id_t leaf_page_ = INVALID_PAGE_ID;  // Pinned while valid
+        Page* leaf_ = nullptr;
+        uint16_t pos_ = 0;        // Next slot to read in leaf_
+        std::string last_;        // Entry key returned last (empty before the first)
+        bool started_ = false;
+        bool done_ = false;
+    };
+
+    // Longest key the tree accepts (a quarter of a node, less the RecordID)
+    size_t MaxKeySize() const { return (page_size_ - BTREE_NODE_HEADER_SIZE) / 4 - 16 - BTREE_RID_SIZE; }
+
     // Get root page id
-    page_id_t GetRootPageId() const { return root_page_id_; }
+    page_id_t GetRootPageId() const;
 
     // Set root page id (after split)
-    void SetRootPageId(page_id_t pid) { root_page_id_ = pid; }
+    void SetRootPageId(page_id_t pid);
 
 private:
-    // ---- Node I/O helpers ----
-    void WriteNodeHeader(char* page_data, const BTreeNodeHeader& header);
-    BTreeNodeHeader ReadNodeHeader(const char* page_data);
+    // One key/value pair while a node is being rebuilt (split, prefix change)
+    struct Entry {
+        std::string key;    // Full key, prefix included
+        const char* value;  // Points into the caller's copy of the node
+    };
 
-    // Read all keys and children/rids from a page
-    void ReadLeafNode(const char* page_data, std::vector<std::string>& keys, std::vector<RecordID>& rids);
-    void WriteLeafNode(char* page_data, const std::vector<std::string>& keys, const std::vector<RecordID>& rids, page_id_t next_leaf);
+    // ---- In-page node access ----
+    static BTreeNodeHeader* Header(char* page_data);
+    static const BTreeNodeHeader* Header(const char* page_data);
+    static void InitNode(char* page_data, uint32_t page_size, bool is_leaf);
 
-    void ReadInternalNode(const char* page_data, std::vector<std::string>& keys, std::vector<page_id_t>& children);
-    void WriteInternalNode(char* page_data, const std::vector<std::string>& keys, const std::vector<page_id_t>& children);
+    static std::string_view Prefix(const char* page_data);
+    static std::string_view SuffixAt(const char* page_data, uint16_t index);  // Key minus the prefix
+    static std::string FullKeyAt(const char* page_data, uint16_t index);
+    static const char* ValueAt(const char* page_data, uint16_t index);
+    static RecordID RidAt(const char* page_data, uint16_t index);  // Leaf only
+    static page_id_t ChildAt(const char* page_data, uint16_t child_index);  // 0..num_keys
+    static bool KeyEquals(const char* page_data, uint16_t index, std::string_view key);
+
+    // First slot whose key is >= key / > key
+    static uint16_t LowerBound(const char* page_data, std::string_view key);
+    static uint16_t UpperBound(const char* page_data, std::string_view key);
+
+    // Insert a cell at slot pos, shifting the later slots up. key must
+    // start with the node's prefix. Compacts the cells first if only
+    // fragmented space is left. Returns false if the node is full.
+    bool InsertCell(char* page_data, uint16_t pos, std::string_view key,
+                    const char* value, uint16_t value_len);
+
+    // Append a cell after the last slot (room must have been checked)
+    static bool AppendCell(char* page_data, std::string_view suffix, const char* value, uint16_t value_len);
+
+    // Drop slot pos; its cell bytes become fragmented space
+    static void RemoveCell(char* page_data, uint16_t pos);
+
+    // Rewrite the cells contiguously at the end of the page
+    void Compact(char* page_data);
+
+    // The node's entries (copied to *copy first), with (key, value)
+    // inserted at pos (NO_INSERT: none)
+    static constexpr uint16_t NO_INSERT = UINT16_MAX;
+    std::vector<Entry> CollectEntries(const char* page_data, uint16_t pos, std::string_view key,
+                                      const char* value, std::vector<char>* copy);
+
+    // Bytes a node holding entries [first, last) needs, prefix-compressed
+    static size_t NodeSize(const std::vector<Entry>& entries, size_t first, size_t last, uint16_t value_len);
+
+    // Format page_data as a node holding entries [first, last)
+    void WriteNode(char* page_data, bool is_leaf, const std::vector<Entry>& entries,
+                   size_t first, size_t last);
+
+    // ---- Entry keys: user key + RecordID ----
+    static std::string EntryKey(const std::string& key, const RecordID& rid);
+    static std::string_view UserKey(std::string_view entry_key);
+
+    // ---- Bulk load ----
+    // The open (rightmost) node of one internal level while bulk loading
+    struct BulkLevel {
+        Page* page;
+        page_id_t page_id;
+        page_id_t leftmost;
+        std::vector<std::string> keys;
+        std::vector<page_id_t> children;  // children[i] is right of keys[i]
+        size_t key_bytes = 0;
+    };
+
+    // Add (separator, right child) to levels[level], closing its node and
+    // posting to the level above when the node passes target bytes
+    void BulkAddToLevel(std::vector<BulkLevel>& levels, size_t level, page_id_t left_child,
+                        std::string separator, page_id_t right_child, size_t target);
+    void BulkWriteLevel(BulkLevel& level);
+
+    // Shortest s with left_last < s <= right_first (suffix truncation)
+    static std::string Separator(const std::string& left_last, const std::string& right_first);
+
+    // ---- Space checks ----
+    // Bytes left for new cells once dead cells are compacted away
+    size_t FreeBytes(const char* page_data) const;
+    // Inserting key fits without a split or a prefix rewrite
+    bool HasRoomFor(const char* page_data, std::string_view key, uint16_t value_len) const;
+    // Any separator a child split could push up fits
+    bool SafeForChildSplit(const char* page_data) const;
+    // Below a quarter of the page (or half of max_keys_) — wants a rebalance
+    bool Underfull(const char* page_data) const;
+    // Losing any one entry leaves the node not underfull
+    bool SafeForRemove(const char* page_data) const;
 
     // ---- Core operations ----
     // Returns (split_happened, new_key, new_page_id)
@@ -82,12 +274,41 @@ private:
         page_id_t new_page_id = INVALID_PAGE_ID;
     };
 
-    InsertResult InsertInternal(page_id_t node_page_id, const std::string& key, const RecordID& rid);
+    bool InsertOptimistic(const std::string& entry_key);
+    void InsertPessimistic(const std::string& entry_key);
+
+    // Put (key, value) at slot pos of the exclusively latched node,
+    // rebuilding it with a shorter prefix or splitting it as needed
+    InsertResult InsertIntoNode(Page* page, uint16_t pos, std::string_view key,
+                                const char* value, uint16_t value_len);
+
+    // Returns 1 (deleted), 0 (not found) or -1 (leaf would underflow:
+    // nothing changed, retry pessimistically)
+    int DeleteOptimistic(const std::string& entry_key);
+    bool DeletePessimistic(const std::string& entry_key);
+
+    // Merge the underfull child at child_idx of parent with a sibling, or
+    // even the two out. Both parent and child are exclusively latched (the
+    // child is briefly let go to latch a left sibling first). Returns true
+    // if the parent lost a key; a page emptied by a merge is added to freed.
+    bool Rebalance(Page* parent, uint16_t child_idx, Page* child, std::vector<page_id_t>* freed);
+
+    // Return emptied pages to the buffer pool and the disk manager's free
+    // list. A page still pinned (an Iterator parked on it) is left alone.
+    void FreePages(const std::vector<page_id_t>& pages);
+
+    // Split a full node while inserting (key, value) at slot pos. The left
+    // half stays in page; the new right page is unpinned before returning.
+    InsertResult SplitNode(Page* page, uint16_t pos, std::string_view key,
+                           const char* value, uint16_t value_len);
 
-    // Find the leaf page that should contain the key
-    page_id_t FindLeaf(const std::string& key);
+    // Crab down to the leaf that should contain key. Returns it pinned and
+    // latched — exclusively if write_leaf — or nullptr.
+    Page* FindLeaf(const std::string& key, page_id_t* leaf_page_id, bool write_leaf);
 
     BufferPoolManager* bpm_;
     page_id_t root_page_id_;
-    uint16_t max_keys_;
+    uint16_t max_keys_;  // 0 = no cap
+    uint32_t page_size_;
+    mutable std::shared_mutex root_latch_;  // Guards root_page_id_, see header comment
 };
@@ -0,0 +1,112 @@
+#include "entry_sorter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+// Run file record: [uint16 key_len][key][page_id_t][uint16 slot_id]
+
+IndexEntrySorter::IndexEntrySorter(size_t memory_limit) : memory_limit_(memory_limit) {}
+
+IndexEntrySorter::~IndexEntrySorter() {
+    for (Run& run : runs_) {
+        if (run.file) std::fclose(run.file);
+    }
+}
+
+// ============================================================================
+// Add / Spill
+// ============================================================================
+
+void IndexEntrySorter::Add(const std::string& key, const RecordID& rid) {
+    if (finished_) {
+        throw std::runtime_error("IndexEntrySorter: Add after Finish");
+    }
+    buffer_.push_back(Item{key, rid});
+    buffered_bytes_ += sizeof(Item) + key.size();
+    total_++;
+    if (buffered_bytes_ >= memory_limit_) Spill();
+}
+
+void IndexEntrySorter::Spill() {
+    std::sort(buffer_.begin(), buffer_.end());
+
+    FILE* file = std::tmpfile();
+    if (!file) {
+        throw std::runtime_error("IndexEntrySorter: cannot create run file: " +
+                                 std::string(strerror(errno)));
+    }
+    runs_.push_back(Run{file, Item{}});
+
+    for (const Item& item : buffer_) {
+        uint16_t key_len = static_cast<uint16_t>(item.key.size());
+        bool ok = std::fwrite(&key_len, sizeof(key_len), 1, file) == 1 &&
+                  (key_len == 0 || std::fwrite(item.key.data(), key_len, 1, file) == 1) &&
+                  std::fwrite(&item.rid.page_id, sizeof(page_id_t), 1, file) == 1 &&
+                  std::fwrite(&item.rid.slot_id, sizeof(uint16_t), 1, file) == 1;
+        if (!ok) {
+            throw std::runtime_error("IndexEntrySorter: run write failed: " + std::string(strerror(errno)));
+        }
+    }
+    if (std::fflush(file) != 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+        throw std::runtime_error("IndexEntrySorter: run flush failed: " + std::string(strerror(errno)));
+    }
+
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    buffered_bytes_ = 0;
+}
+
+bool IndexEntrySorter::ReadItem(FILE* file, Item* item) {
+    uint16_t key_len;
+    if (std::fread(&key_len, sizeof(key_len), 1, file) != 1) return false;
+    item->key.resize(key_len);
+    bool ok = (key_len == 0 || std::fread(item->key.data(), key_len, 1, file) == 1) &&
+              std::fread(&item->rid.page_id, sizeof(page_id_t), 1, file) == 1 &&
+              std::fread(&item->rid.slot_id, sizeof(uint16_t), 1, file) == 1;
+    if (!ok) {
+        throw std::runtime_error("IndexEntrySorter: truncated run file");
+    }
+    return true;
+}
+
+// ============================================================================
+// Finish / Next — k-way merge
+// ============================================================================
+
+void IndexEntrySorter::Finish() {
+    if (finished_) return;
+    finished_ = true;
+    std::sort(buffer_.begin(), buffer_.end());
+
+    for (size_t i = 0; i < runs_.size(); i++) {
+        if (ReadItem(runs_[i].file, &runs_[i].head)) {
+            heap_.push(HeapEntry{&runs_[i].head, i});
+        }
+    }
+    if (!buffer_.empty()) heap_.push(HeapEntry{&buffer_[0], runs_.size()});
+}
+
+bool IndexEntrySorter::Next(std::string* key, RecordID* rid) {
+    if (!finished_) Finish();
+    if (heap_.empty()) return false;
+
+    HeapEntry top = heap_.top();
+    heap_.pop();
+    *key = top.item->key;
+    *rid = top.item->rid;
+
+    // Refill from the source just consumed
+    if (top.source == runs_.size()) {
+        if (++buffer_pos_ < buffer_.size()) heap_.push(HeapEntry{&buffer_[buffer_pos_], top.source});
+    } else {
+        Run& run = runs_[top.source];
+        if (ReadItem(run.file, &run.head)) {
+            heap_.push(HeapEntry{&run.head, top.source});
+        } else {
+            std::fclose(run.file);
+            run.file = nullptr;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "storage_engine/page/slotted_page.h"  // For RecordID
+#include <cstdio>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// IndexEntrySorter — external merge sort of (key, RecordID) pairs
+//
+// Feeds BPlusTree::BulkLoad. Pairs are buffered in memory; once the buffer
+// passes memory_limit bytes it is sorted and spilled to an anonymous
+// temporary file as one run. Finish() sorts what is left, and Next() then
+// merges the runs (plus the in-memory tail) with a heap, reading each run
+// sequentially. With no spills it is a plain in-memory sort.
+//
+// Order is by key bytes, then RecordID — the B+ Tree's entry order for
+// prefix-free keys such as IndexKey's.
+// ============================================================================
+
+class IndexEntrySorter {
+public:
+    explicit IndexEntrySorter(size_t memory_limit = 64 * 1024 * 1024);
+    ~IndexEntrySorter();
+
+    IndexEntrySorter(const IndexEntrySorter&) = delete;
+    IndexEntrySorter& operator=(const IndexEntrySorter&) = delete;
+
+    void Add(const std::string& key, const RecordID& rid);
+
+    // Done adding; start the merge
+    void Finish();
+
+    // The next pair in order. Returns false when all have been read.
+    bool Next(std::string* key, RecordID* rid);
+
+    size_t NumRuns() const { return runs_.size(); }
+    size_t Size() const { return total_; }
+
+private:
+    struct Item {
+        std::string key;
+        RecordID rid;
+        bool operator<(const Item& other) const {
+            if (key != other.key) return key < other.key;
+            return rid < other.rid;
+        }
+    };
+
+    // A sorted run spilled to disk; head is its next unread item
+    struct Run {
+        FILE* file;
+        Item head;
+    };
+
+    // Merge heap entry: which source holds the smallest head
+    // (runs_.size() stands for the in-memory buffer)
+    struct HeapEntry {
+        const Item* item;
+        size_t source;
+        bool operator>(const HeapEntry& other) const { return *other.item < *item; }
+    };
+
+    void Spill();
+    static bool ReadItem(FILE* file, Item* item);
+
+    size_t memory_limit_;
+    size_t buffered_bytes_ = 0;
+    size_t total_ = 0;
+    std::vector<Item> buffer_;
+    size_t buffer_pos_ = 0;  // Next unread item of buffer_ during the merge
+    std::vector<Run> runs_;
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap_;
+    bool finished_ = false;
+};
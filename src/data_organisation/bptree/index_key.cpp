@@ -0,0 +1,158 @@
+#include "index_key.h"
+#include <cstring>
+#include <limits>
+
+void IndexKey::AppendBigEndian(std::string* key, uint64_t bits) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        key->push_back(static_cast<char>((bits >> shift) & 0xFF));
+    }
+}
+
+uint64_t IndexKey::ReadBigEndian(const char* bytes) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++) bits = (bits << 8) | static_cast<uint8_t>(bytes[i]);
+    return bits;
+}
+
+// ============================================================================
+// Encode
+// ============================================================================
+
+bool IndexKey::Encode(const BsonValue& value, std::string* key) {
+    key->clear();
+
+    if (std::holds_alternative<std::nullptr_t>(value)) {
+        key->push_back(static_cast<char>(TAG_NULL));
+        return true;
+    }
+
+    if (std::holds_alternative<int32_t>(value) || std::holds_alternative<int64_t>(value)) {
+        int64_t v = std::holds_alternative<int32_t>(value) ? std::get<int32_t>(value)
+                                                           : std::get<int64_t>(value);
+        // Flipping the sign bit maps two's complement order onto unsigned order
+        key->push_back(static_cast<char>(TAG_INTEGER));
+        AppendBigEndian(key, static_cast<uint64_t>(v) ^ (uint64_t{1} << 63));
+        return true;
+    }
+
+    if (std::holds_alternative<double>(value)) {
+        double d = std::get<double>(value);
+        if (d == 0.0) d = 0.0;  // -0.0 and 0.0 are the same key
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        // Positives: set the sign bit. Negatives: invert everything, so
+        // larger magnitudes sort first.
+        bits = (bits & (uint64_t{1} << 63)) ? ~bits : bits | (uint64_t{1} << 63);
+        key->push_back(static_cast<char>(TAG_DOUBLE));
+        AppendBigEndian(key, bits);
+        return true;
+    }
+
+    if (std::holds_alternative<std::string>(value)) {
+        const std::string& s = std::get<std::string>(value);
+        key->reserve(s.size() + 3);
+        key->push_back(static_cast<char>(TAG_STRING));
+        for (char c : s) {
+            key->push_back(c);
+            if (c == '\0') key->push_back('\xFF');
+        }
+        key->append(2, '\0');
+        return true;
+    }
+
+    if (std::holds_alternative<bool>(value)) {
+        key->push_back(static_cast<char>(TAG_BOOL));
+        key->push_back(std::get<bool>(value) ? 1 : 0);
+        return true;
+    }
+
+    return false;  // Nested documents
+}
+
+// ============================================================================
+// TypeRange
+// ============================================================================
+
+bool IndexKey::TypeRange(const BsonValue& value, std::string* lo, std::string* hi) {
+    if (std::holds_alternative<int32_t>(value) || std::holds_alternative<int64_t>(value)) {
+        Encode(std::numeric_limits<int64_t>::min(), lo);
+        Encode(std::numeric_limits<int64_t>::max(), hi);
+        return true;
+    }
+    if (std::holds_alternative<double>(value)) {
+        Encode(-std::numeric_limits<double>::infinity(), lo);
+        // NaN encodes above +inf; cover it too
+        *hi = std::string(1, static_cast<char>(TAG_DOUBLE)) + std::string(8, '\xFF');
+        return true;
+    }
+    if (std::holds_alternative<std::string>(value)) {
+        *lo = std::string(1, static_cast<char>(TAG_STRING));
+        // No string key reaches the next tag byte
+        *hi = std::string(1, static_cast<char>(TAG_STRING + 1));
+        return true;
+    }
+    if (!Encode(value, lo)) return false;
+    if (std::holds_alternative<bool>(value)) {
+        Encode(false, lo);
+        Encode(true, hi);
+    } else {
+        *hi = *lo;
+    }
+    return true;
+}
+
+// ============================================================================
+// Decode
+// ============================================================================
+
+bool IndexKey::Decode(std::string_view key, BsonValue* value) {
+    if (key.empty()) return false;
+    uint8_t tag = static_cast<uint8_t>(key[0]);
+    std::string_view payload = key.substr(1);
+
+    switch (tag) {
+        case TAG_NULL:
+            if (!payload.empty()) return false;
+            *value = nullptr;
+            return true;
+        case TAG_INTEGER:
+            if (payload.size() != 8) return false;
+            *value = static_cast<int64_t>(ReadBigEndian(payload.data()) ^ (uint64_t{1} << 63));
+            return true;
+        case TAG_DOUBLE: {
+            if (payload.size() != 8) return false;
+            uint64_t bits = ReadBigEndian(payload.data());
+            bits = (bits & (uint64_t{1} << 63)) ? bits & ~(uint64_t{1} << 63) : ~bits;
+            double d;
+            std::memcpy(&d, &bits, sizeof(d));
+            *value = d;
+            return true;
+        }
+        case TAG_STRING: {
+            std::string s;
+            s.reserve(payload.size());
+            for (size_t i = 0; i < payload.size(); i++) {
+                if (payload[i] != '\0') {
+                    s.push_back(payload[i]);
+                    continue;
+                }
+                if (i + 1 >= payload.size()) return false;
+                if (payload[i + 1] == '\0') {
+                    if (i + 2 != payload.size()) return false;  // Terminator, not at the end
+                    *value = std::move(s);
+                    return true;
+                }
+                if (payload[i + 1] != '\xFF') return false;
+                s.push_back('\0');
+                i++;
+            }
+            return false;  // No terminator
+        }
+        case TAG_BOOL:
+            if (payload.size() != 1) return false;
+            *value = payload[0] != 0;
+            return true;
+        default:
+            return false;
+    }
+}
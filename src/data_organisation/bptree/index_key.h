@@ -0,0 +1,49 @@
+#pragma once
+
+#include "storage_engine/common/bson_types.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// ============================================================================
+// IndexKey — order-preserving (memcomparable) encoding of BsonValues
+//
+// A key is a one-byte type tag followed by a payload whose bytes compare
+// the way the values do, so the B+ Tree's plain byte comparison orders
+// 9 before 10 and -1 before 0:
+//
+//   null      [0x10]
+//   integer   [0x20][8 bytes big-endian, sign bit flipped]  (int32 and int64)
+//   double    [0x21][8 bytes big-endian IEEE 754, sign-adjusted]
+//   string    [0x30][bytes, 0x00 escaped as 0x00 0xFF][0x00 0x00]
+//   bool      [0x40][0 | 1]
+//
+// The string terminator keeps keys prefix-free, which the B+ Tree needs to
+// append a RecordID without "ab" landing among the entries of "a".
+// Documents are not indexable. Values of different types never interleave;
+// a typed range stays inside its tag.
+// ============================================================================
+
+class IndexKey {
+public:
+    // Encode value into key. Returns false if the type has no index key.
+    static bool Encode(const BsonValue& value, std::string* key);
+
+    // The smallest and largest keys a value of value's type can encode to,
+    // for open-ended ranges ($gt / $lt). Returns false if not indexable.
+    static bool TypeRange(const BsonValue& value, std::string* lo, std::string* hi);
+
+    // The value a key encodes (integers come back as int64). Returns false
+    // if key is not a valid encoding.
+    static bool Decode(std::string_view key, BsonValue* value);
+
+private:
+    static constexpr uint8_t TAG_NULL = 0x10;
+    static constexpr uint8_t TAG_INTEGER = 0x20;
+    static constexpr uint8_t TAG_DOUBLE = 0x21;
+    static constexpr uint8_t TAG_STRING = 0x30;
+    static constexpr uint8_t TAG_BOOL = 0x40;
+
+    static void AppendBigEndian(std::string* key, uint64_t bits);
+    static uint64_t ReadBigEndian(const char* bytes);
+};
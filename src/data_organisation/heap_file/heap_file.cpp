@@ -1,59 +1,423 @@
 #include "heap_file.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 // ============================================================================
-// Constructor
+// Constructors
 // ============================================================================
 
-HeapFile::HeapFile(BufferPoolManager* bpm, FreeSpaceMap* fsm, page_id_t first_page_id)
-    : bpm_(bpm), fsm_(fsm), first_page_id_(first_page_id), max_page_id_(first_page_id) {}
+HeapFile::HeapFile(BufferPoolManager* bpm, FreeSpaceMap* fsm) : bpm_(bpm), fsm_(fsm) {
+    for (auto& hint : insert_hints_) hint = NO_HINT;
+    AllocateNewPage(nullptr);
+}
+
+HeapFile::HeapFile(BufferPoolManager* bpm, FreeSpaceMap* fsm, std::vector<HeapExtent> extents,
+                   uint32_t num_pages)
+    : bpm_(bpm), fsm_(fsm), extents_(std::move(extents)) {
+    for (auto& hint : insert_hints_) hint = NO_HINT;
+    for (const HeapExtent& extent : extents_) {
+        extent_starts_.push_back(capacity_);
+        capacity_ += extent.num_pages;
+    }
+    num_pages_ = std::min(num_pages, capacity_);
+
+    // Pages initialized after the list was last saved: an initialized
+    // slotted page never has free_space_end == 0, a reserved one is zeroed
+    while (num_pages_ < capacity_) {
+        page_id_t page_id = PageAtLocked(num_pages_);
+        Page* page = bpm_->FetchPage(page_id);
+        if (!page) break;
+        PageHeader header;
+        std::memcpy(&header, page->GetData(), sizeof(header));
+        bpm_->UnpinPage(page_id, false);
+        if (header.free_space_end == 0) break;
+        num_pages_++;
+    }
+}
+
+// ============================================================================
+// Extents
+// ============================================================================
+
+page_id_t HeapFile::PageAtLocked(uint32_t index) const {
+    if (index >= capacity_) return INVALID_PAGE_ID;
+    size_t i = std::upper_bound(extent_starts_.begin(), extent_starts_.end(), index) - extent_starts_.begin() - 1;
+    return extents_[i].first_page + static_cast<page_id_t>(index - extent_starts_[i]);
+}
+
+void HeapFile::EnableCompression() {
+    std::unique_lock<std::shared_mutex> lock(extent_mutex_);
+    compressed_ = true;
+    for (const HeapExtent& extent : extents_) bpm_->SetCompressed(extent.first_page, extent.num_pages);
+}
+
+page_id_t HeapFile::PageAt(uint32_t index) const {
+    std::shared_lock<std::shared_mutex> lock(extent_mutex_);
+    return index < num_pages_ ? PageAtLocked(index) : INVALID_PAGE_ID;
+}
+
+uint32_t HeapFile::IndexOf(page_id_t page_id) const {
+    // Extents are reserved from an increasing counter, so they are sorted
+    std::shared_lock<std::shared_mutex> lock(extent_mutex_);
+    auto it = std::upper_bound(extents_.begin(), extents_.end(), page_id,
+                               [](page_id_t id, const HeapExtent& e) { return id < e.first_page; });
+    if (it == extents_.begin()) return FreeSpaceMap::NO_PAGE;
+    size_t i = it - extents_.begin() - 1;
+    uint32_t offset = static_cast<uint32_t>(page_id - extents_[i].first_page);
+    if (offset >= extents_[i].num_pages) return FreeSpaceMap::NO_PAGE;
+    return extent_starts_[i] + offset;
+}
+
+page_id_t HeapFile::GetFirstPageId() const {
+    std::shared_lock<std::shared_mutex> lock(extent_mutex_);
+    return extents_.empty() ? INVALID_PAGE_ID : extents_.front().first_page;
+}
+
+std::vector<HeapExtent> HeapFile::GetExtents(uint32_t* num_pages) const {
+    std::shared_lock<std::shared_mutex> lock(extent_mutex_);
+    *num_pages = num_pages_;
+    return extents_;
+}
 
 // ============================================================================
-// AllocateNewPage — create a new data page, register with FSM
+// AllocateNewPage — take the next extent page, register with FSM
 // ============================================================================
 
-page_id_t HeapFile::AllocateNewPage() {
+page_id_t HeapFile::AllocateNewPage(uint32_t* index) {
     page_id_t new_page_id;
-    Page* page = bpm_->NewPage(&new_page_id);
+    uint32_t new_index;
+    bool new_extent = false;
+    {
+        std::unique_lock<std::shared_mutex> lock(extent_mutex_);
+        if (num_pages_ == capacity_) {
+            uint32_t size = extents_.empty()
+                                ? FIRST_EXTENT_PAGES
+                                : std::min(extents_.back().num_pages * 2, MAX_EXTENT_PAGES);
+            extents_.push_back(HeapExtent{bpm_->AllocateExtent(size), size});
+            if (compressed_) bpm_->SetCompressed(extents_.back().first_page, size);
+            extent_starts_.push_back(capacity_);
+            capacity_ += size;
+            new_extent = true;
+        }
+        new_index = num_pages_++;
+        new_page_id = PageAtLocked(new_index);
+    }
+
+    // A scan may already see the page as in use; until it is initialized
+    // it reads as an empty page
+    Page* page = bpm_->NewPageAt(new_page_id);
     if (!page) {
         throw std::runtime_error("HeapFile: Failed to allocate new page");
     }
 
     // Initialize as a slotted page
-    SlottedPage::Init(page->GetData());
+    page->WLatch();
+    SlottedPage::Init(page->GetData(), bpm_->GetPageSize());
+    uint16_t free_space = SlottedPage::GetFreeSpace(page->GetData());
+    page->WUnlatch();
 
     // Register with FSM — full page free space (minus header)
-    uint16_t free_space = SlottedPage::GetFreeSpace(page->GetData());
-    fsm_->RegisterNewPage(new_page_id, free_space);
+    fsm_->RegisterNewPage(new_index, free_space);
 
     bpm_->UnpinPage(new_page_id, true);  // Dirty — we initialized it
 
-    if (new_page_id > max_page_id_) {
-        max_page_id_ = new_page_id;
+    if (new_extent && extent_listener_) extent_listener_();
+    if (index) *index = new_index;
+    return new_page_id;
+}
+
+// ============================================================================
+// LogChange — one WAL record per slot modification
+// ============================================================================
+
+void HeapFile::LogChange(Transaction* txn, Page* page, LogRecordType type, const RecordID& rid,
+                         const uint8_t* before, uint16_t before_len,
+                         const uint8_t* after, uint16_t after_len) {
+    if (!wal_ || !txn) return;
+
+    LogRecord record;
+    record.txn_id = txn->txn_id;
+    record.type = type;
+    record.page_id = rid.page_id;
+    record.slot_id = rid.slot_id;
+    if (before) record.before_image.assign(before, before + before_len);
+    if (after) record.after_image.assign(after, after + after_len);
+    // Claim a recLSN no later than the record's own before appending it, so
+    // a checkpoint starting in between still sees the page as dirty
+    page->NoteLoggedChange(wal_->GetCurrentLSN());
+    lsn_t lsn = wal_->AppendLogRecord(record);
+    SlottedPage::SetPageLSN(page->GetData(), lsn);
+    page->SetPageLSN(lsn);
+}
+
+// ============================================================================
+// Record framing — plain documents, forwarding stubs, moved records
+// ============================================================================
+
+void HeapFile::WriteLink(uint8_t* dst, int32_t marker, const RecordID& link) {
+    std::memcpy(dst, &marker, sizeof(marker));
+    std::memcpy(dst + sizeof(marker), &link.page_id, sizeof(link.page_id));
+    std::memcpy(dst + sizeof(marker) + sizeof(link.page_id), &link.slot_id, sizeof(link.slot_id));
+}
+
+HeapFile::RecordKind HeapFile::Classify(const uint8_t* data, uint16_t len, RecordID* link) {
+    int32_t marker;
+    if (len < FORWARD_HEADER_SIZE) return RecordKind::PLAIN;
+    std::memcpy(&marker, data, sizeof(marker));
+    if (marker != FORWARD_STUB && marker != FORWARDED) return RecordKind::PLAIN;
+    std::memcpy(&link->page_id, data + sizeof(marker), sizeof(link->page_id));
+    std::memcpy(&link->slot_id, data + sizeof(marker) + sizeof(link->page_id), sizeof(link->slot_id));
+    return marker == FORWARD_STUB ? RecordKind::STUB : RecordKind::MOVED;
+}
+
+void HeapFile::NoteFreeSpace(page_id_t page_id, uint16_t free_bytes) {
+    uint32_t index = IndexOf(page_id);
+    if (index != FreeSpaceMap::NO_PAGE) fsm_->UpdateFreeSpace(index, free_bytes);
+}
+
+// ============================================================================
+// Out-of-line values — chunk chains in the overflow heap
+// ============================================================================
+
+uint16_t HeapFile::MaxRecordSize() const {
+    return static_cast<uint16_t>(bpm_->GetPageSize() - sizeof(PageHeader) - sizeof(SlotEntry));
+}
+
+void HeapFile::Encode(const BsonDocument& doc, std::vector<uint8_t>* out, Transaction* txn) {
+    BsonSerializer::SerializeTo(doc, out);
+
+    // Leave room for a forwarding header, so the record can always move
+    const size_t limit = MaxRecordSize() - FORWARD_HEADER_SIZE;
+    if (out->size() <= limit || !overflow_) return;  // InsertBytes rejects what cannot fit
+
+    // Top-level values worth moving out, largest first, until the record
+    // is down to a quarter of a page
+    struct Element {
+        const uint8_t* begin;  // Type byte
+        const uint8_t* end;
+        BsonElementView view;
+        bool external = false;
+    };
+    std::vector<Element> elements;
+    BsonView(out->data(), out->size()).ForEach([&elements](const BsonElementView& e) {
+        auto key = reinterpret_cast<const uint8_t*>(e.key.data());
+        elements.push_back(Element{key - 1, e.value + e.value_size, e});
+        return true;
+    });
+    std::vector<Element*> candidates;
+    for (Element& e : elements) {
+        bool movable = e.view.type == BsonType::STRING || e.view.type == BsonType::DOCUMENT ||
+                       e.view.type == BsonType::ARRAY;
+        if (movable && e.view.value_size >= MIN_EXTERNAL_VALUE) candidates.push_back(&e);
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Element* a, const Element* b) { return a->view.value_size > b->view.value_size; });
+    size_t size = out->size();
+    for (Element* e : candidates) {
+        if (size <= limit / 4) break;
+        e->external = true;
+        size -= e->view.value_size - BSON_EXTERNAL_SIZE;
+    }
+    if (size > limit) {
+        throw std::runtime_error("HeapFile: Record too large for a single page");
     }
 
-    return new_page_id;
+    // Rebuild the record with pointers in place of the moved values
+    std::vector<uint8_t> record(sizeof(int32_t));
+    record.reserve(size);
+    for (const Element& e : elements) {
+        if (!e.external) {
+            record.insert(record.end(), e.begin, e.end);
+            continue;
+        }
+        RecordID chain = WriteExternal(e.view.value, e.view.value_size, txn);
+        uint8_t pointer[BSON_EXTERNAL_SIZE];
+        uint32_t value_size = static_cast<uint32_t>(e.view.value_size);
+        pointer[0] = static_cast<uint8_t>(e.view.type);
+        std::memcpy(pointer + 1, &chain.page_id, sizeof(chain.page_id));
+        std::memcpy(pointer + 5, &chain.slot_id, sizeof(chain.slot_id));
+        std::memcpy(pointer + 7, &value_size, sizeof(value_size));
+        record.push_back(static_cast<uint8_t>(BsonType::EXTERNAL));
+        record.insert(record.end(), e.view.key.begin(), e.view.key.end());
+        record.push_back(0x00);
+        record.insert(record.end(), pointer, pointer + BSON_EXTERNAL_SIZE);
+    }
+    record.push_back(0x00);
+    int32_t total = static_cast<int32_t>(record.size());
+    std::memcpy(record.data(), &total, sizeof(total));
+    out->swap(record);
+}
+
+RecordID HeapFile::WriteExternal(const uint8_t* value, size_t size, Transaction* txn) {
+    // Written back to front, so each chunk knows the one after it
+    const size_t payload = overflow_->MaxRecordSize() - CHUNK_HEADER_SIZE;
+    size_t num_chunks = (size + payload - 1) / payload;
+    RecordID next = INVALID_RECORD_ID;
+    for (size_t i = num_chunks; i-- > 0;) {
+        const uint8_t* part = value + i * payload;
+        size_t part_len = std::min(payload, size - i * payload);
+        RecordID after = next;
+        next = overflow_->Place(static_cast<uint16_t>(CHUNK_HEADER_SIZE + part_len), txn,
+                                [&](uint8_t* dst) {
+                                    std::memcpy(dst, &after.page_id, sizeof(after.page_id));
+                                    std::memcpy(dst + sizeof(after.page_id), &after.slot_id, sizeof(after.slot_id));
+                                    std::memcpy(dst + CHUNK_HEADER_SIZE, part, part_len);
+                                });
+        overflow_->NoteSlotChange(0, static_cast<int64_t>(CHUNK_HEADER_SIZE + part_len));
+    }
+    return next;
+}
+
+BsonElementView HeapFile::ResolveExternal(const BsonElementView& pointer) {
+    BsonElementView value = pointer;
+    RecordID chunk;
+    uint32_t size;
+    value.type = static_cast<BsonType>(pointer.value[0]);
+    std::memcpy(&chunk.page_id, pointer.value + 1, sizeof(chunk.page_id));
+    std::memcpy(&chunk.slot_id, pointer.value + 5, sizeof(chunk.slot_id));
+    std::memcpy(&size, pointer.value + 7, sizeof(size));
+    if (!overflow_) throw std::runtime_error("HeapFile: Out-of-line value without an overflow heap");
+
+    // One buffer per thread: valid until this thread's next call
+    thread_local std::vector<uint8_t> bytes;
+    bytes.clear();
+    bytes.reserve(size);
+    while (chunk.IsValid() && bytes.size() < size) {
+        Page* page = bpm_->FetchPage(chunk.page_id);
+        if (!page) {
+            throw std::runtime_error("HeapFile: Failed to fetch page " + std::to_string(chunk.page_id));
+        }
+        page->RLatch();
+        uint16_t len;
+        const uint8_t* data = SlottedPage::GetRecord(page->GetData(), chunk.slot_id, &len);
+        if (!data || len < CHUNK_HEADER_SIZE) {
+            page->RUnlatch();
+            bpm_->UnpinPage(chunk.page_id, false);
+            break;
+        }
+        page_id_t current = chunk.page_id;
+        bytes.insert(bytes.end(), data + CHUNK_HEADER_SIZE, data + len);
+        std::memcpy(&chunk.page_id, data, sizeof(chunk.page_id));
+        std::memcpy(&chunk.slot_id, data + sizeof(chunk.page_id), sizeof(chunk.slot_id));
+        page->RUnlatch();
+        bpm_->UnpinPage(current, false);
+    }
+    if (bytes.size() != size) throw std::runtime_error("HeapFile: Corrupted overflow chain");
+
+    value.value = bytes.data();
+    value.value_size = size;
+    return value;
+}
+
+void HeapFile::CollectOwned(const uint8_t* data, uint16_t len, RecordID* forward,
+                            std::vector<RecordID>* chains) const {
+    switch (Classify(data, len, forward)) {
+        case RecordKind::STUB: return;
+        case RecordKind::MOVED:
+            *forward = INVALID_RECORD_ID;
+            CollectExternals(data + FORWARD_HEADER_SIZE, len - FORWARD_HEADER_SIZE, chains);
+            return;
+        case RecordKind::PLAIN:
+            CollectExternals(data, len, chains);
+            return;
+    }
+}
+
+void HeapFile::CollectExternals(const uint8_t* data, uint16_t len, std::vector<RecordID>* chains) const {
+    if (!overflow_) return;
+    BsonView(data, len).ForEach([chains](const BsonElementView& e) {
+        if (e.type == BsonType::EXTERNAL) {
+            RecordID chain;
+            std::memcpy(&chain.page_id, e.value + 1, sizeof(chain.page_id));
+            std::memcpy(&chain.slot_id, e.value + 5, sizeof(chain.slot_id));
+            chains->push_back(chain);
+        }
+        return true;
+    });
+}
+
+void HeapFile::FreeExternals(const std::vector<RecordID>& chains, Transaction* txn) {
+    for (RecordID chunk : chains) {
+        while (chunk.IsValid()) {
+            RecordID next = INVALID_RECORD_ID;
+            Page* page = bpm_->FetchPage(chunk.page_id);
+            if (!page) break;
+            page->RLatch();
+            uint16_t len;
+            const uint8_t* data = SlottedPage::GetRecord(page->GetData(), chunk.slot_id, &len);
+            if (data && len >= CHUNK_HEADER_SIZE) {
+                std::memcpy(&next.page_id, data, sizeof(next.page_id));
+                std::memcpy(&next.slot_id, data + sizeof(next.page_id), sizeof(next.slot_id));
+            }
+            page->RUnlatch();
+            bpm_->UnpinPage(chunk.page_id, false);
+            overflow_->DeleteSlot(chunk, txn, nullptr);
+            chunk = next;
+        }
+    }
 }
 
 // ============================================================================
 // InsertRecord
 // ============================================================================
 
-RecordID HeapFile::InsertRecord(const BsonDocument& doc) {
-    // Serialize the document
-    std::vector<uint8_t> data = BsonSerializer::Serialize(doc);
-    uint16_t record_len = static_cast<uint16_t>(data.size());
+RecordID HeapFile::InsertRecord(const BsonDocument& doc, Transaction* txn) {
+    // The document is serialized straight into its slot, sized up front
+    size_t size = BsonSerializer::SerializedSize(doc);
+    if (size + FORWARD_HEADER_SIZE <= MaxRecordSize()) {
+        RecordID rid = Place(static_cast<uint16_t>(size), txn,
+                             [&doc](uint8_t* dst) { BsonSerializer::SerializeInto(doc, dst); },
+                             /*new_document=*/true);
+        NoteSlotChange(1, static_cast<int64_t>(size));
+        return rid;
+    }
+    thread_local std::vector<uint8_t> data;
+    Encode(doc, &data, txn);
+    RecordID rid = InsertBytes(data.data(), data.size(), nullptr, txn);
+    NoteSlotChange(1, 0);
+    return rid;
+}
+
+RecordID HeapFile::InsertBytes(const uint8_t* data, size_t len, const RecordID* home, Transaction* txn) {
+    size_t size = len + (home ? FORWARD_HEADER_SIZE : 0);
+    if (size > MaxRecordSize()) {
+        throw std::runtime_error("HeapFile: Record too large for a single page");
+    }
+    RecordID rid = Place(static_cast<uint16_t>(size), txn, [&](uint8_t* dst) {
+        if (home) {
+            WriteLink(dst, FORWARDED, *home);
+            dst += FORWARD_HEADER_SIZE;
+        }
+        std::memcpy(dst, data, len);
+    }, /*new_document=*/home == nullptr);
+    NoteSlotChange(0, static_cast<int64_t>(size));
+    return rid;
+}
 
+std::atomic<uint32_t>& HeapFile::InsertHint() {
+    return insert_hints_[std::hash<std::thread::id>{}(std::this_thread::get_id()) % INSERT_HINT_SLOTS];
+}
+
+uint8_t* HeapFile::ReserveInSomePage(uint16_t record_len, Page** out_page, uint32_t* out_index,
+                                     int16_t* slot_id) {
     // Need space for the record + a slot entry (4 bytes)
     uint16_t total_needed = record_len + sizeof(SlotEntry);
 
-    // Ask FSM for a page with enough space
-    page_id_t target_page = fsm_->FindPageWithSpace(total_needed);
+    // Ask FSM for a page with enough space, starting where this inserter
+    // last found some; a new inserter starts at the rover instead, so
+    // concurrent inserters fill different pages
+    uint32_t start = InsertHint().load(std::memory_order_relaxed);
+    if (start == NO_HINT) start = hint_rover_.fetch_add(1, std::memory_order_relaxed);
+    uint32_t target_index = fsm_->FindPageWithSpace(total_needed, start);
+    page_id_t target_page =
+        target_index == FreeSpaceMap::NO_PAGE ? INVALID_PAGE_ID : PageAt(target_index);
 
     if (target_page == INVALID_PAGE_ID) {
         // No existing page has space — allocate a new one
-        target_page = AllocateNewPage();
+        target_page = AllocateNewPage(&target_index);
     }
 
     // Fetch the page
@@ -62,156 +426,499 @@ RecordID HeapFile::InsertRecord(const BsonDocument& doc) {
         throw std::runtime_error("HeapFile: Failed to fetch page " + std::to_string(target_page));
     }
 
-    // Insert into slotted page
-    int16_t slot_id = SlottedPage::InsertRecord(page->GetData(), data.data(), record_len);
+    // Reserve a slot in the slotted page
+    page->WLatch();
+    uint8_t* record = SlottedPage::ReserveRecord(page->GetData(), record_len, slot_id);
 
-    if (slot_id == -1) {
-        // Page didn't have enough space (FSM was stale) — try a new page
+    if (!record) {
+        // Page didn't have enough space (FSM was stale, or a concurrent
+        // inserter took it) — correct the FSM and try a new page
+        uint16_t actual = SlottedPage::GetFreeSpace(page->GetData());
+        page->WUnlatch();
         bpm_->UnpinPage(target_page, false);
-        target_page = AllocateNewPage();
+        fsm_->UpdateFreeSpace(target_index, actual);
+        target_page = AllocateNewPage(&target_index);
         page = bpm_->FetchPage(target_page);
         if (!page) {
             throw std::runtime_error("HeapFile: Failed to fetch new page");
         }
-        slot_id = SlottedPage::InsertRecord(page->GetData(), data.data(), record_len);
-        if (slot_id == -1) {
+        page->WLatch();
+        record = SlottedPage::ReserveRecord(page->GetData(), record_len, slot_id);
+        if (!record) {
+            page->WUnlatch();
             bpm_->UnpinPage(target_page, false);
             throw std::runtime_error("HeapFile: Record too large for a single page");
         }
     }
+    *out_page = page;
+    *out_index = target_index;
+    return record;
+}
 
-    // Update FSM with remaining free space
+void HeapFile::ReleaseInsertPage(Page* page, uint32_t index) {
+    page_id_t page_id = page->GetPageId();
     uint16_t remaining = SlottedPage::GetFreeSpace(page->GetData());
-    fsm_->UpdateFreeSpace(target_page, remaining);
+    page->WUnlatch();
 
-    bpm_->UnpinPage(target_page, true);  // Dirty
+    // Update FSM with remaining free space
+    fsm_->UpdateFreeSpace(index, remaining);
+    InsertHint().store(index, std::memory_order_relaxed);
+
+    bpm_->UnpinPage(page_id, true);  // Dirty
+}
+
+RecordID HeapFile::Place(uint16_t record_len, Transaction* txn, const std::function<void(uint8_t*)>& write,
+                         bool new_document) {
+    Page* page;
+    uint32_t index;
+    int16_t slot_id;
+    uint8_t* record = ReserveInSomePage(record_len, &page, &index, &slot_id);
+    write(record);
 
     RecordID rid;
-    rid.page_id = target_page;
+    rid.page_id = page->GetPageId();
     rid.slot_id = static_cast<uint16_t>(slot_id);
+    LogChange(txn, page, LogRecordType::INSERT, rid, nullptr, 0, record, record_len);
+    if (new_document && insert_listener_) insert_listener_(rid, txn);
+
+    ReleaseInsertPage(page, index);
     return rid;
 }
 
 // ============================================================================
-// DeleteRecord
+// InsertRecords — a batch, page by page
+//
+// Consecutive documents go into the same page under one pin and latch
+// until it is full; their INSERT records reach the WAL as one group,
+// which tags the page with the group's last LSN. A document that needs
+// the overflow heap ends the page's run and takes the InsertRecord path.
+//
+// The batch goes in whole or not at all: if a document fails (one too
+// large even with its values out of line), the ones already placed are
+// deleted again, under the same transaction, before the error is rethrown.
 // ============================================================================
 
-bool HeapFile::DeleteRecord(const RecordID& rid) {
+std::vector<RecordID> HeapFile::InsertRecords(const std::vector<BsonDocument>& docs, Transaction* txn) {
+    std::vector<RecordID> rids;
+    rids.reserve(docs.size());
+    try {
+        InsertPages(docs, txn, &rids);
+    } catch (...) {
+        for (size_t r = rids.size(); r-- > 0;) DeleteRecord(rids[r], txn);
+        throw;
+    }
+    return rids;
+}
+
+void HeapFile::InsertPages(const std::vector<BsonDocument>& docs, Transaction* txn, std::vector<RecordID>* out) {
+    std::vector<RecordID>& rids = *out;
+    const bool logged = wal_ && txn;
+    size_t i = 0;
+    while (i < docs.size()) {
+        size_t size = BsonSerializer::SerializedSize(docs[i]);
+        if (size + FORWARD_HEADER_SIZE > MaxRecordSize()) {
+            rids.push_back(InsertRecord(docs[i], txn));
+            i++;
+            continue;
+        }
+
+        Page* page;
+        uint32_t index;
+        int16_t slot_id;
+        uint8_t* record = ReserveInSomePage(static_cast<uint16_t>(size), &page, &index, &slot_id);
+        size_t first = rids.size();
+        std::vector<LogRecord> group;
+        int64_t bytes = 0;
+        while (true) {
+            BsonSerializer::SerializeInto(docs[i], record);
+            RecordID rid;
+            rid.page_id = page->GetPageId();
+            rid.slot_id = static_cast<uint16_t>(slot_id);
+            rids.push_back(rid);
+            bytes += static_cast<int64_t>(size);
+            if (logged) {
+                LogRecord log;
+                log.txn_id = txn->txn_id;
+                log.type = LogRecordType::INSERT;
+                log.page_id = rid.page_id;
+                log.slot_id = rid.slot_id;
+                log.after_image.assign(record, record + size);
+                group.push_back(std::move(log));
+            }
+            if (++i == docs.size()) break;
+
+            // Stay on this page while the next document fits in it
+            size = BsonSerializer::SerializedSize(docs[i]);
+            if (size + FORWARD_HEADER_SIZE > MaxRecordSize()) break;
+            record = SlottedPage::ReserveRecord(page->GetData(), static_cast<uint16_t>(size), &slot_id);
+            if (!record) break;
+        }
+
+        if (logged) {
+            page->NoteLoggedChange(wal_->GetCurrentLSN());
+            lsn_t lsn = wal_->AppendLogRecords(group);
+            SlottedPage::SetPageLSN(page->GetData(), lsn);
+            page->SetPageLSN(lsn);
+        }
+        if (insert_listener_) {
+            for (size_t r = first; r < rids.size(); r++) insert_listener_(rids[r], txn);
+        }
+        ReleaseInsertPage(page, index);
+        NoteSlotChange(static_cast<int64_t>(rids.size() - first), bytes);
+    }
+}
+
+// ============================================================================
+// DeleteRecord — a forwarded record goes with its stub
+// ============================================================================
+
+bool HeapFile::DeleteRecord(const RecordID& rid, Transaction* txn) {
+    RecordID target;
+    bool ok = DeleteSlot(rid, txn, &target);
+    RecordID unused;
+    if (ok && target.IsValid()) DeleteSlot(target, txn, &unused);
+    if (ok) NoteSlotChange(-1, 0);
+    return ok;
+}
+
+bool HeapFile::DeleteSlot(const RecordID& rid, Transaction* txn, RecordID* forward) {
+    if (forward) *forward = INVALID_RECORD_ID;
     Page* page = bpm_->FetchPage(rid.page_id);
     if (!page) return false;
 
+    page->WLatch();
+
+    // Capture the before image for the log while the record still exists
+    uint16_t old_len = 0;
+    const uint8_t* old_data = SlottedPage::GetRecord(page->GetData(), rid.slot_id, &old_len);
+    std::vector<RecordID> chains;
+    if (old_data) {
+        if (forward) CollectOwned(old_data, old_len, forward, &chains);
+        LogChange(txn, page, LogRecordType::DELETE, rid, old_data, old_len, nullptr, 0);
+    }
+
     bool ok = SlottedPage::DeleteRecord(page->GetData(), rid.slot_id);
+    uint16_t remaining = SlottedPage::GetFreeSpace(page->GetData());
+    page->WUnlatch();
 
     if (ok) {
-        // Update FSM
-        uint16_t remaining = SlottedPage::GetFreeSpace(page->GetData());
-        fsm_->UpdateFreeSpace(rid.page_id, remaining);
+        NoteFreeSpace(rid.page_id, remaining);
+        NoteSlotChange(0, -static_cast<int64_t>(old_len));
     }
 
     bpm_->UnpinPage(rid.page_id, ok);  // Dirty if deleted
+    if (ok) FreeExternals(chains, txn);
     return ok;
 }
 
 // ============================================================================
-// GetRecord
+// GetRecord — follows a forwarding stub
 // ============================================================================
 
 BsonDocument HeapFile::GetRecord(const RecordID& rid) {
-    Page* page = bpm_->FetchPage(rid.page_id);
-    if (!page) {
-        throw std::runtime_error("HeapFile: Failed to fetch page " + std::to_string(rid.page_id));
-    }
+    BsonDocument doc;
+    ReadRecord(rid, [&](const uint8_t* data, uint16_t len) {
+        doc = BsonSerializer::Deserialize(data, len, &resolver_);
+    });
+    return doc;
+}
 
-    uint16_t len;
-    const uint8_t* data = SlottedPage::GetRecord(page->GetData(), rid.slot_id, &len);
+void HeapFile::GetRecordBytes(const RecordID& rid, std::vector<uint8_t>* out) {
+    ReadRecord(rid, [&](const uint8_t* data, uint16_t len) { BsonView(data, len, &resolver_).CopyTo(out); });
+}
 
-    if (!data || len == 0) {
-        bpm_->UnpinPage(rid.page_id, false);
-        throw std::runtime_error("HeapFile: Record not found at " +
-            std::to_string(rid.page_id) + ":" + std::to_string(rid.slot_id));
-    }
+void HeapFile::ReadRecord(const RecordID& rid, const std::function<void(const uint8_t*, uint16_t)>& read) {
+    RecordID at = rid;
+    for (int hop = 0; hop < 2; hop++) {
+        Page* page = bpm_->FetchPage(at.page_id);
+        if (!page) {
+            throw std::runtime_error("HeapFile: Failed to fetch page " + std::to_string(at.page_id));
+        }
 
-    BsonDocument doc = BsonSerializer::Deserialize(data, len);
-    bpm_->UnpinPage(rid.page_id, false);
-    return doc;
+        page->RLatch();
+        uint16_t len;
+        const uint8_t* data = SlottedPage::GetRecord(page->GetData(), at.slot_id, &len);
+
+        if (!data || len == 0) {
+            page->RUnlatch();
+            bpm_->UnpinPage(at.page_id, false);
+            break;
+        }
+
+        RecordID link;
+        RecordKind kind = Classify(data, len, &link);
+        if (kind == RecordKind::STUB) {
+            page->RUnlatch();
+            bpm_->UnpinPage(at.page_id, false);
+            at = link;
+            continue;
+        }
+        if (kind == RecordKind::MOVED) {
+            data += FORWARD_HEADER_SIZE;
+            len -= FORWARD_HEADER_SIZE;
+        }
+
+        try {
+            read(data, len);
+        } catch (...) {
+            page->RUnlatch();
+            bpm_->UnpinPage(at.page_id, false);
+            throw;
+        }
+        page->RUnlatch();
+        bpm_->UnpinPage(at.page_id, false);
+        return;
+    }
+    throw std::runtime_error("HeapFile: Record not found at " +
+        std::to_string(rid.page_id) + ":" + std::to_string(rid.slot_id));
 }
 
 // ============================================================================
-// UpdateRecord — try in-place, else delete + re-insert
+// UpdateRecord — keep the RecordID: grow within the page, else move the
+// document to another page and leave a forwarding stub in its slot
 // ============================================================================
 
-RecordID HeapFile::UpdateRecord(const RecordID& rid, const BsonDocument& doc) {
-    std::vector<uint8_t> data = BsonSerializer::Serialize(doc);
-    uint16_t record_len = static_cast<uint16_t>(data.size());
-
+bool HeapFile::RewriteSlot(const RecordID& rid, const uint8_t* data, uint16_t len, Transaction* txn,
+                           SlotInfo* old) {
     Page* page = bpm_->FetchPage(rid.page_id);
     if (!page) {
         throw std::runtime_error("HeapFile: Failed to fetch page for update");
     }
 
-    bool ok = SlottedPage::UpdateRecord(page->GetData(), rid.slot_id, data.data(), record_len);
+    page->WLatch();
+    uint16_t old_len = 0;
+    const uint8_t* old_data = SlottedPage::GetRecord(page->GetData(), rid.slot_id, &old_len);
+    if (!old_data) {
+        page->WUnlatch();
+        bpm_->UnpinPage(rid.page_id, false);
+        throw std::runtime_error("HeapFile: Record not found at " +
+            std::to_string(rid.page_id) + ":" + std::to_string(rid.slot_id));
+    }
+    if (old) {
+        old->kind = Classify(old_data, old_len, &old->link);
+        old->len = old_len;
+    }
+    RecordID unused;
+    std::vector<RecordID> chains;
+    CollectOwned(old_data, old_len, &unused, &chains);
+    std::vector<uint8_t> before;
+    if (wal_ && txn) before.assign(old_data, old_data + old_len);
+
+    bool ok = SlottedPage::UpdateRecord(page->GetData(), rid.slot_id, data, len);
+    uint16_t remaining = 0;
+    if (ok) {
+        LogChange(txn, page, LogRecordType::UPDATE, rid, before.data(),
+                  static_cast<uint16_t>(before.size()), data, len);
+        remaining = SlottedPage::GetFreeSpace(page->GetData());
+    }
+    page->WUnlatch();
+    bpm_->UnpinPage(rid.page_id, ok);
 
     if (ok) {
-        bpm_->UnpinPage(rid.page_id, true);
+        NoteFreeSpace(rid.page_id, remaining);
+        NoteSlotChange(0, static_cast<int64_t>(len) - old_len);
+        FreeExternals(chains, txn);
+    }
+    return ok;
+}
+
+RecordID HeapFile::UpdateRecord(const RecordID& rid, const BsonDocument& doc, Transaction* txn) {
+    // One buffer per thread, reused across updates
+    thread_local std::vector<uint8_t> data;
+    Encode(doc, &data, txn);
+    if (data.size() > MaxRecordSize()) {
+        throw std::runtime_error("HeapFile: Record too large for a single page");
+    }
+    uint16_t record_len = static_cast<uint16_t>(data.size());
+
+    // Back in (or still in) its own slot: a stub's target is dropped
+    SlotInfo old;
+    if (RewriteSlot(rid, data.data(), record_len, txn, &old)) {
+        RecordID unused;
+        if (old.kind == RecordKind::STUB) DeleteSlot(old.link, txn, &unused);
+        return rid;
+    }
+
+    uint8_t stub[FORWARD_HEADER_SIZE];
+    if (old.kind == RecordKind::STUB) {
+        // Already forwarded: update the moved copy where it is, if it fits
+        thread_local std::vector<uint8_t> framed;
+        framed.resize(FORWARD_HEADER_SIZE + data.size());
+        WriteLink(framed.data(), FORWARDED, rid);
+        std::memcpy(framed.data() + FORWARD_HEADER_SIZE, data.data(), data.size());
+        if (framed.size() <= MaxRecordSize() &&
+            RewriteSlot(old.link, framed.data(), static_cast<uint16_t>(framed.size()), txn)) {
+            return rid;
+        }
+        // Else move it again and repoint the stub (same size, so in place)
+        RecordID moved = InsertBytes(data.data(), data.size(), &rid, txn);
+        WriteLink(stub, FORWARD_STUB, moved);
+        RewriteSlot(rid, stub, FORWARD_HEADER_SIZE, txn);
+        RecordID unused;
+        DeleteSlot(old.link, txn, &unused);
         return rid;
     }
 
-    // Didn't fit — delete old, insert new
-    bpm_->UnpinPage(rid.page_id, false);
-    DeleteRecord(rid);
-    return InsertRecord(doc);
+    // A record shorter than a stub has no room to leave one: it moves for good
+    if (old.len < FORWARD_HEADER_SIZE) {
+        DeleteRecord(rid, txn);
+        RecordID new_rid = InsertBytes(data.data(), data.size(), nullptr, txn);
+        NoteSlotChange(1, 0);
+        return new_rid;
+    }
+    // Shrinking to the stub always fits in the slot
+    RecordID moved = InsertBytes(data.data(), data.size(), &rid, txn);
+    WriteLink(stub, FORWARD_STUB, moved);
+    RewriteSlot(rid, stub, FORWARD_HEADER_SIZE, txn);
+    return rid;
+}
+
+// ============================================================================
+// Recount — rebuild the live counters from the pages
+// ============================================================================
+
+void HeapFile::Recount() {
+    uint32_t num_pages;
+    GetExtents(&num_pages);
+    uint64_t records = 0, bytes = 0;
+    for (uint32_t index = 0; index < num_pages; index++) {
+        page_id_t page_id = PageAt(index);
+        Page* page = bpm_->FetchPage(page_id, AccessType::SCAN);
+        if (!page) {
+            throw std::runtime_error("HeapFile: Failed to fetch page " + std::to_string(page_id));
+        }
+        page->RLatch();
+        const char* data = page->GetData();
+        uint16_t num_slots = SlottedPage::GetNumSlots(data);
+        for (uint16_t slot = 0; slot < num_slots; slot++) {
+            uint16_t len;
+            const uint8_t* record = SlottedPage::GetRecord(data, slot, &len);
+            if (!record) continue;
+            RecordID link;
+            if (!holds_chunks_ && Classify(record, len, &link) != RecordKind::MOVED) records++;
+            bytes += len;
+        }
+        page->RUnlatch();
+        bpm_->UnpinPage(page_id, false);
+    }
+    SetCounts(records, bytes);
 }
 
 // ============================================================================
 // Iterator
 // ============================================================================
 
-HeapFile::Iterator::Iterator(HeapFile* heap, page_id_t start_page, page_id_t max_page)
-    : heap_(heap), current_page_(start_page), start_page_(start_page),
-      max_page_(max_page), current_slot_(0) {}
+HeapFile::Iterator::Iterator(HeapFile* heap, std::vector<HeapExtent> extents, uint32_t num_pages)
+    : heap_(heap), extents_(std::move(extents)), num_pages_(num_pages), end_index_(num_pages),
+      current_index_(0), prefetched_until_(0), current_slot_(0) {
+    uint32_t start = 0;
+    for (const HeapExtent& extent : extents_) {
+        extent_starts_.push_back(start);
+        start += extent.num_pages;
+    }
+}
+
+page_id_t HeapFile::Iterator::PageAt(uint32_t index) const {
+    size_t i = std::upper_bound(extent_starts_.begin(), extent_starts_.end(), index) -
+               extent_starts_.begin() - 1;
+    return extents_[i].first_page + static_cast<page_id_t>(index - extent_starts_[i]);
+}
+
+void HeapFile::Iterator::ReadAhead() {
+    uint32_t depth = heap_->bpm_->GetReadAheadPages();
+    if (depth == 0 || prefetched_until_ >= end_index_) return;
+    if (prefetched_until_ > current_index_ + depth / 2) return;
+
+    // The current page is fetched right away; start just past it
+    uint32_t first = std::max(prefetched_until_, current_index_ + 1);
+    uint32_t last = std::min(current_index_ + depth, end_index_ - 1);
+    std::vector<page_id_t> pages;
+    for (uint32_t index = first; index <= last; index++) {
+        pages.push_back(PageAt(index));
+    }
+    if (!pages.empty()) heap_->bpm_->Prefetch(pages);
+    prefetched_until_ = last + 1;
+}
 
 bool HeapFile::Iterator::Next(RecordID* out_rid, BsonDocument* out_doc) {
-    while (current_page_ <= max_page_) {
-        Page* page = heap_->bpm_->FetchPage(current_page_);
+    return Next(out_rid, out_doc, nullptr);
+}
+
+bool HeapFile::Iterator::Next(RecordID* out_rid, BsonDocument* out_doc,
+                              const std::function<bool(const BsonView&)>& filter) {
+    return NextBatch(1, filter, [out_rid, out_doc](const RecordID& rid, const BsonView& record) {
+        if (out_doc) *out_doc = record.ToDocument();
+        *out_rid = rid;
+    }) == 1;
+}
+
+size_t HeapFile::Iterator::NextBatch(size_t max_records, const std::function<bool(const BsonView&)>& filter,
+                                     const Visitor& visit) {
+    size_t visited = 0;
+    while (visited < max_records && current_index_ < end_index_) {
+        if (current_slot_ == 0) ReadAhead();
+
+        page_id_t page_id = PageAt(current_index_);
+        Page* page = heap_->bpm_->FetchPage(page_id, AccessType::SCAN);
         if (!page) {
-            current_page_++;
+            current_index_++;
             current_slot_ = 0;
             continue;
         }
 
+        page->RLatch();
         uint16_t num_slots = SlottedPage::GetNumSlots(page->GetData());
 
-        while (current_slot_ < num_slots) {
-            if (SlottedPage::IsSlotOccupied(page->GetData(), current_slot_)) {
+        try {
+            for (; visited < max_records && current_slot_ < num_slots; current_slot_++) {
+                if (!SlottedPage::IsSlotOccupied(page->GetData(), current_slot_)) continue;
                 uint16_t len;
                 const uint8_t* data = SlottedPage::GetRecord(page->GetData(), current_slot_, &len);
 
-                if (data && len > 0) {
-                    out_rid->page_id = current_page_;
-                    out_rid->slot_id = current_slot_;
-                    *out_doc = BsonSerializer::Deserialize(data, len);
-                    
-                    current_slot_++;
-                    heap_->bpm_->UnpinPage(current_page_, false);
-                    return true;
+                // Stubs are skipped: their documents are visited where they
+                // moved to, under the home RecordID
+                RecordID home{page_id, current_slot_};
+                RecordKind kind = data ? Classify(data, len, &home) : RecordKind::STUB;
+                if (kind == RecordKind::MOVED) {
+                    data += FORWARD_HEADER_SIZE;
+                    len -= FORWARD_HEADER_SIZE;
                 }
+                if (kind == RecordKind::STUB || len == 0) continue;
+
+                BsonView record(data, len, &heap_->resolver_);
+                if (filter && !filter(record)) continue;
+                visit(home, record);
+                visited++;
             }
-            current_slot_++;
+        } catch (...) {
+            page->RUnlatch();
+            heap_->bpm_->UnpinPage(page_id, false);
+            throw;
         }
 
-        heap_->bpm_->UnpinPage(current_page_, false);
-        current_page_++;
-        current_slot_ = 0;
+        page->RUnlatch();
+        heap_->bpm_->UnpinPage(page_id, false);
+        if (current_slot_ >= num_slots) {
+            current_index_++;
+            current_slot_ = 0;
+        }
     }
-
-    return false;  // No more records
+    return visited;
 }
 
 void HeapFile::Iterator::Reset() {
-    current_page_ = start_page_;
+    SetRange(0, num_pages_);
+}
+
+void HeapFile::Iterator::SetRange(uint32_t first, uint32_t end) {
+    end_index_ = std::min(end, num_pages_);
+    current_index_ = first;
+    prefetched_until_ = first;
     current_slot_ = 0;
 }
 
 HeapFile::Iterator HeapFile::Begin() {
-    return Iterator(this, first_page_id_, max_page_id_);
+    uint32_t num_pages;
+    std::vector<HeapExtent> extents = GetExtents(&num_pages);
+    return Iterator(this, std::move(extents), num_pages);
 }
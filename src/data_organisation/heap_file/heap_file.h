@@ -6,8 +6,14 @@
 #include "storage_engine/page/slotted_page.h"
 #include "storage_engine/page/free_space_map.h"
 #include "storage_engine/serializer/serializer.h"
+#include "storage_engine/serializer/bson_view.h"
+#include "concurrency/transaction.h"
+#include "recovery/wal.h"
 #include <vector>
 #include <functional>
+#include <array>
+#include <atomic>
+#include <shared_mutex>
 
 // ============================================================================
 // Heap File
@@ -18,52 +24,184 @@
 //   - BufferPoolManager to fetch/create pages  
 //   - SlottedPage to manage records within a page
 //   - BsonSerializer to convert documents to/from bytes
+//   - WAL (optional) to log every change made on behalf of a transaction
+//
+// Pages come from the heap's own extents: runs of contiguous page ids
+// reserved through BufferPoolManager::AllocateExtent, 64 pages at first and
+// doubling up to 1024. Pages are taken from an extent in order, so every
+// extent but the last is full, and a scan walks only this heap's pages, in
+// file order. The catalog persists the extent list.
+//
+// Records keep their RecordID for life. An update that no longer fits in
+// its page moves the document elsewhere and leaves a forwarding stub in
+// the original slot; slots start with an int32 that tells them apart:
+//   BSON size (>= 5)  a plain document
+//   0                 stub: [page_id][slot_id] of the moved document
+//   -1                moved document: [home page_id][home slot_id][BSON]
+// Reads follow the stub, scans skip stubs and report moved documents
+// under their home RecordID, and a delete removes both.
+//
+// A document too large for a page keeps its biggest top-level string and
+// document values out of line, in the overflow heap (the collection's
+// second HeapFile): each becomes a BsonType::EXTERNAL element pointing at
+// a chain of chunk records, [page_id][slot_id] of the next chunk + bytes.
+// Reads fetch the chain only for values they look at: a filter on small
+// fields never reads it, a deserialized document gets every value back.
+// Rewriting or deleting the record frees the chains it pointed to.
+//
+// The FSM tracks pages by their index within the heap. Each inserter
+// (thread) keeps a hint, the index of the page it last inserted into, and
+// searches the FSM from there: it keeps filling its own page instead of
+// every inserter piling onto the lowest page with room.
+//
+// Thread safety: page contents are read under the page's shared latch and
+// modified under its exclusive latch; the page is always pinned first.
+// The extent list is guarded by extent_mutex_.
 // ============================================================================
 
+struct HeapExtent {
+    page_id_t first_page;
+    uint32_t num_pages;
+};
+
 class HeapFile {
 public:
-    // first_page_id: the first data page of this heap
-    // fsm: the free space map tracking this heap's pages
-    HeapFile(BufferPoolManager* bpm, FreeSpaceMap* fsm, page_id_t first_page_id);
+    static constexpr uint32_t FIRST_EXTENT_PAGES = 64;
+    static constexpr uint32_t MAX_EXTENT_PAGES = 1024;
+
+    // A new, empty heap: reserves the first extent and initializes its
+    // first page. fsm: the free space map tracking this heap's pages
+    HeapFile(BufferPoolManager* bpm, FreeSpaceMap* fsm);
+
+    // Reopen a heap from its persisted extent list, of which num_pages
+    // pages are in use. Initialized pages past num_pages in the last
+    // extent (added since the list was saved) are picked up as well.
+    HeapFile(BufferPoolManager* bpm, FreeSpaceMap* fsm, std::vector<HeapExtent> extents,
+             uint32_t num_pages);
 
     // Insert a BSON document. Returns a RecordID.
-    RecordID InsertRecord(const BsonDocument& doc);
+    // If a WAL is attached and txn is given, the change is logged.
+    RecordID InsertRecord(const BsonDocument& doc, Transaction* txn = nullptr);
+
+    // Insert a batch of documents, filling pages sequentially (see
+    // InsertRecords in the .cpp), all or none. Returns their RecordIDs, in order.
+    std::vector<RecordID> InsertRecords(const std::vector<BsonDocument>& docs, Transaction* txn = nullptr);
 
     // Delete a record by RecordID. Returns true on success.
-    bool DeleteRecord(const RecordID& rid);
+    bool DeleteRecord(const RecordID& rid, Transaction* txn = nullptr);
 
     // Get a record by RecordID. Returns the deserialized BSON document.
     // Throws if record not found.
     BsonDocument GetRecord(const RecordID& rid);
 
-    // Update a record. If it doesn't fit in place, delete + re-insert.
-    RecordID UpdateRecord(const RecordID& rid, const BsonDocument& doc);
+    // The same record as serialized BSON (see BsonView::CopyTo), read
+    // without decoding it. Throws if record not found.
+    void GetRecordBytes(const RecordID& rid, std::vector<uint8_t>* out);
+
+    // Update a record, keeping its RecordID (see above). Only a record
+    // too short to leave a stub in is deleted + re-inserted; the RecordID
+    // returned is the one it lives under.
+    RecordID UpdateRecord(const RecordID& rid, const BsonDocument& doc, Transaction* txn = nullptr);
+
+    // Attach the write-ahead log used for transactional changes
+    void SetWAL(WAL* wal) { wal_ = wal; }
+
+    // Heap holding the values of documents too large for a page. Without
+    // one, inserting such a document throws.
+    void SetOverflowHeap(HeapFile* overflow) {
+        overflow_ = overflow;
+        if (overflow) overflow->holds_chunks_ = true;
+    }
+
+    // Keep this heap's pages compressed on disk, the extents it reserves
+    // from now on included. Called once, right after construction.
+    void EnableCompression();
 
     // Get the first data page id
-    page_id_t GetFirstPageId() const { return first_page_id_; }
+    page_id_t GetFirstPageId() const;
 
-    // Set the maximum page id (used to know how many pages to scan)
-    void SetMaxPageId(page_id_t max_id) { max_page_id_ = max_id; }
-    page_id_t GetMaxPageId() const { return max_page_id_; }
+    // Snapshot of the extent list and of how many of its pages are in use
+    std::vector<HeapExtent> GetExtents(uint32_t* num_pages) const;
+
+    // Live documents (a forwarded one counts once; none in an overflow
+    // heap) and the bytes of every live slot, kept up to date by each
+    // change. Exact while the heap is open; the catalog persists them and
+    // Recount rebuilds them from the pages when what it saved may be stale.
+    uint64_t GetRecordCount() const { return live_records_.load(std::memory_order_relaxed); }
+    uint64_t GetRecordBytes() const { return live_bytes_.load(std::memory_order_relaxed); }
+    void SetCounts(uint64_t records, uint64_t bytes) {
+        live_records_.store(records, std::memory_order_relaxed);
+        live_bytes_.store(bytes, std::memory_order_relaxed);
+    }
+
+    // Count the live slots of every page in use (reads slot framing only)
+    void Recount();
+
+    // Called after the heap reserves a new extent, so the owner can persist
+    // the grown list. Runs on the inserting thread, outside any heap latch.
+    void SetExtentListener(std::function<void()> listener) { extent_listener_ = std::move(listener); }
+
+    // Called with each new document's RecordID (an insert, or an update
+    // that moved it for good) while its page is still write-latched, so
+    // no reader can see the document before the listener has run.
+    void SetInsertListener(std::function<void(const RecordID&, Transaction*)> listener) {
+        insert_listener_ = std::move(listener);
+    }
 
     // =========================================================================
     // Heap Iterator — sequential scan over all live records
+    //
+    // Visits the pages in use when it was created, extent by extent.
+    // Keeps the next GetReadAheadPages() heap pages in flight through
+    // BufferPoolManager::Prefetch while records of the current page are
+    // decoded, topping the window up once half of it has been consumed.
+    //
+    // With a filter, each record is first checked as a BsonView over its
+    // bytes in the latched page; only records that pass are deserialized.
+    // NextBatch hands out many records per page pin and latch.
     // =========================================================================
     class Iterator {
     public:
-        Iterator(HeapFile* heap, page_id_t start_page, page_id_t max_page);
+        Iterator(HeapFile* heap, std::vector<HeapExtent> extents, uint32_t num_pages);
 
         // Advance to the next record. Returns false when done.
         bool Next(RecordID* out_rid, BsonDocument* out_doc);
 
+        // Advance to the next record filter accepts (any, if filter is
+        // empty). out_doc may be null when only the RecordID is wanted.
+        bool Next(RecordID* out_rid, BsonDocument* out_doc, const std::function<bool(const BsonView&)>& filter);
+
+        // Call visit for each of the next max_records records filter
+        // accepts (any, if empty), staying on a page while it has them.
+        // visit runs under the page's read latch and sees the record in
+        // place. Returns the number visited; fewer than max_records means
+        // the scan is done.
+        using Visitor = std::function<void(const RecordID&, const BsonView&)>;
+        size_t NextBatch(size_t max_records, const std::function<bool(const BsonView&)>& filter,
+                         const Visitor& visit);
+
         // Reset to beginning
         void Reset();
 
+        // Pages the scan covers, and a restriction to those with index in
+        // [first, end), from the start of first (a morsel of a parallel scan)
+        uint32_t GetNumPages() const { return num_pages_; }
+        void SetRange(uint32_t first, uint32_t end);
+
     private:
+        // Page id of the index-th page in use (index < num_pages_)
+        page_id_t PageAt(uint32_t index) const;
+
+        // Prefetch ahead of current_index_ if the read-ahead window runs low
+        void ReadAhead();
+
         HeapFile* heap_;
-        page_id_t current_page_;
-        page_id_t start_page_;
-        page_id_t max_page_;
+        std::vector<HeapExtent> extents_;
+        std::vector<uint32_t> extent_starts_;  // Index of each extent's first page
+        uint32_t num_pages_;
+        uint32_t end_index_;         // Stop before this page (num_pages_ unless SetRange)
+        uint32_t current_index_;     // Position among the heap's pages
+        uint32_t prefetched_until_;  // Pages below this index were handed to Prefetch
         uint16_t current_slot_;
     };
 
@@ -71,11 +209,138 @@ public:
     Iterator Begin();
 
 private:
-    // Allocate a new data page, init it, register with FSM
-    page_id_t AllocateNewPage();
+    static constexpr int32_t FORWARD_STUB = 0;
+    static constexpr int32_t FORWARDED = -1;
+    static constexpr uint16_t FORWARD_HEADER_SIZE = sizeof(int32_t) + sizeof(page_id_t) + sizeof(uint16_t);
+
+    enum class RecordKind { PLAIN, STUB, MOVED };
+
+    struct SlotInfo {
+        RecordKind kind = RecordKind::PLAIN;
+        RecordID link;  // Stub: the moved document; moved: its home
+        uint16_t len = 0;
+    };
+
+    // Read a slot's framing; link is set for stubs and moved documents
+    static RecordKind Classify(const uint8_t* data, uint16_t len, RecordID* link);
+    static void WriteLink(uint8_t* dst, int32_t marker, const RecordID& link);
+
+    // Reserve record_len bytes in a page with room for them (allocating
+    // one if needed), found from this inserter's hint. The page is left
+    // pinned and write-latched; *index gets its heap index.
+    uint8_t* ReserveInSomePage(uint16_t record_len, Page** page, uint32_t* index, int16_t* slot_id);
+
+    // Unlatch and unpin a page ReserveInSomePage returned, noting its free
+    // space in the FSM and in this inserter's hint
+    void ReleaseInsertPage(Page* page, uint32_t index);
+
+    // This inserting thread's hint slot
+    std::atomic<uint32_t>& InsertHint();
+
+    // Take record_len bytes in some page and have write fill them, logged.
+    // new_document: tell the insert listener.
+    RecordID Place(uint16_t record_len, Transaction* txn, const std::function<void(uint8_t*)>& write,
+                   bool new_document = false);
+
+    // The work of InsertRecords: appends each document's RecordID to *rids
+    // as it is placed, so on a throw *rids holds the ones already in
+    void InsertPages(const std::vector<BsonDocument>& docs, Transaction* txn, std::vector<RecordID>* rids);
+
+    // Insert serialized bytes, framed as moved from *home if home is given
+    RecordID InsertBytes(const uint8_t* data, size_t len, const RecordID* home, Transaction* txn);
+
+    // Delete one slot. For a document slot (forward given), *forward gets
+    // the target if it held a stub and the values it kept out of line are
+    // freed; overflow chunks are deleted without looking inside.
+    bool DeleteSlot(const RecordID& rid, Transaction* txn, RecordID* forward);
+
+    // Replace one slot's bytes within its page, logged. Returns false
+    // (leaving it as it was) if the page cannot hold them; *old describes
+    // what the slot held either way.
+    bool RewriteSlot(const RecordID& rid, const uint8_t* data, uint16_t len, Transaction* txn,
+                     SlotInfo* old = nullptr);
+
+    // Call read on the document bytes of rid (a stub followed, a moved
+    // record's header stripped) under its page's read latch
+    void ReadRecord(const RecordID& rid, const std::function<void(const uint8_t*, uint16_t)>& read);
+
+    // Tell the FSM a page's free space
+    void NoteFreeSpace(page_id_t page_id, uint16_t free_bytes);
+
+    // Account for documents added or removed and slot bytes that changed
+    void NoteSlotChange(int64_t records, int64_t bytes) {
+        live_records_.fetch_add(static_cast<uint64_t>(records), std::memory_order_relaxed);
+        live_bytes_.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+    }
+
+    // ---- Out-of-line values (see above) ----
+    static constexpr uint16_t CHUNK_HEADER_SIZE = sizeof(page_id_t) + sizeof(uint16_t);
+    static constexpr size_t MIN_EXTERNAL_VALUE = 64;  // Smaller values always stay inline
+
+    // Largest record an empty page holds
+    uint16_t MaxRecordSize() const;
+
+    // Serialize doc into *out, moving values to the overflow heap if the
+    // record would not fit in a page together with a forwarding header
+    void Encode(const BsonDocument& doc, std::vector<uint8_t>* out, Transaction* txn);
+
+    // Write one value's bytes as a chunk chain; returns its first chunk
+    RecordID WriteExternal(const uint8_t* value, size_t size, Transaction* txn);
+
+    // The value an EXTERNAL element points to (the resolver_ behind reads)
+    BsonElementView ResolveExternal(const BsonElementView& pointer);
+
+    // What deleting or overwriting a slot lets go of: *forward gets a
+    // stub's target, *chains the chains a document (plain or moved) holds
+    void CollectOwned(const uint8_t* data, uint16_t len, RecordID* forward,
+                      std::vector<RecordID>* chains) const;
+
+    // First chunks of the chains a serialized document points to
+    void CollectExternals(const uint8_t* data, uint16_t len, std::vector<RecordID>* chains) const;
+    void FreeExternals(const std::vector<RecordID>& chains, Transaction* txn);
+
+    static constexpr size_t INSERT_HINT_SLOTS = 16;
+    static constexpr uint32_t NO_HINT = UINT32_MAX;
+
+    // Take the next page of the current extent (reserving a new extent if
+    // it is full), init it, register with FSM. *index gets its heap index.
+    page_id_t AllocateNewPage(uint32_t* index);
+
+    // Page id of the index-th page of the extents (extent_mutex_ held, or
+    // while the heap is not shared yet)
+    page_id_t PageAtLocked(uint32_t index) const;
+
+    // Heap index <-> page id; INVALID_PAGE_ID / FreeSpaceMap::NO_PAGE for
+    // pages that are not (yet) in use by this heap
+    page_id_t PageAt(uint32_t index) const;
+    uint32_t IndexOf(page_id_t page_id) const;
+
+    // Append a heap change to the WAL (no-op without WAL or txn) and tag
+    // the page, write-latched by the caller, with its LSN
+    void LogChange(Transaction* txn, Page* page, LogRecordType type, const RecordID& rid,
+                   const uint8_t* before, uint16_t before_len,
+                   const uint8_t* after, uint16_t after_len);
 
     BufferPoolManager* bpm_;
     FreeSpaceMap* fsm_;
-    page_id_t first_page_id_;
-    page_id_t max_page_id_;  // Tracks highest allocated page
+    WAL* wal_ = nullptr;
+    HeapFile* overflow_ = nullptr;
+    BsonExternalResolver resolver_ = [this](const BsonElementView& pointer) { return ResolveExternal(pointer); };
+    std::function<void()> extent_listener_;
+    std::function<void(const RecordID&, Transaction*)> insert_listener_;
+
+    // Inserter hints, picked by thread id; unset ones start at the rover
+    std::array<std::atomic<uint32_t>, INSERT_HINT_SLOTS> insert_hints_;
+    std::atomic<uint32_t> hint_rover_{0};
+
+    std::atomic<uint64_t> live_records_{0};  // See GetRecordCount
+    std::atomic<uint64_t> live_bytes_{0};
+
+    mutable std::shared_mutex extent_mutex_;
+    std::vector<HeapExtent> extents_;
+    std::vector<uint32_t> extent_starts_;  // Heap index of each extent's first page
+    uint32_t capacity_ = 0;   // Pages in all extents
+    uint32_t num_pages_ = 0;  // Pages in use: a prefix of the extents' pages
+    bool compressed_ = false;
+    bool holds_chunks_ = false;  // An overflow heap: slots are chunks, not documents
 };
@@ -1,114 +1,432 @@
 #include "catalog.h"
 #include "storage_engine/page/slotted_page.h"
+#include "storage_engine/serializer/bson_view.h"
+#include "data_organisation/bptree/entry_sorter.h"
+#include "data_organisation/bptree/index_key.h"
+#include <algorithm>
 #include <iostream>
+#include <random>
 #include <stdexcept>
 
 // ============================================================================
 // Constructor
 // ============================================================================
 
-Catalog::Catalog(BufferPoolManager* bpm) : bpm_(bpm) {}
+Catalog::Catalog(BufferPoolManager* bpm, WAL* wal, TransactionManager* txns)
+    : bpm_(bpm), wal_(wal), txns_(txns) {}
 
 // ============================================================================
-// CreateCollection — allocate FSM page + first heap page
+// Catalog entries — one BSON document per collection
+//
+//   { name, fsm, firstPage, compressed, clean,
+//     heap: { pages, extents, records, bytes }, overflowFsm, overflow: {...},
+//     indexes: { "0": { field, root }, ... } }
+//
+// extents packs the extent list as [4 bytes first_page][4 bytes num_pages]
+// per extent; pages is how many of their pages are in use, records and
+// bytes the heap's live counters. Page ids and counts are int64.
 // ============================================================================
 
-bool Catalog::CreateCollection(const std::string& name) {
-    if (collections_.find(name) != collections_.end()) {
-        std::cerr << "Catalog: Collection '" << name << "' already exists." << std::endl;
-        return false;
+static std::shared_ptr<BsonDocument> EncodeHeap(const HeapFile& heap) {
+    uint32_t num_pages;
+    std::vector<HeapExtent> extents = heap.GetExtents(&num_pages);
+    std::string packed(extents.size() * 8, '\0');
+    for (size_t i = 0; i < extents.size(); i++) {
+        std::memcpy(&packed[i * 8], &extents[i].first_page, 4);
+        std::memcpy(&packed[i * 8 + 4], &extents[i].num_pages, 4);
     }
+    auto doc = std::make_shared<BsonDocument>();
+    doc->Add("pages", int64_t(num_pages));
+    doc->Add("extents", std::move(packed));
+    doc->Add("records", int64_t(heap.GetRecordCount()));
+    doc->Add("bytes", int64_t(heap.GetRecordBytes()));
+    return doc;
+}
 
-    auto info = std::make_unique<CollectionInfo>();
-    info->name = name;
+static BsonDocument EncodeEntry(const CollectionInfo& info, bool clean) {
+    BsonDocument entry;
+    entry.Add("name", info.name);
+    entry.Add("fsm", int64_t(info.fsm_page));
+    entry.Add("firstPage", int64_t(info.first_heap_page));
+    entry.Add("compressed", info.compressed);
+    entry.Add("clean", clean);
+    entry.Add("heap", EncodeHeap(*info.heap_file));
+    entry.Add("overflowFsm", int64_t(info.overflow_fsm_page));
+    entry.Add("overflow", EncodeHeap(*info.overflow_heap));
+    auto indexes = std::make_shared<BsonDocument>();
+    for (size_t i = 0; i < info.indexes.size(); i++) {
+        auto index = std::make_shared<BsonDocument>();
+        index->Add("field", info.indexes[i].field_name);
+        index->Add("root", int64_t(info.indexes[i].btree->GetRootPageId()));
+        indexes->Add(std::to_string(i), index);
+    }
+    entry.Add("indexes", indexes);
+    return entry;
+}
 
-    // Allocate FSM page
+template <typename T>
+static const T& EntryField(const BsonDocument& doc, const char* field) {
+    auto it = doc.elements.find(field);
+    if (it == doc.elements.end() || !std::holds_alternative<T>(it->second)) {
+        throw std::runtime_error(std::string("Catalog: corrupt entry (no '") + field + "')");
+    }
+    return std::get<T>(it->second);
+}
+
+static const BsonDocument& EntryDocument(const BsonDocument& doc, const char* field) {
+    return *EntryField<std::shared_ptr<BsonDocument>>(doc, field);
+}
+
+static void DecodeHeap(const BsonDocument& doc, std::vector<HeapExtent>* extents, uint32_t* num_pages,
+                       uint64_t counts[2]) {
+    const std::string& packed = EntryField<std::string>(doc, "extents");
+    if (packed.empty() || packed.size() % 8 != 0) throw std::runtime_error("Catalog: corrupt extent list");
+    extents->resize(packed.size() / 8);
+    for (size_t i = 0; i < extents->size(); i++) {
+        std::memcpy(&(*extents)[i].first_page, &packed[i * 8], 4);
+        std::memcpy(&(*extents)[i].num_pages, &packed[i * 8 + 4], 4);
+    }
+    *num_pages = static_cast<uint32_t>(EntryField<int64_t>(doc, "pages"));
+    counts[0] = static_cast<uint64_t>(EntryField<int64_t>(doc, "records"));
+    counts[1] = static_cast<uint64_t>(EntryField<int64_t>(doc, "bytes"));
+}
+
+// ============================================================================
+// Catalog heaps — creation, header, logged changes
+// ============================================================================
+
+page_id_t Catalog::NewFSMPage() {
     page_id_t fsm_page_id;
     Page* fsm_page = bpm_->NewPage(&fsm_page_id);
     if (!fsm_page) {
         throw std::runtime_error("Catalog: Failed to allocate FSM page");
     }
-    std::memset(fsm_page->GetData(), 0, 4096);  // Zero out FSM page
+    std::memset(fsm_page->GetData(), 0, bpm_->GetPageSize());  // Zero out FSM page
     bpm_->UnpinPage(fsm_page_id, true);
-    info->fsm_page = fsm_page_id;
+    return fsm_page_id;
+}
 
-    // Create FSM object
-    info->fsm = std::make_unique<FreeSpaceMap>(bpm_, fsm_page_id);
+// Page 0:
+//   [4 bytes] HEADER_MAGIC
+//   Catalog heap, then catalog overflow heap:
+//     [4 bytes] fsm_page
+//     [4 bytes] num_pages (pages of the extents in use)
+//     [4 bytes] num_extents
+//     For each extent: [4 bytes] first_page, [4 bytes] num_pages
+void Catalog::WriteHeader() {
+    Page* page = bpm_->FetchPage(0);
+    if (!page) {
+        throw std::runtime_error("Catalog: Failed to fetch the catalog page");
+    }
+    char* data = page->GetData();
+    const size_t page_size = bpm_->GetPageSize();
+    page->WLatch();
+    std::memset(data, 0, page_size);
+    size_t offset = 0;
+    uint32_t magic = HEADER_MAGIC;
+    std::memcpy(data + offset, &magic, 4); offset += 4;
+    bool fits = true;
+    for (const FreeSpaceMap* fsm : {catalog_fsm_.get(), catalog_overflow_fsm_.get()}) {
+        const HeapFile* heap = fsm == catalog_fsm_.get() ? catalog_heap_.get() : catalog_overflow_.get();
+        uint32_t num_pages;
+        std::vector<HeapExtent> extents = heap->GetExtents(&num_pages);
+        uint32_t num_extents = static_cast<uint32_t>(extents.size());
+        if (offset + 12 + num_extents * 8 > page_size) {
+            fits = false;
+            break;
+        }
+        page_id_t fsm_page = fsm->GetStartPage();
+        std::memcpy(data + offset, &fsm_page, 4); offset += 4;
+        std::memcpy(data + offset, &num_pages, 4); offset += 4;
+        std::memcpy(data + offset, &num_extents, 4); offset += 4;
+        for (const HeapExtent& extent : extents) {
+            std::memcpy(data + offset, &extent.first_page, 4); offset += 4;
+            std::memcpy(data + offset, &extent.num_pages, 4); offset += 4;
+        }
+    }
+    page->WUnlatch();
+    bpm_->UnpinPage(0, true);
+    if (!fits) throw std::runtime_error("Catalog: catalog heap extent list does not fit page 0");
+    // Not logged: on disk before any entry in a new extent can commit
+    bpm_->FlushPage(0);
+}
 
-    // Allocate first heap page
-    page_id_t heap_page_id;
-    Page* heap_page = bpm_->NewPage(&heap_page_id);
-    if (!heap_page) {
-        throw std::runtime_error("Catalog: Failed to allocate heap page");
+void Catalog::EnsureCatalogHeap() {
+    if (catalog_heap_) return;
+    catalog_fsm_ = std::make_unique<FreeSpaceMap>(bpm_, NewFSMPage());
+    catalog_heap_ = std::make_unique<HeapFile>(bpm_, catalog_fsm_.get());
+    catalog_overflow_fsm_ = std::make_unique<FreeSpaceMap>(bpm_, NewFSMPage());
+    catalog_overflow_ = std::make_unique<HeapFile>(bpm_, catalog_overflow_fsm_.get());
+    for (HeapFile* heap : {catalog_heap_.get(), catalog_overflow_.get()}) {
+        heap->SetWAL(wal_);
+        heap->SetExtentListener([this] { WriteHeader(); });
     }
-    SlottedPage::Init(heap_page->GetData());
-    bpm_->UnpinPage(heap_page_id, true);
-    info->first_heap_page = heap_page_id;
+    catalog_heap_->SetOverflowHeap(catalog_overflow_.get());
+    for (page_id_t page_id : {catalog_fsm_->GetStartPage(), catalog_heap_->GetFirstPageId(),
+                              catalog_overflow_fsm_->GetStartPage(), catalog_overflow_->GetFirstPageId()}) {
+        bpm_->FlushPage(page_id);
+    }
+    WriteHeader();
+}
 
-    // Register with FSM
-    uint16_t free_space = 4096 - sizeof(PageHeader);  // Approximate
-    info->fsm->RegisterNewPage(heap_page_id, free_space);
+lsn_t Catalog::RunLogged(const std::function<void(Transaction*)>& change) {
+    std::lock_guard<std::mutex> guard(entry_mutex_);
+    Transaction* txn = txns_ ? txns_->Begin() : nullptr;
+    try {
+        change(txn);
+    } catch (...) {
+        if (txn) {
+            txns_->Abort(txn);
+            txns_->Release(txn);
+        }
+        throw;
+    }
+    if (!txn) return INVALID_LSN;
+    lsn_t lsn = txns_->Commit(txn);
+    txns_->Release(txn);
+    return lsn;
+}
 
-    // Create HeapFile object
-    info->heap_file = std::make_unique<HeapFile>(bpm_, info->fsm.get(), heap_page_id);
+void Catalog::Force(lsn_t lsn) {
+    if (wal_ && lsn != INVALID_LSN) wal_->FlushUntil(lsn);
+}
 
-    collections_[name] = std::move(info);
+lsn_t Catalog::WriteEntry(const CollectionInfo& info, bool clean) {
+    BsonDocument entry = EncodeEntry(info, clean);
+    return RunLogged([&](Transaction* txn) { catalog_heap_->UpdateRecord(info.catalog_rid, entry, txn); });
+}
+
+// ============================================================================
+// CreateCollection — allocate FSM pages + first extents of both heaps
+// ============================================================================
+
+void Catalog::WireHeaps(CollectionInfo* info) {
+    for (HeapFile* heap : {info->heap_file.get(), info->overflow_heap.get()}) {
+        heap->SetWAL(wal_);
+        if (info->compressed) heap->EnableCompression();
+    }
+    info->heap_file->SetOverflowHeap(info->overflow_heap.get());
+    info->versions = std::make_unique<VersionStore>();
+    info->heap_file->SetInsertListener([versions = info->versions.get()](const RecordID& rid, Transaction* txn) {
+        versions->Install(rid, nullptr, txn);
+    });
+}
+
+bool Catalog::CreateCollection(const std::string& name, bool compressed) {
+    std::unique_lock<std::shared_mutex> guard(latch_);
+    if (collections_.find(name) != collections_.end()) {
+        std::cerr << "Catalog: Collection '" << name << "' already exists." << std::endl;
+        return false;
+    }
+    EnsureCatalogHeap();
+
+    auto info = std::make_unique<CollectionInfo>();
+    info->name = name;
+    info->compressed = compressed;
+
+    // FSM pages and objects
+    page_id_t fsm_page_id = NewFSMPage();
+    info->fsm_page = fsm_page_id;
+    info->fsm = std::make_unique<FreeSpaceMap>(bpm_, fsm_page_id);
+    info->overflow_fsm_page = NewFSMPage();
+    info->overflow_fsm = std::make_unique<FreeSpaceMap>(bpm_, info->overflow_fsm_page);
+
+    // Create HeapFile objects — each reserves its first extent
+    info->heap_file = std::make_unique<HeapFile>(bpm_, info->fsm.get());
+    info->overflow_heap = std::make_unique<HeapFile>(bpm_, info->overflow_fsm.get());
+    WireHeaps(info.get());
+    page_id_t heap_page_id = info->heap_file->GetFirstPageId();
+    info->first_heap_page = heap_page_id;
+
+    // The new pages are not logged: write them before the entry naming
+    // them can commit, so a restart never hands their ids out again
+    for (page_id_t page_id : {fsm_page_id, heap_page_id, info->overflow_fsm_page,
+                              info->overflow_heap->GetFirstPageId()}) {
+        bpm_->FlushPage(page_id);
+    }
+    BsonDocument entry = EncodeEntry(*info, /*clean=*/false);
+    lsn_t lsn = RunLogged([&](Transaction* txn) { info->catalog_rid = catalog_heap_->InsertRecord(entry, txn); });
+    WatchExtents(info.get());
+
+    RecordID rid = info->catalog_rid;
+    collections_[name] = Entry{rid, std::move(info)};
+    Force(lsn);
 
     std::cout << "Catalog: Created collection '" << name
               << "' (FSM page=" << fsm_page_id
-              << ", Heap page=" << heap_page_id << ")" << std::endl;
+              << ", Heap page=" << heap_page_id << (compressed ? ", compressed" : "") << ")" << std::endl;
 
     return true;
 }
 
+// ============================================================================
+// WatchExtents — re-save an entry when one of its heaps' extent lists grows
+//
+// Pages added within a saved extent are found again on reopen, a new
+// extent is not. Runs on the inserting thread with no catalog or heap
+// latch held; the entry's transaction commits before the insert's.
+// ============================================================================
+
+void Catalog::WatchExtents(CollectionInfo* info) {
+    for (HeapFile* heap : {info->heap_file.get(), info->overflow_heap.get()}) {
+        heap->SetExtentListener([this, info] {
+            if (save_on_extent_) WriteEntry(*info, /*clean=*/false);
+        });
+    }
+}
+
 // ============================================================================
 // DropCollection
 // ============================================================================
 
 bool Catalog::DropCollection(const std::string& name) {
+    std::unique_lock<std::shared_mutex> guard(latch_);
     auto it = collections_.find(name);
     if (it == collections_.end()) {
         return false;
     }
 
     // In a full implementation, we'd deallocate all pages.
-    // For now, just remove from catalog.
+    // For now, just remove its entry.
+    RecordID rid = it->second.rid;
+    lsn_t lsn = RunLogged([&](Transaction* txn) { catalog_heap_->DeleteRecord(rid, txn); });
     collections_.erase(it);
+    Force(lsn);
     std::cout << "Catalog: Dropped collection '" << name << "'" << std::endl;
     return true;
 }
 
 // ============================================================================
-// GetCollection
+// GetCollection — open the collection on first use
 // ============================================================================
 
 CollectionInfo* Catalog::GetCollection(const std::string& name) {
+    {
+        std::shared_lock<std::shared_mutex> guard(latch_);
+        auto it = collections_.find(name);
+        if (it == collections_.end()) {
+            return nullptr;
+        }
+        if (it->second.info) return it->second.info.get();
+    }
+    std::unique_lock<std::shared_mutex> guard(latch_);
     auto it = collections_.find(name);
     if (it == collections_.end()) {
         return nullptr;
     }
-    return it->second.get();
+    if (!it->second.info) OpenEntry(name, &it->second);
+    return it->second.info.get();
+}
+
+void Catalog::OpenEntry(const std::string& name, Entry* entry) {
+    BsonDocument doc = catalog_heap_->GetRecord(entry->rid);
+    auto info = std::make_unique<CollectionInfo>();
+    info->name = name;
+    info->catalog_rid = entry->rid;
+    info->fsm_page = static_cast<page_id_t>(EntryField<int64_t>(doc, "fsm"));
+    info->first_heap_page = static_cast<page_id_t>(EntryField<int64_t>(doc, "firstPage"));
+    info->compressed = EntryField<bool>(doc, "compressed");
+    info->overflow_fsm_page = static_cast<page_id_t>(EntryField<int64_t>(doc, "overflowFsm"));
+    bool clean = EntryField<bool>(doc, "clean");
+
+    // Reconstruct FSMs and HeapFiles
+    uint32_t num_pages, overflow_num_pages;
+    std::vector<HeapExtent> extents, overflow_extents;
+    uint64_t counts[2], overflow_counts[2];
+    DecodeHeap(EntryDocument(doc, "heap"), &extents, &num_pages, counts);
+    DecodeHeap(EntryDocument(doc, "overflow"), &overflow_extents, &overflow_num_pages, overflow_counts);
+    info->fsm = std::make_unique<FreeSpaceMap>(bpm_, info->fsm_page);
+    info->heap_file = std::make_unique<HeapFile>(bpm_, info->fsm.get(), std::move(extents), num_pages);
+    info->overflow_fsm = std::make_unique<FreeSpaceMap>(bpm_, info->overflow_fsm_page);
+    info->overflow_heap = std::make_unique<HeapFile>(bpm_, info->overflow_fsm.get(),
+                                                     std::move(overflow_extents), overflow_num_pages);
+    WireHeaps(info.get());
+    if (clean) {
+        info->heap_file->SetCounts(counts[0], counts[1]);
+        info->overflow_heap->SetCounts(overflow_counts[0], overflow_counts[1]);
+    } else {
+        info->heap_file->Recount();
+        info->overflow_heap->Recount();
+    }
+
+    // Indexes
+    for (const auto& [position, value] : EntryDocument(doc, "indexes").elements) {
+        if (!std::holds_alternative<std::shared_ptr<BsonDocument>>(value)) continue;
+        const BsonDocument& index = *std::get<std::shared_ptr<BsonDocument>>(value);
+        IndexInfo idx_info;
+        idx_info.field_name = EntryField<std::string>(index, "field");
+        idx_info.btree_root_page = static_cast<page_id_t>(EntryField<int64_t>(index, "root"));
+        idx_info.btree = std::make_unique<BPlusTree>(bpm_, idx_info.btree_root_page);
+        info->indexes.push_back(std::move(idx_info));
+    }
+
+    // Index pages are not logged: after a crash the saved trees may miss
+    // entries, hold ones since deleted, or have a stale root. The heap was
+    // recovered, so build them again from it (the old trees' pages are
+    // left behind).
+    if (!clean) {
+        for (IndexInfo& idx : info->indexes) BuildIndex(info.get(), &idx);
+    }
+
+    // In use from now on (and the rebuilt roots recorded)
+    WriteEntry(*info, /*clean=*/false);
+    WatchExtents(info.get());
+    entry->info = std::move(info);
 }
 
 // ============================================================================
-// CreateIndex — allocate a B+ Tree root page and build the index
+// IndexStatsBuilder — IndexStats from keys fed in index order
+//
+// Entry and distinct counts are exact (equal keys arrive together); the
+// histogram bounds come from a uniform sample of SAMPLE_SIZE keys
+// (reservoir sampling), except the last, which is the true largest key.
 // ============================================================================
 
-bool Catalog::CreateIndex(const std::string& collection_name, const std::string& field_name) {
-    CollectionInfo* coll = GetCollection(collection_name);
-    if (!coll) {
-        std::cerr << "Catalog: Collection '" << collection_name << "' not found." << std::endl;
-        return false;
+class IndexStatsBuilder {
+public:
+    static constexpr size_t SAMPLE_SIZE = 4096;
+    static constexpr size_t NUM_BUCKETS = 64;
+
+    void Add(const std::string& key) {
+        if (stats_.num_entries == 0) {
+            stats_.min_key = key;
+        }
+        if (stats_.num_entries == 0 || key != last_) {
+            stats_.distinct_keys++;
+            last_ = key;
+        }
+        stats_.num_entries++;
+        if (sample_.size() < SAMPLE_SIZE) {
+            sample_.push_back(key);
+        } else {
+            uint64_t slot = rng_() % stats_.num_entries;
+            if (slot < SAMPLE_SIZE) sample_[slot] = key;
+        }
     }
 
-    // Check if index already exists
-    for (auto& idx : coll->indexes) {
-        if (idx.field_name == field_name) {
-            std::cerr << "Catalog: Index on '" << field_name << "' already exists." << std::endl;
-            return false;
+    IndexStats Finish() {
+        std::sort(sample_.begin(), sample_.end());
+        size_t buckets = std::min(NUM_BUCKETS, sample_.size());
+        for (size_t i = 1; i <= buckets; i++) {
+            stats_.bounds.push_back(sample_[i * sample_.size() / buckets - 1]);
         }
+        if (!stats_.bounds.empty()) stats_.bounds.back() = last_;
+        stats_.analyzed = true;
+        return std::move(stats_);
     }
 
+private:
+    IndexStats stats_;
+    std::string last_;
+    std::vector<std::string> sample_;
+    std::mt19937_64 rng_{0x5eed};  // Fixed seed: the same data gives the same plans
+};
+
+// ============================================================================
+// BuildIndex — a new B+ Tree over the collection's documents
+// ============================================================================
+
+uint64_t Catalog::BuildIndex(CollectionInfo* coll, IndexInfo* idx_info) {
     // Allocate root page for B+ Tree
     page_id_t root_page_id;
     Page* root_page = bpm_->NewPage(&root_page_id);
@@ -117,39 +435,69 @@ bool Catalog::CreateIndex(const std::string& collection_name, const std::string&
     }
 
     // Initialize as empty leaf node
-    std::memset(root_page->GetData(), 0, 4096);
-    // Write an empty leaf header
-    char* data = root_page->GetData();
-    data[0] = 1;  // is_leaf = true
-    // num_keys = 0, next_leaf = -1 (already zeroed, just set next_leaf)
-    page_id_t invalid = INVALID_PAGE_ID;
-    std::memcpy(data + 3, &invalid, sizeof(page_id_t));
+    BPlusTree::InitLeaf(root_page->GetData(), bpm_->GetPageSize());
 
     bpm_->UnpinPage(root_page_id, true);
 
-    // Create B+ Tree object
-    IndexInfo idx_info;
-    idx_info.field_name = field_name;
-    idx_info.btree_root_page = root_page_id;
-    idx_info.btree = std::make_unique<BPlusTree>(bpm_, root_page_id);
+    idx_info->btree = std::make_unique<BPlusTree>(bpm_, root_page_id);
 
-    // Build index by scanning existing records
+    // Sort the heap's (key, RecordID) pairs, then load the tree bottom-up
+    // from the sorted stream. Both passes see every key, so the statistics
+    // come for free.
+    IndexEntrySorter sorter;
     HeapFile::Iterator it = coll->heap_file->Begin();
     RecordID rid;
     BsonDocument doc;
+    std::string key;
+    uint64_t num_rows = 0;
     while (it.Next(&rid, &doc)) {
-        auto field_it = doc.elements.find(field_name);
-        if (field_it != doc.elements.end()) {
-            // Extract the string key
-            if (std::holds_alternative<std::string>(field_it->second)) {
-                idx_info.btree->Insert(std::get<std::string>(field_it->second), rid);
-            } else if (std::holds_alternative<int32_t>(field_it->second)) {
-                idx_info.btree->Insert(std::to_string(std::get<int32_t>(field_it->second)), rid);
-            }
+        num_rows++;
+        auto field_it = doc.elements.find(idx_info->field_name);
+        if (field_it != doc.elements.end() && IndexKey::Encode(field_it->second, &key)) {
+            sorter.Add(key, rid);
+        }
+    }
+    sorter.Finish();
+    IndexStatsBuilder stats;
+    idx_info->btree->BulkLoad([&sorter, &stats](std::string* k, RecordID* r) {
+        if (!sorter.Next(k, r)) return false;
+        stats.Add(*k);
+        return true;
+    });
+    idx_info->stats = stats.Finish();
+    idx_info->btree_root_page = idx_info->btree->GetRootPageId();
+    return num_rows;
+}
+
+// ============================================================================
+// CreateIndex — allocate a B+ Tree root page and build the index
+// ============================================================================
+
+bool Catalog::CreateIndex(const std::string& collection_name, const std::string& field_name) {
+    CollectionInfo* coll = GetCollection(collection_name);
+    if (!coll) {
+        std::cerr << "Catalog: Collection '" << collection_name << "' not found." << std::endl;
+        return false;
+    }
+
+    // Check if index already exists
+    for (auto& idx : coll->indexes) {
+        if (idx.field_name == field_name) {
+            std::cerr << "Catalog: Index on '" << field_name << "' already exists." << std::endl;
+            return false;
         }
     }
 
+    IndexInfo idx_info;
+    idx_info.field_name = field_name;
+    uint64_t num_rows = BuildIndex(coll, &idx_info);
+    coll->stats.analyzed = true;
+    coll->stats.row_count = num_rows;
+    coll->heap_file->GetExtents(&coll->stats.page_count);
+    page_id_t root_page_id = idx_info.btree_root_page;
+
     coll->indexes.push_back(std::move(idx_info));
+    Force(WriteEntry(*coll, /*clean=*/false));
 
     std::cout << "Catalog: Created index on '" << collection_name << "." << field_name
               << "' (root page=" << root_page_id << ")" << std::endl;
@@ -157,11 +505,40 @@ bool Catalog::CreateIndex(const std::string& collection_name, const std::string&
     return true;
 }
 
+// ============================================================================
+// Analyze — refresh the optimizer statistics of a collection
+// ============================================================================
+
+bool Catalog::Analyze(const std::string& collection_name) {
+    CollectionInfo* coll = GetCollection(collection_name);
+    if (!coll) return false;
+
+    // Records are counted without decoding them
+    uint64_t num_rows = 0;
+    HeapFile::Iterator it = coll->heap_file->Begin();
+    RecordID rid;
+    while (it.Next(&rid, nullptr, nullptr)) num_rows++;
+    coll->stats.analyzed = true;
+    coll->stats.row_count = num_rows;
+    coll->heap_file->GetExtents(&coll->stats.page_count);
+
+    // Every key sorts between the empty string and a lone 0xFF
+    for (auto& idx : coll->indexes) {
+        IndexStatsBuilder stats;
+        BPlusTree::Iterator keys(idx.btree.get(), std::string(), std::string(1, '\xff'));
+        std::string key;
+        while (keys.Next(&key, &rid)) stats.Add(key);
+        idx.stats = stats.Finish();
+    }
+    return true;
+}
+
 // ============================================================================
 // ListCollections
 // ============================================================================
 
 std::vector<std::string> Catalog::ListCollections() const {
+    std::shared_lock<std::shared_mutex> guard(latch_);
     std::vector<std::string> names;
     for (auto& [name, _] : collections_) {
         names.push_back(name);
@@ -169,133 +546,95 @@ std::vector<std::string> Catalog::ListCollections() const {
     return names;
 }
 
-// ============================================================================
-// SaveCatalog — persist metadata to page 0
-//
-// Format on page 0:
-//   [4 bytes] num_collections
-//   For each collection:
-//     [4 bytes] name_len
-//     [name_len bytes] name
-//     [4 bytes] fsm_page
-//     [4 bytes] first_heap_page
-//     [4 bytes] num_indexes
-//     For each index:
-//       [4 bytes] field_name_len
-//       [field_name_len bytes] field_name
-//       [4 bytes] btree_root_page
-// ============================================================================
-
-void Catalog::SaveCatalog() {
-    // Ensure page 0 exists — try to fetch, create if needed
-    Page* page = bpm_->FetchPage(0);
-    if (!page) {
-        page_id_t pid;
-        page = bpm_->NewPage(&pid);
-        if (!page) {
-            std::cerr << "Catalog: Failed to allocate catalog page!" << std::endl;
-            return;
-        }
+size_t Catalog::PruneVersions(uint64_t oldest_read_ts) {
+    std::shared_lock<std::shared_mutex> guard(latch_);
+    size_t dropped = 0;
+    for (auto& [name, entry] : collections_) {
+        if (entry.info) dropped += entry.info->versions->Prune(oldest_read_ts);
     }
+    return dropped;
+}
 
-    char* data = page->GetData();
-    std::memset(data, 0, 4096);
-    size_t offset = 0;
-
-    uint32_t num_collections = static_cast<uint32_t>(collections_.size());
-    std::memcpy(data + offset, &num_collections, 4); offset += 4;
-
-    for (auto& [name, info] : collections_) {
-        // Name
-        uint32_t name_len = static_cast<uint32_t>(name.size());
-        std::memcpy(data + offset, &name_len, 4); offset += 4;
-        std::memcpy(data + offset, name.c_str(), name_len); offset += name_len;
-
-        // Pages
-        std::memcpy(data + offset, &info->fsm_page, 4); offset += 4;
-        std::memcpy(data + offset, &info->first_heap_page, 4); offset += 4;
-
-        // Indexes
-        uint32_t num_indexes = static_cast<uint32_t>(info->indexes.size());
-        std::memcpy(data + offset, &num_indexes, 4); offset += 4;
-
-        for (auto& idx : info->indexes) {
-            uint32_t field_len = static_cast<uint32_t>(idx.field_name.size());
-            std::memcpy(data + offset, &field_len, 4); offset += 4;
-            std::memcpy(data + offset, idx.field_name.c_str(), field_len); offset += field_len;
-            std::memcpy(data + offset, &idx.btree_root_page, 4); offset += 4;
-        }
+// ============================================================================
+// SaveCatalog — rewrite the entries of the opened collections
+// ============================================================================
 
-        if (offset >= 4000) {
-            std::cerr << "Catalog: Warning — catalog metadata approaching page limit!" << std::endl;
-            break;
-        }
+void Catalog::SaveCatalog(bool final) {
+    std::shared_lock<std::shared_mutex> guard(latch_);
+    for (auto& [name, entry] : collections_) {
+        if (entry.info) WriteEntry(*entry.info, final);
     }
-
-    bpm_->UnpinPage(0, true);
-    bpm_->FlushAllPages();
 }
 
 // ============================================================================
-// LoadCatalog — restore metadata from page 0
+// LoadCatalog — find the catalog heaps, read the collection names
 // ============================================================================
 
 void Catalog::LoadCatalog() {
+    std::unique_lock<std::shared_mutex> guard(latch_);
     Page* page = bpm_->FetchPage(0);
     if (!page) return;
 
-    char* data = page->GetData();
+    const char* data = page->GetData();
+    const size_t page_size = bpm_->GetPageSize();
     size_t offset = 0;
 
-    uint32_t num_collections;
-    std::memcpy(&num_collections, data + offset, 4); offset += 4;
-
-    if (num_collections == 0 || num_collections > 1000) {
-        // No saved catalog or corrupt data
+    uint32_t magic;
+    std::memcpy(&magic, data + offset, 4); offset += 4;
+    if (magic != HEADER_MAGIC) {
+        // No collection created yet
         bpm_->UnpinPage(0, false);
         return;
     }
 
-    for (uint32_t c = 0; c < num_collections; c++) {
-        auto info = std::make_unique<CollectionInfo>();
-
-        // Name
-        uint32_t name_len;
-        std::memcpy(&name_len, data + offset, 4); offset += 4;
-        if (name_len == 0 || name_len > 255 || offset + name_len > 4096) break;
-        info->name = std::string(data + offset, name_len); offset += name_len;
-
-        // Pages
-        std::memcpy(&info->fsm_page, data + offset, 4); offset += 4;
-        std::memcpy(&info->first_heap_page, data + offset, 4); offset += 4;
-
-        // Reconstruct FSM and HeapFile
-        info->fsm = std::make_unique<FreeSpaceMap>(bpm_, info->fsm_page);
-        info->heap_file = std::make_unique<HeapFile>(bpm_, info->fsm.get(), info->first_heap_page);
-
-        // Indexes
-        uint32_t num_indexes;
-        std::memcpy(&num_indexes, data + offset, 4); offset += 4;
-
-        for (uint32_t i = 0; i < num_indexes; i++) {
-            IndexInfo idx_info;
-
-            uint32_t field_len;
-            std::memcpy(&field_len, data + offset, 4); offset += 4;
-            if (field_len == 0 || field_len > 255 || offset + field_len > 4096) break;
-            idx_info.field_name = std::string(data + offset, field_len); offset += field_len;
-
-            std::memcpy(&idx_info.btree_root_page, data + offset, 4); offset += 4;
-
-            idx_info.btree = std::make_unique<BPlusTree>(bpm_, idx_info.btree_root_page);
-            info->indexes.push_back(std::move(idx_info));
+    page_id_t fsm_pages[2];
+    uint32_t num_pages[2];
+    std::vector<HeapExtent> extents[2];
+    for (int heap = 0; heap < 2; heap++) {
+        uint32_t num_extents;
+        if (offset + 12 > page_size) break;
+        std::memcpy(&fsm_pages[heap], data + offset, 4); offset += 4;
+        std::memcpy(&num_pages[heap], data + offset, 4); offset += 4;
+        std::memcpy(&num_extents, data + offset, 4); offset += 4;
+        if (num_extents == 0 || offset + num_extents * 8 > page_size) break;
+        extents[heap].resize(num_extents);
+        for (HeapExtent& extent : extents[heap]) {
+            std::memcpy(&extent.first_page, data + offset, 4); offset += 4;
+            std::memcpy(&extent.num_pages, data + offset, 4); offset += 4;
         }
+    }
+    bpm_->UnpinPage(0, false);
+    if (extents[0].empty() || extents[1].empty()) {
+        throw std::runtime_error("Catalog: corrupt catalog header");
+    }
 
-        std::string coll_name = info->name;
-        collections_[coll_name] = std::move(info);
+    catalog_fsm_ = std::make_unique<FreeSpaceMap>(bpm_, fsm_pages[0]);
+    catalog_heap_ = std::make_unique<HeapFile>(bpm_, catalog_fsm_.get(), std::move(extents[0]), num_pages[0]);
+    catalog_overflow_fsm_ = std::make_unique<FreeSpaceMap>(bpm_, fsm_pages[1]);
+    catalog_overflow_ = std::make_unique<HeapFile>(bpm_, catalog_overflow_fsm_.get(), std::move(extents[1]),
+                                                   num_pages[1]);
+    for (HeapFile* heap : {catalog_heap_.get(), catalog_overflow_.get()}) {
+        heap->SetWAL(wal_);
+        heap->SetExtentListener([this] { WriteHeader(); });
     }
+    catalog_heap_->SetOverflowHeap(catalog_overflow_.get());
 
-    bpm_->UnpinPage(0, false);
+    // Only the names: each entry is read in full on first use
+    HeapFile::Iterator it = catalog_heap_->Begin();
+    RecordID rid;
+    std::string name;
+    auto read_name = [&name](const BsonView& entry) {
+        BsonElementView element;
+        name.clear();
+        if (entry.Find("name", &element) && element.type == BsonType::STRING) name = element.AsString();
+        return true;
+    };
+    while (it.Next(&rid, nullptr, read_name)) {
+        if (name.empty()) {
+            throw std::runtime_error("Catalog: corrupt entry (no 'name')");
+        }
+        collections_[name] = Entry{rid, nullptr};
+    }
 
     if (!collections_.empty()) {
         std::cout << "Catalog: Loaded " << collections_.size() << " collection(s) from disk." << std::endl;
@@ -5,9 +5,15 @@
 #include "storage_engine/page/free_space_map.h"
 #include "data_organisation/heap_file/heap_file.h"
 #include "data_organisation/bptree/bptree.h"
+#include "concurrency/transaction.h"
+#include "concurrency/version_store.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <shared_mutex>
 #include <vector>
 
 // ============================================================================
@@ -15,53 +21,183 @@
 //
 // CollectionInfo tracks:
 //   - Collection name
-//   - First heap page (root of the heap file)
+//   - First heap page (first page of the heap's first extent)
 //   - FSM page for the collection
 //   - List of indexes (field_name → B+ Tree root page)
 //   - Pointers to the HeapFile and FreeSpaceMap objects
+//   - Optimizer statistics for the heap and each index (see Analyze)
+//   - The overflow heap (and its FSM) holding values of documents too
+//     large for a page
+//
+// The collection map is guarded by latch_, so lookups may run concurrently
+// with CreateCollection/DropCollection. A CollectionInfo* stays valid only
+// until its collection is dropped, and CreateIndex appends to ->indexes:
+// callers must keep both from racing with users of the collection (the
+// server runs them under its exclusive engine latch).
+//
+// Storage: page 0 holds a small header locating the catalog heap, a
+// HeapFile (with its own overflow heap) holding one BSON entry per
+// collection. Each change rewrites only the entry concerned: CreateCollection
+// inserts it, DropCollection deletes it, and CreateIndex and a heap's new
+// extents update it. With a TransactionManager, each such change is a
+// transaction of its own, so recovery redoes and undoes it like any heap
+// change; DDL also forces the log before returning.
+//
+// LoadCatalog reads only the entries' names. A collection's heaps and
+// indexes are opened on its first GetCollection, which marks the entry in
+// use; a final SaveCatalog marks every opened entry clean again. An entry
+// found not clean was in use when the database stopped without a final
+// save: its document counters are recounted and its indexes (whose pages
+// are not logged) rebuilt from the heap.
 // ============================================================================
 
+// Optimizer statistics for an index, gathered by Catalog::Analyze (and
+// when the index is built). bounds is an equi-depth histogram over a
+// sample of the keys: bounds[i] closes bucket i, each holding about
+// 1 / bounds.size() of the entries, and the last is the largest key.
+struct IndexStats {
+    bool analyzed = false;
+    uint64_t num_entries = 0;
+    uint64_t distinct_keys = 0;
+    std::string min_key;
+    std::vector<std::string> bounds;
+};
+
+// Optimizer statistics for a collection's heap; the planner scales them by
+// how far the heap has grown since (rows per page stays about the same)
+struct CollectionStats {
+    bool analyzed = false;
+    uint64_t row_count = 0;
+    uint32_t page_count = 0;  // Heap pages at the time
+};
+
 struct IndexInfo {
     std::string field_name;
     page_id_t btree_root_page;
     std::unique_ptr<BPlusTree> btree;
+    IndexStats stats;
 };
 
 struct CollectionInfo {
     std::string name;
+    RecordID catalog_rid;  // Its entry in the catalog heap
     page_id_t first_heap_page;
     page_id_t fsm_page;
+    bool compressed = false;  // Heap pages kept compressed on disk
     std::unique_ptr<HeapFile> heap_file;
     std::unique_ptr<FreeSpaceMap> fsm;
+    page_id_t overflow_fsm_page;
+    std::unique_ptr<HeapFile> overflow_heap;
+    std::unique_ptr<FreeSpaceMap> overflow_fsm;
     std::vector<IndexInfo> indexes;
+    CollectionStats stats;
+    std::unique_ptr<VersionStore> versions;  // Filled by transactional writes to heap_file
+
+    // Live documents and the bytes they take (overflow chunks included),
+    // kept current by the heaps
+    uint64_t DocumentCount() const { return heap_file->GetRecordCount(); }
+    uint64_t BytesUsed() const { return heap_file->GetRecordBytes() + overflow_heap->GetRecordBytes(); }
 };
 
 class Catalog {
 public:
-    explicit Catalog(BufferPoolManager* bpm);
+    // wal: optional log attached to every collection's heap file. txns:
+    // logs catalog changes as transactions (needs wal to have any effect).
+    explicit Catalog(BufferPoolManager* bpm, WAL* wal = nullptr, TransactionManager* txns = nullptr);
 
-    // Create a new collection. Allocates heap + FSM pages.
-    bool CreateCollection(const std::string& name);
+    // Create a new collection. Allocates heap + FSM pages. compressed keeps
+    // the pages of both heaps compressed on disk, for good.
+    bool CreateCollection(const std::string& name, bool compressed = false);
 
     // Drop a collection.
     bool DropCollection(const std::string& name);
 
-    // Get collection info (returns nullptr if not found)
+    // Get collection info (returns nullptr if not found). Opens the
+    // collection if this is its first use since LoadCatalog.
     CollectionInfo* GetCollection(const std::string& name);
 
     // Create an index on a field for a collection
     bool CreateIndex(const std::string& collection_name, const std::string& field_name);
 
+    // Recompute the optimizer statistics of a collection and its indexes:
+    // one pass over the heap and one over each index. Statistics live in
+    // memory only; a reopened database plans with defaults until then.
+    // Same caveat as CreateIndex: nothing may use the collection meanwhile.
+    bool Analyze(const std::string& collection_name);
+
     // Get all collection names
     std::vector<std::string> ListCollections() const;
 
-    // Persist catalog metadata to page 0 of the database file
-    void SaveCatalog();
+    // VersionStore::Prune on every opened collection. Returns versions dropped.
+    size_t PruneVersions(uint64_t oldest_read_ts);
 
-    // Load catalog metadata from page 0 (called on startup)
+    // Rewrite the entry of every opened collection: pages in use, document
+    // counts, index roots. final: the database is being closed and nothing
+    // changes any more, so the entries are marked clean.
+    void SaveCatalog(bool final = false);
+
+    // Find the catalog heap through page 0 and read the collection names
+    // (called on startup). Nothing else is read until a collection is used.
     void LoadCatalog();
 
+    // Update a collection's entry whenever one of its heaps reserves a new
+    // extent, so the persisted extent lists stay complete. Enable once page
+    // 0 belongs to the catalog.
+    void SetSaveOnExtent(bool enabled) { save_on_extent_ = enabled; }
+
 private:
+    static constexpr uint32_t HEADER_MAGIC = 0x4c544344;  // "DCTL": page 0 holds a catalog header
+
+    // A collection known to the catalog; info is null until first use
+    struct Entry {
+        RecordID rid;
+        std::unique_ptr<CollectionInfo> info;
+    };
+
+    // Rewrite the collection's entry when one of its heaps gets a new extent
+    void WatchExtents(CollectionInfo* info);
+
+    // Create the catalog heaps on first use and write the header
+    void EnsureCatalogHeap();
+
+    // Write page 0 (the catalog heaps' FSM pages and extent lists) to disk
+    void WriteHeader();
+
+    // Run change as one logged transaction (if there is a TransactionManager),
+    // serialized with every other catalog heap change. Returns its commit LSN.
+    lsn_t RunLogged(const std::function<void(Transaction*)>& change);
+
+    // Make a catalog change durable before reporting it done
+    void Force(lsn_t lsn);
+
+    // Rewrite a collection's entry from its CollectionInfo
+    lsn_t WriteEntry(const CollectionInfo& info, bool clean);
+
+    // Open the collection an entry describes (latch_ held exclusively)
+    void OpenEntry(const std::string& name, Entry* entry);
+
+    // Allocate a B+ Tree for idx_info->field_name and load it with the
+    // collection's documents, filling in the statistics. Returns the
+    // number of documents read.
+    uint64_t BuildIndex(CollectionInfo* coll, IndexInfo* idx_info);
+
+    // A zeroed page for a new FSM root
+    page_id_t NewFSMPage();
+
+    // Attach the WAL and compression to a collection's heaps, point the
+    // main heap at its overflow heap and give it a VersionStore
+    void WireHeaps(CollectionInfo* info);
+
     BufferPoolManager* bpm_;
-    std::unordered_map<std::string, std::unique_ptr<CollectionInfo>> collections_;
+    WAL* wal_;
+    TransactionManager* txns_;
+    std::atomic<bool> save_on_extent_{false};
+    mutable std::shared_mutex latch_;  // Guards collections_ and the catalog heaps' creation
+    std::unordered_map<std::string, Entry> collections_;
+
+    std::mutex entry_mutex_;  // Serializes changes to the catalog heaps
+    std::unique_ptr<FreeSpaceMap> catalog_fsm_;
+    std::unique_ptr<HeapFile> catalog_heap_;  // One entry per collection
+    std::unique_ptr<FreeSpaceMap> catalog_overflow_fsm_;
+    std::unique_ptr<HeapFile> catalog_overflow_;  // Values of entries too large for a page
 };
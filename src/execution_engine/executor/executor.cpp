@@ -1,84 +1,48 @@
 #include "execution_engine/executor/executor.h"
+#include "execution_engine/executor/filter_expr.h"
 #include <iostream>
 
 // ============================================================================
-// Predicate::Evaluate
+// Executor / BatchExecutor — the adapters between the two paths
 // ============================================================================
 
-bool Predicate::Evaluate(const BsonDocument& doc) const {
-    auto it = doc.elements.find(field_name);
-    if (it == doc.elements.end()) {
-        return false;  // Field not found
-    }
-
-    const BsonValue& doc_val = it->second;
-
-    // Compare strings
-    if (std::holds_alternative<std::string>(value) && std::holds_alternative<std::string>(doc_val)) {
-        const std::string& a = std::get<std::string>(doc_val);
-        const std::string& b = std::get<std::string>(value);
-        switch (op) {
-            case CompareOp::EQ: return a == b;
-            case CompareOp::NE: return a != b;
-            case CompareOp::LT: return a < b;
-            case CompareOp::LE: return a <= b;
-            case CompareOp::GT: return a > b;
-            case CompareOp::GE: return a >= b;
+bool Executor::NextBatch(TupleBatch* batch) {
+    batch->Clear();
+    while (!batch->Full()) {
+        Tuple* tuple = batch->Append();
+        if (!Next(tuple)) {
+            batch->DropLast();
+            break;
         }
     }
+    return batch->Size() > 0;
+}
 
-    // Compare int32
-    if (std::holds_alternative<int32_t>(value) && std::holds_alternative<int32_t>(doc_val)) {
-        int32_t a = std::get<int32_t>(doc_val);
-        int32_t b = std::get<int32_t>(value);
-        switch (op) {
-            case CompareOp::EQ: return a == b;
-            case CompareOp::NE: return a != b;
-            case CompareOp::LT: return a < b;
-            case CompareOp::LE: return a <= b;
-            case CompareOp::GT: return a > b;
-            case CompareOp::GE: return a >= b;
+bool BatchExecutor::Next(Tuple* tuple) {
+    if (buffer_pos_ == buffer_.Size()) {
+        buffer_pos_ = 0;
+        if (!NextBatch(&buffer_)) {
+            buffer_.Clear();
+            return false;
         }
     }
+    *tuple = std::move(buffer_[buffer_pos_++]);
+    return true;
+}
 
-    // Compare int64
-    if (std::holds_alternative<int64_t>(value) && std::holds_alternative<int64_t>(doc_val)) {
-        int64_t a = std::get<int64_t>(doc_val);
-        int64_t b = std::get<int64_t>(value);
-        switch (op) {
-            case CompareOp::EQ: return a == b;
-            case CompareOp::NE: return a != b;
-            case CompareOp::LT: return a < b;
-            case CompareOp::LE: return a <= b;
-            case CompareOp::GT: return a > b;
-            case CompareOp::GE: return a >= b;
-        }
-    }
+void BatchExecutor::ResetBuffer() {
+    buffer_.Clear();
+    buffer_pos_ = 0;
+}
 
-    // Compare double
-    if (std::holds_alternative<double>(value) && std::holds_alternative<double>(doc_val)) {
-        double a = std::get<double>(doc_val);
-        double b = std::get<double>(value);
-        switch (op) {
-            case CompareOp::EQ: return a == b;
-            case CompareOp::NE: return a != b;
-            case CompareOp::LT: return a < b;
-            case CompareOp::LE: return a <= b;
-            case CompareOp::GT: return a > b;
-            case CompareOp::GE: return a >= b;
-        }
-    }
+// ============================================================================
+// Predicate::Evaluate — a one-off FilterExpr (same semantics)
+// ============================================================================
 
-    // Compare bool (only EQ/NE make sense)
-    if (std::holds_alternative<bool>(value) && std::holds_alternative<bool>(doc_val)) {
-        bool a = std::get<bool>(doc_val);
-        bool b = std::get<bool>(value);
-        switch (op) {
-            case CompareOp::EQ: return a == b;
-            case CompareOp::NE: return a != b;
-            default: return false;
-        }
-    }
+bool Predicate::Evaluate(const BsonDocument& doc) const {
+    return FilterExpr::Compare(field_name, op, value).Evaluate(doc);
+}
 
-    return false;  // Type mismatch
+bool Predicate::Evaluate(const BsonView& doc) const {
+    return FilterExpr::Compare(field_name, op, value).Evaluate(doc);
 }
@@ -1,24 +1,78 @@
 #pragma once
 
 #include "storage_engine/common/bson_types.h"
+#include "storage_engine/serializer/bson_view.h"
 #include "storage_engine/page/slotted_page.h"
+#include <cstdint>
 #include <functional>
 #include <string>
+#include <vector>
 
 // ============================================================================
 // Tuple — a single result row from the executor pipeline
 // ============================================================================
+// What a plan hands out for each row (Executor::SetRowFormat)
+enum class RowFormat : uint8_t {
+    DOCUMENT,  // Tuple::doc, decoded
+    BYTES      // Tuple::bytes, the document as BSON, copied from the page; doc unset
+};
+
 struct Tuple {
     RecordID rid;
     BsonDocument doc;
+    std::vector<uint8_t> bytes;
+};
+
+// ============================================================================
+// TupleBatch — up to CAPACITY rows handed from one executor to the next
+//
+// Rows are appended by the producer; operators that drop rows only narrow
+// the selection vector (indices of the rows still in the batch, in
+// order), so nothing is moved or copied. Row slots are kept across
+// Clear(), so a stream of batches allocates them only once.
+// ============================================================================
+struct TupleBatch {
+    static constexpr size_t CAPACITY = 1024;
+
+    std::vector<Tuple> rows;          // rows[0, num_rows) are this batch's
+    size_t num_rows = 0;
+    std::vector<uint32_t> selection;  // Selected rows
+
+    void Clear() {
+        num_rows = 0;
+        selection.clear();
+    }
+    bool Full() const { return num_rows >= CAPACITY; }
+
+    // A fresh, selected row at the end
+    Tuple* Append() {
+        if (num_rows == rows.size()) rows.emplace_back();
+        selection.push_back(static_cast<uint32_t>(num_rows));
+        return &rows[num_rows++];
+    }
+
+    // Take back the last Append
+    void DropLast() {
+        num_rows--;
+        selection.pop_back();
+    }
+
+    // Selected rows, in order
+    size_t Size() const { return selection.size(); }
+    Tuple& operator[](size_t i) { return rows[selection[i]]; }
 };
 
 // ============================================================================
 // Executor — abstract Volcano Iterator interface
 //
-//   Init()  → prepare for iteration
-//   Next()  → return the next tuple, false when done
-//   Close() → clean up
+//   Init()      → prepare for iteration
+//   Next()      → return the next tuple, false when done
+//   NextBatch() → return the next batch of tuples, false when done
+//   Close()     → clean up
+//
+// Either path may be used on an executor, not both. The default NextBatch
+// fills a batch from Next; executors that produce batches natively derive
+// from BatchExecutor instead, which provides Next on top of NextBatch.
 // ============================================================================
 class Executor {
 public:
@@ -26,10 +80,36 @@ public:
     virtual void Init() = 0;
     virtual bool Next(Tuple* tuple) = 0;
     virtual void Close() = 0;
+
+    // Replace *batch with the next rows (at least one). False when done.
+    virtual bool NextBatch(TupleBatch* batch);
+
+    // Set before Init; executors over a child pass it down
+    virtual void SetRowFormat(RowFormat format) { row_format_ = format; }
+
+protected:
+    RowFormat row_format_ = RowFormat::DOCUMENT;
+};
+
+class BatchExecutor : public Executor {
+public:
+    // Tuple at a time, out of an internal batch
+    bool Next(Tuple* tuple) final;
+
+protected:
+    // Drop buffered rows; Init implementations call it
+    void ResetBuffer();
+
+private:
+    TupleBatch buffer_;
+    size_t buffer_pos_ = 0;
 };
 
 // ============================================================================
 // Predicate — a simple field comparison for filtering
+//
+// Scans and filters compile their predicates into a FilterExpr once;
+// Evaluate here is for one-off checks and compiles on every call.
 // ============================================================================
 enum class CompareOp {
     EQ,   // ==
@@ -47,4 +127,7 @@ struct Predicate {
 
     // Evaluate the predicate against a document
     bool Evaluate(const BsonDocument& doc) const;
+
+    // Same, on serialized bytes in place (no decoding, no allocation)
+    bool Evaluate(const BsonView& doc) const;
 };
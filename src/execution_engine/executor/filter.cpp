@@ -5,23 +5,38 @@
 // ============================================================================
 
 FilterExecutor::FilterExecutor(std::unique_ptr<Executor> child, std::vector<Predicate> predicates)
-    : child_(std::move(child)), predicates_(std::move(predicates)) {}
+    : FilterExecutor(std::move(child), FilterExpr(predicates)) {}
+
+FilterExecutor::FilterExecutor(std::unique_ptr<Executor> child, FilterExpr filter)
+    : child_(std::move(child)), filter_(std::move(filter)) {}
 
 void FilterExecutor::Init() {
     child_->Init();
+    terms_ = filter_.Conjuncts();
+    ResetBuffer();
+}
+
+void FilterExecutor::SetRowFormat(RowFormat format) {
+    Executor::SetRowFormat(format);
+    child_->SetRowFormat(format);
 }
 
-bool FilterExecutor::Next(Tuple* tuple) {
-    while (child_->Next(tuple)) {
-        // Check all predicates (AND logic)
-        bool pass = true;
-        for (const auto& pred : predicates_) {
-            if (!pred.Evaluate(tuple->doc)) {
-                pass = false;
-                break;
+bool FilterExecutor::NextBatch(TupleBatch* batch) {
+    const bool bytes = row_format_ == RowFormat::BYTES;
+    while (child_->NextBatch(batch)) {
+        // All conjuncts must hold: each keeps its matches
+        for (const FilterExpr* term : terms_) {
+            size_t kept = 0;
+            for (uint32_t row : batch->selection) {
+                const Tuple& tuple = batch->rows[row];
+                bool match = bytes ? term->Evaluate(BsonView(tuple.bytes.data(), tuple.bytes.size()))
+                                   : term->Evaluate(tuple.doc);
+                if (match) batch->selection[kept++] = row;
             }
+            batch->selection.resize(kept);
+            if (kept == 0) break;
         }
-        if (pass) return true;
+        if (batch->Size() > 0) return true;
     }
     return false;
 }
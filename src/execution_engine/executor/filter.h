@@ -1,21 +1,29 @@
 #pragma once
 
 #include "executor.h"
+#include "filter_expr.h"
 #include <memory>
 #include <vector>
 
 // ============================================================================
 // Filter — wraps a child executor and applies predicates
+//
+// Works a batch at a time: each conjunct of the filter in turn runs over
+// the rows still selected and narrows the selection vector, so rows are
+// never copied.
 // ============================================================================
-class FilterExecutor : public Executor {
+class FilterExecutor : public BatchExecutor {
 public:
     FilterExecutor(std::unique_ptr<Executor> child, std::vector<Predicate> predicates);
+    FilterExecutor(std::unique_ptr<Executor> child, FilterExpr filter);
 
     void Init() override;
-    bool Next(Tuple* tuple) override;
+    bool NextBatch(TupleBatch* batch) override;
     void Close() override;
+    void SetRowFormat(RowFormat format) override;
 
 private:
     std::unique_ptr<Executor> child_;
-    std::vector<Predicate> predicates_;
+    FilterExpr filter_;
+    std::vector<const FilterExpr*> terms_;  // Its conjuncts, set by Init
 };
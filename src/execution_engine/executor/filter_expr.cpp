@@ -0,0 +1,288 @@
+#include "filter_expr.h"
+#include <algorithm>
+
+// ============================================================================
+// Tests — one instantiation per operator and constant type class
+// ============================================================================
+
+template <CompareOp Op, typename T>
+static bool Apply(const T& a, const T& b) {
+    if constexpr (Op == CompareOp::EQ) return a == b;
+    if constexpr (Op == CompareOp::NE) return a != b;
+    if constexpr (Op == CompareOp::LT) return a < b;
+    if constexpr (Op == CompareOp::LE) return a <= b;
+    if constexpr (Op == CompareOp::GT) return a > b;
+    if constexpr (Op == CompareOp::GE) return a >= b;
+}
+
+template <CompareOp Op, FilterExpr::Class C>
+bool FilterExpr::RunTest(const Operand& constant, const Scalar& value) {
+    if constexpr (C == Class::INTEGER) {
+        if (value.type_class == Class::INTEGER) return Apply<Op>(value.integer, constant.integer);
+        if (value.type_class == Class::DOUBLE) return Apply<Op>(value.number, static_cast<double>(constant.integer));
+        return false;
+    } else if constexpr (C == Class::DOUBLE) {
+        if (value.type_class == Class::DOUBLE) return Apply<Op>(value.number, constant.number);
+        if (value.type_class == Class::INTEGER) return Apply<Op>(static_cast<double>(value.integer), constant.number);
+        return false;
+    } else if constexpr (C == Class::STRING) {
+        return value.type_class == Class::STRING && Apply<Op>(value.string, std::string_view(constant.string));
+    } else if constexpr (C == Class::BOOL && (Op == CompareOp::EQ || Op == CompareOp::NE)) {
+        return value.type_class == Class::BOOL && Apply<Op>(value.boolean, constant.boolean);
+    } else {
+        return false;  // Bools only have equality; documents and nulls never match
+    }
+}
+
+template <CompareOp Op>
+FilterExpr::TestFn FilterExpr::SelectTest(Class type_class) {
+    switch (type_class) {
+        case Class::INTEGER: return &RunTest<Op, Class::INTEGER>;
+        case Class::DOUBLE: return &RunTest<Op, Class::DOUBLE>;
+        case Class::STRING: return &RunTest<Op, Class::STRING>;
+        case Class::BOOL: return &RunTest<Op, Class::BOOL>;
+        case Class::NONE: break;
+    }
+    return &RunTest<Op, Class::NONE>;
+}
+
+FilterExpr::Test FilterExpr::CompileTest(CompareOp op, const BsonValue& value) {
+    Test test;
+    Operand& constant = test.operand;
+    if (auto* v = std::get_if<int32_t>(&value)) {
+        constant.type_class = Class::INTEGER;
+        constant.integer = *v;
+    } else if (auto* v = std::get_if<int64_t>(&value)) {
+        constant.type_class = Class::INTEGER;
+        constant.integer = *v;
+    } else if (auto* v = std::get_if<double>(&value)) {
+        constant.type_class = Class::DOUBLE;
+        constant.number = *v;
+    } else if (auto* v = std::get_if<std::string>(&value)) {
+        constant.type_class = Class::STRING;
+        constant.string = *v;
+    } else if (auto* v = std::get_if<bool>(&value)) {
+        constant.type_class = Class::BOOL;
+        constant.boolean = *v;
+    }
+
+    switch (op) {
+        case CompareOp::EQ: test.fn = SelectTest<CompareOp::EQ>(constant.type_class); break;
+        case CompareOp::NE: test.fn = SelectTest<CompareOp::NE>(constant.type_class); break;
+        case CompareOp::LT: test.fn = SelectTest<CompareOp::LT>(constant.type_class); break;
+        case CompareOp::LE: test.fn = SelectTest<CompareOp::LE>(constant.type_class); break;
+        case CompareOp::GT: test.fn = SelectTest<CompareOp::GT>(constant.type_class); break;
+        case CompareOp::GE: test.fn = SelectTest<CompareOp::GE>(constant.type_class); break;
+    }
+    return test;
+}
+
+// ============================================================================
+// Document values
+// ============================================================================
+
+FilterExpr::Scalar FilterExpr::FromElement(const BsonElementView& element) {
+    Scalar value;
+    switch (element.type) {
+        case BsonType::INT32:
+            value.type_class = Class::INTEGER;
+            value.integer = element.AsInt32();
+            break;
+        case BsonType::INT64:
+            value.type_class = Class::INTEGER;
+            value.integer = element.AsInt64();
+            break;
+        case BsonType::DOUBLE:
+            value.type_class = Class::DOUBLE;
+            value.number = element.AsDouble();
+            break;
+        case BsonType::STRING:
+            value.type_class = Class::STRING;
+            value.string = element.AsString();
+            break;
+        case BsonType::BOOLEAN:
+            value.type_class = Class::BOOL;
+            value.boolean = element.AsBool();
+            break;
+        default:
+            break;
+    }
+    return value;
+}
+
+FilterExpr::Scalar FilterExpr::FromValue(const BsonValue& value) {
+    Scalar scalar;
+    if (auto* v = std::get_if<int32_t>(&value)) {
+        scalar.type_class = Class::INTEGER;
+        scalar.integer = *v;
+    } else if (auto* v = std::get_if<int64_t>(&value)) {
+        scalar.type_class = Class::INTEGER;
+        scalar.integer = *v;
+    } else if (auto* v = std::get_if<double>(&value)) {
+        scalar.type_class = Class::DOUBLE;
+        scalar.number = *v;
+    } else if (auto* v = std::get_if<std::string>(&value)) {
+        scalar.type_class = Class::STRING;
+        scalar.string = *v;
+    } else if (auto* v = std::get_if<bool>(&value)) {
+        scalar.type_class = Class::BOOL;
+        scalar.boolean = *v;
+    }
+    return scalar;
+}
+
+// ============================================================================
+// Construction
+// ============================================================================
+
+FilterExpr::FilterExpr(const std::vector<Predicate>& predicates) {
+    std::vector<FilterExpr> terms;
+    for (const Predicate& pred : predicates) terms.push_back(Compare(pred.field_name, pred.op, pred.value));
+    *this = And(std::move(terms));
+}
+
+FilterExpr FilterExpr::Compare(std::string field, CompareOp op, const BsonValue& value) {
+    FilterExpr expr;
+    expr.kind_ = Kind::COMPARE;
+    expr.field_ = std::move(field);
+    expr.op_ = op;
+    expr.values_ = {value};
+    expr.tests_ = {CompileTest(op, value)};
+    return expr;
+}
+
+FilterExpr FilterExpr::In(std::string field, std::vector<BsonValue> values) {
+    FilterExpr expr;
+    expr.kind_ = Kind::IN;
+    expr.field_ = std::move(field);
+    for (const BsonValue& value : values) expr.tests_.push_back(CompileTest(CompareOp::EQ, value));
+    expr.values_ = std::move(values);
+    return expr;
+}
+
+FilterExpr FilterExpr::And(std::vector<FilterExpr> terms) {
+    terms.erase(std::remove_if(terms.begin(), terms.end(), [](const FilterExpr& t) { return t.MatchesAll(); }),
+                terms.end());
+    if (terms.empty()) return FilterExpr();
+    if (terms.size() == 1) return std::move(terms[0]);
+    FilterExpr expr;
+    expr.kind_ = Kind::AND;
+    expr.terms_ = std::move(terms);
+    return expr;
+}
+
+FilterExpr FilterExpr::Or(std::vector<FilterExpr> terms) {
+    for (const FilterExpr& term : terms) {
+        if (term.MatchesAll()) return FilterExpr();
+    }
+    if (terms.size() == 1) return std::move(terms[0]);
+    FilterExpr expr;
+    expr.kind_ = Kind::OR;  // With no terms, matches nothing
+    expr.terms_ = std::move(terms);
+    return expr;
+}
+
+std::vector<const FilterExpr*> FilterExpr::Conjuncts() const {
+    std::vector<const FilterExpr*> conjuncts;
+    if (kind_ == Kind::AND) {
+        for (const FilterExpr& term : terms_) conjuncts.push_back(&term);
+    } else if (kind_ != Kind::ALL) {
+        conjuncts.push_back(this);
+    }
+    return conjuncts;
+}
+
+std::vector<std::string> FilterExpr::Fields() const {
+    std::vector<std::string> fields;
+    std::vector<const FilterExpr*> pending{this};
+    while (!pending.empty()) {
+        const FilterExpr* expr = pending.back();
+        pending.pop_back();
+        if (expr->kind_ == Kind::COMPARE || expr->kind_ == Kind::IN) {
+            if (std::find(fields.begin(), fields.end(), expr->field_) == fields.end()) {
+                fields.push_back(expr->field_);
+            }
+        }
+        // Reversed, so terms come off the stack in order
+        for (auto it = expr->terms_.rbegin(); it != expr->terms_.rend(); ++it) pending.push_back(&*it);
+    }
+    return fields;
+}
+
+// ============================================================================
+// Evaluate
+// ============================================================================
+
+bool FilterExpr::RunTests(const Scalar& value) const {
+    for (const Test& test : tests_) {
+        if (test.fn(test.operand, value)) return true;
+    }
+    return false;
+}
+
+bool FilterExpr::Evaluate(const BsonView& doc) const {
+    switch (kind_) {
+        case Kind::ALL:
+            return true;
+        case Kind::AND:
+            for (const FilterExpr& term : terms_) {
+                if (!term.Evaluate(doc)) return false;
+            }
+            return true;
+        case Kind::OR:
+            for (const FilterExpr& term : terms_) {
+                if (term.Evaluate(doc)) return true;
+            }
+            return false;
+        case Kind::COMPARE:
+        case Kind::IN: {
+            BsonElementView element;
+            return doc.Find(field_, &element) && RunTests(FromElement(element));
+        }
+    }
+    return false;
+}
+
+bool FilterExpr::Evaluate(const BsonDocument& doc) const {
+    switch (kind_) {
+        case Kind::ALL:
+            return true;
+        case Kind::AND:
+            for (const FilterExpr& term : terms_) {
+                if (!term.Evaluate(doc)) return false;
+            }
+            return true;
+        case Kind::OR:
+            for (const FilterExpr& term : terms_) {
+                if (term.Evaluate(doc)) return true;
+            }
+            return false;
+        case Kind::COMPARE:
+        case Kind::IN: {
+            auto it = doc.elements.find(field_);
+            return it != doc.elements.end() && RunTests(FromValue(it->second));
+        }
+    }
+    return false;
+}
+
+bool FilterExpr::Matches(const BsonValue& value) const {
+    switch (kind_) {
+        case Kind::ALL:
+            return true;
+        case Kind::AND:
+            for (const FilterExpr& term : terms_) {
+                if (!term.Matches(value)) return false;
+            }
+            return true;
+        case Kind::OR:
+            for (const FilterExpr& term : terms_) {
+                if (term.Matches(value)) return true;
+            }
+            return false;
+        case Kind::COMPARE:
+        case Kind::IN:
+            return RunTests(FromValue(value));
+    }
+    return false;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "executor.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ============================================================================
+// FilterExpr — a query filter, compiled once and evaluated per document
+//
+// A tree of AND / OR nodes over field tests: a comparison with one
+// constant, or $in, equality with any of several. Each constant is decoded
+// when the filter is built and paired with a test function instantiated
+// for its type class and operator, so evaluating a document costs one
+// field lookup and one indirect call per test, with no variant dispatch on
+// the query side.
+//
+// Numbers compare by value across int32, int64 and double: integers
+// against integers exactly, anything involving a double as doubles.
+// Otherwise only values of the same type compare; a missing field or a
+// type mismatch fails every operator, NE included. Bools only support
+// EQ / NE; documents and nulls match nothing.
+// ============================================================================
+class FilterExpr {
+public:
+    enum class Kind : uint8_t {
+        ALL,      // No filter: matches every document
+        AND,
+        OR,
+        COMPARE,  // field <op> value
+        IN        // field == any of values
+    };
+
+    FilterExpr() = default;
+
+    // AND of the predicates (ALL if there are none)
+    explicit FilterExpr(const std::vector<Predicate>& predicates);
+
+    static FilterExpr Compare(std::string field, CompareOp op, const BsonValue& value);
+    static FilterExpr In(std::string field, std::vector<BsonValue> values);
+    static FilterExpr And(std::vector<FilterExpr> terms);
+    static FilterExpr Or(std::vector<FilterExpr> terms);
+
+    bool Evaluate(const BsonView& doc) const;
+    bool Evaluate(const BsonDocument& doc) const;
+
+    // Evaluate against a document whose only field is the one every test
+    // here is on (see Fields): for answering from that field's index
+    bool Matches(const BsonValue& value) const;
+
+    // The fields the tests run on, each once, in order of first use
+    std::vector<std::string> Fields() const;
+
+    Kind GetKind() const { return kind_; }
+    bool MatchesAll() const { return kind_ == Kind::ALL; }
+
+    // COMPARE / IN: the field, operator (EQ for IN) and constants as given
+    const std::string& GetField() const { return field_; }
+    CompareOp GetOp() const { return op_; }
+    const std::vector<BsonValue>& GetValues() const { return values_; }
+
+    // AND / OR: the terms
+    const std::vector<FilterExpr>& GetTerms() const { return terms_; }
+
+    // The terms that must all hold: an AND's, or this one alone (none for ALL)
+    std::vector<const FilterExpr*> Conjuncts() const;
+
+private:
+    enum class Class : uint8_t { INTEGER, DOUBLE, STRING, BOOL, NONE };
+
+    // A constant, decoded once
+    struct Operand {
+        Class type_class = Class::NONE;
+        int64_t integer = 0;
+        double number = 0;
+        std::string string;
+        bool boolean = false;
+    };
+
+    // A document's value, viewed in the same shape (string points into it)
+    struct Scalar {
+        Class type_class = Class::NONE;
+        int64_t integer = 0;
+        double number = 0;
+        std::string_view string;
+        bool boolean = false;
+    };
+
+    using TestFn = bool (*)(const Operand&, const Scalar&);
+
+    struct Test {
+        Operand operand;
+        TestFn fn;
+    };
+
+    template <CompareOp Op, Class C>
+    static bool RunTest(const Operand& constant, const Scalar& value);
+    template <CompareOp Op>
+    static TestFn SelectTest(Class type_class);
+
+    static Test CompileTest(CompareOp op, const BsonValue& value);
+    static Scalar FromElement(const BsonElementView& element);
+    static Scalar FromValue(const BsonValue& value);
+    bool RunTests(const Scalar& value) const;
+
+    Kind kind_ = Kind::ALL;
+    std::string field_;
+    CompareOp op_ = CompareOp::EQ;
+    std::vector<BsonValue> values_;
+    std::vector<Test> tests_;  // COMPARE: one; IN: one per value, any may pass
+    std::vector<FilterExpr> terms_;
+};
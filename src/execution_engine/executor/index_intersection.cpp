@@ -0,0 +1,65 @@
+#include "index_intersection.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+// ============================================================================
+// IndexIntersectionExecutor
+// ============================================================================
+
+IndexIntersectionExecutor::IndexIntersectionExecutor(HeapFile* heap_file, std::vector<Input> inputs)
+    : heap_file_(heap_file), inputs_(std::move(inputs)) {}
+
+void IndexIntersectionExecutor::Init() {
+    rids_.clear();
+    next_ = 0;
+    ResetBuffer();
+
+    for (size_t i = 0; i < inputs_.size(); i++) {
+        std::vector<RecordID> found;
+        RecordID rid;
+        for (const KeyRange& range : inputs_[i].second) {
+            BPlusTree::Iterator cursor(inputs_[i].first, range.first, range.second);
+            while (cursor.Next(nullptr, &rid)) found.push_back(rid);
+        }
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+
+        if (i == 0) {
+            rids_ = std::move(found);
+        } else {
+            std::vector<RecordID> both;
+            std::set_intersection(rids_.begin(), rids_.end(), found.begin(), found.end(),
+                                  std::back_inserter(both));
+            rids_ = std::move(both);
+        }
+        if (rids_.empty()) break;
+    }
+}
+
+bool IndexIntersectionExecutor::NextBatch(TupleBatch* batch) {
+    batch->Clear();
+
+    while (!batch->Full() && next_ < rids_.size()) {
+        const RecordID& rid = rids_[next_++];
+        Tuple* tuple = batch->Append();
+        try {
+            if (row_format_ == RowFormat::BYTES) {
+                heap_file_->GetRecordBytes(rid, &tuple->bytes);
+            } else {
+                tuple->doc = heap_file_->GetRecord(rid);
+            }
+        } catch (const std::runtime_error&) {
+            // Deleted after the index entries were read
+            batch->DropLast();
+            continue;
+        }
+        tuple->rid = rid;
+    }
+    return batch->Size() > 0;
+}
+
+void IndexIntersectionExecutor::Close() {
+    rids_.clear();
+    next_ = 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "executor.h"
+#include "index_scan.h"
+#include "data_organisation/bptree/bptree.h"
+#include "data_organisation/heap_file/heap_file.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// IndexIntersection — records every one of several index scans returns
+//
+// Init reads the RecordIDs of each input's key ranges (no heap access),
+// sorts them and intersects the sets; the records left are then fetched
+// in RecordID order, so each heap page is visited once. Keeps all the
+// RecordIDs of an input in memory: meant for selective inputs, which is
+// when the planner picks it.
+// ============================================================================
+class IndexIntersectionExecutor : public BatchExecutor {
+public:
+    using Input = std::pair<BPlusTree*, std::vector<KeyRange>>;
+
+    IndexIntersectionExecutor(HeapFile* heap_file, std::vector<Input> inputs);
+
+    void Init() override;
+    bool NextBatch(TupleBatch* batch) override;
+    void Close() override;
+
+private:
+    HeapFile* heap_file_;
+    std::vector<Input> inputs_;
+    std::vector<RecordID> rids_;  // The intersection, sorted
+    size_t next_ = 0;             // Next of rids_ to fetch
+};
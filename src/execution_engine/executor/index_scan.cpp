@@ -7,26 +7,49 @@
 
 IndexScanExecutor::IndexScanExecutor(BPlusTree* index, HeapFile* heap_file,
                                      const std::string& lo_key, const std::string& hi_key)
-    : index_(index), heap_file_(heap_file), lo_key_(lo_key), hi_key_(hi_key), current_idx_(0) {}
+    : IndexScanExecutor(index, heap_file, std::vector<KeyRange>{{lo_key, hi_key}}) {}
+
+IndexScanExecutor::IndexScanExecutor(BPlusTree* index, HeapFile* heap_file, std::vector<KeyRange> ranges)
+    : index_(index), heap_file_(heap_file), ranges_(std::move(ranges)), next_range_(ranges_.size()) {}
 
 void IndexScanExecutor::Init() {
-    results_ = index_->RangeScan(lo_key_, hi_key_);
-    current_idx_ = 0;
+    cursor_.reset();
+    next_range_ = 0;
+    ResetBuffer();
 }
 
-bool IndexScanExecutor::Next(Tuple* tuple) {
-    if (current_idx_ >= results_.size()) {
-        return false;
-    }
+bool IndexScanExecutor::NextBatch(TupleBatch* batch) {
+    batch->Clear();
 
-    const auto& [key, rid] = results_[current_idx_];
-    tuple->rid = rid;
-    tuple->doc = heap_file_->GetRecord(rid);
-    current_idx_++;
-    return true;
+    RecordID rid;
+    while (!batch->Full()) {
+        if (!cursor_) {
+            if (next_range_ == ranges_.size()) break;
+            const KeyRange& range = ranges_[next_range_++];
+            cursor_ = std::make_unique<BPlusTree::Iterator>(index_, range.first, range.second);
+        }
+        if (!cursor_->Next(nullptr, &rid)) {
+            cursor_.reset();
+            continue;
+        }
+        Tuple* tuple = batch->Append();
+        try {
+            if (row_format_ == RowFormat::BYTES) {
+                heap_file_->GetRecordBytes(rid, &tuple->bytes);
+            } else {
+                tuple->doc = heap_file_->GetRecord(rid);
+            }
+        } catch (const std::runtime_error&) {
+            // Deleted after the index entry was read
+            batch->DropLast();
+            continue;
+        }
+        tuple->rid = rid;
+    }
+    return batch->Size() > 0;
 }
 
 void IndexScanExecutor::Close() {
-    results_.clear();
-    current_idx_ = 0;
+    cursor_.reset();
+    next_range_ = ranges_.size();
 }
@@ -3,26 +3,35 @@
 #include "executor.h"
 #include "data_organisation/bptree/bptree.h"
 #include "data_organisation/heap_file/heap_file.h"
-#include <vector>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+// Inclusive [lo, hi] range of index keys
+using KeyRange = std::pair<std::string, std::string>;
 
 // ============================================================================
-// IndexScan — uses B+ Tree range scan to produce matching records
+// IndexScan — streams matching records through a B+ Tree iterator
+//
+// One leaf is pinned at a time; index entries whose record has been
+// deleted since (a concurrent writer got there between the index and the
+// heap) are skipped. Given several ranges it scans them in order.
 // ============================================================================
-class IndexScanExecutor : public Executor {
+class IndexScanExecutor : public BatchExecutor {
 public:
     IndexScanExecutor(BPlusTree* index, HeapFile* heap_file,
                       const std::string& lo_key, const std::string& hi_key);
+    IndexScanExecutor(BPlusTree* index, HeapFile* heap_file, std::vector<KeyRange> ranges);
 
     void Init() override;
-    bool Next(Tuple* tuple) override;
+    bool NextBatch(TupleBatch* batch) override;
     void Close() override;
 
 private:
     BPlusTree* index_;
     HeapFile* heap_file_;
-    std::string lo_key_;
-    std::string hi_key_;
-    std::vector<std::pair<std::string, RecordID>> results_;
-    size_t current_idx_;
+    std::vector<KeyRange> ranges_;
+    size_t next_range_;  // ranges_.size() when not scanning
+    std::unique_ptr<BPlusTree::Iterator> cursor_;  // Over ranges_[next_range_ - 1]
 };
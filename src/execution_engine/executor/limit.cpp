@@ -0,0 +1,46 @@
+#include "limit.h"
+#include <algorithm>
+
+// ============================================================================
+// LimitExecutor
+// ============================================================================
+
+LimitExecutor::LimitExecutor(std::unique_ptr<Executor> child, uint64_t skip, uint64_t limit)
+    : child_(std::move(child)), skip_(skip), limit_(limit) {}
+
+void LimitExecutor::Init() {
+    child_->Init();
+    to_skip_ = skip_;
+    remaining_ = limit_;
+    ResetBuffer();
+}
+
+void LimitExecutor::SetRowFormat(RowFormat format) {
+    Executor::SetRowFormat(format);
+    child_->SetRowFormat(format);
+}
+
+bool LimitExecutor::NextBatch(TupleBatch* batch) {
+    if (limit_ > 0 && remaining_ == 0) {
+        batch->Clear();
+        return false;
+    }
+    while (child_->NextBatch(batch)) {
+        std::vector<uint32_t>& selection = batch->selection;
+        if (to_skip_ > 0) {
+            size_t skipped = static_cast<size_t>(std::min<uint64_t>(to_skip_, selection.size()));
+            selection.erase(selection.begin(), selection.begin() + skipped);
+            to_skip_ -= skipped;
+        }
+        if (limit_ > 0) {
+            if (selection.size() > remaining_) selection.resize(static_cast<size_t>(remaining_));
+            remaining_ -= selection.size();
+        }
+        if (!selection.empty()) return true;
+    }
+    return false;
+}
+
+void LimitExecutor::Close() {
+    child_->Close();
+}
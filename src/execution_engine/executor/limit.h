@@ -0,0 +1,30 @@
+#pragma once
+
+#include "executor.h"
+#include <cstdint>
+#include <memory>
+
+// ============================================================================
+// Limit — the child's rows after the first skip, at most limit of them
+// (0 = no limit)
+//
+// Skipped rows are dropped from the selection vector. Once limit rows
+// have gone out the child is not asked for more, so the scans beneath
+// stop early.
+// ============================================================================
+class LimitExecutor : public BatchExecutor {
+public:
+    LimitExecutor(std::unique_ptr<Executor> child, uint64_t skip, uint64_t limit);
+
+    void Init() override;
+    bool NextBatch(TupleBatch* batch) override;
+    void Close() override;
+    void SetRowFormat(RowFormat format) override;
+
+private:
+    std::unique_ptr<Executor> child_;
+    uint64_t skip_;
+    uint64_t limit_;
+    uint64_t to_skip_ = 0;
+    uint64_t remaining_ = 0;  // Rows still to pass on (with a limit)
+};
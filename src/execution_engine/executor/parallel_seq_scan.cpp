@@ -0,0 +1,143 @@
+#include "parallel_seq_scan.h"
+#include <algorithm>
+
+// ============================================================================
+// ParallelSeqScanExecutor
+// ============================================================================
+
+ParallelSeqScanExecutor::ParallelSeqScanExecutor(HeapFile* heap_file, std::vector<Predicate> predicates,
+                                                 size_t num_threads)
+    : ParallelSeqScanExecutor(heap_file, FilterExpr(predicates), num_threads) {}
+
+ParallelSeqScanExecutor::ParallelSeqScanExecutor(HeapFile* heap_file, FilterExpr filter, size_t num_threads)
+    : heap_file_(heap_file), filter_(std::move(filter)), num_threads_(num_threads) {
+    if (num_threads_ == 0) num_threads_ = std::max(1u, std::thread::hardware_concurrency());
+}
+
+ParallelSeqScanExecutor::~ParallelSeqScanExecutor() {
+    Close();
+}
+
+bool ParallelSeqScanExecutor::Worthwhile(uint32_t num_pages, size_t num_threads) {
+    if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+    return num_threads > 1 && num_pages >= 2 * MORSEL_PAGES;
+}
+
+void ParallelSeqScanExecutor::Init() {
+    Close();
+    ResetBuffer();
+
+    HeapFile::Iterator iterator = heap_file_->Begin();
+    num_morsels_ = (iterator.GetNumPages() + MORSEL_PAGES - 1) / MORSEL_PAGES;
+    next_morsel_.store(0, std::memory_order_relaxed);
+    size_t num_workers = std::max<size_t>(1, std::min<size_t>(num_threads_, num_morsels_));
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.clear();
+        stopped_ = false;
+        error_ = nullptr;
+        producing_ = num_workers;
+        queue_limit_ = QUEUE_BATCHES * num_workers;
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        workers_.emplace_back(&ParallelSeqScanExecutor::Worker, this, iterator);
+    }
+}
+
+// ============================================================================
+// Producers
+// ============================================================================
+
+void ParallelSeqScanExecutor::Worker(HeapFile::Iterator iterator) {
+    std::function<bool(const BsonView&)> filter;
+    if (!filter_.MatchesAll()) {
+        filter = [this](const BsonView& doc) { return filter_.Evaluate(doc); };
+    }
+    const bool bytes = row_format_ == RowFormat::BYTES;
+    auto append = [bytes](TupleBatch* batch) {
+        return [batch, bytes](const RecordID& rid, const BsonView& record) {
+            Tuple* tuple = batch->Append();
+            tuple->rid = rid;
+            if (bytes) {
+                record.CopyTo(&tuple->bytes);
+            } else {
+                tuple->doc = record.ToDocument();
+            }
+        };
+    };
+
+    TupleBatch batch;
+    try {
+        bool open = true;
+        uint32_t morsel;
+        while (open && (morsel = next_morsel_.fetch_add(1, std::memory_order_relaxed)) < num_morsels_) {
+            iterator.SetRange(morsel * MORSEL_PAGES, (morsel + 1) * MORSEL_PAGES);
+            // A batch fills across morsels; the morsel is done once it
+            // yields fewer rows than asked for
+            while (open) {
+                size_t wanted = TupleBatch::CAPACITY - batch.num_rows;
+                size_t got = iterator.NextBatch(wanted, filter, append(&batch));
+                if (batch.Full()) open = Push(&batch);
+                if (got < wanted) break;
+            }
+        }
+        if (open && batch.num_rows > 0) Push(&batch);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) error_ = std::current_exception();
+        stopped_ = true;
+        not_full_.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    producing_--;
+    not_empty_.notify_all();
+}
+
+bool ParallelSeqScanExecutor::Push(TupleBatch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return stopped_ || ready_.size() < queue_limit_; });
+    if (stopped_) return false;
+    ready_.push_back(std::move(*batch));
+    if (!spare_.empty()) {
+        *batch = std::move(spare_.back());
+        spare_.pop_back();
+    } else {
+        *batch = TupleBatch();
+    }
+    batch->Clear();
+    not_empty_.notify_one();
+    return true;
+}
+
+// ============================================================================
+// Consumer
+// ============================================================================
+
+bool ParallelSeqScanExecutor::NextBatch(TupleBatch* batch) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return !ready_.empty() || producing_ == 0 || error_; });
+    if (error_) std::rethrow_exception(error_);
+    if (ready_.empty()) {
+        batch->Clear();
+        return false;
+    }
+    spare_.push_back(std::move(*batch));
+    *batch = std::move(ready_.front());
+    ready_.pop_front();
+    not_full_.notify_one();
+    return true;
+}
+
+void ParallelSeqScanExecutor::Close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    not_full_.notify_all();
+    for (std::thread& worker : workers_) worker.join();
+    workers_.clear();
+    ready_.clear();
+    spare_.clear();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "executor.h"
+#include "filter_expr.h"
+#include "data_organisation/heap_file/heap_file.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// ParallelSeqScan — a sequential scan split across worker threads
+//
+// The heap's pages in use at Init are cut into morsels of MORSEL_PAGES
+// consecutive pages. Each worker claims the next unscanned morsel from a
+// shared cursor, so one that runs ahead simply takes more, and scans it
+// a page at a time as SeqScan does (the filter checked in place).
+// Full batches go through the exchange: a bounded queue NextBatch pops
+// from, handing its emptied batch back for a producer to refill.
+//
+// Rows come out in no particular order. A worker that throws stops the
+// scan; NextBatch rethrows its exception.
+// ============================================================================
+class ParallelSeqScanExecutor : public BatchExecutor {
+public:
+    static constexpr uint32_t MORSEL_PAGES = 32;
+
+    // num_threads = 0 means one per core
+    ParallelSeqScanExecutor(HeapFile* heap_file, std::vector<Predicate> predicates, size_t num_threads = 0);
+    ParallelSeqScanExecutor(HeapFile* heap_file, FilterExpr filter, size_t num_threads = 0);
+    ~ParallelSeqScanExecutor() override;
+
+    void Init() override;
+    bool NextBatch(TupleBatch* batch) override;
+    void Close() override;
+
+    // Whether a heap of num_pages pages gives num_threads workers enough
+    // morsels to be worth it
+    static bool Worthwhile(uint32_t num_pages, size_t num_threads);
+
+private:
+    static constexpr size_t QUEUE_BATCHES = 4;  // Per worker, in the exchange
+
+    void Worker(HeapFile::Iterator iterator);
+
+    // Hand a full batch to the exchange and get an empty one back. False
+    // if the scan was stopped.
+    bool Push(TupleBatch* batch);
+
+    HeapFile* heap_file_;
+    FilterExpr filter_;
+    size_t num_threads_;
+
+    std::vector<std::thread> workers_;
+    std::atomic<uint32_t> next_morsel_{0};
+    uint32_t num_morsels_ = 0;
+
+    std::mutex mutex_;  // The exchange: everything below
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<TupleBatch> ready_;   // Filled batches, in arrival order
+    std::vector<TupleBatch> spare_;  // Emptied batches for producers to reuse
+    size_t producing_ = 0;           // Workers not finished yet
+    size_t queue_limit_ = 0;         // Batches the exchange holds at most
+    bool stopped_ = false;
+    std::exception_ptr error_;
+};
@@ -0,0 +1,48 @@
+#include "projection.h"
+#include <algorithm>
+
+// ============================================================================
+// ProjectionExecutor
+// ============================================================================
+
+ProjectionExecutor::ProjectionExecutor(std::unique_ptr<Executor> child, std::vector<std::string> fields,
+                                       bool include)
+    : child_(std::move(child)), fields_(std::move(fields)), include_(include) {}
+
+void ProjectionExecutor::Init() {
+    child_->Init();
+    ResetBuffer();
+}
+
+void ProjectionExecutor::SetRowFormat(RowFormat format) {
+    Executor::SetRowFormat(format);
+    child_->SetRowFormat(format);
+}
+
+bool ProjectionExecutor::Keep(std::string_view key) const {
+    bool listed = std::find(fields_.begin(), fields_.end(), key) != fields_.end();
+    return listed == include_;
+}
+
+bool ProjectionExecutor::NextBatch(TupleBatch* batch) {
+    if (!child_->NextBatch(batch)) return false;
+    auto keep = [this](std::string_view key) { return Keep(key); };
+    for (uint32_t row : batch->selection) {
+        Tuple& tuple = batch->rows[row];
+        if (row_format_ == RowFormat::BYTES) {
+            BsonView(tuple.bytes.data(), tuple.bytes.size()).CopyFields(keep, &scratch_);
+            tuple.bytes.swap(scratch_);
+            continue;
+        }
+        BsonElements kept;
+        for (auto& [key, value] : tuple.doc.elements) {
+            if (Keep(key)) kept.Append(key, std::move(value));
+        }
+        tuple.doc.elements = std::move(kept);
+    }
+    return true;
+}
+
+void ProjectionExecutor::Close() {
+    child_->Close();
+}
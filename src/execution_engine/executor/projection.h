@@ -0,0 +1,32 @@
+#pragma once
+
+#include "executor.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ============================================================================
+// Projection — keeps only the given top-level fields of each row, or
+// (include = false) everything but them
+//
+// Rows of stored bytes are cut down by copying the elements kept as they
+// are (BsonView::CopyFields); nothing is decoded.
+// ============================================================================
+class ProjectionExecutor : public BatchExecutor {
+public:
+    ProjectionExecutor(std::unique_ptr<Executor> child, std::vector<std::string> fields, bool include);
+
+    void Init() override;
+    bool NextBatch(TupleBatch* batch) override;
+    void Close() override;
+    void SetRowFormat(RowFormat format) override;
+
+private:
+    bool Keep(std::string_view key) const;
+
+    std::unique_ptr<Executor> child_;
+    std::vector<std::string> fields_;
+    bool include_;
+    std::vector<uint8_t> scratch_;  // Swapped with each row's bytes in turn
+};
@@ -4,17 +4,35 @@
 // SeqScanExecutor
 // ============================================================================
 
-SeqScanExecutor::SeqScanExecutor(HeapFile* heap_file)
-    : heap_file_(heap_file) {}
+SeqScanExecutor::SeqScanExecutor(HeapFile* heap_file, std::vector<Predicate> predicates)
+    : SeqScanExecutor(heap_file, FilterExpr(predicates)) {}
+
+SeqScanExecutor::SeqScanExecutor(HeapFile* heap_file, FilterExpr filter)
+    : heap_file_(heap_file), filter_expr_(std::move(filter)) {}
 
 void SeqScanExecutor::Init() {
+    if (!filter_expr_.MatchesAll()) {
+        filter_ = [this](const BsonView& doc) { return filter_expr_.Evaluate(doc); };
+    }
     auto it = heap_file_->Begin();
     iterator_ = std::make_unique<HeapFile::Iterator>(it);
+    ResetBuffer();
 }
 
-bool SeqScanExecutor::Next(Tuple* tuple) {
+bool SeqScanExecutor::NextBatch(TupleBatch* batch) {
+    batch->Clear();
     if (!iterator_) return false;
-    return iterator_->Next(&tuple->rid, &tuple->doc);
+    const bool bytes = row_format_ == RowFormat::BYTES;
+    iterator_->NextBatch(TupleBatch::CAPACITY, filter_, [batch, bytes](const RecordID& rid, const BsonView& record) {
+        Tuple* tuple = batch->Append();
+        tuple->rid = rid;
+        if (bytes) {
+            record.CopyTo(&tuple->bytes);
+        } else {
+            tuple->doc = record.ToDocument();
+        }
+    });
+    return batch->Size() > 0;
 }
 
 void SeqScanExecutor::Close() {
@@ -1,21 +1,32 @@
 #pragma once
 
 #include "executor.h"
+#include "filter_expr.h"
 #include "data_organisation/heap_file/heap_file.h"
+#include <functional>
 #include <memory>
+#include <vector>
 
 // ============================================================================
 // SeqScan — sequential scan over all records in a heap file
+//
+// The filter given here is evaluated on each record's bytes in place
+// (BsonView) before it is deserialized, so records that fail them are
+// never decoded. Same AND semantics as FilterExecutor. A batch is filled
+// a page at a time, under one pin and latch per page.
 // ============================================================================
-class SeqScanExecutor : public Executor {
+class SeqScanExecutor : public BatchExecutor {
 public:
-    SeqScanExecutor(HeapFile* heap_file);
+    explicit SeqScanExecutor(HeapFile* heap_file, std::vector<Predicate> predicates = {});
+    SeqScanExecutor(HeapFile* heap_file, FilterExpr filter);
 
     void Init() override;
-    bool Next(Tuple* tuple) override;
+    bool NextBatch(TupleBatch* batch) override;
     void Close() override;
 
 private:
     HeapFile* heap_file_;
+    FilterExpr filter_expr_;
+    std::function<bool(const BsonView&)> filter_;  // Empty without a filter
     std::unique_ptr<HeapFile::Iterator> iterator_;
 };
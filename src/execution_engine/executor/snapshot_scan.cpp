@@ -0,0 +1,72 @@
+#include "snapshot_scan.h"
+#include "storage_engine/serializer/serializer.h"
+#include <algorithm>
+
+// ============================================================================
+// SnapshotScanExecutor
+// ============================================================================
+
+SnapshotScanExecutor::SnapshotScanExecutor(std::unique_ptr<Executor> child, const VersionStore* versions,
+                                           const Snapshot& snapshot, FilterExpr filter)
+    : child_(std::move(child)), versions_(versions), snapshot_(snapshot), filter_(std::move(filter)) {}
+
+void SnapshotScanExecutor::Init() {
+    child_->Init();
+    child_done_ = false;
+    passed_.clear();
+    changed_.clear();
+    changed_pos_ = 0;
+    ResetBuffer();
+}
+
+void SnapshotScanExecutor::SetRowFormat(RowFormat format) {
+    Executor::SetRowFormat(format);
+    child_->SetRowFormat(format);
+}
+
+bool SnapshotScanExecutor::NextBatch(TupleBatch* batch) {
+    // Child rows whose newest version is the snapshot's
+    BsonDocument unused;
+    while (!child_done_) {
+        if (!child_->NextBatch(batch)) {
+            child_done_ = true;
+            std::sort(passed_.begin(), passed_.end());
+            for (const RecordID& rid : versions_->Changed()) {
+                if (!std::binary_search(passed_.begin(), passed_.end(), rid)) changed_.push_back(rid);
+            }
+            break;
+        }
+        size_t kept = 0;
+        for (uint32_t row : batch->selection) {
+            const RecordID& rid = batch->rows[row].rid;
+            if (versions_->Resolve(rid, snapshot_, &unused) == VersionStore::Visible::CURRENT) {
+                batch->selection[kept++] = row;
+                passed_.push_back(rid);
+            }
+        }
+        batch->selection.resize(kept);
+        if (kept > 0) return true;
+    }
+
+    // The versions the child could not see
+    batch->Clear();
+    while (changed_pos_ < changed_.size() && !batch->Full()) {
+        const RecordID& rid = changed_[changed_pos_++];
+        Tuple* tuple = batch->Append();
+        if (versions_->Resolve(rid, snapshot_, &tuple->doc) == VersionStore::Visible::VERSION &&
+            filter_.Evaluate(tuple->doc)) {
+            tuple->rid = rid;
+            if (row_format_ == RowFormat::BYTES) BsonSerializer::SerializeTo(tuple->doc, &tuple->bytes);
+        } else {
+            batch->DropLast();
+        }
+    }
+    return batch->Size() > 0;
+}
+
+void SnapshotScanExecutor::Close() {
+    child_->Close();
+    passed_.clear();
+    passed_.shrink_to_fit();
+    changed_.clear();
+}
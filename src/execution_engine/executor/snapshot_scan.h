@@ -0,0 +1,46 @@
+#pragma once
+
+#include "executor.h"
+#include "filter_expr.h"
+#include "concurrency/version_store.h"
+#include <memory>
+#include <vector>
+
+// ============================================================================
+// SnapshotScan — a collection as of a snapshot, whatever the access path
+//
+// The child is any plan running filter over the collection's heap, unlocked,
+// so it sees each record's newest version. Its rows are checked against
+// the VersionStore: a row whose newest version the snapshot reads passes
+// through; any other is dropped. Once the child is done, every record with
+// a chain that was not passed through is resolved from the chain and, if
+// the snapshot reads a version of it that matches filter, returned.
+//
+// That covers the rows the child could not get right: changed, deleted or
+// inserted by a writer the snapshot does not see (chains of such writers
+// are kept while the snapshot is registered), including ones whose newest
+// version fails filter or lies outside an index scan's ranges. Rows the
+// child returns come first, the rest after.
+// ============================================================================
+class SnapshotScanExecutor : public BatchExecutor {
+public:
+    // snapshot must stay registered (TransactionManager::TakeSnapshot) until Close
+    SnapshotScanExecutor(std::unique_ptr<Executor> child, const VersionStore* versions, const Snapshot& snapshot,
+                         FilterExpr filter);
+
+    void Init() override;
+    bool NextBatch(TupleBatch* batch) override;
+    void Close() override;
+    void SetRowFormat(RowFormat format) override;
+
+private:
+    std::unique_ptr<Executor> child_;
+    const VersionStore* versions_;
+    Snapshot snapshot_;
+    FilterExpr filter_;
+
+    bool child_done_ = false;
+    std::vector<RecordID> passed_;   // Child rows passed through (sorted once the child is done)
+    std::vector<RecordID> changed_;  // Records to resolve from their chains
+    size_t changed_pos_ = 0;
+};
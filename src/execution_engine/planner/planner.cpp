@@ -0,0 +1,423 @@
+#include "planner.h"
+#include "execution_engine/executor/seq_scan.h"
+#include "execution_engine/executor/filter.h"
+#include "execution_engine/executor/index_intersection.h"
+#include "execution_engine/executor/parallel_seq_scan.h"
+#include "data_organisation/bptree/index_key.h"
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <sstream>
+#include <thread>
+
+// Bytes an index entry takes in a leaf, on average (key, RecordID, slot)
+static constexpr double INDEX_ENTRY_BYTES = 24;
+
+// ============================================================================
+// Key ranges — what a filter allows under an index
+// ============================================================================
+
+// Sort ranges and merge the ones that overlap
+static std::vector<KeyRange> Normalize(std::vector<KeyRange> ranges) {
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<KeyRange> merged;
+    for (KeyRange& range : ranges) {
+        if (!merged.empty() && range.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(std::move(range));
+        }
+    }
+    return merged;
+}
+
+static std::vector<KeyRange> Intersect(const std::vector<KeyRange>& a, const std::vector<KeyRange>& b) {
+    std::vector<KeyRange> both;
+    for (const KeyRange& x : a) {
+        for (const KeyRange& y : b) {
+            KeyRange range{std::max(x.first, y.first), std::min(x.second, y.second)};
+            if (range.first <= range.second) both.push_back(std::move(range));
+        }
+    }
+    return Normalize(std::move(both));
+}
+
+// The keys a value of the type in bound's tag can have, narrowed by
+// "key op bound" (a superset: strict operators keep the bound itself)
+static void AddRange(CompareOp op, const BsonValue& bound, std::vector<KeyRange>* ranges) {
+    std::string key, lo, hi;
+    if (!IndexKey::Encode(bound, &key) || !IndexKey::TypeRange(bound, &lo, &hi)) return;
+    if (op == CompareOp::EQ || op == CompareOp::GT || op == CompareOp::GE) lo = key;
+    if (op == CompareOp::EQ || op == CompareOp::LT || op == CompareOp::LE) hi = key;
+    ranges->emplace_back(std::move(lo), std::move(hi));
+}
+
+// Keys a document matching "field op value" can have under the field's
+// index. Numbers compare across types, but integers and doubles have
+// separate key tags, so a numeric bound yields a range in each. Values
+// FilterExpr never matches (nulls, documents, NaN, bool ranges) yield none.
+static void ValueRanges(CompareOp op, const BsonValue& value, std::vector<KeyRange>* ranges) {
+    bool lower = op == CompareOp::EQ || op == CompareOp::GT || op == CompareOp::GE;
+    bool upper = op == CompareOp::EQ || op == CompareOp::LT || op == CompareOp::LE;
+
+    if (std::holds_alternative<int32_t>(value) || std::holds_alternative<int64_t>(value)) {
+        int64_t integer = std::holds_alternative<int32_t>(value) ? std::get<int32_t>(value) : std::get<int64_t>(value);
+        AddRange(op, integer, ranges);
+        AddRange(op, static_cast<double>(integer), ranges);  // Exactly what doubles are compared with
+    } else if (const double* number = std::get_if<double>(&value)) {
+        if (std::isnan(*number)) return;
+        AddRange(op, *number, ranges);
+        // Integers, rounded outward; past 2^53 they convert inexactly, so
+        // that side is left open
+        std::string lo, hi;
+        IndexKey::TypeRange(int64_t(0), &lo, &hi);
+        const double exact_limit = 9007199254740992.0;
+        if (std::fabs(*number) < exact_limit) {
+            if (lower) IndexKey::Encode(static_cast<int64_t>(std::floor(*number)), &lo);
+            if (upper) IndexKey::Encode(static_cast<int64_t>(std::ceil(*number)), &hi);
+        }
+        if (lo <= hi) ranges->emplace_back(std::move(lo), std::move(hi));
+    } else if (std::holds_alternative<std::string>(value) ||
+               (std::holds_alternative<bool>(value) && op == CompareOp::EQ)) {
+        AddRange(op, value, ranges);
+    }
+}
+
+// Whether a term can narrow an index on its field
+static bool Constrains(const FilterExpr& term) {
+    return (term.GetKind() == FilterExpr::Kind::COMPARE || term.GetKind() == FilterExpr::Kind::IN) &&
+           term.GetOp() != CompareOp::NE;
+}
+
+// Key ranges (sorted, disjoint, inclusive) the conjuncts allow under an
+// index on field; false if none of them constrains it
+static bool FieldRanges(const std::vector<const FilterExpr*>& conjuncts, const std::string& field,
+                        std::vector<KeyRange>* ranges) {
+    bool found = false;
+    for (const FilterExpr* term : conjuncts) {
+        if (!Constrains(*term) || term->GetField() != field) continue;
+        std::vector<KeyRange> allowed;
+        for (const BsonValue& value : term->GetValues()) ValueRanges(term->GetOp(), value, &allowed);
+        allowed = Normalize(std::move(allowed));
+        *ranges = found ? Intersect(*ranges, allowed) : std::move(allowed);
+        found = true;
+    }
+    return found;
+}
+
+// Field tests the filter runs per document (for the CPU cost)
+static size_t CountTests(const FilterExpr& filter) {
+    switch (filter.GetKind()) {
+        case FilterExpr::Kind::ALL:
+            return 0;
+        case FilterExpr::Kind::COMPARE:
+            return 1;
+        case FilterExpr::Kind::IN:
+            return filter.GetValues().size();
+        default: {
+            size_t tests = 0;
+            for (const FilterExpr& term : filter.GetTerms()) tests += CountTests(term);
+            return tests;
+        }
+    }
+}
+
+// ============================================================================
+// AccessPath
+// ============================================================================
+
+std::string AccessPath::Describe() const {
+    std::ostringstream ss;
+    switch (type) {
+        case Type::SEQ_SCAN:
+            if (scan_threads > 1) {
+                ss << "ParallelSeqScan(" << scan_threads << " workers)";
+            } else {
+                ss << "SeqScan";
+            }
+            break;
+        case Type::INDEX_SCAN:
+        case Type::INDEX_INTERSECTION:
+            ss << (type == Type::INDEX_SCAN ? "IndexScan(" : "IndexIntersection(");
+            for (size_t i = 0; i < indexes.size(); i++) {
+                if (i > 0) ss << ", ";
+                size_t n = indexes[i].ranges.size();
+                ss << indexes[i].index->field_name << ": " << n << (n == 1 ? " range" : " ranges");
+            }
+            ss << ")";
+            break;
+    }
+    return ss.str();
+}
+
+// ============================================================================
+// Planner — statistics
+// ============================================================================
+
+Planner::Planner(CollectionInfo* coll, uint32_t page_size, size_t scan_threads)
+    : coll_(coll), page_size_(page_size), scan_threads_(scan_threads) {
+    coll_->heap_file->GetExtents(&num_pages_);
+    rows_ = static_cast<double>(coll_->DocumentCount());
+}
+
+const IndexInfo* Planner::FindIndex(const std::string& field) const {
+    for (const IndexInfo& idx : coll_->indexes) {
+        if (idx.field_name == field) return &idx;
+    }
+    return nullptr;
+}
+
+// An index analyzed while it was empty says nothing about what came since
+static bool HasHistogram(const IndexInfo* index) {
+    return index && index->stats.analyzed && !index->stats.bounds.empty();
+}
+
+double Planner::Coverage(const IndexInfo& index) const {
+    if (!HasHistogram(&index) || coll_->stats.row_count == 0) return 1.0;
+    return std::min(1.0, static_cast<double>(index.stats.num_entries) / coll_->stats.row_count);
+}
+
+double Planner::IndexEntries(const IndexInfo& index) const {
+    if (!HasHistogram(&index) || coll_->stats.row_count == 0) return rows_;
+    return index.stats.num_entries * rows_ / coll_->stats.row_count;
+}
+
+// Each histogram bucket holds 1 / B of the entries; a bucket a range only
+// partly covers counts half. A range containing keys holds at least one
+// distinct key's share.
+double Planner::RangeSelectivity(const IndexStats& stats, const std::vector<KeyRange>& ranges) {
+    const std::vector<std::string>& bounds = stats.bounds;
+    if (bounds.empty()) return 0;
+    const double buckets = static_cast<double>(bounds.size());
+    const double one_key = 1.0 / std::max<uint64_t>(1, stats.distinct_keys);
+
+    double fraction = 0;
+    for (const auto& [lo, hi] : ranges) {
+        if (hi < stats.min_key || lo > bounds.back()) continue;
+        size_t below_lo = std::lower_bound(bounds.begin(), bounds.end(), lo) - bounds.begin();
+        size_t upto_hi = std::upper_bound(bounds.begin(), bounds.end(), hi) - bounds.begin();
+        double from = lo <= stats.min_key ? 0.0 : (below_lo + 0.5) / buckets;
+        double to = hi >= bounds.back() ? 1.0 : (upto_hi + 0.5) / buckets;
+        fraction += std::max(to - from, one_key);
+    }
+    return std::min(1.0, fraction);
+}
+
+double Planner::IndexSelectivity(const IndexInfo& index, const std::vector<const FilterExpr*>& conjuncts,
+                                 const std::vector<KeyRange>& ranges) const {
+    if (HasHistogram(&index)) return RangeSelectivity(index.stats, ranges);
+    double selectivity = 1.0;
+    for (const FilterExpr* term : conjuncts) {
+        if (Constrains(*term) && term->GetField() == index.field_name) selectivity *= TermSelectivity(*term);
+    }
+    return selectivity;
+}
+
+double Planner::TermSelectivity(const FilterExpr& term) const {
+    const IndexInfo* index = FindIndex(term.GetField());
+    if (HasHistogram(index)) {
+        CompareOp op = term.GetOp() == CompareOp::NE ? CompareOp::EQ : term.GetOp();
+        std::vector<KeyRange> ranges;
+        for (const BsonValue& value : term.GetValues()) ValueRanges(op, value, &ranges);
+        double matching = RangeSelectivity(index->stats, Normalize(std::move(ranges))) * Coverage(*index);
+        return term.GetOp() == CompareOp::NE ? std::max(0.0, Coverage(*index) - matching) : matching;
+    }
+
+    switch (term.GetOp()) {
+        case CompareOp::EQ:
+            return std::min(1.0, DEFAULT_EQ_SELECTIVITY * term.GetValues().size());
+        case CompareOp::NE:
+            return 1.0 - DEFAULT_EQ_SELECTIVITY;
+        default:
+            return DEFAULT_RANGE_SELECTIVITY;
+    }
+}
+
+double Planner::Selectivity(const FilterExpr& filter) const {
+    if (filter.MatchesAll()) return 1.0;
+    if (filter.GetKind() == FilterExpr::Kind::OR) {
+        double none = 1.0;
+        for (const FilterExpr& term : filter.GetTerms()) none *= 1.0 - Selectivity(term);
+        return 1.0 - none;
+    }
+
+    // Terms on one analyzed field are estimated together, from the ranges
+    // they leave (x > 10 AND x < 14 is one narrow range, not two wide ones)
+    std::vector<const FilterExpr*> conjuncts = filter.Conjuncts();
+    std::set<std::string> estimated;
+    double selectivity = 1.0;
+    for (const FilterExpr* term : conjuncts) {
+        if (term->GetKind() == FilterExpr::Kind::AND || term->GetKind() == FilterExpr::Kind::OR) {
+            selectivity *= Selectivity(*term);
+            continue;
+        }
+        const IndexInfo* index = FindIndex(term->GetField());
+        if (!Constrains(*term) || !HasHistogram(index)) {
+            selectivity *= TermSelectivity(*term);
+        } else if (estimated.insert(term->GetField()).second) {
+            std::vector<KeyRange> ranges;
+            FieldRanges(conjuncts, term->GetField(), &ranges);
+            selectivity *= RangeSelectivity(index->stats, ranges) * Coverage(*index);
+        }
+    }
+    return selectivity;
+}
+
+// ============================================================================
+// Planner — costs
+// ============================================================================
+
+// Descending to each range's first leaf is CPU work on cached inner pages;
+// the leaves in range are read at random, and so (unless fetch is false)
+// are the heap pages of their records, a page hit again only while the
+// pool still holds it (Mackert-Lohman)
+double Planner::IndexScanCost(const AccessPath::IndexRanges& input, bool fetch) const {
+    if (input.ranges.empty()) return 0;
+    double entries = IndexEntries(*input.index);
+    double matched = entries * input.selectivity;
+    double fanout = std::max(2.0, page_size_ / INDEX_ENTRY_BYTES);
+    double height = 1 + std::ceil(std::log(std::max(entries, 1.0)) / std::log(fanout));
+    double leaf_pages = std::ceil(std::max(entries, 1.0) / fanout);
+
+    double cost = input.ranges.size() * height * 50 * CPU_OPERATOR_COST;
+    cost += std::max(1.0, leaf_pages * input.selectivity) * RANDOM_PAGE_COST;
+    cost += matched * CPU_INDEX_TUPLE_COST;
+    if (fetch) {
+        double pages = std::max<double>(1, num_pages_);
+        double pages_fetched = std::min(pages, 2 * pages * matched / (2 * pages + matched));
+        cost += pages_fetched * RANDOM_PAGE_COST + matched * CPU_TUPLE_COST;
+    }
+    return cost;
+}
+
+std::vector<AccessPath> Planner::Enumerate(const FilterExpr& filter) const {
+    const double test_cost = CountTests(filter) * CPU_OPERATOR_COST;
+    const double rows = rows_ * Selectivity(filter);
+    std::vector<AccessPath> paths;
+
+    // Sequential: every page once, every record tested
+    AccessPath seq;
+    seq.type = AccessPath::Type::SEQ_SCAN;
+    if (ParallelSeqScanExecutor::Worthwhile(num_pages_, scan_threads_)) {
+        seq.scan_threads = scan_threads_ ? scan_threads_ : std::thread::hardware_concurrency();
+    }
+    seq.cost = num_pages_ * SEQ_PAGE_COST + rows_ * (CPU_TUPLE_COST + test_cost) / seq.scan_threads;
+    seq.rows = rows;
+    paths.push_back(seq);
+
+    // One index: its matches fetched and tested
+    std::vector<const FilterExpr*> conjuncts = filter.Conjuncts();
+    std::vector<AccessPath::IndexRanges> inputs;
+    for (const IndexInfo& idx : coll_->indexes) {
+        std::vector<KeyRange> ranges;
+        if (!FieldRanges(conjuncts, idx.field_name, &ranges)) continue;
+        double selectivity = IndexSelectivity(idx, conjuncts, ranges);
+        inputs.push_back(AccessPath::IndexRanges{&idx, std::move(ranges), selectivity});
+    }
+    for (const AccessPath::IndexRanges& input : inputs) {
+        AccessPath path;
+        path.type = AccessPath::Type::INDEX_SCAN;
+        path.indexes = {input};
+        path.cost = IndexScanCost(input, true) + IndexEntries(*input.index) * input.selectivity * test_cost;
+        path.rows = rows;
+        paths.push_back(std::move(path));
+    }
+
+    // Most selective indexes first: RecordIDs read and sorted per index,
+    // then only the records in all of them fetched, in page order (the
+    // fewer pages of the heap that holds, the more random each read)
+    std::sort(inputs.begin(), inputs.end(),
+              [](const auto& a, const auto& b) { return a.selectivity < b.selectivity; });
+    double pages = std::max<double>(1, num_pages_);
+    for (size_t k = 2; k <= inputs.size(); k++) {
+        AccessPath path;
+        path.type = AccessPath::Type::INDEX_INTERSECTION;
+        path.indexes.assign(inputs.begin(), inputs.begin() + k);
+        double fraction = 1.0;
+        for (const AccessPath::IndexRanges& input : path.indexes) {
+            double entries = IndexEntries(*input.index) * input.selectivity;
+            path.cost += IndexScanCost(input, false) + entries * std::log2(entries + 2) * CPU_OPERATOR_COST;
+            fraction *= input.selectivity * Coverage(*input.index);
+        }
+        double fetched = rows_ * fraction;
+        double pages_fetched = std::min(pages, fetched);
+        double page_cost = RANDOM_PAGE_COST - (RANDOM_PAGE_COST - SEQ_PAGE_COST) * std::sqrt(pages_fetched / pages);
+        path.cost += pages_fetched * page_cost + fetched * (CPU_TUPLE_COST + test_cost);
+        path.rows = rows;
+        paths.push_back(std::move(path));
+    }
+
+    std::stable_sort(paths.begin(), paths.end(),
+                     [](const AccessPath& a, const AccessPath& b) { return a.cost < b.cost; });
+    return paths;
+}
+
+// ============================================================================
+// Build
+// ============================================================================
+
+std::unique_ptr<Executor> Planner::Build(const AccessPath& path, const FilterExpr& filter) const {
+    HeapFile* heap = coll_->heap_file.get();
+    switch (path.type) {
+        case AccessPath::Type::INDEX_SCAN: {
+            const AccessPath::IndexRanges& input = path.indexes.front();
+            return std::make_unique<FilterExecutor>(
+                std::make_unique<IndexScanExecutor>(input.index->btree.get(), heap, input.ranges), filter);
+        }
+        case AccessPath::Type::INDEX_INTERSECTION: {
+            std::vector<IndexIntersectionExecutor::Input> inputs;
+            for (const AccessPath::IndexRanges& input : path.indexes) {
+                inputs.emplace_back(input.index->btree.get(), input.ranges);
+            }
+            return std::make_unique<FilterExecutor>(
+                std::make_unique<IndexIntersectionExecutor>(heap, std::move(inputs)), filter);
+        }
+        case AccessPath::Type::SEQ_SCAN:
+        default:
+            if (path.scan_threads > 1) {
+                return std::make_unique<ParallelSeqScanExecutor>(heap, filter, path.scan_threads);
+            }
+            return std::make_unique<SeqScanExecutor>(heap, filter);
+    }
+}
+
+// ============================================================================
+// Count
+// ============================================================================
+
+const IndexInfo* Planner::CoveringIndex(const FilterExpr& filter, std::vector<KeyRange>* ranges) const {
+    std::vector<std::string> fields = filter.Fields();
+    if (fields.size() != 1) return nullptr;
+    const IndexInfo* index = FindIndex(fields.front());
+    if (!index) return nullptr;
+    if (!FieldRanges(filter.Conjuncts(), index->field_name, ranges)) {
+        *ranges = {KeyRange(std::string(), std::string(1, '\xff'))};  // Every key
+    }
+    return index;
+}
+
+uint64_t Planner::Count(const FilterExpr& filter) const {
+    if (filter.MatchesAll()) return coll_->DocumentCount();
+
+    uint64_t count = 0;
+    std::vector<KeyRange> ranges;
+    if (const IndexInfo* index = CoveringIndex(filter, &ranges)) {
+        std::string key;
+        RecordID rid;
+        BsonValue value;
+        for (const KeyRange& range : ranges) {
+            BPlusTree::Iterator it(index->btree.get(), range.first, range.second);
+            while (it.Next(&key, &rid)) {
+                if (IndexKey::Decode(key, &value) && filter.Matches(value)) count++;
+            }
+        }
+        return count;
+    }
+
+    std::unique_ptr<Executor> plan = Build(Choose(filter), filter);
+    plan->Init();
+    TupleBatch batch;
+    while (plan->NextBatch(&batch)) count += batch.Size();
+    plan->Close();
+    return count;
+}
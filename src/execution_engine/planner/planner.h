@@ -0,0 +1,123 @@
+#pragma once
+
+#include "execution_engine/catalog/catalog.h"
+#include "execution_engine/executor/executor.h"
+#include "execution_engine/executor/filter_expr.h"
+#include "execution_engine/executor/index_scan.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// AccessPath — one way to produce the documents a filter selects
+// ============================================================================
+struct AccessPath {
+    enum class Type : uint8_t {
+        SEQ_SCAN,           // Every record, filter pushed down (parallel if scan_threads > 1)
+        INDEX_SCAN,         // Key ranges of one index, then the filter
+        INDEX_INTERSECTION  // RecordIDs in all of several indexes' ranges, then the filter
+    };
+
+    struct IndexRanges {
+        const IndexInfo* index;
+        std::vector<KeyRange> ranges;  // Sorted, disjoint, inclusive
+        double selectivity;            // Estimated fraction of the index's entries in ranges
+    };
+
+    Type type = Type::SEQ_SCAN;
+    std::vector<IndexRanges> indexes;  // INDEX_SCAN: one; INDEX_INTERSECTION: two or more
+    size_t scan_threads = 1;
+    double rows = 0;  // Estimated documents the filter lets through
+    double cost = 0;  // Estimated, in sequential page reads
+
+    // e.g. "IndexScan(age: 2 ranges)"
+    std::string Describe() const;
+};
+
+// ============================================================================
+// Planner — picks the cheapest access path for a filter on one collection
+//
+// Candidates are a sequential scan, an index scan over the key ranges the
+// filter's conjuncts allow on each indexed field they constrain, and the
+// intersection of the two, three, ... most selective of those indexes.
+// Every path still runs the whole filter on what it returns, so the
+// ranges only have to be a superset.
+//
+// Costs follow the System R / PostgreSQL model: page reads (random ones
+// RANDOM_PAGE_COST times a sequential one) plus CPU per record, per index
+// entry and per field test. The row count is the heap's live document
+// count; selectivities from the index
+// histograms where a field is indexed and analyzed and from fixed default
+// fractions otherwise, with the terms of an AND taken as independent.
+//
+// The planner reads the statistics unguarded: the caller keeps Analyze and
+// CreateIndex from running at the same time (as for any use of a
+// CollectionInfo).
+// ============================================================================
+class Planner {
+public:
+    static constexpr double SEQ_PAGE_COST = 1.0;
+    static constexpr double RANDOM_PAGE_COST = 4.0;
+    static constexpr double CPU_TUPLE_COST = 0.01;
+    static constexpr double CPU_INDEX_TUPLE_COST = 0.005;
+    static constexpr double CPU_OPERATOR_COST = 0.0025;
+
+    // Without statistics: fractions a test passes
+    static constexpr double DEFAULT_EQ_SELECTIVITY = 0.005;
+    static constexpr double DEFAULT_RANGE_SELECTIVITY = 1.0 / 3;
+
+    // scan_threads as for ParallelSeqScanExecutor (0 = one per core)
+    Planner(CollectionInfo* coll, uint32_t page_size, size_t scan_threads = 1);
+
+    // Every candidate path, cheapest first (never empty: SEQ_SCAN is always one)
+    std::vector<AccessPath> Enumerate(const FilterExpr& filter) const;
+
+    AccessPath Choose(const FilterExpr& filter) const { return Enumerate(filter).front(); }
+
+    // The executor tree for a path: its access method running filter
+    std::unique_ptr<Executor> Build(const AccessPath& path, const FilterExpr& filter) const;
+
+    // Documents in the collection now
+    double EstimateRows() const { return rows_; }
+
+    // Estimated fraction of the documents filter lets through
+    double Selectivity(const FilterExpr& filter) const;
+
+    // An index that can answer filter from its keys alone: each test runs
+    // on the index's field, so a document passes iff its entry's key does
+    // (one without the field passes no test). Sets *ranges to the keys to
+    // visit. nullptr if there is none, or filter is ALL.
+    const IndexInfo* CoveringIndex(const FilterExpr& filter, std::vector<KeyRange>* ranges) const;
+
+    // Documents filter selects, without fetching any that need not be:
+    // the heap's counter for ALL, the keys of a CoveringIndex, or else the
+    // chosen path's output
+    uint64_t Count(const FilterExpr& filter) const;
+
+private:
+    const IndexInfo* FindIndex(const std::string& field) const;
+
+    // Fraction of the documents having an index's field, per its statistics
+    double Coverage(const IndexInfo& index) const;
+
+    // Estimated entries the index holds now
+    double IndexEntries(const IndexInfo& index) const;
+
+    // Fraction of an analyzed index's entries in ranges (per the histogram)
+    static double RangeSelectivity(const IndexStats& stats, const std::vector<KeyRange>& ranges);
+
+    // Fraction of an index's entries the conjuncts on its field allow
+    double IndexSelectivity(const IndexInfo& index, const std::vector<const FilterExpr*>& conjuncts,
+                            const std::vector<KeyRange>& ranges) const;
+
+    // Fraction of the documents passing one COMPARE / IN term
+    double TermSelectivity(const FilterExpr& term) const;
+
+    double IndexScanCost(const AccessPath::IndexRanges& input, bool fetch) const;
+
+    CollectionInfo* coll_;
+    uint32_t page_size_;
+    size_t scan_threads_;
+    uint32_t num_pages_;  // Heap pages now
+    double rows_;
+};
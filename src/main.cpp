@@ -3,34 +3,62 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <map>
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <atomic>
+#include <thread>
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 // Storage Engine
 #include "storage_engine/config/config.h"
 #include "storage_engine/disk_manager/disk_manager.h"
+#include "storage_engine/disk_manager/page_compressor.h"
 #include "storage_engine/buffer/buffer_pool.h"
 #include "storage_engine/serializer/serializer.h"
+#include "storage_engine/serializer/json.h"
 #include "storage_engine/page/slotted_page.h"
 #include "storage_engine/page/free_space_map.h"
 #include "storage_engine/common/bson_types.h"
+#include "storage_engine/common/metrics.h"
 
 // Data Organisation
 #include "data_organisation/heap_file/heap_file.h"
 #include "data_organisation/bptree/bptree.h"
+#include "data_organisation/bptree/index_key.h"
+#include "data_organisation/bptree/entry_sorter.h"
 
 // Execution Engine
 #include "execution_engine/catalog/catalog.h"
 #include "execution_engine/executor/executor.h"
 #include "execution_engine/executor/seq_scan.h"
 #include "execution_engine/executor/filter.h"
+#include "execution_engine/executor/filter_expr.h"
 #include "execution_engine/executor/index_scan.h"
+#include "execution_engine/executor/parallel_seq_scan.h"
+#include "execution_engine/executor/snapshot_scan.h"
+#include "execution_engine/executor/limit.h"
+#include "execution_engine/executor/projection.h"
+#include "execution_engine/planner/planner.h"
 
 // Concurrency & Recovery
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction.h"
+#include "concurrency/vacuum.h"
 #include "recovery/wal.h"
 #include "recovery/recovery_manager.h"
+#include "recovery/checkpointer.h"
+#include "recovery/background_writer.h"
+#include "recovery/log_cursor.h"
 
 // CLI
 #include "cli/cli.h"
@@ -65,13 +93,86 @@ void PrintDoc(const BsonDocument& doc) {
     std::cout << " }" << std::endl;
 }
 
+// ============================================================================
+// Helper: remove a WAL's segment files and master record
+// ============================================================================
+static void RemoveWAL(const std::string& base) {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(".", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name == base || name.compare(0, base.size() + 1, base + ".") == 0) {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+}
+
+// A port nothing is listening on, for a test server
+static uint16_t FreePort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    assert(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    assert(getsockname(fd, (struct sockaddr*)&addr, &len) == 0);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+// A client connection speaking the server's length-prefixed framing
+struct TestClient {
+    int fd = -1;
+
+    explicit TestClient(uint16_t port) {
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for (int attempt = 0; attempt < 200; attempt++) {  // The server binds on its own thread
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) return;
+            close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        assert(false && "test server did not start");
+    }
+    ~TestClient() { close(fd); }
+
+    // Several requests in one write: pipelined, so they form one batch
+    void Send(const std::vector<std::string>& payloads) {
+        std::string out;
+        for (const std::string& payload : payloads) {
+            uint32_t len = htonl(static_cast<uint32_t>(payload.size()));
+            out.append(reinterpret_cast<const char*>(&len), 4);
+            out += payload;
+        }
+        assert(write(fd, out.data(), out.size()) == static_cast<ssize_t>(out.size()));
+    }
+
+    std::string Receive() {
+        auto read_exact = [this](char* dst, size_t n) {
+            while (n > 0) {
+                ssize_t got = read(fd, dst, n);
+                assert(got > 0);
+                dst += got;
+                n -= static_cast<size_t>(got);
+            }
+        };
+        uint32_t len;
+        read_exact(reinterpret_cast<char*>(&len), 4);
+        std::string payload(ntohl(len), '\0');
+        read_exact(payload.data(), payload.size());
+        return payload;
+    }
+};
+
 // ============================================================================
 // Main — Integration Test Driver
 // ============================================================================
 int run_tests() {
     // Clean up any previous test files
     std::remove("test_docdb.db");
-    std::remove("test_wal.log");
+    RemoveWAL("test_wal.log");
 
     std::cout << "========================================" << std::endl;
     std::cout << "  DocDB Engine — Integration Test" << std::endl;
@@ -89,6 +190,162 @@ int run_tests() {
 
     std::cout << "✓ DiskManager + BufferPoolManager initialized" << std::endl;
 
+    // ---- Replacement policies ----
+    std::cout << "\n--- Phase 1: Replacers ---" << std::endl;
+    {
+        // Frame 0 is used twice, frame 1 once: LRU-K evicts the one-off first
+        LRUKReplacer lru_k(4, 2);
+        lru_k.Pin(0); lru_k.Unpin(0);
+        lru_k.Pin(1); lru_k.Unpin(1);
+        lru_k.Pin(0); lru_k.Unpin(0);
+        frame_id_t victim;
+        assert(lru_k.Victim(&victim) && victim == 1);
+        assert(lru_k.Victim(&victim) && victim == 0);
+        assert(!lru_k.Victim(&victim));
+
+        // CLOCK: every frame referenced, so the sweep wraps and takes the first
+        ClockReplacer clock(3);
+        for (frame_id_t f = 0; f < 3; f++) { clock.Pin(f); clock.Unpin(f); }
+        clock.Pin(1);  // Pinned frames are never victims
+        assert(clock.Victim(&victim) && victim == 0);
+        assert(clock.Victim(&victim) && victim == 2);
+        assert(!clock.Victim(&victim));
+    }
+    std::cout << "✓ LRU-K and CLOCK victim order" << std::endl;
+
+    // ---- Metrics ----
+    std::cout << "\n--- Phase 1: Metrics ---" << std::endl;
+    {
+        DBConfigs metrics_config = config;
+        metrics_config.db_file_name = "test_metrics.db";
+        std::remove("test_metrics.db");
+
+        // Nothing else runs yet, so the deltas are this block's alone
+        MetricsSnapshot before = Metrics::Snapshot();
+        {
+            DiskManager dm(metrics_config);
+            BufferPoolManager pool(4, &dm);
+            page_id_t ids[8];
+            for (page_id_t& id : ids) {
+                assert(pool.NewPage(&id));
+                pool.UnpinPage(id, true);
+            }
+            for (int i = 0; i < 3; i++) {
+                assert(pool.FetchPage(ids[7]));
+                pool.UnpinPage(ids[7], false);
+            }
+            assert(pool.FetchPage(ids[0]));  // Long evicted: read back
+            pool.UnpinPage(ids[0], false);
+        }
+
+        // A thread's counts outlive it
+        std::thread([] {
+            Metrics::Add(Counter::BTREE_SPLITS, 5);
+            Metrics::Record(Histogram::LOCK_WAIT, 1000);
+        }).join();
+
+        MetricsSnapshot after = Metrics::Snapshot();
+        auto delta = [&](Counter c) { return after.Get(c) - before.Get(c); };
+        assert(delta(Counter::BUFFER_HITS) == 3 && delta(Counter::BUFFER_MISSES) == 1);
+        assert(delta(Counter::BUFFER_EVICTIONS) == 5);
+        assert(delta(Counter::BUFFER_DIRTY_WRITES) >= 5);
+        assert(delta(Counter::DISK_READS) == 1 && delta(Counter::DISK_READ_BYTES) == config.page_size);
+        assert(delta(Counter::DISK_WRITES) >= 5);
+        assert(after.Get(Histogram::DISK_READ).count - before.Get(Histogram::DISK_READ).count == 1);
+        assert(delta(Counter::BTREE_SPLITS) == 5);
+        const HistogramSnapshot& waits = after.Get(Histogram::LOCK_WAIT);
+        assert(waits.buckets[10] - before.Get(Histogram::LOCK_WAIT).buckets[10] == 1);  // [512, 1024) µs
+        assert(waits.max_us >= 1000);
+
+        // Percentiles: the bucket's bound, capped at the largest sample
+        HistogramSnapshot h;
+        assert(h.Percentile(0.99) == 0);
+        h.count = 100;
+        h.buckets[3] = 98;  // 4..7 µs
+        h.buckets[10] = 2;  // 512..1023 µs
+        h.max_us = 900;
+        assert(h.Percentile(0.5) == 7 && h.Percentile(0.98) == 7);
+        assert(h.Percentile(0.99) == 900 && h.Percentile(1.0) == 900);
+        std::remove("test_metrics.db");
+    }
+    std::cout << "✓ Metrics: buffer pool and disk counters, per-thread blocks folded on exit, percentiles"
+              << std::endl;
+
+    // ---- Larger pages ----
+    for (uint16_t page_size : {8192, 32768}) {
+        DBConfigs big_config;
+        big_config.db_file_name = "test_pagesize.db";
+        big_config.page_size = page_size;
+        std::remove(big_config.db_file_name.c_str());
+        {
+            DiskManager big_disk(big_config);
+            BufferPoolManager big_bpm(16, &big_disk);
+            Catalog big_catalog(&big_bpm);
+            page_id_t catalog_page;
+            big_bpm.NewPage(&catalog_page);
+            big_bpm.UnpinPage(catalog_page, true);
+            assert(big_catalog.CreateCollection("big"));
+            CollectionInfo* big = big_catalog.GetCollection("big");
+
+            for (int i = 0; i < 2000; i++) {
+                BsonDocument d;
+                d.Add("k", "key_" + std::to_string(i));
+                d.Add("pad", std::string(100, 'x'));
+                big->heap_file->InsertRecord(d);
+            }
+            assert(big_catalog.CreateIndex("big", "k"));
+            std::string big_key;
+            IndexKey::Encode(std::string("key_1234"), &big_key);
+            assert(big->indexes[0].btree->Search(big_key).IsValid());
+
+            int scanned = 0;
+            HeapFile::Iterator it = big->heap_file->Begin();
+            RecordID rid;
+            BsonDocument d;
+            while (it.Next(&rid, &d)) scanned++;
+            assert(scanned == 2000);
+        }
+        std::remove(big_config.db_file_name.c_str());
+        std::cout << "✓ " << page_size / 1024 << " KB pages: heap, FSM, index, scan" << std::endl;
+    }
+
+    // ---- Batched and async I/O ----
+    for (IOBackend backend : {IOBackend::PREAD, IOBackend::AUTO}) {
+        DBConfigs io_config;
+        io_config.db_file_name = "test_io.db";
+        io_config.io_backend = backend;
+        std::remove(io_config.db_file_name.c_str());
+        {
+            DiskManager io_disk(io_config);
+            const size_t n = 40;
+            std::vector<char> buffers(n * io_config.page_size);
+            std::vector<IORequest> requests;
+            for (size_t i = 0; i < n; i++) {
+                char* data = buffers.data() + i * io_config.page_size;
+                std::memset(data, static_cast<int>(i + 1), io_config.page_size);
+                requests.push_back(IORequest{static_cast<page_id_t>(i), data});
+            }
+            io_disk.WritePages(requests);
+            std::memset(buffers.data(), 0, buffers.size());
+            io_disk.ReadPages(requests);
+            for (size_t i = 0; i < n; i++) {
+                assert(requests[i].data[0] == static_cast<char>(i + 1));
+                assert(requests[i].data[io_config.page_size - 1] == static_cast<char>(i + 1));
+            }
+
+            // Prefetched pages come back through FetchPage with their contents
+            BufferPoolManager io_bpm(16, &io_disk, 2, ReplacerPolicy::LRU, 8);
+            io_bpm.Prefetch({0, 1, 2, 3, 4, 5, 6, 7, 1000});  // 1000 is past EOF
+            for (page_id_t pid : {0, 3, 7, 1000}) {
+                Page* p = io_bpm.FetchPage(pid, AccessType::SCAN);
+                assert(p && p->GetData()[0] == static_cast<char>(pid == 1000 ? 0 : pid + 1));
+                io_bpm.UnpinPage(pid, false);
+            }
+        }
+        std::remove(io_config.db_file_name.c_str());
+    }
+    std::cout << "✓ Batched reads/writes and prefetch (pread and auto backends)" << std::endl;
+
     // ---- 2. Test BSON Serialization ----
     std::cout << "\n--- Phase 1: BSON Serialization ---" << std::endl;
 
@@ -104,12 +361,216 @@ int run_tests() {
     assert(std::get<int32_t>(deserialized.elements["age"]) == 30);
     std::cout << "✓ BSON serialize/deserialize roundtrip passed" << std::endl;
 
+    // Flat documents: fields keep the order they were added in, through
+    // serialization; every Serialize variant writes the same bytes
+    {
+        BsonDocument doc;
+        doc.Add("zeta", int32_t(1));
+        doc.Add("alpha", std::string("a"));
+        doc.Add("mid", 2.5);
+        doc.Add("alpha", std::string("b"));  // Replaces in place
+        assert(doc.elements.size() == 3 && doc.elements.begin()->first == "zeta");
+        assert(std::get<std::string>(doc.elements["alpha"]) == "b");
+
+        std::vector<uint8_t> bytes = BsonSerializer::Serialize(doc);
+        assert(bytes.size() == BsonSerializer::SerializedSize(doc));
+        std::vector<uint8_t> reused(1000, 0xAB);
+        BsonSerializer::SerializeTo(doc, &reused);
+        assert(reused == bytes);
+        std::vector<uint8_t> slot(bytes.size());
+        assert(BsonSerializer::SerializeInto(doc, slot.data()) == bytes.size() && slot == bytes);
+
+        BsonDocument back = BsonSerializer::Deserialize(bytes);
+        std::vector<std::string> order;
+        for (const auto& [key, val] : back.elements) order.push_back(key);
+        assert((order == std::vector<std::string>{"zeta", "alpha", "mid"}));
+
+        assert(back.elements.erase("alpha") == 1 && back.elements.count("alpha") == 0);
+        assert(BsonSerializer::SerializedSize(back) == BsonSerializer::Serialize(back).size());
+    }
+    std::cout << "✓ Flat BsonDocument: field order kept, in-place serialization" << std::endl;
+
+    // BsonView: fields located in the serialized bytes, nested documents,
+    // and predicates that agree with the decoded form
+    {
+        BsonDocument inner;
+        inner.Add("zip", std::string("10001"));
+        BsonDocument outer = test_doc;
+        outer.Add("addr", std::make_shared<BsonDocument>(inner));
+        outer.Add("big", int64_t(1) << 40);
+        auto bytes = BsonSerializer::Serialize(outer);
+        BsonView view(bytes.data(), bytes.size());
+
+        BsonElementView e;
+        assert(view.Find("name", &e) && e.type == BsonType::STRING && e.AsString() == "Alice");
+        assert(view.Find("age", &e) && e.AsInt32() == 30);
+        assert(view.Find("big", &e) && e.AsInt64() == (int64_t(1) << 40));
+        assert(view.Find("score", &e) && e.AsDouble() == 95.5);
+        assert(view.Find("active", &e) && e.AsBool());
+        assert(view.Find("addr", &e) && e.type == BsonType::DOCUMENT);
+        BsonElementView zip;
+        assert(e.AsDocument().Find("zip", &zip) && zip.AsString() == "10001");
+        assert(!view.Find("missing", &e) && !view.Find("zip", &e));
+
+        size_t fields = 0;
+        view.ForEach([&](const BsonElementView&) { return ++fields < 100; });
+        assert(fields == outer.elements.size());
+        assert(BsonSerializer::Serialize(view.ToDocument()) == bytes);
+
+        auto check = [&](const std::string& field, CompareOp op, BsonValue v) {
+            Predicate p{field, op, v};
+            bool decoded = p.Evaluate(outer);
+            assert(p.Evaluate(view) == decoded);
+            return decoded;
+        };
+        assert(check("name", CompareOp::EQ, std::string("Alice")));
+        assert(check("name", CompareOp::LT, std::string("Bob")));
+        assert(!check("name", CompareOp::GT, std::string("Alicia")));
+        assert(check("age", CompareOp::GE, int32_t(30)));
+        assert(check("age", CompareOp::EQ, int64_t(30)));  // Numbers compare by value
+        assert(check("age", CompareOp::LT, 30.5) && !check("big", CompareOp::LE, 1e12));
+        assert(!check("name", CompareOp::NE, int32_t(30)));  // Other types never match
+        assert(check("big", CompareOp::GT, int64_t(5)));
+        assert(check("score", CompareOp::LT, 100.0));
+        assert(check("active", CompareOp::NE, false));
+        assert(!check("active", CompareOp::LT, true));
+        assert(!check("addr", CompareOp::EQ, std::string("x")));
+        assert(!check("missing", CompareOp::NE, int32_t(1)));
+
+        bytes[0] = static_cast<uint8_t>(bytes.size() + 1);  // Claims more than there is
+        bool threw = false;
+        try {
+            BsonView bad(bytes.data(), bytes.size());
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+    std::cout << "✓ BsonView: in-place field lookup, nested documents, predicates" << std::endl;
+
+    // Compiled filters: AND / OR / IN trees, numeric promotion, identical
+    // results on the serialized and the decoded document
+    {
+        BsonDocument d;
+        d.Add("n", int32_t(7));
+        d.Add("x", 2.5);
+        d.Add("huge", int64_t(1) << 62);
+        d.Add("s", std::string("pear"));
+        auto bytes = BsonSerializer::Serialize(d);
+        BsonView view(bytes.data(), bytes.size());
+        auto matches = [&](const FilterExpr& f) {
+            bool decoded = f.Evaluate(d);
+            assert(f.Evaluate(view) == decoded);
+            return decoded;
+        };
+
+        assert(matches(FilterExpr()) && FilterExpr().MatchesAll());
+        assert(matches(FilterExpr::Compare("n", CompareOp::GT, 6.5)));
+        assert(!matches(FilterExpr::Compare("n", CompareOp::GT, 7.0)));
+        assert(matches(FilterExpr::Compare("x", CompareOp::LT, int32_t(3))));
+        // Integers compare exactly, even past a double's precision
+        assert(!matches(FilterExpr::Compare("huge", CompareOp::EQ, (int64_t(1) << 62) + 1)));
+        assert(matches(FilterExpr::Compare("huge", CompareOp::LT, (int64_t(1) << 62) + 1)));
+        assert(matches(FilterExpr::In("s", {std::string("fig"), int32_t(1), std::string("pear")})));
+        assert(!matches(FilterExpr::In("n", {int32_t(1), std::string("7")})));
+        assert(matches(FilterExpr::In("n", {int64_t(9), 7.0})));
+
+        FilterExpr both = FilterExpr::And({FilterExpr::Compare("n", CompareOp::GE, int32_t(7)),
+                                           FilterExpr::Compare("s", CompareOp::NE, std::string("fig"))});
+        FilterExpr either = FilterExpr::Or({FilterExpr::Compare("n", CompareOp::EQ, int32_t(1)),
+                                            FilterExpr::Compare("missing", CompareOp::NE, int32_t(1))});
+        assert(matches(both) && !matches(either));
+        assert(matches(FilterExpr::Or({either, both})));
+        assert(both.Conjuncts().size() == 2 && either.Conjuncts().size() == 1);
+
+        // ALL terms drop out of an AND; a single term is not wrapped
+        FilterExpr single = FilterExpr::And({FilterExpr(), FilterExpr::Compare("n", CompareOp::EQ, int32_t(7))});
+        assert(single.GetKind() == FilterExpr::Kind::COMPARE && single.GetField() == "n");
+        assert(FilterExpr(std::vector<Predicate>{}).MatchesAll());
+    }
+    std::cout << "✓ Compiled filters: $and / $or / $in trees, numbers compared by value" << std::endl;
+
+    // Json: text parsed straight to BSON bytes and written back from them
+    {
+        const std::string text =
+            R"({"name":"Ann \"A\"\n","n":7,"big":9000000000,"x":2.5,"whole":3.0,"ok":true,"none":null,)"
+            R"("tags":["a",1,[true,{"k":-0.125}]],"sub":{"e":{},"l":[]}})";
+        std::vector<uint8_t> bytes;
+        assert(!Json::Parse(text, &bytes));
+        BsonView view(bytes.data(), bytes.size());
+        BsonElementView e;
+        assert(view.Find("n", &e) && e.type == BsonType::INT32 && e.AsInt32() == 7);
+        assert(view.Find("big", &e) && e.type == BsonType::INT64 && e.AsInt64() == 9000000000LL);
+        assert(view.Find("whole", &e) && e.type == BsonType::DOUBLE && e.AsDouble() == 3.0);
+        assert(view.Find("none", &e) && e.type == BsonType::NULL_TYPE);
+        assert(view.Find("name", &e) && e.AsString() == "Ann \"A\"\n");
+        assert(view.Find("tags", &e) && e.type == BsonType::ARRAY);
+        BsonElementView inner;
+        assert(e.AsDocument().Find("2", &inner) && inner.type == BsonType::ARRAY);
+
+        // Out again, from the bytes and from the decoded document alike
+        std::string written;
+        Json::Write(view, &written);
+        assert(written == text);
+        BsonDocument doc = Json::ParseDocument(text);
+        auto tags = std::get<std::shared_ptr<BsonDocument>>(doc.elements["tags"]);
+        assert(tags->is_array && tags->elements.size() == 3 && !doc.is_array);
+        assert(Json::ToString(doc) == text);
+        assert(BsonSerializer::Serialize(doc) != bytes);  // Only the stored null is dropped
+        BsonDocument stored = BsonSerializer::Deserialize(BsonSerializer::Serialize(doc));
+        assert(std::get<std::shared_ptr<BsonDocument>>(stored.elements["tags"])->is_array);
+
+        // Escapes, \u code points (a surrogate pair too), number forms
+        doc = Json::ParseDocument(R"( { "s" : "\u00e9\ud83d\ude00\/\t" , "d" : 1e3 , "m" : -12 } )");
+        assert(std::get<std::string>(doc.elements["s"]) == "\xC3\xA9\xF0\x9F\x98\x80/\t");
+        assert(std::get<double>(doc.elements["d"]) == 1000.0 && std::get<int32_t>(doc.elements["m"]) == -12);
+        assert(Json::ToString(doc) == R"({"s":"é😀/\t","d":1000.0,"m":-12})");
+        doc = Json::ParseDocument(R"([0.1, 12345678901234567890])");  // Past INT64: a double
+        assert(doc.is_array && Json::ToString(doc) == "[0.1,12345678901234567168.0]");
+        assert(Json::Escape(std::string("a\x01", 2)) == "a\\u0001");
+
+        for (const char* bad : {"", "  ", "{", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "[1 2]", "{\"a\":01}",
+                                "{\"a\":1.}", "{\"a\":tru}", "{\"a\":\"x}", "{\"a\":\"\\q\"}", "{\"a\":\"\\ud800\"}",
+                                "{\"a\\u0000b\":1}", "{\"a\":1} x", "7", "{'a':1}", "[1e400]",
+                                "{\"a\":1,\"a\":2}", "{\"a\":1,\"\\u0061\":2}"}) {
+            bool threw = false;
+            try {
+                Json::Parse(bad, &bytes);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            assert(threw);
+        }
+        // A repeated key past the few compared in place; nested objects have keys of their own
+        std::string many = "{";
+        for (int k = 0; k < 20; k++) many += "\"k" + std::to_string(k) + "\":" + std::to_string(k) + ",";
+        bool repeat_threw = false;
+        try {
+            Json::Parse(many + "\"k3\":0}", &bytes);
+        } catch (const std::runtime_error&) {
+            repeat_threw = true;
+        }
+        assert(repeat_threw);
+        assert(Json::ParseDocument(many + "\"k20\":{\"k0\":{\"k0\":1}}}").elements.size() == 21);
+
+        std::string deep(Json::MAX_DEPTH + 1, '[');
+        deep += std::string(Json::MAX_DEPTH + 1, ']');
+        bool threw = false;
+        try {
+            Json::Parse(deep, &bytes);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+    std::cout << "✓ Json: one pass to BSON, arrays as ARRAY, escapes, repeated keys refused, to_chars numbers" << std::endl;
+
     // ---- 3. Test Slotted Page ----
     std::cout << "\n--- Phase 1: Slotted Page ---" << std::endl;
 
     page_id_t test_page_id;
     Page* test_page = bpm.NewPage(&test_page_id);
-    SlottedPage::Init(test_page->GetData());
+    SlottedPage::Init(test_page->GetData(), bpm.GetPageSize());
 
     int16_t slot = SlottedPage::InsertRecord(test_page->GetData(), serialized.data(),
                                               static_cast<uint16_t>(serialized.size()));
@@ -191,6 +652,897 @@ int run_tests() {
     assert(count == 10);
     std::cout << "✓ Filter(city=NYC) found " << count << " records (expected 10)" << std::endl;
 
+    // The same predicate pushed into the scan, checked before decoding
+    {
+        SeqScanExecutor pushed(users->heap_file.get(), {pred});
+        pushed.Init();
+        int pushed_count = 0;
+        while (pushed.Next(&tuple)) {
+            assert(std::get<std::string>(tuple.doc.elements["city"]) == "NYC");
+            pushed_count++;
+        }
+        pushed.Close();
+        assert(pushed_count == count);
+    }
+    std::cout << "✓ SeqScan(city=NYC) with the predicate pushed down matches Filter" << std::endl;
+
+    // ---- Batched execution ----
+    {
+        DBConfigs batch_config;
+        batch_config.db_file_name = "test_batches.db";
+        std::remove(batch_config.db_file_name.c_str());
+        DiskManager batch_disk(batch_config);
+        BufferPoolManager batch_bpm(64, &batch_disk);
+        Catalog batch_catalog(&batch_bpm);
+        page_id_t catalog_page;
+        batch_bpm.NewPage(&catalog_page);
+        batch_bpm.UnpinPage(catalog_page, true);
+        assert(batch_catalog.CreateCollection("rows"));
+        CollectionInfo* rows = batch_catalog.GetCollection("rows");
+        for (int i = 0; i < 2500; i++) {
+            BsonDocument d;
+            d.Add("k", int32_t(i));
+            d.Add("m", int32_t(i % 3));
+            rows->heap_file->InsertRecord(d);
+        }
+
+        // Full batches but the last, every record once
+        SeqScanExecutor batch_scan(rows->heap_file.get());
+        batch_scan.Init();
+        TupleBatch batch;
+        std::vector<size_t> sizes;
+        std::vector<bool> seen_k(2500, false);
+        while (batch_scan.NextBatch(&batch)) {
+            sizes.push_back(batch.Size());
+            for (size_t i = 0; i < batch.Size(); i++) {
+                int k = std::get<int32_t>(batch[i].doc.elements["k"]);
+                assert(!seen_k[k]);
+                seen_k[k] = true;
+            }
+        }
+        batch_scan.Close();
+        assert((sizes == std::vector<size_t>{1024, 1024, 452}));
+
+        // Filter narrows the selection; the row at a time path agrees
+        Predicate every_third{"m", CompareOp::EQ, int32_t(0)};
+        Predicate below{"k", CompareOp::LT, int32_t(2000)};
+        FilterExecutor batch_filter(std::make_unique<SeqScanExecutor>(rows->heap_file.get()), {every_third, below});
+        batch_filter.Init();
+        size_t selected = 0;
+        while (batch_filter.NextBatch(&batch)) {
+            assert(batch.Size() <= batch.num_rows);
+            for (size_t i = 0; i < batch.Size(); i++) {
+                int k = std::get<int32_t>(batch[i].doc.elements["k"]);
+                assert(k % 3 == 0 && k < 2000);
+            }
+            selected += batch.Size();
+        }
+        batch_filter.Close();
+        assert(selected == 667);
+
+        FilterExecutor row_filter(std::make_unique<SeqScanExecutor>(rows->heap_file.get()), {every_third, below});
+        row_filter.Init();
+        size_t row_count = 0;
+        while (row_filter.Next(&tuple)) row_count++;
+        row_filter.Close();
+        assert(row_count == selected);
+
+        // Index scans batch too, in key order
+        assert(batch_catalog.CreateIndex("rows", "k"));
+        std::string lo, hi;
+        IndexKey::Encode(int32_t(100), &lo);
+        IndexKey::Encode(int32_t(1400), &hi);
+        IndexScanExecutor batch_index(rows->indexes[0].btree.get(), rows->heap_file.get(), lo, hi);
+        batch_index.Init();
+        int expected_k = 100;
+        while (batch_index.NextBatch(&batch)) {
+            for (size_t i = 0; i < batch.Size(); i++) {
+                assert(std::get<int32_t>(batch[i].doc.elements["k"]) == expected_k++);
+            }
+        }
+        batch_index.Close();
+        assert(expected_k == 1401);
+
+        // Several key ranges, scanned one after the other
+        std::vector<KeyRange> ranges(2);
+        IndexKey::Encode(int32_t(10), &ranges[0].first);
+        IndexKey::Encode(int32_t(12), &ranges[0].second);
+        IndexKey::Encode(int32_t(2000), &ranges[1].first);
+        IndexKey::Encode(int32_t(2000), &ranges[1].second);
+        IndexScanExecutor multi_index(rows->indexes[0].btree.get(), rows->heap_file.get(), ranges);
+        std::vector<int> multi_k;
+        multi_index.Init();
+        while (multi_index.Next(&tuple)) multi_k.push_back(std::get<int32_t>(tuple.doc.elements["k"]));
+        multi_index.Close();
+        assert((multi_k == std::vector<int>{10, 11, 12, 2000}));
+
+        // RowFormat::BYTES: every executor hands out the stored bytes
+        // untouched, the filter evaluating them in place
+        auto view_of = [](const Tuple& t) { return BsonView(t.bytes.data(), t.bytes.size()); };
+        auto k_of = [&view_of](const Tuple& t) {
+            BsonElementView k;
+            assert(view_of(t).Find("k", &k));
+            return k.AsInt32();
+        };
+        auto same_bytes = [&view_of](const Tuple& t) {
+            return t.bytes == BsonSerializer::Serialize(view_of(t).ToDocument());
+        };
+        FilterExecutor bytes_filter(std::make_unique<SeqScanExecutor>(rows->heap_file.get()), {every_third, below});
+        bytes_filter.SetRowFormat(RowFormat::BYTES);
+        bytes_filter.Init();
+        size_t bytes_selected = 0;
+        while (bytes_filter.NextBatch(&batch)) {
+            for (size_t i = 0; i < batch.Size(); i++) {
+                assert(same_bytes(batch[i]));
+                assert(k_of(batch[i]) % 3 == 0);
+            }
+            bytes_selected += batch.Size();
+        }
+        bytes_filter.Close();
+        assert(bytes_selected == selected);
+
+        IndexScanExecutor bytes_index(rows->indexes[0].btree.get(), rows->heap_file.get(), ranges);
+        bytes_index.SetRowFormat(RowFormat::BYTES);
+        bytes_index.Init();
+        std::vector<int> bytes_k;
+        while (bytes_index.Next(&tuple)) {
+            assert(same_bytes(tuple));
+            assert(tuple.bytes == BsonSerializer::Serialize(rows->heap_file->GetRecord(tuple.rid)));
+            bytes_k.push_back(k_of(tuple));
+        }
+        bytes_index.Close();
+        assert(bytes_k == multi_k);
+
+        // Limit stops pulling once it has its rows; projection keeps the
+        // fields asked for, from documents and from stored bytes alike
+        for (RowFormat format : {RowFormat::DOCUMENT, RowFormat::BYTES}) {
+            auto scan = std::make_unique<FilterExecutor>(std::make_unique<SeqScanExecutor>(rows->heap_file.get()),
+                                                         std::vector<Predicate>{every_third});
+            auto limited = std::make_unique<LimitExecutor>(std::move(scan), 100, 5);
+            ProjectionExecutor projected(std::move(limited), {"k"}, true);
+            projected.SetRowFormat(format);
+            projected.Init();
+            std::vector<int> limit_k;
+            while (projected.Next(&tuple)) {
+                BsonDocument doc = format == RowFormat::BYTES
+                                       ? BsonView(tuple.bytes.data(), tuple.bytes.size()).ToDocument()
+                                       : tuple.doc;
+                assert(doc.elements.size() == 1);
+                limit_k.push_back(std::get<int32_t>(doc.elements["k"]));
+            }
+            projected.Close();
+            assert((limit_k == std::vector<int>{300, 303, 306, 309, 312}));
+        }
+        LimitExecutor past_end(std::make_unique<SeqScanExecutor>(rows->heap_file.get()), 2498, 10);
+        past_end.Init();
+        size_t past_rows = 0;
+        while (past_end.NextBatch(&batch)) past_rows += batch.Size();
+        past_end.Close();
+        assert(past_rows == 2);
+
+        BsonDocument wide;
+        wide.Add("a", int32_t(1));
+        wide.Add("b", std::string("two"));
+        wide.Add("c", 3.0);
+        std::vector<uint8_t> wide_bytes = BsonSerializer::Serialize(wide), cut;
+        BsonView(wide_bytes.data(), wide_bytes.size()).CopyFields([](std::string_view k) { return k != "b"; }, &cut);
+        BsonDocument cut_doc = BsonSerializer::Deserialize(cut.data(), cut.size());
+        assert(cut_doc.elements.size() == 2 && cut_doc.elements.count("a") && cut_doc.elements.count("c"));
+    }
+    std::remove("test_batches.db");
+    std::cout << "✓ Batched execution: scans fill 1024-row batches, filters narrow a selection vector, "
+              << "rows come as documents or stored bytes, limit and projection on top" << std::endl;
+
+    // ---- Parallel scan ----
+    {
+        DBConfigs par_config;
+        par_config.db_file_name = "test_parallel.db";
+        std::remove(par_config.db_file_name.c_str());
+        DiskManager par_disk(par_config);
+        BufferPoolManager par_bpm(64, &par_disk);
+        Catalog par_catalog(&par_bpm);
+        page_id_t catalog_page;
+        par_bpm.NewPage(&catalog_page);
+        par_bpm.UnpinPage(catalog_page, true);
+        assert(par_catalog.CreateCollection("rows"));
+        HeapFile* par_heap = par_catalog.GetCollection("rows")->heap_file.get();
+        const int num_docs = 20000;
+        for (int i = 0; i < num_docs; i++) {
+            BsonDocument d;
+            d.Add("k", int32_t(i));
+            d.Add("m", int32_t(i % 7));
+            par_heap->InsertRecord(d);
+        }
+        uint32_t par_pages;
+        par_heap->GetExtents(&par_pages);
+        assert(par_pages > 3 * ParallelSeqScanExecutor::MORSEL_PAGES);
+        assert(ParallelSeqScanExecutor::Worthwhile(par_pages, 4) && !ParallelSeqScanExecutor::Worthwhile(par_pages, 1));
+
+        // Every record exactly once, with or without a pushed-down predicate
+        for (bool filtered : {false, true}) {
+            std::vector<Predicate> preds;
+            if (filtered) preds.push_back(Predicate{"m", CompareOp::EQ, int32_t(3)});
+            ParallelSeqScanExecutor par_scan(par_heap, preds, 4);
+            par_scan.Init();
+            TupleBatch batch;
+            std::vector<bool> seen_k(num_docs, false);
+            int total = 0;
+            while (par_scan.NextBatch(&batch)) {
+                for (size_t i = 0; i < batch.Size(); i++) {
+                    int k = std::get<int32_t>(batch[i].doc.elements["k"]);
+                    assert(!seen_k[k] && (!filtered || k % 7 == 3));
+                    seen_k[k] = true;
+                    total++;
+                }
+            }
+            par_scan.Close();
+            assert(total == (filtered ? (num_docs - 3 + 6) / 7 : num_docs));
+        }
+
+        // Row at a time, and closed early while workers are still producing
+        ParallelSeqScanExecutor early(par_heap, FilterExpr(), 4);
+        early.Init();
+        for (int i = 0; i < 10; i++) assert(early.Next(&tuple));
+        early.Close();
+        early.Init();  // Reusable after Close
+        int rescan = 0;
+        while (early.Next(&tuple)) rescan++;
+        assert(rescan == num_docs);
+    }
+    std::remove("test_parallel.db");
+    std::cout << "✓ Parallel scan: morsels over 4 workers, each record once, early close" << std::endl;
+
+    // ---- Cost-based planner ----
+    {
+        DBConfigs plan_config;
+        plan_config.db_file_name = "test_planner.db";
+        std::remove(plan_config.db_file_name.c_str());
+        DiskManager plan_disk(plan_config);
+        BufferPoolManager plan_bpm(128, &plan_disk);
+        Catalog plan_catalog(&plan_bpm);
+        page_id_t catalog_page;
+        plan_bpm.NewPage(&catalog_page);
+        plan_bpm.UnpinPage(catalog_page, true);
+        assert(plan_catalog.CreateCollection("grid"));
+        CollectionInfo* grid = plan_catalog.GetCollection("grid");
+        const int num_docs = 20000;
+        auto insert_docs = [&](int from, int to) {
+            for (int i = from; i < to; i++) {
+                BsonDocument d;
+                d.Add("id", int32_t(i));
+                d.Add("x", int32_t(i % 50));
+                d.Add("y", int32_t(i / 50 % 50));
+                d.Add("tag", std::string(i % 2 ? "odd" : "even"));
+                grid->heap_file->InsertRecord(d);
+            }
+        };
+        insert_docs(0, num_docs);
+        for (const char* field : {"id", "x", "y"}) assert(plan_catalog.CreateIndex("grid", field));
+        assert(plan_catalog.Analyze("grid"));
+        assert(grid->stats.row_count == num_docs);
+        assert(grid->indexes[1].stats.num_entries == num_docs && grid->indexes[1].stats.distinct_keys == 50);
+        assert(grid->indexes[0].stats.distinct_keys == num_docs);
+
+        Planner planner(grid, plan_bpm.GetPageSize());
+        auto eq = [](const char* field, int32_t v) { return FilterExpr::Compare(field, CompareOp::EQ, v); };
+        FilterExpr by_id = eq("id", 4321);
+        FilterExpr by_tag = FilterExpr::Compare("tag", CompareOp::EQ, std::string("odd"));
+        FilterExpr one_cell = FilterExpr::And({eq("x", 7), eq("y", 3)});
+        FilterExpr low_ids = FilterExpr::Compare("id", CompareOp::LT, int32_t(2000));
+        FilterExpr wide = FilterExpr::Compare("x", CompareOp::GE, int32_t(10));
+
+        // Estimates from the histograms
+        assert(std::abs(planner.Selectivity(low_ids) - 0.1) < 0.03);
+        assert(std::abs(planner.Selectivity(wide) - 0.8) < 0.05);
+        assert(planner.Selectivity(one_cell) < 0.001);
+
+        // A key lookup and a very selective pair use indexes; a wide range
+        // and an unindexed field scan the heap
+        assert(planner.Choose(by_id).type == AccessPath::Type::INDEX_SCAN);
+        assert(planner.Choose(by_id).indexes[0].index->field_name == "id");
+        assert(planner.Choose(one_cell).type == AccessPath::Type::INDEX_INTERSECTION);
+        assert(planner.Choose(wide).type == AccessPath::Type::SEQ_SCAN);
+        assert(planner.Choose(by_tag).type == AccessPath::Type::SEQ_SCAN);
+        assert(planner.Choose(FilterExpr()).type == AccessPath::Type::SEQ_SCAN);
+
+        // Whatever the path, the same documents
+        for (const FilterExpr* filter : {&by_id, &one_cell, &low_ids, &wide}) {
+            std::vector<AccessPath> paths = planner.Enumerate(*filter);
+            assert(paths.size() >= 2);
+            std::vector<int> expected;
+            for (const AccessPath& path : paths) {
+                std::unique_ptr<Executor> plan = planner.Build(path, *filter);
+                std::vector<int> ids;
+                plan->Init();
+                while (plan->Next(&tuple)) ids.push_back(std::get<int32_t>(tuple.doc.elements["id"]));
+                plan->Close();
+                std::sort(ids.begin(), ids.end());
+                if (&path == &paths.front()) expected = ids;
+                assert(ids == expected);
+            }
+            assert(!expected.empty());
+        }
+
+        // Counts: the heap's counter, an index's keys alone, or a scan
+        assert(planner.Count(FilterExpr()) == num_docs);
+        std::vector<KeyRange> ranges;
+        FilterExpr x_or = FilterExpr::Or({eq("x", 3), FilterExpr::Compare("x", CompareOp::GT, 47.5)});
+        FilterExpr x_ne = FilterExpr::And({wide, FilterExpr::Compare("x", CompareOp::NE, int32_t(20))});
+        assert(planner.CoveringIndex(low_ids, &ranges) == &grid->indexes[0]);
+        assert(planner.CoveringIndex(x_or, &ranges) == &grid->indexes[1] && ranges.size() == 1);
+        assert(!planner.CoveringIndex(one_cell, &ranges) && !planner.CoveringIndex(by_tag, &ranges));
+        assert(planner.Count(low_ids) == 2000 && planner.Count(x_or) == 3 * num_docs / 50);
+        assert(planner.Count(x_ne) == 39 * num_docs / 50 && planner.Count(by_tag) == num_docs / 2);
+        assert(planner.Count(one_cell) == num_docs / 2500);
+
+        // The row count follows the heap, analyzed or not
+        insert_docs(num_docs, 2 * num_docs);
+        Planner grown(grid, plan_bpm.GetPageSize());
+        assert(grown.EstimateRows() == 2 * num_docs);
+    }
+    std::remove("test_planner.db");
+    std::cout << "✓ Planner: histograms, index scan vs intersection vs seq scan, same results" << std::endl;
+
+    // ---- Per-collection extents ----
+    {
+        DBConfigs ext_config;
+        ext_config.db_file_name = "test_extents.db";
+        std::remove(ext_config.db_file_name.c_str());
+        auto count_docs = [](HeapFile* heap, const std::string& coll) {
+            int n = 0;
+            HeapFile::Iterator it = heap->Begin();
+            RecordID rid;
+            BsonDocument d;
+            while (it.Next(&rid, &d)) {
+                assert(std::get<std::string>(d.elements["coll"]) == coll);
+                n++;
+            }
+            return n;
+        };
+        {
+            DiskManager ext_disk(ext_config);
+            BufferPoolManager ext_bpm(64, &ext_disk);
+            Catalog ext_catalog(&ext_bpm);
+            page_id_t catalog_page;
+            ext_bpm.NewPage(&catalog_page);
+            ext_bpm.UnpinPage(catalog_page, true);
+            assert(ext_catalog.CreateCollection("a"));
+            assert(ext_catalog.CreateCollection("b"));
+            assert(ext_catalog.CreateIndex("b", "k"));
+            HeapFile* a = ext_catalog.GetCollection("a")->heap_file.get();
+            HeapFile* b = ext_catalog.GetCollection("b")->heap_file.get();
+
+            // Interleaved with b's heap and index pages, a's pages stay its own
+            for (int i = 0; i < 2000; i++) {
+                for (auto [heap, coll] : {std::pair{a, "a"}, std::pair{b, "b"}}) {
+                    BsonDocument d;
+                    d.Add("coll", std::string(coll));
+                    d.Add("k", int32_t(i));
+                    d.Add("pad", std::string(200, 'x'));
+                    RecordID rid = heap->InsertRecord(d);
+                    if (coll == std::string("b")) {
+                        std::string key;
+                        IndexKey::Encode(int32_t(i), &key);
+                        ext_catalog.GetCollection("b")->indexes[0].btree->Insert(key, rid);
+                    }
+                }
+            }
+            assert(count_docs(a, "a") == 2000 && count_docs(b, "b") == 2000);
+
+            uint32_t num_pages;
+            std::vector<HeapExtent> extents = a->GetExtents(&num_pages);
+            assert(extents.size() == 2 && num_pages > HeapFile::FIRST_EXTENT_PAGES);
+            assert(extents[0].num_pages == HeapFile::FIRST_EXTENT_PAGES);
+            assert(extents[1].num_pages == 2 * HeapFile::FIRST_EXTENT_PAGES);
+            assert(extents[0].first_page == a->GetFirstPageId());
+
+            ext_catalog.SaveCatalog();
+
+            // Pages added after the save, within the saved extents
+            for (int i = 0; i < 300; i++) {
+                BsonDocument d;
+                d.Add("coll", std::string("a"));
+                d.Add("pad", std::string(200, 'x'));
+                a->InsertRecord(d);
+            }
+            ext_bpm.FlushAllPages();
+        }
+        {
+            DiskManager ext_disk(ext_config);
+            BufferPoolManager ext_bpm(64, &ext_disk);
+            Catalog ext_catalog(&ext_bpm);
+            ext_catalog.LoadCatalog();
+            assert(count_docs(ext_catalog.GetCollection("a")->heap_file.get(), "a") == 2300);
+            assert(ext_catalog.GetCollection("a")->DocumentCount() == 2300);  // Recounted
+            // Not saved as final, as after a crash: b's index is rebuilt from its heap
+            CollectionInfo* b = ext_catalog.GetCollection("b");
+            Planner b_planner(b, ext_bpm.GetPageSize());
+            FilterExpr all_k = FilterExpr::Compare("k", CompareOp::GE, int32_t(0));
+            assert(b->indexes[0].stats.num_entries == 2000 && b_planner.Count(all_k) == 2000);
+            assert(count_docs(ext_catalog.GetCollection("b")->heap_file.get(), "b") == 2000);
+        }
+        std::remove(ext_config.db_file_name.c_str());
+    }
+    std::cout << "✓ Per-collection extents: scans see only their own pages, list survives reopen"
+              << std::endl;
+
+    // ---- Multi-page catalog ----
+    {
+        DBConfigs cat_config;
+        cat_config.db_file_name = "test_catalog.db";
+        std::remove(cat_config.db_file_name.c_str());
+        auto coll_name = [](int i) { return "c" + std::to_string(i) + "_" + std::string(200, 'n'); };
+        page_id_t index_root;
+        {
+            DiskManager cat_disk(cat_config);
+            BufferPoolManager cat_bpm(64, &cat_disk);
+            Catalog cat_catalog(&cat_bpm);
+            page_id_t catalog_page;
+            cat_bpm.NewPage(&catalog_page);
+            cat_bpm.UnpinPage(catalog_page, true);
+
+            // 150 entries of 300+ bytes: the catalog spans several pages
+            for (int i = 0; i < 150; i++) {
+                assert(cat_catalog.CreateCollection(coll_name(i)));
+                HeapFile* heap = cat_catalog.GetCollection(coll_name(i))->heap_file.get();
+                for (int j = 0; j < (i == 0 ? 500 : i + 1); j++) {
+                    BsonDocument d;
+                    d.Add("k", int32_t(j));
+                    heap->InsertRecord(d);
+                }
+            }
+            assert(!cat_catalog.CreateCollection(coll_name(3)));
+            assert(cat_catalog.CreateIndex(coll_name(0), "k"));
+            index_root = cat_catalog.GetCollection(coll_name(0))->indexes[0].btree->GetRootPageId();
+            for (int i = 5; i < 150; i += 10) assert(cat_catalog.DropCollection(coll_name(i)));
+            cat_catalog.SaveCatalog(/*final=*/true);
+        }
+        {
+            DiskManager cat_disk(cat_config);
+            BufferPoolManager cat_bpm(64, &cat_disk);
+            Catalog cat_catalog(&cat_bpm);
+            cat_catalog.LoadCatalog();
+            assert(cat_catalog.ListCollections().size() == 135);
+            assert(!cat_catalog.GetCollection(coll_name(15)));
+            assert(cat_catalog.GetCollection(coll_name(7))->DocumentCount() == 8);
+
+            // Closed cleanly: the saved index and counts are used as they are
+            CollectionInfo* c0 = cat_catalog.GetCollection(coll_name(0));
+            Planner c0_planner(c0, cat_bpm.GetPageSize());
+            FilterExpr all_k = FilterExpr::Compare("k", CompareOp::GE, int32_t(0));
+            assert(c0->indexes[0].btree_root_page == index_root && c0->DocumentCount() == 500);
+            assert(c0_planner.Count(all_k) == 500);
+            assert(cat_catalog.CreateCollection("later"));
+            // Not saved as final: c0 and c7 were in use when it "crashed"
+        }
+        {
+            DiskManager cat_disk(cat_config);
+            BufferPoolManager cat_bpm(64, &cat_disk);
+            Catalog cat_catalog(&cat_bpm);
+            cat_catalog.LoadCatalog();
+            assert(cat_catalog.ListCollections().size() == 136 && cat_catalog.GetCollection("later"));
+            CollectionInfo* c0 = cat_catalog.GetCollection(coll_name(0));
+            assert(c0->indexes[0].btree_root_page != index_root && c0->indexes[0].stats.num_entries == 500);
+            assert(c0->DocumentCount() == 500);
+            assert(cat_catalog.GetCollection(coll_name(7))->DocumentCount() == 8);
+            assert(cat_catalog.GetCollection(coll_name(149))->DocumentCount() == 150);
+        }
+        std::remove(cat_config.db_file_name.c_str());
+    }
+    std::cout << "✓ Multi-page catalog: per-collection entries, opened on first use, rebuilt when unclean"
+              << std::endl;
+
+    // ---- Multi-level FSM ----
+    {
+        DBConfigs fsm_config;
+        fsm_config.db_file_name = "test_fsm.db";
+        std::remove(fsm_config.db_file_name.c_str());
+        {
+            DiskManager fsm_disk(fsm_config);
+            BufferPoolManager fsm_bpm(32, &fsm_disk);
+            page_id_t root_id;
+            Page* root = fsm_bpm.NewPage(&root_id);
+            std::memset(root->GetData(), 0, fsm_bpm.GetPageSize());
+            fsm_bpm.UnpinPage(root_id, true);
+            FreeSpaceMap fsm(&fsm_bpm, root_id);
+
+            // Several leaves' worth of heap pages, nearly all full
+            const uint32_t n = fsm.GetLeafSlots() * 3 + 7;
+            for (uint32_t i = 0; i < n; i++) fsm.RegisterNewPage(i, 0);
+            assert(fsm.FindPageWithSpace(100) == FreeSpaceMap::NO_PAGE);
+            fsm.UpdateFreeSpace(100, 2000);
+            fsm.UpdateFreeSpace(n - 1, 2000);
+            assert(fsm.FindPageWithSpace(1000) == 100);
+            assert(fsm.FindPageWithSpace(1000, 101) == n - 1);  // Searches from the hint
+            assert(fsm.FindPageWithSpace(1000, n) == 100);      // ... wrapping around
+            assert(fsm.FindPageWithSpace(3000) == FreeSpaceMap::NO_PAGE);
+            fsm.UpdateFreeSpace(n - 1, 50);
+            assert(fsm.FindPageWithSpace(1000, 101) == 100);
+            fsm.UpdateFreeSpace(100, 0);
+            assert(fsm.FindPageWithSpace(1000) == FreeSpaceMap::NO_PAGE);
+            assert(fsm.FindPageWithSpace(40) == n - 1);
+        }
+        std::remove(fsm_config.db_file_name.c_str());
+
+        // A heap past one leaf page still finds, and reuses, free space
+        fsm_config.db_file_name = "test_fsm_heap.db";
+        std::remove(fsm_config.db_file_name.c_str());
+        {
+            DiskManager fsm_disk(fsm_config);
+            BufferPoolManager fsm_bpm(64, &fsm_disk);
+            Catalog fsm_catalog(&fsm_bpm);
+            page_id_t catalog_page;
+            fsm_bpm.NewPage(&catalog_page);
+            fsm_bpm.UnpinPage(catalog_page, true);
+            assert(fsm_catalog.CreateCollection("wide"));
+            HeapFile* wide = fsm_catalog.GetCollection("wide")->heap_file.get();
+
+            const int pages = 4500;  // One ~3 KB record per page
+            std::vector<RecordID> rids;
+            for (int i = 0; i < pages; i++) {
+                BsonDocument d;
+                d.Add("pad", std::string(3000, 'x'));
+                rids.push_back(wide->InsertRecord(d));
+            }
+            uint32_t num_pages;
+            wide->GetExtents(&num_pages);
+            assert(num_pages == static_cast<uint32_t>(pages));
+
+            // Room left on the last page (past the first leaf) is found from
+            // this inserter's hint; from the start, the first page is found
+            BsonDocument small;
+            small.Add("pad", std::string(500, 'y'));
+            assert(wide->InsertRecord(small).page_id == rids.back().page_id);
+            assert(fsm_catalog.GetCollection("wide")->fsm->FindPageWithSpace(500) == 0);
+            wide->GetExtents(&num_pages);
+            assert(num_pages == static_cast<uint32_t>(pages));
+        }
+        std::remove(fsm_config.db_file_name.c_str());
+    }
+    std::cout << "✓ Multi-level FSM: spans many leaf pages, searches from a hint" << std::endl;
+
+    // ---- Page compaction + forwarding stubs ----
+    {
+        DBConfigs fwd_config;
+        fwd_config.db_file_name = "test_forward.db";
+        std::remove(fwd_config.db_file_name.c_str());
+        {
+            DiskManager fwd_disk(fwd_config);
+            BufferPoolManager fwd_bpm(64, &fwd_disk);
+
+            // A page riddled with holes takes a record as big as their sum
+            page_id_t sp_id;
+            Page* sp = fwd_bpm.NewPage(&sp_id);
+            char* spd = sp->GetData();
+            SlottedPage::Init(spd, fwd_bpm.GetPageSize());
+            std::vector<uint8_t> rec(300, 0xAB);
+            std::vector<int16_t> slots;
+            int16_t s;
+            while ((s = SlottedPage::InsertRecord(spd, rec.data(), rec.size())) >= 0) slots.push_back(s);
+            for (size_t i = 0; i < slots.size(); i += 2) SlottedPage::DeleteRecord(spd, slots[i]);
+            std::vector<uint8_t> big(900, 0xCD);
+            int16_t big_slot = SlottedPage::InsertRecord(spd, big.data(), big.size());
+            assert(big_slot == slots[0]);  // Reuses the first empty slot
+            uint16_t len;
+            assert(SlottedPage::GetRecord(spd, slots[1], &len)[0] == 0xAB && len == 300);
+            assert(SlottedPage::GetRecord(spd, big_slot, &len)[899] == 0xCD && len == 900);
+            // ... and a record grows in place into the holes
+            std::vector<uint8_t> bigger(1200, 0xEF);
+            assert(SlottedPage::UpdateRecord(spd, slots[1], bigger.data(), bigger.size()));
+            assert(SlottedPage::GetRecord(spd, slots[1], &len)[1199] == 0xEF && len == 1200);
+            fwd_bpm.UnpinPage(sp_id, true);
+
+            Catalog fwd_catalog(&fwd_bpm);
+            page_id_t catalog_page;
+            fwd_bpm.NewPage(&catalog_page);
+            fwd_bpm.UnpinPage(catalog_page, true);
+            assert(fwd_catalog.CreateCollection("f"));
+            HeapFile* heap = fwd_catalog.GetCollection("f")->heap_file.get();
+
+            std::vector<RecordID> rids;
+            for (int i = 0; i < 200; i++) {
+                BsonDocument d;
+                d.Add("k", int32_t(i));
+                d.Add("pad", std::string(100, 'x'));
+                rids.push_back(heap->InsertRecord(d));
+            }
+            auto scan = [&](std::map<int32_t, RecordID>* seen) {
+                HeapFile::Iterator it = heap->Begin();
+                RecordID rid;
+                BsonDocument d;
+                while (it.Next(&rid, &d)) {
+                    int32_t k = std::get<int32_t>(d.elements["k"]);
+                    assert(seen->emplace(k, rid).second);  // Visited once
+                }
+            };
+
+            // Growing past its page leaves a stub: the RecordID is kept
+            BsonDocument grown;
+            grown.Add("k", int32_t(7));
+            grown.Add("pad", std::string(3000, 'g'));
+            assert(heap->UpdateRecord(rids[7], grown) == rids[7]);
+            BsonDocument got = heap->GetRecord(rids[7]);
+            assert(std::get<std::string>(got.elements["pad"]).size() == 3000);
+
+            // Moving again, and shrinking back home, keep it too
+            grown.elements["pad"] = std::string(3500, 'h');
+            assert(heap->UpdateRecord(rids[7], grown) == rids[7]);
+            grown.elements["pad"] = std::string(10, 's');
+            assert(heap->UpdateRecord(rids[7], grown) == rids[7]);
+            got = heap->GetRecord(rids[7]);
+            assert(std::get<std::string>(got.elements["pad"]) == std::string(10, 's'));
+
+            grown.elements["k"] = int32_t(8);
+            grown.elements["pad"] = std::string(3000, 'g');
+            assert(heap->UpdateRecord(rids[8], grown) == rids[8]);
+            std::map<int32_t, RecordID> seen;
+            scan(&seen);
+            assert(seen.size() == 200 && seen[8] == rids[8] && seen[7] == rids[7]);
+
+            // Deleting a forwarded record removes the stub and the document
+            assert(heap->DeleteRecord(rids[8]));
+            bool deleted = false;
+            try {
+                heap->GetRecord(rids[8]);
+            } catch (const std::runtime_error&) {
+                deleted = true;
+            }
+            assert(deleted);
+            seen.clear();
+            scan(&seen);
+            assert(seen.size() == 199 && seen.count(8) == 0);
+
+            // Updates that keep resizing records reuse the space they free
+            uint32_t pages_before;
+            heap->GetExtents(&pages_before);
+            for (int round = 0; round < 20; round++) {
+                for (int i = 20; i < 120; i++) {
+                    BsonDocument d;
+                    d.Add("k", int32_t(i));
+                    d.Add("pad", std::string(round % 2 ? 50 : 150, 'r'));
+                    assert(heap->UpdateRecord(rids[i], d) == rids[i]);
+                }
+            }
+            uint32_t pages_after;
+            heap->GetExtents(&pages_after);
+            assert(pages_after <= pages_before + 1);
+        }
+        std::remove(fwd_config.db_file_name.c_str());
+    }
+    std::cout << "✓ Page compaction: holes and empty slots reused; growing updates keep their RID"
+              << std::endl;
+
+    // ---- Out-of-line values ----
+    {
+        DBConfigs ool_config;
+        ool_config.db_file_name = "test_overflow.db";
+        std::remove(ool_config.db_file_name.c_str());
+        auto blob = [](int i) { return std::string(20000, static_cast<char>('a' + i % 26)); };
+        std::vector<RecordID> rids;
+        std::array<uint64_t, 3> counts;  // Documents, heap bytes, overflow bytes
+        {
+            DiskManager ool_disk(ool_config);
+            BufferPoolManager ool_bpm(64, &ool_disk);
+            Catalog ool_catalog(&ool_bpm);
+            page_id_t catalog_page;
+            ool_bpm.NewPage(&catalog_page);
+            ool_bpm.UnpinPage(catalog_page, true);
+            assert(ool_catalog.CreateCollection("big"));
+            CollectionInfo* big = ool_catalog.GetCollection("big");
+
+            for (int i = 0; i < 20; i++) {
+                BsonDocument d;
+                d.Add("k", int32_t(i));
+                d.Add("blob", i % 2 == 0 ? blob(i) : std::string("small"));
+                if (i == 3) {
+                    auto sub = std::make_shared<BsonDocument>();
+                    sub->Add("text", std::string(6000, 's'));
+                    d.Add("sub", sub);
+                    auto list = std::make_shared<BsonDocument>();
+                    list->is_array = true;
+                    for (int j = 0; j < 1000; j++) list->Add(std::to_string(j), int32_t(j));
+                    d.Add("list", list);
+                }
+                rids.push_back(big->heap_file->InsertRecord(d));
+            }
+            BsonDocument got = big->heap_file->GetRecord(rids[4]);
+            assert(std::get<std::string>(got.elements["blob"]) == blob(4));
+            got = big->heap_file->GetRecord(rids[3]);
+            auto sub = std::get<std::shared_ptr<BsonDocument>>(got.elements["sub"]);
+            assert(std::get<std::string>(sub->elements["text"]).size() == 6000);
+            // An array moved out of line comes back as one
+            auto list = std::get<std::shared_ptr<BsonDocument>>(got.elements["list"]);
+            assert(list->is_array && list->elements.size() == 1000);
+            assert(Json::ToString(got).find(R"("list":[0,1,2,)") != std::string::npos);
+
+            // Ten 20 KB values take several chunk pages each; the documents
+            // themselves share a page
+            uint32_t overflow_pages, heap_pages;
+            big->overflow_heap->GetExtents(&overflow_pages);
+            big->heap_file->GetExtents(&heap_pages);
+            assert(overflow_pages >= 50 && heap_pages == 1);
+
+            // A filter on an out-of-line value fetches it ...
+            Predicate on_blob{"blob", CompareOp::EQ, blob(6)};
+            SeqScanExecutor blob_scan(big->heap_file.get(), {on_blob});
+            blob_scan.Init();
+            Tuple t;
+            assert(blob_scan.Next(&t) && std::get<int32_t>(t.doc.elements["k"]) == 6);
+            assert(!blob_scan.Next(&t));
+            blob_scan.Close();
+
+            // As bytes, its out-of-line value is fetched back in
+            SeqScanExecutor blob_bytes(big->heap_file.get(), {on_blob});
+            blob_bytes.SetRowFormat(RowFormat::BYTES);
+            blob_bytes.Init();
+            assert(blob_bytes.Next(&t));
+            assert(t.bytes == BsonSerializer::Serialize(big->heap_file->GetRecord(t.rid)));
+            BsonElementView blob_value;
+            assert(BsonView(t.bytes.data(), t.bytes.size()).Find("blob", &blob_value));
+            assert(blob_value.type == BsonType::STRING && blob_value.AsString() == blob(6));
+            blob_bytes.Close();
+
+            // ... one on small fields never does: it runs without the overflow heap
+            big->heap_file->SetOverflowHeap(nullptr);
+            Predicate on_k{"k", CompareOp::LT, int32_t(10)};
+            HeapFile::Iterator it = big->heap_file->Begin();
+            RecordID rid;
+            int matched = 0;
+            while (it.Next(&rid, nullptr, [&on_k](const BsonView& v) { return on_k.Evaluate(v); })) matched++;
+            assert(matched == 10);
+            big->heap_file->SetOverflowHeap(big->overflow_heap.get());
+
+            // Growing past a page moves values out, keeping the RecordID;
+            // shrinking, updating and deleting free the chains for reuse
+            BsonDocument grown;
+            grown.Add("k", int32_t(1));
+            grown.Add("blob", blob(1));
+            assert(big->heap_file->UpdateRecord(rids[1], grown) == rids[1]);
+            assert(std::get<std::string>(big->heap_file->GetRecord(rids[1]).elements["blob"]) == blob(1));
+            big->overflow_heap->GetExtents(&overflow_pages);
+            for (int round = 0; round < 3; round++) {
+                for (int i = 0; i < 20; i += 2) {
+                    BsonDocument d;
+                    d.Add("k", int32_t(i));
+                    d.Add("blob", blob(i + round));
+                    assert(big->heap_file->UpdateRecord(rids[i], d) == rids[i]);
+                }
+                for (int i = 10; i < 20; i += 2) assert(big->heap_file->DeleteRecord(rids[i]));
+                for (int i = 10; i < 20; i += 2) {
+                    BsonDocument d;
+                    d.Add("k", int32_t(i));
+                    d.Add("blob", blob(i));
+                    rids[i] = big->heap_file->InsertRecord(d);
+                }
+            }
+            uint32_t overflow_pages_after;
+            big->overflow_heap->GetExtents(&overflow_pages_after);
+            // An update writes its new chain before freeing the old one
+            assert(overflow_pages_after <= overflow_pages + 6);
+
+            // The counters kept through all of that match the pages
+            counts = {big->DocumentCount(), big->heap_file->GetRecordBytes(), big->overflow_heap->GetRecordBytes()};
+            assert(counts[0] == 20 && counts[2] > 10 * 20000);
+            big->heap_file->Recount();
+            big->overflow_heap->Recount();
+            assert(big->DocumentCount() == counts[0] && big->heap_file->GetRecordBytes() == counts[1] &&
+                   big->overflow_heap->GetRecordBytes() == counts[2]);
+
+            ool_catalog.SaveCatalog();
+            ool_bpm.FlushAllPages();
+        }
+        for (int reopen = 0; reopen < 3; reopen++) {
+            // Recounted after the plain save, then taken as saved after the
+            // final one, then recounted again: loading clears the mark
+            DiskManager ool_disk(ool_config);
+            BufferPoolManager ool_bpm(64, &ool_disk);
+            Catalog ool_catalog(&ool_bpm);
+            ool_catalog.LoadCatalog();
+            CollectionInfo* big = ool_catalog.GetCollection("big");
+            HeapFile* heap = big->heap_file.get();
+            assert(std::get<std::string>(heap->GetRecord(rids[8]).elements["blob"]) == blob(10));
+            assert(std::get<std::string>(heap->GetRecord(rids[12]).elements["blob"]) == blob(12));
+            assert(big->DocumentCount() == counts[0] && heap->GetRecordBytes() == counts[1] &&
+                   big->overflow_heap->GetRecordBytes() == counts[2]);
+            if (reopen == 0) ool_catalog.SaveCatalog(/*final=*/true);
+            ool_bpm.FlushAllPages();
+        }
+        std::remove(ool_config.db_file_name.c_str());
+    }
+    std::cout << "✓ Out-of-line values: large documents spill to overflow chains, fetched on demand"
+              << std::endl;
+
+    // ---- Page compression ----
+    {
+        // A slotted page of similar documents shrinks well; noise round-trips
+        std::vector<char> page_bytes(4096);
+        SlottedPage::Init(page_bytes.data(), 4096);
+        for (int i = 0;; i++) {
+            BsonDocument d;
+            d.Add("name", std::string("User_") + std::to_string(i));
+            d.Add("email", std::string("user") + std::to_string(i) + "@example.com");
+            d.Add("age", int32_t(20 + i % 50));
+            std::vector<uint8_t> bytes = BsonSerializer::Serialize(d);
+            if (SlottedPage::InsertRecord(page_bytes.data(), bytes.data(), bytes.size()) < 0) break;
+        }
+        std::vector<uint8_t> packed(4096), unpacked(4096);
+        size_t packed_size = PageCompressor::Compress(reinterpret_cast<const uint8_t*>(page_bytes.data()), 4096,
+                                                      packed.data(), packed.size());
+        assert(packed_size > 0 && packed_size < 2048);
+        assert(PageCompressor::Decompress(packed.data(), packed_size, unpacked.data(), 4096));
+        assert(std::memcmp(unpacked.data(), page_bytes.data(), 4096) == 0);
+        assert(!PageCompressor::Decompress(packed.data(), packed_size / 2, unpacked.data(), 4096));
+
+        std::vector<uint8_t> noise(4096), noise_packed(8192);
+        uint32_t seed = 12345;
+        for (uint8_t& b : noise) b = static_cast<uint8_t>((seed = seed * 1103515245 + 12345) >> 16);
+        assert(PageCompressor::Compress(noise.data(), 4096, noise_packed.data(), 4096) == 0);
+        size_t noise_size = PageCompressor::Compress(noise.data(), 4096, noise_packed.data(), noise_packed.size());
+        assert(noise_size > 4096);
+        assert(PageCompressor::Decompress(noise_packed.data(), noise_size, unpacked.data(), 4096));
+        assert(std::memcmp(unpacked.data(), noise.data(), 4096) == 0);
+
+        // A compressed collection takes a fraction of its pages on disk and
+        // reads back the same after reopening
+        DBConfigs z_config;
+        z_config.db_file_name = "test_compressed.db";
+        auto remove_files = [&z_config] {
+            for (const char* suffix : {"", ".z", ".zmap"}) std::remove((z_config.db_file_name + suffix).c_str());
+        };
+        remove_files();
+        uint32_t heap_pages;
+        {
+            DiskManager z_disk(z_config);
+            BufferPoolManager z_bpm(32, &z_disk);
+            Catalog z_catalog(&z_bpm);
+            page_id_t catalog_page;
+            z_bpm.NewPage(&catalog_page);
+            z_bpm.UnpinPage(catalog_page, true);
+            assert(z_catalog.CreateCollection("plain"));
+            assert(z_catalog.CreateCollection("packed", true));
+            CollectionInfo* packed_coll = z_catalog.GetCollection("packed");
+            for (int i = 0; i < 3000; i++) {
+                BsonDocument d;
+                d.Add("name", std::string("User_") + std::to_string(i));
+                d.Add("email", std::string("user") + std::to_string(i) + "@example.com");
+                d.Add("age", int32_t(20 + i % 50));
+                packed_coll->heap_file->InsertRecord(d);
+            }
+            packed_coll->heap_file->GetExtents(&heap_pages);
+            z_catalog.SaveCatalog();
+            z_bpm.FlushAllPages();
+            z_bpm.SyncDisk();
+            assert(heap_pages > 20);
+            assert(z_bpm.GetCompressedBytes() > 0 &&
+                   z_bpm.GetCompressedBytes() < uint64_t(heap_pages) * z_config.page_size / 2);
+        }
+        {
+            DiskManager z_disk(z_config);
+            BufferPoolManager z_bpm(32, &z_disk);
+            Catalog z_catalog(&z_bpm);
+            z_catalog.LoadCatalog();
+            CollectionInfo* packed_coll = z_catalog.GetCollection("packed");
+            assert(packed_coll && packed_coll->compressed && !z_catalog.GetCollection("plain")->compressed);
+            SeqScanExecutor z_scan(packed_coll->heap_file.get());
+            z_scan.Init();
+            Tuple t;
+            int seen = 0;
+            std::vector<bool> seen_ids(3000, false);
+            while (z_scan.Next(&t)) {
+                std::string name = std::get<std::string>(t.doc.elements["name"]);
+                int i = std::stoi(name.substr(5));
+                assert(std::get<int32_t>(t.doc.elements["age"]) == 20 + i % 50);
+                assert(!seen_ids[i]);
+                seen_ids[i] = true;
+                seen++;
+            }
+            z_scan.Close();
+            assert(seen == 3000);
+        }
+        remove_files();
+    }
+    std::cout << "✓ Page compression: compressed heap pages shrink on disk and survive a reopen" << std::endl;
+
     // ---- 7. Test B+ Tree Index + Index Scan ----
     std::cout << "\n--- Phase 2/3: B+ Tree Index + IndexScan ---" << std::endl;
 
@@ -207,7 +1559,12 @@ int run_tests() {
     assert(name_idx != nullptr);
 
     // Exact search via B+ Tree
-    RecordID found = name_idx->btree->Search("User_5");
+    auto encode = [](const BsonValue& v) {
+        std::string key;
+        IndexKey::Encode(v, &key);
+        return key;
+    };
+    RecordID found = name_idx->btree->Search(encode(std::string("User_5")));
     assert(found.IsValid());
     BsonDocument found_doc = users->heap_file->GetRecord(found);
     assert(std::get<std::string>(found_doc.elements["name"]) == "User_5");
@@ -215,7 +1572,8 @@ int run_tests() {
     PrintDoc(found_doc);
 
     // Range scan via IndexScan executor
-    IndexScanExecutor idx_scan(name_idx->btree.get(), users->heap_file.get(), "User_1", "User_3");
+    IndexScanExecutor idx_scan(name_idx->btree.get(), users->heap_file.get(),
+                               encode(std::string("User_1")), encode(std::string("User_3")));
     idx_scan.Init();
 
     count = 0;
@@ -229,6 +1587,345 @@ int run_tests() {
     // User_1, User_10..User_19, User_2, User_3  (lexicographic order)
     std::cout << "✓ IndexScan found " << count << " records in range" << std::endl;
 
+    // Typed keys order numerically: 9 < 10, negatives first, doubles by value
+    assert(encode(int32_t(9)) < encode(int32_t(10)));
+    assert(encode(int32_t(-1)) < encode(int32_t(0)) && encode(int64_t(-5000000000)) < encode(int32_t(-1)));
+    assert(encode(int32_t(7)) == encode(int64_t(7)));
+    assert(encode(-2.5) < encode(-1.0) && encode(-1.0) < encode(0.0) && encode(0.0) < encode(1.5));
+    assert(encode(-0.0) == encode(0.0));
+    for (const BsonValue& v : {BsonValue(int64_t(-5000000000)), BsonValue(-2.5), BsonValue(1e300), BsonValue(nullptr),
+                               BsonValue(std::string("a\0b", 3)), BsonValue(std::string()), BsonValue(true)}) {
+        BsonValue decoded;
+        assert(IndexKey::Decode(encode(v), &decoded) && decoded == v);
+    }
+    BsonValue decoded;
+    assert(IndexKey::Decode(encode(int32_t(7)), &decoded) && std::get<int64_t>(decoded) == 7);
+    assert(!IndexKey::Decode(encode(std::string("ab")).substr(0, 3), &decoded));
+    {
+        assert(catalog.CreateIndex("users", "age"));
+        IndexInfo* age_idx = &users->indexes.back();
+        IndexScanExecutor age_scan(age_idx->btree.get(), users->heap_file.get(),
+                                   encode(int32_t(25)), encode(int32_t(30)));
+        age_scan.Init();
+        int expected_age = 25;
+        while (age_scan.Next(&tuple)) {
+            assert(std::get<int32_t>(tuple.doc.elements["age"]) == expected_age++);
+        }
+        age_scan.Close();
+        assert(expected_age == 31);
+    }
+    std::cout << "✓ Typed index keys: numeric order, IndexScan on age [25, 30]" << std::endl;
+
+    // Many splits with a small fan-out: lookups, deletes and range order
+    {
+        page_id_t tree_root;
+        Page* root_page = bpm.NewPage(&tree_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(tree_root, true);
+        BPlusTree tree(&bpm, tree_root, /*max_keys_per_node=*/8);
+
+        std::vector<int> order(1000);
+        for (int i = 0; i < 1000; i++) order[i] = (i * 7919) % 1000;  // Scrambled
+        auto tree_key = [](int i) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "k%05d", i);
+            return std::string(buf);
+        };
+        for (int i : order) tree.Insert(tree_key(i), RecordID{i, static_cast<uint16_t>(i % 7)});
+        for (int i = 0; i < 1000; i++) {
+            RecordID r = tree.Search(tree_key(i));
+            assert(r.page_id == i && r.slot_id == i % 7);
+        }
+        for (int i = 0; i < 1000; i += 2) assert(tree.Delete(tree_key(i)));
+        assert(!tree.Search(tree_key(10)).IsValid() && tree.Search(tree_key(11)).IsValid());
+
+        auto range = tree.RangeScan(tree_key(100), tree_key(199));
+        assert(range.size() == 50);
+        for (size_t i = 0; i < range.size(); i++) assert(range[i].first == tree_key(101 + 2 * i));
+
+        // Churn in one leaf fills its free gap with dead cells until it compacts
+        for (int n = 0; n < 400; n++) {
+            assert(tree.Delete(tree_key(11)));
+            tree.Insert(tree_key(11), RecordID{11, 4});
+        }
+        assert(tree.RangeScan(tree_key(100), tree_key(199)).size() == 50);
+        assert(tree.Search(tree_key(11)).IsValid() && tree.Search(tree_key(13)).IsValid());
+    }
+    std::cout << "✓ B+ Tree in-page nodes: 1000 keys with fan-out 8, deletes, range order" << std::endl;
+
+    // Space-based splits: long shared prefixes, keys that break a node's
+    // prefix, and the key size limit
+    {
+        page_id_t tree_root;
+        Page* root_page = bpm.NewPage(&tree_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(tree_root, true);
+        BPlusTree tree(&bpm, tree_root);
+
+        auto tree_key = [](int i) {
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "customers/eu-west/orders/%06d", i);
+            return std::string(buf);
+        };
+        for (int i = 0; i < 3000; i++) {
+            int k = (i * 7919) % 3000;
+            tree.Insert(tree_key(k), RecordID{k, 1});
+        }
+        tree.Insert("a", RecordID{-2, 1});
+        tree.Insert("zz", RecordID{-3, 1});
+        tree.Insert(std::string(tree.MaxKeySize(), 'm'), RecordID{-4, 1});
+        for (int i = 0; i < 3000; i++) assert(tree.Search(tree_key(i)).page_id == i);
+        assert(tree.Search("a").page_id == -2 && tree.Search("zz").page_id == -3);
+
+        auto range = tree.RangeScan(tree_key(0), tree_key(2999));
+        assert(range.size() == 3000);
+        for (size_t i = 1; i < range.size(); i++) assert(range[i - 1].first < range[i].first);
+        assert(tree.RangeScan("", "{").size() == 3003);
+
+        bool rejected = false;
+        try {
+            tree.Insert(std::string(tree.MaxKeySize() + 1, 'x'), RecordID{0, 0});
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+    std::cout << "✓ B+ Tree prefix compression: 3000 long keys, prefix-breaking inserts, key limit" << std::endl;
+
+    // Non-unique keys: three statuses over 1500 records, spread across many leaves
+    {
+        page_id_t tree_root;
+        Page* root_page = bpm.NewPage(&tree_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(tree_root, true);
+        BPlusTree tree(&bpm, tree_root, /*max_keys_per_node=*/16);
+
+        auto status = [&](int i) {
+            std::string key;
+            IndexKey::Encode(std::string(i % 3 == 0 ? "active" : i % 3 == 1 ? "closed" : "pending"), &key);
+            return key;
+        };
+        for (int i = 0; i < 1500; i++) {
+            int r = (i * 7919) % 1500;
+            tree.Insert(status(r), RecordID{r / 10, static_cast<uint16_t>(r % 10)});
+        }
+        tree.Insert(status(0), RecordID{0, 0});  // Same pair again: no-op
+
+        auto active = tree.RangeScan(status(0), status(0));
+        assert(active.size() == 500);
+        for (size_t i = 1; i < active.size(); i++) assert(active[i - 1].second < active[i].second);
+        assert(tree.Search(status(1)) == (RecordID{0, 1}));
+
+        // Remove one specific pair; its neighbours under the same key stay
+        assert(tree.Delete(status(3), RecordID{0, 3}));
+        assert(!tree.Delete(status(3), RecordID{0, 3}));
+        assert(tree.RangeScan(status(0), status(0)).size() == 499);
+        assert(tree.RangeScan(status(2), status(2)).size() == 500);
+        assert(tree.RangeScan(status(0), status(2)).size() == 1499);
+    }
+    std::cout << "✓ B+ Tree duplicates: 3 keys x 500 RecordIDs, in RecordID order, pair deletes" << std::endl;
+
+    // Streaming iterator: the tree splits and shifts under an open cursor
+    {
+        page_id_t tree_root;
+        Page* root_page = bpm.NewPage(&tree_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(tree_root, true);
+        BPlusTree tree(&bpm, tree_root, /*max_keys_per_node=*/8);
+
+        auto tree_key = [](int i) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "k%05d", i);
+            return std::string(buf);
+        };
+        for (int i = 0; i < 400; i += 2) tree.Insert(tree_key(i), RecordID{i, 0});
+
+        BPlusTree::Iterator it(&tree, tree_key(0), tree_key(399));
+        std::string key, prev;
+        RecordID rid;
+        int evens = 0, odds = 0;
+        while (it.Next(&key, &rid)) {
+            assert(key > prev);
+            prev = key;
+            (rid.page_id % 2 == 0 ? evens : odds)++;
+            // Keys on both sides of the cursor; only those ahead are seen
+            if (rid.page_id % 2 == 0) {
+                if (rid.page_id > 0) tree.Insert(tree_key(rid.page_id - 1), RecordID{rid.page_id - 1, 0});
+                tree.Insert(tree_key(rid.page_id + 1), RecordID{rid.page_id + 1, 0});
+            }
+        }
+        assert(evens == 200 && odds == 200);
+
+        // Stopping early reads only what it needs
+        BPlusTree::Iterator head(&tree, tree_key(100), tree_key(399));
+        assert(head.Next(&key, &rid) && key == tree_key(100));
+        assert(head.Next(&key, &rid) && key == tree_key(101));
+    }
+    std::cout << "✓ B+ Tree iterator: streams across splits made under the cursor" << std::endl;
+
+    // Latch crabbing: writers splitting nodes while readers descend and scan
+    {
+        page_id_t tree_root;
+        Page* root_page = bpm.NewPage(&tree_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(tree_root, true);
+        BPlusTree tree(&bpm, tree_root, /*max_keys_per_node=*/6);
+
+        auto tree_key = [](int i) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "k%05d", i);
+            return std::string(buf);
+        };
+        const int writers = 4, per_writer = 500;
+        std::atomic<bool> writing{true};
+        std::atomic<int> bad_reads{0};
+        std::vector<std::thread> threads;
+        for (int w = 0; w < writers; w++) {
+            threads.emplace_back([&, w] {
+                for (int i = 0; i < per_writer; i++) {
+                    int k = i * writers + w;
+                    tree.Insert(tree_key(k), RecordID{k, 0});
+                    if (k % 5 == 0) tree.Delete(tree_key(k), RecordID{k, 0});
+                }
+            });
+        }
+        threads.emplace_back([&] {
+            while (writing) {
+                // Scans stay ordered; lookups only ever see the right RecordID
+                std::string prev;
+                for (auto& [key, rid] : tree.RangeScan(tree_key(0), tree_key(99999))) {
+                    if (key <= prev || key != tree_key(rid.page_id)) bad_reads++;
+                    prev = key;
+                }
+                RecordID r = tree.Search(tree_key(7));
+                if (r.IsValid() && r.page_id != 7) bad_reads++;
+            }
+        });
+        for (int w = 0; w < writers; w++) threads[w].join();
+        writing = false;
+        threads.back().join();
+
+        assert(bad_reads == 0);
+        auto all = tree.RangeScan(tree_key(0), tree_key(99999));
+        assert(all.size() == static_cast<size_t>(writers * per_writer * 4 / 5));
+        for (int k = 0; k < writers * per_writer; k++) {
+            assert(tree.Search(tree_key(k)).IsValid() == (k % 5 != 0));
+        }
+    }
+    std::cout << "✓ B+ Tree latch crabbing: 4 writers splitting under a concurrent reader" << std::endl;
+
+    // Bulk load: external sort with spilled runs, then a bottom-up build
+    {
+        auto tree_key = [](int i) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "k%05d", i);
+            return std::string(buf);
+        };
+        const int n = 5000;
+        IndexEntrySorter sorter(/*memory_limit=*/16 * 1024);
+        for (int i = 0; i < n; i++) {
+            int k = (i * 7919) % n;  // A permutation of 0..n-1
+            sorter.Add(tree_key(k / 2), RecordID{k, 0});
+        }
+        assert(sorter.NumRuns() > 1 && sorter.Size() == static_cast<size_t>(n));
+
+        page_id_t tree_root;
+        Page* root_page = bpm.NewPage(&tree_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(tree_root, true);
+        BPlusTree tree(&bpm, tree_root);
+        tree.BulkLoad([&sorter](std::string* key, RecordID* rid) { return sorter.Next(key, rid); },
+                      /*fill_factor=*/0.7);
+        assert(tree.GetRootPageId() != tree_root);
+
+        auto all = tree.RangeScan(tree_key(0), tree_key(99999));
+        assert(all.size() == static_cast<size_t>(n));
+        for (int k = 0; k < n; k++) {
+            assert(all[k].first == tree_key(k / 2) && all[k].second.page_id == k);
+        }
+        assert(tree.Search(tree_key(1234)).page_id == 2468);
+
+        // The loaded tree takes ordinary inserts and deletes
+        for (int k = n; k < n + 500; k++) tree.Insert(tree_key(k / 2), RecordID{k, 0});
+        for (int k = 0; k < n; k += 3) assert(tree.Delete(tree_key(k / 2), RecordID{k, 0}));
+        assert(tree.RangeScan(tree_key(0), tree_key(99999)).size() == static_cast<size_t>(n + 500 - (n + 2) / 3));
+
+        // Out-of-order input is refused
+        page_id_t bad_root;
+        Page* bad_page = bpm.NewPage(&bad_root);
+        BPlusTree::InitLeaf(bad_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(bad_root, true);
+        BPlusTree bad(&bpm, bad_root);
+        int calls = 0;
+        bool threw = false;
+        try {
+            bad.BulkLoad([&](std::string* key, RecordID* rid) {
+                *key = tree_key(calls == 1 ? 0 : 5);
+                *rid = RecordID{calls, 0};
+                return ++calls <= 2;
+            });
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+    std::cout << "✓ B+ Tree bulk load: 5000 pairs through 2+ sorted runs, built bottom-up" << std::endl;
+
+    // Delete rebalancing: merges shrink the tree, and the pages they free
+    // are allocated again before the file grows
+    {
+        auto tree_key = [](int i) {
+            char buf[16];
+            std::snprintf(buf, sizeof(buf), "k%05d", i);
+            return std::string(buf);
+        };
+        page_id_t tree_root;
+        Page* root_page = bpm.NewPage(&tree_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(tree_root, true);
+        BPlusTree tree(&bpm, tree_root, /*max_keys_per_node=*/8);
+
+        for (int i = 0; i < 2000; i++) tree.Insert(tree_key(i), RecordID{i, 0});
+        page_id_t tall_root = tree.GetRootPageId();
+        size_t free_before = disk_manager.GetFreePageCount();
+        for (int i = 0; i < 2000; i++) {
+            if (i % 50 != 0) assert(tree.Delete(tree_key(i), RecordID{i, 0}));
+        }
+        size_t freed = disk_manager.GetFreePageCount() - free_before;
+        assert(freed > 200);
+        assert(tree.GetRootPageId() != tall_root);  // The root collapsed
+
+        auto rest = tree.RangeScan(tree_key(0), tree_key(99999));
+        assert(rest.size() == 40);
+        for (size_t i = 0; i < rest.size(); i++) assert(rest[i].first == tree_key(static_cast<int>(i) * 50));
+
+        for (int i = 0; i < 2000; i++) tree.Insert(tree_key(i), RecordID{i, 0});
+        assert(disk_manager.GetFreePageCount() < free_before + freed / 2);
+        assert(tree.RangeScan(tree_key(0), tree_key(99999)).size() == 2000);
+
+        // Space-based nodes: long keys, every leaf but a few emptied
+        page_id_t wide_root;
+        root_page = bpm.NewPage(&wide_root);
+        BPlusTree::InitLeaf(root_page->GetData(), bpm.GetPageSize());
+        bpm.UnpinPage(wide_root, true);
+        BPlusTree wide(&bpm, wide_root);
+        auto wide_key = [&](int i) { return std::string(60, 'w') + tree_key(i) + std::string(40, 'x'); };
+        for (int i = 0; i < 3000; i++) wide.Insert(wide_key(i), RecordID{i, 1});
+        free_before = disk_manager.GetFreePageCount();
+        for (int i = 0; i < 3000; i++) {
+            if (i % 100 != 7) assert(wide.Delete(wide_key(i)));
+        }
+        assert(disk_manager.GetFreePageCount() > free_before + 20);
+        auto wide_rest = wide.RangeScan(wide_key(0), wide_key(2999));
+        assert(wide_rest.size() == 30);
+        for (size_t i = 0; i < wide_rest.size(); i++) {
+            assert(wide_rest[i].first == wide_key(static_cast<int>(i) * 100 + 7));
+        }
+        for (int i = 7; i < 3000; i += 100) assert(wide.Delete(wide_key(i)));
+        assert(wide.RangeScan(wide_key(0), wide_key(2999)).empty());
+    }
+    std::cout << "✓ B+ Tree delete rebalancing: merges, root collapse, freed pages reused" << std::endl;
+
     // ---- 8. Test Delete ----
     std::cout << "\n--- Phase 2: Delete ---" << std::endl;
 
@@ -255,8 +1952,9 @@ int run_tests() {
     assert(txn1->state == TransactionState::GROWING);
 
     // Simulate locking
-    lock_manager.LockShared(txn1->txn_id, inserted_rids[1]);
-    lock_manager.LockExclusive(txn1->txn_id, inserted_rids[2]);
+    assert(lock_manager.LockRecord(txn1->txn_id, 1, inserted_rids[1], LockMode::SHARED));
+    assert(lock_manager.LockRecord(txn1->txn_id, 1, inserted_rids[2], LockMode::EXCLUSIVE));
+    assert(lock_manager.LockRecord(txn1->txn_id, 1, inserted_rids[1], LockMode::EXCLUSIVE));  // Upgrade
 
     txn_manager.Commit(txn1);
     assert(txn1->state == TransactionState::COMMITTED);
@@ -267,6 +1965,168 @@ int run_tests() {
     assert(txn2->state == TransactionState::ABORTED);
     std::cout << "✓ Transaction lifecycle: BEGIN → ABORT" << std::endl;
 
+    // ---- Lock hierarchy, escalation, deadlock detection ----
+    {
+        assert(LockManager::Compatible(LockMode::INTENTION_EXCLUSIVE, LockMode::INTENTION_SHARED));
+        assert(!LockManager::Compatible(LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED));
+        assert(LockManager::Combine(LockMode::SHARED, LockMode::INTENTION_EXCLUSIVE) ==
+               LockMode::SHARED_INTENTION_EXCLUSIVE);
+        assert(LockManager::Covers(LockMode::EXCLUSIVE, LockMode::SHARED));
+
+        LockManager locks(/*escalation_threshold=*/100, std::chrono::milliseconds(5));
+        locks.Start();
+
+        // An X record lock holds IX on the collection: a collection S waits for it
+        assert(locks.LockRecord(1, 7, RecordID{10, 0}, LockMode::EXCLUSIVE));
+        assert(locks.LockRecord(2, 7, RecordID{10, 1}, LockMode::SHARED));  // IS / IX share
+        std::atomic<bool> granted{false};
+        std::thread reader([&] {
+            assert(locks.LockCollection(3, 7, LockMode::SHARED));
+            granted = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(!granted);
+        locks.UnlockAll(1);
+        locks.UnlockAll(2);
+        reader.join();
+        assert(granted);
+        locks.UnlockAll(3);
+        assert(locks.GetStats().waits >= 1);
+
+        // 150 record locks: the 101st trades the 100 for X on the collection
+        for (uint16_t slot = 0; slot < 150; slot++) {
+            assert(locks.LockRecord(4, 8, RecordID{page_id_t(20 + slot / 50), slot}, LockMode::EXCLUSIVE));
+        }
+        assert(locks.GetStats().escalations == 1);
+        granted = false;
+        std::thread other([&] {
+            assert(locks.LockRecord(5, 8, RecordID{99, 0}, LockMode::SHARED));
+            granted = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        assert(!granted);  // Any record of the collection waits now
+        locks.UnlockAll(4);
+        other.join();
+        locks.UnlockAll(5);
+
+        // 6 and 7 each wait for the other's record: the detector refuses
+        // the younger (7) its lock, and 6 goes on once 7 aborts
+        assert(locks.LockRecord(6, 9, RecordID{30, 0}, LockMode::EXCLUSIVE));
+        assert(locks.LockRecord(7, 9, RecordID{30, 1}, LockMode::EXCLUSIVE));
+        std::atomic<bool> older_done{false};
+        std::thread older([&] {
+            assert(locks.LockRecord(6, 9, RecordID{30, 1}, LockMode::EXCLUSIVE));
+            older_done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        assert(!locks.LockRecord(7, 9, RecordID{30, 0}, LockMode::EXCLUSIVE));
+        locks.UnlockAll(7);
+        older.join();
+        assert(older_done);
+        locks.UnlockAll(6);
+
+        LockStats stats = locks.GetStats();
+        assert(stats.deadlocks == 1 && stats.max_wait_us > 0 && stats.wait_us >= stats.max_wait_us);
+        locks.Stop();
+    }
+    std::cout << "✓ Lock manager: intention locks, escalation to the collection, deadlock victim" << std::endl;
+
+    // ---- MVCC snapshot reads ----
+    {
+        DBConfigs mv_config;
+        mv_config.db_file_name = "test_mvcc.db";
+        std::remove(mv_config.db_file_name.c_str());
+        {
+            DiskManager mv_disk(mv_config);
+            BufferPoolManager mv_bpm(64, &mv_disk);
+            Catalog mv_catalog(&mv_bpm);
+            page_id_t catalog_page;
+            mv_bpm.NewPage(&catalog_page);
+            mv_bpm.UnpinPage(catalog_page, true);
+            LockManager mv_locks;
+            TransactionManager mv_txns(&mv_locks);
+            mv_catalog.CreateCollection("m");
+            CollectionInfo* m = mv_catalog.GetCollection("m");
+
+            std::vector<RecordID> rids;
+            Transaction* load = mv_txns.Begin();
+            for (int i = 0; i < 10; i++) {
+                BsonDocument d;
+                d.Add("v", int32_t(i));
+                rids.push_back(m->heap_file->InsertRecord(d, load));
+            }
+            assert(m->versions->Size() == 10);  // Each insert hid its record until committed
+            Snapshot before_load = mv_txns.TakeSnapshot();
+            mv_txns.Commit(load);
+            mv_txns.Release(load);
+
+            // Snapshot-read sum of v (and row count) through a seq scan
+            auto read = [&](const Snapshot& snapshot, const FilterExpr& filter) {
+                SnapshotScanExecutor scan(std::make_unique<SeqScanExecutor>(m->heap_file.get(), filter),
+                                          m->versions.get(), snapshot, filter);
+                std::pair<int, int> rows_sum = {0, 0};
+                Tuple tuple;
+                scan.Init();
+                while (scan.Next(&tuple)) {
+                    rows_sum.first++;
+                    rows_sum.second += std::get<int32_t>(tuple.doc.elements["v"]);
+                }
+                scan.Close();
+                return rows_sum;
+            };
+            FilterExpr all;
+            assert(read(before_load, all) == std::make_pair(0, 0));
+            mv_txns.ReleaseSnapshot(before_load);
+            Snapshot old = mv_txns.TakeSnapshot();
+            assert(read(old, all) == std::make_pair(10, 45));
+
+            // Uncommitted: v0 -> 100, v1 deleted, v 7 inserted
+            Transaction* writer = mv_txns.Begin();
+            BsonDocument doc0 = m->heap_file->GetRecord(rids[0]);
+            m->versions->Install(rids[0], &doc0, writer);
+            BsonDocument doc0_new;
+            doc0_new.Add("v", int32_t(100));
+            m->heap_file->UpdateRecord(rids[0], doc0_new, writer);
+            BsonDocument doc1 = m->heap_file->GetRecord(rids[1]);
+            m->versions->Install(rids[1], &doc1, writer);
+            m->heap_file->DeleteRecord(rids[1], writer);
+            BsonDocument doc_new;
+            doc_new.Add("v", int32_t(7));
+            m->heap_file->InsertRecord(doc_new, writer);
+
+            Snapshot during = mv_txns.TakeSnapshot();
+            assert(read(old, all) == std::make_pair(10, 45) && read(during, all) == std::make_pair(10, 45));
+            mv_txns.Commit(writer);
+            mv_txns.Release(writer);
+
+            Snapshot after = mv_txns.TakeSnapshot();
+            assert(read(after, all) == std::make_pair(10, 45 - 1 + 100 + 7));
+            assert(read(old, all) == std::make_pair(10, 45));
+            // The old version matches although the newest one does not (and the reverse)
+            FilterExpr small = FilterExpr::Compare("v", CompareOp::LT, int32_t(2));
+            assert(read(old, small) == std::make_pair(2, 1) && read(after, small) == std::make_pair(0, 0));
+
+            // Pruning keeps what the oldest snapshot needs
+            Vacuum vacuum(&mv_txns, [&](uint64_t ts) { return mv_catalog.PruneVersions(ts); },
+                          std::chrono::milliseconds(10));
+            size_t held = m->versions->Size();  // 10 from the load, 2 or 3 from writer (slot reuse)
+            assert(vacuum.RunOnce() == 10 && m->versions->Size() == held - 10);  // The load's are gone
+            assert(read(old, all) == std::make_pair(10, 45));
+            mv_txns.ReleaseSnapshot(old);
+            mv_txns.ReleaseSnapshot(during);
+            vacuum.Start();
+            for (int i = 0; i < 500 && m->versions->Size() > 0; i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            vacuum.Stop();
+            assert(m->versions->Size() == 0 && vacuum.GetPruned() == held);
+            assert(read(after, all) == std::make_pair(10, 45 - 1 + 100 + 7));
+            mv_txns.ReleaseSnapshot(after);
+        }
+        std::remove(mv_config.db_file_name.c_str());
+    }
+    std::cout << "✓ MVCC: snapshots read past uncommitted and later changes, vacuum prunes" << std::endl;
+
     // ---- 10. Test WAL ----
     std::cout << "\n--- Phase 4: WAL ---" << std::endl;
 
@@ -309,19 +2169,622 @@ int run_tests() {
     recovery.Recover();
     std::cout << "✓ Recovery completed successfully" << std::endl;
 
+    // ---- 12. Background writer + fuzzy checkpoint ----
+    std::cout << "\n--- Phase 4: Fuzzy Checkpoint ---" << std::endl;
+    {
+        DBConfigs ckpt_config;
+        ckpt_config.db_file_name = "test_ckpt.db";
+        std::remove("test_ckpt.db");
+        RemoveWAL("test_ckpt.wal");
+
+        DiskManager ckpt_disk(ckpt_config);
+        BufferPoolManager ckpt_bpm(32, &ckpt_disk);
+        WAL ckpt_wal("test_ckpt.wal", /*force_on_commit=*/false);
+        ckpt_bpm.SetLogFlusher([&](int64_t lsn) { ckpt_wal.FlushUntil(lsn); });
+        LockManager ckpt_locks;
+        TransactionManager ckpt_txns(&ckpt_locks, &ckpt_wal);
+        Catalog ckpt_catalog(&ckpt_bpm, &ckpt_wal);
+        page_id_t catalog_page;
+        ckpt_bpm.NewPage(&catalog_page);
+        ckpt_bpm.UnpinPage(catalog_page, true);
+        ckpt_catalog.CreateCollection("c");
+        HeapFile* heap = ckpt_catalog.GetCollection("c")->heap_file.get();
+
+        Transaction* committed = ckpt_txns.Begin();
+        for (int i = 0; i < 10; i++) {
+            BsonDocument d;
+            d.Add("i", int32_t(i));
+            heap->InsertRecord(d, committed);
+        }
+        ckpt_txns.Commit(committed);
+
+        Transaction* running = ckpt_txns.Begin();  // Still open at the checkpoint
+        BsonDocument pending;
+        pending.Add("i", int32_t(99));
+        RecordID pending_rid = heap->InsertRecord(pending, running);
+        Page* pending_page = ckpt_bpm.FetchPage(pending_rid.page_id);
+        lsn_t page_lsn = SlottedPage::GetPageLSN(pending_page->GetData());
+        ckpt_bpm.UnpinPage(pending_rid.page_id, false);
+        assert(page_lsn != INVALID_LSN && ckpt_wal.GetFlushedLSN() < page_lsn);
+
+        // WAL-before-data: writing the page forces its log records out first
+        BackgroundWriter writer(&ckpt_bpm, std::chrono::milliseconds(100), 64);
+        assert(writer.RunOnce() > 0);
+        assert(ckpt_wal.GetFlushedLSN() >= page_lsn);
+        assert(ckpt_bpm.GetDirtyPageTable().empty());
+
+        Checkpointer checkpointer(&ckpt_bpm, &ckpt_wal, std::chrono::milliseconds(1000));
+        checkpointer.RunOnce();
+
+        // The open transaction's records survive truncation; the checkpoint names it
+        auto ckpt_records = ckpt_wal.ReadAllRecords();
+        assert(ckpt_records.back().type == LogRecordType::CHECKPOINT);
+        CheckpointData ckpt = CheckpointData::Decode(ckpt_records.back().after_image);
+        assert(ckpt.active_txns.size() == 1 && ckpt.active_txns[0].first == running->txn_id);
+        assert(std::any_of(ckpt_records.begin(), ckpt_records.end(), [&](const LogRecord& r) {
+            return r.txn_id == running->txn_id && r.type == LogRecordType::INSERT;
+        }));
+        assert(ckpt_wal.ReadMasterRecord() == ckpt_records.back().lsn);
+
+        RecoveryManager ckpt_recovery(&ckpt_wal, &ckpt_bpm);
+        ckpt_recovery.Recover();
+        int survivors = 0;
+        HeapFile::Iterator it = heap->Begin();
+        RecordID rid;
+        BsonDocument d;
+        while (it.Next(&rid, &d)) survivors++;
+        assert(survivors == 10);
+        ckpt_bpm.SetLogFlusher(nullptr);  // ckpt_wal goes out of scope first
+    }
+    std::remove("test_ckpt.db");
+    RemoveWAL("test_ckpt.wal");
+    std::cout << "✓ Background write-back, fuzzy checkpoint, recovery from checkpoint" << std::endl;
+
+    // ---- 12b. Undo: CLRs, and slots reused since ----
+    std::cout << "\n--- Phase 4: Undo ---" << std::endl;
+    {
+        DBConfigs undo_config;
+        undo_config.db_file_name = "test_undo.db";
+        std::remove("test_undo.db");
+        RemoveWAL("test_undo.wal");
+
+        DiskManager undo_disk(undo_config);
+        BufferPoolManager undo_bpm(32, &undo_disk);
+        WAL undo_wal("test_undo.wal", /*force_on_commit=*/false);
+        undo_bpm.SetLogFlusher([&](int64_t lsn) { undo_wal.FlushUntil(lsn); });
+        LockManager undo_locks;
+        TransactionManager undo_txns(&undo_locks, &undo_wal);
+        Catalog undo_catalog(&undo_bpm, &undo_wal);
+        page_id_t catalog_page;
+        undo_bpm.NewPage(&catalog_page);
+        undo_bpm.UnpinPage(catalog_page, true);
+        undo_catalog.CreateCollection("u");
+        HeapFile* heap = undo_catalog.GetCollection("u")->heap_file.get();
+        auto doc = [](const char* name) {
+            BsonDocument d;
+            d.Add("name", std::string(name));
+            return d;
+        };
+
+        Transaction* setup = undo_txns.Begin();
+        RecordID a = heap->InsertRecord(doc("a"), setup);
+        RecordID b = heap->InsertRecord(doc("b"), setup);
+        undo_txns.Commit(setup);
+
+        // The loser deletes a and inserts c; a committed insert takes a's slot
+        Transaction* loser = undo_txns.Begin();
+        heap->DeleteRecord(a, loser);
+        Transaction* other = undo_txns.Begin();
+        RecordID d = heap->InsertRecord(doc("d"), other);
+        undo_txns.Commit(other);
+        RecordID c = heap->InsertRecord(doc("c"), loser);
+        assert(d == a);
+        undo_wal.Flush();
+
+        RecoveryManager first(&undo_wal, &undo_bpm);
+        first.Recover();
+        assert(first.GetStats().undone == 1 && first.GetStats().undo_skipped == 1);
+        assert(std::get<std::string>(heap->GetRecord(a).elements["name"]) == "d");
+        assert(std::get<std::string>(heap->GetRecord(b).elements["name"]) == "b");
+        bool gone = false;
+        try {
+            heap->GetRecord(c);
+        } catch (const std::runtime_error&) {
+            gone = true;
+        }
+        assert(gone);
+
+        // One CLR for the insert, pointing past it, then the loser's ABORT
+        auto undo_records = undo_wal.ReadAllRecords();
+        const LogRecord& clr = undo_records[undo_records.size() - 2];
+        assert(clr.type == LogRecordType::CLR && clr.txn_id == loser->txn_id && clr.after_image.empty());
+        assert(clr.page_id == c.page_id && clr.slot_id == c.slot_id && clr.undo_next_lsn != INVALID_LSN);
+        assert(undo_records.back().type == LogRecordType::ABORT && undo_records.back().txn_id == loser->txn_id);
+
+        // Recovering again finds no loser
+        RecoveryManager second(&undo_wal, &undo_bpm);
+        second.Recover();
+        assert(second.GetStats().undone == 0 && second.GetStats().undo_skipped == 0);
+        assert(std::get<std::string>(heap->GetRecord(a).elements["name"]) == "d");
+        undo_bpm.SetLogFlusher(nullptr);
+    }
+    std::remove("test_undo.db");
+    RemoveWAL("test_undo.wal");
+    std::cout << "✓ Undo: logged as CLRs, the loser ends with an ABORT, a reused slot is left alone" << std::endl;
+
+    // ---- 13. Parallel redo ----
+    std::cout << "\n--- Phase 4: Parallel Redo ---" << std::endl;
+    {
+        DBConfigs live_config;
+        live_config.db_file_name = "test_redo_live.db";
+        DBConfigs replay_config;
+        replay_config.db_file_name = "test_redo_replay.db";
+        std::remove("test_redo_live.db");
+        std::remove("test_redo_replay.db");
+        RemoveWAL("test_redo.wal");
+
+        WAL redo_wal("test_redo.wal", /*force_on_commit=*/false);
+        std::vector<std::pair<RecordID, std::vector<uint8_t>>> expected;
+        {
+            DiskManager live_disk(live_config);
+            BufferPoolManager live_bpm(64, &live_disk, 4);
+            LockManager live_locks;
+            TransactionManager live_txns(&live_locks, &redo_wal);
+            Catalog live_catalog(&live_bpm, &redo_wal);
+            page_id_t catalog_page;
+            live_bpm.NewPage(&catalog_page);
+            live_bpm.UnpinPage(catalog_page, true);
+            live_catalog.CreateCollection("r");
+            HeapFile* heap = live_catalog.GetCollection("r")->heap_file.get();
+            Transaction* txn = live_txns.Begin();
+            for (int i = 0; i < 300; i++) {
+                BsonDocument d;
+                d.Add("i", int32_t(i));
+                d.Add("pad", std::string(40, 'x'));
+                expected.emplace_back(heap->InsertRecord(d, txn), BsonSerializer::Serialize(d));
+            }
+            live_txns.Commit(txn);
+            redo_wal.Flush();
+        }
+
+        // Replay into a data file that never saw the changes
+        DiskManager replay_disk(replay_config);
+        BufferPoolManager replay_bpm(64, &replay_disk, 4);
+        RecoveryManager parallel(&redo_wal, &replay_bpm, 4);
+        parallel.Recover();
+        assert(parallel.GetStats().redo_threads == 4);
+        assert(parallel.GetStats().redone == expected.size());
+        for (const auto& [rid, bytes] : expected) {
+            Page* page = replay_bpm.FetchPage(rid.page_id);
+            uint16_t len = 0;
+            const uint8_t* got = SlottedPage::GetRecord(page->GetData(), rid.slot_id, &len);
+            assert(got && len == bytes.size() && std::memcmp(got, bytes.data(), len) == 0);
+            replay_bpm.UnpinPage(rid.page_id, false);
+        }
+
+        // A second pass finds every change behind the pageLSNs
+        RecoveryManager again(&redo_wal, &replay_bpm, 1);
+        again.Recover();
+        assert(again.GetStats().redone == 0 && again.GetStats().redo_skipped > 0);
+    }
+    std::remove("test_redo_live.db");
+    std::remove("test_redo_replay.db");
+    RemoveWAL("test_redo.wal");
+    std::cout << "✓ Parallel redo: 4 partitions match the log, replay is idempotent" << std::endl;
+
+    // ---- 13b. Batched insert ----
+    std::cout << "\n--- Phase 4: Batched Insert ---" << std::endl;
+    {
+        DBConfigs live_config;
+        live_config.db_file_name = "test_batch_live.db";
+        DBConfigs replay_config;
+        replay_config.db_file_name = "test_batch_replay.db";
+        std::remove("test_batch_live.db");
+        std::remove("test_batch_replay.db");
+        RemoveWAL("test_batch.wal");
+
+        WAL batch_wal("test_batch.wal", /*force_on_commit=*/false);
+        std::vector<BsonDocument> docs;
+        for (int i = 0; i < 400; i++) {
+            BsonDocument d;
+            d.Add("i", int32_t(i));
+            d.Add("pad", std::string(i == 200 ? 9000 : 40, 'b'));  // One needs the overflow heap
+            docs.push_back(d);
+        }
+        std::vector<RecordID> rids;
+        lsn_t first_lsn;
+        {
+            DiskManager live_disk(live_config);
+            BufferPoolManager live_bpm(64, &live_disk, 4);
+            LockManager live_locks;
+            TransactionManager live_txns(&live_locks, &batch_wal);
+            Catalog live_catalog(&live_bpm, &batch_wal);
+            page_id_t catalog_page;
+            live_bpm.NewPage(&catalog_page);
+            live_bpm.UnpinPage(catalog_page, true);
+            live_catalog.CreateCollection("b");
+            HeapFile* heap = live_catalog.GetCollection("b")->heap_file.get();
+            Transaction* txn = live_txns.Begin();
+            first_lsn = batch_wal.GetCurrentLSN();
+            rids = heap->InsertRecords(docs, txn);
+            live_txns.Commit(txn);
+            batch_wal.Flush();
+
+            // In order, pages filled one after another, every document back whole
+            assert(rids.size() == docs.size() && heap->GetRecordCount() == docs.size());
+            for (size_t i = 1; i < rids.size(); i++) {
+                assert(rids[i].page_id >= rids[i - 1].page_id && !(rids[i] == rids[i - 1]));
+            }
+            for (size_t i = 0; i < docs.size(); i += 50) {
+                BsonDocument got = heap->GetRecord(rids[i]);
+                assert(std::get<int32_t>(got.elements["i"]) == int32_t(i));
+            }
+            assert(std::get<std::string>(heap->GetRecord(rids[200]).elements["pad"]).size() == 9000);
+
+            // A batch whose last document is too large even out of line
+            // (small fields only) goes in not at all
+            std::vector<BsonDocument> failing(docs.begin(), docs.begin() + 100);
+            BsonDocument huge;
+            for (int f = 0; f < 5000; f++) huge.Add("f" + std::to_string(f), int32_t(f));
+            failing.push_back(huge);
+            Transaction* bad = live_txns.Begin();
+            bool threw = false;
+            try {
+                heap->InsertRecords(failing, bad);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            live_txns.Abort(bad);
+            assert(threw && heap->GetRecordCount() == docs.size());
+            size_t scanned = 0;
+            auto it = heap->Begin();
+            RecordID scan_rid;
+            BsonDocument scan_doc;
+            while (it.Next(&scan_rid, &scan_doc)) scanned++;
+            assert(scanned == docs.size());
+        }
+
+        // One INSERT per document (plus the big one's chunks), chained by prev_lsn
+        size_t inserts = 0;
+        lsn_t prev = INVALID_LSN;
+        for (const LogRecord& r : batch_wal.ReadAllRecords()) {
+            if (r.lsn < first_lsn || r.type != LogRecordType::INSERT) continue;
+            assert(r.prev_lsn != INVALID_LSN && r.prev_lsn >= prev);
+            prev = r.lsn;
+            inserts++;
+        }
+        assert(inserts > docs.size());
+
+        // Redo rebuilds the batch in a data file that never saw it
+        DiskManager replay_disk(replay_config);
+        BufferPoolManager replay_bpm(64, &replay_disk, 4);
+        RecoveryManager replay(&batch_wal, &replay_bpm, 1);
+        replay.Recover();
+        for (size_t i = 0; i < rids.size(); i++) {
+            if (i == 200) continue;  // Its bytes point into the overflow heap
+            Page* page = replay_bpm.FetchPage(rids[i].page_id);
+            uint16_t len = 0;
+            const uint8_t* got = SlottedPage::GetRecord(page->GetData(), rids[i].slot_id, &len);
+            std::vector<uint8_t> bytes = BsonSerializer::Serialize(docs[i]);
+            assert(got && len == bytes.size() && std::memcmp(got, bytes.data(), len) == 0);
+            replay_bpm.UnpinPage(rids[i].page_id, false);
+        }
+    }
+    std::remove("test_batch_live.db");
+    std::remove("test_batch_replay.db");
+    RemoveWAL("test_batch.wal");
+    std::cout << "✓ Batched insert: pages filled in order, all or none, WAL groups replay to the same slots" << std::endl;
+
+    // ---- 14. Segmented log + streaming cursor ----
+    std::cout << "\n--- Phase 4: WAL Segments ---" << std::endl;
+    RemoveWAL("test_seg.wal");
+    {
+        WAL seg_wal("test_seg.wal", /*force_on_commit=*/true, /*segment_size=*/512);
+        auto append = [&](txn_id_t txn, LogRecordType type) {
+            LogRecord r;
+            r.txn_id = txn;
+            r.type = type;
+            r.page_id = type == LogRecordType::INSERT ? 1 : INVALID_PAGE_ID;
+            r.slot_id = 0;
+            if (type == LogRecordType::INSERT) r.after_image.assign(100, 0xAB);
+            return seg_wal.AppendLogRecord(r);
+        };
+        for (txn_id_t t = 1; t <= 20; t++) {
+            append(t, LogRecordType::BEGIN);
+            append(t, LogRecordType::INSERT);
+            append(t, LogRecordType::COMMIT);  // Flushes; rotates when the segment is full
+        }
+        lsn_t loser_begin = append(99, LogRecordType::BEGIN);
+        append(99, LogRecordType::INSERT);
+        lsn_t loser_last = append(99, LogRecordType::INSERT);
+        seg_wal.Flush();
+        assert(seg_wal.ListSegments().size() > 5);
+
+        // Forward scan crosses segments in LSN order
+        LogCursor cursor(&seg_wal);
+        LogRecord r;
+        LogPosition pos;
+        lsn_t expect = 0;
+        while (cursor.Next(&r, &pos)) assert(r.lsn == expect++);
+        assert(expect == loser_last + 1);
+
+        // Seek lands on the record, ReadLSN follows prev_lsn back across segments
+        cursor.Seek(31);
+        assert(cursor.Next(&r, &pos) && r.lsn == 31);
+        LogRecord at;
+        assert(cursor.ReadAt(pos, &at) && at.lsn == 31);
+        int chain = 0;
+        for (lsn_t lsn = loser_last; lsn != INVALID_LSN; lsn = r.prev_lsn, chain++) {
+            assert(cursor.ReadLSN(lsn, &r) && r.txn_id == 99);
+        }
+        assert(chain == 3 && r.lsn == loser_begin);
+
+        // Truncation drops whole segments below the cut, never the record at it
+        size_t before = seg_wal.ListSegments().size();
+        seg_wal.TruncateBefore(40);
+        assert(seg_wal.ListSegments().size() < before);
+        auto kept = seg_wal.ReadAllRecords();
+        assert(kept.front().lsn <= 40 && kept.back().lsn == loser_last);
+    }
+    {
+        // Reopening continues the LSN sequence after the newest segment
+        WAL seg_wal("test_seg.wal", /*force_on_commit=*/true, /*segment_size=*/512);
+        assert(seg_wal.GetCurrentLSN() == 63);
+    }
+    RemoveWAL("test_seg.wal");
+    {
+        // ReadLSN inside one large segment, through its sparse index
+        WAL big_wal("test_seg.wal", /*force_on_commit=*/false);
+        for (txn_id_t t = 0; t < 1000; t++) {
+            LogRecord r;
+            r.txn_id = t;
+            r.type = LogRecordType::BEGIN;
+            r.page_id = INVALID_PAGE_ID;
+            r.slot_id = 0;
+            big_wal.AppendLogRecord(r);
+        }
+        big_wal.Flush();
+        assert(big_wal.ListSegments().size() == 1);
+        LogCursor cursor(&big_wal);
+        LogRecord r;
+        for (lsn_t lsn = 999; lsn >= 0; lsn--) {
+            assert(cursor.ReadLSN(lsn, &r) && r.lsn == lsn && r.txn_id == static_cast<txn_id_t>(lsn));
+        }
+        assert(!cursor.ReadLSN(1000, &r));
+    }
+    RemoveWAL("test_seg.wal");
+    {
+        // A flush that fails part way (the file size limit cuts the write
+        // short) keeps its records buffered, and the retry leaves no hole
+        WAL full_wal("test_seg.wal", /*force_on_commit=*/false);
+        auto append = [&full_wal](txn_id_t txn) {
+            LogRecord r;
+            r.txn_id = txn;
+            r.type = LogRecordType::BEGIN;
+            r.page_id = INVALID_PAGE_ID;
+            r.slot_id = 0;
+            return full_wal.AppendLogRecord(r);
+        };
+        append(1);
+        full_wal.Flush();
+        uint64_t size = std::filesystem::file_size(full_wal.SegmentPath(full_wal.ListSegments().back()));
+
+        struct rlimit old_limit;
+        getrlimit(RLIMIT_FSIZE, &old_limit);
+        struct rlimit limit = old_limit;
+        limit.rlim_cur = size + 10;
+        auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+        setrlimit(RLIMIT_FSIZE, &limit);
+        for (txn_id_t t = 2; t <= 4; t++) append(t);
+        bool threw = false;
+        try {
+            full_wal.Flush();
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        setrlimit(RLIMIT_FSIZE, &old_limit);
+        std::signal(SIGXFSZ, old_handler);
+        assert(threw && full_wal.GetFlushedLSN() == 0);
+
+        append(5);
+        full_wal.Flush();
+        auto kept = full_wal.ReadAllRecords();
+        assert(kept.size() == 5);
+        for (size_t i = 0; i < kept.size(); i++) {
+            assert(kept[i].lsn == static_cast<lsn_t>(i) && kept[i].txn_id == static_cast<txn_id_t>(i + 1));
+        }
+    }
+    RemoveWAL("test_seg.wal");
+    std::cout << "✓ WAL segments: rotation, streaming cursor, prev_lsn chain, indexed ReadLSN, segment truncation, failed flush retried" << std::endl;
+
+    // ---- 15. Connection input ring ----
+    std::cout << "\n--- Server: Input Ring Buffer ---" << std::endl;
+    {
+        RingBuffer ring(16);
+        auto produce = [&ring](const std::string& bytes) {
+            size_t done = 0;
+            while (done < bytes.size()) {
+                size_t space;
+                uint8_t* dst = ring.WriteSpace(&space);
+                size_t n = std::min(space, bytes.size() - done);
+                std::memcpy(dst, bytes.data() + done, n);
+                ring.Produce(n);
+                done += n;
+            }
+        };
+        produce("0123456789");
+        assert(ring.Take(6) == "012345");
+        produce("abcdefghij");  // Wraps around the end of the 16-byte ring
+        char peeked[4];
+        ring.Peek(2, 4, peeked);
+        assert(std::string(peeked, 4) == "89ab");
+        assert(ring.Take(14) == "6789abcdefghij" && ring.Size() == 0);
+        produce("wrapped ");
+        ring.Consume(4);
+        produce(std::string(100, 'z'));  // Grows while wrapped, keeping the order
+        assert(ring.Size() == 104 && ring.Take(4) == "ped " && ring.Take(100) == std::string(100, 'z'));
+
+        // Drained past the high-water mark, it goes back to its first size
+        produce(std::string(1000, 'q'));
+        assert(ring.Capacity() == 1024 && ring.Take(500) == std::string(500, 'q') && ring.Capacity() == 1024);
+        assert(ring.Take(500) == std::string(500, 'q') && ring.Capacity() == 16);
+        produce("again");
+        assert(ring.Take(5) == "again");
+    }
+    std::cout << "✓ Input ring buffer: wrap-around reads, growth keeps order, shrinks once drained" << std::endl;
+
+    // ---- 16. Cursor table ----
+    std::cout << "\n--- Server: Cursor Table ---" << std::endl;
+    {
+        CursorTable cursors(std::chrono::milliseconds(50));
+        auto open = [&cursors](const std::string& collection) {
+            auto cursor = std::make_unique<Cursor>();
+            cursor->collection = collection;
+            return cursors.Put(std::move(cursor));
+        };
+        uint64_t a = open("a"), b = open("b"), a2 = open("a");
+        assert(a != 0 && a != b && b != a2 && cursors.Size() == 3);
+
+        // Taken out while a request uses it: nobody else gets it
+        std::unique_ptr<Cursor> taken = cursors.Take(a);
+        assert(taken && taken->id == a && !cursors.Take(a));
+        assert(cursors.Put(std::move(taken)) == a && cursors.Size() == 3);
+
+        assert(cursors.KillCollection("a") == 2 && cursors.Size() == 1);
+        assert(cursors.Kill(b) && !cursors.Kill(b));
+
+        open("c");
+        std::this_thread::sleep_for(std::chrono::milliseconds(80));
+        uint64_t fresh = open("c");
+        assert(cursors.ExpireIdle() == 1 && cursors.Take(fresh));
+    }
+    std::cout << "✓ Cursor table: one user at a time, killed by collection, idle ones expire" << std::endl;
+
+    // ---- Error replies over the wire, inline and on workers ----
+    std::cout << "\n--- Server: Error Replies ---" << std::endl;
+    for (uint32_t workers : {0u, 2u}) {
+        DBConfigs server_config;
+        server_config.db_file_name = "test_server.db";
+        server_config.wal_file_name = "test_server.wal";
+        server_config.num_workers = workers;
+        std::remove("test_server.db");
+        RemoveWAL("test_server.wal");
+        uint16_t port = FreePort();
+        {
+            Server server(server_config, port);
+            std::thread loop([&server] { server.Start(); });
+            {
+                TestClient client(port);
+                client.Send({R"({"cmd":"hello","protocol":"bson"})"});
+                assert(client.Receive() == R"({"ok":true,"protocol":"bson"})");
+
+                // A command name that needs escaping in the JSON reply the
+                // BSON one is encoded from, then a request behind it
+                BsonDocument bad;
+                bad.Add("cmd", std::string("x\"y"));
+                bad.Add("collection", std::string("c"));
+                BsonDocument ping;
+                ping.Add("cmd", std::string("ping"));
+                auto encode = [](const BsonDocument& doc) {
+                    std::vector<uint8_t> bytes = BsonSerializer::Serialize(doc);
+                    return std::string(bytes.begin(), bytes.end());
+                };
+                client.Send({encode(bad), encode(ping)});
+
+                std::string reply = client.Receive();
+                BsonDocument error = BsonSerializer::Deserialize(
+                    reinterpret_cast<const uint8_t*>(reply.data()), reply.size());
+                assert(!std::get<bool>(error.elements["ok"]));
+                assert(std::get<std::string>(error.elements["error"]) == "unknown command: x\"y");
+                reply = client.Receive();
+                BsonDocument pong = BsonSerializer::Deserialize(
+                    reinterpret_cast<const uint8_t*>(reply.data()), reply.size());
+                assert(std::get<std::string>(pong.elements["result"]) == "pong");
+
+                // A key repeated on the wire is refused
+                BsonDocument twice;
+                twice.elements.Append("cmd", std::string("ping"));
+                twice.elements.Append("cmd", std::string("ping"));
+                client.Send({encode(twice)});
+                reply = client.Receive();
+                error = BsonSerializer::Deserialize(reinterpret_cast<const uint8_t*>(reply.data()), reply.size());
+                assert(std::get<std::string>(error.elements["error"]) == "duplicate key 'cmd'");
+            }
+            server.Stop();
+            loop.join();
+        }
+        std::remove("test_server.db");
+        RemoveWAL("test_server.wal");
+    }
+    std::cout << "✓ Server: a BSON reply to an unknown command with a quote in it, a repeated key refused, inline and on workers"
+              << std::endl;
+
+    // ---- A write that fails part way leaves nothing behind ----
+    std::cout << "\n--- Server: Failed Writes ---" << std::endl;
+    {
+        DBConfigs server_config;
+        server_config.db_file_name = "test_server.db";
+        server_config.wal_file_name = "test_server.wal";
+        std::remove("test_server.db");
+        RemoveWAL("test_server.wal");
+        uint16_t port = FreePort();
+        {
+            Server server(server_config, port);
+            std::thread loop([&server] { server.Start(); });
+            {
+                TestClient client(port);
+                auto call = [&client](const std::string& request) {
+                    client.Send({request});
+                    return client.Receive();
+                };
+                // Small fields only, so nothing can go out of line: a 4 KB
+                // page holds 340 of them, not 490
+                auto fields = [](const char* prefix, int n) {
+                    std::string out;
+                    for (int f = 0; f < n; f++) out += ",\"" + std::string(prefix) + std::to_string(f) + "\":" + std::to_string(f);
+                    return out;
+                };
+                assert(call(R"({"cmd":"createIndex","collection":"u","field":"k"})") == R"({"ok":true})");
+                assert(call(R"({"cmd":"insert","collection":"u","document":{"k":1,"n":1}})").find(R"("ok":true)") != std::string::npos);
+                assert(call(R"({"cmd":"insert","collection":"u","document":{"k":2)" + fields("f", 340) + "}}").find(R"("ok":true)") != std::string::npos);
+
+                // The first match is updated, the second does not fit: both stay as they were
+                std::string reply = call(R"({"cmd":"update","collection":"u","filter":{},"update":{"k":5)" + fields("g", 150) + "}}");
+                assert(reply.find(R"("ok":false)") != std::string::npos && reply.find("too large") != std::string::npos);
+
+                // A batch whose last document is too large
+                reply = call(R"({"cmd":"insertMany","collection":"u","documents":[{"k":7},{"k":8)" + fields("h", 600) + "}]}");
+                assert(reply.find(R"("ok":false)") != std::string::npos && reply.find("too large") != std::string::npos);
+
+                for (const auto& [filter, count] : std::vector<std::pair<std::string, int>>{
+                         {R"({"k":1})", 1}, {R"({"k":2})", 1}, {R"({"k":5})", 0}, {R"({"k":7})", 0}, {R"({"g0":0})", 0}}) {
+                    reply = call(R"({"cmd":"count","collection":"u","filter":)" + filter + "}");
+                    assert(reply == R"({"ok":true,"count":)" + std::to_string(count) + "}");
+                }
+                assert(call(R"({"cmd":"count","collection":"u"})").find(R"({"ok":true,"count":2,)") == 0);
+            }
+            server.Stop();
+            loop.join();
+        }
+        std::remove("test_server.db");
+        RemoveWAL("test_server.wal");
+    }
+    std::cout << "✓ Server: a failed update or insertMany leaves heap and index as they were" << std::endl;
+
     // ---- Summary ----
     std::cout << "\n========================================" << std::endl;
     std::cout << "  ALL TESTS PASSED ✓" << std::endl;
     std::cout << "========================================" << std::endl;
     std::cout << "\nComponents tested:" << std::endl;
-    std::cout << "  Phase 1: DiskManager, BsonSerializer, SlottedPage, BufferPool" << std::endl;
+    std::cout << "  Phase 1: DiskManager, BsonSerializer, Json, SlottedPage, BufferPool, Metrics" << std::endl;
     std::cout << "  Phase 2: FreeSpaceMap, HeapFile, B+Tree Index" << std::endl;
     std::cout << "  Phase 3: Catalog, SeqScan, Filter, IndexScan" << std::endl;
     std::cout << "  Phase 4: LockManager, TransactionManager, WAL, RecoveryManager" << std::endl;
+    std::cout << "  Server:  RingBuffer, CursorTable, error replies" << std::endl;
 
     // Cleanup test files
     std::remove("test_docdb.db");
-    std::remove("test_wal.log");
+    RemoveWAL("test_wal.log");
 
     return 0;
 }
@@ -334,15 +2797,32 @@ int main(int argc, char* argv[]) {
         return run_tests();
     }
 
+    // --config <file> may appear anywhere; other flags override the file
+    DBConfigs config;
+    try {
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::strcmp(argv[i], "--config") == 0) config = ConfigManager::LoadConfig(argv[i + 1]);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
     if (argc > 1 && std::strcmp(argv[1], "--server") == 0) {
-        int port = 6379;
-        if (argc > 2) port = std::atoi(argv[2]);
-        Server server("docdb_data.db", port);
+        for (int i = 2; i < argc; i++) {
+            if (std::strcmp(argv[i], "--config") == 0 && i + 1 < argc) i++;
+            else if (std::strcmp(argv[i], "--flush-all") == 0) config.flush_policy = FlushPolicy::FLUSH_ALL;
+            else if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) config.num_workers = std::atoi(argv[++i]);
+            else if (std::strcmp(argv[i], "--bp-shards") == 0 && i + 1 < argc) config.buffer_pool_shards = std::atoi(argv[++i]);
+            else if (std::strcmp(argv[i], "--metrics-port") == 0 && i + 1 < argc) config.metrics_port = static_cast<uint16_t>(std::atoi(argv[++i]));
+            else config.port = static_cast<uint16_t>(std::atoi(argv[i]));
+        }
+        Server server(config, config.port);
         server.Start();
         return 0;
     }
 
-    CLI cli;
+    CLI cli(config);
     cli.Run();
     return 0;
 }
\ No newline at end of file
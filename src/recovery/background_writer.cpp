@@ -0,0 +1,66 @@
+#include "background_writer.h"
+#include <iostream>
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+BackgroundWriter::BackgroundWriter(BufferPoolManager* bpm, std::chrono::milliseconds interval,
+                                   size_t max_pages)
+    : bpm_(bpm), interval_(interval), max_pages_(max_pages) {}
+
+BackgroundWriter::~BackgroundWriter() {
+    Stop();
+}
+
+// ============================================================================
+// Start / Stop
+// ============================================================================
+
+void BackgroundWriter::Start() {
+    if (thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = false;
+    }
+    thread_ = std::thread(&BackgroundWriter::Loop, this);
+}
+
+void BackgroundWriter::Stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+// ============================================================================
+// Loop — wake up every interval and clean a batch of pages
+// ============================================================================
+
+void BackgroundWriter::Loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        cv_.wait_for(lock, interval_, [this] { return stop_; });
+        if (stop_) break;
+
+        lock.unlock();
+        try {
+            RunOnce();
+        } catch (const std::exception& e) {
+            std::cerr << "BackgroundWriter: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+// ============================================================================
+// RunOnce
+// ============================================================================
+
+size_t BackgroundWriter::RunOnce() {
+    return bpm_->WriteBackDirty(max_pages_);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "storage_engine/buffer/buffer_pool.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// ============================================================================
+// BackgroundWriter — trickles dirty pages to disk ahead of eviction
+//
+// Every interval it cleans up to max_pages dirty, unpinned frames through
+// BufferPoolManager::WriteBackDirty, so a FetchPage/NewPage that needs a
+// victim almost always finds a clean one and does not wait on a write.
+// The pool's log flusher runs after the pages are copied and before they
+// are written (WAL-before-data, see BufferPoolManager::SetLogFlusher).
+//
+// Pages are not fsynced here. A written page drops out of the dirty page
+// table, so the checkpointer fsyncs the data file before it logs a table
+// that relies on that.
+// ============================================================================
+
+class BackgroundWriter {
+public:
+    BackgroundWriter(BufferPoolManager* bpm, std::chrono::milliseconds interval, size_t max_pages);
+    ~BackgroundWriter();
+
+    BackgroundWriter(const BackgroundWriter&) = delete;
+    BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+    // Start / stop the background thread
+    void Start();
+    void Stop();
+
+    // Run one round now. Returns the number of pages written.
+    size_t RunOnce();
+
+private:
+    void Loop();
+
+    BufferPoolManager* bpm_;
+    std::chrono::milliseconds interval_;
+    size_t max_pages_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
@@ -0,0 +1,84 @@
+#include "checkpointer.h"
+#include <algorithm>
+#include <iostream>
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+Checkpointer::Checkpointer(BufferPoolManager* bpm, WAL* wal, std::chrono::milliseconds interval)
+    : bpm_(bpm), wal_(wal), interval_(interval) {}
+
+Checkpointer::~Checkpointer() {
+    Stop();
+}
+
+// ============================================================================
+// Start / Stop
+// ============================================================================
+
+void Checkpointer::Start() {
+    if (thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = false;
+    }
+    thread_ = std::thread(&Checkpointer::Loop, this);
+}
+
+void Checkpointer::Stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+// ============================================================================
+// Loop — wake up every interval and checkpoint
+// ============================================================================
+
+void Checkpointer::Loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        cv_.wait_for(lock, interval_, [this] { return stop_; });
+        if (stop_) break;
+
+        lock.unlock();
+        try {
+            RunOnce();
+        } catch (const std::exception& e) {
+            std::cerr << "Checkpointer: " << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+// ============================================================================
+// RunOnce — log a fuzzy checkpoint and drop the log prefix it makes obsolete
+// ============================================================================
+
+void Checkpointer::RunOnce() {
+    lsn_t begin_lsn = wal_->GetCurrentLSN();
+    if (begin_lsn - 1 == last_checkpoint_lsn_) return;  // Nothing logged since
+
+    std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;
+    lsn_t keep_from = begin_lsn;
+    for (const auto& [page_id, rec_lsn] : bpm_->GetDirtyPageTable()) {
+        dirty_pages.emplace_back(page_id, rec_lsn);
+        keep_from = std::min(keep_from, rec_lsn);
+    }
+    bpm_->SyncDisk();
+
+    lsn_t oldest_active;
+    lsn_t checkpoint_lsn = wal_->AppendCheckpoint(begin_lsn, std::move(dirty_pages), &oldest_active);
+    wal_->FlushUntil(checkpoint_lsn);
+    wal_->WriteMasterRecord(checkpoint_lsn);  // Only once the record is durable
+    if (oldest_active != INVALID_LSN) keep_from = std::min(keep_from, oldest_active);
+
+    wal_->TruncateBefore(keep_from);
+    last_checkpoint_lsn_ = checkpoint_lsn;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "recovery/wal.h"
+#include "storage_engine/buffer/buffer_pool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// ============================================================================
+// Checkpointer — fuzzy checkpoints for group-commit durability
+//
+// Requests are acknowledged once their log records are durable, and the
+// BackgroundWriter writes pages back behind them. Every interval the
+// checkpointer, without stopping requests:
+//   1. Notes begin_lsn, the next LSN to be assigned
+//   2. Collects the dirty page table (page -> recLSN) from the buffer pool
+//   3. fsyncs the data file, so pages that already left the table are durable
+//   4. Logs a CHECKPOINT record with that table and the active transaction
+//      table, flushes the WAL and points the master record at it
+//   5. Drops the log prefix no recovery can need: everything older than
+//      the checkpoint, the oldest recLSN and the oldest active transaction,
+//      a whole segment at a time
+//
+// Recovery then starts analysis at the last checkpoint instead of LSN 0.
+// ============================================================================
+
+class Checkpointer {
+public:
+    Checkpointer(BufferPoolManager* bpm, WAL* wal, std::chrono::milliseconds interval);
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    // Start / stop the background thread
+    void Start();
+    void Stop();
+
+    // Run one checkpoint now (skipped if nothing was logged since the last one)
+    void RunOnce();
+
+private:
+    void Loop();
+
+    BufferPoolManager* bpm_;
+    WAL* wal_;
+    std::chrono::milliseconds interval_;
+
+    lsn_t last_checkpoint_lsn_ = INVALID_LSN;  // LSN of the last CHECKPOINT record
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
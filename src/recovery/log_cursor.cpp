@@ -0,0 +1,169 @@
+#include "log_cursor.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Smallest serialized record: see LogRecord::Serialize
+static constexpr uint32_t MIN_RECORD_SIZE = 43;
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+LogCursor::LogCursor(WAL* wal) : wal_(wal), segments_(wal->ListSegments()) {}
+
+LogCursor::~LogCursor() {
+    Unmap(current_);
+    Unmap(random_);
+}
+
+// ============================================================================
+// Segment mapping
+// ============================================================================
+
+bool LogCursor::Map(Mapping& m, size_t index) {
+    if (m.start == segments_[index] && m.data) return true;
+    Unmap(m);
+    m.start = segments_[index];
+
+    std::string path = wal_->SegmentPath(m.start);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return false;  // Removed by truncation since the snapshot
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+    if (data == MAP_FAILED) return false;
+
+    madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    m.data = static_cast<const uint8_t*>(data);
+    m.size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void LogCursor::Unmap(Mapping& m) {
+    if (m.data) munmap(const_cast<uint8_t*>(m.data), m.size);
+    m = Mapping();
+}
+
+size_t LogCursor::SegmentFor(lsn_t lsn) const {
+    // Last segment whose start LSN is <= lsn
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), lsn);
+    return it == segments_.begin() ? 0 : static_cast<size_t>(it - segments_.begin()) - 1;
+}
+
+lsn_t LogCursor::PeekLSN(const Mapping& m, uint64_t offset, uint32_t* total_size) {
+    if (offset + 4 + sizeof(lsn_t) > m.size) return INVALID_LSN;
+    std::memcpy(total_size, m.data + offset, 4);
+    if (*total_size < MIN_RECORD_SIZE || offset + *total_size > m.size) return INVALID_LSN;
+    lsn_t lsn;
+    std::memcpy(&lsn, m.data + offset + 4, sizeof(lsn_t));
+    return lsn;
+}
+
+// ============================================================================
+// Forward scan
+// ============================================================================
+
+void LogCursor::Seek(lsn_t lsn) {
+    segment_ = segments_.empty() ? 0 : SegmentFor(lsn);
+    offset_ = 0;
+
+    // Skip whole records by their headers until we reach lsn
+    while (segment_ < segments_.size()) {
+        if (!Map(current_, segment_)) {
+            segment_++;
+            continue;
+        }
+        uint32_t total_size;
+        lsn_t at = PeekLSN(current_, offset_, &total_size);
+        if (at == INVALID_LSN) {
+            segment_++;
+            offset_ = 0;
+            continue;
+        }
+        if (at >= lsn) return;
+        offset_ += total_size;
+    }
+}
+
+bool LogCursor::Next(LogRecord* out, LogPosition* pos) {
+    while (segment_ < segments_.size()) {
+        if (Map(current_, segment_) && offset_ < current_.size) {
+            uint64_t start = offset_;
+            size_t offset = offset_;
+            try {
+                *out = LogRecord::Deserialize(current_.data, current_.size, offset);
+                offset_ = offset;
+                if (pos) *pos = LogPosition{segments_[segment_], start};
+                return true;
+            } catch (const std::runtime_error&) {
+                // Torn or corrupt: nothing more in this segment
+            }
+        }
+        Unmap(current_);
+        segment_++;
+        offset_ = 0;
+    }
+    return false;
+}
+
+// ============================================================================
+// Random access
+// ============================================================================
+
+bool LogCursor::ReadAt(const LogPosition& pos, LogRecord* out) {
+    auto it = std::lower_bound(segments_.begin(), segments_.end(), pos.segment);
+    if (it == segments_.end() || *it != pos.segment) return false;
+    if (!Map(random_, static_cast<size_t>(it - segments_.begin()))) return false;
+
+    size_t offset = pos.offset;
+    try {
+        *out = LogRecord::Deserialize(random_.data, random_.size, offset);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+const std::vector<std::pair<lsn_t, uint64_t>>& LogCursor::IndexFor(const Mapping& m) {
+    auto it = lsn_index_.find(m.start);
+    if (it != lsn_index_.end()) return it->second;
+
+    std::vector<std::pair<lsn_t, uint64_t>>& entries = lsn_index_[m.start];
+    uint64_t offset = 0;
+    uint32_t total_size;
+    lsn_t at;
+    for (size_t n = 0; (at = PeekLSN(m, offset, &total_size)) != INVALID_LSN; n++) {
+        if (n % INDEX_STRIDE == 0) entries.emplace_back(at, offset);
+        offset += total_size;
+    }
+    return entries;
+}
+
+bool LogCursor::ReadLSN(lsn_t lsn, LogRecord* out, LogPosition* pos) {
+    if (segments_.empty()) return false;
+    size_t index = SegmentFor(lsn);
+    if (!Map(random_, index)) return false;
+
+    // Start from the last indexed record at or before lsn
+    const auto& entries = IndexFor(random_);
+    auto entry = std::upper_bound(entries.begin(), entries.end(), std::make_pair(lsn, UINT64_MAX));
+    if (entry == entries.begin()) return false;
+    uint64_t offset = std::prev(entry)->second;
+    uint32_t total_size;
+    lsn_t at;
+    while ((at = PeekLSN(random_, offset, &total_size)) != INVALID_LSN && at < lsn) {
+        offset += total_size;
+    }
+    if (at != lsn) return false;
+    if (pos) *pos = LogPosition{segments_[index], offset};
+    return ReadAt(LogPosition{segments_[index], offset}, out);
+}
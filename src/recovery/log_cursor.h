@@ -0,0 +1,84 @@
+#pragma once
+
+#include "recovery/wal.h"
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// LogCursor — streams log records out of the WAL's segment files
+//
+// Each segment is mmap'd read-only while the cursor is inside it, and
+// records are decoded one at a time, so reading a large log costs one
+// segment of address space rather than the whole log in memory.
+//
+//   Next()     — forward scan (analysis, redo)
+//   Seek(lsn)  — continue the scan from the first record with lsn >= lsn
+//   ReadAt()   — random access to a record whose position Next() reported
+//   ReadLSN()  — random access by LSN (binary search on segment start LSNs,
+//                then on that segment's sparse LSN index, then a scan of
+//                at most INDEX_STRIDE headers); undo uses it to follow
+//                prev_lsn into records it has no position for
+//
+// A segment's LSN index holds the offset of every INDEX_STRIDE-th record.
+// It is built by one pass over the record headers, the first time ReadLSN
+// looks into the segment, and kept for the life of the cursor.
+//
+// The segment list is a snapshot taken at construction. A record cut short
+// by a crash ends its segment.
+// ============================================================================
+
+class LogCursor {
+public:
+    static constexpr size_t INDEX_STRIDE = 64;
+
+    explicit LogCursor(WAL* wal);
+    ~LogCursor();
+
+    LogCursor(const LogCursor&) = delete;
+    LogCursor& operator=(const LogCursor&) = delete;
+
+    // Position the cursor before the first record with lsn >= lsn
+    void Seek(lsn_t lsn);
+
+    // Read the next record; pos (optional) receives where it starts.
+    // Returns false at the end of the log.
+    bool Next(LogRecord* out, LogPosition* pos = nullptr);
+
+    // Read the record starting at pos. Does not move the forward scan.
+    bool ReadAt(const LogPosition& pos, LogRecord* out);
+
+    // Read the record with this LSN. Does not move the forward scan.
+    bool ReadLSN(lsn_t lsn, LogRecord* out, LogPosition* pos = nullptr);
+
+private:
+    struct Mapping {
+        lsn_t start = INVALID_LSN;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    // Map segments_[index] into m (unmapping whatever it held)
+    bool Map(Mapping& m, size_t index);
+    void Unmap(Mapping& m);
+
+    // Index of the segment that would hold lsn
+    size_t SegmentFor(lsn_t lsn) const;
+
+    // The LSN index of the segment mapped in m, built if need be
+    const std::vector<std::pair<lsn_t, uint64_t>>& IndexFor(const Mapping& m);
+
+    // LSN of the record at offset, or INVALID_LSN if none fits there
+    static lsn_t PeekLSN(const Mapping& m, uint64_t offset, uint32_t* total_size);
+
+    WAL* wal_;
+    std::vector<lsn_t> segments_;
+    size_t segment_ = 0;   // Forward scan: current segment index
+    uint64_t offset_ = 0;  // Forward scan: next record offset
+    Mapping current_;      // Mapping used by the forward scan
+    Mapping random_;       // Mapping used by ReadAt/ReadLSN
+
+    // Segment start LSN -> (lsn, offset) of every INDEX_STRIDE-th record
+    std::unordered_map<lsn_t, std::vector<std::pair<lsn_t, uint64_t>>> lsn_index_;
+};
@@ -1,13 +1,54 @@
 #include "recovery_manager.h"
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iomanip>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+// Records a redo worker may have queued before the reader waits for it
+static constexpr size_t REDO_QUEUE_LIMIT = 4096;
+
+struct RecoveryManager::RedoPartition {
+    std::unordered_map<page_id_t, lsn_t> dirty_pages;  // page -> recLSN
+    std::mutex mutex;
+    std::condition_variable cv;  // Queue became non-empty / non-full / closed
+    std::deque<LogRecord> queue;
+    bool closed = false;
+    size_t redone = 0;
+    size_t skipped = 0;
+    std::exception_ptr error;
+    std::thread thread;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double MillisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void PrintPhaseTiming(const char* phase, size_t records, double ms) {
+    double per_sec = ms > 0 ? records * 1000.0 / ms : 0;
+    std::cout << "  " << phase << ": " << records << " records in " << std::fixed
+              << std::setprecision(2) << ms << " ms (" << static_cast<uint64_t>(per_sec)
+              << " records/s)" << std::defaultfloat << std::endl;
+}
 
 // ============================================================================
-// Constructor
+// Constructor / Destructor
 // ============================================================================
 
-RecoveryManager::RecoveryManager(WAL* wal, BufferPoolManager* bpm)
-    : wal_(wal), bpm_(bpm) {}
+RecoveryManager::RecoveryManager(WAL* wal, BufferPoolManager* bpm, size_t redo_threads)
+    : wal_(wal), bpm_(bpm), redo_threads_(redo_threads) {
+    if (redo_threads_ == 0) redo_threads_ = std::max(1u, std::thread::hardware_concurrency());
+}
+
+RecoveryManager::~RecoveryManager() = default;
 
 // ============================================================================
 // Recover — run all 3 ARIES phases
@@ -16,41 +57,77 @@ RecoveryManager::RecoveryManager(WAL* wal, BufferPoolManager* bpm)
 void RecoveryManager::Recover() {
     std::cout << "=== RECOVERY START ===" << std::endl;
 
-    std::vector<LogRecord> records = wal_->ReadAllRecords();
-    if (records.empty()) {
+    if (wal_->IsEmpty()) {
         std::cout << "No WAL records found. Clean start." << std::endl;
         return;
     }
 
-    std::cout << "Read " << records.size() << " log records." << std::endl;
+    LogCursor cursor(wal_);
+    stats_ = RecoveryStats();
+    stats_.redo_threads = redo_threads_;
 
     // Phase 1: Analysis
-    std::unordered_set<txn_id_t> active_txns;
+    ActiveTxnTable active_txns;
     std::unordered_map<page_id_t, lsn_t> dirty_pages;
-    AnalysisPhase(records, active_txns, dirty_pages);
+    Clock::time_point start = Clock::now();
+    AnalysisPhase(cursor, active_txns, dirty_pages);
+    stats_.analysis_ms = MillisSince(start);
 
     // Phase 2: Redo
-    RedoPhase(records, dirty_pages);
+    start = Clock::now();
+    RedoPhase(cursor, dirty_pages);
+    stats_.redo_ms = MillisSince(start);
 
     // Phase 3: Undo
-    UndoPhase(records, active_txns);
-
-    std::cout << "=== RECOVERY COMPLETE ===" << std::endl;
+    start = Clock::now();
+    UndoPhase(cursor, active_txns);
+    stats_.undo_ms = MillisSince(start);
+
+    PrintPhaseTiming("Analysis", stats_.analysis_records, stats_.analysis_ms);
+    PrintPhaseTiming("Redo", stats_.redo_records, stats_.redo_ms);
+    PrintPhaseTiming("Undo", stats_.undone, stats_.undo_ms);
+    std::cout << "=== RECOVERY COMPLETE (" << std::fixed << std::setprecision(2)
+              << stats_.analysis_ms + stats_.redo_ms + stats_.undo_ms << " ms) ==="
+              << std::defaultfloat << std::endl;
 }
 
 // ============================================================================
 // Phase 1: Analysis
 // ============================================================================
 
-void RecoveryManager::AnalysisPhase(const std::vector<LogRecord>& records,
-                                     std::unordered_set<txn_id_t>& active_txns,
+void RecoveryManager::AnalysisPhase(LogCursor& cursor, ActiveTxnTable& active_txns,
                                      std::unordered_map<page_id_t, lsn_t>& dirty_pages) {
     std::cout << "[Analysis Phase]" << std::endl;
 
-    for (const auto& record : records) {
+    // Start from the tables of the last checkpoint, then roll them forward
+    // from the LSN at which that checkpoint began. Without a usable master
+    // record, scan everything that is left of the log.
+    lsn_t start_lsn = INVALID_LSN;
+    lsn_t master = wal_->ReadMasterRecord();
+    LogRecord record;
+    if (master != INVALID_LSN && cursor.ReadLSN(master, &record) &&
+        record.type == LogRecordType::CHECKPOINT) {
+        try {
+            CheckpointData ckpt = CheckpointData::Decode(record.after_image);
+            for (const auto& [page_id, rec_lsn] : ckpt.dirty_pages) dirty_pages[page_id] = rec_lsn;
+            for (const auto& [txn_id, last_lsn] : ckpt.active_txns) active_txns[txn_id].last_lsn = last_lsn;
+            start_lsn = ckpt.begin_lsn;
+            std::cout << "  Starting from checkpoint at LSN " << master
+                      << " (begin LSN " << start_lsn << ")" << std::endl;
+        } catch (const std::runtime_error&) {
+            dirty_pages.clear();
+            active_txns.clear();
+        }
+    }
+    cursor.Seek(start_lsn == INVALID_LSN ? 0 : start_lsn);
+
+    size_t scanned = 0;
+    LogPosition pos;
+    while (cursor.Next(&record, &pos)) {
+        scanned++;
         switch (record.type) {
             case LogRecordType::BEGIN:
-                active_txns.insert(record.txn_id);
+                active_txns[record.txn_id].last_lsn = record.lsn;
                 break;
 
             case LogRecordType::COMMIT:
@@ -61,16 +138,25 @@ void RecoveryManager::AnalysisPhase(const std::vector<LogRecord>& records,
             case LogRecordType::INSERT:
             case LogRecordType::DELETE:
             case LogRecordType::UPDATE:
-                active_txns.insert(record.txn_id);
+            case LogRecordType::CLR: {
+                TxnEntry& txn = active_txns[record.txn_id];
+                txn.last_lsn = record.lsn;
+                txn.positions[record.lsn] = pos;
                 if (record.page_id != INVALID_PAGE_ID) {
                     if (dirty_pages.find(record.page_id) == dirty_pages.end()) {
                         dirty_pages[record.page_id] = record.lsn;
                     }
                 }
                 break;
+            }
+
+            case LogRecordType::CHECKPOINT:
+                break;
         }
     }
 
+    stats_.analysis_records = scanned;
+    std::cout << "  Scanned " << scanned << " log records." << std::endl;
     std::cout << "  Active transactions: " << active_txns.size() << std::endl;
     std::cout << "  Dirty pages: " << dirty_pages.size() << std::endl;
 }
@@ -79,62 +165,159 @@ void RecoveryManager::AnalysisPhase(const std::vector<LogRecord>& records,
 // Phase 2: Redo
 // ============================================================================
 
-void RecoveryManager::RedoPhase(const std::vector<LogRecord>& records,
+void RecoveryManager::RedoPhase(LogCursor& cursor,
                                  const std::unordered_map<page_id_t, lsn_t>& dirty_pages) {
     std::cout << "[Redo Phase]" << std::endl;
 
-    int redo_count = 0;
+    if (dirty_pages.empty()) {
+        std::cout << "  Redone 0 operations." << std::endl;
+        return;
+    }
+
+    // Nothing below the oldest recLSN can be missing from disk
+    lsn_t redo_lsn = dirty_pages.begin()->second;
+    for (const auto& [page_id, rec_lsn] : dirty_pages) redo_lsn = std::min(redo_lsn, rec_lsn);
+    cursor.Seek(redo_lsn);
+
+    // Each page belongs to exactly one partition, so its records are
+    // replayed in log order no matter how the workers interleave
+    const size_t n = redo_threads_;
+    std::vector<std::unique_ptr<RedoPartition>> parts;
+    for (size_t i = 0; i < n; i++) parts.push_back(std::make_unique<RedoPartition>());
+    for (const auto& [page_id, rec_lsn] : dirty_pages) {
+        parts[static_cast<size_t>(page_id) % n]->dirty_pages[page_id] = rec_lsn;
+    }
+    if (n > 1) {
+        for (auto& part : parts) {
+            part->thread = std::thread(&RecoveryManager::RunPartition, this, std::ref(*part));
+        }
+    }
 
-    for (const auto& record : records) {
+    LogRecord record;
+    size_t scanned = 0;
+    while (cursor.Next(&record)) {
+        scanned++;
         if (record.type != LogRecordType::INSERT &&
             record.type != LogRecordType::DELETE &&
-            record.type != LogRecordType::UPDATE) {
+            record.type != LogRecordType::UPDATE &&
+            record.type != LogRecordType::CLR) {
             continue;
         }
-
         if (record.page_id == INVALID_PAGE_ID) continue;
 
-        // Check if page is in dirty page table and if record LSN >= first dirty LSN
-        auto it = dirty_pages.find(record.page_id);
-        if (it == dirty_pages.end()) continue;
-        if (record.lsn < it->second) continue;
+        RedoPartition& part = *parts[static_cast<size_t>(record.page_id) % n];
+        if (n == 1) {
+            ReplayRecord(record, part);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(part.mutex);
+        part.cv.wait(lock, [&part] { return part.queue.size() < REDO_QUEUE_LIMIT; });
+        part.queue.push_back(std::move(record));
+        part.cv.notify_all();
+    }
 
-        // Redo the operation
-        Page* page = bpm_->FetchPage(record.page_id);
-        if (!page) continue;
+    for (auto& part : parts) {
+        {
+            std::lock_guard<std::mutex> lock(part->mutex);
+            part->closed = true;
+        }
+        part->cv.notify_all();
+    }
+    std::exception_ptr error;
+    for (auto& part : parts) {
+        if (part->thread.joinable()) part->thread.join();
+        if (part->error && !error) error = part->error;
+        stats_.redone += part->redone;
+        stats_.redo_skipped += part->skipped;
+    }
+    if (error) std::rethrow_exception(error);
+    stats_.redo_records = scanned;
 
-        if (record.type == LogRecordType::INSERT) {
-            // Re-insert the after image
-            if (!record.after_image.empty()) {
-                SlottedPage::InsertRecord(page->GetData(),
-                    record.after_image.data(),
-                    static_cast<uint16_t>(record.after_image.size()));
-                redo_count++;
-            }
-        } else if (record.type == LogRecordType::DELETE) {
-            SlottedPage::DeleteRecord(page->GetData(), record.slot_id);
-            redo_count++;
-        } else if (record.type == LogRecordType::UPDATE) {
-            if (!record.after_image.empty()) {
-                SlottedPage::UpdateRecord(page->GetData(), record.slot_id,
-                    record.after_image.data(),
-                    static_cast<uint16_t>(record.after_image.size()));
-                redo_count++;
+    std::cout << "  Redone " << stats_.redone << " operations, skipped " << stats_.redo_skipped
+              << " already on disk (" << n << " thread" << (n == 1 ? "" : "s") << ")." << std::endl;
+}
+
+void RecoveryManager::RunPartition(RedoPartition& part) {
+    std::unique_lock<std::mutex> lock(part.mutex);
+    while (true) {
+        part.cv.wait(lock, [&part] { return !part.queue.empty() || part.closed; });
+        if (part.queue.empty()) return;  // Closed and drained
+
+        LogRecord record = std::move(part.queue.front());
+        part.queue.pop_front();
+        part.cv.notify_all();  // The reader may be waiting for room
+        lock.unlock();
+        // After a failure the rest of the queue is drained unapplied, so
+        // the reader never blocks on us
+        if (!part.error) {
+            try {
+                ReplayRecord(record, part);
+            } catch (...) {
+                part.error = std::current_exception();
             }
         }
+        lock.lock();
+    }
+}
+
+void RecoveryManager::ReplayRecord(const LogRecord& record, RedoPartition& part) {
+    // Not dirty, or dirtied only after this record: already on disk,
+    // decided without fetching the page
+    auto it = part.dirty_pages.find(record.page_id);
+    if (it == part.dirty_pages.end()) return;
+    if (record.lsn < it->second) {
+        part.skipped++;
+        return;
+    }
+
+    Page* page = bpm_->FetchPage(record.page_id);
+    if (!page) return;
+    page->WLatch();
+
+    // The page on disk already has this change. Every earlier record for
+    // it is applied as well, so raise the recLSN past the pageLSN and let
+    // the check above skip them without another fetch.
+    lsn_t page_lsn = SlottedPage::GetPageLSN(page->GetData());
+    if (page_lsn >= record.lsn) {
+        it->second = page_lsn + 1;
+        page->WUnlatch();
+        bpm_->UnpinPage(record.page_id, false);
+        part.skipped++;
+        return;
+    }
 
-        bpm_->UnpinPage(record.page_id, true);
+    // A CLR with no after image freed its slot
+    bool freed = record.type == LogRecordType::DELETE ||
+                 (record.type == LogRecordType::CLR && record.after_image.empty());
+    if (!freed) {
+        // Put the after image back at the logged slot
+        if (!record.after_image.empty()) {
+            SlottedPage::PutRecordAt(page->GetData(), record.slot_id,
+                record.after_image.data(),
+                static_cast<uint16_t>(record.after_image.size()), bpm_->GetPageSize());
+            part.redone++;
+        }
+    } else {
+        SlottedPage::DeleteRecord(page->GetData(), record.slot_id);
+        part.redone++;
     }
+    SlottedPage::SetPageLSN(page->GetData(), record.lsn);
+    page->SetPageLSN(record.lsn);
 
-    std::cout << "  Redone " << redo_count << " operations." << std::endl;
+    page->WUnlatch();
+    bpm_->UnpinPage(record.page_id, true);
 }
 
 // ============================================================================
 // Phase 3: Undo
+//
+// Newest first across all losers: always the largest pending LSN, then
+// the record before it in the same transaction. A CLR is not undone; it
+// sends undo to the record before the one it compensated. A loser whose
+// chain runs out gets an ABORT, so later recoveries leave it alone.
 // ============================================================================
 
-void RecoveryManager::UndoPhase(const std::vector<LogRecord>& records,
-                                 const std::unordered_set<txn_id_t>& active_txns) {
+void RecoveryManager::UndoPhase(LogCursor& cursor, const ActiveTxnTable& active_txns) {
     std::cout << "[Undo Phase]" << std::endl;
 
     if (active_txns.empty()) {
@@ -142,46 +325,101 @@ void RecoveryManager::UndoPhase(const std::vector<LogRecord>& records,
         return;
     }
 
-    int undo_count = 0;
-
-    // Process log records in reverse order
-    for (auto it = records.rbegin(); it != records.rend(); ++it) {
-        const LogRecord& record = *it;
+    std::priority_queue<std::pair<lsn_t, txn_id_t>> to_undo;
+    for (const auto& [txn_id, txn] : active_txns) {
+        if (txn.last_lsn != INVALID_LSN) to_undo.push({txn.last_lsn, txn_id});
+    }
 
-        if (active_txns.find(record.txn_id) == active_txns.end()) {
-            continue;  // Not an active (uncommitted) transaction
+    LogRecord record;
+    while (!to_undo.empty()) {
+        auto [lsn, txn_id] = to_undo.top();
+        to_undo.pop();
+
+        const TxnEntry& txn = active_txns.at(txn_id);
+        auto pos = txn.positions.find(lsn);
+        bool found = pos != txn.positions.end() ? cursor.ReadAt(pos->second, &record)
+                                                : cursor.ReadLSN(lsn, &record);
+        // Truncated away: nothing older survives either
+        lsn_t next = INVALID_LSN;
+        if (found) {
+            if (record.type == LogRecordType::CLR) {
+                next = record.undo_next_lsn;
+            } else {
+                next = record.prev_lsn;
+                if (!UndoRecord(record)) stats_.undo_skipped++;
+            }
+        }
+        if (next != INVALID_LSN) {
+            to_undo.push({next, txn_id});
+            continue;
         }
 
-        if (record.page_id == INVALID_PAGE_ID) continue;
+        LogRecord abort;
+        abort.txn_id = txn_id;
+        abort.type = LogRecordType::ABORT;
+        abort.page_id = INVALID_PAGE_ID;
+        abort.slot_id = 0;
+        wal_->AppendLogRecord(abort);
+    }
+    // The CLRs and ABORTs are durable before anyone relies on the undo
+    wal_->Flush();
 
-        Page* page = bpm_->FetchPage(record.page_id);
-        if (!page) continue;
+    std::cout << "  Undone " << stats_.undone << " operations from "
+              << active_txns.size() << " uncommitted transactions";
+    if (stats_.undo_skipped > 0) std::cout << ", " << stats_.undo_skipped << " slots reused since";
+    std::cout << "." << std::endl;
+}
 
+// The page holds every change logged for it once redo is done; one it
+// does not show (pageLSN behind the record) never reached it. A slot
+// that no longer holds what the change left there (the inserted or
+// updated bytes, or nothing after a delete) was taken by a transaction
+// that went on to commit, and restoring over it would lose that.
+bool RecoveryManager::UndoRecord(const LogRecord& record) {
+    if (record.page_id == INVALID_PAGE_ID) return true;
+    bool restores = record.type == LogRecordType::DELETE || record.type == LogRecordType::UPDATE;
+    if (record.type != LogRecordType::INSERT && !restores) return true;
+    if (restores && record.before_image.empty()) return true;
+
+    Page* page = bpm_->FetchPage(record.page_id);
+    if (!page) return false;
+    page->WLatch();
+    char* data = page->GetData();
+
+    bool undone = false;
+    bool on_page = SlottedPage::GetPageLSN(data) >= record.lsn;
+    uint16_t len = 0;
+    const uint8_t* current = SlottedPage::GetRecord(data, record.slot_id, &len);
+    bool intact = record.type == LogRecordType::DELETE
+                      ? current == nullptr
+                      : current && len == record.after_image.size() &&
+                            std::memcmp(current, record.after_image.data(), len) == 0;
+    if (on_page && intact) {
         if (record.type == LogRecordType::INSERT) {
-            // Undo insert → delete
-            SlottedPage::DeleteRecord(page->GetData(), record.slot_id);
-            undo_count++;
-        } else if (record.type == LogRecordType::DELETE) {
-            // Undo delete → re-insert before image
-            if (!record.before_image.empty()) {
-                SlottedPage::InsertRecord(page->GetData(),
-                    record.before_image.data(),
-                    static_cast<uint16_t>(record.before_image.size()));
-                undo_count++;
-            }
-        } else if (record.type == LogRecordType::UPDATE) {
-            // Undo update → restore before image
-            if (!record.before_image.empty()) {
-                SlottedPage::UpdateRecord(page->GetData(), record.slot_id,
-                    record.before_image.data(),
-                    static_cast<uint16_t>(record.before_image.size()));
-                undo_count++;
-            }
+            undone = SlottedPage::DeleteRecord(data, record.slot_id);
+        } else {
+            undone = SlottedPage::PutRecordAt(data, record.slot_id, record.before_image.data(),
+                                              static_cast<uint16_t>(record.before_image.size()),
+                                              bpm_->GetPageSize());
         }
+    }
 
-        bpm_->UnpinPage(record.page_id, true);
+    if (undone) {
+        LogRecord clr;
+        clr.txn_id = record.txn_id;
+        clr.type = LogRecordType::CLR;
+        clr.page_id = record.page_id;
+        clr.slot_id = record.slot_id;
+        if (restores) clr.after_image = record.before_image;
+        clr.undo_next_lsn = record.prev_lsn;
+        page->NoteLoggedChange(wal_->GetCurrentLSN());
+        lsn_t lsn = wal_->AppendLogRecord(clr);
+        SlottedPage::SetPageLSN(data, lsn);
+        page->SetPageLSN(lsn);
+        stats_.undone++;
     }
 
-    std::cout << "  Undone " << undo_count << " operations from "
-              << active_txns.size() << " uncommitted transactions." << std::endl;
+    page->WUnlatch();
+    bpm_->UnpinPage(record.page_id, undone);
+    return undone || !on_page;
 }
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "recovery/wal.h"
+#include "recovery/log_cursor.h"
 #include "storage_engine/buffer/buffer_pool.h"
 #include "storage_engine/page/slotted_page.h"
+#include <cstddef>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -11,32 +14,87 @@
 // Recovery Manager — ARIES-style crash recovery
 //
 // Three phases:
-//   1. Analysis: Scan log to find active transactions and dirty pages
-//   2. Redo:     Replay all logged actions to bring data to crash state
-//   3. Undo:     Roll back all uncommitted transactions
+//   1. Analysis: Scan log to find active transactions and dirty pages,
+//                starting from the checkpoint named by the master record
+//                if there is one
+//   2. Redo:     Replay all logged actions to bring data to crash state,
+//                scanning forward from the smallest recLSN. A record is
+//                skipped when the page's recLSN is past it (no fetch) or
+//                the page's pageLSN shows it was already applied, so redo
+//                is idempotent. Records are dispatched to redo_threads
+//                workers by page_id, keeping per-page LSN order while
+//                independent pages replay concurrently.
+//   3. Undo:     Roll back all uncommitted transactions by following their
+//                prev_lsn chains, newest record first. Each change is
+//                undone under the page latch and logged as a CLR whose
+//                undo_next_lsn skips what it compensated; a loser ends
+//                with an ABORT. A crash during undo is then recovered like
+//                any other: redo replays the CLRs, undo resumes where the
+//                last one points. A change is undone only while its slot
+//                still holds what the change left there (see UndoRecord).
+//
+// The log is streamed through a LogCursor; no phase holds it in memory.
 // ============================================================================
 
+// Wall-clock time and records processed per phase of the last Recover()
+struct RecoveryStats {
+    double analysis_ms = 0, redo_ms = 0, undo_ms = 0;
+    size_t analysis_records = 0;  // Records scanned
+    size_t redo_records = 0;      // Records scanned from the redo LSN
+    size_t redone = 0;            // Changes reapplied
+    size_t redo_skipped = 0;      // Changes found already on disk
+    size_t undone = 0;            // Changes rolled back
+    size_t undo_skipped = 0;      // Changes whose slot another transaction has reused since
+    size_t redo_threads = 0;
+};
+
 class RecoveryManager {
 public:
-    RecoveryManager(WAL* wal, BufferPoolManager* bpm);
+    // redo_threads = 0 uses one per core; 1 replays on the calling thread
+    RecoveryManager(WAL* wal, BufferPoolManager* bpm, size_t redo_threads = 0);
+    ~RecoveryManager();
 
     // Run full ARIES recovery
     void Recover();
 
+    const RecoveryStats& GetStats() const { return stats_; }
+
 private:
+    // One redo worker: the pages with page_id % redo_threads == its index,
+    // their slice of the dirty page table, and a queue of records
+    struct RedoPartition;
+
+    // Active transaction table entry: the newest record of the transaction,
+    // plus where analysis saw its records (lets undo skip the LSN lookup)
+    struct TxnEntry {
+        lsn_t last_lsn = INVALID_LSN;
+        std::unordered_map<lsn_t, LogPosition> positions;
+    };
+    using ActiveTxnTable = std::unordered_map<txn_id_t, TxnEntry>;
+
     // Phase 1: Build the active transaction table and dirty page table
-    void AnalysisPhase(const std::vector<LogRecord>& records,
-                       std::unordered_set<txn_id_t>& active_txns,
+    void AnalysisPhase(LogCursor& cursor, ActiveTxnTable& active_txns,
                        std::unordered_map<page_id_t, lsn_t>& dirty_pages);
 
     // Phase 2: Redo all actions from the log
-    void RedoPhase(const std::vector<LogRecord>& records,
-                   const std::unordered_map<page_id_t, lsn_t>& dirty_pages);
+    void RedoPhase(LogCursor& cursor, const std::unordered_map<page_id_t, lsn_t>& dirty_pages);
+
+    // Redo one record if its page still needs it (recLSNs in the
+    // partition's table move up as pageLSNs show what is already on disk)
+    void ReplayRecord(const LogRecord& record, RedoPartition& part);
+
+    // Worker thread body: replay queued records until the queue is closed
+    void RunPartition(RedoPartition& part);
 
     // Phase 3: Undo all uncommitted transactions
-    void UndoPhase(const std::vector<LogRecord>& records,
-                   const std::unordered_set<txn_id_t>& active_txns);
+    void UndoPhase(LogCursor& cursor, const ActiveTxnTable& active_txns);
+
+    // Undo one INSERT / DELETE / UPDATE and log its CLR. False if the
+    // slot no longer holds what the change left (see the .cpp).
+    bool UndoRecord(const LogRecord& record);
 
     WAL* wal_;
     BufferPoolManager* bpm_;
+    size_t redo_threads_;
+    RecoveryStats stats_;
 };
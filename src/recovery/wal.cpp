@@ -1,14 +1,23 @@
 #include "wal.h"
+#include "log_cursor.h"
+#include "storage_engine/common/metrics.h"
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 // ============================================================================
 // LogRecord Serialization
 //
 // Format: [total_size(4)] [lsn(8)] [txn_id(8)] [prev_lsn(8)] [type(1)]
 //         [page_id(4)] [slot_id(2)] [before_len(4)] [before_data...]
-//         [after_len(4)] [after_data...]
+//         [after_len(4)] [after_data...] [undo_next_lsn(8), CLR only]
 // ============================================================================
 
 std::vector<uint8_t> LogRecord::Serialize() const {
@@ -49,6 +58,11 @@ std::vector<uint8_t> LogRecord::Serialize() const {
                reinterpret_cast<const uint8_t*>(&after_len) + 4);
     buf.insert(buf.end(), after_image.begin(), after_image.end());
 
+    if (type == LogRecordType::CLR) {
+        buf.insert(buf.end(), reinterpret_cast<const uint8_t*>(&undo_next_lsn),
+                   reinterpret_cast<const uint8_t*>(&undo_next_lsn) + 8);
+    }
+
     // Write total size at the beginning
     uint32_t total_size = static_cast<uint32_t>(buf.size());
     std::memcpy(buf.data(), &total_size, 4);
@@ -64,7 +78,12 @@ LogRecord LogRecord::Deserialize(const uint8_t* data, size_t size, size_t& offse
     std::memcpy(&total_size, data + offset, 4);
     offset += 4;
 
-    size_t start = offset;
+    // A record cut short by a crash mid-write is treated as the end of the log
+    if (total_size < 43 || offset - 4 + total_size > size) {
+        throw std::runtime_error("WAL: Truncated log record (body)");
+    }
+
+    size_t record_end = offset - 4 + total_size;
 
     std::memcpy(&record.lsn, data + offset, 8); offset += 8;
     std::memcpy(&record.txn_id, data + offset, 8); offset += 8;
@@ -75,88 +94,441 @@ LogRecord LogRecord::Deserialize(const uint8_t* data, size_t size, size_t& offse
 
     uint32_t before_len;
     std::memcpy(&before_len, data + offset, 4); offset += 4;
+    if (offset + before_len + 4 > record_end) throw std::runtime_error("WAL: Corrupt log record");
     record.before_image.assign(data + offset, data + offset + before_len);
     offset += before_len;
 
     uint32_t after_len;
     std::memcpy(&after_len, data + offset, 4); offset += 4;
+    if (offset + after_len > record_end) throw std::runtime_error("WAL: Corrupt log record");
     record.after_image.assign(data + offset, data + offset + after_len);
     offset += after_len;
 
+    if (record.type == LogRecordType::CLR) {
+        if (offset + 8 > record_end) throw std::runtime_error("WAL: Corrupt log record");
+        std::memcpy(&record.undo_next_lsn, data + offset, 8); offset += 8;
+    }
+
     return record;
 }
 
 // ============================================================================
-// WAL Implementation
+// CheckpointData Encoding
+//
+// Format: [begin_lsn(8)] [num_dirty(4)] {[page_id(4)] [rec_lsn(8)]}...
+//         [num_active(4)] {[txn_id(8)] [last_lsn(8)]}...
 // ============================================================================
 
-WAL::WAL(const std::string& log_file_name) : log_file_name_(log_file_name) {
-    log_file_.open(log_file_name_, std::ios::binary | std::ios::app);
-    if (!log_file_.is_open()) {
-        throw std::runtime_error("WAL: Failed to open log file: " + log_file_name_);
+template <typename T>
+static void Put(std::vector<uint8_t>& buf, const T& value) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+static T Get(const std::vector<uint8_t>& buf, size_t& offset) {
+    if (offset + sizeof(T) > buf.size()) throw std::runtime_error("WAL: Corrupt checkpoint record");
+    T value;
+    std::memcpy(&value, buf.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+}
+
+std::vector<uint8_t> CheckpointData::Encode() const {
+    std::vector<uint8_t> buf;
+    Put(buf, begin_lsn);
+    Put(buf, static_cast<uint32_t>(dirty_pages.size()));
+    for (const auto& [page_id, rec_lsn] : dirty_pages) {
+        Put(buf, page_id);
+        Put(buf, rec_lsn);
     }
+    Put(buf, static_cast<uint32_t>(active_txns.size()));
+    for (const auto& [txn_id, last_lsn] : active_txns) {
+        Put(buf, txn_id);
+        Put(buf, last_lsn);
+    }
+    return buf;
+}
+
+CheckpointData CheckpointData::Decode(const std::vector<uint8_t>& data) {
+    CheckpointData ckpt;
+    size_t offset = 0;
+    ckpt.begin_lsn = Get<lsn_t>(data, offset);
+    uint32_t num_dirty = Get<uint32_t>(data, offset);
+    for (uint32_t i = 0; i < num_dirty; i++) {
+        page_id_t page_id = Get<page_id_t>(data, offset);
+        lsn_t rec_lsn = Get<lsn_t>(data, offset);
+        ckpt.dirty_pages.emplace_back(page_id, rec_lsn);
+    }
+    uint32_t num_active = Get<uint32_t>(data, offset);
+    for (uint32_t i = 0; i < num_active; i++) {
+        txn_id_t txn_id = Get<txn_id_t>(data, offset);
+        lsn_t last_lsn = Get<lsn_t>(data, offset);
+        ckpt.active_txns.emplace_back(txn_id, last_lsn);
+    }
+    return ckpt;
+}
+
+// ============================================================================
+// Segment helpers
+// ============================================================================
+
+// Length of the longest prefix of the file made of whole records; the LSN
+// of the last of them goes to *last_lsn (left alone if there is none)
+static uint64_t ValidPrefix(const std::string& path, lsn_t* last_lsn) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in.is_open()) return 0;
+    size_t file_size = in.tellg();
+    in.seekg(0);
+    std::vector<uint8_t> data(file_size);
+    in.read(reinterpret_cast<char*>(data.data()), file_size);
+
+    size_t offset = 0;
+    while (offset < file_size) {
+        size_t start = offset;
+        try {
+            *last_lsn = LogRecord::Deserialize(data.data(), file_size, offset).lsn;
+        } catch (...) {
+            return start;  // Torn or corrupt from here on
+        }
+    }
+    return offset;
+}
+
+static void SyncDirectoryOf(const std::string& path) {
+    std::string dir = std::filesystem::path(path).parent_path().string();
+    int dir_fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd == -1) return;
+    fsync(dir_fd);
+    close(dir_fd);
+}
+
+// ============================================================================
+// WAL Implementation
+// ============================================================================
+
+WAL::WAL(const std::string& log_file_name, bool force_on_commit, uint64_t segment_size)
+    : log_file_name_(log_file_name), force_on_commit_(force_on_commit), segment_size_(segment_size) {
+    std::lock_guard<std::mutex> flush_guard(flush_latch_);
+    OpenSegments();
 }
 
 WAL::~WAL() {
     if (!buffer_.empty()) {
         Flush();
     }
-    if (log_file_.is_open()) {
-        log_file_.close();
+    if (fd_ != -1) {
+        close(fd_);
     }
 }
 
-lsn_t WAL::AppendLogRecord(LogRecord& record) {
-    std::lock_guard<std::mutex> guard(latch_);
+std::string WAL::SegmentPath(lsn_t start_lsn) const {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%020lld", static_cast<long long>(start_lsn));
+    return log_file_name_ + suffix;
+}
+
+void WAL::OpenSegments() {
+    namespace fs = std::filesystem;
+    fs::path base(log_file_name_);
+    fs::path dir = base.parent_path().empty() ? fs::path(".") : base.parent_path();
+    std::string prefix = base.filename().string() + ".";
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() != prefix.size() + 20 || name.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string digits = name.substr(prefix.size());
+        if (digits.find_first_not_of("0123456789") != std::string::npos) continue;
+        segments_.push_back(std::stoll(digits));
+    }
+
+    // A log from before segmentation is a single file named <base>
+    if (fs::is_regular_file(base, ec)) {
+        lsn_t first = INVALID_LSN;
+        std::ifstream in(log_file_name_, std::ios::binary);
+        uint8_t header[12];
+        if (in.read(reinterpret_cast<char*>(header), sizeof(header))) {
+            std::memcpy(&first, header + 4, sizeof(lsn_t));
+        }
+        in.close();
+        if (first >= 0 && std::find(segments_.begin(), segments_.end(), first) == segments_.end()) {
+            fs::rename(base, SegmentPath(first), ec);
+            if (!ec) segments_.push_back(first);
+        } else if (first == INVALID_LSN) {
+            fs::remove(base, ec);
+        }
+    }
+    std::sort(segments_.begin(), segments_.end());
+
+    if (segments_.empty()) {
+        StartSegment(0);
+        return;
+    }
+
+    // Continue the LSN sequence after the newest record. A record torn by a
+    // crash at the end of the active segment is cut off, or appends would
+    // land behind bytes no reader gets past.
+    lsn_t last = INVALID_LSN;
+    for (size_t i = segments_.size(); i-- > 0 && last == INVALID_LSN;) {
+        std::string path = SegmentPath(segments_[i]);
+        uint64_t valid = ValidPrefix(path, &last);
+        if (i == segments_.size() - 1) {
+            if (valid < static_cast<uint64_t>(fs::file_size(path, ec)) && !ec) {
+                std::cerr << "WAL: dropping torn tail of " << path << std::endl;
+                if (truncate(path.c_str(), static_cast<off_t>(valid)) == -1) {
+                    throw std::runtime_error("WAL: cannot trim " + path + ": " + strerror(errno));
+                }
+            }
+            segment_bytes_ = valid;
+        }
+    }
+    next_lsn_ = std::max(last + 1, segments_.back());
+    buffered_lsn_ = next_lsn_ - 1;
+    flushed_lsn_ = next_lsn_ - 1;
+
+    fd_ = open(SegmentPath(segments_.back()).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0664);
+    if (fd_ == -1) {
+        throw std::runtime_error("WAL: Failed to open log file: " + SegmentPath(segments_.back()) +
+                                 " (" + strerror(errno) + ")");
+    }
+}
+
+void WAL::StartSegment(lsn_t start_lsn) {
+    std::string path = SegmentPath(start_lsn);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0664);
+    if (fd == -1) {
+        throw std::runtime_error("WAL: Failed to open log file: " + path + " (" + strerror(errno) + ")");
+    }
+    if (fd_ != -1) close(fd_);
+    fd_ = fd;
+    segments_.push_back(start_lsn);
+    segment_bytes_ = 0;
+    SyncDirectoryOf(path);  // The new file must survive a crash, not just its data
+}
 
+void WAL::AppendLocked(LogRecord& record) {
     record.lsn = next_lsn_++;
     record.prev_lsn = GetPrevLSN(record.txn_id);
-    txn_prev_lsn_[record.txn_id] = record.lsn;
+
+    if (record.type == LogRecordType::COMMIT || record.type == LogRecordType::ABORT) {
+        txn_prev_lsn_.erase(record.txn_id);  // Transaction is finished
+        txn_first_lsn_.erase(record.txn_id);
+    } else {
+        txn_prev_lsn_[record.txn_id] = record.lsn;
+        txn_first_lsn_.emplace(record.txn_id, record.lsn);  // Kept if already there
+    }
 
     std::vector<uint8_t> serialized = record.Serialize();
+    Metrics::Add(Counter::WAL_APPENDS);
+    Metrics::Add(Counter::WAL_APPEND_BYTES, serialized.size());
+    if (buffer_.empty()) buffer_first_lsn_ = record.lsn;
     buffer_.insert(buffer_.end(), serialized.begin(), serialized.end());
+    buffered_lsn_ = record.lsn;
+}
 
-    // Force flush on COMMIT
-    if (record.type == LogRecordType::COMMIT) {
-        // Write buffer to file
-        log_file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
-        log_file_.flush();
-        buffer_.clear();
+lsn_t WAL::AppendLogRecord(LogRecord& record) {
+    bool force = false;
+    {
+        Metrics::Timer timer(Histogram::WAL_APPEND);
+        std::lock_guard<std::mutex> guard(latch_);
+        AppendLocked(record);
+        force = force_on_commit_ && record.type == LogRecordType::COMMIT;
+    }
+
+    // Force flush on COMMIT (unless the caller batches commits itself)
+    if (force) {
+        FlushUntil(record.lsn);
     }
 
     return record.lsn;
 }
 
+lsn_t WAL::AppendLogRecords(std::vector<LogRecord>& records) {
+    if (records.empty()) return INVALID_LSN;
+    bool force = false;
+    {
+        Metrics::Timer timer(Histogram::WAL_APPEND);
+        std::lock_guard<std::mutex> guard(latch_);
+        for (LogRecord& record : records) {
+            AppendLocked(record);
+            force = force || (force_on_commit_ && record.type == LogRecordType::COMMIT);
+        }
+    }
+    if (force) {
+        FlushUntil(records.back().lsn);
+    }
+    return records.back().lsn;
+}
+
 void WAL::Flush() {
-    std::lock_guard<std::mutex> guard(latch_);
-    if (!buffer_.empty()) {
-        log_file_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
-        log_file_.flush();
-        buffer_.clear();
+    lsn_t target;
+    {
+        std::lock_guard<std::mutex> guard(latch_);
+        target = buffered_lsn_;
     }
+    FlushUntil(target);
 }
 
-std::vector<LogRecord> WAL::ReadAllRecords() {
-    std::vector<LogRecord> records;
+void WAL::FlushUntil(lsn_t lsn) {
+    if (lsn == INVALID_LSN || flushed_lsn_.load() >= lsn) return;
 
-    std::ifstream in(log_file_name_, std::ios::binary | std::ios::ate);
-    if (!in.is_open()) return records;
+    std::lock_guard<std::mutex> flush_guard(flush_latch_);
 
-    size_t file_size = in.tellg();
-    in.seekg(0);
+    // Another thread may have flushed our records while we waited
+    if (flushed_lsn_.load() >= lsn) return;
 
-    std::vector<uint8_t> data(file_size);
-    in.read(reinterpret_cast<char*>(data.data()), file_size);
+    std::vector<uint8_t> to_write;
+    lsn_t first;
+    lsn_t upto;
+    {
+        std::lock_guard<std::mutex> guard(latch_);
+        to_write.swap(buffer_);
+        first = buffer_first_lsn_;
+        upto = buffered_lsn_;
+    }
 
-    size_t offset = 0;
-    while (offset < file_size) {
+    if (!to_write.empty()) {
         try {
-            records.push_back(LogRecord::Deserialize(data.data(), file_size, offset));
+            if (segment_bytes_ >= segment_size_) StartSegment(first);
+            WriteAndSync(to_write);
         } catch (...) {
-            break;  // Truncated or corrupt — stop
+            // The records keep their LSNs: put them back in front of any
+            // appended since, for the next flush to retry
+            std::lock_guard<std::mutex> guard(latch_);
+            to_write.insert(to_write.end(), buffer_.begin(), buffer_.end());
+            buffer_.swap(to_write);
+            buffer_first_lsn_ = first;
+            throw;
+        }
+    }
+    flushed_lsn_ = upto;
+}
+
+void WAL::WriteAndSync(const std::vector<uint8_t>& data) {
+    Metrics::Timer timer(Histogram::WAL_FSYNC);
+    // On failure the segment is cut back to where this write began, so a
+    // retry of the same bytes does not leave a partial copy ahead of them
+    auto fail = [this](const char* what) {
+        std::string message = std::string("WAL: ") + what + " failed: " + strerror(errno);
+        if (ftruncate(fd_, static_cast<off_t>(segment_bytes_)) == -1) {
+            message += " (and the segment could not be cut back)";
+        }
+        throw std::runtime_error(message);
+    };
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd_, data.data() + written, data.size() - written);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            fail("write");
+        }
+        written += static_cast<size_t>(n);
+    }
+    if (fdatasync(fd_) == -1) fail("fdatasync");
+    segment_bytes_ += data.size();
+}
+
+void WAL::Truncate() {
+    std::lock_guard<std::mutex> flush_guard(flush_latch_);
+    for (lsn_t start : segments_) {
+        if (unlink(SegmentPath(start).c_str()) == -1 && errno != ENOENT) {
+            throw std::runtime_error("WAL: truncate failed: " + std::string(strerror(errno)));
         }
     }
+    segments_.clear();
+    unlink((log_file_name_ + ".master").c_str());  // Its checkpoint is gone
+    StartSegment(flushed_lsn_.load() + 1);
+}
 
+void WAL::TruncateBefore(lsn_t keep_from) {
+    std::lock_guard<std::mutex> flush_guard(flush_latch_);
+    // Every record of segment 0 is below segment 1's start LSN
+    while (segments_.size() > 1 && segments_[1] <= keep_from) {
+        if (unlink(SegmentPath(segments_.front()).c_str()) == -1 && errno != ENOENT) {
+            throw std::runtime_error("WAL: cannot remove segment: " + std::string(strerror(errno)));
+        }
+        segments_.erase(segments_.begin());
+    }
+}
+
+lsn_t WAL::AppendCheckpoint(lsn_t begin_lsn,
+                            std::vector<std::pair<page_id_t, lsn_t>> dirty_pages,
+                            lsn_t* oldest_active_lsn) {
+    std::lock_guard<std::mutex> guard(latch_);
+
+    CheckpointData ckpt;
+    ckpt.begin_lsn = begin_lsn;
+    ckpt.dirty_pages = std::move(dirty_pages);
+    ckpt.active_txns.assign(txn_prev_lsn_.begin(), txn_prev_lsn_.end());
+
+    lsn_t oldest = INVALID_LSN;
+    for (const auto& [txn_id, first_lsn] : txn_first_lsn_) {
+        if (oldest == INVALID_LSN || first_lsn < oldest) oldest = first_lsn;
+    }
+    *oldest_active_lsn = oldest;
+
+    LogRecord record;
+    record.lsn = next_lsn_++;
+    record.txn_id = INVALID_TXN_ID;
+    record.prev_lsn = INVALID_LSN;
+    record.type = LogRecordType::CHECKPOINT;
+    record.page_id = INVALID_PAGE_ID;
+    record.slot_id = 0;
+    record.after_image = ckpt.Encode();
+
+    std::vector<uint8_t> serialized = record.Serialize();
+    if (buffer_.empty()) buffer_first_lsn_ = record.lsn;
+    buffer_.insert(buffer_.end(), serialized.begin(), serialized.end());
+    buffered_lsn_ = record.lsn;
+    return record.lsn;
+}
+
+void WAL::WriteMasterRecord(lsn_t checkpoint_lsn) {
+    std::string path = log_file_name_ + ".master";
+    std::string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (fd == -1) {
+        throw std::runtime_error("WAL: cannot write " + tmp + ": " + strerror(errno));
+    }
+    bool ok = write(fd, &checkpoint_lsn, sizeof(checkpoint_lsn)) == sizeof(checkpoint_lsn) &&
+              fdatasync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) == -1) {
+        throw std::runtime_error("WAL: cannot write " + path + ": " + strerror(errno));
+    }
+}
+
+lsn_t WAL::ReadMasterRecord() const {
+    lsn_t checkpoint_lsn = INVALID_LSN;
+    std::ifstream in(log_file_name_ + ".master", std::ios::binary);
+    if (!in.read(reinterpret_cast<char*>(&checkpoint_lsn), sizeof(checkpoint_lsn))) {
+        return INVALID_LSN;
+    }
+    return checkpoint_lsn;
+}
+
+bool WAL::IsEmpty() {
+    std::lock_guard<std::mutex> flush_guard(flush_latch_);
+    for (lsn_t start : segments_) {
+        struct stat st;
+        if (stat(SegmentPath(start).c_str(), &st) == 0 && st.st_size > 0) return false;
+    }
+    return true;
+}
+
+std::vector<lsn_t> WAL::ListSegments() {
+    std::lock_guard<std::mutex> flush_guard(flush_latch_);
+    return segments_;
+}
+
+std::vector<LogRecord> WAL::ReadAllRecords() {
+    std::vector<LogRecord> records;
+    LogCursor cursor(this);
+    LogRecord record;
+    while (cursor.Next(&record)) {
+        records.push_back(record);
+    }
     return records;
 }
 
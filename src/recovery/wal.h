@@ -3,10 +3,11 @@
 #include "storage_engine/common/common.h"
 #include "concurrency/lock_manager.h"
 #include <cstdint>
+#include <atomic>
 #include <vector>
 #include <string>
-#include <fstream>
 #include <mutex>
+#include <unordered_map>
 
 // ============================================================================
 // Write-Ahead Log (WAL)
@@ -21,6 +22,22 @@
 //   INSERT   — record inserted (after image)
 //   DELETE   — record deleted (before image)
 //   UPDATE   — record updated (before + after images)
+//   CHECKPOINT — fuzzy checkpoint: dirty page table + active transaction
+//                table, encoded in after_image (see CheckpointData)
+//   CLR      — compensation, written by recovery as it undoes a change:
+//              what it left in the slot (after image; empty if it freed
+//              the slot), and undo_next_lsn, the record undo goes on with
+//
+// Segments: the log is a series of files "<base>.<start LSN>" (20-digit,
+// zero-padded), each holding the records from its start LSN up to the next
+// segment's. The flusher rotates to a new segment once the active one
+// reaches segment_size, and truncation deletes whole segments. Readers
+// stream through the segments with a LogCursor.
+//
+// Group commit: with force_on_commit = false, COMMIT records are only
+// buffered. Callers acknowledge a transaction after FlushUntil(commit_lsn)
+// returns; one fsync makes every record appended so far durable, so many
+// concurrent commits share a single flush.
 // ============================================================================
 
 using lsn_t = int64_t;
@@ -32,7 +49,9 @@ enum class LogRecordType : uint8_t {
     ABORT   = 2,
     INSERT  = 3,
     DELETE  = 4,
-    UPDATE  = 5
+    UPDATE  = 5,
+    CHECKPOINT = 6,
+    CLR     = 7
 };
 
 struct LogRecord {
@@ -45,41 +64,134 @@ struct LogRecord {
 
     // Data images (only for INSERT/DELETE/UPDATE)
     std::vector<uint8_t> before_image;   // DELETE, UPDATE
-    std::vector<uint8_t> after_image;    // INSERT, UPDATE
+    std::vector<uint8_t> after_image;    // INSERT, UPDATE, CLR
+
+    lsn_t undo_next_lsn = INVALID_LSN;   // CLR: the transaction's next record to undo
 
     // Serialization
     std::vector<uint8_t> Serialize() const;
     static LogRecord Deserialize(const uint8_t* data, size_t size, size_t& offset);
 };
 
+// Payload of a CHECKPOINT record. begin_lsn is the next LSN at the moment
+// the checkpoint started, before the dirty page table was collected:
+// analysis has to scan from there, since records between begin_lsn and the
+// checkpoint record itself may not be reflected in the tables.
+struct CheckpointData {
+    lsn_t begin_lsn = INVALID_LSN;
+    std::vector<std::pair<page_id_t, lsn_t>> dirty_pages;  // page -> recLSN
+    std::vector<std::pair<txn_id_t, lsn_t>> active_txns;   // txn -> last LSN
+
+    std::vector<uint8_t> Encode() const;
+    static CheckpointData Decode(const std::vector<uint8_t>& data);
+};
+
+// Where a record starts in the segmented log (see LogCursor)
+struct LogPosition {
+    lsn_t segment = INVALID_LSN;  // Start LSN naming the segment file
+    uint64_t offset = 0;          // Byte offset of the record in that file
+};
+
 class WAL {
 public:
-    explicit WAL(const std::string& log_file_name = "wal.log");
+    static constexpr uint64_t DEFAULT_SEGMENT_SIZE = 16ull << 20;
+
+    // log_file_name is the base name; segments are "<base>.<start LSN>".
+    // A new segment is started once the current one reaches segment_size.
+    explicit WAL(const std::string& log_file_name = "wal.log", bool force_on_commit = true,
+                 uint64_t segment_size = DEFAULT_SEGMENT_SIZE);
     ~WAL();
 
+    WAL(const WAL&) = delete;
+    WAL& operator=(const WAL&) = delete;
+
     // Append a log record. Returns the assigned LSN.
     lsn_t AppendLogRecord(LogRecord& record);
 
+    // Append records as one group: consecutive LSNs, one latch acquisition.
+    // Returns the last LSN assigned (INVALID_LSN if records is empty).
+    lsn_t AppendLogRecords(std::vector<LogRecord>& records);
+
     // Force flush all buffered log records to disk
     void Flush();
 
-    // Read all log records from the log file (for recovery)
+    // Block until every record up to and including `lsn` is on disk.
+    // Returns immediately if it already is; otherwise flushes the whole
+    // buffer with one write + fdatasync (group commit). If that fails the
+    // records stay buffered, in LSN order, and the error is thrown.
+    void FlushUntil(lsn_t lsn);
+
+    // Highest LSN known to be durable (INVALID_LSN if none yet)
+    lsn_t GetFlushedLSN() const { return flushed_lsn_.load(); }
+
+    // Discard all durable records (called after every page they describe
+    // has been written back). Buffered records are kept.
+    void Truncate();
+
+    // Discard durable records with lsn < keep_from by deleting every
+    // segment that lies wholly below it. The active segment is kept.
+    void TruncateBefore(lsn_t keep_from);
+
+    // Append a CHECKPOINT record. The active transaction table is taken
+    // from the log's own bookkeeping, atomically with the append.
+    // *oldest_active_lsn receives the first LSN of the oldest transaction
+    // still running (INVALID_LSN if none), which undo may need.
+    lsn_t AppendCheckpoint(lsn_t begin_lsn,
+                           std::vector<std::pair<page_id_t, lsn_t>> dirty_pages,
+                           lsn_t* oldest_active_lsn);
+
+    // Master record: LSN of the last durable CHECKPOINT record, kept in
+    // "<base>.master" so recovery can start there without a scan
+    void WriteMasterRecord(lsn_t checkpoint_lsn);
+    lsn_t ReadMasterRecord() const;
+
+    // True if no segment holds a record
+    bool IsEmpty();
+
+    // Start LSNs of the segment files, oldest first; and a segment's path
+    std::vector<lsn_t> ListSegments();
+    std::string SegmentPath(lsn_t start_lsn) const;
+
+    // Read all log records (tests and small logs; recovery uses LogCursor)
     std::vector<LogRecord> ReadAllRecords();
 
     // Get the current LSN
-    lsn_t GetCurrentLSN() const { return next_lsn_; }
+    lsn_t GetCurrentLSN() const { return next_lsn_.load(); }
 
     // Get the previous LSN for a transaction
     lsn_t GetPrevLSN(txn_id_t txn_id);
 
 private:
-    std::string log_file_name_;
-    std::ofstream log_file_;
-    std::mutex latch_;
-    lsn_t next_lsn_{0};
+    // Assign record its LSN and add it to the buffer. Caller holds latch_.
+    void AppendLocked(LogRecord& record);
+
+    // Write `data` to the active segment and fdatasync it; on failure the
+    // segment is cut back to its old size before the throw. Caller holds flush_latch_.
+    void WriteAndSync(const std::vector<uint8_t>& data);
+
+    // Find the segments on disk, trim a torn tail, open the newest for append
+    void OpenSegments();
 
-    // Track prev_lsn per transaction
+    // Close the active segment and start "<base>.<start_lsn>". Caller holds flush_latch_.
+    void StartSegment(lsn_t start_lsn);
+
+    std::string log_file_name_;
+    int fd_ = -1;                    // Active (newest) segment
+    bool force_on_commit_;
+    uint64_t segment_size_;
+    std::mutex latch_;         // Protects the buffer, next_lsn_ and txn_prev_lsn_
+    std::mutex flush_latch_;   // Serializes writers to the log; guards segments_ and segment_bytes_
+    std::atomic<lsn_t> next_lsn_{0};  // Written under latch_, read without it
+    lsn_t buffered_lsn_{INVALID_LSN};          // Highest LSN appended to buffer_
+    lsn_t buffer_first_lsn_{INVALID_LSN};      // Lowest LSN in buffer_
+    std::atomic<lsn_t> flushed_lsn_{INVALID_LSN};
+
+    std::vector<lsn_t> segments_;    // Start LSNs, oldest first; back() is active
+    uint64_t segment_bytes_ = 0;     // Size of the active segment
+
+    // Track prev_lsn (and the first LSN) per running transaction
     std::unordered_map<txn_id_t, lsn_t> txn_prev_lsn_;
+    std::unordered_map<txn_id_t, lsn_t> txn_first_lsn_;
 
     // In-memory buffer for log records
     std::vector<uint8_t> buffer_;
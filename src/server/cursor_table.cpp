@@ -0,0 +1,70 @@
+#include "cursor_table.h"
+
+// ============================================================================
+// CursorTable
+// ============================================================================
+
+CursorTable::CursorTable(std::chrono::milliseconds timeout) : timeout_(timeout) {}
+
+uint64_t CursorTable::Put(std::unique_ptr<Cursor> cursor) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (cursor->id == 0) cursor->id = next_id_++;
+    cursor->last_used = std::chrono::steady_clock::now();
+    uint64_t id = cursor->id;
+    cursors_[id] = std::move(cursor);
+    return id;
+}
+
+std::unique_ptr<Cursor> CursorTable::Take(uint64_t id) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = cursors_.find(id);
+    if (it == cursors_.end()) return nullptr;
+    std::unique_ptr<Cursor> cursor = std::move(it->second);
+    cursors_.erase(it);
+    return cursor;
+}
+
+bool CursorTable::Kill(uint64_t id) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return cursors_.erase(id) > 0;
+}
+
+size_t CursorTable::KillCollection(const std::string& collection) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_t killed = 0;
+    for (auto it = cursors_.begin(); it != cursors_.end();) {
+        if (it->second->collection == collection) {
+            it = cursors_.erase(it);
+            killed++;
+        } else {
+            ++it;
+        }
+    }
+    return killed;
+}
+
+size_t CursorTable::ExpireIdle() {
+    if (timeout_.count() == 0) return 0;
+    auto cutoff = std::chrono::steady_clock::now() - timeout_;
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_t expired = 0;
+    for (auto it = cursors_.begin(); it != cursors_.end();) {
+        if (it->second->last_used < cutoff) {
+            it = cursors_.erase(it);
+            expired++;
+        } else {
+            ++it;
+        }
+    }
+    return expired;
+}
+
+void CursorTable::Clear() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    cursors_.clear();
+}
+
+size_t CursorTable::Size() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return cursors_.size();
+}
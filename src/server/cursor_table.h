@@ -0,0 +1,75 @@
+#pragma once
+
+#include "concurrency/transaction.h"
+#include "execution_engine/executor/executor.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// A find whose results have not all been sent: the suspended executor
+// tree and the snapshot it reads at, so every batch comes from the same
+// snapshot. Between requests the tree holds no latch, at most a pin on
+// one index leaf.
+struct Cursor {
+    ~Cursor() {
+        if (plan) plan->Close();
+    }
+
+    uint64_t id = 0;  // Set by CursorTable::Put
+    std::string collection;
+    std::unique_ptr<ScopedSnapshot> snapshot;
+    std::unique_ptr<Executor> plan;  // After snapshot: destroyed first
+    TupleBatch batch;                // Pulled from plan; batch[pos, Size()) not sent yet
+    size_t pos = 0;
+    std::chrono::steady_clock::time_point last_used;
+};
+
+// ============================================================================
+// CursorTable — the server's open cursors, by id
+//
+// A request takes its cursor out while it runs and puts it back after
+// (or drops it once the results are used up), so a cursor never serves
+// two requests at once. ExpireIdle closes the cursors left unused past
+// the timeout; KillCollection those over a collection about to be
+// dropped. Cursors are closed under the table's mutex, so neither can
+// close one the other already took out and leave it running.
+// ============================================================================
+class CursorTable {
+public:
+    // timeout = 0: cursors never expire
+    explicit CursorTable(std::chrono::milliseconds timeout);
+
+    CursorTable(const CursorTable&) = delete;
+    CursorTable& operator=(const CursorTable&) = delete;
+
+    // Keep cursor for a later request; gives it an id if it has none.
+    // Returns the id.
+    uint64_t Put(std::unique_ptr<Cursor> cursor);
+
+    // Take a cursor out. Null if there is no such cursor (never was,
+    // closed, or in use by another request).
+    std::unique_ptr<Cursor> Take(uint64_t id);
+
+    // Close a cursor; false if it was not in the table
+    bool Kill(uint64_t id);
+
+    // Close every cursor over a collection. Returns how many.
+    size_t KillCollection(const std::string& collection);
+
+    // Close the cursors idle longer than the timeout. Returns how many.
+    size_t ExpireIdle();
+
+    // Close everything
+    void Clear();
+
+    size_t Size() const;
+
+private:
+    std::chrono::milliseconds timeout_;
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, std::unique_ptr<Cursor>> cursors_;
+    uint64_t next_id_ = 1;
+};
@@ -0,0 +1,105 @@
+#include "metrics_endpoint.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define POLL_INTERVAL_MS 200   // How soon Stop is noticed
+#define MAX_REQUEST_BYTES 8192 // Headers beyond this are not read
+
+MetricsEndpoint::MetricsEndpoint(uint16_t port, std::function<std::string()> render)
+    : port_(port), render_(std::move(render)) {}
+
+MetricsEndpoint::~MetricsEndpoint() {
+    Stop();
+}
+
+void MetricsEndpoint::Start() {
+    if (thread_.joinable()) return;
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) throw std::runtime_error("MetricsEndpoint: failed to create socket");
+    int opt = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 16) < 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        throw std::runtime_error("MetricsEndpoint: failed to bind to port " + std::to_string(port_));
+    }
+
+    stop_ = false;
+    thread_ = std::thread(&MetricsEndpoint::Loop, this);
+}
+
+void MetricsEndpoint::Stop() {
+    if (!thread_.joinable()) return;
+    stop_ = true;
+    thread_.join();
+    close(listen_fd_);
+    listen_fd_ = -1;
+}
+
+void MetricsEndpoint::Loop() {
+    while (!stop_) {
+        struct pollfd pfd{listen_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, POLL_INTERVAL_MS) <= 0) continue;
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) continue;
+
+        // A scraper that stalls gets a second, not the thread
+        struct timeval timeout{1, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        try {
+            Serve(fd);
+        } catch (const std::exception& e) {
+            std::cerr << "MetricsEndpoint: " << e.what() << std::endl;
+        }
+        close(fd);
+    }
+}
+
+void MetricsEndpoint::Serve(int fd) {
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_BYTES) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    // "GET /metrics HTTP/1.1" — a query string is ignored
+    std::string line = request.substr(0, request.find("\r\n"));
+    size_t path_start = line.find(' ');
+    size_t path_end = path_start == std::string::npos ? std::string::npos : line.find_first_of(" ?", path_start + 1);
+    bool found = line.compare(0, path_start, "GET") == 0 && path_end != std::string::npos &&
+                 line.compare(path_start + 1, path_end - path_start - 1, "/metrics") == 0;
+
+    std::string body = found ? render_() : "not found\n";
+    std::string response = std::string(found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n") +
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        sent += static_cast<size_t>(n);
+    }
+}
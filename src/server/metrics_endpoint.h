@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+// ============================================================================
+// MetricsEndpoint — the Prometheus text exposition over plain HTTP
+//
+// A thread of its own (Start / Stop) accepts on a separate port and
+// answers GET /metrics with what render returns (404 for anything else),
+// one connection at a time, closing each after the reply. Scrapes are
+// small and seconds apart, so they never go near the event loop.
+// ============================================================================
+
+class MetricsEndpoint {
+public:
+    MetricsEndpoint(uint16_t port, std::function<std::string()> render);
+    ~MetricsEndpoint();
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    // Bind and start serving; throws std::runtime_error if the port is taken
+    void Start();
+    void Stop();
+
+    uint16_t Port() const { return port_; }
+
+private:
+    void Loop();
+
+    // Read one request from fd and answer it
+    void Serve(int fd);
+
+    uint16_t port_;
+    std::function<std::string()> render_;
+    int listen_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+};
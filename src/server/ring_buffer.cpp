@@ -0,0 +1,64 @@
+#include "ring_buffer.h"
+#include <algorithm>
+#include <cstring>
+
+// ============================================================================
+// Constructor
+// ============================================================================
+
+RingBuffer::RingBuffer(size_t capacity) {
+    size_t rounded = 1;
+    while (rounded < capacity) rounded <<= 1;
+    initial_ = rounded;
+    data_.resize(rounded);
+    mask_ = rounded - 1;
+}
+
+// ============================================================================
+// Producing — read() straight into the ring
+// ============================================================================
+
+uint8_t* RingBuffer::WriteSpace(size_t* len) {
+    if (size_ == data_.size()) Grow();
+    if (size_ == 0) head_ = 0;  // Empty: the whole ring is one run
+    size_t tail = (head_ + size_) & mask_;
+    *len = tail >= head_ ? data_.size() - tail : head_ - tail;
+    return data_.data() + tail;
+}
+
+void RingBuffer::Grow() {
+    // Unwrap into the front of a ring twice the size
+    std::vector<uint8_t> bigger(data_.size() * 2);
+    Peek(0, size_, bigger.data());
+    data_.swap(bigger);
+    mask_ = data_.size() - 1;
+    head_ = 0;
+}
+
+// ============================================================================
+// Consuming
+// ============================================================================
+
+void RingBuffer::Peek(size_t offset, size_t len, void* dst) const {
+    size_t start = (head_ + offset) & mask_;
+    size_t first = std::min(len, data_.size() - start);
+    std::memcpy(dst, data_.data() + start, first);
+    std::memcpy(static_cast<uint8_t*>(dst) + first, data_.data(), len - first);
+}
+
+void RingBuffer::Consume(size_t n) {
+    head_ = (head_ + n) & mask_;
+    size_ -= n;
+    if (size_ == 0 && data_.size() > initial_ * SHRINK_ABOVE) {
+        std::vector<uint8_t>(initial_).swap(data_);
+        mask_ = initial_ - 1;
+        head_ = 0;
+    }
+}
+
+std::string RingBuffer::Take(size_t n) {
+    std::string out(n, '\0');
+    Peek(0, n, out.data());
+    Consume(n);
+    return out;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// RingBuffer — a connection's unparsed input bytes
+//
+// A power-of-two byte ring: read() fills the free space after the tail in
+// place (WriteSpace / Produce) and framing takes whole messages off the
+// head (Peek / Take), so consuming a message costs only its own bytes, not
+// a shift of everything buffered behind it. A message may wrap around the
+// end; Peek and Take copy it out in two pieces then. Grows by doubling
+// when full; once drained, a ring past SHRINK_ABOVE times its initial
+// capacity goes back to that, so one large message does not pin its
+// size for the life of the connection.
+// ============================================================================
+
+class RingBuffer {
+public:
+    static constexpr size_t SHRINK_ABOVE = 8;
+
+    explicit RingBuffer(size_t capacity = 8192);
+
+    // Bytes buffered, and room for them
+    size_t Size() const { return size_; }
+    size_t Capacity() const { return data_.size(); }
+
+    // Contiguous free space after the tail (growing the ring first if it
+    // is full); *len gets its size. Produce(n) then appends the n bytes
+    // written there.
+    uint8_t* WriteSpace(size_t* len);
+    void Produce(size_t n) { size_ += n; }
+
+    // Copy len bytes starting offset bytes past the head (offset + len <= Size())
+    void Peek(size_t offset, size_t len, void* dst) const;
+
+    // Remove the first n bytes; Take returns them
+    void Consume(size_t n);
+    std::string Take(size_t n);
+
+private:
+    void Grow();
+
+    size_t initial_;  // Capacity to shrink back to
+    std::vector<uint8_t> data_;
+    size_t mask_;
+    size_t head_ = 0;  // Index of the first buffered byte
+    size_t size_ = 0;
+};
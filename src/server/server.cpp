@@ -7,14 +7,30 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <algorithm>
+#include <array>
+#include <charconv>
+#include <map>
+#include <unordered_set>
+#include "recovery/recovery_manager.h"
+#include "data_organisation/bptree/index_key.h"
+#include "data_organisation/bptree/entry_sorter.h"
+#include "execution_engine/executor/parallel_seq_scan.h"
+#include "execution_engine/executor/snapshot_scan.h"
+#include "execution_engine/executor/limit.h"
+#include "execution_engine/executor/projection.h"
+#include "storage_engine/serializer/json.h"
+#include "storage_engine/common/metrics.h"
 
 #define MAX_EVENTS 64
-#define READ_BUF_SIZE 8192
+#define MAX_IOVECS 64  // Responses per writev: a header and a payload each
+#define DEFAULT_BATCH_SIZE 1000       // Documents per find / getMore reply unless asked otherwise
+#define BATCH_REPLY_BYTES (4 << 20)   // A batch ends with the document that takes it past this
 
 // ANSI
 #define S_GREEN  "\033[32m"
@@ -22,6 +38,22 @@
 #define S_DIM    "\033[2m"
 #define S_RESET  "\033[0m"
 
+// Commands timed by name, each in the Metrics command slot of its index;
+// anything else (unknown, or no cmd at all) goes to the last, "other"
+static const char* const COMMAND_NAMES[] = {
+    "insert", "insertMany", "find", "getMore", "killCursors", "delete", "update", "count", "explain",
+    "analyze", "createCollection", "dropCollection", "createIndex", "listCollections", "hello", "ping",
+    "stats", "other"};
+static constexpr size_t NUM_COMMAND_SLOTS = sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]);
+static_assert(NUM_COMMAND_SLOTS <= MetricsSnapshot::MAX_COMMANDS, "too many timed commands");
+
+static size_t CommandSlot(const std::string& cmd) {
+    for (size_t i = 0; i + 1 < NUM_COMMAND_SLOTS; i++) {
+        if (cmd == COMMAND_NAMES[i]) return i;
+    }
+    return NUM_COMMAND_SLOTS - 1;
+}
+
 // Global pointer for signal handler
 static Server* g_server_instance = nullptr;
 
@@ -33,35 +65,80 @@ static void sigint_handler(int) {
 // Constructor / Destructor
 // ============================================================================
 
-Server::Server(const std::string& db_file, int port)
-    : server_fd_(-1), epoll_fd_(-1), port_(port), running_(false) {
-
-    DBConfigs config;
-    config.db_file_name = db_file;
-    config.page_size = 4096;
+Server::Server(const DBConfigs& config, int port)
+    : flush_policy_(config.flush_policy), scan_threads_(config.scan_threads), server_fd_(-1), epoll_fd_(-1), port_(port), running_(false) {
 
     disk_manager_ = std::make_unique<DiskManager>(config);
-    bpm_ = std::make_unique<BufferPoolManager>(256, disk_manager_.get());
-    catalog_ = std::make_unique<Catalog>(bpm_.get());
+    bpm_ = std::make_unique<BufferPoolManager>(config.buffer_pool_size, disk_manager_.get(),
+                                               config.buffer_pool_shards,
+                                               config.replacer_policy, config.scan_ring_frames);
+
+    if (flush_policy_ == FlushPolicy::GROUP_COMMIT) {
+        // Commits are batched by the event loop, not forced one by one
+        wal_ = std::make_unique<WAL>(config.wal_file_name, /*force_on_commit=*/false,
+                                     config.wal_segment_size);
+        bpm_->SetLogFlusher([wal = wal_.get()](int64_t lsn) { wal->FlushUntil(lsn); });
+
+        // Changes acknowledged after the last checkpoint live only in the log
+        if (!wal_->IsEmpty()) {
+            RecoveryManager recovery(wal_.get(), bpm_.get(), config.recovery_threads);
+            recovery.Recover();
+            bpm_->FlushAllPages();
+            wal_->Truncate();
+        }
+
+        checkpointer_ = std::make_unique<Checkpointer>(
+            bpm_.get(), wal_.get(), std::chrono::milliseconds(config.checkpoint_interval_ms));
+        bg_writer_ = std::make_unique<BackgroundWriter>(
+            bpm_.get(), std::chrono::milliseconds(config.bgwriter_interval_ms),
+            config.bgwriter_max_pages);
+    }
+
+    lock_manager_ = std::make_unique<LockManager>(config.lock_escalation,
+                                                  std::chrono::milliseconds(config.deadlock_check_ms));
+    txn_manager_ = std::make_unique<TransactionManager>(lock_manager_.get(), wal_.get());
+    catalog_ = std::make_unique<Catalog>(bpm_.get(), wal_.get(), txn_manager_.get());
 
     // Reserve page 0 / load catalog
     if (disk_manager_->GetFileSize() == 0) {
         page_id_t pid;
         Page* p = bpm_->NewPage(&pid);
         if (p) {
-            std::memset(p->GetData(), 0, 4096);
+            std::memset(p->GetData(), 0, bpm_->GetPageSize());
             bpm_->UnpinPage(pid, true);
         }
     } else {
         catalog_->LoadCatalog();
     }
+    catalog_->SetSaveOnExtent(true);
+    vacuum_ = std::make_unique<Vacuum>(
+        txn_manager_.get(), [this](uint64_t oldest_read_ts) { return catalog_->PruneVersions(oldest_read_ts); },
+        std::chrono::milliseconds(config.vacuum_interval_ms));
+    cursors_ = std::make_unique<CursorTable>(std::chrono::milliseconds(config.cursor_timeout_ms));
+
+    if (config.num_workers > 0) {
+        workers_ = std::make_unique<WorkerPool>(config.num_workers);
+    }
+    if (config.metrics_port != 0) {
+        metrics_endpoint_ = std::make_unique<MetricsEndpoint>(config.metrics_port,
+                                                              [this] { return PrometheusText(); });
+    }
 }
 
 Server::~Server() {
-    catalog_->SaveCatalog();
+    if (metrics_endpoint_) metrics_endpoint_->Stop();
+    if (workers_) workers_->Stop();
+    cursors_->Clear();  // Their pins and snapshots
+    lock_manager_->Stop();
+    vacuum_->Stop();
+    if (checkpointer_) checkpointer_->Stop();
+    if (bg_writer_) bg_writer_->Stop();
+    catalog_->SaveCatalog(/*final=*/true);
     bpm_->FlushAllPages();
+    if (wal_) wal_->Truncate();  // Everything logged is now in the data file
+    bpm_->SetLogFlusher(nullptr);  // wal_ is destroyed before bpm_
 
-    for (auto& [fd, _] : client_buffers_) {
+    for (auto& [fd, _] : connections_) {
         close(fd);
     }
     if (epoll_fd_ != -1) close(epoll_fd_);
@@ -130,26 +207,60 @@ void Server::Start() {
     epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_fd_, &ev);
 
     running_ = true;
+    if (checkpointer_) checkpointer_->Start();
+    if (bg_writer_) bg_writer_->Start();
+    lock_manager_->Start();
+    vacuum_->Start();
+    if (workers_) workers_->Start();
+    if (metrics_endpoint_) metrics_endpoint_->Start();
 
     std::cout << S_GREEN "DocDB Server started on port " << port_ << S_RESET << std::endl;
+    if (workers_) {
+        std::cout << S_DIM "Executing requests on " << workers_->Size()
+                  << " worker thread(s)" S_RESET << std::endl;
+    }
+    if (metrics_endpoint_) {
+        std::cout << S_DIM "Serving Prometheus metrics on port " << metrics_endpoint_->Port()
+                  << " at /metrics" S_RESET << std::endl;
+    }
     std::cout << S_DIM "Waiting for connections..." S_RESET << std::endl;
 
     // Event loop
     struct epoll_event events[MAX_EVENTS];
+    auto last_expiry = std::chrono::steady_clock::now();
     while (running_) {
         int nfds = epoll_wait(epoll_fd_, events, MAX_EVENTS, 1000);  // 1s timeout
         for (int i = 0; i < nfds; i++) {
             if (events[i].data.fd == server_fd_) {
                 AcceptConnection();
-            } else {
-                HandleClient(events[i].data.fd);
+                continue;
             }
+            if (events[i].events & EPOLLOUT) HandleWritable(events[i].data.fd);
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) HandleClient(events[i].data.fd);
+        }
+
+        // One WAL flush for every write processed in this iteration
+        FlushPendingResponses();
+
+        // Close the cursors their clients stopped reading, once a second
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_expiry >= std::chrono::seconds(1)) {
+            cursors_->ExpireIdle();
+            last_expiry = now;
         }
     }
 
-    // Cleanup
-    catalog_->SaveCatalog();
+    // Cleanup — let in-flight requests finish before the final checkpoint
+    if (metrics_endpoint_) metrics_endpoint_->Stop();
+    if (workers_) workers_->Stop();
+    cursors_->Clear();
+    lock_manager_->Stop();
+    vacuum_->Stop();
+    if (checkpointer_) checkpointer_->Stop();
+    if (bg_writer_) bg_writer_->Stop();
+    catalog_->SaveCatalog(/*final=*/true);
     bpm_->FlushAllPages();
+    if (wal_) wal_->Truncate();
     std::cout << S_GREEN "\nServer stopped. Data saved." S_RESET << std::endl;
 }
 
@@ -175,217 +286,825 @@ void Server::AcceptConnection() {
         setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
 
         struct epoll_event ev{};
-        ev.events = EPOLLIN | EPOLLET;  // Edge-triggered
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;  // Edge-triggered: OUT fires once a full socket drains
         ev.data.fd = client_fd;
         epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_fd, &ev);
 
-        client_buffers_[client_fd] = ClientBuffer{};
+        auto conn = std::make_shared<Connection>();
+        conn->fd = client_fd;
+        connections_[client_fd] = std::move(conn);
     }
 }
 
+// ============================================================================
+// CloseClient — forget the connection and any responses held for it
+// ============================================================================
+
+void Server::CloseClient(int client_fd) {
+    auto it = connections_.find(client_fd);
+    if (it != connections_.end()) {
+        // A worker may be sending on this fd — close it under the connection's mutex
+        std::lock_guard<std::mutex> guard(it->second->mutex);
+        it->second->closed = true;
+        it->second->requests.clear();
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client_fd, nullptr);
+        close(client_fd);
+    }
+    connections_.erase(client_fd);
+
+    // The fd number may be reused by the next accept in this iteration
+    pending_responses_.erase(
+        std::remove_if(pending_responses_.begin(), pending_responses_.end(),
+                       [client_fd](const PendingResponse& p) { return p.client_fd == client_fd; }),
+        pending_responses_.end());
+}
+
 // ============================================================================
 // HandleClient — read data, frame messages, process commands
 // ============================================================================
 
 void Server::HandleClient(int client_fd) {
-    char buf[READ_BUF_SIZE];
+    auto conn_it = connections_.find(client_fd);
+    if (conn_it == connections_.end()) return;
+    std::shared_ptr<Connection> conn = conn_it->second;
+
+    RingBuffer& buffer = conn->in_buffer;
 
     while (true) {
-        ssize_t n = read(client_fd, buf, sizeof(buf));
+        size_t space;
+        uint8_t* dst = buffer.WriteSpace(&space);
+        ssize_t n = read(client_fd, dst, space);
         if (n <= 0) {
             if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
                 // Client disconnected
-                epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, client_fd, nullptr);
-                close(client_fd);
-                client_buffers_.erase(client_fd);
+                CloseClient(client_fd);
                 return;
             }
             break;  // EAGAIN — no more data right now
         }
-
-        client_buffers_[client_fd].data.append(buf, n);
+        buffer.Produce(static_cast<size_t>(n));
     }
 
     // Process complete messages from the buffer
-    auto& buffer = client_buffers_[client_fd].data;
-
-    while (buffer.size() >= 4) {
+    while (buffer.Size() >= 4) {
         // Read 4-byte big-endian length prefix
-        uint32_t msg_len = 0;
-        msg_len |= (static_cast<uint8_t>(buffer[0]) << 24);
-        msg_len |= (static_cast<uint8_t>(buffer[1]) << 16);
-        msg_len |= (static_cast<uint8_t>(buffer[2]) << 8);
-        msg_len |= (static_cast<uint8_t>(buffer[3]));
+        uint8_t header[4];
+        buffer.Peek(0, 4, header);
+        uint32_t msg_len = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) |
+                           (uint32_t(header[2]) << 8) | uint32_t(header[3]);
 
         if (msg_len > 1024 * 1024) {
             // Protect against absurd messages
-            close(client_fd);
-            client_buffers_.erase(client_fd);
+            CloseClient(client_fd);
             return;
         }
 
-        if (buffer.size() < 4 + msg_len) break;  // Incomplete message
+        if (buffer.Size() < 4 + msg_len) break;  // Incomplete message
 
-        std::string request_json = buffer.substr(4, msg_len);
-        buffer.erase(0, 4 + msg_len);
+        buffer.Consume(4);
+        std::string request_json = buffer.Take(msg_len);
 
-        // Process and send response
-        std::string response = ProcessCommand(request_json);
+        if (workers_) {
+            DispatchRequest(conn, std::move(request_json));
+            continue;
+        }
 
-        // Send length-prefixed response
-        uint32_t resp_len = static_cast<uint32_t>(response.size());
-        uint8_t header[4];
-        header[0] = (resp_len >> 24) & 0xFF;
-        header[1] = (resp_len >> 16) & 0xFF;
-        header[2] = (resp_len >> 8) & 0xFF;
-        header[3] = resp_len & 0xFF;
+        // Process now; the response is sent once its commit is durable
+        lsn_t commit_lsn = INVALID_LSN;
+        std::string response = ProcessCommand(request_json, &conn->protocol, &commit_lsn);
+        pending_commit_lsn_ = std::max(pending_commit_lsn_, commit_lsn);
+        pending_responses_.push_back({client_fd, std::move(response)});
+    }
+}
+
+// ============================================================================
+// DispatchRequest / DrainConnection — per-connection ordering on the pool
+//
+// At most one worker drains a connection at a time (busy), so its requests
+// execute and answer in arrival order while other connections proceed on
+// other workers.
+// ============================================================================
 
-        // Write header + payload (blocking is fine for responses)
-        write(client_fd, header, 4);
-        write(client_fd, response.data(), response.size());
+void Server::DispatchRequest(const std::shared_ptr<Connection>& conn, std::string request) {
+    std::lock_guard<std::mutex> guard(conn->mutex);
+    conn->requests.push_back(std::move(request));
+    if (conn->busy) return;  // The draining worker will pick it up
+
+    conn->busy = true;
+    workers_->Submit([this, conn] { DrainConnection(conn); });
+}
+
+void Server::DrainConnection(const std::shared_ptr<Connection>& conn) {
+    // A failure past the requests themselves (the WAL wait, the write)
+    // must not leave the connection busy, which would strand everything
+    // queued behind it. Its replies can no longer come back in order, so
+    // it is shut down too; the epoll thread sees that as a disconnect.
+    struct BusyGuard {
+        Connection& conn;
+        bool released = false;
+        ~BusyGuard() {
+            if (released) return;
+            std::lock_guard<std::mutex> guard(conn.mutex);
+            conn.busy = false;
+            if (!conn.closed) shutdown(conn.fd, SHUT_RDWR);
+        }
+    } busy_guard{*conn};
+
+    while (true) {
+        // Everything pipelined so far runs as one batch: one WAL wait and
+        // one write for all of its responses
+        std::deque<std::string> batch;
+        {
+            std::lock_guard<std::mutex> guard(conn->mutex);
+            if (conn->closed || conn->requests.empty()) {
+                conn->busy = false;
+                busy_guard.released = true;
+                return;
+            }
+            batch.swap(conn->requests);
+        }
+
+        std::vector<std::string> responses;
+        lsn_t batch_lsn = INVALID_LSN;
+        for (const std::string& request : batch) {
+            lsn_t commit_lsn = INVALID_LSN;
+            WireProtocol format = conn->protocol;  // The reply's, even to a hello
+            try {
+                responses.push_back(ProcessCommand(request, &conn->protocol, &commit_lsn));
+            } catch (const std::exception& e) {
+                responses.push_back(ErrorReply(format, e.what()));
+            }
+            batch_lsn = std::max(batch_lsn, commit_lsn);
+        }
+
+        // Workers committing at the same time are covered by one fsync
+        if (wal_ && batch_lsn != INVALID_LSN) {
+            wal_->FlushUntil(batch_lsn);
+        }
+
+        std::lock_guard<std::mutex> guard(conn->mutex);
+        if (conn->closed) continue;
+        for (std::string& response : responses) QueueResponse(*conn, std::move(response));
+        FlushOutput(*conn);
     }
 }
 
 // ============================================================================
-// JSON helpers — simple builders (we avoid pulling in a JSON lib)
+// FlushPendingResponses — group commit: one fsync, then all replies
 // ============================================================================
 
-static std::string EscapeJSON(const std::string& s) {
-    std::string out;
-    out.reserve(s.size());
-    for (char c : s) {
-        if (c == '"') out += "\\\"";
-        else if (c == '\\') out += "\\\\";
-        else if (c == '\n') out += "\\n";
-        else out += c;
+void Server::FlushPendingResponses() {
+    if (pending_responses_.empty()) return;
+
+    if (wal_ && pending_commit_lsn_ != INVALID_LSN) {
+        wal_->FlushUntil(pending_commit_lsn_);
+    }
+    pending_commit_lsn_ = INVALID_LSN;
+
+    // Queue every reply first, so a connection's pipelined ones share a write
+    std::vector<Connection*> touched;
+    for (auto& pending : pending_responses_) {
+        auto it = connections_.find(pending.client_fd);
+        if (it == connections_.end()) continue;
+        std::lock_guard<std::mutex> guard(it->second->mutex);
+        if (it->second->out.empty()) touched.push_back(it->second.get());
+        QueueResponse(*it->second, std::move(pending.response));
+    }
+    pending_responses_.clear();
+    for (Connection* conn : touched) {
+        std::lock_guard<std::mutex> guard(conn->mutex);
+        FlushOutput(*conn);
     }
-    return out;
 }
 
-std::string Server::DocToJSON(const BsonDocument& doc) {
-    std::ostringstream ss;
-    ss << "{";
-    bool first = true;
-    for (const auto& [key, val] : doc.elements) {
-        if (!first) ss << ",";
-        first = false;
-        ss << "\"" << EscapeJSON(key) << "\":";
-        if (std::holds_alternative<std::string>(val)) {
-            ss << "\"" << EscapeJSON(std::get<std::string>(val)) << "\"";
-        } else if (std::holds_alternative<int32_t>(val)) {
-            ss << std::get<int32_t>(val);
-        } else if (std::holds_alternative<int64_t>(val)) {
-            ss << std::get<int64_t>(val);
-        } else if (std::holds_alternative<double>(val)) {
-            ss << std::get<double>(val);
-        } else if (std::holds_alternative<bool>(val)) {
-            ss << (std::get<bool>(val) ? "true" : "false");
+// ============================================================================
+// Output queues — framed responses written with writev
+// ============================================================================
+
+void Server::QueueResponse(Connection& conn, std::string response) {
+    OutFrame frame;
+    uint32_t len = static_cast<uint32_t>(response.size());
+    frame.header = {uint8_t(len >> 24), uint8_t(len >> 16), uint8_t(len >> 8), uint8_t(len)};
+    frame.payload = std::move(response);
+    conn.out.push_back(std::move(frame));
+}
+
+void Server::FlushOutput(Connection& conn) {
+    while (!conn.out.empty() && !conn.closed) {
+        struct iovec iov[MAX_IOVECS];
+        int count = 0;
+        size_t skip = conn.out_sent;
+        for (auto it = conn.out.begin(); it != conn.out.end() && count + 2 <= MAX_IOVECS; ++it) {
+            if (skip < it->header.size()) {
+                iov[count++] = {it->header.data() + skip, it->header.size() - skip};
+                skip = 0;
+            } else {
+                skip -= it->header.size();
+            }
+            if (skip < it->payload.size()) {
+                iov[count++] = {const_cast<char*>(it->payload.data()) + skip, it->payload.size() - skip};
+            }
+            skip = 0;
+        }
+
+        ssize_t written = writev(conn.fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;  // Resumed on EPOLLOUT
+            conn.out.clear();
+            conn.out_sent = 0;
+            shutdown(conn.fd, SHUT_RDWR);
+            return;
+        }
+
+        // Retire the frames written in full; the last may be partial
+        size_t left = static_cast<size_t>(written);
+        while (left > 0) {
+            size_t remaining = conn.out.front().header.size() + conn.out.front().payload.size() - conn.out_sent;
+            if (left < remaining) {
+                conn.out_sent += left;
+                break;
+            }
+            left -= remaining;
+            conn.out.pop_front();
+            conn.out_sent = 0;
+        }
+    }
+}
+
+void Server::HandleWritable(int client_fd) {
+    auto it = connections_.find(client_fd);
+    if (it == connections_.end()) return;
+    std::lock_guard<std::mutex> guard(it->second->mutex);
+    FlushOutput(*it->second);
+}
+
+// ============================================================================
+// BeginWrite / CommitWrite — one transaction per write request
+//
+// Early lock release: Commit appends the COMMIT record and frees the
+// locks without waiting for the record to reach disk, so the writers of
+// one event-loop batch (or of concurrent workers) share a single flush
+// instead of queueing behind each other's. What makes that safe is that
+// no reply leaves before the log is durable up to every commit it may
+// depend on: the commit's own LSN for the writer, the log tail for any
+// request that read after it (see ProcessCommand). A crash before the
+// flush loses only changes nobody was told about.
+// ============================================================================
+
+Transaction* Server::BeginWrite() {
+    return txn_manager_->Begin();
+}
+
+void Server::CommitWrite(Transaction* txn, lsn_t* commit_lsn) {
+    lsn_t lsn = txn_manager_->Commit(txn);
+    txn_manager_->Release(txn);
+
+    if (flush_policy_ == FlushPolicy::FLUSH_ALL) {
+        bpm_->FlushAllPages();
+    } else if (commit_lsn) {
+        *commit_lsn = lsn;
+    }
+}
+
+std::unique_ptr<Executor> Server::Plan(CollectionInfo* coll, const FilterExpr& filter) {
+    Planner planner(coll, bpm_->GetPageSize(), scan_threads_);
+    return planner.Build(planner.Choose(filter), filter);
+}
+
+bool Server::LockAndReread(Transaction* txn, CollectionInfo* coll, const RecordID& rid,
+                           const FilterExpr& filter, BsonDocument* out_doc) {
+    if (!lock_manager_->LockRecord(txn->txn_id, coll->first_heap_page, rid, LockMode::EXCLUSIVE)) {
+        throw std::runtime_error("deadlock: transaction aborted, retry");
+    }
+
+    try {
+        *out_doc = coll->heap_file->GetRecord(rid);
+    } catch (const std::runtime_error&) {
+        return false;  // Deleted by a transaction that committed first
+    }
+
+    return filter.Evaluate(*out_doc);
+}
+
+// ============================================================================
+// Filters and index selection
+// ============================================================================
+
+// {"field": value} is equality; {"field": {"$gt": v, "$lte": w}} compares;
+// {"field": {"$in": [a, b]}} matches any of the values. {"$and": [...]}
+// and {"$or": [...]} combine filters. A sub-document without operators is
+// an equality match on the document.
+static FilterExpr ParseFilter(const BsonDocument& filter) {
+    static const std::map<std::string, CompareOp> ops = {
+        {"$eq", CompareOp::EQ}, {"$ne", CompareOp::NE}, {"$lt", CompareOp::LT},
+        {"$lte", CompareOp::LE}, {"$gt", CompareOp::GT}, {"$gte", CompareOp::GE}};
+
+    // Arrays arrive as documents keyed "0", "1", ...
+    auto array_values = [](const BsonValue& value, const std::string& op) {
+        if (!std::holds_alternative<std::shared_ptr<BsonDocument>>(value)) {
+            throw std::runtime_error("'" + op + "' takes an array");
+        }
+        std::vector<BsonValue> values;
+        for (const auto& [_, v] : std::get<std::shared_ptr<BsonDocument>>(value)->elements) values.push_back(v);
+        return values;
+    };
+
+    std::vector<FilterExpr> terms;
+    for (const auto& [field, value] : filter.elements) {
+        if (field == "$and" || field == "$or") {
+            std::vector<FilterExpr> branches;
+            for (const BsonValue& branch : array_values(value, field)) {
+                if (!std::holds_alternative<std::shared_ptr<BsonDocument>>(branch)) {
+                    throw std::runtime_error("'" + field + "' takes an array of filters");
+                }
+                branches.push_back(ParseFilter(*std::get<std::shared_ptr<BsonDocument>>(branch)));
+            }
+            terms.push_back(field == "$and" ? FilterExpr::And(std::move(branches))
+                                            : FilterExpr::Or(std::move(branches)));
+            continue;
+        }
+        if (std::holds_alternative<std::shared_ptr<BsonDocument>>(value)) {
+            const auto& sub = std::get<std::shared_ptr<BsonDocument>>(value);
+            bool all_ops = sub && !sub->elements.empty();
+            for (const auto& [k, _] : sub->elements) all_ops = all_ops && (ops.count(k) || k == "$in");
+            if (all_ops) {
+                for (const auto& [k, v] : sub->elements) {
+                    terms.push_back(k == "$in" ? FilterExpr::In(field, array_values(v, k))
+                                               : FilterExpr::Compare(field, ops.at(k), v));
+                }
+                continue;
+            }
+        }
+        terms.push_back(FilterExpr::Compare(field, CompareOp::EQ, value));
+    }
+    return FilterExpr::And(std::move(terms));
+}
+
+// A non-negative whole number, whichever numeric type carries it
+static bool ToCount(const BsonValue& value, uint64_t* out) {
+    int64_t n;
+    if (std::holds_alternative<int32_t>(value)) {
+        n = std::get<int32_t>(value);
+    } else if (std::holds_alternative<int64_t>(value)) {
+        n = std::get<int64_t>(value);
+    } else if (std::holds_alternative<double>(value)) {
+        double d = std::get<double>(value);
+        if (d < 0 || d > 9e18 || d != static_cast<double>(static_cast<int64_t>(d))) return false;
+        n = static_cast<int64_t>(d);
+    } else {
+        return false;
+    }
+    if (n < 0) return false;
+    *out = static_cast<uint64_t>(n);
+    return true;
+}
+
+// Such a number as an option of a request, into *out (left as is when
+// absent). False if it is there but not one.
+static bool GetCount(const BsonDocument& req, const char* key, uint64_t* out) {
+    auto it = req.elements.find(key);
+    return it == req.elements.end() || ToCount(it->second, out);
+}
+
+// {"a": 1, "b": 1} keeps a and b, {"a": 0} drops a (any number or bool
+// counts by its truth). False for a mix, or a value of another type.
+static bool ParseProjection(const BsonDocument& spec, std::vector<std::string>* fields, bool* include) {
+    bool any = false;
+    for (const auto& [field, value] : spec.elements) {
+        bool keep;
+        if (std::holds_alternative<bool>(value)) {
+            keep = std::get<bool>(value);
+        } else if (std::holds_alternative<int32_t>(value)) {
+            keep = std::get<int32_t>(value) != 0;
+        } else if (std::holds_alternative<int64_t>(value)) {
+            keep = std::get<int64_t>(value) != 0;
+        } else if (std::holds_alternative<double>(value)) {
+            keep = std::get<double>(value) != 0;
         } else {
-            ss << "null";
+            return false;
         }
+        if (any && keep != *include) return false;
+        *include = keep;
+        any = true;
+        fields->push_back(field);
     }
-    ss << "}";
-    return ss.str();
+    return true;
 }
 
-// Reuse the CLI's JSON parser logic (flat objects)
-BsonDocument Server::ParseJSON(const std::string& json) {
-    BsonDocument doc;
-    std::string s = json;
-
-    // Trim whitespace
-    size_t start = s.find_first_not_of(" \t\n\r");
-    if (start == std::string::npos) return doc;
-    s = s.substr(start);
-    size_t end = s.find_last_not_of(" \t\n\r");
-    s = s.substr(0, end + 1);
-
-    if (s.empty() || s[0] != '{') return doc;
-    s = s.substr(1, s.size() - 2);
-
-    // Trim again
-    start = s.find_first_not_of(" \t\n\r");
-    if (start == std::string::npos) return doc;
-    s = s.substr(start);
-    end = s.find_last_not_of(" \t\n\r");
-    s = s.substr(0, end + 1);
-    if (s.empty()) return doc;
-
-    size_t pos = 0;
-    while (pos < s.size()) {
-        while (pos < s.size() && (s[pos] == ' ' || s[pos] == ',' || s[pos] == '\t' || s[pos] == '\n')) pos++;
-        if (pos >= s.size()) break;
-
-        if (s[pos] != '"') break;
-        pos++;
-        size_t key_end = s.find('"', pos);
-        if (key_end == std::string::npos) break;
-        std::string key = s.substr(pos, key_end - pos);
-        pos = key_end + 1;
-
-        while (pos < s.size() && (s[pos] == ' ' || s[pos] == ':')) pos++;
-        if (pos >= s.size()) break;
-
-        if (s[pos] == '"') {
-            pos++;
-            size_t val_end = s.find('"', pos);
-            if (val_end == std::string::npos) break;
-            doc.Add(key, s.substr(pos, val_end - pos));
-            pos = val_end + 1;
-        } else if (s[pos] == '{') {
-            // Nested object — find matching brace
-            int depth = 0;
-            size_t obj_start = pos;
-            for (; pos < s.size(); pos++) {
-                if (s[pos] == '{') depth++;
-                if (s[pos] == '}') { depth--; if (depth == 0) { pos++; break; } }
-            }
-            std::string nested = s.substr(obj_start, pos - obj_start);
-            auto sub = std::make_shared<BsonDocument>(ParseJSON(nested));
-            doc.Add(key, sub);
-        } else if (s[pos] == 't' || s[pos] == 'f') {
-            if (s.substr(pos, 4) == "true") { doc.Add(key, true); pos += 4; }
-            else if (s.substr(pos, 5) == "false") { doc.Add(key, false); pos += 5; }
-        } else if (s[pos] == '-' || std::isdigit(s[pos])) {
-            size_t num_start = pos;
-            bool is_double = false;
-            if (s[pos] == '-') pos++;
-            while (pos < s.size() && (std::isdigit(s[pos]) || s[pos] == '.')) {
-                if (s[pos] == '.') is_double = true;
-                pos++;
-            }
-            std::string num_str = s.substr(num_start, pos - num_start);
-            if (is_double) {
-                doc.Add(key, std::stod(num_str));
-            } else {
-                int64_t v = std::stoll(num_str);
-                if (v >= INT32_MIN && v <= INT32_MAX) doc.Add(key, static_cast<int32_t>(v));
-                else doc.Add(key, v);
+// Keep every index of the collection in step with one document
+static void IndexDocument(CollectionInfo* coll, const BsonDocument& doc, const RecordID& rid) {
+    for (auto& idx : coll->indexes) {
+        auto fit = doc.elements.find(idx.field_name);
+        std::string key;
+        if (fit != doc.elements.end() && IndexKey::Encode(fit->second, &key)) {
+            idx.btree->Insert(key, rid);
+        }
+    }
+}
+
+// The same for a batch: each index takes its new entries in key order, so
+// consecutive inserts land in the same or neighbouring leaves
+static void IndexDocuments(CollectionInfo* coll, const std::vector<BsonDocument>& docs,
+                           const std::vector<RecordID>& rids) {
+    for (auto& idx : coll->indexes) {
+        IndexEntrySorter sorter;
+        for (size_t i = 0; i < docs.size(); i++) {
+            auto fit = docs[i].elements.find(idx.field_name);
+            std::string key;
+            if (fit != docs[i].elements.end() && IndexKey::Encode(fit->second, &key)) sorter.Add(key, rids[i]);
+        }
+        sorter.Finish();
+        std::string key;
+        RecordID rid;
+        while (sorter.Next(&key, &rid)) idx.btree->Insert(key, rid);
+    }
+}
+
+static void UnindexDocument(CollectionInfo* coll, const BsonDocument& doc, const RecordID& rid) {
+    for (auto& idx : coll->indexes) {
+        auto fit = doc.elements.find(idx.field_name);
+        std::string key;
+        if (fit != doc.elements.end() && IndexKey::Encode(fit->second, &key)) {
+            idx.btree->Delete(key, rid);
+        }
+    }
+}
+
+// ============================================================================
+// WriteUndo — puts back what a failed write request changed
+//
+// The transaction manager does no undo of its own, so a write request
+// registers, as it goes, the step that reverses each change it made to
+// the heap, the indexes and the versions. If the request throws, leaving
+// the scope runs them newest first, while the transaction still holds
+// its locks; the abort that follows ends a transaction that changed
+// nothing. Index entries are put back with Insert / Delete, which take a
+// pair that is already there (or gone) in their stride, so a step may
+// run for a change that only half happened. Declare it after the locals
+// its steps use (it runs them as it goes out of scope, before those do),
+// and Dismiss before committing.
+// ============================================================================
+
+class WriteUndo {
+public:
+    WriteUndo() = default;
+    WriteUndo(const WriteUndo&) = delete;
+    WriteUndo& operator=(const WriteUndo&) = delete;
+
+    ~WriteUndo() {
+        for (size_t i = steps_.size(); i-- > 0;) {
+            try {
+                steps_[i]();
+            } catch (const std::exception& e) {
+                std::cerr << "WriteUndo: " << e.what() << std::endl;
             }
         }
     }
+
+    void Add(std::function<void()> step) { steps_.push_back(std::move(step)); }
+    void Dismiss() { steps_.clear(); }
+
+private:
+    std::vector<std::function<void()>> steps_;
+};
+
+// ============================================================================
+// Binary protocol — BSON requests in, BSON responses out
+// ============================================================================
+
+// A request document, checked as it is decoded (it comes off the wire).
+// An array's elements are keyed by position, whatever keys they came
+// with; an object repeating a key is refused, as it is in JSON. Keys
+// are views into the request: the first few are compared one by one,
+// the rest looked up in a hash set.
+static constexpr size_t FEW_KEYS = 8;
+
+static BsonDocument DecodeBSON(const BsonView& view, bool is_array = false) {
+    BsonDocument doc;
+    doc.is_array = is_array;
+    std::array<std::string_view, FEW_KEYS> few;
+    std::unordered_set<std::string_view> many;
+    view.ForEach([&](const BsonElementView& e) {
+        BsonValue value;
+        switch (e.type) {
+            case BsonType::DOCUMENT:
+            case BsonType::ARRAY:
+                value = std::make_shared<BsonDocument>(DecodeBSON(e.AsDocument(), e.type == BsonType::ARRAY));
+                break;
+            case BsonType::NULL_TYPE:
+                value = nullptr;
+                break;
+            case BsonType::EXTERNAL:
+                throw std::runtime_error("Unknown BSON Type: " + std::to_string(static_cast<int>(e.type)));
+            default:
+                value = e.ToValue();
+        }
+
+        if (is_array) {
+            doc.elements.Append(std::to_string(doc.elements.size()), std::move(value));
+            return true;
+        }
+        size_t count = doc.elements.size();
+        bool repeated;
+        if (count < FEW_KEYS) {
+            repeated = std::find(few.begin(), few.begin() + count, e.key) != few.begin() + count;
+            few[count] = e.key;
+        } else {
+            if (many.empty()) many.insert(few.begin(), few.end());
+            repeated = !many.insert(e.key).second;
+        }
+        if (repeated) throw std::runtime_error("duplicate key '" + std::string(e.key) + "'");
+        doc.elements.Append(std::string(e.key), std::move(value));
+        return true;
+    });
     return doc;
 }
 
+// {"ok": true, "result": [...], "cursor": id} from documents that are BSON
+// already: each is appended to the reply as it is
+class BsonResultReply {
+public:
+    BsonResultReply() {
+        out_.assign(sizeof(int32_t), '\0');
+        out_.push_back(static_cast<char>(BsonType::BOOLEAN));
+        out_.append("ok", 3);  // With its terminator
+        out_.push_back(0x01);
+        out_.push_back(static_cast<char>(BsonType::ARRAY));
+        out_.append("result", 7);
+        array_start_ = out_.size();
+        out_.append(sizeof(int32_t), '\0');
+    }
+
+    void Add(const std::vector<uint8_t>& doc) {
+        out_.push_back(static_cast<char>(BsonType::DOCUMENT));
+        out_.append(std::to_string(count_++));
+        out_.push_back('\0');
+        out_.append(reinterpret_cast<const char*>(doc.data()), doc.size());
+    }
+
+    size_t Size() const { return out_.size(); }
+
+    std::string Finish(uint64_t cursor_id) {
+        out_.push_back('\0');
+        PatchLength(array_start_, out_.size() - array_start_);
+        out_.push_back(static_cast<char>(BsonType::INT64));
+        out_.append("cursor", 7);
+        int64_t id = static_cast<int64_t>(cursor_id);
+        out_.append(reinterpret_cast<const char*>(&id), sizeof(id));
+        out_.push_back('\0');
+        PatchLength(0, out_.size());
+        return std::move(out_);
+    }
+
+private:
+    void PatchLength(size_t at, size_t len) {
+        int32_t value = static_cast<int32_t>(len);
+        std::memcpy(&out_[at], &value, sizeof(value));
+    }
+
+    std::string out_;
+    size_t array_start_;
+    size_t count_ = 0;
+};
+
+// ============================================================================
+// Cursors — one reply's worth of a find's results at a time
+// ============================================================================
+
+std::string Server::NextBatch(std::unique_ptr<Cursor> cursor, uint64_t batch_size, bool bson, bool* encoded) {
+    // Rows come as they are stored, whichever protocol asks: BSON appends
+    // them, JSON writes each straight from its bytes
+    std::string json;
+    BsonResultReply reply;
+    if (!bson) json = R"({"ok":true,"result":[)";
+
+    bool done = false;
+    for (uint64_t sent = 0; sent < batch_size; sent++) {
+        if ((bson ? reply.Size() : json.size()) >= BATCH_REPLY_BYTES) break;
+        if (cursor->pos == cursor->batch.Size()) {
+            cursor->pos = 0;
+            if (!cursor->plan->NextBatch(&cursor->batch)) {
+                done = true;
+                break;
+            }
+        }
+        const Tuple& row = cursor->batch[cursor->pos++];
+        if (bson) {
+            reply.Add(row.bytes);
+        } else {
+            if (sent > 0) json.push_back(',');
+            Json::Write(BsonView(row.bytes.data(), row.bytes.size()), &json);
+        }
+    }
+    // A batch that ends exactly with the results leaves no cursor behind
+    if (!done && cursor->pos == cursor->batch.Size()) {
+        cursor->pos = 0;
+        done = !cursor->plan->NextBatch(&cursor->batch);
+    }
+
+    uint64_t id = done ? 0 : cursors_->Put(std::move(cursor));
+    if (bson) {
+        *encoded = true;
+        return reply.Finish(id);
+    }
+    json += R"(],"cursor":)" + std::to_string(id) + "}";
+    return json;
+}
+
+// ============================================================================
+// Stats — the Metrics snapshot and engine totals, as JSON or Prometheus text
+// ============================================================================
+
+static void WriteHistogramJSON(std::ostringstream& ss, const HistogramSnapshot& h) {
+    ss << R"({"count":)" << h.count << R"(,"sum_us":)" << h.sum_us << R"(,"max_us":)" << h.max_us
+       << R"(,"p50":)" << h.Percentile(0.5) << R"(,"p99":)" << h.Percentile(0.99) << R"(,"buckets":[)";
+    size_t used = HistogramSnapshot::NUM_BUCKETS;
+    while (used > 0 && h.buckets[used - 1] == 0) used--;  // Trailing empty buckets say nothing
+    for (size_t b = 0; b < used; b++) ss << (b ? "," : "") << h.buckets[b];
+    ss << "]}";
+}
+
+std::string Server::StatsJSON() {
+    MetricsSnapshot snap = Metrics::Snapshot();
+    LockStats locks = lock_manager_->GetStats();
+    std::ostringstream ss;
+
+    ss << R"({"ok":true,"result":{"counters":{)";
+    for (size_t i = 0; i < snap.counters.size(); i++) {
+        ss << (i ? "," : "") << '"' << Metrics::Name(static_cast<Counter>(i)) << "\":" << snap.counters[i];
+    }
+    ss << R"(},"latency":{)";
+    for (size_t i = 0; i < snap.histograms.size(); i++) {
+        ss << (i ? "," : "") << '"' << Metrics::Name(static_cast<Histogram>(i)) << "\":";
+        WriteHistogramJSON(ss, snap.histograms[i]);
+    }
+    ss << R"(},"commands":{)";
+    bool first = true;
+    for (size_t i = 0; i < NUM_COMMAND_SLOTS; i++) {
+        if (snap.commands[i].count == 0) continue;
+        ss << (first ? "" : ",") << '"' << COMMAND_NAMES[i] << "\":";
+        WriteHistogramJSON(ss, snap.commands[i]);
+        first = false;
+    }
+    ss << R"(},"locks":{"acquired":)" << locks.acquired << R"(,"waits":)" << locks.waits
+       << R"(,"wait_us":)" << locks.wait_us << R"(,"max_wait_us":)" << locks.max_wait_us
+       << R"(,"deadlocks":)" << locks.deadlocks << R"(,"escalations":)" << locks.escalations
+       << R"(},"vacuum_pruned":)" << vacuum_->GetPruned() << R"(,"open_cursors":)" << cursors_->Size() << "}}";
+    return ss.str();
+}
+
+// µs as seconds, the unit Prometheus histograms are in
+static std::string Seconds(uint64_t us) {
+    char buf[32];
+    auto res = std::to_chars(buf, buf + sizeof(buf), static_cast<double>(us) / 1e6);
+    return std::string(buf, res.ptr);
+}
+
+static void WriteCounter(std::ostringstream& ss, const std::string& name, const char* help, uint64_t value) {
+    ss << "# HELP " << name << ' ' << help << "\n# TYPE " << name << " counter\n" << name << ' ' << value << '\n';
+}
+
+// One series of a histogram; label is "" or `key="value",`. Bucket b holds
+// samples of at most 2^b - 1 µs, so that is its le.
+static void WriteHistogramSeries(std::ostringstream& ss, const std::string& name, const std::string& label,
+                                 const HistogramSnapshot& h) {
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b + 1 < HistogramSnapshot::NUM_BUCKETS; b++) {
+        cumulative += h.buckets[b];
+        ss << name << "_bucket{" << label << "le=\"" << Seconds(HistogramSnapshot::BucketLimit(b) - 1) << "\"} "
+           << cumulative << '\n';
+    }
+    ss << name << "_bucket{" << label << "le=\"+Inf\"} " << h.count << '\n';
+    std::string labels = label.empty() ? "" : "{" + label.substr(0, label.size() - 1) + "}";
+    ss << name << "_sum" << labels << ' ' << Seconds(h.sum_us) << '\n';
+    ss << name << "_count" << labels << ' ' << h.count << '\n';
+}
+
+std::string Server::PrometheusText() {
+    MetricsSnapshot snap = Metrics::Snapshot();
+    LockStats locks = lock_manager_->GetStats();
+    std::ostringstream ss;
+
+    for (size_t i = 0; i < snap.counters.size(); i++) {
+        WriteCounter(ss, std::string("docdb_") + Metrics::Name(static_cast<Counter>(i)) + "_total",
+                     "Engine event count", snap.counters[i]);
+    }
+    for (size_t i = 0; i < snap.histograms.size(); i++) {
+        std::string name = std::string("docdb_") + Metrics::Name(static_cast<Histogram>(i)) + "_seconds";
+        ss << "# HELP " << name << " Latency\n# TYPE " << name << " histogram\n";
+        WriteHistogramSeries(ss, name, "", snap.histograms[i]);
+    }
+    ss << "# HELP docdb_command_seconds Time to execute a request, by command\n"
+          "# TYPE docdb_command_seconds histogram\n";
+    for (size_t i = 0; i < NUM_COMMAND_SLOTS; i++) {
+        if (snap.commands[i].count == 0) continue;
+        WriteHistogramSeries(ss, "docdb_command_seconds", std::string("command=\"") + COMMAND_NAMES[i] + "\",",
+                             snap.commands[i]);
+    }
+
+    WriteCounter(ss, "docdb_lock_acquired_total", "Lock requests granted", locks.acquired);
+    WriteCounter(ss, "docdb_lock_waits_total", "Lock requests that had to wait", locks.waits);
+    WriteCounter(ss, "docdb_lock_deadlocks_total", "Lock requests refused to break a deadlock", locks.deadlocks);
+    WriteCounter(ss, "docdb_lock_escalations_total", "Record locks traded for a collection lock",
+                 locks.escalations);
+    WriteCounter(ss, "docdb_vacuum_pruned_total", "Row versions pruned by vacuum", vacuum_->GetPruned());
+    ss << "# HELP docdb_open_cursors Server-side cursors open\n# TYPE docdb_open_cursors gauge\n"
+       << "docdb_open_cursors " << cursors_->Size() << '\n';
+    return ss.str();
+}
+
 // ============================================================================
-// ProcessCommand — route a JSON request to the engine
+// ProcessCommand — route a request to the engine
 // ============================================================================
 
-std::string Server::ProcessCommand(const std::string& request_json) {
+std::string Server::ProcessCommand(const std::string& request, WireProtocol* protocol, lsn_t* commit_lsn) {
+    WireProtocol format = *protocol;  // The reply's, even to a hello
+    bool encoded = false;
+    size_t slot = NUM_COMMAND_SLOTS - 1;
+    auto start = std::chrono::steady_clock::now();
+    std::string response = Execute(request, protocol, commit_lsn, &encoded, &slot);
+    Metrics::RecordCommand(slot, Metrics::ElapsedUs(start));
+
+    // A commit is visible as soon as its COMMIT record is appended (see
+    // CommitWrite), so anything this request read may rest on one not yet
+    // durable: the reply, a read's too, waits for the log as it is now
+    if (wal_ && commit_lsn) *commit_lsn = std::max(*commit_lsn, wal_->GetCurrentLSN() - 1);
+    if (format == WireProtocol::JSON || encoded) return response;
+
+    // Other replies are small and built as JSON: re-encode them. One that
+    // does not parse is a server bug, answered as an error rather than thrown
+    std::vector<uint8_t> bytes;
     try {
-        BsonDocument req = ParseJSON(request_json);
+        Json::Parse(response, &bytes);
+    } catch (const std::runtime_error& e) {
+        return ErrorReply(WireProtocol::BSON, std::string("malformed reply: ") + e.what());
+    }
+    return std::string(bytes.begin(), bytes.end());
+}
+
+std::string Server::ErrorReply(WireProtocol protocol, const std::string& message) {
+    if (protocol == WireProtocol::JSON) return R"({"ok":false,"error":")" + Json::Escape(message) + "\"}";
+    BsonDocument reply;
+    reply.Add("ok", false);
+    reply.Add("error", message);
+    std::vector<uint8_t> bytes = BsonSerializer::Serialize(reply);
+    return std::string(bytes.begin(), bytes.end());
+}
+
+std::string Server::Execute(const std::string& request, WireProtocol* protocol, lsn_t* commit_lsn, bool* encoded,
+                            size_t* command_slot) {
+    // DDL reshapes the catalog under everyone's feet, and analyze rewrites the
+    // statistics every planner reads; everything else shares
+    std::shared_lock<ReaderWriterLatch> shared_guard(engine_latch_, std::defer_lock);
+    std::unique_lock<ReaderWriterLatch> exclusive_guard(engine_latch_, std::defer_lock);
+    Transaction* txn = nullptr;  // Set while a write request is in flight
+
+    try {
+        const bool bson = *protocol == WireProtocol::BSON;
+        BsonDocument req = bson ? DecodeBSON(BsonView(reinterpret_cast<const uint8_t*>(request.data()),
+                                                      request.size()))
+                                : Json::ParseDocument(request);
 
         auto cmd_it = req.elements.find("cmd");
         if (cmd_it == req.elements.end() || !std::holds_alternative<std::string>(cmd_it->second)) {
             return R"({"ok":false,"error":"missing 'cmd' field"})";
         }
         std::string cmd = std::get<std::string>(cmd_it->second);
+        *command_slot = CommandSlot(cmd);
+
+        if (cmd == "createCollection" || cmd == "dropCollection" || cmd == "createIndex" || cmd == "analyze") {
+            exclusive_guard.lock();
+        } else {
+            shared_guard.lock();
+        }
 
         // ---- ping ----
         if (cmd == "ping") {
             return R"({"ok":true,"result":"pong"})";
         }
 
+        // ---- stats ----
+        if (cmd == "stats") {
+            return StatsJSON();
+        }
+
+        // ---- hello — pick the protocol of the requests that follow ----
+        if (cmd == "hello") {
+            auto it = req.elements.find("protocol");
+            std::string wanted = it != req.elements.end() && std::holds_alternative<std::string>(it->second)
+                                     ? std::get<std::string>(it->second)
+                                     : "";
+            if (wanted == "bson") {
+                *protocol = WireProtocol::BSON;
+            } else if (wanted == "json") {
+                *protocol = WireProtocol::JSON;
+            } else {
+                return R"({"ok":false,"error":"'protocol' must be \"json\" or \"bson\""})";
+            }
+            return R"({"ok":true,"protocol":")" + wanted + "\"}";
+        }
+
         // ---- listCollections ----
         if (cmd == "listCollections") {
             auto names = catalog_->ListCollections();
@@ -393,7 +1112,7 @@ std::string Server::ProcessCommand(const std::string& request_json) {
             ss << R"({"ok":true,"result":[)";
             for (size_t i = 0; i < names.size(); i++) {
                 if (i > 0) ss << ",";
-                ss << "\"" << EscapeJSON(names[i]) << "\"";
+                ss << "\"" << Json::Escape(names[i]) << "\"";
             }
             ss << "]}";
             return ss.str();
@@ -404,10 +1123,13 @@ std::string Server::ProcessCommand(const std::string& request_json) {
             auto it = req.elements.find("name");
             if (it == req.elements.end()) return R"({"ok":false,"error":"missing 'name'"})";
             std::string name = std::get<std::string>(it->second);
-            bool ok = catalog_->CreateCollection(name);
+            auto cit = req.elements.find("compressed");
+            bool compressed = cit != req.elements.end() && std::holds_alternative<bool>(cit->second) &&
+                              std::get<bool>(cit->second);
+            bool ok = catalog_->CreateCollection(name, compressed);
             if (ok) {
-                catalog_->SaveCatalog();
-                bpm_->FlushAllPages();
+                // Logged by the catalog; without a WAL only the pages are durable
+                if (flush_policy_ == FlushPolicy::FLUSH_ALL) bpm_->FlushAllPages();
                 return R"({"ok":true})";
             }
             return R"({"ok":false,"error":"collection already exists"})";
@@ -418,12 +1140,40 @@ std::string Server::ProcessCommand(const std::string& request_json) {
             auto it = req.elements.find("name");
             if (it == req.elements.end()) return R"({"ok":false,"error":"missing 'name'"})";
             std::string name = std::get<std::string>(it->second);
+            cursors_->KillCollection(name);
             catalog_->DropCollection(name);
-            catalog_->SaveCatalog();
-            bpm_->FlushAllPages();
+            if (flush_policy_ == FlushPolicy::FLUSH_ALL) bpm_->FlushAllPages();
             return R"({"ok":true})";
         }
 
+        // ---- getMore — the next batch of a find ----
+        if (cmd == "getMore") {
+            uint64_t id = 0, batch_size = DEFAULT_BATCH_SIZE;
+            if (!GetCount(req, "cursor", &id) || id == 0) return R"({"ok":false,"error":"missing 'cursor'"})";
+            if (!GetCount(req, "batchSize", &batch_size)) {
+                return R"({"ok":false,"error":"'batchSize' must be a non-negative integer"})";
+            }
+            if (batch_size == 0) batch_size = DEFAULT_BATCH_SIZE;
+            std::unique_ptr<Cursor> cursor = cursors_->Take(id);
+            if (!cursor) return R"({"ok":false,"error":"cursor not found"})";
+            return NextBatch(std::move(cursor), batch_size, bson, encoded);
+        }
+
+        // ---- killCursors ----
+        if (cmd == "killCursors") {
+            auto ids_it = req.elements.find("cursors");
+            if (ids_it == req.elements.end() ||
+                !std::holds_alternative<std::shared_ptr<BsonDocument>>(ids_it->second)) {
+                return R"({"ok":false,"error":"missing 'cursors' array"})";
+            }
+            size_t killed = 0;
+            for (const auto& [key, value] : std::get<std::shared_ptr<BsonDocument>>(ids_it->second)->elements) {
+                uint64_t id;
+                if (ToCount(value, &id) && cursors_->Kill(id)) killed++;
+            }
+            return R"({"ok":true,"killed":)" + std::to_string(killed) + "}";
+        }
+
         // Commands that need a collection
         auto coll_it = req.elements.find("collection");
         if (coll_it == req.elements.end() || !std::holds_alternative<std::string>(coll_it->second)) {
@@ -431,8 +1181,16 @@ std::string Server::ProcessCommand(const std::string& request_json) {
         }
         std::string coll_name = std::get<std::string>(coll_it->second);
 
-        // Auto-create collection if it doesn't exist
-        if (!catalog_->GetCollection(coll_name)) {
+        // Auto-create collection if it doesn't exist (creation is DDL)
+        if (shared_guard.owns_lock() && !catalog_->GetCollection(coll_name)) {
+            shared_guard.unlock();
+            exclusive_guard.lock();
+            if (!catalog_->GetCollection(coll_name)) {
+                catalog_->CreateCollection(coll_name);
+            }
+            exclusive_guard.unlock();
+            shared_guard.lock();
+        } else if (!catalog_->GetCollection(coll_name)) {
             catalog_->CreateCollection(coll_name);
         }
         CollectionInfo* coll = catalog_->GetCollection(coll_name);
@@ -443,161 +1201,168 @@ std::string Server::ProcessCommand(const std::string& request_json) {
             auto doc_it = req.elements.find("document");
             if (doc_it == req.elements.end()) return R"({"ok":false,"error":"missing 'document'"})";
 
-            // The document is stored as a nested BsonDocument
-            BsonDocument insert_doc;
-            if (std::holds_alternative<std::shared_ptr<BsonDocument>>(doc_it->second)) {
-                insert_doc = *std::get<std::shared_ptr<BsonDocument>>(doc_it->second);
-            } else {
+            // The document is stored as a nested BsonDocument, used in place
+            if (!std::holds_alternative<std::shared_ptr<BsonDocument>>(doc_it->second) ||
+                std::get<std::shared_ptr<BsonDocument>>(doc_it->second)->is_array) {
                 return R"({"ok":false,"error":"'document' must be an object"})";
             }
+            const BsonDocument& insert_doc = *std::get<std::shared_ptr<BsonDocument>>(doc_it->second);
 
-            RecordID rid = coll->heap_file->InsertRecord(insert_doc);
+            txn = BeginWrite();
+            RecordID rid = coll->heap_file->InsertRecord(insert_doc, txn);
+            WriteUndo undo;
+            undo.Add([&] {
+                coll->heap_file->DeleteRecord(rid, txn);
+                coll->versions->Discard(rid, txn);
+            });
 
-            // Update indexes
-            for (auto& idx : coll->indexes) {
-                auto fit = insert_doc.elements.find(idx.field_name);
-                if (fit != insert_doc.elements.end()) {
-                    std::string key_str;
-                    if (std::holds_alternative<std::string>(fit->second))
-                        key_str = std::get<std::string>(fit->second);
-                    else if (std::holds_alternative<int32_t>(fit->second))
-                        key_str = std::to_string(std::get<int32_t>(fit->second));
-                    if (!key_str.empty()) idx.btree->Insert(key_str, rid);
-                }
-            }
+            undo.Add([&] { UnindexDocument(coll, insert_doc, rid); });
+            IndexDocument(coll, insert_doc, rid);
 
             std::ostringstream ss;
             ss << R"({"ok":true,"page":)" << rid.page_id << R"(,"slot":)" << rid.slot_id << "}";
 
-            bpm_->FlushAllPages();
+            undo.Dismiss();
+            CommitWrite(txn, commit_lsn);
             return ss.str();
         }
 
-        // ---- find ----
+        // ---- insertMany ----
+        if (cmd == "insertMany") {
+            auto docs_it = req.elements.find("documents");
+            if (docs_it == req.elements.end() ||
+                !std::holds_alternative<std::shared_ptr<BsonDocument>>(docs_it->second)) {
+                return R"({"ok":false,"error":"missing 'documents' array"})";
+            }
+
+            // The array arrives as a document keyed "0", "1", ...
+            std::vector<BsonDocument> docs;
+            for (auto& [key, value] : std::get<std::shared_ptr<BsonDocument>>(docs_it->second)->elements) {
+                if (!std::holds_alternative<std::shared_ptr<BsonDocument>>(value) ||
+                    std::get<std::shared_ptr<BsonDocument>>(value)->is_array) {
+                    return R"({"ok":false,"error":"'documents' must hold objects"})";
+                }
+                docs.push_back(std::move(*std::get<std::shared_ptr<BsonDocument>>(value)));
+            }
+
+            // One transaction: its records go to the WAL page group by page
+            // group, and the commit is a single flush. InsertRecords places
+            // all of the batch or none of it.
+            txn = BeginWrite();
+            std::vector<RecordID> rids = coll->heap_file->InsertRecords(docs, txn);
+            WriteUndo undo;
+            undo.Add([&] {
+                for (size_t i = rids.size(); i-- > 0;) {
+                    coll->heap_file->DeleteRecord(rids[i], txn);
+                    coll->versions->Discard(rids[i], txn);
+                }
+            });
+            undo.Add([&] {
+                for (size_t i = 0; i < docs.size(); i++) UnindexDocument(coll, docs[i], rids[i]);
+            });
+            IndexDocuments(coll, docs, rids);
+            undo.Dismiss();
+            CommitWrite(txn, commit_lsn);
+            return R"({"ok":true,"inserted":)" + std::to_string(rids.size()) + "}";
+        }
+
+        // ---- find — the first batch, and a cursor for the rest ----
         if (cmd == "find") {
-            std::vector<Predicate> predicates;
-            std::shared_ptr<BsonDocument> filter_doc_ptr;
+            FilterExpr filter;
             auto filter_it = req.elements.find("filter");
             if (filter_it != req.elements.end() &&
                 std::holds_alternative<std::shared_ptr<BsonDocument>>(filter_it->second)) {
-                filter_doc_ptr = std::get<std::shared_ptr<BsonDocument>>(filter_it->second);
-                for (auto& [k, v] : filter_doc_ptr->elements) {
-                    Predicate p;
-                    p.field_name = k;
-                    p.op = CompareOp::EQ;
-                    p.value = v;
-                    predicates.push_back(p);
-                }
+                filter = ParseFilter(*std::get<std::shared_ptr<BsonDocument>>(filter_it->second));
+            }
+            std::vector<std::string> fields;
+            bool include = true;
+            auto proj_it = req.elements.find("projection");
+            if (proj_it != req.elements.end() &&
+                (!std::holds_alternative<std::shared_ptr<BsonDocument>>(proj_it->second) ||
+                 !ParseProjection(*std::get<std::shared_ptr<BsonDocument>>(proj_it->second), &fields, &include))) {
+                return R"({"ok":false,"error":"'projection' must map fields to all 1 or all 0"})";
+            }
+            uint64_t skip = 0, limit = 0, batch_size = DEFAULT_BATCH_SIZE;
+            if (!GetCount(req, "skip", &skip) || !GetCount(req, "limit", &limit) ||
+                !GetCount(req, "batchSize", &batch_size)) {
+                return R"({"ok":false,"error":"'skip', 'limit' and 'batchSize' must be non-negative integers"})";
             }
+            if (batch_size == 0) batch_size = DEFAULT_BATCH_SIZE;
+
+            // The records travel as stored: never decoded
+            auto cursor = std::make_unique<Cursor>();
+            cursor->collection = coll_name;
+            cursor->snapshot = std::make_unique<ScopedSnapshot>(txn_manager_.get());
+            std::unique_ptr<Executor> plan = std::make_unique<SnapshotScanExecutor>(
+                Plan(coll, filter), coll->versions.get(), cursor->snapshot->Get(), filter);
+            if (skip > 0 || limit > 0) plan = std::make_unique<LimitExecutor>(std::move(plan), skip, limit);
+            if (!fields.empty()) plan = std::make_unique<ProjectionExecutor>(std::move(plan), std::move(fields), include);
+            plan->SetRowFormat(RowFormat::BYTES);
+            plan->Init();
+            cursor->plan = std::move(plan);
+            return NextBatch(std::move(cursor), batch_size, bson, encoded);
+        }
 
-            std::ostringstream ss;
-            ss << R"({"ok":true,"result":[)";
+        // ---- count ----
+        if (cmd == "count") {
+            FilterExpr filter;
+            auto filter_it = req.elements.find("filter");
+            if (filter_it != req.elements.end() &&
+                std::holds_alternative<std::shared_ptr<BsonDocument>>(filter_it->second)) {
+                filter = ParseFilter(*std::get<std::shared_ptr<BsonDocument>>(filter_it->second));
+            }
+            uint64_t count = Planner(coll, bpm_->GetPageSize(), scan_threads_).Count(filter);
 
-            if (predicates.empty()) {
-                // No filter — full sequential scan
-                SeqScanExecutor scan(coll->heap_file.get());
-                scan.Init();
-                Tuple tuple;
-                bool first = true;
-                while (scan.Next(&tuple)) {
-                    if (!first) ss << ",";
-                    first = false;
-                    ss << DocToJSON(tuple.doc);
-                }
-                scan.Close();
-            } else {
-                // Check if any predicate field has an index
-                BPlusTree* matched_index = nullptr;
-                std::string index_key;
-                std::string index_field;
-                std::vector<Predicate> remaining_predicates;
-
-                for (auto& pred : predicates) {
-                    bool found_index = false;
-                    if (!matched_index) {
-                        for (auto& idx : coll->indexes) {
-                            if (idx.field_name == pred.field_name && pred.op == CompareOp::EQ) {
-                                matched_index = idx.btree.get();
-                                index_field = pred.field_name;
-                                // Convert value to string key for B+ Tree
-                                if (std::holds_alternative<std::string>(pred.value))
-                                    index_key = std::get<std::string>(pred.value);
-                                else if (std::holds_alternative<int32_t>(pred.value))
-                                    index_key = std::to_string(std::get<int32_t>(pred.value));
-                                else if (std::holds_alternative<int64_t>(pred.value))
-                                    index_key = std::to_string(std::get<int64_t>(pred.value));
-                                found_index = true;
-                                break;
-                            }
-                        }
-                    }
-                    if (!found_index) {
-                        remaining_predicates.push_back(pred);
-                    }
-                }
+            std::ostringstream ss;
+            ss << R"({"ok":true,"count":)" << count;
+            if (filter.MatchesAll()) ss << R"(,"bytes":)" << coll->BytesUsed();
+            ss << "}";
+            return ss.str();
+        }
 
-                Tuple tuple;
-                bool first = true;
-
-                if (matched_index && !index_key.empty()) {
-                    // Use index scan (equality: lo_key == hi_key)
-                    IndexScanExecutor iscan(matched_index, coll->heap_file.get(),
-                                            index_key, index_key);
-                    iscan.Init();
-
-                    if (remaining_predicates.empty()) {
-                        while (iscan.Next(&tuple)) {
-                            if (!first) ss << ",";
-                            first = false;
-                            ss << DocToJSON(tuple.doc);
-                        }
-                    } else {
-                        // Index narrows results, then apply remaining filters
-                        while (iscan.Next(&tuple)) {
-                            bool match = true;
-                            for (auto& rp : remaining_predicates) {
-                                auto it = tuple.doc.elements.find(rp.field_name);
-                                if (it == tuple.doc.elements.end() || it->second != rp.value) {
-                                    match = false; break;
-                                }
-                            }
-                            if (match) {
-                                if (!first) ss << ",";
-                                first = false;
-                                ss << DocToJSON(tuple.doc);
-                            }
-                        }
-                    }
-                    iscan.Close();
-                } else {
-                    // Fallback: sequential scan + filter
-                    auto child = std::make_unique<SeqScanExecutor>(coll->heap_file.get());
-                    FilterExecutor filter(std::move(child), predicates);
-                    filter.Init();
-                    while (filter.Next(&tuple)) {
-                        if (!first) ss << ",";
-                        first = false;
-                        ss << DocToJSON(tuple.doc);
-                    }
-                    filter.Close();
-                }
+        // ---- explain ----
+        if (cmd == "explain") {
+            FilterExpr filter;
+            auto filter_it = req.elements.find("filter");
+            if (filter_it != req.elements.end() &&
+                std::holds_alternative<std::shared_ptr<BsonDocument>>(filter_it->second)) {
+                filter = ParseFilter(*std::get<std::shared_ptr<BsonDocument>>(filter_it->second));
             }
 
+            // The chosen plan, then every candidate, cheapest first
+            Planner planner(coll, bpm_->GetPageSize(), scan_threads_);
+            std::vector<AccessPath> paths = planner.Enumerate(filter);
+            auto path_json = [](const AccessPath& path) {
+                std::ostringstream ps;
+                ps << R"({"plan":")" << Json::Escape(path.Describe()) << R"(","rows":)" << path.rows
+                   << R"(,"cost":)" << path.cost << "}";
+                return ps.str();
+            };
+            std::ostringstream ss;
+            ss << R"({"ok":true,"plan":")" << Json::Escape(paths.front().Describe()) << R"(","rows":)"
+               << paths.front().rows << R"(,"cost":)" << paths.front().cost
+               << R"(,"collectionRows":)" << planner.EstimateRows() << R"(,"candidates":[)";
+            for (size_t i = 0; i < paths.size(); i++) {
+                if (i > 0) ss << ",";
+                ss << path_json(paths[i]);
+            }
             ss << "]}";
             return ss.str();
         }
 
-        // ---- count ----
-        if (cmd == "count") {
-            SeqScanExecutor scan(coll->heap_file.get());
-            scan.Init();
-            Tuple tuple;
-            int count = 0;
-            while (scan.Next(&tuple)) count++;
-            scan.Close();
-
+        // ---- analyze ----
+        if (cmd == "analyze") {
+            catalog_->Analyze(coll_name);
             std::ostringstream ss;
-            ss << R"({"ok":true,"count":)" << count << "}";
+            ss << R"({"ok":true,"rows":)" << coll->stats.row_count << R"(,"pages":)" << coll->stats.page_count
+               << R"(,"indexes":[)";
+            for (size_t i = 0; i < coll->indexes.size(); i++) {
+                const IndexInfo& idx = coll->indexes[i];
+                if (i > 0) ss << ",";
+                ss << R"({"field":")" << Json::Escape(idx.field_name) << R"(","entries":)" << idx.stats.num_entries
+                   << R"(,"distinct":)" << idx.stats.distinct_keys << "}";
+            }
+            ss << "]}";
             return ss.str();
         }
 
@@ -607,36 +1372,54 @@ std::string Server::ProcessCommand(const std::string& request_json) {
             if (filter_it == req.elements.end())
                 return R"({"ok":false,"error":"missing 'filter'"})";
 
-            std::vector<Predicate> predicates;
+            FilterExpr filter;
             if (std::holds_alternative<std::shared_ptr<BsonDocument>>(filter_it->second)) {
-                auto& filter_doc = *std::get<std::shared_ptr<BsonDocument>>(filter_it->second);
-                for (auto& [k, v] : filter_doc.elements) {
-                    Predicate p;
-                    p.field_name = k;
-                    p.op = CompareOp::EQ;
-                    p.value = v;
-                    predicates.push_back(p);
-                }
+                filter = ParseFilter(*std::get<std::shared_ptr<BsonDocument>>(filter_it->second));
             }
 
-            auto child = std::make_unique<SeqScanExecutor>(coll->heap_file.get());
-            FilterExecutor filter(std::move(child), predicates);
-            filter.Init();
+            std::unique_ptr<Executor> scan = Plan(coll, filter);
+            scan->Init();
 
             std::vector<RecordID> to_delete;
-            Tuple tuple;
-            while (filter.Next(&tuple)) to_delete.push_back(tuple.rid);
-            filter.Close();
+            TupleBatch batch;
+            while (scan->NextBatch(&batch)) {
+                for (size_t i = 0; i < batch.Size(); i++) to_delete.push_back(batch[i].rid);
+            }
+            scan->Close();
 
-            int deleted = 0;
+            // The scan ran unlocked: lock each match, then make sure it still matches
+            txn = BeginWrite();
+            std::sort(to_delete.begin(), to_delete.end());
+            // Every lock first: a deadlock victim aborts before changing anything
+            std::vector<std::pair<RecordID, BsonDocument>> matches;
             for (auto& rid : to_delete) {
-                if (coll->heap_file->DeleteRecord(rid)) deleted++;
+                BsonDocument current;
+                if (LockAndReread(txn, coll, rid, filter, &current)) matches.emplace_back(rid, std::move(current));
+            }
+            // Undone by inserting the document again: its slot may have
+            // gone to another inserter, so it comes back under a new RecordID
+            // (the version left at the old one shows it to older snapshots)
+            WriteUndo undo;
+            int deleted = 0;
+            for (auto& match : matches) {
+                const RecordID& rid = match.first;
+                coll->versions->Install(rid, &match.second, txn);
+                if (coll->heap_file->DeleteRecord(rid, txn)) {
+                    undo.Add([&, m = &match] {
+                        UnindexDocument(coll, m->second, m->first);
+                        RecordID back = coll->heap_file->InsertRecord(m->second, txn);
+                        IndexDocument(coll, m->second, back);
+                    });
+                    UnindexDocument(coll, match.second, rid);
+                    deleted++;
+                }
             }
 
             std::ostringstream ss;
             ss << R"({"ok":true,"deleted":)" << deleted << "}";
 
-            bpm_->FlushAllPages();
+            undo.Dismiss();
+            CommitWrite(txn, commit_lsn);
             return ss.str();
         }
 
@@ -647,42 +1430,63 @@ std::string Server::ProcessCommand(const std::string& request_json) {
             if (filter_it == req.elements.end() || update_it == req.elements.end())
                 return R"({"ok":false,"error":"missing 'filter' or 'update'"})";
 
-            std::vector<Predicate> predicates;
+            FilterExpr filter;
             BsonDocument update_doc;
             if (std::holds_alternative<std::shared_ptr<BsonDocument>>(filter_it->second)) {
-                auto& fd = *std::get<std::shared_ptr<BsonDocument>>(filter_it->second);
-                for (auto& [k, v] : fd.elements) {
-                    Predicate p; p.field_name = k; p.op = CompareOp::EQ; p.value = v;
-                    predicates.push_back(p);
-                }
+                filter = ParseFilter(*std::get<std::shared_ptr<BsonDocument>>(filter_it->second));
             }
             if (std::holds_alternative<std::shared_ptr<BsonDocument>>(update_it->second)) {
                 update_doc = *std::get<std::shared_ptr<BsonDocument>>(update_it->second);
             }
 
-            auto child = std::make_unique<SeqScanExecutor>(coll->heap_file.get());
-            FilterExecutor filter(std::move(child), predicates);
-            filter.Init();
+            std::unique_ptr<Executor> scan = Plan(coll, filter);
+            scan->Init();
 
-            std::vector<std::pair<RecordID, BsonDocument>> to_update;
-            Tuple tuple;
-            while (filter.Next(&tuple)) {
-                BsonDocument merged = tuple.doc;
-                for (auto& [k, v] : update_doc.elements) merged.elements[k] = v;
-                to_update.push_back({tuple.rid, merged});
+            std::vector<RecordID> to_update;
+            TupleBatch batch;
+            while (scan->NextBatch(&batch)) {
+                for (size_t i = 0; i < batch.Size(); i++) to_update.push_back(batch[i].rid);
             }
-            filter.Close();
-
+            scan->Close();
+
+            // The scan ran unlocked: lock each match, then merge into what is there now
+            txn = BeginWrite();
+            std::sort(to_update.begin(), to_update.end());
+            std::vector<std::pair<RecordID, BsonDocument>> matches;
+            for (auto& rid : to_update) {
+                BsonDocument current;
+                if (LockAndReread(txn, coll, rid, filter, &current)) matches.emplace_back(rid, std::move(current));
+            }
+            // The heap write, the step that can fail, goes first; undone, it
+            // writes the matched document back and takes its version away
+            std::vector<std::pair<RecordID, BsonDocument>> written;  // Where each lives now, as merged
+            written.reserve(matches.size());
+            WriteUndo undo;
             int updated = 0;
-            for (auto& [rid, new_doc] : to_update) {
-                coll->heap_file->UpdateRecord(rid, new_doc);
+            for (auto& match : matches) {
+                const RecordID& rid = match.first;
+                BsonDocument merged = match.second;
+                for (auto& [k, v] : update_doc.elements) merged.elements[k] = v;
+                coll->versions->Install(rid, &match.second, txn);
+                RecordID new_rid = coll->heap_file->UpdateRecord(rid, merged, txn);
+                written.emplace_back(new_rid, std::move(merged));
+                undo.Add([&, m = &match, w = &written.back()] {
+                    UnindexDocument(coll, w->second, w->first);
+                    UnindexDocument(coll, m->second, m->first);
+                    RecordID back = coll->heap_file->UpdateRecord(w->first, m->second, txn);
+                    IndexDocument(coll, m->second, back);
+                    if (back == m->first) coll->versions->Discard(back, txn);
+                });
+                UnindexDocument(coll, match.second, rid);
+                IndexDocument(coll, written.back().second, new_rid);
                 updated++;
             }
 
             std::ostringstream ss;
             ss << R"({"ok":true,"updated":)" << updated << "}";
 
-            bpm_->FlushAllPages();
+            undo.Dismiss();
+            CommitWrite(txn, commit_lsn);
             return ss.str();
         }
 
@@ -693,14 +1497,17 @@ std::string Server::ProcessCommand(const std::string& request_json) {
                 return R"({"ok":false,"error":"missing 'field'"})";
             std::string field = std::get<std::string>(field_it->second);
             catalog_->CreateIndex(coll_name, field);
-            catalog_->SaveCatalog();
-            bpm_->FlushAllPages();
+            if (flush_policy_ == FlushPolicy::FLUSH_ALL) bpm_->FlushAllPages();
             return R"({"ok":true})";
         }
 
-        return R"({"ok":false,"error":"unknown command: )" + cmd + "\"}";
+        return R"({"ok":false,"error":"unknown command: )" + Json::Escape(cmd) + "\"}";
 
     } catch (const std::exception& e) {
-        return std::string(R"({"ok":false,"error":")") + EscapeJSON(e.what()) + "\"}";
+        if (txn) {
+            txn_manager_->Abort(txn);
+            txn_manager_->Release(txn);
+        }
+        return std::string(R"({"ok":false,"error":")") + Json::Escape(e.what()) + "\"}";
     }
 }
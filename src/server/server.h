@@ -4,43 +4,132 @@
 #include "execution_engine/executor/executor.h"
 #include "execution_engine/executor/seq_scan.h"
 #include "execution_engine/executor/filter.h"
+#include "execution_engine/executor/filter_expr.h"
 #include "execution_engine/executor/index_scan.h"
+#include "execution_engine/planner/planner.h"
 #include "storage_engine/buffer/buffer_pool.h"
 #include "storage_engine/disk_manager/disk_manager.h"
 #include "storage_engine/serializer/serializer.h"
+#include "concurrency/lock_manager.h"
+#include "concurrency/transaction.h"
+#include "concurrency/vacuum.h"
+#include "recovery/wal.h"
+#include "recovery/checkpointer.h"
+#include "recovery/background_writer.h"
+#include "concurrency/rw_latch.h"
+#include "server/worker_pool.h"
+#include "server/ring_buffer.h"
+#include "server/cursor_table.h"
+#include "server/metrics_endpoint.h"
 
 #include <string>
 #include <memory>
+#include <array>
 #include <atomic>
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 // ============================================================================
-// TCP Server — epoll-based, non-blocking, single-threaded event loop
+// TCP Server — epoll-based, non-blocking event loop with optional worker pool
 //
 // Wire protocol (length-prefixed JSON):
 //   Request:   [4 bytes big-endian length] [JSON payload]
 //   Response:  [4 bytes big-endian length] [JSON payload]
 //
+// Requests may be pipelined: a client can send many before reading a
+// response, and gets the responses in request order. Responses queue per
+// connection and go out several per writev; what the socket does not take
+// waits for EPOLLOUT, so the event loop never blocks on a slow reader.
+//
+// Binary protocol: { "cmd": "hello", "protocol": "bson" } switches the
+// connection, from the next request on, to requests and responses that
+// are BSON documents of the same shape (same framing). find results are
+// then the stored records' bytes, copied out of the heap pages without
+// being decoded (RowFormat::BYTES). { "protocol": "json" } switches back.
+// JSON's find writes its text from those same bytes (Json::Write); arrays
+// in either protocol are BsonType::ARRAY, and come back as arrays.
+//
 // Request JSON:
 //   { "cmd": "insert", "collection": "users", "document": {...} }
-//   { "cmd": "find",   "collection": "users", "filter": {...} }
+//   { "cmd": "insertMany", "collection": "users", "documents": [{...}, ...] }
+//   { "cmd": "find",   "collection": "users", "filter": {...},
+//     "projection": {"name": 1, ...}, "skip": N, "limit": N, "batchSize": N }  (all optional)
+//   { "cmd": "getMore", "cursor": id, "batchSize": N }
+//   { "cmd": "killCursors", "cursors": [id, ...] }
 //   { "cmd": "delete", "collection": "users", "filter": {...} }
 //   { "cmd": "update", "collection": "users", "filter": {...}, "update": {...} }
-//   { "cmd": "count",  "collection": "users" }
+//   { "cmd": "count",  "collection": "users", "filter": {...} }  (filter optional)
+//   { "cmd": "explain", "collection": "users", "filter": {...} }
+//   { "cmd": "analyze", "collection": "users" }
 //   { "cmd": "createCollection", "name": "users" }
 //   { "cmd": "dropCollection",   "name": "users" }
 //   { "cmd": "createIndex", "collection": "users", "field": "name" }
 //   { "cmd": "listCollections" }
+//   { "cmd": "hello", "protocol": "bson" | "json" }
 //   { "cmd": "ping" }
+//   { "cmd": "stats" }
 //
 // Response JSON:
 //   { "ok": true, "result": ... }
 //   { "ok": false, "error": "..." }
+//   find, getMore: { "ok": true, "result": [...], "cursor": id }
+//
+// Cursors: find answers with the first batchSize documents (at most about
+// BATCH_REPLY_BYTES of them) and, if there are more, the id of a cursor
+// holding the suspended plan; getMore resumes it for the next batch, and
+// cursor 0 means the results are done. Every batch reads find's snapshot.
+// A projection lists the fields to keep (1) or to drop (0), not both;
+// limit 0 means none. Cursors unused for cursor_timeout_ms are closed.
+//
+// Metrics: stats answers with the process's counters (buffer pool, disk,
+// WAL, B+ tree splits), the latency histograms of disk I/O, WAL appends
+// and fsyncs and lock waits, and one per command — time in Execute, not
+// the wait for the commit's fsync — each as count, sum_us, max_us, p50,
+// p99 and its power-of-two buckets; plus lock, vacuum and cursor totals.
+// With metrics_port set, the same is served as Prometheus text on GET
+// /metrics by a MetricsEndpoint thread.
+//
+// Durability (FlushPolicy):
+//   FLUSH_ALL     — every write request flushes all dirty pages before replying
+//   GROUP_COMMIT  — every write request is a WAL transaction. Responses are
+//                   held until the end of the event-loop iteration, then one
+//                   WAL fsync covers every commit in the batch before any of
+//                   them is sent. A BackgroundWriter writes pages back and
+//                   a Checkpointer logs fuzzy checkpoints that bound the log.
+//
+// Execution (num_workers):
+//   0   — requests run inline on the epoll thread (the batching above)
+//   N>0 — the epoll thread only frames requests; N WorkerPool threads run
+//         them. Each connection's requests run one at a time, in arrival
+//         order, so its responses come back in order. A worker waits for its
+//         own commit LSN; concurrent workers share each WAL fsync.
+//
+//   engine_latch_ is taken shared by every request and exclusively by DDL.
+//   Below it, heap/FSM pages use their page latches, each
+//   B+ Tree its tree latch, and delete/update take exclusive record locks
+//   from the LockManager (in RecordID order; past lock_escalation of them,
+//   the collection) before re-checking the filter, and change nothing
+//   until all are held. A deadlock victim's request fails and is aborted.
+//
+//   find reads a snapshot (SnapshotScanExecutor): no locks, and none of
+//   the changes of write requests still running or started after it. Each
+//   write request installs the versions it replaces in its collection's
+//   VersionStore; a Vacuum thread prunes them every vacuum_interval_ms.
+//   count reads the newest versions. An open cursor keeps its snapshot
+//   registered, so its versions stay until it is done or closed; a
+//   collection's cursors are closed when it is dropped.
 // ============================================================================
 
+// How a connection's requests and responses are encoded
+enum class WireProtocol : uint8_t { JSON, BSON };
+
 class Server {
 public:
-    Server(const std::string& db_file, int port = 6379);
+    // Uses config's db/WAL file names, flush policy, worker and shard counts
+    explicit Server(const DBConfigs& config, int port = 6379);
     ~Server();
 
     // Start the server (blocks until stopped)
@@ -59,17 +148,89 @@ private:
     // Read data from a client
     void HandleClient(int client_fd);
 
-    // Process a complete request and return response JSON
-    std::string ProcessCommand(const std::string& request_json);
+    // The client's socket can take more: write what its queue holds
+    void HandleWritable(int client_fd);
+
+    // Close a connection and drop its held responses
+    void CloseClient(int client_fd);
+
+    // ---- Worker-pool mode ----
+    struct Connection;
+
+    // Queue a framed request; schedules the connection if it is idle
+    void DispatchRequest(const std::shared_ptr<Connection>& conn, std::string request);
+
+    // Worker task: run the connection's queued requests in order
+    void DrainConnection(const std::shared_ptr<Connection>& conn);
+
+    // Process a complete request in *protocol and return the response in
+    // it; a hello request changes *protocol for the requests after it.
+    // commit_lsn receives the LSN the response must wait for (INVALID_LSN if none).
+    std::string ProcessCommand(const std::string& request, WireProtocol* protocol, lsn_t* commit_lsn = nullptr);
 
-    // ---- JSON helpers (reuse BsonDocument as quick parser) ----
-    BsonDocument ParseJSON(const std::string& json);
-    std::string DocToJSON(const BsonDocument& doc);
+    // ProcessCommand's body. Responses are JSON except where *encoded is
+    // set: a BSON reply built directly (find). *command_slot receives the
+    // command's Metrics slot once it is known.
+    std::string Execute(const std::string& request, WireProtocol* protocol, lsn_t* commit_lsn, bool* encoded,
+                        size_t* command_slot);
+
+    // {"ok": false, "error": message}, encoded in protocol
+    static std::string ErrorReply(WireProtocol protocol, const std::string& message);
+
+    // The stats reply, and the same numbers in Prometheus text format
+    std::string StatsJSON();
+    std::string PrometheusText();
+
+    // Write requests run as one transaction each
+    Transaction* BeginWrite();
+    void CommitWrite(Transaction* txn, lsn_t* commit_lsn);
+
+    // X-lock a record found by an unlocked scan and re-read it. False if it
+    // was deleted or no longer matches the filter in the meantime; throws
+    // if the transaction was chosen as a deadlock victim.
+    bool LockAndReread(Transaction* txn, CollectionInfo* coll, const RecordID& rid,
+                       const FilterExpr& filter, BsonDocument* out_doc);
+
+    // The Planner's cheapest plan for filter on a collection
+    std::unique_ptr<Executor> Plan(CollectionInfo* coll, const FilterExpr& filter);
+
+    // The reply to find / getMore: the cursor's next batch_size rows (fewer
+    // past BATCH_REPLY_BYTES), in JSON or BSON (*encoded). The cursor goes
+    // back to cursors_ unless the rows ran out.
+    std::string NextBatch(std::unique_ptr<Cursor> cursor, uint64_t batch_size, bool bson, bool* encoded);
+
+    // Make the batch's commits durable, then send the held responses
+    void FlushPendingResponses();
+
+    // Append a length-prefixed response to the connection's output queue
+    // (its mutex held)
+    void QueueResponse(Connection& conn, std::string response);
+
+    // Write as much of the output queue as the socket takes, many
+    // responses per writev (its mutex held). On EAGAIN the rest waits for
+    // the next EPOLLOUT; on a write error the queue is dropped and the
+    // socket shut down, which the epoll thread sees as a disconnect.
+    void FlushOutput(Connection& conn);
 
     // ---- Engine components ----
     std::unique_ptr<DiskManager> disk_manager_;
     std::unique_ptr<BufferPoolManager> bpm_;
     std::unique_ptr<Catalog> catalog_;
+    std::unique_ptr<WAL> wal_;                  // GROUP_COMMIT only
+    std::unique_ptr<LockManager> lock_manager_;
+    std::unique_ptr<TransactionManager> txn_manager_;
+    std::unique_ptr<Checkpointer> checkpointer_;  // GROUP_COMMIT only
+    std::unique_ptr<BackgroundWriter> bg_writer_; // GROUP_COMMIT only
+    std::unique_ptr<Vacuum> vacuum_;
+    std::unique_ptr<CursorTable> cursors_;
+    FlushPolicy flush_policy_;
+    size_t scan_threads_;  // For ParallelSeqScanExecutor (0 = one per core)
+
+    // Shared by requests, exclusive for DDL
+    ReaderWriterLatch engine_latch_;
+
+    std::unique_ptr<WorkerPool> workers_;  // Worker-pool mode only
+    std::unique_ptr<MetricsEndpoint> metrics_endpoint_;  // metrics_port set only
 
     // ---- Network state ----
     int server_fd_;
@@ -77,9 +238,32 @@ private:
     int port_;
     std::atomic<bool> running_;
 
-    // ---- Per-client read buffers ----
-    struct ClientBuffer {
-        std::string data;
+    // ---- Per-connection state ----
+    // The epoll thread owns the map and in_buffer. In worker-pool mode the
+    // rest is guarded by mutex; closed is set (and the fd closed) under it,
+    // so a worker never writes to a reused fd number.
+    struct OutFrame {
+        std::array<uint8_t, 4> header;  // Big-endian payload length
+        std::string payload;
+    };
+    struct Connection {
+        int fd;
+        RingBuffer in_buffer;
+        std::mutex mutex;
+        std::deque<std::string> requests;
+        bool busy = false;     // A worker is draining this connection
+        bool closed = false;
+        std::deque<OutFrame> out;  // Responses not yet fully written, in order
+        size_t out_sent = 0;       // Bytes of out.front() already written
+        WireProtocol protocol = WireProtocol::JSON;  // Touched only by whoever runs its requests
+    };
+    std::unordered_map<int, std::shared_ptr<Connection>> connections_;
+
+    // ---- Responses waiting for the batch's WAL flush ----
+    struct PendingResponse {
+        int client_fd;
+        std::string response;
     };
-    std::unordered_map<int, ClientBuffer> client_buffers_;
+    std::vector<PendingResponse> pending_responses_;
+    lsn_t pending_commit_lsn_ = INVALID_LSN;
 };
@@ -0,0 +1,74 @@
+#include "worker_pool.h"
+#include <iostream>
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+WorkerPool::WorkerPool(size_t num_workers) : num_workers_(num_workers) {}
+
+WorkerPool::~WorkerPool() {
+    Stop();
+}
+
+// ============================================================================
+// Start / Stop
+// ============================================================================
+
+void WorkerPool::Start() {
+    if (!workers_.empty()) return;
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = false;
+    }
+    for (size_t i = 0; i < num_workers_; i++) {
+        workers_.emplace_back(&WorkerPool::Loop, this);
+    }
+}
+
+void WorkerPool::Stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+    workers_.clear();
+}
+
+// ============================================================================
+// Submit
+// ============================================================================
+
+void WorkerPool::Submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+// ============================================================================
+// Loop — pop and run tasks until stopped and the queue is empty
+// ============================================================================
+
+void WorkerPool::Loop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) return;  // Stopped and drained
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "WorkerPool: " << e.what() << std::endl;
+        }
+    }
+}
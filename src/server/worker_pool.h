@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+// WorkerPool — fixed set of executor threads draining one task queue
+//
+// The server's epoll thread frames requests and submits them here so that a
+// long-running command (e.g. a full-scan find) only occupies one worker
+// instead of stalling the event loop. Ordering between tasks is not
+// guaranteed; callers that need per-connection order serialise on their own
+// (see Server::DrainConnection).
+// ============================================================================
+
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t num_workers);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Spawn the worker threads
+    void Start();
+
+    // Run every task already queued, then join the workers
+    void Stop();
+
+    // Queue a task for any idle worker
+    void Submit(std::function<void()> task);
+
+    size_t Size() const { return num_workers_; }
+
+private:
+    void Loop();
+
+    size_t num_workers_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_ = false;
+};
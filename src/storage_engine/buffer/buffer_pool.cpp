@@ -1,143 +1,177 @@
 #include "buffer_pool.h" 
+#include "storage_engine/common/metrics.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
 #include <iostream>
 
 // ==============================================================================
-// LRUReplacer Implementation
+// BufferPoolManager Implementation
 // ==============================================================================
 
-void LRUReplacer::Pin(frame_id_t frame_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = lru_map_.find(frame_id);
-    if (it != lru_map_.end()) {
-        lru_list_.erase(it->second);
-        lru_map_.erase(it);
-    }
-}
+BufferPoolManager::BufferPoolManager(size_t pool_size, DiskManager *disk_manager, size_t num_shards,
+                                     ReplacerPolicy policy, size_t scan_ring_frames)
+    : pool_size_(pool_size), page_size_(disk_manager->GetPageSize()), disk_manager_(disk_manager) {
 
-void LRUReplacer::Unpin(frame_id_t frame_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (lru_map_.find(frame_id) == lru_map_.end()) {
-        lru_list_.push_front(frame_id);
-        lru_map_[frame_id] = lru_list_.begin();
+    // One allocation for all frames; aligned so frames can be handed to direct I/O
+    frame_arena_ = static_cast<char*>(std::aligned_alloc(4096, pool_size_ * page_size_));
+    if (!frame_arena_) {
+        throw std::runtime_error("BufferPoolManager: cannot allocate " +
+                                 std::to_string(pool_size_) + " frames of " +
+                                 std::to_string(page_size_) + " bytes");
     }
-}
+    std::memset(frame_arena_, 0, pool_size_ * page_size_);
 
-bool LRUReplacer::Victim(frame_id_t *frame_id) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (lru_list_.empty()) {
-        return false;
-    }
-    *frame_id = lru_list_.back();
-    lru_map_.erase(*frame_id);
-    lru_list_.pop_back();
-    return true;
-}
-
-size_t LRUReplacer::Size() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return lru_list_.size();
-}
-
-// ==============================================================================
-// BufferPoolManager Implementation
-// ==============================================================================
-
-BufferPoolManager::BufferPoolManager(size_t pool_size, DiskManager *disk_manager)
-    : pool_size_(pool_size), disk_manager_(disk_manager) {
-    
     // FIX 1: Use 'new' instead of 'resize'
     pages_ = new Page[pool_size_];
-    
-    replacer_ = std::make_unique<LRUReplacer>(pool_size);
-
     for (size_t i = 0; i < pool_size_; ++i) {
-        free_list_.emplace_back(static_cast<frame_id_t>(i));
+        pages_[i].data_ = frame_arena_ + i * page_size_;
+        pages_[i].page_size_ = page_size_;
+    }
+
+    // Every shard needs at least one frame
+    num_shards = std::max<size_t>(1, std::min(num_shards, pool_size_));
+
+    // Give each shard a contiguous run of frames; the first (pool_size % n) get one extra
+    frame_id_t next_frame = 0;
+    for (size_t s = 0; s < num_shards; ++s) {
+        size_t frames = pool_size_ / num_shards + (s < pool_size_ % num_shards ? 1 : 0);
+        auto shard = std::make_unique<Shard>();
+        shard->first_frame = next_frame;
+        shard->replacer = Replacer::Create(policy, frames);
+        // A scan may hold at most a quarter of a shard
+        size_t ring = (scan_ring_frames + num_shards - 1) / num_shards;
+        shard->scan_ring_capacity = std::min(ring, frames / 4);
+        for (size_t i = 0; i < frames; ++i) {
+            shard->free_list.emplace_back(next_frame++);
+        }
+        shards_.push_back(std::move(shard));
     }
 }
 
 BufferPoolManager::~BufferPoolManager() {
+    // Prefetch completions touch our frames; let them land first
+    disk_manager_->DrainAsync();
+
     // Flush all dirty pages directly (no lock — we're in destructor, single-threaded)
-    for (size_t i = 0; i < pool_size_; ++i) {
-        if (pages_[i].IsDirty() && pages_[i].GetPageId() != INVALID_PAGE_ID) {
-            disk_manager_->WritePage(pages_[i].GetPageId(), pages_[i].GetData());
-            pages_[i].is_dirty_ = false;
-        }
+    for (auto &shard : shards_) {
+        FlushShard(*shard);
     }
     disk_manager_->Sync();
     delete[] pages_;
+    std::free(frame_arena_);
 }
 
-Page *BufferPoolManager::FetchPage(page_id_t page_id) {
-    std::lock_guard<std::mutex> lock(latch_);
-
-    if (page_table_.find(page_id) != page_table_.end()) {
-        frame_id_t frame_id = page_table_[page_id];
-        replacer_->Pin(frame_id);
-        pages_[frame_id].pin_count_++;
-        return &pages_[frame_id];
-    }
-
-    frame_id_t frame_id;
-    if (!FindFreeFrame(&frame_id)) {
-        return nullptr;
-    }
-
+Page *BufferPoolManager::InstallPage(Shard &shard, frame_id_t frame_id, page_id_t page_id) {
     Page *page = &pages_[frame_id];
 
+    if (page->GetPageId() != INVALID_PAGE_ID) Metrics::Add(Counter::BUFFER_EVICTIONS);
     if (page->IsDirty()) {
+        FlushLogFor(page->page_lsn_.load());
         disk_manager_->WritePage(page->GetPageId(), page->GetData());
+        Metrics::Add(Counter::BUFFER_DIRTY_WRITES);
     }
 
-    page_table_.erase(page->GetPageId());
-    page_table_[page_id] = frame_id;
+    shard.page_table.erase(page->GetPageId());
+    shard.page_table[page_id] = frame_id;
 
     page->page_id_ = page_id;
     page->pin_count_ = 1;
     page->is_dirty_ = false;
-    page->ResetMemory(); 
-
-    disk_manager_->ReadPage(page_id, page->GetData());
-    replacer_->Pin(frame_id);
+    page->rec_lsn_ = Page::INVALID_REC_LSN;
+    page->page_lsn_ = Page::INVALID_REC_LSN;
+    page->scan_resident_ = false;
+    page->io_pending_ = false;
+    page->io_failed_ = false;
+    page->ResetMemory();
 
+    shard.replacer->Pin(frame_id - shard.first_frame);
     return page;
 }
 
-Page *BufferPoolManager::NewPage(page_id_t *page_id) {
-    std::lock_guard<std::mutex> lock(latch_);
+Page *BufferPoolManager::FetchPage(page_id_t page_id, AccessType access) {
+    Shard &shard = ShardFor(page_id);
+    std::unique_lock<std::mutex> lock(shard.latch);
+
+    auto it = shard.page_table.find(page_id);
+    if (it != shard.page_table.end()) {
+        frame_id_t frame_id = it->second;
+        Page *page = &pages_[frame_id];
+        shard.replacer->Pin(frame_id - shard.first_frame);
+        page->pin_count_++;
+        Metrics::Add(Counter::BUFFER_HITS);
+        // Someone other than a scan wants it: the ring must not recycle it
+        if (access == AccessType::NORMAL) page->scan_resident_ = false;
+
+        // Prefetched but not read yet; our pin keeps the frame in place
+        if (page->io_pending_) {
+            shard.io_done.wait(lock, [page] { return !page->io_pending_; });
+        }
+        if (page->io_failed_) {
+            page->io_failed_ = false;
+            disk_manager_->ReadPage(page_id, page->GetData());
+        }
+        return page;
+    }
 
     frame_id_t frame_id;
-    if (!FindFreeFrame(&frame_id)) {
+    bool found = (access == AccessType::SCAN && shard.scan_ring_capacity > 0)
+                     ? FindScanFrame(shard, &frame_id)
+                     : FindFreeFrame(shard, &frame_id);
+    if (!found) {
         return nullptr;
     }
 
-    *page_id = disk_manager_->AllocatePage();
-    Page *page = &pages_[frame_id];
-    
-    if (page->IsDirty()) {
-        disk_manager_->WritePage(page->GetPageId(), page->GetData());
-    }
+    Metrics::Add(Counter::BUFFER_MISSES);
+    Page *page = InstallPage(shard, frame_id, page_id);
+    page->scan_resident_ = (access == AccessType::SCAN);
+    disk_manager_->ReadPage(page_id, page->GetData());
+    return page;
+}
 
-    page_table_.erase(page->GetPageId());
-    page_table_[*page_id] = frame_id;
+Page *BufferPoolManager::NewPage(page_id_t *page_id) {
+    // The id picks the shard, so it has to be allocated before we know
+    // whether that shard has a frame to spare. A failed call leaves a hole
+    // in the file that reads back as a zeroed page.
+    page_id_t new_page_id = disk_manager_->AllocatePage();
+    Shard &shard = ShardFor(new_page_id);
+    std::lock_guard<std::mutex> lock(shard.latch);
 
-    page->page_id_ = *page_id;
-    page->pin_count_ = 1;
-    page->is_dirty_ = false;
-    page->ResetMemory(); 
+    frame_id_t frame_id;
+    if (!FindFreeFrame(shard, &frame_id)) {
+        return nullptr;
+    }
 
-    replacer_->Pin(frame_id);
+    *page_id = new_page_id;
+    return InstallPage(shard, frame_id, new_page_id);
+}
 
-    return page;
+Page *BufferPoolManager::NewPageAt(page_id_t page_id) {
+    {
+        Shard &shard = ShardFor(page_id);
+        std::lock_guard<std::mutex> lock(shard.latch);
+        if (shard.page_table.find(page_id) == shard.page_table.end()) {
+            frame_id_t frame_id;
+            if (!FindFreeFrame(shard, &frame_id)) {
+                return nullptr;
+            }
+            return InstallPage(shard, frame_id, page_id);
+        }
+    }
+    // A scan got to it first and read back the zeroed page
+    return FetchPage(page_id);
 }
 
 bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
-    std::lock_guard<std::mutex> lock(latch_);
+    Shard &shard = ShardFor(page_id);
+    std::lock_guard<std::mutex> lock(shard.latch);
 
-    if (page_table_.find(page_id) == page_table_.end()) {
+    auto it = shard.page_table.find(page_id);
+    if (it == shard.page_table.end()) {
         return false;
     }
 
-    frame_id_t frame_id = page_table_[page_id];
+    frame_id_t frame_id = it->second;
     Page *page = &pages_[frame_id];
 
     if (is_dirty) {
@@ -151,48 +185,221 @@ bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
     page->pin_count_--;
 
     if (page->pin_count_ == 0) {
-        replacer_->Unpin(frame_id);
+        shard.replacer->Unpin(frame_id - shard.first_frame);
     }
 
     return true;
 }
 
 bool BufferPoolManager::FlushPage(page_id_t page_id) {
-    std::lock_guard<std::mutex> lock(latch_);
-    
-    if (page_table_.find(page_id) == page_table_.end()) {
+    Shard &shard = ShardFor(page_id);
+    std::lock_guard<std::mutex> lock(shard.latch);
+
+    auto it = shard.page_table.find(page_id);
+    if (it == shard.page_table.end()) {
         return false;
     }
-    
-    frame_id_t frame_id = page_table_[page_id];
-    Page *page = &pages_[frame_id];
-    
+
+    Page *page = &pages_[it->second];
+
+    // The frame does not hold the page's contents yet; disk already does
+    if (page->io_pending_ || page->io_failed_) {
+        return true;
+    }
+
+    FlushLogFor(page->page_lsn_.load());
     disk_manager_->WritePage(page_id, page->GetData());
+    if (page->is_dirty_) Metrics::Add(Counter::BUFFER_DIRTY_WRITES);
     page->is_dirty_ = false;
+    page->rec_lsn_ = Page::INVALID_REC_LSN;
     return true;
 }
 
-void BufferPoolManager::FlushAllPages() {
-    std::lock_guard<std::mutex> lock(latch_);
-    for (auto& [pid, fid] : page_table_) {
+void BufferPoolManager::FlushShard(Shard &shard) {
+    std::vector<IORequest> batch;
+    std::vector<Page *> flushed;
+    int64_t max_lsn = Page::INVALID_REC_LSN;
+    for (auto& [pid, fid] : shard.page_table) {
         Page* page = &pages_[fid];
         if (page->IsDirty() && page->GetPageId() != INVALID_PAGE_ID) {
-            disk_manager_->WritePage(page->GetPageId(), page->GetData());
-            page->is_dirty_ = false;
+            batch.push_back(IORequest{page->GetPageId(), page->GetData()});
+            flushed.push_back(page);
+            max_lsn = std::max(max_lsn, page->page_lsn_.load());
         }
     }
+    FlushLogFor(max_lsn);
+    disk_manager_->WritePages(batch);
+    Metrics::Add(Counter::BUFFER_DIRTY_WRITES, batch.size());
+    for (Page *page : flushed) {
+        page->is_dirty_ = false;
+        page->rec_lsn_ = Page::INVALID_REC_LSN;
+    }
+}
+
+void BufferPoolManager::FlushAllPages() {
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->latch);
+        FlushShard(*shard);
+    }
     disk_manager_->Sync();
 }
 
+size_t BufferPoolManager::WriteBackDirty(size_t max_pages) {
+    size_t written = 0;
+    std::vector<char> copies;
+
+    for (size_t n = 0; n < shards_.size() && written < max_pages; n++) {
+        size_t index = writer_next_shard_.fetch_add(1) % shards_.size();
+        Shard &shard = *shards_[index];
+
+        // Pick victims and pin them so they stay put while we copy
+        std::vector<Page *> picks;
+        {
+            std::lock_guard<std::mutex> lock(shard.latch);
+            for (auto &[pid, fid] : shard.page_table) {
+                if (written + picks.size() >= max_pages) break;
+                Page *page = &pages_[fid];
+                if (!page->is_dirty_ || page->pin_count_ > 0 || page->io_pending_) continue;
+                page->pin_count_++;
+                shard.replacer->Pin(fid - shard.first_frame);
+                // Cleared before the copy: a change made after it marks the page dirty again
+                page->is_dirty_ = false;
+                picks.push_back(page);
+            }
+        }
+        if (picks.empty()) continue;
+
+        copies.resize(picks.size() * page_size_);
+        std::vector<IORequest> batch;
+        int64_t max_lsn = Page::INVALID_REC_LSN;
+        for (size_t i = 0; i < picks.size(); i++) {
+            Page *page = picks[i];
+            char *copy = copies.data() + i * page_size_;
+            page->RLatch();
+            std::memcpy(copy, page->GetData(), page_size_);
+            // The copy carries every change up to here; until it is on disk
+            // its recLSN stays visible to GetDirtyPageTable
+            page->writeback_rec_lsn_ = page->rec_lsn_.load();
+            page->rec_lsn_ = Page::INVALID_REC_LSN;
+            max_lsn = std::max(max_lsn, page->page_lsn_.load());
+            page->RUnlatch();
+            batch.push_back(IORequest{page->GetPageId(), copy});
+        }
+
+        bool ok = true;
+        try {
+            FlushLogFor(max_lsn);
+            disk_manager_->WritePages(batch);
+        } catch (const std::exception &e) {
+            std::cerr << "BufferPoolManager: write-back failed: " << e.what() << std::endl;
+            ok = false;
+        }
+
+        std::lock_guard<std::mutex> lock(shard.latch);
+        for (Page *page : picks) {
+            if (!ok) {
+                page->is_dirty_ = true;
+                int64_t rec_lsn = page->writeback_rec_lsn_.load();
+                if (rec_lsn != Page::INVALID_REC_LSN) page->NoteLoggedChange(rec_lsn);
+            }
+            page->writeback_rec_lsn_ = Page::INVALID_REC_LSN;
+            page->pin_count_--;
+            if (page->pin_count_ == 0) {
+                frame_id_t frame_id = static_cast<frame_id_t>(page - pages_);
+                shard.replacer->Unpin(frame_id - shard.first_frame);
+            }
+        }
+        if (!ok) break;
+        written += picks.size();
+        Metrics::Add(Counter::BUFFER_DIRTY_WRITES, picks.size());
+    }
+    return written;
+}
+
+std::vector<std::pair<page_id_t, int64_t>> BufferPoolManager::GetDirtyPageTable() {
+    std::vector<std::pair<page_id_t, int64_t>> table;
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->latch);
+        for (auto &[pid, fid] : shard->page_table) {
+            // writeback_rec_lsn_ is published before rec_lsn_ is cleared, so
+            // reading in this order never misses both
+            int64_t rec_lsn = pages_[fid].rec_lsn_.load();
+            int64_t in_flight = pages_[fid].writeback_rec_lsn_.load();
+            if (rec_lsn == Page::INVALID_REC_LSN ||
+                (in_flight != Page::INVALID_REC_LSN && in_flight < rec_lsn)) {
+                rec_lsn = in_flight;
+            }
+            if (rec_lsn != Page::INVALID_REC_LSN) table.emplace_back(pid, rec_lsn);
+        }
+    }
+    return table;
+}
+
+void BufferPoolManager::Prefetch(const std::vector<page_id_t> &page_ids) {
+    std::vector<IORequest> batch;
+    for (page_id_t page_id : page_ids) {
+        if (page_id == INVALID_PAGE_ID) continue;
+        Shard &shard = ShardFor(page_id);
+        std::lock_guard<std::mutex> lock(shard.latch);
+
+        if (shard.page_table.count(page_id)) continue;
+
+        frame_id_t frame_id;
+        bool found = shard.scan_ring_capacity > 0 ? FindScanFrame(shard, &frame_id)
+                                                  : FindFreeFrame(shard, &frame_id);
+        if (!found) continue;
+
+        // The pin belongs to the read and is dropped by CompletePrefetch
+        Page *page = InstallPage(shard, frame_id, page_id);
+        page->scan_resident_ = true;
+        page->io_pending_ = true;
+        batch.push_back(IORequest{page_id, page->GetData()});
+    }
+
+    disk_manager_->ReadPagesAsync(std::move(batch), [this](const IORequest &request, bool ok) {
+        CompletePrefetch(request, ok);
+    });
+}
+
+void BufferPoolManager::CompletePrefetch(const IORequest &request, bool ok) {
+    Shard &shard = ShardFor(request.page_id);
+    {
+        std::lock_guard<std::mutex> lock(shard.latch);
+        // Still mapped: the read's pin kept the frame from being reused
+        frame_id_t frame_id = shard.page_table.at(request.page_id);
+        Page *page = &pages_[frame_id];
+        page->io_pending_ = false;
+        page->io_failed_ = !ok;
+        page->pin_count_--;
+
+        if (page->pin_count_ == 0) {
+            if (page->io_failed_) {
+                // Nobody is waiting; forget the page so the next fetch starts over
+                shard.page_table.erase(request.page_id);
+                shard.replacer->Remove(frame_id - shard.first_frame);
+                page->page_id_ = INVALID_PAGE_ID;
+                page->io_failed_ = false;
+                page->scan_resident_ = false;
+                shard.free_list.push_back(frame_id);
+            } else {
+                shard.replacer->Unpin(frame_id - shard.first_frame);
+            }
+        }
+    }
+    shard.io_done.notify_all();
+}
+
 bool BufferPoolManager::DeletePage(page_id_t page_id) {
-    std::lock_guard<std::mutex> lock(latch_);
+    Shard &shard = ShardFor(page_id);
+    std::lock_guard<std::mutex> lock(shard.latch);
 
-    if (page_table_.find(page_id) == page_table_.end()) {
+    auto it = shard.page_table.find(page_id);
+    if (it == shard.page_table.end()) {
         disk_manager_->DeallocatePage(page_id);
         return true;
     }
 
-    frame_id_t frame_id = page_table_[page_id];
+    frame_id_t frame_id = it->second;
     Page *page = &pages_[frame_id];
 
     if (page->pin_count_ > 0) {
@@ -200,22 +407,57 @@ bool BufferPoolManager::DeletePage(page_id_t page_id) {
     }
 
     disk_manager_->DeallocatePage(page_id);
-    page_table_.erase(page_id);
+    shard.page_table.erase(it);
+    shard.replacer->Remove(frame_id - shard.first_frame);  // No longer a victim candidate
 
     page->page_id_ = INVALID_PAGE_ID;
     page->is_dirty_ = false;
+    page->rec_lsn_ = Page::INVALID_REC_LSN;
+    page->page_lsn_ = Page::INVALID_REC_LSN;
     page->pin_count_ = 0;
+    page->scan_resident_ = false;
     page->ResetMemory();
 
-    free_list_.push_back(frame_id);
+    shard.free_list.push_back(frame_id);
+    return true;
+}
+
+bool BufferPoolManager::FindFreeFrame(Shard &shard, frame_id_t *out_frame_id) {
+    if (!shard.free_list.empty()) {
+        *out_frame_id = shard.free_list.front();
+        shard.free_list.pop_front();
+        return true;
+    }
+    frame_id_t local;
+    if (!shard.replacer->Victim(&local)) return false;
+    *out_frame_id = local + shard.first_frame;
     return true;
 }
 
-bool BufferPoolManager::FindFreeFrame(frame_id_t *out_frame_id) {
-    if (!free_list_.empty()) {
-        *out_frame_id = free_list_.front();
-        free_list_.pop_front();
+bool BufferPoolManager::FindScanFrame(Shard &shard, frame_id_t *out_frame_id) {
+    // Ring not full yet — grow it with an ordinary frame
+    if (shard.scan_ring.size() < shard.scan_ring_capacity) {
+        if (!FindFreeFrame(shard, out_frame_id)) return false;
+        shard.scan_ring.push_back(*out_frame_id);
         return true;
     }
-    return replacer_->Victim(out_frame_id);
-}
\ No newline at end of file
+
+    size_t slot = shard.scan_ring_next;
+    shard.scan_ring_next = (slot + 1) % shard.scan_ring.size();
+
+    // Reuse the slot's frame if it still holds an unpinned scan-only page.
+    // Otherwise (evicted, promoted by a normal access, or pinned) take a new
+    // frame for the slot.
+    frame_id_t candidate = shard.scan_ring[slot];
+    Page *page = &pages_[candidate];
+    if (page->scan_resident_ && page->pin_count_ == 0 &&
+        page->GetPageId() != INVALID_PAGE_ID) {
+        shard.replacer->Remove(candidate - shard.first_frame);
+        *out_frame_id = candidate;
+        return true;
+    }
+
+    if (!FindFreeFrame(shard, out_frame_id)) return false;
+    shard.scan_ring[slot] = *out_frame_id;
+    return true;
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <vector>
 #include <list>
 #include <mutex>
@@ -8,25 +10,26 @@
 #include "storage_engine/common/common.h"
 #include "storage_engine/disk_manager/disk_manager.h"
 #include "storage_engine/config/config.h"
+#include "storage_engine/buffer/replacer.h"
+#include <condition_variable>
 #include <cstring>
 #include <shared_mutex>
 
-using frame_id_t = int32_t;
 constexpr frame_id_t INVALID_FRAME_ID = -1;
-const int32_t PAGE_SIZE = 4096;
-
 /**
  * Page Class
- * Wrapper around the 4KB data array with metadata.
+ * Wrapper around one page_size frame of the pool's arena, with metadata.
  */
 class Page {
     friend class BufferPoolManager; 
 
 public:
-    Page() { ResetMemory(); }
+    Page() = default;
     ~Page() = default;
 
     inline char *GetData() { return data_; }
+
+    inline uint32_t GetPageSize() const { return page_size_; }
     
     inline page_id_t GetPageId() { return page_id_; }
     
@@ -34,58 +37,87 @@ public:
 
     inline bool IsDirty() { return is_dirty_; }
 
+    // A logged change with this LSN was applied to the page (caller holds
+    // the write latch). Keeps the first such LSN since the page was last
+    // written back: the recLSN reported in the dirty page table.
+    inline void NoteLoggedChange(int64_t lsn) {
+        int64_t none = INVALID_REC_LSN;
+        rec_lsn_.compare_exchange_strong(none, lsn);
+    }
+
+    // The logged change with this LSN is in the frame (caller holds the
+    // write latch). The pool flushes the log up to the newest such LSN
+    // before it writes the page out.
+    inline void SetPageLSN(int64_t lsn) {
+        if (lsn > page_lsn_.load()) page_lsn_ = lsn;
+    }
+
     inline void WLatch() { rwlatch_.lock(); }
     inline void WUnlatch() { rwlatch_.unlock(); }
     inline void RLatch() { rwlatch_.lock_shared(); }
     inline void RUnlatch() { rwlatch_.unlock_shared(); }
 
 private:
-    void ResetMemory() { memset(data_, 0, PAGE_SIZE); }
+    static constexpr int64_t INVALID_REC_LSN = -1;
+
+    void ResetMemory() { memset(data_, 0, page_size_); }
 
-    char data_[PAGE_SIZE]{}; 
+    char *data_ = nullptr;     // Points into BufferPoolManager::frame_arena_
+    uint32_t page_size_ = 0;
     page_id_t page_id_ = INVALID_PAGE_ID;
     
     int pin_count_ = 0;   
     bool is_dirty_ = false; 
+    bool scan_resident_ = false;  // Loaded by a scan and not touched by a normal access since
+    bool io_pending_ = false;     // A prefetch read into data_ has not completed yet
+    bool io_failed_ = false;      // That read failed; the next fetch rereads synchronously
+    std::atomic<int64_t> rec_lsn_{INVALID_REC_LSN};  // Oldest unwritten logged change
+    std::atomic<int64_t> writeback_rec_lsn_{INVALID_REC_LSN};  // rec_lsn_ of a copy still being written
+    std::atomic<int64_t> page_lsn_{INVALID_REC_LSN};  // Newest logged change since the page was loaded
     std::shared_mutex rwlatch_; 
 };
 
-/**
- * LRU Replacer
- * Keeps track of unpinned frames to decide which one to evict.
- */
-class LRUReplacer {
-public:
-    explicit LRUReplacer(size_t num_pages) {}
-    ~LRUReplacer() = default;
-
-    // Remove the object that was accessed the least recently (victim)
-    bool Victim(frame_id_t *frame_id);
-
-    // Pin: Called when a page is pinned (removed from LRU candidates)
-    void Pin(frame_id_t frame_id);
-
-    // Unpin: Called when a page is unpinned (added to LRU candidates)
-    void Unpin(frame_id_t frame_id);
-
-    size_t Size();
-
-private:
-    std::mutex mutex_;
-    std::list<frame_id_t> lru_list_; // Front = Least recently used
-    std::unordered_map<frame_id_t, std::list<frame_id_t>::iterator> lru_map_;
+// How a fetch intends to use the page
+enum class AccessType {
+    NORMAL,  // Point access; the page competes for the whole pool
+    SCAN     // Sequential scan; misses are recycled through the shard's scan ring
 };
 
 /**
  * Buffer Pool Manager
+ *
+ * The frames are split into num_shards independent shards; a page always
+ * lives in shard (page_id % num_shards). Each shard has its own latch, page
+ * table, free list and replacer, so threads touching different pages rarely
+ * contend on the same latch. With one shard this is the classic single-latch
+ * buffer pool.
+ *
+ * Each shard evicts with its own Replacer (policy chosen at construction).
+ * AccessType::SCAN misses go through a small per-shard ring of frames that
+ * the scan keeps recycling, so one pass over a large collection cannot
+ * flush hot index and FSM pages out of the pool.
+ *
+ * Prefetch() installs missing pages in scan frames, pinned and marked
+ * io_pending_, and hands the reads to the DiskManager's async path; the
+ * completion drops that pin. A FetchPage that hits a pending page waits on
+ * the shard's io_done condition instead of reading the page a second time.
+ *
+ * WriteBackDirty() is the background writer's entry point: it cleans a few
+ * unpinned dirty pages at a time so that eviction rarely finds a dirty
+ * victim. GetDirtyPageTable() feeds fuzzy checkpoints.
+ *
+ * WAL-before-data: every path that writes a page (eviction, FlushPage,
+ * FlushAllPages, WriteBackDirty) first hands the page's LSN to the log
+ * flusher, so no change reaches the data file before its log record.
  */
 class BufferPoolManager {
 public:
-    BufferPoolManager(size_t pool_size, DiskManager *disk_manager);
+    BufferPoolManager(size_t pool_size, DiskManager *disk_manager, size_t num_shards = 1,
+                      ReplacerPolicy policy = ReplacerPolicy::LRU, size_t scan_ring_frames = 0);
     ~BufferPoolManager();
 
     // 1. Fetch a page from disk or memory. Returns nullptr if no frames free.
-    Page *FetchPage(page_id_t page_id);
+    Page *FetchPage(page_id_t page_id, AccessType access = AccessType::NORMAL);
 
     // 2. Unpin a page. Set is_dirty to true if you modified it.
     bool UnpinPage(page_id_t page_id, bool is_dirty);
@@ -102,21 +134,94 @@ public:
     // 6. Flush ALL dirty pages to disk.
     void FlushAllPages();
 
+    // 7. Start reading the given pages in the background and return at once.
+    //    Resident pages are skipped; the rest are loaded like SCAN misses and
+    //    are not pinned for the caller. Best effort: pages without a frame
+    //    to spare are left for FetchPage.
+    void Prefetch(const std::vector<page_id_t> &page_ids);
+
+    // 8. Write back up to max_pages dirty, unpinned pages, continuing the
+    //    sweep where the previous call stopped. Each page is copied under
+    //    its read latch and the copies go out as one batch, so requests
+    //    are only held off for the memcpy. Returns the number of pages
+    //    written.
+    size_t WriteBackDirty(size_t max_pages);
+
+    // 9. Dirty pages carrying logged changes, with their recLSN
+    std::vector<std::pair<page_id_t, int64_t>> GetDirtyPageTable();
+
+    // 10. fsync the data file (makes earlier write-backs durable)
+    void SyncDisk() { disk_manager_->Sync(); }
+
+    // 11. Install the WAL-before-data hook: called with an LSN that must
+    //     be durable before a page carrying it is written
+    void SetLogFlusher(std::function<void(int64_t)> flusher) { log_flusher_ = std::move(flusher); }
+
+    // 12. Reserve num_pages contiguous page ids on disk (see DiskManager::
+    //     AllocateExtent); returns the first. No frames are taken.
+    page_id_t AllocateExtent(uint32_t num_pages) { return disk_manager_->AllocateExtent(num_pages); }
+
+    // 13. Bring a page of a reserved extent into memory as a zeroed, pinned
+    //     page without reading it. Returns nullptr if no frames free.
+    Page *NewPageAt(page_id_t page_id);
+
+    // 14. Keep pages [first, first + num_pages) compressed on disk (see
+    //     DiskManager::SetCompressed)
+    void SetCompressed(page_id_t first, uint32_t num_pages) { disk_manager_->SetCompressed(first, num_pages); }
+    uint64_t GetCompressedBytes() const { return disk_manager_->GetCompressedBytes(); }
+
+    // Pages a sequential scan should keep in flight (0 = no read-ahead)
+    uint32_t GetReadAheadPages() const { return disk_manager_->GetReadAheadPages(); }
+
+    size_t GetPoolSize() const { return pool_size_; }
+    uint32_t GetPageSize() const { return page_size_; }
+    size_t GetNumShards() const { return shards_.size(); }
+
 private:
-    // Helper to find a free frame or evict a victim
-    bool FindFreeFrame(frame_id_t *out_frame_id);
+    struct Shard {
+        std::mutex latch;                                   // Guards everything below
+        std::condition_variable io_done;                    // Signalled when a prefetch read lands
+        std::unordered_map<page_id_t, frame_id_t> page_table;  // PageID -> FrameID
+        std::list<frame_id_t> free_list;                    // Unused frames of this shard
+        frame_id_t first_frame = 0;                         // Replacer ids are relative to this
+        std::unique_ptr<Replacer> replacer;
+        std::vector<frame_id_t> scan_ring;                  // Frames handed to scans, reused in turn
+        size_t scan_ring_capacity = 0;
+        size_t scan_ring_next = 0;
+    };
+
+    Shard &ShardFor(page_id_t page_id) {
+        return *shards_[static_cast<size_t>(page_id) % shards_.size()];
+    }
+
+    // Helper to find a free frame or evict a victim (shard latch held)
+    bool FindFreeFrame(Shard &shard, frame_id_t *out_frame_id);
+
+    // Pick the frame for a scan miss: recycle the next ring frame if the scan
+    // still owns it, else take a new one into the ring (shard latch held)
+    bool FindScanFrame(Shard &shard, frame_id_t *out_frame_id);
+
+    // I/O thread callback for one prefetched page
+    void CompletePrefetch(const IORequest &request, bool ok);
+
+    // Write back every dirty page of a shard in one batch (shard latch held)
+    void FlushShard(Shard &shard);
+
+    // Make the log durable up to page_lsn before a page carrying it is written
+    void FlushLogFor(int64_t page_lsn) {
+        if (log_flusher_ && page_lsn != Page::INVALID_REC_LSN) log_flusher_(page_lsn);
+    }
+
+    // Point a free/victim frame at page_id, writing back its old contents (shard latch held)
+    Page *InstallPage(Shard &shard, frame_id_t frame_id, page_id_t page_id);
 
     size_t pool_size_;
-    Page* pages_; // The actual memory pool (array of Pages)
-    
-    DiskManager *disk_manager_;
-    std::unique_ptr<LRUReplacer> replacer_;
+    uint32_t page_size_;  // Taken from the DiskManager
+    Page* pages_; // Frame descriptors, shared by all shards
+    char* frame_arena_;   // pool_size_ x page_size_ bytes, page-aligned
 
-    // Map PageID -> FrameID
-    std::unordered_map<page_id_t, frame_id_t> page_table_;
-    
-    // List of free frames (indices in pages_ vector)
-    std::list<frame_id_t> free_list_;
-    
-    std::mutex latch_; // Global latch for BPM structure safety
-};
\ No newline at end of file
+    DiskManager *disk_manager_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> writer_next_shard_{0};  // Where WriteBackDirty resumes
+    std::function<void(int64_t)> log_flusher_;  // See SetLogFlusher
+};
@@ -0,0 +1,166 @@
+#include "replacer.h"
+#include <limits>
+
+// ==============================================================================
+// Factory
+// ==============================================================================
+
+std::unique_ptr<Replacer> Replacer::Create(ReplacerPolicy policy, size_t num_frames) {
+    switch (policy) {
+        case ReplacerPolicy::LRU:   return std::make_unique<LRUReplacer>(num_frames);
+        case ReplacerPolicy::LRU_K: return std::make_unique<LRUKReplacer>(num_frames, 2);
+        case ReplacerPolicy::CLOCK: return std::make_unique<ClockReplacer>(num_frames);
+    }
+    return std::make_unique<LRUReplacer>(num_frames);
+}
+
+// ==============================================================================
+// LRUReplacer Implementation
+// ==============================================================================
+
+void LRUReplacer::Pin(frame_id_t frame_id) {
+    auto it = lru_map_.find(frame_id);
+    if (it != lru_map_.end()) {
+        lru_list_.erase(it->second);
+        lru_map_.erase(it);
+    }
+}
+
+void LRUReplacer::Unpin(frame_id_t frame_id) {
+    if (lru_map_.find(frame_id) == lru_map_.end()) {
+        lru_list_.push_front(frame_id);
+        lru_map_[frame_id] = lru_list_.begin();
+    }
+}
+
+bool LRUReplacer::Victim(frame_id_t *frame_id) {
+    if (lru_list_.empty()) {
+        return false;
+    }
+    *frame_id = lru_list_.back();
+    lru_map_.erase(*frame_id);
+    lru_list_.pop_back();
+    return true;
+}
+
+size_t LRUReplacer::Size() {
+    return lru_list_.size();
+}
+
+// ==============================================================================
+// LRUKReplacer Implementation
+// ==============================================================================
+
+LRUKReplacer::LRUKReplacer(size_t num_frames, size_t k)
+    : k_(k == 0 ? 1 : k), history_(num_frames * k_, 0), accesses_(num_frames, 0),
+      next_slot_(num_frames, 0), evictable_(num_frames, 0) {}
+
+void LRUKReplacer::Pin(frame_id_t frame_id) {
+    // Record the access
+    size_t base = static_cast<size_t>(frame_id) * k_;
+    history_[base + next_slot_[frame_id]] = ++clock_;
+    next_slot_[frame_id] = (next_slot_[frame_id] + 1) % k_;
+    if (accesses_[frame_id] < k_) accesses_[frame_id]++;
+
+    if (evictable_[frame_id]) {
+        evictable_[frame_id] = 0;
+        evictable_count_--;
+    }
+}
+
+void LRUKReplacer::Unpin(frame_id_t frame_id) {
+    if (!evictable_[frame_id]) {
+        evictable_[frame_id] = 1;
+        evictable_count_++;
+    }
+}
+
+void LRUKReplacer::Remove(frame_id_t frame_id) {
+    if (evictable_[frame_id]) {
+        evictable_[frame_id] = 0;
+        evictable_count_--;
+    }
+    accesses_[frame_id] = 0;
+    next_slot_[frame_id] = 0;
+}
+
+bool LRUKReplacer::Victim(frame_id_t *frame_id) {
+    if (evictable_count_ == 0) return false;
+
+    // Prefer frames with < k accesses (infinite backward k-distance), oldest
+    // first access first; otherwise the oldest k-th most recent access.
+    frame_id_t best = -1;
+    bool best_infinite = false;
+    uint64_t best_ts = std::numeric_limits<uint64_t>::max();
+
+    for (size_t f = 0; f < evictable_.size(); ++f) {
+        if (!evictable_[f]) continue;
+
+        bool infinite = accesses_[f] < k_;
+        // The oldest stored access: slot 0 until the ring wraps, then next_slot_
+        uint64_t ts = history_[f * k_ + (infinite ? 0 : next_slot_[f])];
+
+        if (infinite != best_infinite) {
+            if (!infinite) continue;   // Finite never beats infinite
+        } else if (ts >= best_ts) {
+            continue;
+        }
+        best = static_cast<frame_id_t>(f);
+        best_infinite = infinite;
+        best_ts = ts;
+    }
+
+    Remove(best);
+    *frame_id = best;
+    return true;
+}
+
+// ==============================================================================
+// ClockReplacer Implementation
+// ==============================================================================
+
+ClockReplacer::ClockReplacer(size_t num_frames)
+    : evictable_(num_frames, 0), referenced_(num_frames, 0) {}
+
+void ClockReplacer::Pin(frame_id_t frame_id) {
+    referenced_[frame_id] = 1;
+    if (evictable_[frame_id]) {
+        evictable_[frame_id] = 0;
+        evictable_count_--;
+    }
+}
+
+void ClockReplacer::Unpin(frame_id_t frame_id) {
+    if (!evictable_[frame_id]) {
+        evictable_[frame_id] = 1;
+        evictable_count_++;
+    }
+}
+
+void ClockReplacer::Remove(frame_id_t frame_id) {
+    if (evictable_[frame_id]) {
+        evictable_[frame_id] = 0;
+        evictable_count_--;
+    }
+    referenced_[frame_id] = 0;
+}
+
+bool ClockReplacer::Victim(frame_id_t *frame_id) {
+    if (evictable_count_ == 0) return false;
+
+    // Two sweeps are enough: the first clears every reference bit
+    size_t n = evictable_.size();
+    for (size_t step = 0; step < 2 * n; ++step) {
+        size_t f = hand_;
+        hand_ = (hand_ + 1) % n;
+        if (!evictable_[f]) continue;
+        if (referenced_[f]) {
+            referenced_[f] = 0;  // Second chance
+            continue;
+        }
+        Remove(static_cast<frame_id_t>(f));
+        *frame_id = static_cast<frame_id_t>(f);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "storage_engine/common/common.h"
+#include "storage_engine/config/config.h"
+
+/**
+ * Replacer
+ * Tracks which frames may be evicted and picks the victim.
+ *
+ * Frame ids are local to the replacer: 0 .. num_frames-1. Replacers keep no
+ * latch of their own; the buffer pool only calls them while holding the
+ * latch of the shard that owns them.
+ */
+class Replacer {
+public:
+    virtual ~Replacer() = default;
+
+    // Pick and remove an evictable frame. False if every frame is pinned.
+    virtual bool Victim(frame_id_t *frame_id) = 0;
+
+    // Pin: the frame was accessed and is in use (not evictable)
+    virtual void Pin(frame_id_t frame_id) = 0;
+
+    // Unpin: the frame's pin count dropped to zero (evictable)
+    virtual void Unpin(frame_id_t frame_id) = 0;
+
+    // Forget the frame entirely (its page was deleted)
+    virtual void Remove(frame_id_t frame_id) = 0;
+
+    // Number of evictable frames
+    virtual size_t Size() = 0;
+
+    // Build the replacer selected by policy
+    static std::unique_ptr<Replacer> Create(ReplacerPolicy policy, size_t num_frames);
+};
+
+/**
+ * LRU Replacer
+ * Keeps track of unpinned frames to decide which one to evict.
+ */
+class LRUReplacer : public Replacer {
+public:
+    explicit LRUReplacer(size_t num_pages) {}
+    ~LRUReplacer() override = default;
+
+    // Remove the object that was accessed the least recently (victim)
+    bool Victim(frame_id_t *frame_id) override;
+
+    // Pin: Called when a page is pinned (removed from LRU candidates)
+    void Pin(frame_id_t frame_id) override;
+
+    // Unpin: Called when a page is unpinned (added to LRU candidates)
+    void Unpin(frame_id_t frame_id) override;
+
+    void Remove(frame_id_t frame_id) override { Pin(frame_id); }
+
+    size_t Size() override;
+
+private:
+    std::list<frame_id_t> lru_list_; // Front = Least recently used
+    std::unordered_map<frame_id_t, std::list<frame_id_t>::iterator> lru_map_;
+};
+
+/**
+ * LRU-K Replacer
+ * Evicts the frame whose K-th most recent access is the oldest. Frames with
+ * fewer than K accesses count as infinitely old (ties: oldest first access),
+ * so pages touched once by a scan go before pages that are used repeatedly.
+ *
+ * The access history is a flat num_frames x K array of logical timestamps.
+ */
+class LRUKReplacer : public Replacer {
+public:
+    LRUKReplacer(size_t num_frames, size_t k);
+
+    bool Victim(frame_id_t *frame_id) override;
+    void Pin(frame_id_t frame_id) override;
+    void Unpin(frame_id_t frame_id) override;
+    void Remove(frame_id_t frame_id) override;
+    size_t Size() override { return evictable_count_; }
+
+private:
+    size_t k_;
+    uint64_t clock_ = 0;                // Logical time, bumped per access
+    std::vector<uint64_t> history_;     // [frame * k_ + i], ring of the last k accesses
+    std::vector<uint32_t> accesses_;    // Accesses recorded per frame (saturates at k_)
+    std::vector<uint32_t> next_slot_;   // Next ring position per frame
+    std::vector<uint8_t> evictable_;
+    size_t evictable_count_ = 0;
+};
+
+/**
+ * CLOCK Replacer
+ * Flat arrays of evictable/reference bits and a sweeping hand: an access
+ * only sets a bit, and Victim gives each referenced frame a second chance.
+ */
+class ClockReplacer : public Replacer {
+public:
+    explicit ClockReplacer(size_t num_frames);
+
+    bool Victim(frame_id_t *frame_id) override;
+    void Pin(frame_id_t frame_id) override;
+    void Unpin(frame_id_t frame_id) override;
+    void Remove(frame_id_t frame_id) override;
+    size_t Size() override { return evictable_count_; }
+
+private:
+    std::vector<uint8_t> evictable_;
+    std::vector<uint8_t> referenced_;
+    size_t hand_ = 0;
+    size_t evictable_count_ = 0;
+};
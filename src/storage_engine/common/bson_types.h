@@ -3,7 +3,9 @@
 #include <string>
 #include <vector>
 #include <variant>
-#include <map>
+#include <algorithm>
+#include <string_view>
+#include <utility>
 #include <memory>
 
 enum class BsonType : uint8_t{
@@ -15,9 +17,15 @@ enum class BsonType : uint8_t{
     BOOLEAN = 0x08,
     NULL_TYPE = 0x0A,
     INT32 = 0x10,
-    INT64 = 0x12
+    INT64 = 0x12,
+    // Internal to stored records, never sent to clients: a value kept
+    // outside the record's page, BSON_EXTERNAL_SIZE bytes of
+    // [uint8 value type][page_id][uint16 slot][uint32 value size]
+    EXTERNAL = 0xEE
 };
 
+constexpr size_t BSON_EXTERNAL_SIZE = 11;
+
 struct BsonDocument;
 
 using BsonValue = std::variant<
@@ -30,10 +38,67 @@ using BsonValue = std::variant<
     std::nullptr_t
 >;
 
+// ============================================================================
+// BsonElements — a document's fields, flat and in the order they were added
+//
+// One vector of (key, value) pairs, searched linearly: documents have few
+// fields, so a scan over contiguous pairs beats chasing tree nodes, and
+// keys of up to 15 bytes live inline in the pair (SSO). Provides the part
+// of the std::map interface the engine uses; iteration (and therefore
+// serialization and JSON output) follows field order, not key order.
+// ============================================================================
+class BsonElements {
+public:
+    using value_type = std::pair<std::string, BsonValue>;
+    using iterator = std::vector<value_type>::iterator;
+    using const_iterator = std::vector<value_type>::const_iterator;
+
+    iterator begin() { return fields_.begin(); }
+    iterator end() { return fields_.end(); }
+    const_iterator begin() const { return fields_.begin(); }
+    const_iterator end() const { return fields_.end(); }
+
+    size_t size() const { return fields_.size(); }
+    bool empty() const { return fields_.empty(); }
+    void reserve(size_t n) { fields_.reserve(n); }
+    void clear() { fields_.clear(); }
+
+    iterator find(std::string_view key) {
+        return std::find_if(begin(), end(), [key](const value_type& f) { return f.first == key; });
+    }
+    const_iterator find(std::string_view key) const {
+        return std::find_if(begin(), end(), [key](const value_type& f) { return f.first == key; });
+    }
+    size_t count(std::string_view key) const { return find(key) == end() ? 0 : 1; }
+
+    // The field's value, appending a null field if there is none
+    BsonValue& operator[](std::string_view key) {
+        auto it = find(key);
+        if (it != end()) return it->second;
+        fields_.emplace_back(std::string(key), nullptr);
+        return fields_.back().second;
+    }
+
+    size_t erase(std::string_view key) {
+        auto it = find(key);
+        if (it == end()) return 0;
+        fields_.erase(it);
+        return 1;
+    }
+
+    // Append without looking for the key first; the caller knows it is new
+    // (BsonSerializer::Deserialize, whose input has unique keys)
+    void Append(std::string key, BsonValue value) { fields_.emplace_back(std::move(key), std::move(value)); }
+
+private:
+    std::vector<value_type> fields_;
+};
+
 struct BsonDocument{
-    std::map<std::string,BsonValue> elements;
+    BsonElements elements;
+    bool is_array = false;  // Keyed "0", "1", ... and stored as BsonType::ARRAY
 
     void Add(const std::string& key, BsonValue value) {
-        elements[key] = value;
+        elements[key] = std::move(value);
     }
 };
\ No newline at end of file
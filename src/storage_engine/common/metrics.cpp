@@ -0,0 +1,107 @@
+#include "metrics.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+// ============================================================================
+// Registry — the live blocks, and the totals of threads that are gone
+//
+// Never destroyed: threads may still exit (and fold in their counts)
+// while static objects are being torn down.
+// ============================================================================
+
+struct MetricsRegistry {
+    std::mutex latch;
+    std::vector<const Metrics::Block*> blocks;
+    MetricsSnapshot retired;
+};
+
+static MetricsRegistry& Registry() {
+    static MetricsRegistry* registry = new MetricsRegistry();
+    return *registry;
+}
+
+// ============================================================================
+// HistogramSnapshot
+// ============================================================================
+
+uint64_t HistogramSnapshot::Percentile(double p) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(count) + 0.5);
+    rank = std::clamp<uint64_t>(rank, 1, count);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < NUM_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank) return b + 1 < NUM_BUCKETS ? std::min(BucketLimit(b) - 1, max_us) : max_us;
+    }
+    return max_us;
+}
+
+// ============================================================================
+// Metrics
+// ============================================================================
+
+void Metrics::LocalHistogram::AddTo(HistogramSnapshot* out) const {
+    out->count += count.load(std::memory_order_relaxed);
+    out->sum_us += sum_us.load(std::memory_order_relaxed);
+    out->max_us = std::max(out->max_us, max_us.load(std::memory_order_relaxed));
+    for (size_t b = 0; b < HistogramSnapshot::NUM_BUCKETS; b++) {
+        out->buckets[b] += buckets[b].load(std::memory_order_relaxed);
+    }
+}
+
+void Metrics::Block::AddTo(MetricsSnapshot* out) const {
+    for (size_t i = 0; i < counters.size(); i++) out->counters[i] += counters[i].load(std::memory_order_relaxed);
+    for (size_t i = 0; i < histograms.size(); i++) histograms[i].AddTo(&out->histograms[i]);
+    for (size_t i = 0; i < commands.size(); i++) commands[i].AddTo(&out->commands[i]);
+}
+
+Metrics::Block::Block() {
+    MetricsRegistry& registry = Registry();
+    std::lock_guard<std::mutex> guard(registry.latch);
+    registry.blocks.push_back(this);
+}
+
+Metrics::Block::~Block() {
+    MetricsRegistry& registry = Registry();
+    std::lock_guard<std::mutex> guard(registry.latch);
+    AddTo(&registry.retired);
+    registry.blocks.erase(std::find(registry.blocks.begin(), registry.blocks.end(), this));
+}
+
+MetricsSnapshot Metrics::Snapshot() {
+    MetricsRegistry& registry = Registry();
+    std::lock_guard<std::mutex> guard(registry.latch);
+    MetricsSnapshot out = registry.retired;
+    for (const Block* block : registry.blocks) block->AddTo(&out);
+    return out;
+}
+
+const char* Metrics::Name(Counter c) {
+    switch (c) {
+        case Counter::BUFFER_HITS: return "buffer_hits";
+        case Counter::BUFFER_MISSES: return "buffer_misses";
+        case Counter::BUFFER_EVICTIONS: return "buffer_evictions";
+        case Counter::BUFFER_DIRTY_WRITES: return "buffer_dirty_writes";
+        case Counter::DISK_READS: return "disk_reads";
+        case Counter::DISK_READ_BYTES: return "disk_read_bytes";
+        case Counter::DISK_WRITES: return "disk_writes";
+        case Counter::DISK_WRITE_BYTES: return "disk_write_bytes";
+        case Counter::WAL_APPENDS: return "wal_appends";
+        case Counter::WAL_APPEND_BYTES: return "wal_append_bytes";
+        case Counter::BTREE_SPLITS: return "btree_splits";
+        default: return "unknown";
+    }
+}
+
+const char* Metrics::Name(Histogram h) {
+    switch (h) {
+        case Histogram::DISK_READ: return "disk_read";
+        case Histogram::DISK_WRITE: return "disk_write";
+        case Histogram::DISK_SYNC: return "disk_sync";
+        case Histogram::WAL_APPEND: return "wal_append";
+        case Histogram::WAL_FSYNC: return "wal_fsync";
+        case Histogram::LOCK_WAIT: return "lock_wait";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Counted events, each a running total
+enum class Counter : uint8_t {
+    BUFFER_HITS,          // FetchPage found the page in the pool
+    BUFFER_MISSES,        // ... had to read it
+    BUFFER_EVICTIONS,     // A frame given up by one page for another
+    BUFFER_DIRTY_WRITES,  // Dirty pages written back (eviction, flush, background writer)
+    DISK_READS,           // Pages read from the data file
+    DISK_READ_BYTES,
+    DISK_WRITES,          // Pages written to it
+    DISK_WRITE_BYTES,
+    WAL_APPENDS,          // Log records appended
+    WAL_APPEND_BYTES,
+    BTREE_SPLITS,         // B+ tree nodes split (the root counts once)
+    NUM_COUNTERS
+};
+
+// Timed operations, in microseconds
+enum class Histogram : uint8_t {
+    DISK_READ,    // One ReadPage, or one batch through io_uring
+    DISK_WRITE,   // Likewise for writes
+    DISK_SYNC,    // fsync of the data file
+    WAL_APPEND,   // AppendLogRecord(s) up to the forced flush, latch wait included
+    WAL_FSYNC,    // write + fdatasync of a group of log records
+    LOCK_WAIT,    // A lock request that had to wait, until granted or refused
+    NUM_HISTOGRAMS
+};
+
+// A histogram as read: bucket 0 holds 0 µs, bucket b the values in
+// [2^(b-1), 2^b) µs, the last everything above
+struct HistogramSnapshot {
+    static constexpr size_t NUM_BUCKETS = 32;
+
+    uint64_t count = 0;
+    uint64_t sum_us = 0;
+    uint64_t max_us = 0;
+    std::array<uint64_t, NUM_BUCKETS> buckets{};
+
+    // Upper bound of the bucket holding the p-th fraction (0 < p <= 1) of
+    // the samples, capped at the largest seen; 0 when empty
+    uint64_t Percentile(double p) const;
+
+    // Exclusive upper bound in µs of bucket b (the last is unbounded)
+    static uint64_t BucketLimit(size_t b) { return uint64_t(1) << b; }
+};
+
+struct MetricsSnapshot {
+    static constexpr size_t MAX_COMMANDS = 32;
+
+    std::array<uint64_t, static_cast<size_t>(Counter::NUM_COUNTERS)> counters{};
+    std::array<HistogramSnapshot, static_cast<size_t>(Histogram::NUM_HISTOGRAMS)> histograms;
+    std::array<HistogramSnapshot, MAX_COMMANDS> commands;  // By the server's command slot
+
+    uint64_t Get(Counter c) const { return counters[static_cast<size_t>(c)]; }
+    const HistogramSnapshot& Get(Histogram h) const { return histograms[static_cast<size_t>(h)]; }
+};
+
+// ============================================================================
+// Metrics — process-wide counters and latency histograms for the hot paths
+//
+// Every thread counts into a block of its own (thread_local, registered
+// on first use), so recording is a relaxed load and store of an atomic
+// only that thread writes: no lock, no read-modify-write, no cache line
+// shared with other writers. Snapshot sums the live blocks and what
+// threads that have exited left behind; it may trail the writers by the
+// events in flight, but never reads a torn value.
+//
+// Histograms bucket by powers of two, so percentiles are estimates within
+// a factor of two: enough to tell which subsystem a slow p99 came from.
+// Command latencies are kept by slot (0 .. MAX_COMMANDS-1); the server
+// names them.
+// ============================================================================
+class Metrics {
+public:
+    static void Add(Counter c, uint64_t n = 1) { Bump(Local().counters[static_cast<size_t>(c)], n); }
+    static void Record(Histogram h, uint64_t us) { Local().histograms[static_cast<size_t>(h)].Record(us); }
+    static void RecordCommand(size_t slot, uint64_t us) { Local().commands[slot].Record(us); }
+
+    static MetricsSnapshot Snapshot();
+
+    // snake_case names, as reported by the stats command
+    static const char* Name(Counter c);
+    static const char* Name(Histogram h);
+
+    static uint64_t ElapsedUs(std::chrono::steady_clock::time_point start) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start)
+                .count());
+    }
+
+    // Records the time from construction to destruction
+    class Timer {
+    public:
+        explicit Timer(Histogram h) : histogram_(h), start_(std::chrono::steady_clock::now()) {}
+        ~Timer() { Record(histogram_, ElapsedUs(start_)); }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        Histogram histogram_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+private:
+    friend struct MetricsRegistry;
+    using Cell = std::atomic<uint64_t>;
+
+    // Only the owning thread writes
+    static void Bump(Cell& cell, uint64_t n) {
+        cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct LocalHistogram {
+        Cell count{0};
+        Cell sum_us{0};
+        Cell max_us{0};
+        std::array<Cell, HistogramSnapshot::NUM_BUCKETS> buckets{};
+
+        void Record(uint64_t us) {
+            size_t b = us == 0 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(us));
+            if (b >= HistogramSnapshot::NUM_BUCKETS) b = HistogramSnapshot::NUM_BUCKETS - 1;
+            Bump(buckets[b], 1);
+            Bump(count, 1);
+            Bump(sum_us, us);
+            if (us > max_us.load(std::memory_order_relaxed)) max_us.store(us, std::memory_order_relaxed);
+        }
+
+        void AddTo(HistogramSnapshot* out) const;
+    };
+
+    // One thread's counts; joins the registry when built, folds itself
+    // into the exited threads' totals when its thread ends
+    struct Block {
+        Block();
+        ~Block();
+
+        std::array<Cell, static_cast<size_t>(Counter::NUM_COUNTERS)> counters{};
+        std::array<LocalHistogram, static_cast<size_t>(Histogram::NUM_HISTOGRAMS)> histograms;
+        std::array<LocalHistogram, MetricsSnapshot::MAX_COMMANDS> commands;
+
+        void AddTo(MetricsSnapshot* out) const;
+    };
+
+    static Block& Local() {
+        thread_local Block block;
+        return block;
+    }
+};
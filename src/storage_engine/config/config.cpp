@@ -0,0 +1,190 @@
+#include "config.h"
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+// ============================================================================
+// Parsing helpers
+// ============================================================================
+
+static std::string Trim(const std::string& s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+static uint64_t ParseUnsigned(const std::string& key, const std::string& value) {
+    size_t used = 0;
+    unsigned long long v = 0;
+    try {
+        v = std::stoull(value, &used);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Config: '" + key + "' expects a number, got '" + value + "'");
+    }
+    if (used != value.size()) {
+        throw std::runtime_error("Config: '" + key + "' expects a number, got '" + value + "'");
+    }
+    return v;
+}
+
+// "4GB", "512MB", "64KB" or a plain byte count
+static uint64_t ParseBytes(const std::string& key, const std::string& value) {
+    static const struct { const char* suffix; uint64_t mult; } units[] = {
+        {"GB", 1ull << 30}, {"MB", 1ull << 20}, {"KB", 1ull << 10},
+    };
+    for (const auto& unit : units) {
+        size_t n = std::char_traits<char>::length(unit.suffix);
+        if (value.size() > n && value.compare(value.size() - n, n, unit.suffix) == 0) {
+            return ParseUnsigned(key, Trim(value.substr(0, value.size() - n))) * unit.mult;
+        }
+    }
+    return ParseUnsigned(key, value);
+}
+
+// ============================================================================
+// ApplyOption
+// ============================================================================
+
+void ConfigManager::ApplyOption(DBConfigs& config, const std::string& key, const std::string& value) {
+    if (key == "db_file") {
+        // Keep the WAL next to the data file unless it was set explicitly
+        if (config.wal_file_name == config.db_file_name + ".wal") config.wal_file_name = value + ".wal";
+        config.db_file_name = value;
+    } else if (key == "wal_file") {
+        config.wal_file_name = value;
+    } else if (key == "wal_segment_size") {
+        config.wal_segment_size = ParseBytes(key, value);
+    } else if (key == "page_size") {
+        uint64_t v = ParseBytes(key, value);
+        if (v < MIN_PAGE_SIZE || v > MAX_PAGE_SIZE || (v & (v - 1)) != 0) {
+            throw std::runtime_error("Config: page_size must be 4096, 8192, 16384 or 32768");
+        }
+        config.page_size = static_cast<u_int16_t>(v);
+    } else if (key == "buffer_pool_size") {
+        // Plain numbers are frames; sizes with a unit are divided by the page size
+        bool has_unit = value.find_first_not_of("0123456789") != std::string::npos;
+        uint64_t v = ParseBytes(key, value);
+        if (has_unit) v /= config.page_size;
+        if (v == 0 || v > UINT32_MAX) {
+            throw std::runtime_error("Config: buffer_pool_size '" + value + "' is out of range");
+        }
+        config.buffer_pool_size = static_cast<uint32_t>(v);
+    } else if (key == "buffer_pool_shards") {
+        config.buffer_pool_shards = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "replacer") {
+        if (value == "lru") config.replacer_policy = ReplacerPolicy::LRU;
+        else if (value == "lru_k") config.replacer_policy = ReplacerPolicy::LRU_K;
+        else if (value == "clock") config.replacer_policy = ReplacerPolicy::CLOCK;
+        else throw std::runtime_error("Config: unknown replacer '" + value + "'");
+    } else if (key == "scan_ring_frames") {
+        config.scan_ring_frames = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "io_backend") {
+        if (value == "auto") config.io_backend = IOBackend::AUTO;
+        else if (value == "io_uring") config.io_backend = IOBackend::IO_URING;
+        else if (value == "pread") config.io_backend = IOBackend::PREAD;
+        else throw std::runtime_error("Config: unknown io_backend '" + value + "'");
+    } else if (key == "read_ahead_pages") {
+        config.read_ahead_pages = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "flush_policy") {
+        if (value == "group_commit") config.flush_policy = FlushPolicy::GROUP_COMMIT;
+        else if (value == "flush_all") config.flush_policy = FlushPolicy::FLUSH_ALL;
+        else throw std::runtime_error("Config: unknown flush_policy '" + value + "'");
+    } else if (key == "checkpoint_interval_ms") {
+        config.checkpoint_interval_ms = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "bgwriter_interval_ms") {
+        config.bgwriter_interval_ms = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "bgwriter_max_pages") {
+        config.bgwriter_max_pages = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "deadlock_check_ms") {
+        config.deadlock_check_ms = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "lock_escalation") {
+        config.lock_escalation = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "vacuum_interval_ms") {
+        config.vacuum_interval_ms = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "num_workers") {
+        config.num_workers = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "recovery_threads") {
+        config.recovery_threads = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "scan_threads") {
+        config.scan_threads = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "cursor_timeout_ms") {
+        config.cursor_timeout_ms = static_cast<uint32_t>(ParseUnsigned(key, value));
+    } else if (key == "port") {
+        config.port = static_cast<uint16_t>(ParseUnsigned(key, value));
+    } else if (key == "metrics_port") {
+        config.metrics_port = static_cast<uint16_t>(ParseUnsigned(key, value));
+    } else {
+        throw std::runtime_error("Config: unknown key '" + key + "'");
+    }
+}
+
+// ============================================================================
+// LoadConfig
+// ============================================================================
+
+DBConfigs ConfigManager::LoadConfig(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Config: cannot open '" + path + "'");
+    }
+
+    DBConfigs config;
+    std::string pool_size;  // Applied last: a byte size depends on page_size
+    std::string line;
+    int line_no = 0;
+
+    while (std::getline(in, line)) {
+        line_no++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        line = Trim(line);
+        if (line.empty()) continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            throw std::runtime_error("Config: " + path + ":" + std::to_string(line_no) +
+                                     ": expected 'key = value'");
+        }
+        std::string key = Trim(line.substr(0, eq));
+        std::string value = Trim(line.substr(eq + 1));
+
+        if (key == "buffer_pool_size") {
+            pool_size = value;
+            continue;
+        }
+        try {
+            ApplyOption(config, key, value);
+        } catch (const std::runtime_error& e) {
+            throw std::runtime_error(path + ":" + std::to_string(line_no) + ": " + e.what());
+        }
+    }
+
+    if (!pool_size.empty()) ApplyOption(config, "buffer_pool_size", pool_size);
+    Validate(config);
+    return config;
+}
+
+// ============================================================================
+// Validate
+// ============================================================================
+
+void ConfigManager::Validate(const DBConfigs& config) {
+    if (config.page_size < MIN_PAGE_SIZE || config.page_size > MAX_PAGE_SIZE ||
+        (config.page_size & (config.page_size - 1)) != 0) {
+        throw std::runtime_error("Config: page_size must be 4096, 8192, 16384 or 32768");
+    }
+    if (config.buffer_pool_size == 0) {
+        throw std::runtime_error("Config: buffer_pool_size must be at least 1 frame");
+    }
+    if (config.checkpoint_interval_ms == 0 || config.bgwriter_interval_ms == 0) {
+        throw std::runtime_error("Config: checkpoint and bgwriter intervals must be at least 1 ms");
+    }
+    if (config.wal_segment_size < 4096) {
+        throw std::runtime_error("Config: wal_segment_size must be at least 4KB");
+    }
+    if (config.db_file_name.empty() || config.wal_file_name.empty()) {
+        throw std::runtime_error("Config: db_file and wal_file must not be empty");
+    }
+}
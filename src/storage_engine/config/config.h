@@ -4,17 +4,94 @@
 #include <iostream>
 #include <cstdint>
 
+// How write requests are made durable before they are acknowledged.
+enum class FlushPolicy : uint8_t {
+    FLUSH_ALL,      // Write back every dirty page after each write request
+    GROUP_COMMIT    // Log to the WAL, ack once the log is durable, checkpointer writes pages
+};
+
+// Buffer pool eviction policy (see storage_engine/buffer/replacer.h)
+enum class ReplacerPolicy : uint8_t {
+    LRU,     // Least recently used
+    LRU_K,   // Oldest K-th most recent access (K = 2); scan resistant
+    CLOCK    // Second-chance reference bits over a flat frame array
+};
+
+// How the DiskManager talks to the data file (see storage_engine/disk_manager)
+enum class IOBackend : uint8_t {
+    AUTO,      // io_uring when the kernel allows it, else pread/pwrite
+    IO_URING,  // io_uring only; fail to open if it is unavailable
+    PREAD      // Blocking pread/pwrite, one page per call
+};
+
+// Page sizes are limited by the 16-bit offsets in the slotted page layout
+constexpr uint32_t MIN_PAGE_SIZE = 4096;
+constexpr uint32_t MAX_PAGE_SIZE = 32768;
+
 struct DBConfigs {
-    u_int16_t page_size = 4096; 
-    std::string db_file_name = "data.db";
+    u_int16_t page_size = 4096;              // 4/8/16/32 KB; fixed for the life of a database file
+    std::string db_file_name = "docdb_data.db";
+    std::string wal_file_name = "docdb_data.db.wal";
+    uint64_t wal_segment_size = 16ull << 20; // WAL segment file size before rotating
+    uint32_t buffer_pool_size = 1024;        // Frames in the buffer pool (x page_size bytes)
+    FlushPolicy flush_policy = FlushPolicy::GROUP_COMMIT;
+    uint32_t checkpoint_interval_ms = 1000;  // How often a fuzzy checkpoint is logged
+    uint32_t bgwriter_interval_ms = 100;     // Background writer period
+    uint32_t bgwriter_max_pages = 64;        // Dirty pages the writer cleans per round
+    uint32_t deadlock_check_ms = 50;         // Deadlock detector period (0 = off)
+    uint32_t lock_escalation = 1000;         // Record locks per collection before locking it whole
+    uint32_t vacuum_interval_ms = 100;       // How often superseded row versions are pruned
+    uint32_t num_workers = 0;                // Server executor threads (0 = run on the epoll thread)
+    uint32_t recovery_threads = 0;           // Redo workers at startup (0 = one per core)
+    uint32_t scan_threads = 0;               // Workers of a large full-collection scan (0 = one per core, 1 = serial)
+    uint32_t cursor_timeout_ms = 60000;      // Idle server-side cursors are closed after this
+    uint32_t buffer_pool_shards = 8;         // Independent buffer pool partitions (by page_id)
+    ReplacerPolicy replacer_policy = ReplacerPolicy::LRU_K;
+    uint32_t scan_ring_frames = 32;          // Frames sequential scans may occupy (split across shards)
+    IOBackend io_backend = IOBackend::AUTO;
+    uint32_t read_ahead_pages = 8;           // Heap pages a sequential scan keeps in flight (0 = off)
+    uint16_t port = 6379;                    // Server listen port
+    uint16_t metrics_port = 0;               // Prometheus /metrics over HTTP (0 = off)
 };
 
+// ============================================================================
+// ConfigManager — loads DBConfigs from a "key = value" text file
+//
+//   # comments and blank lines are ignored
+//   db_file            = /data/docdb.db
+//   wal_file           = /data/docdb.wal     (default: <db_file>.wal)
+//   wal_segment_size   = 64MB                (bytes per WAL segment file)
+//   page_size          = 16384               (4096, 8192, 16384 or 32768)
+//   buffer_pool_size   = 262144              (frames; also accepts 4GB / 512MB / 64KB)
+//   buffer_pool_shards = 16
+//   replacer           = lru | lru_k | clock
+//   scan_ring_frames   = 64
+//   io_backend         = auto | io_uring | pread
+//   read_ahead_pages   = 8                   (0 disables scan read-ahead)
+//   flush_policy       = group_commit | flush_all
+//   checkpoint_interval_ms = 1000
+//   bgwriter_interval_ms   = 100
+//   bgwriter_max_pages     = 64
+//   deadlock_check_ms  = 50                  (0 disables deadlock detection)
+//   lock_escalation    = 1000                (record locks per collection per transaction)
+//   vacuum_interval_ms = 100
+//   num_workers        = 16
+//   recovery_threads   = 8                   (0 = one per core)
+//   scan_threads       = 8                   (0 = one per core, 1 = no parallel scans)
+//   cursor_timeout_ms  = 60000
+//   port               = 6379
+//   metrics_port       = 9100                (0 = no /metrics endpoint)
+//
+// Unknown keys and bad values throw std::runtime_error naming the line.
+// ============================================================================
+
 class ConfigManager {
 public:
-    static DBConfigs LoadConfig(const std::string& path) {
-        DBConfigs config;
-        config.page_size = 4096; 
-        config.db_file_name = "my_database.db";
-        return config;
-    }
-};
\ No newline at end of file
+    static DBConfigs LoadConfig(const std::string& path);
+
+    // Apply one key/value pair (also used for command-line overrides)
+    static void ApplyOption(DBConfigs& config, const std::string& key, const std::string& value);
+
+    // Check cross-field constraints (page size, non-zero pool)
+    static void Validate(const DBConfigs& config);
+};
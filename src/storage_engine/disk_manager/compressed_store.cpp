@@ -0,0 +1,270 @@
+#include "compressed_store.h"
+#include "page_compressor.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// ============================================================================
+// Constructor / Destructor
+// ============================================================================
+
+CompressedStore::CompressedStore(const std::string& base, uint32_t page_size)
+    : data_path_(base + ".z"), journal_path_(base + ".zmap"), page_size_(page_size) {
+    struct stat st;
+    if (stat(journal_path_.c_str(), &st) == 0) {
+        OpenFiles();
+        ReplayJournal();
+    }
+}
+
+CompressedStore::~CompressedStore() {
+    if (data_fd_ != -1) close(data_fd_);
+    if (journal_fd_ != -1) close(journal_fd_);
+}
+
+void CompressedStore::OpenFiles() {
+    data_fd_ = open(data_path_.c_str(), O_RDWR | O_CREAT, 0664);
+    journal_fd_ = open(journal_path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0664);
+    if (data_fd_ == -1 || journal_fd_ == -1) {
+        throw std::runtime_error("Error opening compressed page store: " + std::string(strerror(errno)));
+    }
+    active_.store(true, std::memory_order_release);
+}
+
+// ============================================================================
+// ReplayJournal — rebuild the mapping and free space, compact the journal
+// ============================================================================
+
+void CompressedStore::ReplayJournal() {
+    struct stat st;
+    if (fstat(journal_fd_, &st) != 0) {
+        throw std::runtime_error("Error reading page journal: " + std::string(strerror(errno)));
+    }
+    // A torn last entry (crash mid-append) is ignored
+    size_t count = static_cast<size_t>(st.st_size) / sizeof(JournalEntry);
+    std::vector<JournalEntry> entries(count);
+    if (count > 0 && pread(journal_fd_, entries.data(), count * sizeof(JournalEntry), 0) !=
+                         static_cast<ssize_t>(count * sizeof(JournalEntry))) {
+        throw std::runtime_error("Error reading page journal " + journal_path_);
+    }
+    for (const JournalEntry& entry : entries) slots_[entry.page_id] = Slot{entry.offset, entry.length};
+
+    // Free space: the gaps between current copies
+    std::vector<std::pair<uint64_t, uint64_t>> used;
+    for (const auto& [page_id, slot] : slots_) used.emplace_back(slot.offset, Units(slot.length));
+    std::sort(used.begin(), used.end());
+    for (const auto& [offset, length] : used) {
+        if (offset > end_) Release(end_, offset - end_);
+        end_ = std::max(end_, offset + length);
+    }
+
+    // Rewrite the journal with one entry per page if it has grown past that
+    if (count > 2 * slots_.size() + 1024) {
+        std::string tmp_path = journal_path_ + ".tmp";
+        int tmp_fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664);
+        if (tmp_fd == -1) return;  // Keep the long one
+        std::vector<JournalEntry> live;
+        for (const auto& [page_id, slot] : slots_) live.push_back(JournalEntry{page_id, slot.length, slot.offset});
+        size_t bytes = live.size() * sizeof(JournalEntry);
+        bool ok = write(tmp_fd, live.data(), bytes) == static_cast<ssize_t>(bytes) && fsync(tmp_fd) == 0;
+        close(tmp_fd);
+        if (ok && rename(tmp_path.c_str(), journal_path_.c_str()) == 0) {
+            close(journal_fd_);
+            journal_fd_ = open(journal_path_.c_str(), O_RDWR | O_APPEND, 0664);
+            if (journal_fd_ == -1) {
+                throw std::runtime_error("Error reopening page journal: " + std::string(strerror(errno)));
+            }
+        } else {
+            unlink(tmp_path.c_str());
+        }
+    }
+}
+
+// ============================================================================
+// Ranges
+// ============================================================================
+
+void CompressedStore::MarkCompressed(page_id_t first, uint32_t num_pages) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (!Active()) OpenFiles();
+    auto range = std::make_pair(first, num_pages);
+    ranges_.insert(std::upper_bound(ranges_.begin(), ranges_.end(), range), range);
+}
+
+bool CompressedStore::Handles(page_id_t page_id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    // Pages with a copy here stay here, marked again or not (a reopened
+    // database marks its ranges only once the catalog is loaded)
+    if (slots_.count(page_id)) return true;
+    // Ranges are heap extents, which do not overlap: only the last one
+    // starting at or before page_id can hold it
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), std::make_pair(page_id, UINT32_MAX));
+    return it != ranges_.begin() &&
+           static_cast<uint64_t>(page_id - std::prev(it)->first) < std::prev(it)->second;
+}
+
+// ============================================================================
+// Space
+// ============================================================================
+
+uint64_t CompressedStore::Allocate(uint64_t length) {
+    auto it = free_by_size_.lower_bound(length);
+    if (it == free_by_size_.end()) {
+        uint64_t offset = end_;
+        end_ += length;
+        return offset;
+    }
+    uint64_t offset = it->second;
+    uint64_t available = it->first;
+    free_by_size_.erase(it);
+    free_.erase(offset);
+    if (available > length) {
+        free_[offset + length] = available - length;
+        free_by_size_.emplace(available - length, offset + length);
+    }
+    return offset;
+}
+
+void CompressedStore::Release(uint64_t offset, uint64_t length) {
+    auto drop = [this](uint64_t off, uint64_t len) {
+        auto range = free_by_size_.equal_range(len);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == off) {
+                free_by_size_.erase(it);
+                break;
+            }
+        }
+        free_.erase(off);
+    };
+
+    // Merge with the free neighbours on either side
+    auto next = free_.lower_bound(offset);
+    if (next != free_.end() && next->first == offset + length) {
+        uint64_t next_len = next->second;
+        drop(next->first, next_len);
+        length += next_len;
+    }
+    auto prev = free_.lower_bound(offset);
+    if (prev != free_.begin()) {
+        --prev;
+        if (prev->first + prev->second == offset) {
+            uint64_t prev_off = prev->first;
+            uint64_t prev_len = prev->second;
+            drop(prev_off, prev_len);
+            offset = prev_off;
+            length += prev_len;
+        }
+    }
+    free_[offset] = length;
+    free_by_size_.emplace(length, offset);
+}
+
+// ============================================================================
+// Read / Write
+// ============================================================================
+
+bool CompressedStore::Read(page_id_t page_id, char* data) {
+    Slot slot;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = slots_.find(page_id);
+        if (it == slots_.end()) return false;
+        slot = it->second;
+    }
+
+    thread_local std::vector<uint8_t> buffer;
+    buffer.resize(slot.length);
+    ssize_t n = pread(data_fd_, buffer.data(), slot.length, static_cast<off_t>(slot.offset));
+    if (n != static_cast<ssize_t>(slot.length)) {
+        throw std::runtime_error("I/O error reading compressed page " + std::to_string(page_id) + ": " +
+                                 (n == -1 ? strerror(errno) : "short read"));
+    }
+    if (slot.length == page_size_) {
+        std::memcpy(data, buffer.data(), page_size_);
+    } else if (!PageCompressor::Decompress(buffer.data(), slot.length, reinterpret_cast<uint8_t*>(data),
+                                           page_size_)) {
+        throw std::runtime_error("Corrupted compressed page " + std::to_string(page_id));
+    }
+    return true;
+}
+
+bool CompressedStore::Write(page_id_t page_id, const char* data) {
+    if (!Handles(page_id)) return false;
+
+    // Compressed only if that saves at least one unit
+    thread_local std::vector<uint8_t> buffer;
+    buffer.resize(page_size_);
+    size_t length = PageCompressor::Compress(reinterpret_cast<const uint8_t*>(data), page_size_,
+                                             buffer.data(), page_size_ - UNIT);
+    const uint8_t* bytes = buffer.data();
+    if (length == 0) {
+        length = page_size_;
+        bytes = reinterpret_cast<const uint8_t*>(data);
+    }
+
+    uint64_t offset;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        offset = Allocate(Units(length));
+    }
+    ssize_t n = pwrite(data_fd_, bytes, length, static_cast<off_t>(offset));
+    if (n != static_cast<ssize_t>(length)) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        Release(offset, Units(length));
+        throw std::runtime_error("I/O error writing compressed page " + std::to_string(page_id) + ": " +
+                                 (n == -1 ? strerror(errno) : "short write"));
+    }
+
+    // The new copy is complete: make it current
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto it = slots_.find(page_id);
+    if (it != slots_.end()) {
+        retired_.emplace_back(it->second.offset, Units(it->second.length));
+        it->second = Slot{offset, static_cast<uint32_t>(length)};
+    } else {
+        slots_.emplace(page_id, Slot{offset, static_cast<uint32_t>(length)});
+        unsynced_new_.push_back(page_id);
+    }
+    unsynced_.push_back(JournalEntry{page_id, static_cast<uint32_t>(length), offset});
+    return true;
+}
+
+// ============================================================================
+// Sync — data, then the mapping, then free what the mapping dropped
+// ============================================================================
+
+void CompressedStore::Sync(std::vector<page_id_t>* moved) {
+    if (!Active()) return;
+    std::lock_guard<std::mutex> sync_lock(sync_mutex_);
+
+    std::vector<JournalEntry> entries;
+    std::vector<std::pair<uint64_t, uint64_t>> retired;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        entries.swap(unsynced_);
+        retired.swap(retired_);
+        moved->swap(unsynced_new_);
+    }
+
+    if (fsync(data_fd_) == -1) {
+        throw std::runtime_error("fsync failed: " + std::string(strerror(errno)));
+    }
+    if (!entries.empty()) {
+        size_t bytes = entries.size() * sizeof(JournalEntry);
+        if (write(journal_fd_, entries.data(), bytes) != static_cast<ssize_t>(bytes) || fsync(journal_fd_) == -1) {
+            throw std::runtime_error("Error writing page journal: " + std::string(strerror(errno)));
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& [offset, length] : retired) Release(offset, length);
+}
+
+uint64_t CompressedStore::GetStoredBytes() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return end_;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "storage_engine/common/common.h"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ============================================================================
+// CompressedStore — variable-size, compressed copies of selected pages
+//
+// Pages in ranges marked compressed (through DiskManager::SetCompressed)
+// are kept in <db_file>.z instead of at their offset in the data file:
+// each is LZ-compressed (PageCompressor) into a run of 256-byte units, or
+// stored whole if it does not shrink. The page mapping (page id ->
+// offset, length) lives in memory and in <db_file>.zmap, an append-only
+// journal of 16-byte entries where the last entry for a page wins.
+//
+// Writes never overwrite a page's current copy: the new one goes to free
+// space and becomes current once written. Sync fsyncs the .z file, then
+// appends the entries made since the last Sync and fsyncs the journal;
+// only then does the space of the copies they replaced become free. So
+// after a crash the journal points at copies that were all durable, at
+// worst older ones, which the WAL brings up to date like any page that
+// missed its write-back. The journal is compacted when the store opens.
+// For the same reason a page's old blocks in the data file are released
+// only once its first copy here is durable.
+//
+// Files are created when the first range is marked; until then, or after
+// opening a database that never used compression, Active() is false and
+// the DiskManager skips the store entirely.
+// ============================================================================
+
+class CompressedStore {
+public:
+    // Open <base>.z / <base>.zmap if they exist and replay the journal
+    CompressedStore(const std::string& base, uint32_t page_size);
+    ~CompressedStore();
+
+    CompressedStore(const CompressedStore&) = delete;
+    CompressedStore& operator=(const CompressedStore&) = delete;
+
+    bool Active() const { return active_.load(std::memory_order_acquire); }
+
+    // Store pages [first, first + num_pages) here from now on
+    void MarkCompressed(page_id_t first, uint32_t num_pages);
+
+    // Whether page_id is (to be) stored here
+    bool Handles(page_id_t page_id) const;
+
+    // Read a page stored here into data. Returns false if the store has no
+    // copy (the data file's, if any, is current then). Throws on I/O error.
+    bool Read(page_id_t page_id, char* data);
+
+    // Store a page if Handles(page_id); returns false otherwise
+    bool Write(page_id_t page_id, const char* data);
+
+    // Make every completed Write durable, mapping included. *moved gets
+    // the pages whose first copy here became durable: their blocks in the
+    // data file are no longer needed.
+    void Sync(std::vector<page_id_t>* moved);
+
+    // Bytes the .z file takes (for stats and tests)
+    uint64_t GetStoredBytes() const;
+
+private:
+    static constexpr uint64_t UNIT = 256;
+
+    struct Slot {
+        uint64_t offset;
+        uint32_t length;  // Stored bytes; page_size means uncompressed
+    };
+
+    struct JournalEntry {
+        page_id_t page_id;
+        uint32_t length;
+        uint64_t offset;
+    };
+    static_assert(sizeof(JournalEntry) == 16, "JournalEntry must be 16 bytes");
+
+    static uint64_t Units(uint64_t length) { return (length + UNIT - 1) / UNIT * UNIT; }
+
+    void OpenFiles();
+    void ReplayJournal();
+
+    // Space for length bytes (mutex_ held)
+    uint64_t Allocate(uint64_t length);
+    void Release(uint64_t offset, uint64_t length);
+
+    std::string data_path_;
+    std::string journal_path_;
+    uint32_t page_size_;
+    int data_fd_ = -1;
+    int journal_fd_ = -1;
+    std::atomic<bool> active_{false};
+
+    mutable std::shared_mutex mutex_;  // Everything below
+    std::vector<std::pair<page_id_t, uint32_t>> ranges_;  // Sorted (first, num_pages)
+    std::unordered_map<page_id_t, Slot> slots_;
+    std::vector<JournalEntry> unsynced_;                 // Entries since the last Sync
+    std::vector<page_id_t> unsynced_new_;                // Pages first stored since then
+    std::vector<std::pair<uint64_t, uint64_t>> retired_;  // Replaced copies, freed by Sync
+    std::map<uint64_t, uint64_t> free_;                  // offset -> length, coalesced
+    std::multimap<uint64_t, uint64_t> free_by_size_;     // length -> offset, for best fit
+    uint64_t end_ = 0;                                   // File tail
+
+    std::mutex sync_mutex_;  // One Sync at a time
+};
@@ -1,12 +1,22 @@
 #include "disk_manager.h"
+#include "compressed_store.h"
+#include "io_uring.h"
+#include "storage_engine/common/metrics.h"
 #include <fcntl.h>
+#include <linux/falloc.h>
+#include <algorithm>
 #include <unistd.h>     
 #include <sys/stat.h>   
 #include <stdexcept>
 #include <iostream>
 #include <cstring>
 
-DiskManager::DiskManager(const DBConfigs& config) : file_name_(config.db_file_name) , page_size_(config.page_size){
+// Large enough to keep a read-ahead window or a checkpoint's writes in flight
+static constexpr unsigned IO_RING_ENTRIES = 64;
+
+DiskManager::DiskManager(const DBConfigs& config)
+    : file_name_(config.db_file_name), page_size_(config.page_size),
+      read_ahead_pages_(config.read_ahead_pages) {
 
     fd_ = open(file_name_.c_str(), O_RDWR | O_CREAT, 0664);
     if (fd_ == -1) {
@@ -19,20 +29,66 @@ DiskManager::DiskManager(const DBConfigs& config) : file_name_(config.db_file_na
         throw std::runtime_error("Error seeking file end: " + std::string(strerror(errno)));
     }
 
+    // Either a page write cut short by a crash (recovery rewrites it) or a
+    // file created with another page size
+    if (file_size % config.page_size != 0) {
+        std::cerr << "Warning: " << file_name_ << " size is not a multiple of page_size "
+                  << config.page_size << std::endl;
+    }
+
     if(file_size > 0){
-        next_page_id_ = file_size / config.page_size;
+        next_page_id_ = (file_size + config.page_size - 1) / config.page_size;
     } else {
         next_page_id_ = 0;
     }
+
+    compressed_ = std::make_unique<CompressedStore>(file_name_, config.page_size);
+
+    if (config.io_backend != IOBackend::PREAD) {
+        try {
+            sync_ring_ = std::make_unique<IoUring>(IO_RING_ENTRIES);
+        } catch (const std::runtime_error& e) {
+            if (config.io_backend == IOBackend::IO_URING) {
+                close(fd_);
+                throw;
+            }
+            std::cerr << "Note: " << e.what() << "; using pread/pwrite" << std::endl;
+        }
+    }
 }
 
 DiskManager::~DiskManager() {
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        async_stop_ = true;
+    }
+    async_cv_.notify_all();
+    if (async_thread_.joinable()) {
+        async_thread_.join();  // Finishes whatever is still queued
+    }
+    sync_ring_.reset();
+    // The compressed store's mapping must reach its journal before closing,
+    // or the copies written since the last Sync would be unreachable
+    if (compressed_ && compressed_->Active()) {
+        try {
+            Sync();
+        } catch (const std::runtime_error& e) {
+            std::cerr << "DiskManager: " << e.what() << std::endl;
+        }
+    }
     if (fd_ != -1) {
         close(fd_);
     }
 }
 
 void DiskManager::WritePage(page_id_t page_id, const char* data){
+    Metrics::Timer timer(Histogram::DISK_WRITE);
+    Metrics::Add(Counter::DISK_WRITES);
+    Metrics::Add(Counter::DISK_WRITE_BYTES, page_size_);
+    if (compressed_->Active() && compressed_->Write(page_id, data)) {
+        NoteWritten(page_id);
+        return;
+    }
 
     off_t offset = static_cast<off_t>(page_id)*page_size_; 
 
@@ -44,9 +100,23 @@ void DiskManager::WritePage(page_id_t page_id, const char* data){
     if(bytes_written != page_size_){
         std::cerr << "Warning: Partial write to page " << page_id << std::endl;
     }
+
+    NoteWritten(page_id);
+}
+
+void DiskManager::NoteWritten(page_id_t page_id) {
+    // Recovery may write pages that were allocated but never reached disk
+    // before a crash; never hand those ids out again.
+    page_id_t next = next_page_id_.load();
+    while (page_id >= next && !next_page_id_.compare_exchange_weak(next, page_id + 1)) {}
 }
 
 void DiskManager::ReadPage(page_id_t page_id, char* data){
+    Metrics::Timer timer(Histogram::DISK_READ);
+    Metrics::Add(Counter::DISK_READS);
+    Metrics::Add(Counter::DISK_READ_BYTES, page_size_);
+    if (compressed_->Active() && compressed_->Read(page_id, data)) return;
+
     off_t offset = static_cast<off_t>(page_id) *page_size_;
 
     ssize_t bytes_read = pread(fd_, data, page_size_, offset);
@@ -60,14 +130,240 @@ void DiskManager::ReadPage(page_id_t page_id, char* data){
     }
 }
 
+// ============================================================================
+// Batched I/O
+// ============================================================================
+
+void DiskManager::RunBatch(IoUring& ring, bool write, const std::vector<IORequest>& requests,
+                           std::vector<int32_t>* results) {
+    // The whole batch is one latency sample
+    Metrics::Timer timer(write ? Histogram::DISK_WRITE : Histogram::DISK_READ);
+    Metrics::Add(write ? Counter::DISK_WRITES : Counter::DISK_READS, requests.size());
+    Metrics::Add(write ? Counter::DISK_WRITE_BYTES : Counter::DISK_READ_BYTES, requests.size() * page_size_);
+    results->assign(requests.size(), 0);
+    size_t next = 0;
+    size_t in_flight = 0;
+    size_t completed = 0;
+
+    while (completed < requests.size()) {
+        // Keep the ring as full as it will go
+        while (next < requests.size() && in_flight < ring.Capacity()) {
+            const IORequest& req = requests[next];
+            off_t offset = static_cast<off_t>(req.page_id) * page_size_;
+            bool queued = write ? ring.PrepWrite(fd_, req.data, page_size_, offset, next)
+                                : ring.PrepRead(fd_, req.data, page_size_, offset, next);
+            if (!queued) break;
+            next++;
+            in_flight++;
+        }
+
+        ring.SubmitAndWait(1);
+
+        uint64_t index;
+        int32_t res;
+        while (ring.PopCompletion(&index, &res)) {
+            (*results)[index] = res;
+            in_flight--;
+            completed++;
+        }
+    }
+}
+
+void DiskManager::SplitCompressed(bool write, const std::vector<IORequest>& requests,
+                                  std::vector<IORequest>* rest, const IOCallback* done) {
+    for (const IORequest& req : requests) {
+        bool handled;
+        bool ok = true;
+        try {
+            handled = write ? compressed_->Write(req.page_id, req.data) : compressed_->Read(req.page_id, req.data);
+        } catch (const std::runtime_error& e) {
+            if (!done) throw;
+            std::cerr << "DiskManager: async " << e.what() << std::endl;
+            handled = true;
+            ok = false;
+        }
+        if (!handled) {
+            rest->push_back(req);
+        } else {
+            if (write) NoteWritten(req.page_id);
+            if (done) (*done)(req, ok);
+        }
+    }
+}
+
+void DiskManager::ReadPages(const std::vector<IORequest>& all) {
+    if (!sync_ring_) {
+        for (const IORequest& req : all) ReadPage(req.page_id, req.data);
+        return;
+    }
+    std::vector<IORequest> uncompressed;
+    if (compressed_->Active()) SplitCompressed(false, all, &uncompressed);
+    const std::vector<IORequest>& requests = compressed_->Active() ? uncompressed : all;
+
+    std::vector<int32_t> results;
+    {
+        std::lock_guard<std::mutex> lock(sync_ring_mutex_);
+        RunBatch(*sync_ring_, false, requests, &results);
+    }
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (results[i] < 0) {
+            throw std::runtime_error("I/O error reading page " + std::to_string(requests[i].page_id) +
+                                     ": " + strerror(-results[i]));
+        }
+        // Short read: past EOF, or cut short — let pread finish or zero-fill it
+        if (results[i] < page_size_) ReadPage(requests[i].page_id, requests[i].data);
+    }
+}
+
+void DiskManager::WritePages(const std::vector<IORequest>& all) {
+    if (!sync_ring_) {
+        for (const IORequest& req : all) WritePage(req.page_id, req.data);
+        return;
+    }
+    std::vector<IORequest> uncompressed;
+    if (compressed_->Active()) SplitCompressed(true, all, &uncompressed);
+    const std::vector<IORequest>& requests = compressed_->Active() ? uncompressed : all;
+
+    std::vector<int32_t> results;
+    {
+        std::lock_guard<std::mutex> lock(sync_ring_mutex_);
+        RunBatch(*sync_ring_, true, requests, &results);
+    }
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (results[i] < 0) {
+            throw std::runtime_error("I/O error writing page " + std::to_string(requests[i].page_id) +
+                                     ": " + strerror(-results[i]));
+        }
+        if (results[i] < page_size_) {
+            WritePage(requests[i].page_id, requests[i].data);
+        } else {
+            NoteWritten(requests[i].page_id);
+        }
+    }
+}
+
+// ============================================================================
+// Async reads — queued batches served by one I/O thread
+// ============================================================================
+
+void DiskManager::ReadPagesAsync(std::vector<IORequest> requests, IOCallback done) {
+    if (requests.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        if (!async_thread_.joinable()) {
+            async_thread_ = std::thread(&DiskManager::AsyncLoop, this);
+        }
+        async_queue_.push_back(AsyncBatch{std::move(requests), std::move(done)});
+    }
+    async_cv_.notify_all();
+}
+
+void DiskManager::DrainAsync() {
+    std::unique_lock<std::mutex> lock(async_mutex_);
+    async_cv_.wait(lock, [this] { return async_queue_.empty() && async_running_ == 0; });
+}
+
+void DiskManager::AsyncLoop() {
+    // The thread's own ring, so async batches never wait behind sync ones
+    std::unique_ptr<IoUring> ring;
+    if (sync_ring_) {
+        try {
+            ring = std::make_unique<IoUring>(IO_RING_ENTRIES);
+        } catch (const std::runtime_error&) {}
+    }
+
+    while (true) {
+        AsyncBatch batch;
+        {
+            std::unique_lock<std::mutex> lock(async_mutex_);
+            async_cv_.wait(lock, [this] { return async_stop_ || !async_queue_.empty(); });
+            if (async_queue_.empty()) return;  // Stopping and drained
+            batch = std::move(async_queue_.front());
+            async_queue_.pop_front();
+            async_running_++;
+        }
+        if (compressed_->Active()) {
+            std::vector<IORequest> uncompressed;
+            SplitCompressed(false, batch.requests, &uncompressed, &batch.done);
+            batch.requests.swap(uncompressed);
+        }
+
+        std::vector<int32_t> results;
+        if (ring) {
+            try {
+                RunBatch(*ring, false, batch.requests, &results);
+            } catch (const std::runtime_error&) {
+                results.assign(batch.requests.size(), -EIO);
+            }
+        }
+
+        for (size_t i = 0; i < batch.requests.size(); i++) {
+            const IORequest& req = batch.requests[i];
+            bool ok = ring && results[i] == page_size_;
+            if (!ok && (!ring || results[i] >= 0)) {
+                // pread backend, or a short read to finish or zero-fill
+                try {
+                    ReadPage(req.page_id, req.data);
+                    ok = true;
+                } catch (const std::runtime_error& e) {
+                    std::cerr << "DiskManager: async " << e.what() << std::endl;
+                }
+            }
+            batch.done(req, ok);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(async_mutex_);
+            async_running_--;
+        }
+        async_cv_.notify_all();
+    }
+}
+
 page_id_t DiskManager::AllocatePage() {
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        if (!free_pages_.empty()) {
+            page_id_t page_id = *free_pages_.begin();
+            free_pages_.erase(free_pages_.begin());
+            return page_id;
+        }
+    }
     return next_page_id_.fetch_add(1);
 }
 
-void DiskManager::DeallocatePage(page_id_t page_id){
+page_id_t DiskManager::AllocateExtent(uint32_t num_pages) {
+    page_id_t first = next_page_id_.fetch_add(static_cast<page_id_t>(num_pages));
+    off_t offset = static_cast<off_t>(first) * page_size_;
+    off_t length = static_cast<off_t>(num_pages) * page_size_;
+    int err = posix_fallocate(fd_, offset, length);
+    if (err != 0) {
+        // Not contiguous then, but the file must still cover the run, or a
+        // restart would size next_page_id_ from the file and hand the
+        // unwritten tail out again
+        struct stat st;
+        if (fstat(fd_, &st) != 0 ||
+            (st.st_size < offset + length && ftruncate(fd_, offset + length) != 0)) {
+            throw std::runtime_error("Error reserving pages: " + std::string(strerror(err)));
+        }
+    }
+    return first;
+}
+
+void DiskManager::DeallocatePage(page_id_t page_id) {
+    if (page_id < 0 || page_id >= next_page_id_.load()) return;
+    std::lock_guard<std::mutex> lock(free_mutex_);
+    free_pages_.insert(page_id);
 }
 
-page_size_t DiskManager::GetFileSize(){
+size_t DiskManager::GetFreePageCount() {
+    std::lock_guard<std::mutex> lock(free_mutex_);
+    return free_pages_.size();
+}
+
+int64_t DiskManager::GetFileSize(){
     struct stat st;
     if(fstat(fd_, &st) == -1){
         return -1;
@@ -75,8 +371,33 @@ page_size_t DiskManager::GetFileSize(){
     return st.st_size;
 }
 
+void DiskManager::SetCompressed(page_id_t first, uint32_t num_pages) {
+    compressed_->MarkCompressed(first, num_pages);
+}
+
+uint64_t DiskManager::GetCompressedBytes() const {
+    return compressed_->Active() ? compressed_->GetStoredBytes() : 0;
+}
+
 void DiskManager::Sync() {
-    if (fsync(fd_) == -1) {
-        throw std::runtime_error("fsync failed: " + std::string(strerror(errno)));
+    {
+        Metrics::Timer timer(Histogram::DISK_SYNC);
+        if (fsync(fd_) == -1) {
+            throw std::runtime_error("fsync failed: " + std::string(strerror(errno)));
+        }
+    }
+    if (!compressed_->Active()) return;
+
+    // Pages now durable in the compressed store give back their blocks here,
+    // a run of adjacent pages at a time
+    std::vector<page_id_t> moved;
+    compressed_->Sync(&moved);
+    std::sort(moved.begin(), moved.end());
+    for (size_t i = 0; i < moved.size();) {
+        size_t j = i + 1;
+        while (j < moved.size() && moved[j] == moved[j - 1] + 1) j++;
+        fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(moved[i]) * page_size_,
+                  static_cast<off_t>(j - i) * page_size_);  // Best effort: only space is at stake
+        i = j;
     }
 }
\ No newline at end of file
@@ -1,10 +1,53 @@
 #pragma once
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 #include "storage_engine/common/common.h"
 #include "storage_engine/config/config.h"
 
+class IoUring;
+class CompressedStore;
+
+// One page-sized transfer between the data file and a caller-owned buffer
+struct IORequest {
+    page_id_t page_id;
+    char* data;
+};
+
+// Called once per page of an async batch, on the disk manager's I/O thread.
+// ok == false means the read failed and data holds nothing useful.
+using IOCallback = std::function<void(const IORequest& request, bool ok)>;
+
+// ============================================================================
+// DiskManager — page I/O against the data file
+//
+// Single pages go through pread/pwrite. Batches (ReadPages/WritePages and
+// ReadPagesAsync) are submitted through io_uring when the backend allows
+// it, so the device sees the whole batch at once instead of one page per
+// round trip; with the pread backend they degrade to a loop of syscalls.
+// Async reads run on a lazily started I/O thread that owns its own ring.
+//
+// Deallocated pages go on a free list that AllocatePage takes from before
+// growing the file. The list lives in memory only: pages freed before a
+// restart stay unused holes until something reclaims them.
+//
+// AllocateExtent hands out a run of fresh, contiguous ids and preallocates
+// their blocks, so the run is laid out sequentially on disk and survives a
+// restart as part of the file even before its pages are written.
+//
+// Page ranges given to SetCompressed are stored compressed, at variable
+// size, in a CompressedStore beside the data file; callers still see
+// whole pages. Their blocks in the data file are released once the
+// compressed copy is durable (at Sync).
+// ============================================================================
+
 class DiskManager {
 public:
     explicit DiskManager(const DBConfigs& config);
@@ -18,17 +61,72 @@ public:
     void WritePage(page_id_t page_id, const char* data);
     void ReadPage(page_id_t page_id, char* data);
 
+    // Batched I/O; both block until every page is done and throw on error
+    void ReadPages(const std::vector<IORequest>& requests);
+    void WritePages(const std::vector<IORequest>& requests);
+
+    // Queue reads and return at once; done runs on the I/O thread per page
+    void ReadPagesAsync(std::vector<IORequest> requests, IOCallback done);
+
+    // Block until every queued async read has completed
+    void DrainAsync();
+
+    bool UsesIoUring() const { return sync_ring_ != nullptr; }
+    uint32_t GetReadAheadPages() const { return read_ahead_pages_; }
+
     // Management
-    page_id_t AllocatePage();
+    page_id_t AllocatePage();     // Reuses a deallocated page if there is one
+    page_id_t AllocateExtent(uint32_t num_pages);  // First id of the run; never reuses freed pages
     void DeallocatePage(page_id_t page_id);
-    int GetFileSize();
+    size_t GetFreePageCount();
+    int64_t GetFileSize();
+    page_size_t GetPageSize() const { return page_size_; }
     
+    // Store pages [first, first + num_pages) compressed from now on
+    void SetCompressed(page_id_t first, uint32_t num_pages);
+
+    // Bytes the compressed pages take on disk
+    uint64_t GetCompressedBytes() const;
+
     // Force OS to flush data to physical disk (Critical for WAL later)
     void Sync(); 
 
 private:
+    struct AsyncBatch {
+        std::vector<IORequest> requests;
+        IOCallback done;
+    };
+
+    // Run one batch through ring; results[i] is bytes or -errno for requests[i]
+    void RunBatch(IoUring& ring, bool write, const std::vector<IORequest>& requests,
+                  std::vector<int32_t>* results);
+    void AsyncLoop();
+    void NoteWritten(page_id_t page_id);  // Bump next_page_id_ past page_id
+
+    // Serve the requests of a batch the compressed store handles one by
+    // one (calling done for each, if given); the rest are left in *rest
+    void SplitCompressed(bool write, const std::vector<IORequest>& requests,
+                         std::vector<IORequest>* rest, const IOCallback* done = nullptr);
+
     int fd_; // The Linux File Descriptor
-    page_size_t page_size_;
     std::string file_name_;
+    page_size_t page_size_;
+    uint32_t read_ahead_pages_;
     std::atomic<page_id_t> next_page_id_; // Atomic counter for lock-free allocation
+
+    std::mutex free_mutex_;
+    std::set<page_id_t> free_pages_;  // Deallocated; the lowest is reused first
+
+    std::unique_ptr<CompressedStore> compressed_;
+
+    std::unique_ptr<IoUring> sync_ring_;  // Null with the pread backend
+    std::mutex sync_ring_mutex_;
+
+    // Async reads: one I/O thread, started on first use
+    std::mutex async_mutex_;
+    std::condition_variable async_cv_;
+    std::deque<AsyncBatch> async_queue_;
+    size_t async_running_ = 0;  // Batches taken off the queue but not finished
+    bool async_stop_ = false;
+    std::thread async_thread_;
 };
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "io_uring.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// ============================================================================
+// Setup — create the ring and map the SQ/CQ rings and the SQE array
+// ============================================================================
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (ring_fd_ < 0) {
+        throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+    }
+    sq_entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        close(ring_fd_);
+        throw std::runtime_error("io_uring: cannot map SQ ring: " + std::string(strerror(errno)));
+    }
+
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            munmap(sq_ring_, sq_ring_size_);
+            close(ring_fd_);
+            throw std::runtime_error("io_uring: cannot map CQ ring: " + std::string(strerror(errno)));
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        if (cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+        munmap(sq_ring_, sq_ring_size_);
+        close(ring_fd_);
+        throw std::runtime_error("io_uring: cannot map SQEs: " + std::string(strerror(errno)));
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+IoUring::~IoUring() {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+    if (ring_fd_ >= 0) close(ring_fd_);
+}
+
+// ============================================================================
+// Submission
+// ============================================================================
+
+bool IoUring::Prep(uint8_t opcode, int fd, const void* buf, uint32_t len, off_t offset,
+                   uint64_t user_data) {
+    // We are the only producer, so our own tail needs no atomic load
+    unsigned tail = *sq_tail_;
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (tail - head >= sq_entries_) return false;
+
+    unsigned index = tail & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = static_cast<uint64_t>(offset);
+    sqe->user_data = user_data;
+
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    to_submit_++;
+    return true;
+}
+
+bool IoUring::PrepRead(int fd, char* buf, uint32_t len, off_t offset, uint64_t user_data) {
+    return Prep(IORING_OP_READ, fd, buf, len, offset, user_data);
+}
+
+bool IoUring::PrepWrite(int fd, const char* buf, uint32_t len, off_t offset, uint64_t user_data) {
+    return Prep(IORING_OP_WRITE, fd, buf, len, offset, user_data);
+}
+
+void IoUring::SubmitAndWait(unsigned min_complete) {
+    while (true) {
+        long ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit_, min_complete,
+                           IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (ret >= 0) {
+            // The kernel may take fewer than we queued; the rest stay in the SQ
+            to_submit_ -= std::min<unsigned>(to_submit_, static_cast<unsigned>(ret));
+            if (to_submit_ == 0) return;
+            continue;
+        }
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+        throw std::runtime_error("io_uring_enter failed: " + std::string(strerror(errno)));
+    }
+}
+
+// ============================================================================
+// Completion
+// ============================================================================
+
+bool IoUring::PopCompletion(uint64_t* user_data, int32_t* res) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) return false;
+
+    const io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <sys/types.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// ============================================================================
+// IoUring — a minimal io_uring ring driven through the raw syscalls
+//
+// Only what the DiskManager needs: queue reads/writes at file offsets,
+// submit them in one io_uring_enter, and reap completions. Not thread-safe;
+// each ring has a single owner (or a mutex around it).
+//
+// The constructor throws std::runtime_error when the kernel has no io_uring
+// (ENOSYS, or EPERM under a seccomp filter), so callers can fall back to
+// pread/pwrite.
+// ============================================================================
+
+class IoUring {
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // Submission queue size; at most this many operations may be in flight
+    unsigned Capacity() const { return sq_entries_; }
+
+    // Queue one operation. Returns false if the submission queue is full.
+    bool PrepRead(int fd, char* buf, uint32_t len, off_t offset, uint64_t user_data);
+    bool PrepWrite(int fd, const char* buf, uint32_t len, off_t offset, uint64_t user_data);
+
+    // Submit everything queued and block until at least min_complete
+    // completions are available. Throws on a syscall error.
+    void SubmitAndWait(unsigned min_complete);
+
+    // Pop one completion (res is bytes transferred or -errno).
+    // Returns false if the completion queue is empty.
+    bool PopCompletion(uint64_t* user_data, int32_t* res);
+
+private:
+    bool Prep(uint8_t opcode, int fd, const void* buf, uint32_t len, off_t offset, uint64_t user_data);
+
+    int ring_fd_ = -1;
+    unsigned sq_entries_ = 0;
+    unsigned to_submit_ = 0;  // Queued since the last SubmitAndWait
+
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    // Pointers into the shared rings
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+};
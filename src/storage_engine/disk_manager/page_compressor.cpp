@@ -0,0 +1,127 @@
+#include "page_compressor.h"
+#include <cstring>
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static uint32_t Load32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Write the part of a length that does not fit its nibble
+static bool PutLength(uint8_t** out, const uint8_t* end, size_t length) {
+    while (length >= 255) {
+        if (*out >= end) return false;
+        *(*out)++ = 255;
+        length -= 255;
+    }
+    if (*out >= end) return false;
+    *(*out)++ = static_cast<uint8_t>(length);
+    return true;
+}
+
+static bool GetLength(const uint8_t** in, const uint8_t* end, size_t* length) {
+    uint8_t byte;
+    do {
+        if (*in >= end) return false;
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// One sequence; match_length == 0 for the closing literals-only one
+static bool PutSequence(uint8_t** out, const uint8_t* end, const uint8_t* literals, size_t num_literals,
+                        size_t offset, size_t match_length) {
+    size_t match_code = match_length ? match_length - 4 : 0;
+    if (*out >= end) return false;
+    *(*out)++ = static_cast<uint8_t>((num_literals < 15 ? num_literals : 15) << 4 |
+                                     (match_code < 15 ? match_code : 15));
+    if (num_literals >= 15 && !PutLength(out, end, num_literals - 15)) return false;
+    if (static_cast<size_t>(end - *out) < num_literals) return false;
+    std::memcpy(*out, literals, num_literals);
+    *out += num_literals;
+    if (match_length == 0) return true;
+
+    if (end - *out < 2) return false;
+    *(*out)++ = static_cast<uint8_t>(offset);
+    *(*out)++ = static_cast<uint8_t>(offset >> 8);
+    return match_code < 15 || PutLength(out, end, match_code - 15);
+}
+
+// ============================================================================
+// Compress
+// ============================================================================
+
+size_t PageCompressor::Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity) {
+    // Last position seen for each hash; 0 doubles as "none", since a match
+    // is only taken after comparing the bytes
+    uint32_t table[1u << HASH_BITS] = {};
+    uint8_t* out = dst;
+    const uint8_t* out_end = dst + capacity;
+    size_t anchor = 0;  // First byte not yet emitted
+    size_t pos = 0;
+
+    while (pos + MIN_MATCH <= size) {
+        uint32_t sequence = Load32(src + pos);
+        uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(pos);
+
+        if (candidate < pos && pos - candidate <= MAX_OFFSET && Load32(src + candidate) == sequence) {
+            size_t length = MIN_MATCH;
+            while (pos + length < size && src[candidate + length] == src[pos + length]) length++;
+            if (!PutSequence(&out, out_end, src + anchor, pos - anchor, pos - candidate, length)) return 0;
+            pos += length;
+            anchor = pos;
+        } else {
+            pos++;
+        }
+    }
+    if (!PutSequence(&out, out_end, src + anchor, size - anchor, 0, 0)) return 0;
+    return static_cast<size_t>(out - dst);
+}
+
+// ============================================================================
+// Decompress
+// ============================================================================
+
+bool PageCompressor::Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t out_size) {
+    const uint8_t* in = src;
+    const uint8_t* in_end = src + size;
+    uint8_t* out = dst;
+    uint8_t* out_end = dst + out_size;
+
+    while (in < in_end) {
+        uint8_t token = *in++;
+        size_t num_literals = token >> 4;
+        if (num_literals == 15 && !GetLength(&in, in_end, &num_literals)) return false;
+        if (static_cast<size_t>(in_end - in) < num_literals ||
+            static_cast<size_t>(out_end - out) < num_literals) {
+            return false;
+        }
+        std::memcpy(out, in, num_literals);
+        in += num_literals;
+        out += num_literals;
+        if (in == in_end) break;  // The closing literals
+
+        if (in_end - in < 2) return false;
+        size_t offset = in[0] | static_cast<size_t>(in[1]) << 8;
+        in += 2;
+        size_t length = token & 0x0F;
+        if (length == 15 && !GetLength(&in, in_end, &length)) return false;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(out - dst) ||
+            static_cast<size_t>(out_end - out) < length) {
+            return false;
+        }
+        // Byte by byte: the source may overlap what is being written
+        const uint8_t* match = out - offset;
+        for (size_t i = 0; i < length; i++) out[i] = match[i];
+        out += length;
+    }
+    return out == out_end;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ============================================================================
+// PageCompressor — LZ77 block compression for pages on disk
+//
+// The LZ4 block format, written from scratch so the engine needs no
+// library: a run of sequences, each
+//   [token: literal count << 4 | (match length - 4)]
+//   [more literal count: 255, 255, ..., rest]   (if the nibble is 15)
+//   [literals]
+//   [uint16 match offset, little endian]
+//   [more match length, the same way]
+// with a last sequence of literals only. Matches are found greedily
+// through a hash of the next four bytes, which catches what a slotted page
+// repeats: field names, the zeroed gap between slots and records, padding.
+// ============================================================================
+
+class PageCompressor {
+public:
+    // Compress src[0..size) into dst. Returns the compressed length, or 0
+    // if it would exceed capacity (store the page uncompressed then).
+    static size_t Compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+
+    // Decompress exactly out_size bytes. Returns false on corrupt input.
+    static bool Decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t out_size);
+
+private:
+    static constexpr size_t MIN_MATCH = 4;
+    static constexpr unsigned HASH_BITS = 12;
+    static constexpr size_t MAX_OFFSET = UINT16_MAX;
+};
@@ -1,13 +1,62 @@
 #include "free_space_map.h"
 #include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// ============================================================================
+// Category byte search — SSE2 over 16 slots at a time where available
+// ============================================================================
+
+// First i in [from, n) with cats[i] >= need, or n
+static uint32_t FindAtLeast(const uint8_t* cats, uint32_t from, uint32_t n, uint8_t need) {
+    uint32_t i = from;
+#if defined(__SSE2__)
+    const __m128i needv = _mm_set1_epi8(static_cast<char>(need));
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cats + i));
+        // Unsigned v >= need exactly where max(v, need) == v
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, needv), v));
+        if (mask != 0) return i + static_cast<uint32_t>(__builtin_ctz(mask));
+    }
+#endif
+    for (; i < n; i++) {
+        if (cats[i] >= need) return i;
+    }
+    return n;
+}
+
+static uint8_t MaxCategory(const uint8_t* cats, uint32_t n) {
+    uint8_t max = 0;
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    __m128i maxv = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        maxv = _mm_max_epu8(maxv, _mm_loadu_si128(reinterpret_cast<const __m128i*>(cats + i)));
+    }
+    alignas(16) uint8_t lanes[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), maxv);
+    for (uint8_t lane : lanes) max = std::max(max, lane);
+#endif
+    for (; i < n; i++) max = std::max(max, cats[i]);
+    return max;
+}
 
 // ============================================================================
 // Constructor
 // ============================================================================
 
-FreeSpaceMap::FreeSpaceMap(BufferPoolManager* bpm, page_id_t fsm_start_page, uint16_t page_size)
-    : bpm_(bpm), fsm_start_page_(fsm_start_page), page_size_(page_size) {
-    entries_per_page_ = page_size_;  // 1 byte per entry, so one FSM page tracks page_size_ heap pages
+FreeSpaceMap::FreeSpaceMap(BufferPoolManager* bpm, page_id_t fsm_start_page)
+    : bpm_(bpm), fsm_start_page_(fsm_start_page), page_size_(bpm->GetPageSize()) {
+    leaf_slots_ = page_size_ - HEADER_SIZE;
+    // One category byte and one child id per slot; a multiple of 16 keeps
+    // the child ids aligned
+    internal_slots_ = ((page_size_ - HEADER_SIZE) / (1 + sizeof(page_id_t))) & ~15u;
+    granularity_ = static_cast<uint16_t>(page_size_ / 256);
 }
 
 // ============================================================================
@@ -15,70 +64,286 @@ FreeSpaceMap::FreeSpaceMap(BufferPoolManager* bpm, page_id_t fsm_start_page, uin
 // ============================================================================
 
 uint8_t FreeSpaceMap::BytesToCategory(uint16_t free_bytes) const {
-    uint16_t cat = free_bytes / GRANULARITY;
+    uint16_t cat = free_bytes / granularity_;
     return static_cast<uint8_t>(std::min<uint16_t>(cat, 255));
 }
 
+uint8_t FreeSpaceMap::NeededCategory(uint16_t needed_bytes) const {
+    uint32_t cat = (static_cast<uint32_t>(needed_bytes) + granularity_ - 1) / granularity_;
+    return static_cast<uint8_t>(std::clamp<uint32_t>(cat, 1, 255));
+}
+
 uint16_t FreeSpaceMap::CategoryToBytes(uint8_t category) const {
-    return static_cast<uint16_t>(category) * GRANULARITY;
+    return static_cast<uint16_t>(category) * granularity_;
+}
+
+// ============================================================================
+// Page layout helpers
+// ============================================================================
+
+uint64_t FreeSpaceMap::Span(uint16_t level) const {
+    uint64_t span = leaf_slots_;
+    for (uint16_t l = 0; l < level && span <= UINT32_MAX; l++) span *= internal_slots_;
+    return span;
+}
+
+uint16_t FreeSpaceMap::Level(const char* data) {
+    uint16_t level;
+    std::memcpy(&level, data, sizeof(level));
+    return level;
+}
+
+page_id_t FreeSpaceMap::GetChild(const char* data, uint32_t slot) const {
+    page_id_t child;
+    std::memcpy(&child, data + HEADER_SIZE + internal_slots_ + slot * sizeof(page_id_t), sizeof(child));
+    return child;
+}
+
+void FreeSpaceMap::SetChild(char* data, uint32_t slot, page_id_t child) const {
+    std::memcpy(data + HEADER_SIZE + internal_slots_ + slot * sizeof(page_id_t), &child, sizeof(child));
+}
+
+void FreeSpaceMap::InitPage(char* data, uint16_t level) const {
+    std::memset(data, 0, page_size_);
+    std::memcpy(data, &level, sizeof(level));
+    if (level > 0) {
+        for (uint32_t slot = 0; slot < internal_slots_; slot++) SetChild(data, slot, INVALID_PAGE_ID);
+    }
+}
+
+uint8_t FreeSpaceMap::PageMax(page_id_t page_id, uint16_t level) {
+    Page* page = bpm_->FetchPage(page_id);
+    if (!page) return 0;
+    page->RLatch();
+    uint8_t max = 0;
+    if (Level(page->GetData()) == level) max = MaxCategory(Categories(page->GetData()), NumSlots(level));
+    page->RUnlatch();
+    bpm_->UnpinPage(page_id, false);
+    return max;
 }
 
 // ============================================================================
-// GetFSMLocation — map heap_page_id → (fsm_page_id, offset)
+// EnsureCovers — add levels above the root until heap_page fits
 // ============================================================================
 
-void FreeSpaceMap::GetFSMLocation(page_id_t heap_page_id, page_id_t* fsm_page_id, uint16_t* offset) const {
-    *fsm_page_id = fsm_start_page_ + (heap_page_id / entries_per_page_);
-    *offset = static_cast<uint16_t>(heap_page_id % entries_per_page_);
+void FreeSpaceMap::EnsureCovers(uint32_t heap_page) {
+    Page* root = bpm_->FetchPage(fsm_start_page_);
+    if (!root) throw std::runtime_error("FreeSpaceMap: Failed to fetch root page");
+    root->RLatch();
+    uint16_t level = Level(root->GetData());
+    root->RUnlatch();
+    if (heap_page < Span(level)) {
+        bpm_->UnpinPage(fsm_start_page_, false);
+        return;
+    }
+
+    std::lock_guard<std::mutex> grow(grow_mutex_);
+    root->WLatch();
+    level = Level(root->GetData());
+    while (heap_page >= Span(level)) {
+        // The root's page id is fixed, so its contents move down instead
+        page_id_t moved_id;
+        Page* moved = bpm_->NewPage(&moved_id);
+        if (!moved) {
+            root->WUnlatch();
+            bpm_->UnpinPage(fsm_start_page_, true);
+            throw std::runtime_error("FreeSpaceMap: Failed to allocate FSM page");
+        }
+        std::memcpy(moved->GetData(), root->GetData(), page_size_);
+        uint8_t max = MaxCategory(Categories(moved->GetData()), NumSlots(level));
+        bpm_->UnpinPage(moved_id, true);
+
+        level++;
+        InitPage(root->GetData(), level);
+        Categories(root->GetData())[0] = max;
+        SetChild(root->GetData(), 0, moved_id);
+    }
+    root->WUnlatch();
+    bpm_->UnpinPage(fsm_start_page_, true);
 }
 
 // ============================================================================
-// FindPageWithSpace — linear scan of FSM entries
+// FindPageWithSpace — descend through slots whose subtree has room
 // ============================================================================
 
-page_id_t FreeSpaceMap::FindPageWithSpace(uint16_t needed_bytes) {
-    uint8_t needed_cat = BytesToCategory(needed_bytes);
+uint64_t FreeSpaceMap::Search(page_id_t page_id, int level, uint64_t base, uint8_t need, uint64_t start) {
+    Page* page = bpm_->FetchPage(page_id);
+    if (!page) return NOT_FOUND;
+    page->RLatch();
+    char* data = page->GetData();
+    uint16_t page_level = Level(data);
+    // A child that is not at its parent's level was lost in a crash
+    if (level >= 0 && page_level != level) {
+        page->RUnlatch();
+        bpm_->UnpinPage(page_id, false);
+        return NOT_FOUND;
+    }
+
+    uint32_t n = NumSlots(page_level);
+    uint64_t child_span = page_level == 0 ? 1 : Span(page_level - 1);
+    uint32_t from = start > base ? static_cast<uint32_t>(std::min<uint64_t>((start - base) / child_span, n)) : 0;
 
-    // Scan FSM pages starting from the first
-    // We'll scan up to a reasonable limit (first FSM page should cover most cases)
-    Page* fsm_page = bpm_->FetchPage(fsm_start_page_);
-    if (!fsm_page) return INVALID_PAGE_ID;
+    if (page_level == 0) {
+        uint32_t slot = FindAtLeast(Categories(data), from, n, need);
+        page->RUnlatch();
+        bpm_->UnpinPage(page_id, false);
+        return slot < n ? base + slot : NOT_FOUND;
+    }
 
-    const uint8_t* data = reinterpret_cast<const uint8_t*>(fsm_page->GetData());
+    bool dirty = false;
+    uint64_t found = NOT_FOUND;
+    for (;;) {
+        uint32_t slot = FindAtLeast(Categories(data), from, n, need);
+        if (slot == n) break;
+        page_id_t child = GetChild(data, slot);
+        uint64_t child_base = base + slot * child_span;
+        page->RUnlatch();
 
-    for (uint16_t i = 0; i < entries_per_page_; ++i) {
-        if (data[i] >= needed_cat && data[i] > 0) {
-            bpm_->UnpinPage(fsm_start_page_, false);
-            return static_cast<page_id_t>(i);
+        if (child != INVALID_PAGE_ID) found = Search(child, page_level - 1, child_base, need, start);
+        if (found != NOT_FOUND) {
+            bpm_->UnpinPage(page_id, dirty);
+            return found;
         }
+
+        // The slot promised more than its subtree holds (or than it holds
+        // after start, which is no fault of the slot's)
+        page->WLatch();
+        if (child_base >= start && GetChild(data, slot) == child) {
+            Categories(data)[slot] =
+                child == INVALID_PAGE_ID ? 0 : PageMax(child, static_cast<uint16_t>(page_level - 1));
+            dirty = true;
+        }
+        page->WUnlatch();
+        page->RLatch();
+        from = slot + 1;
     }
+    page->RUnlatch();
+    bpm_->UnpinPage(page_id, dirty);
+    return NOT_FOUND;
+}
 
-    bpm_->UnpinPage(fsm_start_page_, false);
-    return INVALID_PAGE_ID;  // No page with enough space
+uint32_t FreeSpaceMap::FindPageWithSpace(uint16_t needed_bytes, uint32_t start) {
+    uint8_t need = NeededCategory(needed_bytes);
+    uint64_t found = Search(fsm_start_page_, -1, 0, need, start);
+    if (found == NOT_FOUND && start > 0) found = Search(fsm_start_page_, -1, 0, need, 0);
+    return found == NOT_FOUND || found >= NO_PAGE ? NO_PAGE : static_cast<uint32_t>(found);
 }
 
 // ============================================================================
-// UpdateFreeSpace — write the category for a heap page
+// UpdateFreeSpace — write the heap page's category, then carry the new
+// page maximum up the tree while it changes a parent's slot
 // ============================================================================
 
-void FreeSpaceMap::UpdateFreeSpace(page_id_t heap_page_id, uint16_t free_bytes) {
-    page_id_t fsm_page_id;
-    uint16_t offset;
-    GetFSMLocation(heap_page_id, &fsm_page_id, &offset);
+void FreeSpaceMap::UpdateFreeSpace(uint32_t heap_page, uint16_t free_bytes) {
+    EnsureCovers(heap_page);
+    uint8_t category = BytesToCategory(free_bytes);
+
+    // Internal pages passed on the way down, with the slot taken in each
+    std::vector<std::pair<page_id_t, uint32_t>> path;
+    page_id_t page_id = fsm_start_page_;
+    Page* page = bpm_->FetchPage(page_id);
+    if (!page) return;
+    page->RLatch();
+    bool dirty = false;
+    int expected = -1;  // The root's level is whatever it says
+
+    for (;;) {
+        char* data = page->GetData();
+        uint16_t level = Level(data);
+        if (expected >= 0 && level != expected) {
+            // Lost in a crash: start it over, empty
+            page->RUnlatch();
+            page->WLatch();
+            if (Level(data) != expected) InitPage(data, static_cast<uint16_t>(expected));
+            page->WUnlatch();
+            dirty = true;
+            page->RLatch();
+            continue;
+        }
+
+        if (level == 0) {
+            // Leaf: swap to the exclusive latch, making sure it stayed a leaf
+            page->RUnlatch();
+            page->WLatch();
+            if (Level(data) != 0) {
+                page->WUnlatch();
+                page->RLatch();
+                continue;
+            }
+            break;
+        }
+
+        uint32_t slot = static_cast<uint32_t>((heap_page % Span(level)) / Span(level - 1));
+        page_id_t child = GetChild(data, slot);
+        if (child == INVALID_PAGE_ID) {
+            page->RUnlatch();
+            {
+                std::lock_guard<std::mutex> grow(grow_mutex_);
+                page->WLatch();
+                if (GetChild(data, slot) == INVALID_PAGE_ID && Level(data) == level) {
+                    Page* child_page = bpm_->NewPage(&child);
+                    if (!child_page) {
+                        page->WUnlatch();
+                        bpm_->UnpinPage(page_id, dirty);
+                        throw std::runtime_error("FreeSpaceMap: Failed to allocate FSM page");
+                    }
+                    InitPage(child_page->GetData(), static_cast<uint16_t>(level - 1));
+                    bpm_->UnpinPage(child, true);
+                    SetChild(data, slot, child);
+                    dirty = true;
+                }
+                page->WUnlatch();
+            }
+            // Retry this page with the child in place
+            page->RLatch();
+            continue;
+        }
 
-    Page* fsm_page = bpm_->FetchPage(fsm_page_id);
-    if (!fsm_page) return;
+        // Crab down: latch the child before letting go of the parent
+        Page* child_page = bpm_->FetchPage(child);
+        if (!child_page) {
+            page->RUnlatch();
+            bpm_->UnpinPage(page_id, dirty);
+            return;
+        }
+        child_page->RLatch();
+        page->RUnlatch();
+        bpm_->UnpinPage(page_id, dirty);
+        path.emplace_back(page_id, slot);
+        page_id = child;
+        page = child_page;
+        dirty = false;
+        expected = level - 1;
+    }
 
-    uint8_t* data = reinterpret_cast<uint8_t*>(fsm_page->GetData());
-    data[offset] = BytesToCategory(free_bytes);
+    // Leaf, exclusively latched
+    Categories(page->GetData())[heap_page % leaf_slots_] = category;
+    page->WUnlatch();
+    bpm_->UnpinPage(page_id, true);
 
-    bpm_->UnpinPage(fsm_page_id, true);  // Dirty
+    // Each parent slot is set from its child's current maximum, read under
+    // the parent's latch, so racing updates cannot leave it behind
+    page_id_t child_id = page_id;
+    for (size_t i = path.size(); i-- > 0;) {
+        auto [parent_id, slot] = path[i];
+        Page* parent = bpm_->FetchPage(parent_id);
+        if (!parent) return;
+        parent->WLatch();
+        uint8_t max = PageMax(child_id, static_cast<uint16_t>(path.size() - 1 - i));
+        uint8_t* parent_cats = Categories(parent->GetData());
+        bool changed = parent_cats[slot] != max;
+        if (changed) parent_cats[slot] = max;
+        parent->WUnlatch();
+        bpm_->UnpinPage(parent_id, changed);
+        if (!changed) return;
+        child_id = parent_id;
+    }
 }
 
 // ============================================================================
 // RegisterNewPage — same as UpdateFreeSpace but semantically distinct
 // ============================================================================
 
-void FreeSpaceMap::RegisterNewPage(page_id_t heap_page_id, uint16_t free_bytes) {
-    UpdateFreeSpace(heap_page_id, free_bytes);
+void FreeSpaceMap::RegisterNewPage(uint32_t heap_page, uint16_t free_bytes) {
+    UpdateFreeSpace(heap_page, free_bytes);
 }
@@ -3,52 +3,103 @@
 #include "storage_engine/common/common.h"
 #include "storage_engine/buffer/buffer_pool.h"
 #include <cstdint>
+#include <mutex>
 #include <vector>
 
 // ============================================================================
 // Free Space Map (FSM)
 //
 // Stores one byte per heap page indicating approximate free space.
-// Value 0-255 maps to 0–4080 bytes free (in 16-byte granularity).
-// FSM data is stored in dedicated page(s) managed by the buffer pool.
+// Value 0-255 maps to 0..page_size free, in page_size/256-byte steps
+// (16 bytes for 4 KB pages, 128 bytes for 32 KB pages). Heap pages are
+// named by their index within the heap (HeapFile maps indexes to page ids).
+//
+// The map is a tree of FSM pages, in the spirit of PostgreSQL's FSM:
+//   - Leaf pages (level 0) hold the category byte of each heap page.
+//   - An internal page at level L holds, per child, the highest category
+//     found below it, plus the child's page id.
+//   - The root is always fsm_start_page; when a heap page falls outside
+//     it, its contents move to a new page that becomes the root's first
+//     child. Missing children are created when first written.
 //
 // Layout of an FSM page:
-//   Byte 0: free-space category for heap page 0
-//   Byte 1: free-space category for heap page 1
-//   ...
-//   One FSM page can track up to PAGE_SIZE heap pages.
+//   [16 bytes] header: uint16 level, rest reserved
+//   Leaf:     page_size - 16 category bytes
+//   Internal: internal_slots category bytes, then internal_slots child ids
+//
+// A zeroed page is an empty leaf, so a fresh collection needs only a
+// zeroed fsm_start_page. Upper levels may go stale under concurrent
+// updates; a search that finds less below a slot than the slot promised
+// lowers the slot and moves on. Like the rest of the map, a stale entry
+// only costs callers a retry: they re-check the page itself.
+//
+// Pages are read under their shared latch and changed under their
+// exclusive latch, one page at a time or parent before child. grow_mutex_
+// serializes adding pages to the tree.
 // ============================================================================
 
 class FreeSpaceMap {
 public:
-    // fsm_start_page: the page_id of the first FSM page in the file
-    FreeSpaceMap(BufferPoolManager* bpm, page_id_t fsm_start_page, uint16_t page_size = 4096);
+    static constexpr uint32_t NO_PAGE = UINT32_MAX;
 
-    // Find a page with at least `needed_bytes` free. Returns INVALID_PAGE_ID if none found.
-    page_id_t FindPageWithSpace(uint16_t needed_bytes);
+    // fsm_start_page: the page_id of the root FSM page
+    FreeSpaceMap(BufferPoolManager* bpm, page_id_t fsm_start_page);
+
+    // Find a heap page with at least `needed_bytes` free: the first at or
+    // after `start`, else the first before it. Returns NO_PAGE if none.
+    uint32_t FindPageWithSpace(uint16_t needed_bytes, uint32_t start = 0);
 
     // Update the free space record for a given heap page.
-    void UpdateFreeSpace(page_id_t heap_page_id, uint16_t free_bytes);
+    void UpdateFreeSpace(uint32_t heap_page, uint16_t free_bytes);
 
     // Register a newly allocated heap page in the FSM.
-    void RegisterNewPage(page_id_t heap_page_id, uint16_t free_bytes);
+    void RegisterNewPage(uint32_t heap_page, uint16_t free_bytes);
 
     // Get the FSM start page
     page_id_t GetStartPage() const { return fsm_start_page_; }
 
+    // Heap pages one leaf page tracks, and children per internal page
+    uint32_t GetLeafSlots() const { return leaf_slots_; }
+    uint32_t GetInternalSlots() const { return internal_slots_; }
+
 private:
-    // Convert free bytes to a category byte (0-255)
+    static constexpr size_t HEADER_SIZE = 16;
+    static constexpr uint64_t NOT_FOUND = UINT64_MAX;
+
+    // Convert free bytes to a category byte (0-255), rounding down
     uint8_t BytesToCategory(uint16_t free_bytes) const;
 
+    // Smallest category that guarantees needed_bytes (at least 1)
+    uint8_t NeededCategory(uint16_t needed_bytes) const;
+
     // Convert category byte back to minimum free bytes
     uint16_t CategoryToBytes(uint8_t category) const;
 
-    // Get which FSM page and offset within it for a given heap_page_id
-    void GetFSMLocation(page_id_t heap_page_id, page_id_t* fsm_page_id, uint16_t* offset) const;
+    // Heap pages covered by one FSM page at level
+    uint64_t Span(uint16_t level) const;
+
+    uint32_t NumSlots(uint16_t level) const { return level == 0 ? leaf_slots_ : internal_slots_; }
+    static uint16_t Level(const char* data);
+    static uint8_t* Categories(char* data) { return reinterpret_cast<uint8_t*>(data + HEADER_SIZE); }
+    page_id_t GetChild(const char* data, uint32_t slot) const;
+    void SetChild(char* data, uint32_t slot, page_id_t child) const;
+    void InitPage(char* data, uint16_t level) const;
+
+    // Highest category recorded on a page (0 if it is not at level)
+    uint8_t PageMax(page_id_t page_id, uint16_t level);
+
+    // Grow the tree upward until the root covers heap_page
+    void EnsureCovers(uint32_t heap_page);
+
+    // Leftmost heap page >= start with category >= need in the subtree at
+    // page_id, whose first heap page is base
+    uint64_t Search(page_id_t page_id, int level, uint64_t base, uint8_t need, uint64_t start);
 
     BufferPoolManager* bpm_;
     page_id_t fsm_start_page_;
-    uint16_t page_size_;
-    uint16_t entries_per_page_;  // How many heap pages one FSM page tracks
-    static constexpr uint16_t GRANULARITY = 16;  // 16-byte granularity
+    uint32_t page_size_;
+    uint32_t leaf_slots_;
+    uint32_t internal_slots_;
+    uint16_t granularity_;       // Bytes per category step
+    std::mutex grow_mutex_;
 };
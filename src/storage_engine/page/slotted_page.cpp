@@ -1,6 +1,7 @@
 #include "slotted_page.h"
 #include <iostream>
 #include <algorithm>
+#include <vector>
 
 // ============================================================================
 // Helper accessors
@@ -32,7 +33,8 @@ void SlottedPage::Init(char* page_data, uint16_t page_size) {
     header->num_slots = 0;
     header->free_space_begin = sizeof(PageHeader);  // Right after header
     header->free_space_end = page_size;              // End of page
-    header->reserved = 0;
+    header->fragmented_bytes = 0;
+    header->page_lsn = -1;
 }
 
 // ============================================================================
@@ -40,6 +42,14 @@ void SlottedPage::Init(char* page_data, uint16_t page_size) {
 // ============================================================================
 
 int16_t SlottedPage::InsertRecord(char* page_data, const uint8_t* record, uint16_t record_len) {
+    int16_t slot_id;
+    uint8_t* dst = ReserveRecord(page_data, record_len, &slot_id);
+    if (!dst) return -1;
+    std::memcpy(dst, record, record_len);
+    return slot_id;
+}
+
+uint8_t* SlottedPage::ReserveRecord(char* page_data, uint16_t record_len, int16_t* slot_id) {
     PageHeader* header = GetHeader(page_data);
 
     // Check if we need a new slot or can reuse a deleted one
@@ -58,14 +68,13 @@ int16_t SlottedPage::InsertRecord(char* page_data, const uint8_t* record, uint16
         space_needed += sizeof(SlotEntry);
     }
 
-    // Check free space
-    if (header->free_space_end - header->free_space_begin < space_needed) {
-        return -1;  // Not enough space
+    // Check free space (holes count: compaction reclaims them)
+    if (!EnsureContiguous(page_data, space_needed)) {
+        return nullptr;  // Not enough space
     }
 
-    // Write record data from end of page backwards
+    // Record data grows from the end of the page backwards
     header->free_space_end -= record_len;
-    std::memcpy(page_data + header->free_space_end, record, record_len);
 
     if (target_slot == -1) {
         // Allocate new slot at end of slot directory
@@ -79,7 +88,62 @@ int16_t SlottedPage::InsertRecord(char* page_data, const uint8_t* record, uint16
     slot->offset = header->free_space_end;
     slot->length = record_len;
 
-    return target_slot;
+    *slot_id = target_slot;
+    return reinterpret_cast<uint8_t*>(page_data + header->free_space_end);
+}
+
+// ============================================================================
+// Compact / EnsureContiguous / TrimSlots — reclaim dead space
+// ============================================================================
+
+void SlottedPage::Compact(char* page_data) {
+    PageHeader* header = GetHeader(page_data);
+
+    // Live slots, highest record first: each record only ever moves toward
+    // the page end, over bytes already moved or dead
+    std::vector<uint16_t> live;
+    uint32_t live_bytes = 0;
+    uint32_t live_end = header->free_space_end;
+    for (uint16_t i = 0; i < header->num_slots; ++i) {
+        const SlotEntry* slot = GetSlotEntry(page_data, i);
+        if (slot->length > 0) {
+            live.push_back(i);
+            live_bytes += slot->length;
+            live_end = std::max<uint32_t>(live_end, slot->offset + slot->length);
+        }
+    }
+    std::sort(live.begin(), live.end(), [page_data](uint16_t a, uint16_t b) {
+        return GetSlotEntry(page_data, a)->offset > GetSlotEntry(page_data, b)->offset;
+    });
+
+    // The record area ends at the page end; never below the last record,
+    // which would make records move down over ones not yet moved
+    uint32_t end = std::max(header->free_space_end + live_bytes + header->fragmented_bytes, live_end);
+    for (uint16_t i : live) {
+        SlotEntry* slot = GetSlotEntry(page_data, i);
+        end -= slot->length;
+        if (end != slot->offset) std::memmove(page_data + end, page_data + slot->offset, slot->length);
+        slot->offset = static_cast<uint16_t>(end);
+    }
+    header->free_space_end = static_cast<uint16_t>(end);
+    header->fragmented_bytes = 0;
+}
+
+bool SlottedPage::EnsureContiguous(char* page_data, uint16_t needed) {
+    PageHeader* header = GetHeader(page_data);
+    uint32_t contiguous = header->free_space_end - header->free_space_begin;
+    if (contiguous >= needed) return true;
+    if (contiguous + header->fragmented_bytes < needed) return false;
+    Compact(page_data);
+    return true;
+}
+
+void SlottedPage::TrimSlots(char* page_data) {
+    PageHeader* header = GetHeader(page_data);
+    while (header->num_slots > 0 && GetSlotEntry(page_data, header->num_slots - 1)->length == 0) {
+        header->num_slots--;
+        header->free_space_begin -= sizeof(SlotEntry);
+    }
 }
 
 // ============================================================================
@@ -98,9 +162,11 @@ bool SlottedPage::DeleteRecord(char* page_data, uint16_t slot_id) {
         return false;  // Already deleted
     }
 
-    // Mark as deleted (we don't compact here — space is reclaimed lazily)
+    // Mark as deleted; the bytes become a hole for the next compaction
+    header->fragmented_bytes += slot->length;
     slot->length = 0;
     slot->offset = 0;
+    TrimSlots(page_data);
 
     return true;
 }
@@ -128,30 +194,96 @@ const uint8_t* SlottedPage::GetRecord(const char* page_data, uint16_t slot_id, u
 }
 
 // ============================================================================
-// UpdateRecord — in-place update (only if new data fits)
+// UpdateRecord / ResizeRecord — replace a record, keeping its slot
 // ============================================================================
 
 bool SlottedPage::UpdateRecord(char* page_data, uint16_t slot_id, const uint8_t* record, uint16_t record_len) {
+    uint8_t* dst = ResizeRecord(page_data, slot_id, record_len);
+    if (!dst) return false;
+    std::memmove(dst, record, record_len);
+    return true;
+}
+
+uint8_t* SlottedPage::ResizeRecord(char* page_data, uint16_t slot_id, uint16_t record_len) {
     PageHeader* header = GetHeader(page_data);
 
-    if (slot_id >= header->num_slots) {
-        return false;
+    if (slot_id >= header->num_slots || record_len == 0) {
+        return nullptr;
     }
 
     SlotEntry* slot = GetSlotEntry(page_data, slot_id);
     if (slot->length == 0) {
-        return false;  // Deleted slot
+        return nullptr;  // Deleted slot
     }
 
     if (record_len <= slot->length) {
-        // Fits in existing space — overwrite in place
-        std::memcpy(page_data + slot->offset, record, record_len);
+        // Fits in existing space — the tail becomes a hole
+        header->fragmented_bytes += slot->length - record_len;
         slot->length = record_len;
-        return true;
+        return reinterpret_cast<uint8_t*>(page_data + slot->offset);
     }
 
-    // Doesn't fit — caller should delete + re-insert
-    return false;
+    // Grow: the old bytes count as free, so drop them before looking
+    uint32_t available = GetFreeSpace(page_data) + slot->length;
+    if (available < record_len) {
+        return nullptr;
+    }
+    header->fragmented_bytes += slot->length;
+    slot->length = 0;
+    slot->offset = 0;
+    EnsureContiguous(page_data, record_len);
+
+    header->free_space_end -= record_len;
+    slot->offset = header->free_space_end;
+    slot->length = record_len;
+    return reinterpret_cast<uint8_t*>(page_data + slot->offset);
+}
+
+// ============================================================================
+// PutRecordAt — slot-exact placement for redo/undo
+// ============================================================================
+
+bool SlottedPage::PutRecordAt(char* page_data, uint16_t slot_id, const uint8_t* record,
+                              uint16_t record_len, uint16_t page_size) {
+    PageHeader* header = GetHeader(page_data);
+
+    // A page that was allocated but never written back reads as zeros
+    if (header->free_space_end == 0) {
+        Init(page_data, page_size);
+    }
+
+    if (slot_id < header->num_slots) {
+        SlotEntry* slot = GetSlotEntry(page_data, slot_id);
+        if (slot->length != 0) {
+            uint8_t* dst = ResizeRecord(page_data, slot_id, record_len);
+            if (!dst) return false;
+            std::memcpy(dst, record, record_len);
+            return true;
+        }
+    }
+
+    // Grow the slot directory up to slot_id (new slots start out empty)
+    uint16_t new_slots = slot_id >= header->num_slots ? slot_id + 1 - header->num_slots : 0;
+    uint16_t space_needed = record_len + new_slots * sizeof(SlotEntry);
+    if (!EnsureContiguous(page_data, space_needed)) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < new_slots; ++i) {
+        SlotEntry* slot = GetSlotEntry(page_data, header->num_slots);
+        slot->offset = 0;
+        slot->length = 0;
+        header->num_slots++;
+        header->free_space_begin += sizeof(SlotEntry);
+    }
+
+    header->free_space_end -= record_len;
+    std::memcpy(page_data + header->free_space_end, record, record_len);
+
+    SlotEntry* slot = GetSlotEntry(page_data, slot_id);
+    slot->offset = header->free_space_end;
+    slot->length = record_len;
+    return true;
 }
 
 // ============================================================================
@@ -161,9 +293,9 @@ bool SlottedPage::UpdateRecord(char* page_data, uint16_t slot_id, const uint8_t*
 uint16_t SlottedPage::GetFreeSpace(const char* page_data) {
     const PageHeader* header = GetHeader(page_data);
     if (header->free_space_end <= header->free_space_begin) {
-        return 0;
+        return header->fragmented_bytes;
     }
-    return header->free_space_end - header->free_space_begin;
+    return header->free_space_end - header->free_space_begin + header->fragmented_bytes;
 }
 
 // ============================================================================
@@ -185,3 +317,18 @@ bool SlottedPage::IsSlotOccupied(const char* page_data, uint16_t slot_id) {
     }
     return GetSlotEntry(page_data, slot_id)->length > 0;
 }
+
+// ============================================================================
+// pageLSN
+// ============================================================================
+
+int64_t SlottedPage::GetPageLSN(const char* page_data) {
+    const PageHeader* header = GetHeader(page_data);
+    // A page that was allocated but never written back reads as zeros
+    if (header->free_space_end == 0) return -1;
+    return header->page_lsn;
+}
+
+void SlottedPage::SetPageLSN(char* page_data, int64_t lsn) {
+    GetHeader(page_data)->page_lsn = lsn;
+}
@@ -17,6 +17,10 @@ struct RecordID {
         return page_id == other.page_id && slot_id == other.slot_id;
     }
     bool operator!=(const RecordID& other) const { return !(*this == other); }
+    bool operator<(const RecordID& other) const {
+        if (page_id != other.page_id) return page_id < other.page_id;
+        return slot_id < other.slot_id;
+    }
     bool IsValid() const { return page_id != INVALID_PAGE_ID; }
 };
 
@@ -26,7 +30,7 @@ const RecordID INVALID_RECORD_ID = {INVALID_PAGE_ID, 0};
 // Slotted Page Layout
 //
 //  +---------------------------------------------------+
-//  | PageHeader (8 bytes)                               |
+//  | PageHeader (16 bytes)                              |
 //  +---------------------------------------------------+
 //  | Slot Directory (grows downward →)                  |
 //  |   SlotEntry[0], SlotEntry[1], ...                  |
@@ -38,6 +42,13 @@ const RecordID INVALID_RECORD_ID = {INVALID_PAGE_ID, 0};
 //
 // Records grow from the END of the page backwards.
 // Slot directory grows from AFTER the header forwards.
+//
+// Deleting or shrinking a record leaves a hole in the record area; the
+// header counts those bytes (fragmented_bytes) and free space includes
+// them. When a record does not fit in the contiguous gap, Compact() slides
+// the live records back together first. Deleted slots are reused before
+// the directory grows, and dead slots at its end are dropped. Slot ids of
+// live records never change.
 // ============================================================================
 
 struct SlotEntry {
@@ -49,10 +60,11 @@ struct PageHeader {
     uint16_t num_slots;         // Total slots (including deleted)
     uint16_t free_space_begin;  // Offset where slot directory ends (first free byte after slots)
     uint16_t free_space_end;    // Offset where record data begins (first used byte from the end)
-    uint16_t reserved;          // For alignment / future use
+    uint16_t fragmented_bytes;  // Dead record bytes between free_space_end and the page end
+    int64_t page_lsn;           // LSN of the newest logged change applied (-1 = none)
 };
 
-static_assert(sizeof(PageHeader) == 8, "PageHeader must be 8 bytes");
+static_assert(sizeof(PageHeader) == 16, "PageHeader must be 16 bytes");
 static_assert(sizeof(SlotEntry) == 4, "SlotEntry must be 4 bytes");
 
 // ============================================================================
@@ -61,11 +73,15 @@ static_assert(sizeof(SlotEntry) == 4, "SlotEntry must be 4 bytes");
 class SlottedPage {
 public:
     // Initialize a fresh page (call once on newly allocated pages)
-    static void Init(char* page_data, uint16_t page_size = 4096);
+    static void Init(char* page_data, uint16_t page_size);
 
     // Insert a record. Returns the slot_id, or -1 if not enough space.
     static int16_t InsertRecord(char* page_data, const uint8_t* record, uint16_t record_len);
 
+    // Allocate a slot of record_len bytes and return where the record goes,
+    // for callers that write it in place (nullptr if not enough space)
+    static uint8_t* ReserveRecord(char* page_data, uint16_t record_len, int16_t* slot_id);
+
     // Delete a record by slot_id. Returns true on success.
     static bool DeleteRecord(char* page_data, uint16_t slot_id);
 
@@ -73,10 +89,25 @@ public:
     // Returns nullptr if slot is deleted or invalid.
     static const uint8_t* GetRecord(const char* page_data, uint16_t slot_id, uint16_t* out_len);
 
-    // Update a record in place (only if new data fits in the same slot)
+    // Replace a record, keeping its slot. Grows into free space (compacting
+    // if need be); returns false if the page cannot hold the new record.
     static bool UpdateRecord(char* page_data, uint16_t slot_id, const uint8_t* record, uint16_t record_len);
 
-    // Get available free space in bytes
+    // Give a live slot record_len bytes and return where they go. The old
+    // contents are lost unless the record shrinks. nullptr if it cannot fit.
+    static uint8_t* ResizeRecord(char* page_data, uint16_t slot_id, uint16_t record_len);
+
+    // Pack the live records against the page end, reclaiming every hole
+    static void Compact(char* page_data);
+
+    // Place a record at exactly `slot_id`, growing the slot directory if needed
+    // and overwriting whatever the slot held. Used by recovery so that replaying
+    // a logged insert/update lands on the logged RecordID. Returns false if the
+    // page has no room.
+    static bool PutRecordAt(char* page_data, uint16_t slot_id, const uint8_t* record,
+                            uint16_t record_len, uint16_t page_size);
+
+    // Get available free space in bytes, holes included
     static uint16_t GetFreeSpace(const char* page_data);
 
     // Get number of slots (including deleted)
@@ -85,9 +116,21 @@ public:
     // Check if a slot is occupied (not deleted)
     static bool IsSlotOccupied(const char* page_data, uint16_t slot_id);
 
+    // pageLSN: set with each logged change, compared by redo so replay is
+    // idempotent
+    static int64_t GetPageLSN(const char* page_data);
+    static void SetPageLSN(char* page_data, int64_t lsn);
+
 private:
     static PageHeader* GetHeader(char* page_data);
     static const PageHeader* GetHeader(const char* page_data);
     static SlotEntry* GetSlotEntry(char* page_data, uint16_t slot_id);
     static const SlotEntry* GetSlotEntry(const char* page_data, uint16_t slot_id);
+
+    // Make the contiguous gap at least `needed` bytes, compacting if the
+    // holes make up the difference. False if even that is not enough.
+    static bool EnsureContiguous(char* page_data, uint16_t needed);
+
+    // Drop dead slots from the end of the directory
+    static void TrimSlots(char* page_data);
 };
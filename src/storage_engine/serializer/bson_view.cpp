@@ -0,0 +1,157 @@
+#include "bson_view.h"
+#include "serializer.h"
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+// ============================================================================
+// BsonElementView
+// ============================================================================
+
+int32_t BsonElementView::AsInt32() const {
+    int32_t v;
+    std::memcpy(&v, value, sizeof(v));
+    return v;
+}
+
+int64_t BsonElementView::AsInt64() const {
+    int64_t v;
+    std::memcpy(&v, value, sizeof(v));
+    return v;
+}
+
+double BsonElementView::AsDouble() const {
+    double v;
+    std::memcpy(&v, value, sizeof(v));
+    return v;
+}
+
+std::string_view BsonElementView::AsString() const {
+    // [int32 length incl. terminator][bytes][0x00]
+    return std::string_view(reinterpret_cast<const char*>(value + sizeof(int32_t)),
+                            value_size - sizeof(int32_t) - 1);
+}
+
+BsonView BsonElementView::AsDocument() const {
+    return BsonView(value, value_size);
+}
+
+BsonValue BsonElementView::ToValue() const {
+    switch (type) {
+        case BsonType::INT32: return AsInt32();
+        case BsonType::INT64: return AsInt64();
+        case BsonType::DOUBLE: return AsDouble();
+        case BsonType::BOOLEAN: return AsBool();
+        case BsonType::STRING: return std::string(AsString());
+        case BsonType::DOCUMENT:
+        case BsonType::ARRAY: {
+            auto doc = std::make_shared<BsonDocument>(AsDocument().ToDocument());
+            doc->is_array = type == BsonType::ARRAY;
+            return doc;
+        }
+        default: return nullptr;
+    }
+}
+
+// ============================================================================
+// BsonView
+// ============================================================================
+
+BsonView::BsonView(const uint8_t* data, size_t size, const BsonExternalResolver* resolver)
+    : data_(data), resolver_(resolver) {
+    int32_t doc_size;
+    if (size < sizeof(doc_size) + 1) throw std::runtime_error("Corrupted BSON: Size mismatch");
+    std::memcpy(&doc_size, data, sizeof(doc_size));
+    if (doc_size < static_cast<int32_t>(sizeof(doc_size) + 1) || static_cast<size_t>(doc_size) > size) {
+        throw std::runtime_error("Corrupted BSON: Size mismatch");
+    }
+    size_ = static_cast<size_t>(doc_size);
+}
+
+bool BsonView::NextElement(size_t* offset, BsonElementView* out) const {
+    size_t pos = *offset;
+    if (pos >= size_ - 1) return false;  // At the document's terminator
+
+    uint8_t type_byte = data_[pos++];
+    if (type_byte == 0x00) return false;
+
+    const char* key = reinterpret_cast<const char*>(data_ + pos);
+    const void* key_end = std::memchr(key, 0, size_ - pos);
+    if (!key_end) throw std::runtime_error("Corrupted BSON: unterminated key");
+    size_t key_len = static_cast<const char*>(key_end) - key;
+    pos += key_len + 1;
+
+    size_t value_size;
+    switch (static_cast<BsonType>(type_byte)) {
+        case BsonType::INT32: value_size = sizeof(int32_t); break;
+        case BsonType::INT64: value_size = sizeof(int64_t); break;
+        case BsonType::DOUBLE: value_size = sizeof(double); break;
+        case BsonType::BOOLEAN: value_size = 1; break;
+        case BsonType::NULL_TYPE: value_size = 0; break;
+        case BsonType::EXTERNAL: value_size = BSON_EXTERNAL_SIZE; break;
+        case BsonType::STRING:
+        case BsonType::DOCUMENT:
+        case BsonType::ARRAY: {
+            // Both lead with an int32: the string's length after it, or the
+            // sub-document's whole length
+            int32_t len;
+            if (pos + sizeof(len) > size_) throw std::runtime_error("Corrupted BSON: Size mismatch");
+            std::memcpy(&len, data_ + pos, sizeof(len));
+            if (len < 1) throw std::runtime_error("Corrupted BSON: Size mismatch");
+            value_size = static_cast<BsonType>(type_byte) == BsonType::STRING ? sizeof(len) + len : len;
+            break;
+        }
+        default:
+            throw std::runtime_error("Unknown BSON Type: " + std::to_string(type_byte));
+    }
+    if (pos + value_size > size_) throw std::runtime_error("Corrupted BSON: Size mismatch");
+
+    out->type = static_cast<BsonType>(type_byte);
+    out->key = std::string_view(key, key_len);
+    out->value = data_ + pos;
+    out->value_size = value_size;
+    *offset = pos + value_size;
+    return true;
+}
+
+bool BsonView::Find(std::string_view key, BsonElementView* out) const {
+    size_t offset = sizeof(int32_t);
+    while (NextElement(&offset, out)) {
+        if (out->key == key) {
+            if (out->type == BsonType::EXTERNAL && resolver_) *out = (*resolver_)(*out);
+            return true;
+        }
+    }
+    return false;
+}
+
+BsonDocument BsonView::ToDocument() const {
+    return BsonSerializer::Deserialize(data_, size_, resolver_);
+}
+
+void BsonView::CopyTo(std::vector<uint8_t>* out) const {
+    size_t offset = sizeof(int32_t);
+    BsonElementView element;
+    while (NextElement(&offset, &element)) {
+        if (element.type == BsonType::EXTERNAL) {
+            BsonSerializer::SerializeTo(ToDocument(), out);
+            return;
+        }
+    }
+    out->assign(data_, data_ + size_);
+}
+
+void BsonView::CopyFields(const std::function<bool(std::string_view key)>& keep, std::vector<uint8_t>* out) const {
+    out->assign(sizeof(int32_t), 0);
+    size_t offset = sizeof(int32_t);
+    BsonElementView element;
+    while (NextElement(&offset, &element)) {
+        if (!keep(element.key)) continue;
+        // [type][key\0][value]: the key sits right after its type byte
+        const uint8_t* start = reinterpret_cast<const uint8_t*>(element.key.data()) - 1;
+        out->insert(out->end(), start, element.value + element.value_size);
+    }
+    out->push_back(0x00);
+    int32_t size = static_cast<int32_t>(out->size());
+    std::memcpy(out->data(), &size, sizeof(size));
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "storage_engine/common/bson_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+class BsonView;
+
+// ============================================================================
+// BsonElementView — one element of a serialized document, read in place
+//
+// The As*() accessors assume the matching type(); string and document
+// values point into the viewed buffer, so they live only as long as it.
+// ============================================================================
+
+struct BsonElementView {
+    BsonType type;
+    std::string_view key;
+    const uint8_t* value;  // Start of the value bytes
+    size_t value_size;
+
+    int32_t AsInt32() const;
+    int64_t AsInt64() const;
+    double AsDouble() const;
+    bool AsBool() const { return value[0] == 0x01; }
+    std::string_view AsString() const;  // Without the terminator
+    BsonView AsDocument() const;
+
+    // Materialize the value (decodes nested documents in full)
+    BsonValue ToValue() const;
+};
+
+// Turns a BsonType::EXTERNAL element into the value it stands for. The
+// returned view's bytes belong to the resolver (HeapFile reads them from
+// its overflow pages) and last until its next call on the same thread.
+using BsonExternalResolver = std::function<BsonElementView(const BsonElementView&)>;
+
+// ============================================================================
+// BsonView — read-only access to a serialized document (BsonSerializer's
+// format) without decoding it
+//
+// Find() walks the element list, skipping values by their encoded sizes,
+// so looking up one field allocates nothing. Scans evaluate filters on a
+// view over the record bytes in the pinned page and only deserialize the
+// documents that pass. Malformed input throws std::runtime_error, as
+// BsonSerializer::Deserialize does.
+//
+// Given a resolver, Find() and ForEach() hand out values stored out of
+// line as the values themselves, fetched only when looked at.
+//
+// An ARRAY is laid out as a document keyed "0", "1", ... and is walked as
+// one.
+// ============================================================================
+
+class BsonView {
+public:
+    BsonView(const uint8_t* data, size_t size, const BsonExternalResolver* resolver = nullptr);
+
+    // Locate a top-level field. Returns false if the document lacks it.
+    bool Find(std::string_view key, BsonElementView* out) const;
+
+    // Visit every element in stored order; stop early by returning false
+    template <typename F>
+    void ForEach(F&& visit) const {
+        size_t offset = sizeof(int32_t);
+        BsonElementView element;
+        while (NextElement(&offset, &element)) {
+            if (element.type == BsonType::EXTERNAL && resolver_) element = (*resolver_)(element);
+            if (!visit(element)) return;
+        }
+    }
+
+    BsonDocument ToDocument() const;
+
+    // Replace *out with the document's bytes: a plain copy, unless values
+    // stored out of line have to be fetched back in and the whole
+    // document re-encoded
+    void CopyTo(std::vector<uint8_t>* out) const;
+
+    // Replace *out with a document of just the elements keep accepts (by
+    // key), each copied as it is stored. Out-of-line values stay stubs:
+    // use on bytes CopyTo produced.
+    void CopyFields(const std::function<bool(std::string_view key)>& keep, std::vector<uint8_t>* out) const;
+
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+    // Decode the element at *offset and advance past it; false at the end
+    bool NextElement(size_t* offset, BsonElementView* out) const;
+
+    const uint8_t* data_;
+    size_t size_;  // The document's own length, from its header
+    const BsonExternalResolver* resolver_;
+};
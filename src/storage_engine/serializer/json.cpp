@@ -0,0 +1,458 @@
+#include "json.h"
+#include "serializer.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+// ============================================================================
+// Parser — one pass over the text, BSON appended as it goes
+// ============================================================================
+
+static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+class JsonParser {
+public:
+    JsonParser(std::string_view text, std::vector<uint8_t>* out) : s_(text), out_(out) {}
+
+    bool Run() {
+        out_->clear();
+        out_->reserve(s_.size() + 16);  // BSON runs about as long as the text
+        SkipSpace();
+        char open = Peek();
+        if (open != '{' && open != '[') Fail("expected '{' or '['");
+        Container(0);
+        SkipSpace();
+        if (pos_ != s_.size()) Fail("unexpected text after the document");
+        return open == '[';
+    }
+
+private:
+    [[noreturn]] void Fail(const char* what) const {
+        throw std::runtime_error("Invalid JSON at offset " + std::to_string(pos_) + ": " + what);
+    }
+
+    char Peek() const { return pos_ < s_.size() ? s_[pos_] : '\0'; }
+
+    void SkipSpace() {
+        while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\n' || s_[pos_] == '\r')) {
+            pos_++;
+        }
+    }
+
+    void Append(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out_->insert(out_->end(), bytes, bytes + size);
+    }
+
+    // Reserve an int32 to patch once its value is known; returns where
+    size_t ReserveInt32() {
+        size_t at = out_->size();
+        out_->resize(at + sizeof(int32_t));
+        return at;
+    }
+
+    void PatchInt32(size_t at, size_t value) {
+        int32_t v = static_cast<int32_t>(value);
+        std::memcpy(out_->data() + at, &v, sizeof(v));
+    }
+
+    // The keys of one object so far, to refuse a repeat: the first few by
+    // where they sit in *out_, compared in place; past that, in a hash set
+    static constexpr size_t FEW_KEYS = 8;
+    struct ObjectKeys {
+        std::array<std::pair<size_t, size_t>, FEW_KEYS> few;  // Offset, length
+        size_t count = 0;
+        std::unordered_set<std::string> many;
+    };
+
+    std::string_view KeyAt(size_t at, size_t len) const {
+        return std::string_view(reinterpret_cast<const char*>(out_->data()) + at, len);
+    }
+
+    void AddKey(ObjectKeys& keys, size_t at, size_t len) {
+        std::string_view key = KeyAt(at, len);
+        if (keys.count < FEW_KEYS) {
+            for (size_t i = 0; i < keys.count; i++) {
+                if (KeyAt(keys.few[i].first, keys.few[i].second) == key) Fail("duplicate key");
+            }
+            keys.few[keys.count++] = {at, len};
+            return;
+        }
+        if (keys.many.empty()) {
+            for (const auto& [few_at, few_len] : keys.few) keys.many.emplace(KeyAt(few_at, few_len));
+        }
+        if (!keys.many.emplace(key).second) Fail("duplicate key");
+    }
+
+    // An object or array at pos_: [int32 length][elements][0x00]
+    void Container(size_t depth) {
+        if (depth >= Json::MAX_DEPTH) Fail("nested too deeply");
+        const bool array = s_[pos_++] == '[';
+        const char close = array ? ']' : '}';
+        size_t start = ReserveInt32();
+        ObjectKeys keys;
+
+        SkipSpace();
+        if (Peek() == close) {
+            pos_++;
+        } else {
+            for (uint32_t index = 0;; index++) {
+                size_t type_at = out_->size();
+                out_->push_back(0x00);  // The type, known once the value is read
+                if (array) {
+                    char digits[16];
+                    auto result = std::to_chars(digits, digits + sizeof(digits), index);
+                    Append(digits, result.ptr - digits);
+                } else {
+                    if (Peek() != '"') Fail("expected a key");
+                    size_t key_at = out_->size();
+                    String();
+                    if (std::memchr(out_->data() + key_at, 0, out_->size() - key_at)) Fail("key holds a NUL");
+                    AddKey(keys, key_at, out_->size() - key_at);
+                    SkipSpace();
+                    if (Peek() != ':') Fail("expected ':'");
+                    pos_++;
+                    SkipSpace();
+                }
+                out_->push_back(0x00);  // The key's terminator
+                (*out_)[type_at] = static_cast<uint8_t>(Value(depth));
+
+                SkipSpace();
+                if (Peek() == ',') {
+                    pos_++;
+                    SkipSpace();
+                    continue;
+                }
+                if (Peek() != close) Fail(array ? "expected ',' or ']'" : "expected ',' or '}'");
+                pos_++;
+                break;
+            }
+        }
+        out_->push_back(0x00);
+        PatchInt32(start, out_->size() - start);
+    }
+
+    // The value at pos_, appended; returns its type
+    BsonType Value(size_t depth) {
+        switch (Peek()) {
+            case '{':
+                Container(depth + 1);
+                return BsonType::DOCUMENT;
+            case '[':
+                Container(depth + 1);
+                return BsonType::ARRAY;
+            case '"': {
+                // [int32 length incl. terminator][bytes][0x00]
+                size_t at = ReserveInt32();
+                String();
+                out_->push_back(0x00);
+                PatchInt32(at, out_->size() - at - sizeof(int32_t));
+                return BsonType::STRING;
+            }
+            case 't':
+                Literal("true");
+                out_->push_back(0x01);
+                return BsonType::BOOLEAN;
+            case 'f':
+                Literal("false");
+                out_->push_back(0x00);
+                return BsonType::BOOLEAN;
+            case 'n':
+                Literal("null");
+                return BsonType::NULL_TYPE;
+            default:
+                return Number();
+        }
+    }
+
+    void Literal(std::string_view word) {
+        if (s_.substr(pos_, word.size()) != word) Fail("expected a value");
+        pos_ += word.size();
+    }
+
+    // The string at pos_, unescaped and appended without its quotes or a
+    // terminator. Runs without escapes are copied whole.
+    void String() {
+        pos_++;  // The opening quote
+        while (true) {
+            size_t run = pos_;
+            while (pos_ < s_.size()) {
+                unsigned char c = static_cast<unsigned char>(s_[pos_]);
+                if (c == '"' || c == '\\' || c < 0x20) break;
+                pos_++;
+            }
+            Append(s_.data() + run, pos_ - run);
+            if (pos_ >= s_.size()) Fail("unterminated string");
+
+            char c = s_[pos_];
+            if (c == '"') {
+                pos_++;
+                return;
+            }
+            if (c != '\\') Fail("control character in string");
+            if (++pos_ >= s_.size()) Fail("unterminated string");
+            switch (s_[pos_++]) {
+                case '"': out_->push_back('"'); break;
+                case '\\': out_->push_back('\\'); break;
+                case '/': out_->push_back('/'); break;
+                case 'b': out_->push_back('\b'); break;
+                case 'f': out_->push_back('\f'); break;
+                case 'n': out_->push_back('\n'); break;
+                case 'r': out_->push_back('\r'); break;
+                case 't': out_->push_back('\t'); break;
+                case 'u': CodePoint(); break;
+                default:
+                    pos_--;
+                    Fail("invalid escape");
+            }
+        }
+    }
+
+    uint32_t Hex4() {
+        if (pos_ + 4 > s_.size()) Fail("truncated \\u escape");
+        uint32_t v = 0;
+        for (size_t i = 0; i < 4; i++) {
+            char c = s_[pos_ + i];
+            v <<= 4;
+            if (IsDigit(c)) v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else Fail("invalid \\u escape");
+        }
+        pos_ += 4;
+        return v;
+    }
+
+    // After "\u": the code point (a surrogate pair spans two escapes), as UTF-8
+    void CodePoint() {
+        uint32_t cp = Hex4();
+        if (cp >= 0xDC00 && cp <= 0xDFFF) Fail("unpaired surrogate");
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            if (s_.substr(pos_, 2) != "\\u") Fail("unpaired surrogate");
+            pos_ += 2;
+            uint32_t low = Hex4();
+            if (low < 0xDC00 || low > 0xDFFF) Fail("unpaired surrogate");
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+
+        if (cp < 0x80) {
+            out_->push_back(static_cast<uint8_t>(cp));
+        } else if (cp < 0x800) {
+            out_->push_back(static_cast<uint8_t>(0xC0 | (cp >> 6)));
+            out_->push_back(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out_->push_back(static_cast<uint8_t>(0xE0 | (cp >> 12)));
+            out_->push_back(static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F)));
+            out_->push_back(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+        } else {
+            out_->push_back(static_cast<uint8_t>(0xF0 | (cp >> 18)));
+            out_->push_back(static_cast<uint8_t>(0x80 | ((cp >> 12) & 0x3F)));
+            out_->push_back(static_cast<uint8_t>(0x80 | ((cp >> 6) & 0x3F)));
+            out_->push_back(static_cast<uint8_t>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    // JSON's number grammar, checked here; std::from_chars converts
+    BsonType Number() {
+        size_t start = pos_;
+        bool real = false;
+        if (Peek() == '-') pos_++;
+        if (Peek() == '0') {
+            pos_++;
+        } else if (IsDigit(Peek())) {
+            while (IsDigit(Peek())) pos_++;
+        } else {
+            Fail("expected a value");
+        }
+        if (Peek() == '.') {
+            pos_++;
+            real = true;
+            if (!IsDigit(Peek())) Fail("expected a digit");
+            while (IsDigit(Peek())) pos_++;
+        }
+        if (Peek() == 'e' || Peek() == 'E') {
+            pos_++;
+            real = true;
+            if (Peek() == '+' || Peek() == '-') pos_++;
+            if (!IsDigit(Peek())) Fail("expected a digit");
+            while (IsDigit(Peek())) pos_++;
+        }
+
+        const char* first = s_.data() + start;
+        const char* last = s_.data() + pos_;
+        if (!real) {
+            int64_t v;
+            auto result = std::from_chars(first, last, v);
+            if (result.ec == std::errc() && result.ptr == last) {
+                if (v >= INT32_MIN && v <= INT32_MAX) {
+                    int32_t narrow = static_cast<int32_t>(v);
+                    Append(&narrow, sizeof(narrow));
+                    return BsonType::INT32;
+                }
+                Append(&v, sizeof(v));
+                return BsonType::INT64;
+            }
+            // Beyond INT64: kept as a double
+        }
+        double d;
+        auto result = std::from_chars(first, last, d);
+        if (result.ec != std::errc() || result.ptr != last) Fail("number out of range");
+        Append(&d, sizeof(d));
+        return BsonType::DOUBLE;
+    }
+
+    std::string_view s_;
+    size_t pos_ = 0;
+    std::vector<uint8_t>* out_;
+};
+
+// ============================================================================
+// Writer helpers
+// ============================================================================
+
+template <typename T>
+static void WriteInteger(T v, std::string* out) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), v);
+    out->append(buf, result.ptr - buf);
+}
+
+static void WriteDouble(double v, std::string* out) {
+    if (!std::isfinite(v)) {
+        out->append("null");  // JSON has no NaN or infinity
+        return;
+    }
+    char buf[32];
+    auto result = std::to_chars(buf, buf + sizeof(buf), v);
+    out->append(buf, result.ptr - buf);
+    // 3.0 would print as "3" and read back as INT32
+    if (std::find_if(buf, result.ptr, [](char c) { return c == '.' || c == 'e'; }) == result.ptr) {
+        out->append(".0");
+    }
+}
+
+static void AppendEscaped(std::string_view s, std::string* out) {
+    static const char HEX[] = "0123456789abcdef";
+    size_t run = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out->append(s.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out->append("\\\""); break;
+            case '\\': out->append("\\\\"); break;
+            case '\n': out->append("\\n"); break;
+            case '\r': out->append("\\r"); break;
+            case '\t': out->append("\\t"); break;
+            case '\b': out->append("\\b"); break;
+            case '\f': out->append("\\f"); break;
+            default:
+                out->append("\\u00");
+                out->push_back(HEX[c >> 4]);
+                out->push_back(HEX[c & 0xF]);
+        }
+    }
+    out->append(s.data() + run, s.size() - run);
+}
+
+static void WriteElement(const BsonElementView& e, std::string* out) {
+    switch (e.type) {
+        case BsonType::INT32: WriteInteger(e.AsInt32(), out); break;
+        case BsonType::INT64: WriteInteger(e.AsInt64(), out); break;
+        case BsonType::DOUBLE: WriteDouble(e.AsDouble(), out); break;
+        case BsonType::BOOLEAN: out->append(e.AsBool() ? "true" : "false"); break;
+        case BsonType::STRING: Json::WriteString(e.AsString(), out); break;
+        case BsonType::NULL_TYPE: out->append("null"); break;
+        case BsonType::DOCUMENT:
+        case BsonType::ARRAY: Json::Write(e.AsDocument(), out, e.type == BsonType::ARRAY); break;
+        default:
+            throw std::runtime_error("Cannot write BSON type " + std::to_string(static_cast<int>(e.type)) +
+                                     " as JSON");
+    }
+}
+
+// ============================================================================
+// Json
+// ============================================================================
+
+bool Json::Parse(std::string_view text, std::vector<uint8_t>* out) {
+    return JsonParser(text, out).Run();
+}
+
+BsonDocument Json::ParseDocument(std::string_view text) {
+    std::vector<uint8_t> bytes;
+    bool array = Parse(text, &bytes);
+    BsonDocument doc = BsonSerializer::Deserialize(bytes.data(), bytes.size());
+    doc.is_array = array;
+    return doc;
+}
+
+void Json::Write(const BsonView& doc, std::string* out, bool as_array) {
+    out->push_back(as_array ? '[' : '{');
+    bool first = true;
+    doc.ForEach([&](const BsonElementView& e) {
+        if (!first) out->push_back(',');
+        first = false;
+        if (!as_array) {
+            WriteString(e.key, out);
+            out->push_back(':');
+        }
+        WriteElement(e, out);
+        return true;
+    });
+    out->push_back(as_array ? ']' : '}');
+}
+
+void Json::Write(const BsonDocument& doc, std::string* out) {
+    out->push_back(doc.is_array ? '[' : '{');
+    bool first = true;
+    for (const auto& [key, val] : doc.elements) {
+        if (!first) out->push_back(',');
+        first = false;
+        if (!doc.is_array) {
+            WriteString(key, out);
+            out->push_back(':');
+        }
+        if (std::holds_alternative<std::string>(val)) {
+            WriteString(std::get<std::string>(val), out);
+        } else if (std::holds_alternative<int32_t>(val)) {
+            WriteInteger(std::get<int32_t>(val), out);
+        } else if (std::holds_alternative<int64_t>(val)) {
+            WriteInteger(std::get<int64_t>(val), out);
+        } else if (std::holds_alternative<double>(val)) {
+            WriteDouble(std::get<double>(val), out);
+        } else if (std::holds_alternative<bool>(val)) {
+            out->append(std::get<bool>(val) ? "true" : "false");
+        } else if (std::holds_alternative<std::shared_ptr<BsonDocument>>(val)) {
+            Write(*std::get<std::shared_ptr<BsonDocument>>(val), out);
+        } else {
+            out->append("null");
+        }
+    }
+    out->push_back(doc.is_array ? ']' : '}');
+}
+
+std::string Json::ToString(const BsonDocument& doc) {
+    std::string out;
+    Write(doc, &out);
+    return out;
+}
+
+void Json::WriteString(std::string_view s, std::string* out) {
+    out->push_back('"');
+    AppendEscaped(s, out);
+    out->push_back('"');
+}
+
+std::string Json::Escape(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    AppendEscaped(s, &out);
+    return out;
+}
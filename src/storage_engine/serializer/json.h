@@ -0,0 +1,52 @@
+#pragma once
+#include "storage_engine/common/bson_types.h"
+#include "storage_engine/serializer/bson_view.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ============================================================================
+// Json — JSON text to and from BSON, shared by the server and the CLI
+//
+// Parse reads the text once, left to right, writing each value's BSON as
+// it is read: a document's length and each element's type byte are
+// reserved and patched in once the value ends, so nothing is scanned
+// twice and no tree is built on the way. Numbers become INT32 when they
+// fit, else INT64, and DOUBLE with a fraction or an exponent (or beyond
+// INT64); arrays become BsonType::ARRAY keyed "0", "1", ...; null is
+// BsonType::NULL_TYPE. Malformed text, an object repeating a key
+// included, throws std::runtime_error naming the offset.
+//
+// Write goes the other way, from the bytes in place (BsonView) or from a
+// BsonDocument, appending to a string. Numbers go through std::to_chars;
+// doubles in the shortest form that reads back the same, and always with
+// a '.' or an exponent, so they read back as doubles.
+// ============================================================================
+class Json {
+public:
+    static constexpr size_t MAX_DEPTH = 100;  // Deeper nesting is refused
+
+    // Replace *out with the BSON of text, an object or an array (keyed as
+    // above). Returns whether it was an array.
+    static bool Parse(std::string_view text, std::vector<uint8_t>* out);
+
+    // Parse and decode; is_array is set for an array
+    static BsonDocument ParseDocument(std::string_view text);
+
+    // Append doc as JSON, as an array if as_array. Values stored out of
+    // line must be resolved (a view with a resolver) or fetched in first
+    // (BsonView::CopyTo).
+    static void Write(const BsonView& doc, std::string* out, bool as_array = false);
+    static void Write(const BsonDocument& doc, std::string* out);
+    static std::string ToString(const BsonDocument& doc);
+
+    // Append s as a JSON string: quoted, with '"', '\' and control
+    // characters escaped
+    static void WriteString(std::string_view s, std::string* out);
+
+    // s escaped as WriteString does, without the quotes, for replies built
+    // by hand
+    static std::string Escape(std::string_view s);
+};
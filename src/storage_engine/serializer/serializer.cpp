@@ -6,68 +6,108 @@
 // field - type|key|val strings end by null
 
 std::vector<uint8_t> BsonSerializer::Serialize(const BsonDocument& doc){
-    std::vector<uint8_t> buffer;
+    std::vector<uint8_t> buffer(SerializedSize(doc));
+    WriteDocument(buffer.data(), doc);
+    return buffer;
+}
+
+void BsonSerializer::SerializeTo(const BsonDocument& doc, std::vector<uint8_t>* out){
+    out->resize(SerializedSize(doc));
+    WriteDocument(out->data(), doc);
+}
+
+size_t BsonSerializer::SerializeInto(const BsonDocument& doc, uint8_t* dst){
+    return WriteDocument(dst, doc) - dst;
+}
+
+size_t BsonSerializer::SerializedSize(const BsonDocument& doc){
+    // size + elements + terminator
+    size_t size = sizeof(int32_t) + 1;
+
+    //type,key,val
+    for(auto& [key,value]:doc.elements){
+        size_t value_size;
+        if(std::holds_alternative<double>(value)){
+            value_size = sizeof(double);
+        }else if(std::holds_alternative<std::string>(value)){
+            value_size = sizeof(int32_t) + std::get<std::string>(value).size() + 1;
+        }else if(std::holds_alternative<int32_t>(value)){
+            value_size = sizeof(int32_t);
+        }else if(std::holds_alternative<int64_t>(value)){
+            value_size = sizeof(int64_t);
+        }else if(std::holds_alternative<bool>(value)){
+            value_size = 1;
+        }else if(std::holds_alternative<std::shared_ptr<BsonDocument>>(value)){
+            value_size = SerializedSize(*std::get<std::shared_ptr<BsonDocument>>(value));
+        }else{
+            continue;  // null is not stored
+        }
+        size += 1 + key.size() + 1 + value_size;
+    }
+    return size;
+}
 
-    // Total document size
-    AppendInt32(buffer,0);
+uint8_t* BsonSerializer::WriteDocument(uint8_t* dst, const BsonDocument& doc){
+    uint8_t* start = dst;
 
+    // Total document size, filled in at the end
+    dst += sizeof(int32_t);
 
     //type,key,val
     for(auto& [key,value]:doc.elements){
         if(std::holds_alternative<double>(value)){
 
-            buffer.push_back(static_cast<uint8_t>(BsonType::DOUBLE));
-            AppendCString(buffer,key);
-            AppendDouble(buffer,std::get<double>(value));
+            *dst++ = static_cast<uint8_t>(BsonType::DOUBLE);
+            dst = WriteCString(dst,key);
+            dst = WriteDouble(dst,std::get<double>(value));
 
         }else if(std::holds_alternative<std::string>(value)){
 
-            buffer.push_back(static_cast<uint8_t>(BsonType::STRING));
-            AppendCString(buffer,key);
-            AppendString(buffer,std::get<std::string>(value));
+            *dst++ = static_cast<uint8_t>(BsonType::STRING);
+            dst = WriteCString(dst,key);
+            dst = WriteString(dst,std::get<std::string>(value));
 
         }else if(std::holds_alternative<int32_t>(value)){
 
-            buffer.push_back(static_cast<uint8_t>(BsonType::INT32));
-            AppendCString(buffer, key);
-            AppendInt32(buffer, std::get<int32_t>(value));
+            *dst++ = static_cast<uint8_t>(BsonType::INT32);
+            dst = WriteCString(dst, key);
+            dst = WriteInt32(dst, std::get<int32_t>(value));
             
         }else if(std::holds_alternative<std::int64_t>(value)){
 
-            buffer.push_back(static_cast<uint8_t>(BsonType::INT64));
-            AppendCString(buffer, key);
-            AppendInt64(buffer, std::get<int64_t>(value));
+            *dst++ = static_cast<uint8_t>(BsonType::INT64);
+            dst = WriteCString(dst, key);
+            dst = WriteInt64(dst, std::get<int64_t>(value));
             
         }else if(std::holds_alternative<bool>(value)){
             
-            buffer.push_back(static_cast<uint8_t>(BsonType::BOOLEAN));
-            AppendCString(buffer, key);
-            buffer.push_back(std::get<bool>(value) ? 0x01 : 0x00);
+            *dst++ = static_cast<uint8_t>(BsonType::BOOLEAN);
+            dst = WriteCString(dst, key);
+            *dst++ = std::get<bool>(value) ? 0x01 : 0x00;
 
         }else if(std::holds_alternative<std::shared_ptr<BsonDocument>>(value)){
 
-            buffer.push_back(static_cast<uint8_t>(BsonType::DOCUMENT));
-            AppendCString(buffer,key);
-
-            std::vector<uint8_t> sub_doc = Serialize(*std::get<std::shared_ptr<BsonDocument>>(value));
-            buffer.insert(buffer.end(),sub_doc.begin(),sub_doc.end());
+            const BsonDocument& sub = *std::get<std::shared_ptr<BsonDocument>>(value);
+            *dst++ = static_cast<uint8_t>(sub.is_array ? BsonType::ARRAY : BsonType::DOCUMENT);
+            dst = WriteCString(dst,key);
+            dst = WriteDocument(dst, sub);
         }
     }
 
-        buffer.push_back(0x00);
-
-        // putting size again
-        int32_t total_size = static_cast<int32_t>(buffer.size());
-        std::memcpy(buffer.data(), &total_size, sizeof(int32_t));
+    *dst++ = 0x00;
 
-        return buffer;
+    // putting size again
+    int32_t total_size = static_cast<int32_t>(dst - start);
+    std::memcpy(start, &total_size, sizeof(int32_t));
+    return dst;
 }
 
 BsonDocument BsonSerializer::Deserialize(const std::vector<uint8_t>& data){
     return Deserialize(data.data(), data.size());
 }
 
-BsonDocument BsonSerializer::Deserialize(const uint8_t* data,size_t size){
+BsonDocument BsonSerializer::Deserialize(const uint8_t* data, size_t size,
+                                         const BsonExternalResolver* resolver){
     
     BsonDocument doc;
     size_t offset = 0;
@@ -86,29 +126,44 @@ BsonDocument BsonSerializer::Deserialize(const uint8_t* data,size_t size){
 
         std::string key=ReadCString(data, offset);
 
+        // Keys are unique in what Serialize wrote: append in stored order
         switch(static_cast<BsonType>(type_byte)){
             case BsonType::INT32:
-                doc.Add(key, ReadInt32(data, offset));
+                doc.elements.Append(std::move(key), ReadInt32(data, offset));
                 break;
             case BsonType::INT64:
-                doc.Add(key, ReadInt64(data, offset));
+                doc.elements.Append(std::move(key), ReadInt64(data, offset));
                 break;
             case BsonType::DOUBLE:
-                doc.Add(key, ReadDouble(data, offset));
+                doc.elements.Append(std::move(key), ReadDouble(data, offset));
                 break;
             case BsonType::STRING:
-                doc.Add(key, ReadString(data, offset));
+                doc.elements.Append(std::move(key), ReadString(data, offset));
                 break;
             case BsonType::BOOLEAN:
-                doc.Add(key, data[offset++] == 0x01);
+                doc.elements.Append(std::move(key), data[offset++] == 0x01);
                 break;
-            case BsonType::DOCUMENT: {                    
+            case BsonType::DOCUMENT:
+            case BsonType::ARRAY: {
                 int32_t sub_len;
                 std::memcpy(&sub_len, data + offset, sizeof(int32_t));
-                doc.Add(key, std::make_shared<BsonDocument>(Deserialize(data + offset, sub_len)));
+                auto sub = std::make_shared<BsonDocument>(Deserialize(data + offset, sub_len));
+                sub->is_array = static_cast<BsonType>(type_byte) == BsonType::ARRAY;
+                doc.elements.Append(std::move(key), std::move(sub));
                 offset += sub_len;
                 break;
             }
+            case BsonType::NULL_TYPE:
+                doc.elements.Append(std::move(key), nullptr);
+                break;
+            case BsonType::EXTERNAL: {
+                if(!resolver)throw std::runtime_error("Unknown BSON Type: " + std::to_string(type_byte));
+                BsonElementView pointer{BsonType::EXTERNAL, key, data + offset, BSON_EXTERNAL_SIZE};
+                BsonValue value = (*resolver)(pointer).ToValue();
+                doc.elements.Append(std::move(key), std::move(value));
+                offset += BSON_EXTERNAL_SIZE;
+                break;
+            }
             default:
                 throw std::runtime_error("Unknown BSON Type: " + std::to_string(type_byte));
         }
@@ -116,41 +171,32 @@ BsonDocument BsonSerializer::Deserialize(const uint8_t* data,size_t size){
     return doc;
 }
 
-void BsonSerializer::AppendInt32(std::vector<uint8_t> &buffer,int32_t value){
-
-    uint8_t bytes[4];
-    std::memcpy(bytes,&value,4);
-    for(int i=0;i<4;i++){
-        buffer.push_back(bytes[i]);
-    }
-
+uint8_t* BsonSerializer::WriteInt32(uint8_t* dst, int32_t value){
+    std::memcpy(dst, &value, sizeof(value));
+    return dst + sizeof(value);
 }
 
-void BsonSerializer::AppendInt64(std::vector<uint8_t>& buffer, int64_t value){
-    uint8_t bytes[8];
-    std::memcpy(bytes, &value, 8);
-    for(int i=0; i<8; i++) buffer.push_back(bytes[i]);
+uint8_t* BsonSerializer::WriteInt64(uint8_t* dst, int64_t value){
+    std::memcpy(dst, &value, sizeof(value));
+    return dst + sizeof(value);
 }
 
-void BsonSerializer::AppendDouble(std::vector<uint8_t>& buffer, double value) {
-    uint8_t bytes[8];
-    std::memcpy(bytes, &value, 8);
-    for(int i=0; i<8; i++) buffer.push_back(bytes[i]);
+uint8_t* BsonSerializer::WriteDouble(uint8_t* dst, double value) {
+    std::memcpy(dst, &value, sizeof(value));
+    return dst + sizeof(value);
 }
 
-void BsonSerializer::AppendString(std::vector<uint8_t>& buffer, const std::string& value){
+uint8_t* BsonSerializer::WriteString(uint8_t* dst, const std::string& value){
     // BSON String: int32 (length including null) + bytes + 0x00
-    AppendInt32(buffer, value.size() + 1);
-    AppendCString(buffer, value);
+    dst = WriteInt32(dst, static_cast<int32_t>(value.size() + 1));
+    return WriteCString(dst, value);
 }
 
-void BsonSerializer::AppendCString(std::vector<uint8_t>& buffer, const std::string& value) {
-    // Write characters
-    for (char c : value) {
-        buffer.push_back(static_cast<uint8_t>(c));
-    }
-    // Write Null Terminator
-    buffer.push_back(0x00);
+uint8_t* BsonSerializer::WriteCString(uint8_t* dst, const std::string& value) {
+    // Write characters, then the null terminator
+    std::memcpy(dst, value.data(), value.size());
+    dst[value.size()] = 0x00;
+    return dst + value.size() + 1;
 }
 
 
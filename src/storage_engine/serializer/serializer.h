@@ -1,22 +1,43 @@
 #pragma once
 #include "storage_engine/common/bson_types.h"
+#include "storage_engine/serializer/bson_view.h"
 #include <vector>
 #include <cstring>
 #include <stdexcept>
 
+// Serialize sizes the document first and writes it in one pass, so the
+// bytes can go straight into a caller's buffer (SerializeTo reuses its
+// capacity) or into memory reserved for them, such as a slotted-page slot
+// (SerializeInto).
 class BsonSerializer{
 public:
     static std::vector<uint8_t> Serialize(const BsonDocument& doc);
 
+    // Exact number of bytes Serialize produces for doc
+    static size_t SerializedSize(const BsonDocument& doc);
+
+    // Replace *out's contents with doc's bytes, keeping its capacity
+    static void SerializeTo(const BsonDocument& doc, std::vector<uint8_t>* out);
+
+    // Write doc's bytes to dst, which must hold SerializedSize(doc).
+    // Returns the bytes written.
+    static size_t SerializeInto(const BsonDocument& doc, uint8_t* dst);
+
     static BsonDocument Deserialize(const std::vector<uint8_t>& data);
-    static BsonDocument Deserialize(const uint8_t* data,size_t size);
+
+    // Values stored out of line (BsonType::EXTERNAL) are fetched through
+    // resolver; without one they are corrupt input
+    static BsonDocument Deserialize(const uint8_t* data, size_t size,
+                                    const BsonExternalResolver* resolver = nullptr);
 
 private:
-    static void AppendInt32(std::vector<uint8_t>& buffer, int32_t value);
-    static void AppendInt64(std::vector<uint8_t>& buffer, int64_t value);
-    static void AppendDouble(std::vector<uint8_t>& buffer, double value);
-    static void AppendString(std::vector<uint8_t>& buffer, const std::string& value);
-    static void AppendCString(std::vector<uint8_t>& buffer, const std::string& value); 
+    // Write at dst, returning the position after
+    static uint8_t* WriteInt32(uint8_t* dst, int32_t value);
+    static uint8_t* WriteInt64(uint8_t* dst, int64_t value);
+    static uint8_t* WriteDouble(uint8_t* dst, double value);
+    static uint8_t* WriteString(uint8_t* dst, const std::string& value);
+    static uint8_t* WriteCString(uint8_t* dst, const std::string& value);
+    static uint8_t* WriteDocument(uint8_t* dst, const BsonDocument& doc);
     
     static int32_t ReadInt32(const uint8_t* data, size_t& offset);
     static int64_t ReadInt64(const uint8_t* data, size_t& offset);